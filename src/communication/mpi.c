@@ -83,6 +83,7 @@ static int  Waitany(IceTCommunicator self,
                     int count, IceTCommRequest *array_of_requests);
 static int Comm_size(IceTCommunicator self);
 static int Comm_rank(IceTCommunicator self);
+static int Comm_node(IceTCommunicator self);
 
 typedef struct IceTMPICommRequestInternalsStruct {
     MPI_Request request;
@@ -212,6 +213,8 @@ IceTCommunicator icetCreateMPICommunicator(MPI_Comm mpi_comm)
     }
     MPI_Comm_dup(mpi_comm, (MPI_Comm *)comm->data);
 
+    icetCommunicatorSetNodeFunc(comm, Comm_node);
+
 #ifdef BREAK_ON_MPI_ERROR
     MPI_Errhandler_create(ErrorHandler, &eh);
     MPI_Errhandler_set(*((MPI_Comm *)comm->data), eh);
@@ -236,6 +239,7 @@ static IceTCommunicator Duplicate(IceTCommunicator self)
 
 static void Destroy(IceTCommunicator self)
 {
+    icetCommunicatorSetNodeFunc(self, NULL);
     MPI_Comm_free((MPI_Comm *)self->data);
     free(self->data);
     free(self);
@@ -468,3 +472,25 @@ static int Comm_rank(IceTCommunicator self)
     MPI_Comm_rank(MPI_COMM, &rank);
     return rank;
 }
+
+static int Comm_node(IceTCommunicator self)
+{
+#if MPI_VERSION >= 3
+    MPI_Comm node_comm;
+    int rank;
+    int node;
+
+    /* Identify the node by the smallest rank among the processes that can
+       share memory with this one. */
+    MPI_Comm_rank(MPI_COMM, &rank);
+    MPI_Comm_split_type(MPI_COMM, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                        &node_comm);
+    MPI_Allreduce(&rank, &node, 1, MPI_INT, MPI_MIN, node_comm);
+    MPI_Comm_free(&node_comm);
+    return node;
+#else
+    /* Before MPI 3 there is no portable way to find the processes on the
+       same node, so treat every process as its own node. */
+    return Comm_rank(self);
+#endif
+}
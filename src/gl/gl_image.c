@@ -101,6 +101,21 @@ void icetGLDrawCallbackFunction(const IceTDouble *projection_matrix,
                          GL_FLOAT,
                          colorBuffer + 4*(  readback_viewport[0]
                                           + width*readback_viewport[1]));
+        } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+#ifdef GL_HALF_FLOAT
+            IceTUShort *colorBuffer = icetImageGetColorus(result);
+            glReadPixels((GLint)x_offset,
+                         (GLint)y_offset,
+                         (GLsizei)readback_viewport[2],
+                         (GLsizei)readback_viewport[3],
+                         GL_RGBA,
+                         GL_HALF_FLOAT,
+                         colorBuffer + 4*(  readback_viewport[0]
+                                          + width*readback_viewport[1]));
+#else
+            icetRaiseError("This OpenGL cannot read half float colors.",
+                           ICET_INVALID_OPERATION);
+#endif
         } else if (color_format != ICET_IMAGE_COLOR_NONE) {
             icetRaiseError("Invalid color format.", ICET_SANITY_CHECK_FAIL);
         }
@@ -115,6 +130,16 @@ void icetGLDrawCallbackFunction(const IceTDouble *projection_matrix,
                          GL_FLOAT,
                          depthBuffer + (  readback_viewport[0]
                                         + width*readback_viewport[1]));
+        } else if (depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+            IceTUShort *depthBuffer = icetImageGetDepthus(result);
+            glReadPixels((GLint)x_offset,
+                         (GLint)y_offset,
+                         (GLsizei)readback_viewport[2],
+                         (GLsizei)readback_viewport[3],
+                         GL_DEPTH_COMPONENT,
+                         GL_UNSIGNED_SHORT,
+                         depthBuffer + (  readback_viewport[0]
+                                        + width*readback_viewport[1]));
         } else if (depth_format != ICET_IMAGE_DEPTH_NONE) {
             icetRaiseError("Invalid depth format.", ICET_SANITY_CHECK_FAIL);
         }
@@ -0,0 +1,325 @@
+/* -*- c -*- *******************************************************/
+/*
+ * Copyright (C) 2011 Sandia Corporation
+ * Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+ * the U.S. Government retains certain rights in this software.
+ *
+ * This source code is released under the New BSD License.
+ */
+
+/* This is not a traditional header file, but rather a "macro" file that defines
+ * a template for a compressed-compressed composite function.  The pixels are
+ * handled in spans of colors and depths, so each image may have either the
+ * interleaved or the planar layout.  For images without color or depth,
+ * CCC_COLOR_SIZE or CCC_DEPTH_SIZE is 0.
+ *
+ * Where the active runs of the two images do not overlap, whole runs of one
+ * image are copied to the destination, run lengths and all, without looking
+ * at the pixels.  Two images with disjoint active regions are composited by
+ * concatenating a few blocks of their data.
+ *
+ * The following macros must be defined:
+ *      CCC_FRONT_COMPRESSED_IMAGE - compressed image to blend in front.
+ *      CCC_BACK_COMPRESSED_IMAGE - compressed image to blend in back.
+ *      CCC_DEST_COMPRESSED_IMAGE - the resulting compressed image buffer.
+ *      CCC_COMPOSITE_SPAN(front_span, back_span, dest_span, count) - given
+ *              pointers to IceTPixelSpan structures for the three buffers,
+ *              composite count pixels.
+ *      CCC_COLOR_SIZE - the number of bytes required to store the color of
+ *              one pixel.
+ *      CCC_DEPTH_SIZE - the number of bytes required to store the depth of
+ *              one pixel.
+ *
+ * All of the above macros are undefined at the end of this file.
+ */
+
+#ifndef ICET_IMAGE_DATA
+#error Need ICET_IMAGE_DATA macro.  Is this included in image.c?
+#endif
+#ifndef GET_INACTIVE_RUN_LENGTH
+#error Need GET_INACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#endif
+#ifndef SET_ACTIVE_RUN_LENGTH
+#error Need SET_ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#endif
+#ifndef SEEK_INDEX_ADD_RUN
+#error Need SEEK_INDEX_ADD_RUN macro.  Is this included in image.c?
+#endif
+#ifndef MAX_ACTIVE_RUN_LENGTH_OF
+#error Need MAX_ACTIVE_RUN_LENGTH_OF macro.  Is this included in image.c?
+#endif
+
+#define CCC_MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* Loads run lengths from an input image until it has active pixels (or the
+   image ends) and points its span at the active pixels. */
+#define CCC_LOAD_RUN(image)                                             \
+    while(   (image##_num_active == 0)                                  \
+          && ((image##_num_inactive + _pixel) < _num_pixels) ) {        \
+        image##_num_inactive                                            \
+            += GET_INACTIVE_RUN_LENGTH(image##_next, image##_compact);  \
+        image##_num_active                                              \
+            = GET_ACTIVE_RUN_LENGTH(image##_next, image##_compact);     \
+        image##_span.color                                              \
+            = (IceTByte *)image##_next + RUN_LENGTH_SIZE_OF(image##_compact);\
+        if (image##_planar) {                                           \
+            image##_span.depth                                          \
+                = image##_span.color + image##_num_active*CCC_COLOR_SIZE;\
+        } else {                                                        \
+            image##_span.depth = image##_span.color + CCC_COLOR_SIZE;   \
+        }                                                               \
+        image##_next = (  image##_span.color                            \
+                        + image##_num_active*_pixel_size );             \
+    }
+
+/* If image is at the start of a run (recorded in image##_runs before it was
+   loaded) and other stays inactive at least to the end of that run, copies
+   all the runs of image that end before other becomes active directly to the
+   destination and goes to the next iteration.  This requires the run lengths
+   and layout of image to match those of the destination. */
+#define CCC_COPY_RUNS(image, other)                                     \
+    if (   (image##_runs != NULL)                                       \
+        && image##_copy_runs                                            \
+        && (  GET_INACTIVE_RUN_LENGTH(image##_runs, image##_compact)    \
+            + GET_ACTIVE_RUN_LENGTH(image##_runs, image##_compact)      \
+            <= other##_num_inactive) ) {                                \
+        IceTSizeType _num_copied;                                       \
+        CCC_CLOSE_DEST_RUN();                                           \
+        _dest_runlengths = NULL;                                        \
+        _num_copied = icetSparseImageCopyRuns(&image##_runs,            \
+                                              &_dest,                   \
+                                              other##_num_inactive,     \
+                                              image##_compact,          \
+                                              _pixel_size,              \
+                                              &_dest_index,             \
+                                              _pixel);                  \
+        image##_next = image##_runs;                                    \
+        image##_num_inactive = image##_num_active = 0;                  \
+        other##_num_inactive -= _num_copied;                            \
+        _pixel += _num_copied;                                          \
+        continue;                                                       \
+    }
+
+/* Moves a span past count pixels. */
+#define CCC_ADVANCE_SPAN(span, count)                                   \
+    (span).color += (count)*(span).color_stride;                        \
+    (span).depth += (count)*(span).depth_stride;
+
+{
+    const IceTByte *_front_next;
+    const IceTByte *_back_next;
+    const IceTByte *_front_runs;
+    const IceTByte *_back_runs;
+    IceTPixelSpan _front_span;
+    IceTPixelSpan _back_span;
+    IceTPixelSpan _dest_span;
+    /* Use IceTByte for byte-based pointer arithmetic. */
+    IceTByte *_dest;
+    IceTVoid *_dest_runlengths;
+    IceTSizeType _num_pixels;
+    IceTSizeType _pixel;
+    IceTSizeType _pixel_size = CCC_COLOR_SIZE + CCC_DEPTH_SIZE;
+    IceTSizeType _front_num_inactive;
+    IceTSizeType _front_num_active;
+    IceTSizeType _back_num_inactive;
+    IceTSizeType _back_num_active;
+    IceTSizeType _dest_num_active;
+    IceTSeekIndexBuilder _dest_index;
+    IceTBoolean _front_compact
+        = ICET_SPARSE_IMAGE_COMPACT(CCC_FRONT_COMPRESSED_IMAGE);
+    IceTBoolean _back_compact
+        = ICET_SPARSE_IMAGE_COMPACT(CCC_BACK_COMPRESSED_IMAGE);
+    IceTBoolean _dest_compact
+        = ICET_SPARSE_IMAGE_COMPACT(CCC_DEST_COMPRESSED_IMAGE);
+    IceTBoolean _front_planar
+        = ICET_SPARSE_IMAGE_PLANAR(CCC_FRONT_COMPRESSED_IMAGE);
+    IceTBoolean _back_planar
+        = ICET_SPARSE_IMAGE_PLANAR(CCC_BACK_COMPRESSED_IMAGE);
+    IceTBoolean _dest_planar
+        = ICET_SPARSE_IMAGE_PLANAR(CCC_DEST_COMPRESSED_IMAGE);
+    IceTBoolean _front_copy_runs
+        = (_front_compact == _dest_compact) && (_front_planar == _dest_planar);
+    IceTBoolean _back_copy_runs
+        = (_back_compact == _dest_compact) && (_back_planar == _dest_planar);
+    IceTSizeType _dest_run_length_size = RUN_LENGTH_SIZE_OF(_dest_compact);
+    IceTSizeType _dest_max_run_length
+        = MAX_ACTIVE_RUN_LENGTH_OF(_dest_compact, _dest_planar);
+    /* The depths of a planar run being written go here until the run is
+       closed and they can be placed after the colors. */
+    IceTByte _dest_depths[MAX_PLANAR_RUN_LENGTH*MAX_PLANAR_DEPTH_SIZE];
+
+    _num_pixels = icetSparseImageGetNumPixels(CCC_FRONT_COMPRESSED_IMAGE);
+    if (_num_pixels != icetSparseImageGetNumPixels(CCC_BACK_COMPRESSED_IMAGE)) {
+        icetRaiseError("Input buffers do not agree for compressed-compressed"
+                       " composite.",
+                       ICET_SANITY_CHECK_FAIL);
+    }
+    icetSparseImageSetDimensions(
+                           CCC_DEST_COMPRESSED_IMAGE,
+                           icetSparseImageGetWidth(CCC_FRONT_COMPRESSED_IMAGE),
+                           icetSparseImageGetHeight(CCC_BACK_COMPRESSED_IMAGE));
+
+    _front_next = ICET_IMAGE_DATA(CCC_FRONT_COMPRESSED_IMAGE);
+    _back_next = ICET_IMAGE_DATA(CCC_BACK_COMPRESSED_IMAGE);
+    _dest = ICET_IMAGE_DATA(CCC_DEST_COMPRESSED_IMAGE);
+    _dest_runlengths = NULL;
+    icetSeekIndexBegin(CCC_DEST_COMPRESSED_IMAGE, &_dest_index);
+
+    _front_span.color = _front_span.depth = NULL;
+    _front_span.color_stride
+        = _front_planar ? CCC_COLOR_SIZE : _pixel_size;
+    _front_span.depth_stride
+        = _front_planar ? CCC_DEPTH_SIZE : _pixel_size;
+    _back_span.color = _back_span.depth = NULL;
+    _back_span.color_stride
+        = _back_planar ? CCC_COLOR_SIZE : _pixel_size;
+    _back_span.depth_stride
+        = _back_planar ? CCC_DEPTH_SIZE : _pixel_size;
+    _dest_span.color_stride
+        = _dest_planar ? CCC_COLOR_SIZE : _pixel_size;
+    _dest_span.depth_stride
+        = _dest_planar ? CCC_DEPTH_SIZE : _pixel_size;
+
+/* Closes the current destination run (if any) with its active pixels. */
+#define CCC_CLOSE_DEST_RUN()                                            \
+    if (_dest_runlengths != NULL) {                                     \
+        SET_ACTIVE_RUN_LENGTH(_dest_runlengths,                         \
+                              _dest_compact,                            \
+                              _dest_num_active);                        \
+        if (_dest_planar) {                                             \
+            memcpy(_dest, _dest_depths, _dest_num_active*CCC_DEPTH_SIZE);\
+            _dest += _dest_num_active*CCC_DEPTH_SIZE;                   \
+        }                                                               \
+        _dest_num_active = 0;                                           \
+    }
+
+/* Points _dest_span at the next active pixel to write. */
+#define CCC_DEST_SPAN()                                                 \
+    _dest_span.color = _dest;                                           \
+    _dest_span.depth = (  _dest_planar                                  \
+                        ? _dest_depths + _dest_num_active*CCC_DEPTH_SIZE\
+                        : _dest + CCC_COLOR_SIZE );
+
+/* Moves _dest past count active pixels just written. */
+#define CCC_ADVANCE_DEST(count)                                         \
+    _dest += (count)*_dest_span.color_stride;                           \
+    _dest_num_active += (count);
+
+    _pixel = 0;
+    _front_num_inactive = _front_num_active = 0;
+    _back_num_inactive = _back_num_active = 0;
+    _dest_num_active = 0;
+    while (_pixel < _num_pixels) {
+        _front_runs
+            = (((_front_num_inactive == 0) && (_front_num_active == 0))
+               ? _front_next : NULL);
+        _back_runs
+            = (((_back_num_inactive == 0) && (_back_num_active == 0))
+               ? _back_next : NULL);
+        CCC_LOAD_RUN(_front);
+        CCC_LOAD_RUN(_back);
+
+        CCC_COPY_RUNS(_front, _back);
+        CCC_COPY_RUNS(_back, _front);
+
+        {
+            IceTSizeType _dest_num_inactive
+                = CCC_MIN(_front_num_inactive, _back_num_inactive);
+            if (_dest_num_inactive > 0) {
+                /* Handle inactive pixel region. */
+                CCC_CLOSE_DEST_RUN();
+                SEEK_INDEX_ADD_RUN(&_dest_index, _dest, _pixel);
+                _dest_runlengths = icetSparseImageStartRun(_dest,
+                                                           _dest_num_inactive,
+                                                           _dest_compact);
+                _dest = (IceTByte *)_dest_runlengths + _dest_run_length_size;
+                _pixel += _dest_num_inactive;
+                _front_num_inactive -= _dest_num_inactive;
+                _back_num_inactive -= _dest_num_inactive;
+            } else if (   (_dest_runlengths == NULL)
+                       || (_dest_num_active >= _dest_max_run_length) ) {
+                /* Handle special case where first pixel is active or the
+                 * active pixels no longer fit in the current run.  Either
+                 * way, start a run with no inactive pixels. */
+                CCC_CLOSE_DEST_RUN();
+                SEEK_INDEX_ADD_RUN(&_dest_index, _dest, _pixel);
+                _dest_runlengths = icetSparseImageStartRun(_dest,
+                                                           0,
+                                                           _dest_compact);
+                _dest = (IceTByte *)_dest_runlengths + _dest_run_length_size;
+            }
+        }
+
+        /* At this point, either the front or back (or both) have no inactive
+           pixels. */
+
+        if ((0 < _front_num_inactive) && (0 < _back_num_active)) {
+            IceTSizeType _num_to_copy
+                = CCC_MIN(CCC_MIN(_front_num_inactive, _back_num_active),
+                          _dest_max_run_length - _dest_num_active);
+            CCC_DEST_SPAN();
+            icetCopyPixelSpan(&_back_span, &_dest_span,
+                              CCC_COLOR_SIZE, CCC_DEPTH_SIZE,
+                              _num_to_copy);
+            CCC_ADVANCE_SPAN(_back_span, _num_to_copy);
+            CCC_ADVANCE_DEST(_num_to_copy);
+            _front_num_inactive -= _num_to_copy;
+            _back_num_active -= _num_to_copy;
+            _pixel += _num_to_copy;
+        }
+
+        if ((0 < _back_num_inactive) && (0 < _front_num_active)) {
+            IceTSizeType _num_to_copy
+                = CCC_MIN(CCC_MIN(_back_num_inactive, _front_num_active),
+                          _dest_max_run_length - _dest_num_active);
+            CCC_DEST_SPAN();
+            icetCopyPixelSpan(&_front_span, &_dest_span,
+                              CCC_COLOR_SIZE, CCC_DEPTH_SIZE,
+                              _num_to_copy);
+            CCC_ADVANCE_SPAN(_front_span, _num_to_copy);
+            CCC_ADVANCE_DEST(_num_to_copy);
+            _back_num_inactive -= _num_to_copy;
+            _front_num_active -= _num_to_copy;
+            _pixel += _num_to_copy;
+        }
+
+        if ((_front_num_inactive == 0) && (_back_num_inactive == 0)) {
+            IceTSizeType _num_to_composite
+                = CCC_MIN(CCC_MIN(_front_num_active, _back_num_active),
+                          _dest_max_run_length - _dest_num_active);
+            CCC_DEST_SPAN();
+            CCC_COMPOSITE_SPAN(&_front_span, &_back_span, &_dest_span,
+                               _num_to_composite);
+            CCC_ADVANCE_SPAN(_front_span, _num_to_composite);
+            CCC_ADVANCE_SPAN(_back_span, _num_to_composite);
+            CCC_ADVANCE_DEST(_num_to_composite);
+            _front_num_active -= _num_to_composite;
+            _back_num_active -= _num_to_composite;
+            _pixel += _num_to_composite;
+        }
+    }
+
+    CCC_CLOSE_DEST_RUN();
+
+    if (_pixel != _num_pixels) {
+        icetRaiseError("Corrupt compressed image.", ICET_INVALID_VALUE);
+    }
+
+    icetSparseImageSetActualSize(CCC_DEST_COMPRESSED_IMAGE, _dest);
+    icetSeekIndexEnd(&_dest_index);
+}
+
+#undef CCC_LOAD_RUN
+#undef CCC_COPY_RUNS
+#undef CCC_ADVANCE_SPAN
+#undef CCC_CLOSE_DEST_RUN
+#undef CCC_DEST_SPAN
+#undef CCC_ADVANCE_DEST
+#undef CCC_MIN
+
+#undef CCC_FRONT_COMPRESSED_IMAGE
+#undef CCC_BACK_COMPRESSED_IMAGE
+#undef CCC_DEST_COMPRESSED_IMAGE
+#undef CCC_COMPOSITE_SPAN
+#undef CCC_COLOR_SIZE
+#undef CCC_DEPTH_SIZE
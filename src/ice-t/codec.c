@@ -0,0 +1,249 @@
+/* -*- c -*- *******************************************************/
+/*
+ * Copyright (C) 2011 Sandia Corporation
+ * Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+ * the U.S. Government retains certain rights in this software.
+ *
+ * This source code is released under the New BSD License.
+ */
+
+#include <IceTDevCodec.h>
+
+#include <string.h>
+
+/* The encoding follows the LZ4 block format.  Each sequence starts with a
+   token byte.  The high nibble of the token is the number of literal bytes
+   and the low nibble is the match length minus MIN_MATCH.  A nibble of 15
+   means more length follows in bytes of 255 ending with a byte less than
+   255.  After the literals comes the 2-byte little endian match offset.  The
+   last sequence has only literals.  As in LZ4, the last LAST_LITERALS bytes
+   are always literals and no match starts in the last MATCH_LIMIT bytes. */
+#define MIN_MATCH       4
+#define MAX_OFFSET      0xFFFF
+#define LAST_LITERALS   5
+#define MATCH_LIMIT     12
+#define RUN_MASK        15
+
+#define HASH_LOG        12
+#define HASH_SIZE       (1 << HASH_LOG)
+
+/* When no match is found for a while, start skipping ahead faster.  Data
+   that does not compress is passed through quickly this way. */
+#define SKIP_TRIGGER    6
+
+static IceTUInt icetCodecRead32(const IceTUByte *p)
+{
+    IceTUInt value;
+    memcpy(&value, p, sizeof(IceTUInt));
+    return value;
+}
+
+static IceTUInt icetCodecHash(IceTUInt sequence)
+{
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Writes a length continuation (the part of the length not held in the token
+   nibble).  Returns the new output position or NULL if out of room. */
+static IceTUByte *icetCodecWriteLength(IceTUByte *op,
+                                       const IceTUByte *op_end,
+                                       IceTSizeType length)
+{
+    while (length >= 255) {
+        if (op >= op_end) return NULL;
+        *(op++) = 255;
+        length -= 255;
+    }
+    if (op >= op_end) return NULL;
+    *(op++) = (IceTUByte)length;
+    return op;
+}
+
+/* Writes one sequence of literals followed by a match.  If match_length is 0,
+   only literals are written (the last sequence).  Returns the new output
+   position or NULL if out of room. */
+static IceTUByte *icetCodecWriteSequence(IceTUByte *op,
+                                         const IceTUByte *op_end,
+                                         const IceTUByte *literals,
+                                         IceTSizeType num_literals,
+                                         IceTSizeType offset,
+                                         IceTSizeType match_length)
+{
+    IceTUByte *token;
+    IceTSizeType match_code = match_length - MIN_MATCH;
+
+    if (op >= op_end) return NULL;
+    token = op++;
+
+    if (num_literals >= RUN_MASK) {
+        *token = RUN_MASK << 4;
+        op = icetCodecWriteLength(op, op_end, num_literals - RUN_MASK);
+        if (op == NULL) return NULL;
+    } else {
+        *token = (IceTUByte)(num_literals << 4);
+    }
+
+    if (num_literals > op_end - op) return NULL;
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    if (match_length == 0) return op;
+
+    if (op_end - op < 2) return NULL;
+    *(op++) = (IceTUByte)(offset & 0xFF);
+    *(op++) = (IceTUByte)(offset >> 8);
+
+    if (match_code >= RUN_MASK) {
+        *token |= RUN_MASK;
+        op = icetCodecWriteLength(op, op_end, match_code - RUN_MASK);
+    } else {
+        *token |= (IceTUByte)match_code;
+    }
+
+    return op;
+}
+
+IceTSizeType icetCodecEncode(const IceTVoid *input,
+                             IceTSizeType input_size,
+                             IceTVoid *output,
+                             IceTSizeType max_output_size)
+{
+    const IceTUByte *in = input;
+    IceTUByte *out = output;
+    const IceTUByte *op_end = out + max_output_size;
+    IceTUByte *op = out;
+    /* Positions are stored plus one so that zero means empty. */
+    IceTSizeType hash_table[HASH_SIZE];
+    IceTSizeType anchor = 0;
+    IceTSizeType ip = 0;
+    IceTSizeType match_start_limit = input_size - MATCH_LIMIT;
+    IceTSizeType match_end_limit = input_size - LAST_LITERALS;
+    IceTSizeType search_count = 1 << SKIP_TRIGGER;
+
+    memset(hash_table, 0, sizeof(hash_table));
+
+    while (ip < match_start_limit) {
+        IceTUInt sequence = icetCodecRead32(in + ip);
+        IceTUInt hash = icetCodecHash(sequence);
+        IceTSizeType ref = hash_table[hash] - 1;
+        IceTSizeType match_length;
+
+        hash_table[hash] = ip + 1;
+        if (   (ref < 0)
+            || (ip - ref > MAX_OFFSET)
+            || (icetCodecRead32(in + ref) != sequence) ) {
+            ip += search_count++ >> SKIP_TRIGGER;
+            continue;
+        }
+
+        /* Extend the match backward over pending literals and forward. */
+        while ((ip > anchor) && (ref > 0) && (in[ip-1] == in[ref-1])) {
+            ip--;
+            ref--;
+        }
+        match_length = MIN_MATCH;
+        while (   (ip + match_length < match_end_limit)
+               && (in[ip + match_length] == in[ref + match_length]) ) {
+            match_length++;
+        }
+
+        op = icetCodecWriteSequence(op, op_end,
+                                    in + anchor, ip - anchor,
+                                    ip - ref, match_length);
+        if (op == NULL) return 0;
+
+        ip += match_length;
+        anchor = ip;
+        search_count = 1 << SKIP_TRIGGER;
+    }
+
+    op = icetCodecWriteSequence(op, op_end,
+                                in + anchor, input_size - anchor,
+                                0, 0);
+    if (op == NULL) return 0;
+
+    return (IceTSizeType)(op - out);
+}
+
+/* Reads a length continuation.  Returns -1 if the input runs out. */
+static IceTSizeType icetCodecReadLength(const IceTUByte **ip_p,
+                                        const IceTUByte *ip_end)
+{
+    const IceTUByte *ip = *ip_p;
+    IceTSizeType length = 0;
+    IceTUByte b;
+
+    do {
+        if (ip >= ip_end) return -1;
+        b = *(ip++);
+        length += b;
+    } while (b == 255);
+
+    *ip_p = ip;
+    return length;
+}
+
+IceTSizeType icetCodecDecode(const IceTVoid *input,
+                             IceTSizeType input_size,
+                             IceTVoid *output,
+                             IceTSizeType max_output_size)
+{
+    const IceTUByte *ip = input;
+    const IceTUByte *ip_end = ip + input_size;
+    IceTUByte *out = output;
+    IceTUByte *op = out;
+    const IceTUByte *op_end = out + max_output_size;
+
+    while (ip < ip_end) {
+        IceTUByte token = *(ip++);
+        IceTSizeType num_literals = token >> 4;
+        IceTSizeType match_length;
+        IceTSizeType offset;
+        const IceTUByte *match;
+
+        if (num_literals == RUN_MASK) {
+            IceTSizeType more = icetCodecReadLength(&ip, ip_end);
+            if (more < 0) return -1;
+            num_literals += more;
+        }
+        if (   (num_literals > ip_end - ip)
+            || (num_literals > op_end - op) ) {
+            return -1;
+        }
+        memcpy(op, ip, num_literals);
+        ip += num_literals;
+        op += num_literals;
+
+        /* The last sequence has no match. */
+        if (ip >= ip_end) break;
+
+        if (ip_end - ip < 2) return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > op - out)) return -1;
+
+        match_length = token & RUN_MASK;
+        if (match_length == RUN_MASK) {
+            IceTSizeType more = icetCodecReadLength(&ip, ip_end);
+            if (more < 0) return -1;
+            match_length += more;
+        }
+        match_length += MIN_MATCH;
+        if (match_length > op_end - op) return -1;
+
+        /* Matches may overlap their own output (a repeating pattern), so
+           copy forward one byte at a time unless there is no overlap. */
+        match = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            IceTSizeType i;
+            for (i = 0; i < match_length; i++) {
+                *(op++) = *(match++);
+            }
+        }
+    }
+
+    return (IceTSizeType)(op - out);
+}
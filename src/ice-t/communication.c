@@ -14,6 +14,8 @@
 #include <IceTDevDiagnostics.h>
 #include <IceTDevPorting.h>
 
+#include <stdlib.h>
+
 #define icetAddSentBytes(num_sending)                                   \
     icetStateSetInteger(ICET_BYTES_SENT,                                \
                         icetUnsafeStateGetInteger(ICET_BYTES_SENT)[0]   \
@@ -28,6 +30,64 @@
                          ICET_INVALID_VALUE);                           \
     }
 
+/* The node functions given to icetCommunicatorSetNodeFunc.  They are kept
+   here rather than in IceTCommunicatorStruct so that communicators written
+   before there were node functions keep working unchanged. */
+typedef struct IceTCommNodeFuncEntryStruct {
+    IceTCommunicator comm;
+    IceTCommNodeFunc node_func;
+    struct IceTCommNodeFuncEntryStruct *next;
+} *IceTCommNodeFuncEntry;
+
+static IceTCommNodeFuncEntry icet_comm_node_funcs = NULL;
+
+void icetCommunicatorSetNodeFunc(IceTCommunicator comm,
+                                 IceTCommNodeFunc node_func)
+{
+    IceTCommNodeFuncEntry *entry_p;
+    IceTCommNodeFuncEntry entry;
+
+    for (entry_p = &icet_comm_node_funcs;
+         *entry_p != NULL;
+         entry_p = &(*entry_p)->next) {
+        if ((*entry_p)->comm == comm) { break; }
+    }
+
+    entry = *entry_p;
+    if (entry != NULL) {
+        if (node_func != NULL) {
+            entry->node_func = node_func;
+        } else {
+            *entry_p = entry->next;
+            free(entry);
+        }
+        return;
+    }
+
+    if (node_func == NULL) { return; }
+
+    entry = malloc(sizeof(struct IceTCommNodeFuncEntryStruct));
+    if (entry == NULL) {
+        icetRaiseError("Could not allocate memory for node function.",
+                       ICET_OUT_OF_MEMORY);
+        return;
+    }
+    entry->comm = comm;
+    entry->node_func = node_func;
+    entry->next = icet_comm_node_funcs;
+    icet_comm_node_funcs = entry;
+}
+
+IceTCommNodeFunc icetCommunicatorGetNodeFunc(IceTCommunicator comm)
+{
+    IceTCommNodeFuncEntry entry;
+
+    for (entry = icet_comm_node_funcs; entry != NULL; entry = entry->next) {
+        if (entry->comm == comm) { return entry->node_func; }
+    }
+    return NULL;
+}
+
 IceTCommunicator icetCommDuplicate()
 {
     IceTCommunicator comm = icetGetCommunicator();
@@ -213,6 +273,17 @@ int icetCommRank()
     return comm->Comm_rank(comm);
 }
 
+int icetCommNode()
+{
+    IceTCommunicator comm = icetGetCommunicator();
+    IceTCommNodeFunc node_func = icetCommunicatorGetNodeFunc(comm);
+    if (node_func == NULL) {
+        /* Communicator cannot tell.  Treat each process as its own node. */
+        return comm->Comm_rank(comm);
+    }
+    return node_func(comm);
+}
+
 
 int icetFindRankInGroup(const int *group,
                         IceTSizeType group_size,
@@ -36,6 +36,28 @@
  *              pixels in memory.  If defined, then REGION_OFFSET_X,
  *              REGION_OFFSET_Y, REGION_WIDTH, and REGION_HEIGHT must also be
  *              defined.
+ *      INTERLACE - If defined, pixels are taken from a list of segments of
+ *              the image, which lets an image be compressed in a different
+ *              order than the pixels lie in memory.  INTERLACE must be
+ *              defined to an array of IceTSizeType holding three entries per
+ *              segment: the offset of the segment in the input, the number of
+ *              pixels in it, and how far the input has to jump from the end
+ *              of the segment to get to the next one.  The segments may not be
+ *              empty, and the array must end with an extra entry.  Not
+ *              compatible with REGION or OFFSET.
+ *      INTERLACE_GAPS - If defined, inactive pixels are placed between the
+ *              segments of INTERLACE, which lets the segments be taken from
+ *              the rendered region of a tile without the padding around it.
+ *              INTERLACE_GAPS must be defined to an array of IceTSizeType
+ *              holding the number of inactive pixels before each segment and
+ *              one more entry for the inactive pixels after the last segment.
+ *              PIXEL_COUNT must be defined to the number of pixels in the
+ *              segments (not counting the gaps).  Not compatible with
+ *              PADDING.
+ *      NO_TIMING - If defined, the compression is not timed and the
+ *              compression ratio is not reported.  This is used when
+ *              compressing pieces of an image in parallel, in which case the
+ *              caller times the whole operation.
  *
  * All of the above macros are undefined at the end of this file.
  */
@@ -61,6 +83,46 @@
 #endif
 #endif
 
+#ifdef INTERLACE
+#ifdef OFFSET
+#error INTERLACE and OFFSET are incompatible
+#elif defined(REGION)
+#error INTERLACE and REGION are incompatible
+#else
+#define OFFSET ((INTERLACE)[0])
+#endif
+#endif
+
+/* Both REGION and INTERLACE read the input in rows.  At the end of each row,
+   the input jumps _region_x_skip pixels to the start of the next. */
+#if defined(REGION) || defined(INTERLACE)
+#define REGION_ROWS
+#endif
+#ifdef INTERLACE
+#define NEXT_REGION_ROW()                                               \
+    _region_count = 0;                                                  \
+    _interlace_segment += 3;                                            \
+    _region_width = _interlace_segment[1];                              \
+    _region_x_skip = _interlace_segment[2]
+#else
+#define NEXT_REGION_ROW()       _region_count = 0
+#endif
+
+#ifdef INTERLACE_GAPS
+#ifndef INTERLACE
+#error INTERLACE_GAPS requires INTERLACE
+#endif
+#ifdef PADDING
+#error INTERLACE_GAPS and PADDING are incompatible
+#endif
+#define CT_GAPS                         (INTERLACE_GAPS)
+#define CT_SEGMENT_SIZE(segment)        ((INTERLACE)[3*(segment) + 1])
+#endif
+
+#ifdef NO_TIMING
+#define CT_NO_TIMING
+#endif
+
 {
     IceTEnum _color_format, _depth_format;
     IceTSizeType _pixel_count;
@@ -70,6 +132,11 @@
     IceTSizeType _region_width = REGION_WIDTH;
     IceTSizeType _region_x_skip = _input_width - (REGION_WIDTH);
 #endif
+#ifdef INTERLACE
+    const IceTSizeType *_interlace_segment = (INTERLACE);
+    IceTSizeType _region_width = _interlace_segment[1];
+    IceTSizeType _region_x_skip = _interlace_segment[2];
+#endif
 
     icetGetEnumv(ICET_COMPOSITE_MODE, &_composite_mode);
 
@@ -85,9 +152,11 @@
 #endif
 
 #ifdef DEBUG
-    if (   (icetSparseImageGetColorFormat(OUTPUT_SPARSE_IMAGE) != _color_format)
-        || (icetSparseImageGetDepthFormat(OUTPUT_SPARSE_IMAGE) != _depth_format)
-           ) {
+    if (   (_composite_mode != ICET_COMPOSITE_MODE_FRAGMENTS)
+        && (   (   icetSparseImageGetColorFormat(OUTPUT_SPARSE_IMAGE)
+                != _color_format)
+            || (   icetSparseImageGetDepthFormat(OUTPUT_SPARSE_IMAGE)
+                != _depth_format) ) ) {
         icetRaiseError("Format of input and output to compress do not match.",
                        ICET_SANITY_CHECK_FAIL);
     }
@@ -99,6 +168,21 @@
         icetRaiseError("Size of input and output to compress do not match.",
                        ICET_SANITY_CHECK_FAIL);
     }
+#elif defined(INTERLACE_GAPS)
+    {
+        IceTSizeType _gap_pixels = 0;
+        IceTSizeType _segment = 0;
+        while (CT_SEGMENT_SIZE(_segment) > 0) {
+            _gap_pixels += CT_GAPS[_segment];
+            _segment++;
+        }
+        _gap_pixels += CT_GAPS[_segment];
+        if (   icetSparseImageGetNumPixels(OUTPUT_SPARSE_IMAGE)
+            != _pixel_count + _gap_pixels) {
+            icetRaiseError("Size of input and output to compress do not match.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+    }
 #else /*PADDING*/
     if (icetSparseImageGetNumPixels(OUTPUT_SPARSE_IMAGE) != _pixel_count) {
         icetRaiseError("Size of input and output to compress do not match.",
@@ -126,7 +210,7 @@
                 const IceTUInt *_color;
                 IceTUInt *_c_out;
                 IceTFloat *_d_out;
-#ifdef REGION
+#ifdef REGION_ROWS
                 IceTSizeType _region_count = 0;
 #endif
                 _color = icetImageGetColorui(INPUT_IMAGE);
@@ -144,17 +228,30 @@
                                 _d_out = (IceTFloat *)dest;     \
                                 _d_out[0] = _depth[0];          \
                                 dest += sizeof(IceTFloat);
-#ifdef REGION
+#ifdef REGION_ROWS
 #define CT_INCREMENT_PIXEL()    _color++;  _depth++;                    \
                                 _region_count++;                        \
                                 if (_region_count >= _region_width) {   \
                                     _color += _region_x_skip;           \
                                     _depth += _region_x_skip;           \
-                                    _region_count = 0;                  \
+                                    NEXT_REGION_ROW();                  \
                                 }
 #else
 #define CT_INCREMENT_PIXEL()    _color++;  _depth++;
 #endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthf(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += (num);  _depth += (num);      \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _region_x_skip;           \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += (num);  _depth += (num);
+#endif
 #ifdef PADDING
 #define CT_PADDING
 #define CT_SPACE_BOTTOM         SPACE_BOTTOM
@@ -168,7 +265,7 @@
             } else if (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
                 const IceTFloat *_color;
                 IceTFloat *_out;
-#ifdef REGION
+#ifdef REGION_ROWS
                 IceTSizeType _region_count = 0;
 #endif
                 _color = icetImageGetColorf(INPUT_IMAGE);
@@ -187,17 +284,84 @@
                                 _out[3] = _color[3];            \
                                 _out[4] = _depth[0];            \
                                 dest += 5*sizeof(IceTFloat);
-#ifdef REGION
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;                 \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthf(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);    \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                const IceTUShort *_color;
+                IceTFloat *_d_out;
+#ifdef REGION_ROWS
+                IceTSizeType _region_count = 0;
+#endif
+                _color = icetImageGetColorus(INPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             (_depth[0] < 1.0)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, 4*sizeof(IceTUShort)); \
+                                dest += 4*sizeof(IceTUShort);   \
+                                _d_out = (IceTFloat *)dest;     \
+                                _d_out[0] = _depth[0];          \
+                                dest += sizeof(IceTFloat);
+#ifdef REGION_ROWS
 #define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;                 \
                                 _region_count++;                        \
                                 if (_region_count >= _region_width) {   \
                                     _color += 4*_region_x_skip;         \
                                     _depth += _region_x_skip;           \
-                                    _region_count = 0;                  \
+                                    NEXT_REGION_ROW();                  \
                                 }
 #else
 #define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;
 #endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthf(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);    \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);
+#endif
 #ifdef PADDING
 #define CT_PADDING
 #define CT_SPACE_BOTTOM         SPACE_BOTTOM
@@ -210,7 +374,7 @@
 #include "compress_template_body.h"
             } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
                 IceTFloat *_out;
-#ifdef REGION
+#ifdef REGION_ROWS
                 IceTSizeType _region_count = 0;
 #endif
 #define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
@@ -221,16 +385,247 @@
 #define CT_WRITE_PIXEL(dest)    _out = (IceTFloat *)dest;       \
                                 _out[0] = _depth[0];            \
                                 dest += 1*sizeof(IceTFloat);
-#ifdef REGION
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _depth++;                               \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _depth++;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthf(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _depth += (num);                        \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _depth += (num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+            } else {
+                icetRaiseError("Encountered invalid color format.",
+                               ICET_SANITY_CHECK_FAIL);
+            }
+        } else if (_depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+          /* Use Z buffer for active pixel testing.  The pixels in the sparse
+             image are not necessarily 4-byte aligned, so color is copied with
+             memcpy. */
+            const IceTUShort *_depth = icetImageGetDepthus(INPUT_IMAGE);
+#ifdef OFFSET
+            _depth += OFFSET;
+#endif
+            if (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                const IceTUInt *_color;
+                IceTUShort *_d_out;
+#ifdef REGION_ROWS
+                IceTSizeType _region_count = 0;
+#endif
+                _color = icetImageGetColorui(INPUT_IMAGE);
+#ifdef OFFSET
+                _color += OFFSET;
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             (_depth[0] != ICET_UNORM16_FAR_DEPTH)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, sizeof(IceTUInt)); \
+                                dest += sizeof(IceTUInt);       \
+                                _d_out = (IceTUShort *)dest;    \
+                                _d_out[0] = _depth[0];          \
+                                dest += sizeof(IceTUShort);
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color++;  _depth++;                    \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _region_x_skip;           \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color++;  _depth++;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthus(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += (num);  _depth += (num);      \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _region_x_skip;           \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += (num);  _depth += (num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                const IceTFloat *_color;
+                IceTUShort *_d_out;
+#ifdef REGION_ROWS
+                IceTSizeType _region_count = 0;
+#endif
+                _color = icetImageGetColorf(INPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             (_depth[0] != ICET_UNORM16_FAR_DEPTH)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, 4*sizeof(IceTFloat)); \
+                                dest += 4*sizeof(IceTFloat);    \
+                                _d_out = (IceTUShort *)dest;    \
+                                _d_out[0] = _depth[0];          \
+                                dest += sizeof(IceTUShort);
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;                 \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthus(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);    \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                const IceTUShort *_color;
+                IceTUShort *_d_out;
+#ifdef REGION_ROWS
+                IceTSizeType _region_count = 0;
+#endif
+                _color = icetImageGetColorus(INPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             (_depth[0] != ICET_UNORM16_FAR_DEPTH)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, 4*sizeof(IceTUShort)); \
+                                dest += 4*sizeof(IceTUShort);   \
+                                _d_out = (IceTUShort *)dest;    \
+                                _d_out[0] = _depth[0];          \
+                                dest += sizeof(IceTUShort);
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;                 \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += 4;  _depth++;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthus(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);    \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);  _depth += (num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+            } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
+                IceTUShort *_out;
+#ifdef REGION_ROWS
+                IceTSizeType _region_count = 0;
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             (_depth[0] != ICET_UNORM16_FAR_DEPTH)
+#define CT_WRITE_PIXEL(dest)    _out = (IceTUShort *)dest;      \
+                                _out[0] = _depth[0];            \
+                                dest += 1*sizeof(IceTUShort);
+#ifdef REGION_ROWS
 #define CT_INCREMENT_PIXEL()    _depth++;                               \
                                 _region_count++;                        \
                                 if (_region_count >= _region_width) {   \
                                     _depth += _region_x_skip;           \
-                                    _region_count = 0;                  \
+                                    NEXT_REGION_ROW();                  \
                                 }
 #else
 #define CT_INCREMENT_PIXEL()    _depth++;
 #endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveDepthus(_depth, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _depth += (num);                        \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _depth += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _depth += (num);
+#endif
 #ifdef PADDING
 #define CT_PADDING
 #define CT_SPACE_BOTTOM         SPACE_BOTTOM
@@ -262,7 +657,7 @@
         if (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
             const IceTUInt *_color;
             IceTUInt *_out;
-#ifdef REGION
+#ifdef REGION_ROWS
             IceTSizeType _region_count = 0;
 #endif
             _color = icetImageGetColorui(INPUT_IMAGE);
@@ -277,16 +672,28 @@
 #define CT_WRITE_PIXEL(dest)    _out = (IceTUInt *)dest;        \
                                 _out[0] = _color[0];            \
                                 dest += sizeof(IceTUInt);
-#ifdef REGION
+#ifdef REGION_ROWS
 #define CT_INCREMENT_PIXEL()    _color++;                               \
                                 _region_count++;                        \
                                 if (_region_count >= _region_width) {   \
                                     _color += _region_x_skip;           \
-                                    _region_count = 0;                  \
+                                    NEXT_REGION_ROW();                  \
                                 }
 #else
 #define CT_INCREMENT_PIXEL()    _color++;
 #endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveColorub(_color, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += (num);                        \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _region_x_skip;           \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += (num);
+#endif
 #ifdef PADDING
 #define CT_PADDING
 #define CT_SPACE_BOTTOM         SPACE_BOTTOM
@@ -300,7 +707,7 @@
         } else if (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
             const IceTFloat *_color;
             IceTFloat *_out;
-#ifdef REGION
+#ifdef REGION_ROWS
             IceTSizeType _region_count = 0;
 #endif
             _color = icetImageGetColorf(INPUT_IMAGE);
@@ -318,16 +725,76 @@
                                 _out[2] = _color[2];            \
                                 _out[3] = _color[3];            \
                                 dest += 4*sizeof(IceTUInt);
-#ifdef REGION
+#ifdef REGION_ROWS
 #define CT_INCREMENT_PIXEL()    _color += 4;                            \
                                 _region_count++;                        \
                                 if (_region_count >= _region_width) {   \
                                     _color += 4*_region_x_skip;         \
-                                    _region_count = 0;                  \
+                                    NEXT_REGION_ROW();                  \
                                 }
 #else
 #define CT_INCREMENT_PIXEL()    _color += 4;
 #endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveColorf(_color, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);                      \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+        } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+            const IceTUShort *_color;
+#ifdef REGION_ROWS
+            IceTSizeType _region_count = 0;
+#endif
+            _color = icetImageGetColorus(INPUT_IMAGE);
+#ifdef OFFSET
+            _color += 4*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()             ((_color[3] & 0x7FFF) != 0)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, 4*sizeof(IceTUShort)); \
+                                dest += 4*sizeof(IceTUShort);
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += 4;                            \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += 4;
+#endif
+#define CT_FIND_ACTIVE(num)     icetScanInactiveColorus(_color, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);                      \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += 4*_region_x_skip;         \
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += 4*(num);
+#endif
 #ifdef PADDING
 #define CT_PADDING
 #define CT_SPACE_BOTTOM         SPACE_BOTTOM
@@ -339,28 +806,181 @@
 #endif
 #include "compress_template_body.h"
         } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
-            IceTUInt *_out;
             icetRaiseWarning("Compressing image with no data.",
                              ICET_INVALID_OPERATION);
-            _out = ICET_IMAGE_DATA(OUTPUT_SPARSE_IMAGE);
-            INACTIVE_RUN_LENGTH(_out) = _pixel_count;
-            ACTIVE_RUN_LENGTH(_out) = 0;
-            _out++;
-            icetSparseImageSetActualSize(OUTPUT_SPARSE_IMAGE, _out);
+            icetClearSparseImage(OUTPUT_SPARSE_IMAGE);
         } else {
             icetRaiseError("Encountered invalid color format.",
                            ICET_SANITY_CHECK_FAIL);
         }
+    } else if (   (_composite_mode == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+               || (_composite_mode == ICET_COMPOSITE_MODE_ADD) ) {
+      /* A pixel is active if any of its channels is not zero. */
+        if (_depth_format != ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseWarning("Z buffer ignored during channel compress"
+                             " operation.  Output z buffer meaningless.",
+                             ICET_INVALID_VALUE);
+        }
+        if (   (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE)
+            || (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT)
+            || (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) ) {
+            IceTSizeType _in_color_size = colorPixelSize(_color_format);
+            const IceTByte *_color;
+#ifdef REGION_ROWS
+            IceTSizeType _region_count = 0;
+#endif
+            _color = icetImageGetColorConstVoid(INPUT_IMAGE, NULL);
+#ifdef OFFSET
+            _color += _in_color_size*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _color_format
+#define CT_DEPTH_FORMAT         _depth_format
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()                                                     \
+                        (icetScanChannelColor(_color, _color_format,    \
+                                              _in_color_size, 1,        \
+                                              ICET_TRUE) == 1)
+#define CT_WRITE_PIXEL(dest)    memcpy(dest, _color, _in_color_size);   \
+                                dest += _in_color_size;
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += _in_color_size;               \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _in_color_size*_region_x_skip;\
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += _in_color_size;
+#endif
+#define CT_FIND_ACTIVE(num)                                             \
+                        icetScanChannelColor(_color, _color_format,     \
+                                             _in_color_size, num,       \
+                                             ICET_FALSE)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += _in_color_size*(num);         \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _in_color_size*_region_x_skip;\
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += _in_color_size*(num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+        } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
+            icetRaiseWarning("Compressing image with no data.",
+                             ICET_INVALID_OPERATION);
+            icetClearSparseImage(OUTPUT_SPARSE_IMAGE);
+        } else {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+    } else if (_composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+      /* Use alpha for active pixel testing.  Each active pixel becomes the
+         first fragment of its sparse pixel, tagged with its depth. */
+        IceTEnum _sparse_format
+            = icetSparseImageGetColorFormat(OUTPUT_SPARSE_IMAGE);
+        if (   !ICET_IMAGE_COLOR_IS_FRAGMENTS(_sparse_format)
+            || (   icetSparseImageGetDepthFormat(OUTPUT_SPARSE_IMAGE)
+                != ICET_IMAGE_DEPTH_NONE) ) {
+            icetRaiseError("Output of fragment compress does not hold"
+                           " fragments.", ICET_SANITY_CHECK_FAIL);
+        } else if (_depth_format == ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseError("Cannot use fragment compression with no"
+                           " Z buffer.", ICET_INVALID_OPERATION);
+        } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
+            icetRaiseError("Cannot use fragment compression with no"
+                           " color buffer.", ICET_INVALID_OPERATION);
+        } else {
+            IceTInt _num_fragments
+                = ICET_IMAGE_COLOR_FRAGMENT_COUNT(_sparse_format);
+            IceTSizeType _in_color_size = colorPixelSize(_color_format);
+            IceTSizeType _in_depth_size = depthPixelSize(_depth_format);
+            const IceTByte *_color;
+            const IceTByte *_depth;
+#ifdef REGION_ROWS
+            IceTSizeType _region_count = 0;
+#endif
+            _color = icetImageGetColorConstVoid(INPUT_IMAGE, NULL);
+            _depth = icetImageGetDepthConstVoid(INPUT_IMAGE, NULL);
+#ifdef OFFSET
+            _color += _in_color_size*(OFFSET);
+            _depth += _in_depth_size*(OFFSET);
+#endif
+#define CT_COMPRESSED_IMAGE     OUTPUT_SPARSE_IMAGE
+#define CT_COLOR_FORMAT         _sparse_format
+#define CT_DEPTH_FORMAT         ICET_IMAGE_DEPTH_NONE
+#define CT_PIXEL_COUNT          _pixel_count
+#define CT_ACTIVE()                                                     \
+                        (icetScanInactiveColor(_color, _color_format, 1) == 0)
+#define CT_WRITE_PIXEL(dest)    icetFragmentsFromPixel(_color, _color_format, \
+                                                       _depth, _depth_format, \
+                                                       _num_fragments,  \
+                                                       dest);           \
+                                dest += 5*sizeof(IceTFloat)*_num_fragments;
+#ifdef REGION_ROWS
+#define CT_INCREMENT_PIXEL()    _color += _in_color_size;               \
+                                _depth += _in_depth_size;               \
+                                _region_count++;                        \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _in_color_size*_region_x_skip;\
+                                    _depth += _in_depth_size*_region_x_skip;\
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_INCREMENT_PIXEL()    _color += _in_color_size;               \
+                                _depth += _in_depth_size;
+#endif
+#define CT_FIND_ACTIVE(num)                                             \
+                        icetScanInactiveColor(_color, _color_format, num)
+#ifdef REGION_ROWS
+#define CT_CONTIGUOUS_PIXELS()  (_region_width - _region_count)
+#define CT_SKIP_PIXELS(num)     _color += _in_color_size*(num);         \
+                                _depth += _in_depth_size*(num);         \
+                                _region_count += (num);                 \
+                                if (_region_count >= _region_width) {   \
+                                    _color += _in_color_size*_region_x_skip;\
+                                    _depth += _in_depth_size*_region_x_skip;\
+                                    NEXT_REGION_ROW();                  \
+                                }
+#else
+#define CT_SKIP_PIXELS(num)     _color += _in_color_size*(num);         \
+                                _depth += _in_depth_size*(num);
+#endif
+#ifdef PADDING
+#define CT_PADDING
+#define CT_SPACE_BOTTOM         SPACE_BOTTOM
+#define CT_SPACE_TOP            SPACE_TOP
+#define CT_SPACE_LEFT           SPACE_LEFT
+#define CT_SPACE_RIGHT          SPACE_RIGHT
+#define CT_FULL_WIDTH           FULL_WIDTH
+#define CT_FULL_HEIGHT          FULL_HEIGHT
+#endif
+#include "compress_template_body.h"
+        }
     } else {
         icetRaiseError("Encountered invalid composite mode.",
                        ICET_SANITY_CHECK_FAIL);
     }
 
+#ifndef NO_TIMING
     icetRaiseDebug1("Compression: %f%%\n",
         100.0f - (  100.0f*icetSparseImageGetCompressedBufferSize(OUTPUT_SPARSE_IMAGE)
                   / icetImageBufferSizeType(_color_format, _depth_format,
                                             icetSparseImageGetWidth(OUTPUT_SPARSE_IMAGE),
                                             icetSparseImageGetHeight(OUTPUT_SPARSE_IMAGE)) ));
+#endif
 }
 
 #undef INPUT_IMAGE
@@ -384,6 +1004,19 @@
 #undef REGION_HEIGHT
 #endif
 
+#ifdef INTERLACE
+#undef INTERLACE
+#endif
+
+#ifdef INTERLACE_GAPS
+#undef INTERLACE_GAPS
+#undef CT_GAPS
+#undef CT_SEGMENT_SIZE
+#endif
+
+#undef REGION_ROWS
+#undef NEXT_REGION_ROW
+
 #ifdef OFFSET
 #undef OFFSET
 #endif
@@ -391,3 +1024,8 @@
 #ifdef PIXEL_COUNT
 #undef PIXEL_COUNT
 #endif
+
+#ifdef NO_TIMING
+#undef NO_TIMING
+#undef CT_NO_TIMING
+#endif
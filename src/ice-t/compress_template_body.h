@@ -32,8 +32,31 @@
  *              around the file.  If defined, then CT_SPACE_BOTTOM,
  *              CT_SPACE_TOP, CT_SPACE_LEFT, CT_SPACE_RIGHT, CT_FULL_WIDTH,
  *              and CT_FULL_HEIGHT must all also be defined.
+ *      CT_FIND_ACTIVE(num) - If defined, returns the number of inactive pixels
+ *              starting at the current pixel, looking at no more than num
+ *              pixels.  This allows long runs of inactive pixels to be
+ *              skipped in bulk rather than testing one pixel at a time.  If
+ *              defined, then CT_SKIP_PIXELS must also be defined.
+ *      CT_SKIP_PIXELS(num) - Advances the input num pixels.  The pixels
+ *              skipped will never span more than CT_CONTIGUOUS_PIXELS().
+ *      CT_CONTIGUOUS_PIXELS() - If defined, the number of pixels starting at
+ *              the current pixel that are contiguous in memory.  Used when the
+ *              input pixels are not stored contiguously (such as a region of
+ *              a larger image).
+ *      CT_NO_TIMING - If defined, the compression is not timed with
+ *              icetTimingCompressBegin/End.  The caller is expected to time
+ *              the operation.  Unlike the other macros, this one is not
+ *              undefined at the end of this file.
+ *      CT_GAPS - If defined, an array of the number of inactive pixels to
+ *              place before each segment of the input and (in the last entry)
+ *              after the last segment.  The input pixels that are counted in
+ *              CT_PIXEL_COUNT are split into segments of CT_SEGMENT_SIZE(i)
+ *              pixels, which must also be defined.  Not compatible with
+ *              CT_PADDING.  Like CT_NO_TIMING, these are not undefined at the
+ *              end of this file.
  *
- * All of the above macros are undefined at the end of this file.
+ * All of the above macros (except CT_NO_TIMING, CT_GAPS, and CT_SEGMENT_SIZE)
+ * are undefined at the end of this file.
  */
 
 #ifndef CT_COMPRESSED_IMAGE
@@ -51,14 +74,20 @@
 #ifndef ICET_IMAGE_DATA
 #error Need ICET_IMAGE_DATA macro.  Is this included in image.c?
 #endif
-#ifndef INACTIVE_RUN_LENGTH
-#error Need INACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#ifndef SET_ACTIVE_RUN_LENGTH
+#error Need SET_ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
 #endif
-#ifndef ACTIVE_RUN_LENGTH
-#error Need ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#ifndef RUN_LENGTH_SIZE_OF
+#error Need RUN_LENGTH_SIZE_OF macro.  Is this included in image.c?
 #endif
-#ifndef RUN_LENGTH_SIZE
-#error Need RUN_LENGTH_SIZE macro.  Is this included in image.c?
+#ifndef MAX_ACTIVE_RUN_LENGTH_OF
+#error Need MAX_ACTIVE_RUN_LENGTH_OF macro.  Is this included in image.c?
+#endif
+#ifndef SEEK_INDEX_ADD_RUN
+#error Need SEEK_INDEX_ADD_RUN macro.  Is this included in image.c?
+#endif
+#if defined(CT_GAPS) && defined(CT_PADDING)
+#error CT_GAPS and CT_PADDING are incompatible
 #endif
 
 #ifdef _MSC_VER
@@ -66,20 +95,104 @@
 #pragma warning(disable:4127)
 #endif
 
+#ifdef CT_FIND_ACTIVE
+#ifdef CT_CONTIGUOUS_PIXELS
+#define CT_SKIP_LIMIT(remaining)        MIN(remaining, CT_CONTIGUOUS_PIXELS())
+#else
+#define CT_SKIP_LIMIT(remaining)        (remaining)
+#endif
+#define CT_SKIP_INACTIVE(position, end)                                 \
+    while (position < end) {                                            \
+        IceTSizeType _limit = CT_SKIP_LIMIT(end - position);            \
+        IceTSizeType _run = CT_FIND_ACTIVE(_limit);                     \
+        CT_SKIP_PIXELS(_run);                                           \
+        position += _run;                                               \
+        _count += _run;                                                 \
+        if (_run < _limit) break;                                       \
+    }
+#else /*CT_FIND_ACTIVE*/
+#define CT_SKIP_INACTIVE(position, end)                                 \
+    while ((position < end) && (!CT_ACTIVE())) {                        \
+        position++;                                                     \
+        _count++;                                                       \
+        CT_INCREMENT_PIXEL();                                           \
+    }
+#endif /*CT_FIND_ACTIVE*/
+
 {
   IceTByte *_dest;  /* Use IceTByte for byte-based pointer arithmetic. */
     IceTSizeType _pixels = CT_PIXEL_COUNT;
     IceTSizeType _p;
     IceTSizeType _count;
-#ifdef DEBUG
+    /* Pixels in the runs written so far. */
     IceTSizeType _totalcount = 0;
-#endif
+    IceTSeekIndexBuilder _seek_index;
     IceTSizeType _compressed_size;
+    IceTBoolean _compact = ICET_SPARSE_IMAGE_COMPACT(CT_COMPRESSED_IMAGE);
+    IceTBoolean _planar = ICET_SPARSE_IMAGE_PLANAR(CT_COMPRESSED_IMAGE);
+    IceTSizeType _run_length_size = RUN_LENGTH_SIZE_OF(_compact);
+    IceTSizeType _max_run_length = MAX_ACTIVE_RUN_LENGTH_OF(_compact, _planar);
+    IceTSizeType _color_size = colorPixelSize(CT_COLOR_FORMAT);
+    IceTSizeType _depth_size = depthPixelSize(CT_DEPTH_FORMAT);
 
+#ifndef CT_NO_TIMING
     icetTimingCompressBegin();
+#endif
 
     _dest = ICET_IMAGE_DATA(CT_COMPRESSED_IMAGE);
+    icetSeekIndexBegin(CT_COMPRESSED_IMAGE, &_seek_index);
+
+#ifdef CT_GAPS
+    {
+        IceTSizeType _segment = 0;
 
+        _count = CT_GAPS[0];
+        _p = 0;
+        while (_p < _pixels) {
+            IceTSizeType _gap_end = _p;
+          /* Segments with no gap between them are compressed as one. */
+            do {
+                _gap_end += CT_SEGMENT_SIZE(_segment);
+                _segment++;
+            } while ((_gap_end < _pixels) && (CT_GAPS[_segment] == 0));
+            while (ICET_TRUE) {
+                IceTVoid *_runlengths;
+                IceTSizeType _active_end;
+                CT_SKIP_INACTIVE(_p, _gap_end);
+                if (_p >= _gap_end) break;
+                SEEK_INDEX_ADD_RUN(&_seek_index, _dest, _totalcount);
+                _runlengths = icetSparseImageStartRun(_dest, _count, _compact);
+                _dest = (IceTByte *)_runlengths + _run_length_size;
+                _totalcount += _count;
+                _count = 0;
+                _active_end = _p + MIN(_gap_end - _p, _max_run_length);
+                while ((_p < _active_end) && CT_ACTIVE()) {
+                    CT_WRITE_PIXEL(_dest);
+                    CT_INCREMENT_PIXEL();
+                    _count++;
+                    _p++;
+                }
+                SET_ACTIVE_RUN_LENGTH(_runlengths, _compact, _count);
+                if (_planar) {
+                    icetSparseImagePlanarizeRun(
+                                  (IceTByte *)_runlengths + _run_length_size,
+                                  _count, _color_size, _depth_size);
+                }
+                _totalcount += _count;
+                _count = 0;
+            }
+            _count += CT_GAPS[_segment];
+        }
+
+        if (_count > 0) {
+            _dest = (  (IceTByte *)icetSparseImageStartRun(_dest,
+                                                           _count,
+                                                           _compact)
+                     + _run_length_size );
+            _totalcount += _count;
+        }
+    }
+#else /*CT_GAPS*/
 #ifndef CT_PADDING
     _count = 0;
 #else /* CT_PADDING */
@@ -94,29 +207,30 @@
             _count += CT_SPACE_LEFT;
             while (ICET_TRUE) {
                 IceTVoid *_runlengths;
-                while ((_x < _lastx) && (!CT_ACTIVE())) {
-                    _x++;
-                    _count++;
-                    CT_INCREMENT_PIXEL();
-                }
+                IceTSizeType _active_end;
+                CT_SKIP_INACTIVE(_x, _lastx);
                 if (_x >= _lastx) break;
-                _runlengths = _dest;
-                _dest += RUN_LENGTH_SIZE;
-                INACTIVE_RUN_LENGTH(_runlengths) = _count;
-#ifdef DEBUG
+                SEEK_INDEX_ADD_RUN(&_seek_index, _dest, _totalcount);
+                _runlengths = icetSparseImageStartRun(_dest, _count, _compact);
+                _dest = (IceTByte *)_runlengths + _run_length_size;
                 _totalcount += _count;
-#endif
                 _count = 0;
-                while ((_x < _lastx) && CT_ACTIVE()) {
+                _active_end = _x + MIN(_lastx - _x, _max_run_length);
+                while ((_x < _active_end) && CT_ACTIVE()) {
                     CT_WRITE_PIXEL(_dest);
                     CT_INCREMENT_PIXEL();
                     _count++;
                     _x++;
                 }
-                ACTIVE_RUN_LENGTH(_runlengths) = _count;
-#ifdef DEBUG
+                SET_ACTIVE_RUN_LENGTH(_runlengths, _compact, _count);
+              /* Pixels are written interleaved and then split into colors
+                 and depths for the planar layout. */
+                if (_planar) {
+                    icetSparseImagePlanarizeRun(
+                                  (IceTByte *)_runlengths + _run_length_size,
+                                  _count, _color_size, _depth_size);
+                }
                 _totalcount += _count;
-#endif
                 _count = 0;
                 if (_x >= _lastx) break;
             }
@@ -128,31 +242,35 @@
 
         _p = 0;
         while (_p < _pixels) {
-            IceTVoid *_runlengths = _dest;
-            _dest += RUN_LENGTH_SIZE;
+            IceTVoid *_runlengths;
+            IceTSizeType _active_end;
           /* Count background pixels. */
-            while ((_p < _pixels) && (!CT_ACTIVE())) {
-                _p++;
-                _count++;
-                CT_INCREMENT_PIXEL();
-            }
-            INACTIVE_RUN_LENGTH(_runlengths) = _count;
-#ifdef DEBUG
-            _totalcount += _count;
+            CT_SKIP_INACTIVE(_p, _pixels);
+#ifdef CT_PADDING
+          /* Trailing background pixels are joined with the padding on top. */
+            if (_p >= _pixels) break;
 #endif
+            SEEK_INDEX_ADD_RUN(&_seek_index, _dest, _totalcount);
+            _runlengths = icetSparseImageStartRun(_dest, _count, _compact);
+            _dest = (IceTByte *)_runlengths + _run_length_size;
+            _totalcount += _count;
 
           /* Count and store active pixels. */
             _count = 0;
-            while ((_p < _pixels) && CT_ACTIVE()) {
+            _active_end = _p + MIN(_pixels - _p, _max_run_length);
+            while ((_p < _active_end) && CT_ACTIVE()) {
                 CT_WRITE_PIXEL(_dest);
                 CT_INCREMENT_PIXEL();
                 _count++;
                 _p++;
             }
-            ACTIVE_RUN_LENGTH(_runlengths) = _count;
-#ifdef DEBUG
+            SET_ACTIVE_RUN_LENGTH(_runlengths, _compact, _count);
+            if (_planar) {
+                icetSparseImagePlanarizeRun(
+                                  (IceTByte *)_runlengths + _run_length_size,
+                                  _count, _color_size, _depth_size);
+            }
             _totalcount += _count;
-#endif
 
             _count = 0;
         }
@@ -161,16 +279,24 @@
 
     _count += CT_SPACE_TOP*CT_FULL_WIDTH;
     if (_count > 0) {
-        INACTIVE_RUN_LENGTH(_dest) = _count;
-        ACTIVE_RUN_LENGTH(_dest) = 0;
-        _dest += RUN_LENGTH_SIZE;
-#ifdef DEBUG
+        _dest = (  (IceTByte *)icetSparseImageStartRun(_dest, _count, _compact)
+                 + _run_length_size );
         _totalcount += _count;
-#endif /*DEBUG*/
     }
 #endif /*CT_PADDING*/
+#endif /*CT_GAPS*/
 
 #ifdef DEBUG
+#ifdef CT_GAPS
+    {
+        IceTSizeType _segment = 0;
+        while (CT_SEGMENT_SIZE(_segment) > 0) {
+            _totalcount -= CT_GAPS[_segment];
+            _segment++;
+        }
+        _totalcount -= CT_GAPS[_segment];
+    }
+#endif /*CT_GAPS*/
 #ifdef CT_PADDING
     _totalcount -= (CT_FULL_WIDTH)*(CT_SPACE_TOP+CT_SPACE_BOTTOM);
     _totalcount -= (  (CT_FULL_HEIGHT-(CT_SPACE_TOP+CT_SPACE_BOTTOM))
@@ -184,7 +310,9 @@
     }
 #endif /*DEBUG*/
 
+#ifndef CT_NO_TIMING
     icetTimingCompressEnd();
+#endif
 
     _compressed_size
         = (IceTSizeType)
@@ -192,6 +320,7 @@
              - (IceTPointerArithmetic)ICET_IMAGE_HEADER(CT_COMPRESSED_IMAGE));
     ICET_IMAGE_HEADER(CT_COMPRESSED_IMAGE)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
       = (IceTInt)_compressed_size;
+    icetSeekIndexEnd(&_seek_index);
 }
 
 #ifdef _MSC_VER
@@ -206,6 +335,17 @@
 #undef CT_WRITE_PIXEL
 #undef CT_INCREMENT_PIXEL
 #undef COMPRESSED_SIZE
+#undef CT_SKIP_INACTIVE
+
+#ifdef CT_FIND_ACTIVE
+#undef CT_FIND_ACTIVE
+#undef CT_SKIP_PIXELS
+#undef CT_SKIP_LIMIT
+#endif
+
+#ifdef CT_CONTIGUOUS_PIXELS
+#undef CT_CONTIGUOUS_PIXELS
+#endif
 
 #ifdef CT_PADDING
 #undef CT_PADDING
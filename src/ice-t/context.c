@@ -11,6 +11,7 @@
 
 #include <IceT.h>
 
+#include <IceTDevCommunication.h>
 #include <IceTDevDiagnostics.h>
 #include <IceTDevImage.h>
 
@@ -40,6 +41,10 @@ IceTContext icetCreateContext(IceTCommunicator comm)
     context->magic_number = CONTEXT_MAGIC_NUMBER;
 
     context->communicator = comm->Duplicate(comm);
+    if (icetCommunicatorGetNodeFunc(comm) != NULL) {
+        icetCommunicatorSetNodeFunc(context->communicator,
+                                    icetCommunicatorGetNodeFunc(comm));
+    }
 
     context->state = icetStateCreate();
 
@@ -84,6 +89,7 @@ void icetDestroyContext(IceTContext context)
     icetStateDestroy(context->state);
     context->state = NULL;
 
+    icetCommunicatorSetNodeFunc(context->communicator, NULL);
     context->communicator->Destroy(context->communicator);
 
   /* The context is now completely destroyed and now null.  Restore saved
@@ -27,13 +27,22 @@
  *              onto which to composite the data from the INPUT_SPARSE_IMAGE.
  *              (It is more efficient to do both operations simultaneously.)
  *              If defined, the following also need to be defined:
- *              BLEND_RGBA_UBYTE(src, dest) - blend the incoming color from
- *                      the compressed image (src) to the data value in the
- *                      output image (dest).  Store the result in dest.  Both
- *                      src and dest are IceTUByte arrays representing the RGBA
- *                      values.
+ *              BLEND_RGBA_UBYTE(src, dest, count) - blend count incoming
+ *                      colors from the compressed image (src) to the data
+ *                      values in the output image (dest).  Store the result in
+ *                      dest.  Both src and dest are IceTUByte arrays
+ *                      representing the RGBA values.
  *              BLEND_RGBA_FLOAT(src, dest) - same as above except src and dest
- *                      are IceTFloat arrays.
+ *                      are IceTFloat arrays holding a single pixel.
+ *              BLEND_RGBA_HALF(src, dest) - same as above except src and dest
+ *                      are IceTUShort arrays of half floats.
+ *      CORRECT_BACKGROUND - if defined (and COMPOSITE is not), blended
+ *              colors are placed over the true background color of the frame
+ *              (ICET_TRUE_BACKGROUND_COLOR) as they are written, and inactive
+ *              pixels get that color.  This does in passing what
+ *              icetDrawFrame otherwise does to the final image with
+ *              ICET_CORRECT_COLORED_BACKGROUND.  Z-buffer compositing is not
+ *              affected.
  *      OFFSET - If defined to a number (or variable holding a number), skips
  *              that many pixels at the beginning of the image.
  *      PIXEL_COUNT - If defined to a number (or a variable holding a number),
@@ -57,6 +66,39 @@
 #error Need ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
 #endif
 
+/* Reads a span of pixels in the planar layout into the output image at the
+   current _color and _depth. */
+#ifdef COMPOSITE
+#define READ_SPAN(span, count, color_size, depth_size, z_composite_span)  \
+    {                                                                   \
+        IceTPixelSpan _out_span;                                        \
+        _out_span.color = (IceTByte *)_color;                           \
+        _out_span.depth = (IceTByte *)_depth;                           \
+        _out_span.color_stride = (color_size);                          \
+        _out_span.depth_stride = (depth_size);                          \
+        z_composite_span(span, &_out_span, &_out_span, count);          \
+    }
+#else
+#define READ_SPAN(span, count, color_size, depth_size, z_composite_span)  \
+    {                                                                   \
+        IceTPixelSpan _out_span;                                        \
+        _out_span.color = (IceTByte *)_color;                           \
+        _out_span.depth = (IceTByte *)_depth;                           \
+        _out_span.color_stride = (color_size);                          \
+        _out_span.depth_stride = (depth_size);                          \
+        icetCopyPixelSpan(span, &_out_span, color_size, depth_size, count);\
+    }
+#endif
+
+/* The background color given to inactive pixels when blending. */
+#if defined(CORRECT_BACKGROUND) && !defined(COMPOSITE)
+#define BLEND_BACKGROUND_COLOR          ICET_TRUE_BACKGROUND_COLOR
+#define BLEND_BACKGROUND_COLOR_WORD     ICET_TRUE_BACKGROUND_COLOR_WORD
+#else
+#define BLEND_BACKGROUND_COLOR          ICET_BACKGROUND_COLOR
+#define BLEND_BACKGROUND_COLOR_WORD     ICET_BACKGROUND_COLOR_WORD
+#endif
+
 {
     IceTEnum _color_format, _depth_format;
     IceTSizeType _pixel_count;
@@ -72,8 +114,10 @@
     _depth_format = icetSparseImageGetDepthFormat(INPUT_SPARSE_IMAGE);
     _pixel_count = icetSparseImageGetNumPixels(INPUT_SPARSE_IMAGE);
 
-    if (   (_color_format != icetImageGetColorFormat(OUTPUT_IMAGE))
-        || (_depth_format != icetImageGetDepthFormat(OUTPUT_IMAGE))
+  /* Fragments are resolved to whatever format the output image has. */
+    if (   (   !ICET_IMAGE_COLOR_IS_FRAGMENTS(_color_format)
+            && (   (_color_format != icetImageGetColorFormat(OUTPUT_IMAGE))
+                || (_depth_format != icetImageGetDepthFormat(OUTPUT_IMAGE)) ) )
 #ifdef PIXEL_COUNT
         || (_pixel_count  != PIXEL_COUNT)
 #else
@@ -125,6 +169,14 @@
                                 COPY_PIXEL(_c_in, _color,       \
                                            _d_in, _depth);      \
                                 _color++;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)sizeof(IceTUInt))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTFloat))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorubDepthf);\
+                                _color += count;  _depth += count;
 #ifdef COMPOSITE
 #define DT_INCREMENT_INACTIVE_PIXELS(count) _color += count;  _depth += count;
 #else
@@ -174,6 +226,77 @@
                                 COPY_PIXEL(_c_in, _color,       \
                                            _d_in, _depth);      \
                                 _color += 4;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)(4*sizeof(IceTFloat)))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTFloat))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorfDepthf);\
+                                _color += 4*count;  _depth += count;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += 4*count;  _depth += count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        _color[0] =_background_color[0];\
+                                        _color[1] =_background_color[1];\
+                                        _color[2] =_background_color[2];\
+                                        _color[3] =_background_color[3];\
+                                        _color += 4;                    \
+                                        *(_depth++) = 1.0f;             \
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
+#undef COPY_PIXEL
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                IceTUShort *_color;
+                IceTUShort _c_in[4];
+                const IceTFloat *_d_in;
+                IceTFloat _background_float[4];
+                IceTUShort _background_color[4];
+                _color = icetImageGetColorus(OUTPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+                icetGetFloatv(ICET_BACKGROUND_COLOR, _background_float);
+                icetFloatToHalfArray(_background_float, _background_color, 4);
+#ifdef COMPOSITE
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                if (d_src[0] < d_dest[0]) {     \
+                                    c_dest[0] = c_src[0];       \
+                                    c_dest[1] = c_src[1];       \
+                                    c_dest[2] = c_src[2];       \
+                                    c_dest[3] = c_src[3];       \
+                                    d_dest[0] = d_src[0];       \
+                                }
+#else
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                c_dest[0] = c_src[0];           \
+                                c_dest[1] = c_src[1];           \
+                                c_dest[2] = c_src[2];           \
+                                c_dest[3] = c_src[3];           \
+                                d_dest[0] = d_src[0];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      memcpy(_c_in, src, 4*sizeof(IceTUShort)); \
+                                src += 4*sizeof(IceTUShort);    \
+                                _d_in = (IceTFloat *)src;       \
+                                src += sizeof(IceTFloat);       \
+                                COPY_PIXEL(_c_in, _color,       \
+                                           _d_in, _depth);      \
+                                _color += 4;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)(4*sizeof(IceTUShort)))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTFloat))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorusDepthf);\
+                                _color += 4*count;  _depth += count;
 #ifdef COMPOSITE
 #define DT_INCREMENT_INACTIVE_PIXELS(count) _color += 4*count;  _depth += count;
 #else
@@ -220,6 +343,223 @@
                                 }
 #endif
 #include "decompress_template_body.h"
+#undef COPY_PIXEL
+            } else {
+                icetRaiseError("Encountered invalid color format.",
+                               ICET_SANITY_CHECK_FAIL);
+            }
+        } else if (_depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+          /* Use Z buffer for active pixel testing and compositing.  The pixels
+             in the sparse image are not necessarily 4-byte aligned, so color
+             is read with memcpy. */
+            IceTUShort *_depth = icetImageGetDepthus(OUTPUT_IMAGE);
+#ifdef OFFSET
+            _depth += OFFSET;
+#endif
+            if (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                IceTUInt *_color;
+                IceTUInt _c_in[1];
+                const IceTUShort *_d_in;
+                IceTUInt _background_color;
+                _color = icetImageGetColorui(OUTPUT_IMAGE);
+#ifdef OFFSET
+                _color += OFFSET;
+#endif
+                icetGetIntegerv(ICET_BACKGROUND_COLOR_WORD,
+                                (IceTInt *)&_background_color);
+#ifdef COMPOSITE
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                if (d_src[0] < d_dest[0]) {     \
+                                    c_dest[0] = c_src[0];       \
+                                    d_dest[0] = d_src[0];       \
+                                }
+#else
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                c_dest[0] = c_src[0];           \
+                                d_dest[0] = d_src[0];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      memcpy(_c_in, src, sizeof(IceTUInt)); \
+                                src += sizeof(IceTUInt);        \
+                                _d_in = (IceTUShort *)src;      \
+                                src += sizeof(IceTUShort);      \
+                                COPY_PIXEL(_c_in, _color,       \
+                                           _d_in, _depth);      \
+                                _color++;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)sizeof(IceTUInt))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTUShort))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorubDepthus);\
+                                _color += count;  _depth += count;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += count;  _depth += count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        *(_color++) = _background_color;\
+                                        *(_depth++) = ICET_UNORM16_FAR_DEPTH;\
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
+#undef COPY_PIXEL
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                IceTFloat *_color;
+                IceTFloat _c_in[4];
+                const IceTUShort *_d_in;
+                IceTFloat _background_color[4];
+                _color = icetImageGetColorf(OUTPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+                icetGetFloatv(ICET_BACKGROUND_COLOR, _background_color);
+#ifdef COMPOSITE
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                if (d_src[0] < d_dest[0]) {     \
+                                    c_dest[0] = c_src[0];       \
+                                    c_dest[1] = c_src[1];       \
+                                    c_dest[2] = c_src[2];       \
+                                    c_dest[3] = c_src[3];       \
+                                    d_dest[0] = d_src[0];       \
+                                }
+#else
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                c_dest[0] = c_src[0];           \
+                                c_dest[1] = c_src[1];           \
+                                c_dest[2] = c_src[2];           \
+                                c_dest[3] = c_src[3];           \
+                                d_dest[0] = d_src[0];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      memcpy(_c_in, src, 4*sizeof(IceTFloat)); \
+                                src += 4*sizeof(IceTFloat);     \
+                                _d_in = (IceTUShort *)src;      \
+                                src += sizeof(IceTUShort);      \
+                                COPY_PIXEL(_c_in, _color,       \
+                                           _d_in, _depth);      \
+                                _color += 4;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)(4*sizeof(IceTFloat)))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTUShort))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorfDepthus);\
+                                _color += 4*count;  _depth += count;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += 4*count;  _depth += count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        _color[0] =_background_color[0];\
+                                        _color[1] =_background_color[1];\
+                                        _color[2] =_background_color[2];\
+                                        _color[3] =_background_color[3];\
+                                        _color += 4;                    \
+                                        *(_depth++) = ICET_UNORM16_FAR_DEPTH;\
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
+#undef COPY_PIXEL
+            } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                IceTUShort *_color;
+                IceTUShort _c_in[4];
+                const IceTUShort *_d_in;
+                IceTFloat _background_float[4];
+                IceTUShort _background_color[4];
+                _color = icetImageGetColorus(OUTPUT_IMAGE);
+#ifdef OFFSET
+                _color += 4*(OFFSET);
+#endif
+                icetGetFloatv(ICET_BACKGROUND_COLOR, _background_float);
+                icetFloatToHalfArray(_background_float, _background_color, 4);
+#ifdef COMPOSITE
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                if (d_src[0] < d_dest[0]) {     \
+                                    c_dest[0] = c_src[0];       \
+                                    c_dest[1] = c_src[1];       \
+                                    c_dest[2] = c_src[2];       \
+                                    c_dest[3] = c_src[3];       \
+                                    d_dest[0] = d_src[0];       \
+                                }
+#else
+#define COPY_PIXEL(c_src, c_dest, d_src, d_dest)                \
+                                c_dest[0] = c_src[0];           \
+                                c_dest[1] = c_src[1];           \
+                                c_dest[2] = c_src[2];           \
+                                c_dest[3] = c_src[3];           \
+                                d_dest[0] = d_src[0];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      memcpy(_c_in, src, 4*sizeof(IceTUShort)); \
+                                src += 4*sizeof(IceTUShort);    \
+                                _d_in = (IceTUShort *)src;      \
+                                src += sizeof(IceTUShort);      \
+                                COPY_PIXEL(_c_in, _color,       \
+                                           _d_in, _depth);      \
+                                _color += 4;  _depth++;
+#define DT_COLOR_SIZE           ((IceTSizeType)(4*sizeof(IceTUShort)))
+#define DT_DEPTH_SIZE           ((IceTSizeType)sizeof(IceTUShort))
+#define DT_READ_SPAN(span, count)                               \
+                                READ_SPAN(span, count,          \
+                                          DT_COLOR_SIZE,        \
+                                          DT_DEPTH_SIZE,        \
+                                          icetZCompositeSpanColorusDepthus);\
+                                _color += 4*count;  _depth += count;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += 4*count;  _depth += count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        _color[0] =_background_color[0];\
+                                        _color[1] =_background_color[1];\
+                                        _color[2] =_background_color[2];\
+                                        _color[3] =_background_color[3];\
+                                        _color += 4;                    \
+                                        *(_depth++) = ICET_UNORM16_FAR_DEPTH;\
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
+#undef COPY_PIXEL
+            } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
+                const IceTUShort *_d_in;
+#ifdef COMPOSITE
+#define COPY_PIXEL(d_src, d_dest)                               \
+                                if (d_src[0] < d_dest[0]) {     \
+                                    d_dest[0] = d_src[0];       \
+                                }
+#else
+#define COPY_PIXEL(d_src, d_dest)                               \
+                                d_dest[0] = d_src[0];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      _d_in = (IceTUShort *)src;      \
+                                src += sizeof(IceTUShort);      \
+                                COPY_PIXEL(_d_in, _depth);      \
+                                _depth++;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _depth += count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        *(_depth++) = ICET_UNORM16_FAR_DEPTH;\
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
 #undef COPY_PIXEL
             } else {
                 icetRaiseError("Encountered invalid color format.",
@@ -232,8 +572,64 @@
             icetRaiseError("Encountered invalid depth format.",
                            ICET_SANITY_CHECK_FAIL);
         }
-    } else if (_composite_mode == ICET_COMPOSITE_MODE_BLEND) {
-      /* Use alpha for active pixel and compositing. */
+#ifdef COMPOSITE
+    } else if (   (_composite_mode == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+               || (_composite_mode == ICET_COMPOSITE_MODE_ADD) ) {
+      /* Combine each channel of whole runs.  The order of the images does
+         not matter, so neither does which is on top. */
+        if (_depth_format != ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseWarning("Z buffer ignored during channel composite"
+                             " operation.  Output z buffer meaningless.",
+                             ICET_INVALID_VALUE);
+        }
+        if (   (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE)
+            || (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT)
+            || (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) ) {
+            IceTSizeType _color_size = colorPixelSize(_color_format);
+            IceTByte *_color = icetImageGetColorVoid(OUTPUT_IMAGE, NULL);
+#ifdef OFFSET
+            _color += _color_size*(OFFSET);
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXELS(src, count)                                      \
+                                {                                       \
+                                    IceTPixelSpan _in_span, _out_span;  \
+                                    _in_span.color = (IceTByte *)src;   \
+                                    _out_span.color = _color;           \
+                                    _in_span.depth = _out_span.depth    \
+                                        = NULL;                         \
+                                    _in_span.color_stride               \
+                                        = _out_span.color_stride        \
+                                        = _color_size;                  \
+                                    _in_span.depth_stride               \
+                                        = _out_span.depth_stride = 0;   \
+                                    icetChannelCompositeSpan(           \
+                                        _composite_mode, _color_format, \
+                                        &_in_span, &_out_span,          \
+                                        &_out_span, count);             \
+                                }                                       \
+                                src += (count)*_color_size;             \
+                                _color += (count)*_color_size;
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += (count)*_color_size;
+#include "decompress_template_body.h"
+        } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
+            icetRaiseWarning("Decompressing image with no data.",
+                             ICET_INVALID_OPERATION);
+        } else {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+#endif
+    } else if (   (_composite_mode == ICET_COMPOSITE_MODE_BLEND)
+               || (_composite_mode == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+               || (_composite_mode == ICET_COMPOSITE_MODE_ADD) ) {
+      /* Use alpha for active pixel and compositing.  Decompressing an image
+         of a channel mode is no different except that the background is
+         combined with it by the mode's own operation. */
+#if defined(CORRECT_BACKGROUND) && !defined(COMPOSITE)
+        IceTBoolean _channel_mode
+            = (IceTBoolean)(_composite_mode != ICET_COMPOSITE_MODE_BLEND);
+#endif
         if (_depth_format != ICET_IMAGE_DEPTH_NONE) {
             icetRaiseWarning("Z buffer ignored during blend composite"
                              " operation.  Output z buffer meaningless.",
@@ -241,29 +637,59 @@
         }
         if (_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
             IceTUInt *_color;
+#if !defined(COMPOSITE) && !defined(CORRECT_BACKGROUND)
             const IceTUInt *_c_in;
+#endif
             IceTUInt _background_color;
             _color = icetImageGetColorui(OUTPUT_IMAGE);
 #ifdef OFFSET
             _color += OFFSET;
 #endif
-            icetGetIntegerv(ICET_BACKGROUND_COLOR_WORD,
+            icetGetIntegerv(BLEND_BACKGROUND_COLOR_WORD,
                             (IceTInt *)&_background_color);
-#ifdef COMPOSITE
-#define COPY_PIXEL(c_src, c_dest) \
-            BLEND_RGBA_UBYTE(((IceTUByte*)c_src), ((IceTUByte*)c_dest))
-#else
-#define COPY_PIXEL(c_src, c_dest) \
-            c_dest[0] = c_src[0];
-#endif
 #define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#if defined(CORRECT_BACKGROUND) && !defined(COMPOSITE)
+          /* Copy whole runs and blend them over the background in place. */
+#define DT_READ_PIXELS(src, count)                                      \
+                                memcpy(_color, src,                     \
+                                       (count)*sizeof(IceTUInt));       \
+                                if (_channel_mode) {                    \
+                                    icetChannelCompositeArrayWithColor( \
+                                        _composite_mode,                \
+                                        ICET_IMAGE_COLOR_RGBA_UBYTE,    \
+                                        _color,                         \
+                                        &_background_color,             \
+                                        count);                         \
+                                } else {                                \
+                                    icetBlendUByteArrayOverColor(       \
+                                        (IceTUByte *)_color,            \
+                                        (const IceTUByte *)             \
+                                            &_background_color,         \
+                                        count);                         \
+                                }                                       \
+                                src += (count)*sizeof(IceTUInt);        \
+                                _color += count;
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        *(_color++) = _background_color;\
+                                    }                                   \
+                                }
+#elif defined(COMPOSITE)
+          /* Blend whole runs so that several pixels are blended at once. */
+#define DT_READ_PIXELS(src, count)                                      \
+                                BLEND_RGBA_UBYTE((const IceTUByte *)src,\
+                                                 (IceTUByte *)_color,   \
+                                                 count);                \
+                                src += (count)*sizeof(IceTUInt);        \
+                                _color += count;
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += count;
+#else
 #define DT_READ_PIXEL(src)      _c_in = (IceTUInt *)src;        \
                                 src += sizeof(IceTUInt);        \
-                                COPY_PIXEL(_c_in, _color);      \
+                                _color[0] = _c_in[0];           \
                                 _color++;
-#ifdef COMPOSITE
-#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += count;
-#else
 #define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
                                 {                                       \
                                     IceTSizeType __i;                   \
@@ -273,7 +699,6 @@
                                 }
 #endif
 #include "decompress_template_body.h"
-#undef COPY_PIXEL
         } else if (_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
             IceTFloat *_color;
             const IceTFloat *_c_in;
@@ -282,9 +707,27 @@
 #ifdef OFFSET
             _color += 4*(OFFSET);
 #endif
-            icetGetFloatv(ICET_BACKGROUND_COLOR, _background_color);
+            icetGetFloatv(BLEND_BACKGROUND_COLOR, _background_color);
 #ifdef COMPOSITE
 #define COPY_PIXEL(c_src, c_dest) BLEND_RGBA_FLOAT(c_src, c_dest);
+#elif defined(CORRECT_BACKGROUND)
+#define COPY_PIXEL(c_src, c_dest)                               \
+                                if (_channel_mode) {            \
+                                    c_dest[0] = c_src[0];       \
+                                    c_dest[1] = c_src[1];       \
+                                    c_dest[2] = c_src[2];       \
+                                    c_dest[3] = c_src[3];       \
+                                    icetChannelCompositeArrayWithColor(\
+                                        _composite_mode,        \
+                                        ICET_IMAGE_COLOR_RGBA_FLOAT,\
+                                        c_dest,                 \
+                                        _background_color,      \
+                                        1);                     \
+                                } else {                        \
+                                    ICET_BLEND_FLOAT(c_src,     \
+                                                     _background_color,\
+                                                     c_dest);   \
+                                }
 #else
 #define COPY_PIXEL(c_src, c_dest)                               \
                                 c_dest[0] = c_src[0];           \
@@ -313,6 +756,66 @@
                                 }
 #endif
 #include "decompress_template_body.h"
+#undef COPY_PIXEL
+        } else if (_color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+            IceTUShort *_color;
+            const IceTUShort *_c_in;
+            IceTFloat _background_float[4];
+            IceTUShort _background_color[4];
+            _color = icetImageGetColorus(OUTPUT_IMAGE);
+#ifdef OFFSET
+            _color += 4*(OFFSET);
+#endif
+            icetGetFloatv(BLEND_BACKGROUND_COLOR, _background_float);
+            icetFloatToHalfArray(_background_float, _background_color, 4);
+#ifdef COMPOSITE
+#define COPY_PIXEL(c_src, c_dest) BLEND_RGBA_HALF(c_src, c_dest);
+#elif defined(CORRECT_BACKGROUND)
+#define COPY_PIXEL(c_src, c_dest)                               \
+                                if (_channel_mode) {            \
+                                    c_dest[0] = c_src[0];       \
+                                    c_dest[1] = c_src[1];       \
+                                    c_dest[2] = c_src[2];       \
+                                    c_dest[3] = c_src[3];       \
+                                    icetChannelCompositeArrayWithColor(\
+                                        _composite_mode,        \
+                                        ICET_IMAGE_COLOR_RGBA_HALF,\
+                                        c_dest,                 \
+                                        _background_color,      \
+                                        1);                     \
+                                } else {                        \
+                                    icetBlendHalfPixel(c_src,   \
+                                                       _background_color,\
+                                                       c_dest); \
+                                }
+#else
+#define COPY_PIXEL(c_src, c_dest)                               \
+                                c_dest[0] = c_src[0];           \
+                                c_dest[1] = c_src[1];           \
+                                c_dest[2] = c_src[2];           \
+                                c_dest[3] = c_src[3];
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      _c_in = (IceTUShort *)src;      \
+                                src += 4*sizeof(IceTUShort);    \
+                                COPY_PIXEL(_c_in, _color);      \
+                                _color += 4;
+#ifdef COMPOSITE
+#define DT_INCREMENT_INACTIVE_PIXELS(count) _color += 4*count;
+#else
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        _color[0] =_background_color[0];\
+                                        _color[1] =_background_color[1];\
+                                        _color[2] =_background_color[2];\
+                                        _color[3] =_background_color[3];\
+                                        _color += 4;                    \
+                                    }                                   \
+                                }
+#endif
+#include "decompress_template_body.h"
 #undef COPY_PIXEL
         } else if (_color_format == ICET_IMAGE_COLOR_NONE) {
             icetRaiseWarning("Decompressing image with no data.",
@@ -321,6 +824,90 @@
             icetRaiseError("Encountered invalid color format.",
                            ICET_SANITY_CHECK_FAIL);
         }
+    } else if (_composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+#ifdef COMPOSITE
+        icetRaiseError("Fragments can only be composited with other sparse"
+                       " images.", ICET_INVALID_OPERATION);
+#else
+        if (   !icetValidFragmentFormat(_color_format)
+            || (_depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+            icetRaiseError("Cannot resolve fragments of an image without"
+                           " fragments.", ICET_INVALID_VALUE);
+        } else {
+          /* Blend the fragments of each pixel front to back and write the
+             result and the nearest depth in the formats of the output
+             image. */
+            IceTInt _num_fragments
+                = ICET_IMAGE_COLOR_FRAGMENT_COUNT(_color_format);
+            IceTEnum _out_color_format = icetImageGetColorFormat(OUTPUT_IMAGE);
+            IceTEnum _out_depth_format = icetImageGetDepthFormat(OUTPUT_IMAGE);
+            IceTSizeType _out_color_size = colorPixelSize(_out_color_format);
+            IceTSizeType _out_depth_size = depthPixelSize(_out_depth_format);
+            IceTByte *_color;
+            IceTByte *_depth;
+            IceTFloat _background_float[4];
+            IceTFloat _background_color[4];
+            IceTFloat _far_depth;
+            IceTFloat _resolved_color[4];
+            IceTFloat _resolved_depth;
+            _color = icetImageGetColorVoid(OUTPUT_IMAGE, NULL);
+            _depth = icetImageGetDepthVoid(OUTPUT_IMAGE, NULL);
+#ifdef OFFSET
+            _color += _out_color_size*(OFFSET);
+            _depth += _out_depth_size*(OFFSET);
+#endif
+            icetGetFloatv(BLEND_BACKGROUND_COLOR, _background_float);
+            icetWriteResolvedPixel(_background_float,
+                                   1.0f,
+                                   _out_color_format,
+                                   _out_depth_format,
+                                   (IceTByte *)_background_color,
+                                   (IceTByte *)&_far_depth);
+            if (_out_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                icetGetIntegerv(BLEND_BACKGROUND_COLOR_WORD,
+                                (IceTInt *)_background_color);
+            }
+#ifdef CORRECT_BACKGROUND
+#define CORRECT_PIXEL(color)                                            \
+                                ICET_BLEND_FLOAT(color,                 \
+                                                 _background_float,     \
+                                                 color);
+#else
+#define CORRECT_PIXEL(color)
+#endif
+#define DT_COMPRESSED_IMAGE     INPUT_SPARSE_IMAGE
+#define DT_READ_PIXEL(src)      icetResolveFragments(src,               \
+                                                     _num_fragments,    \
+                                                     _resolved_color,   \
+                                                     &_resolved_depth); \
+                                CORRECT_PIXEL(_resolved_color);         \
+                                icetWriteResolvedPixel(_resolved_color, \
+                                                       _resolved_depth, \
+                                                       _out_color_format,\
+                                                       _out_depth_format,\
+                                                       _color,          \
+                                                       _depth);         \
+                                src += 5*sizeof(IceTFloat)*_num_fragments;\
+                                _color += _out_color_size;              \
+                                _depth += _out_depth_size;
+#define DT_INCREMENT_INACTIVE_PIXELS(count)                             \
+                                {                                       \
+                                    IceTSizeType __i;                   \
+                                    for (__i = 0; __i < count; __i++) { \
+                                        memcpy(_color,                  \
+                                               _background_color,       \
+                                               _out_color_size);        \
+                                        memcpy(_depth,                  \
+                                               &_far_depth,             \
+                                               _out_depth_size);        \
+                                        _color += _out_color_size;      \
+                                        _depth += _out_depth_size;      \
+                                    }                                   \
+                                }
+#include "decompress_template_body.h"
+#undef CORRECT_PIXEL
+        }
+#endif /*COMPOSITE*/
     } else {
         icetRaiseError("Encountered invalid composite mode.",
                        ICET_SANITY_CHECK_FAIL);
@@ -333,6 +920,7 @@
 
 #undef INPUT_SPARSE_IMAGE
 #undef OUTPUT_IMAGE
+#undef READ_SPAN
 
 #ifdef TIME_DECOMPRESSION
 #undef TIME_DECOMPRESSION
@@ -342,7 +930,14 @@
 #undef COMPOSITE
 #undef BLEND_RGBA_UBYTE
 #undef BLEND_RGBA_FLOAT
+#undef BLEND_RGBA_HALF
+#endif
+
+#ifdef CORRECT_BACKGROUND
+#undef CORRECT_BACKGROUND
 #endif
+#undef BLEND_BACKGROUND_COLOR
+#undef BLEND_BACKGROUND_COLOR_WORD
 
 #ifdef OFFSET
 #undef OFFSET
@@ -21,24 +21,43 @@
  *	DT_INCREMENT_INACTIVE_PIXELS(count) - Increments over count pixels,
  *		setting them all to appropriate inactive values.
  *
+ * The following macros are optional:
+ *	DT_READ_SPAN(span, count) - If defined, reads the count active pixels
+ *		of a run in the planar layout, given as a pointer to an
+ *		IceTPixelSpan, and increments past them in the output.  If
+ *		defined, DT_COLOR_SIZE and DT_DEPTH_SIZE must also be
+ *		defined to the size of the color and depth of a pixel.  If
+ *		not defined, the image must not have the planar layout.
+ *	DT_READ_PIXELS(src, count) - If defined, used in place of
+ *		DT_READ_PIXEL (which then need not be defined) to read all
+ *		count active pixels of a run at once.  It must also
+ *		increment the pointer.
+ *
  * All of the above macros are undefined at the end of this file.
  */
 
 #ifndef ICET_IMAGE_DATA
 #error Need ICET_IMAGE_DATA macro.  Is this included in image.c?
 #endif
-#ifndef INACTIVE_RUN_LENGTH
-#error Need INACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#ifndef GET_INACTIVE_RUN_LENGTH
+#error Need GET_INACTIVE_RUN_LENGTH macro.  Is this included in image.c?
 #endif
-#ifndef ACTIVE_RUN_LENGTH
-#error Need ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
+#ifndef GET_ACTIVE_RUN_LENGTH
+#error Need GET_ACTIVE_RUN_LENGTH macro.  Is this included in image.c?
 #endif
 
 {
     const IceTByte *_src;  /* Use IceTByte for byte-based pointer arithmetic. */
     IceTSizeType _pixels;
     IceTSizeType _p;
+#ifndef DT_READ_PIXELS
     IceTSizeType _i;
+#endif
+    IceTBoolean _compact = ICET_SPARSE_IMAGE_COMPACT(DT_COMPRESSED_IMAGE);
+    IceTSizeType _run_length_size = RUN_LENGTH_SIZE_OF(_compact);
+#ifdef DT_READ_SPAN
+    IceTBoolean _planar = ICET_SPARSE_IMAGE_PLANAR(DT_COMPRESSED_IMAGE);
+#endif
 
     _pixels = icetSparseImageGetNumPixels(DT_COMPRESSED_IMAGE);
     _src = ICET_IMAGE_DATA(DT_COMPRESSED_IMAGE);
@@ -49,10 +68,10 @@
 	IceTSizeType _rl;
 
         _runlengths = _src;
-        _src += RUN_LENGTH_SIZE;
+        _src += _run_length_size;
 
       /* Set background pixels. */
-	_rl = INACTIVE_RUN_LENGTH(_runlengths);
+	_rl = GET_INACTIVE_RUN_LENGTH(_runlengths, _compact);
 	_p += _rl;
 	if (_p > _pixels) {
 	    icetRaiseError("Corrupt compressed image.", ICET_INVALID_VALUE);
@@ -61,18 +80,44 @@
 	DT_INCREMENT_INACTIVE_PIXELS(_rl);
 
       /* Set active pixels. */
-	_rl = ACTIVE_RUN_LENGTH(_runlengths);
+	_rl = GET_ACTIVE_RUN_LENGTH(_runlengths, _compact);
 	_p += _rl;
 	if (_p > _pixels) {
 	    icetRaiseError("Corrupt compressed image.", ICET_INVALID_VALUE);
 	    break;
 	}
+#ifdef DT_READ_SPAN
+        if (_planar) {
+            IceTPixelSpan _span;
+            _span.color = (IceTByte *)_src;
+            _span.depth = (IceTByte *)_src + _rl*DT_COLOR_SIZE;
+            _span.color_stride = DT_COLOR_SIZE;
+            _span.depth_stride = DT_DEPTH_SIZE;
+            DT_READ_SPAN(&_span, _rl);
+            _src += _rl*(DT_COLOR_SIZE + DT_DEPTH_SIZE);
+            continue;
+        }
+#endif
+#ifdef DT_READ_PIXELS
+        DT_READ_PIXELS(_src, _rl);
+#else
 	for (_i = 0; _i < _rl; _i++) {
 	    DT_READ_PIXEL(_src);
 	}
+#endif
     }
 }
 
 #undef DT_COMPRESSED_IMAGE
 #undef DT_READ_PIXEL
 #undef DT_INCREMENT_INACTIVE_PIXELS
+
+#ifdef DT_READ_PIXELS
+#undef DT_READ_PIXELS
+#endif
+
+#ifdef DT_READ_SPAN
+#undef DT_READ_SPAN
+#undef DT_COLOR_SIZE
+#undef DT_DEPTH_SIZE
+#endif
@@ -31,6 +31,38 @@ void icetDrawCallback(IceTDrawCallbackType func)
     icetStateSetPointer(ICET_DRAW_FUNCTION, (IceTVoid *)func);
 }
 
+void icetOutputBuffer(IceTEnum color_format,
+                      IceTSizeType row_pitch,
+                      IceTVoid *buffer)
+{
+    IceTBoolean isDrawing;
+
+    icetGetBooleanv(ICET_IS_DRAWING_FRAME, &isDrawing);
+    if (isDrawing) {
+        icetRaiseError("Attempted to change the output buffer while drawing.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+        && (color_format != ICET_IMAGE_COLOR_NONE) ) {
+        icetRaiseError("Invalid color format for output buffer.",
+                       ICET_INVALID_ENUM);
+        return;
+    }
+    if (row_pitch < 0) {
+        icetRaiseError("Row pitch of output buffer cannot be negative.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    icetStateSetInteger(ICET_OUTPUT_BUFFER_FORMAT, color_format);
+    icetStateSetInteger(ICET_OUTPUT_BUFFER_ROW_PITCH, (IceTInt)row_pitch);
+    icetStateSetPointer(ICET_OUTPUT_BUFFER, buffer);
+}
+
 void icetStrategy(IceTEnum strategy)
 {
     if (icetStrategyValid(strategy)) {
@@ -76,12 +108,16 @@ const char *icetGetSingleImageStrategyName(void)
 void icetCompositeMode(IceTEnum mode)
 {
     if (    (mode != ICET_COMPOSITE_MODE_Z_BUFFER)
-         && (mode != ICET_COMPOSITE_MODE_BLEND) ) {
+         && (mode != ICET_COMPOSITE_MODE_BLEND)
+         && (mode != ICET_COMPOSITE_MODE_FRAGMENTS)
+         && (mode != ICET_COMPOSITE_MODE_MAX_INTENSITY)
+         && (mode != ICET_COMPOSITE_MODE_ADD) ) {
         icetRaiseError("Invalid composite mode.", ICET_INVALID_ENUM);
         return;
     }
 
     icetStateSetInteger(ICET_COMPOSITE_MODE, mode);
+    icetSelectCompositeKernel();
 }
 
 void icetCompositeOrder(const IceTInt *process_ranks)
@@ -167,9 +203,17 @@ static void drawUseBackgroundColor(const IceTFloat *background_color,
                                    IceTUInt *background_color_word_p,
                                    IceTBoolean *need_color_correction_p)
 {
+  IceTEnum composite_mode = *(icetUnsafeStateGetInteger(ICET_COMPOSITE_MODE));
+  /* Fragments are blended when they are resolved, so they need the same
+     background treatment as blending.  So do the channel operations, which
+     would otherwise count the background once for each process.  Their
+     images are combined with the background by their own operation rather
+     than blended over it. */
   IceTBoolean use_color_blending
-    = (IceTBoolean)(   *(icetUnsafeStateGetInteger(ICET_COMPOSITE_MODE))
-                    == ICET_COMPOSITE_MODE_BLEND);
+    = (IceTBoolean)(   (composite_mode == ICET_COMPOSITE_MODE_BLEND)
+                    || (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS)
+                    || (composite_mode == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+                    || (composite_mode == ICET_COMPOSITE_MODE_ADD) );
 
   /* Make sure background color is up to date. */
     ((IceTUByte *)background_color_word_p)[0]
@@ -188,19 +232,28 @@ static void drawUseBackgroundColor(const IceTFloat *background_color,
         icetStateSetInteger(ICET_BACKGROUND_COLOR_WORD, 0);
 
         icetGetIntegerv(ICET_TILE_DISPLAYED, &display_tile);
-        if (   (display_tile >= 0)
-            && (*background_color_word_p != 0)
+        if (   (*background_color_word_p != 0)
             && icetIsEnabled(ICET_CORRECT_COLORED_BACKGROUND) ) {
-            *need_color_correction_p = ICET_TRUE;
+          /* Every process notes the correction so that the pieces of the
+           * image can be corrected as they are decompressed for collection.
+           * Only a process displaying a tile has to see that it is done. */
+            icetStateSetBoolean(ICET_NEED_BACKGROUND_CORRECTION, 1);
+            *need_color_correction_p = (IceTBoolean)(display_tile >= 0);
         } else {
+            icetStateSetBoolean(ICET_NEED_BACKGROUND_CORRECTION, 0);
             *need_color_correction_p = ICET_FALSE;
         }
     } else {
         icetStateSetFloatv(ICET_BACKGROUND_COLOR, 4, background_color);
         icetStateSetInteger(ICET_BACKGROUND_COLOR_WORD,
                             *background_color_word_p);
+        icetStateSetBoolean(ICET_NEED_BACKGROUND_CORRECTION, 0);
         *need_color_correction_p = ICET_FALSE;
     }
+    icetStateSetFloatv(ICET_TRUE_BACKGROUND_COLOR, 4, background_color);
+    icetStateSetInteger(ICET_TRUE_BACKGROUND_COLOR_WORD,
+                        *background_color_word_p);
+    icetStateSetBoolean(ICET_BACKGROUND_CORRECTED, 0);
 }
 
 static void drawFindContainedViewport(IceTInt contained_viewport[4],
@@ -689,6 +742,7 @@ static IceTImage drawInvokeStrategy(void)
     icetRaiseDebug("Calling strategy");
     icetStateSetBoolean(ICET_IS_DRAWING_FRAME, 1);
     icetGetEnumv(ICET_STRATEGY, &strategy);
+    icetPrepareSingleImageStrategy();
     image = icetInvokeStrategy(strategy);
 
     icetStateSetBoolean(ICET_IS_DRAWING_FRAME, 0);
@@ -728,36 +782,132 @@ static IceTImage drawInvokeStrategy(void)
     return image;
 }
 
-static void drawCorrectBackground(IceTImage image,
+/* The arguments of drawCorrectBackground passed to drawCorrectBackgroundRows,
+   with the background color in the format of the buffer. */
+typedef struct {
+    IceTByte *color_buffer;
+    IceTEnum color_format;
+    IceTEnum composite_mode;
+    IceTSizeType width;
+    IceTSizeType row_pitch;
+    IceTUByte background_ubyte[4];
+    IceTFloat background_float[4];
+    IceTUShort background_half[4];
+} IceTCorrectBackgroundData;
+
+/* Blends num_rows rows of the buffer, starting at first_row, over the
+   background, or combines them with it by the channel operation of the
+   composite mode.  An IceTPixelRangeFunc taking an
+   IceTCorrectBackgroundData. */
+static void drawCorrectBackgroundRows(IceTVoid *data_p,
+                                      IceTSizeType first_row,
+                                      IceTSizeType num_rows)
+{
+    const IceTCorrectBackgroundData *data
+        = (IceTCorrectBackgroundData *)data_p;
+    IceTSizeType x, y;
+
+    for (y = first_row; y < first_row + num_rows; y++) {
+        IceTByte *row = data->color_buffer + y*data->row_pitch;
+        if (   (data->composite_mode == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+            || (data->composite_mode == ICET_COMPOSITE_MODE_ADD) ) {
+            const IceTVoid *background;
+            if (data->color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                background = data->background_ubyte;
+            } else if (data->color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                background = data->background_float;
+            } else {
+                background = data->background_half;
+            }
+            icetChannelCompositeArrayWithColor(data->composite_mode,
+                                               data->color_format,
+                                               row,
+                                               background,
+                                               data->width);
+        } else if (data->color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            icetBlendUByteArrayOverColor((IceTUByte *)row,
+                                         data->background_ubyte,
+                                         data->width);
+        } else if (data->color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+            IceTFloat *color = (IceTFloat *)row;
+            for (x = 0; x < data->width; x++, color += 4) {
+                ICET_UNDER_FLOAT(data->background_float, color);
+            }
+        } else { /* data->color_format == ICET_IMAGE_COLOR_RGBA_HALF */
+            IceTUShort *color = (IceTUShort *)row;
+            for (x = 0; x < data->width; x++, color += 4) {
+                ICET_UNDER_HALF(data->background_half, color);
+            }
+        }
+    }
+}
+
+static void drawCorrectBackground(IceTVoid *color_buffer,
+                                  IceTEnum color_format,
+                                  IceTSizeType width,
+                                  IceTSizeType height,
+                                  IceTSizeType row_pitch,
                                   const IceTFloat *background_color,
                                   IceTUInt background_color_word)
 {
-    IceTSizeType pixels = icetImageGetWidth(image)*icetImageGetHeight(image);
-    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTCorrectBackgroundData data;
 
-    icetTimingBlendBegin();
-
-    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
-        IceTUByte *color = icetImageGetColorub(image);
-        IceTUByte *bc = (IceTUByte *)(&background_color_word);
-        IceTSizeType p;
-        for (p = 0; p < pixels; p++, color += 4) {
-            ICET_UNDER_UBYTE(bc, color);
-        }
-    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
-        IceTFloat *color = icetImageGetColorf(image);
-        IceTSizeType p;
-        for (p = 0; p < pixels; p++, color += 4) {
-            ICET_UNDER_FLOAT(background_color, color);
-        }
-    } else {
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
         icetRaiseError("Encountered invalid color buffer type"
                        " with color blending.", ICET_SANITY_CHECK_FAIL);
+        return;
     }
 
+    data.color_buffer = (IceTByte *)color_buffer;
+    data.color_format = color_format;
+    icetGetEnumv(ICET_COMPOSITE_MODE, &data.composite_mode);
+    data.width = width;
+    if (row_pitch == 0) {
+        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            row_pitch = 4*width;
+        } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+            row_pitch = 4*width*sizeof(IceTFloat);
+        } else {
+            row_pitch = 4*width*sizeof(IceTUShort);
+        }
+    }
+    data.row_pitch = row_pitch;
+    memcpy(data.background_ubyte, &background_color_word, sizeof(IceTUInt));
+    memcpy(data.background_float, background_color, 4*sizeof(IceTFloat));
+    data.background_half[0] = icetFloatToHalf(background_color[0]);
+    data.background_half[1] = icetFloatToHalf(background_color[1]);
+    data.background_half[2] = icetFloatToHalf(background_color[2]);
+    data.background_half[3] = icetFloatToHalf(background_color[3]);
+
+    icetTimingBlendBegin();
+
+    icetParallelPixelRanges(height, width, drawCorrectBackgroundRows, &data);
+
     icetTimingBlendEnd();
 }
 
+/* Returns true if the final image of this frame goes in the buffer given to
+   icetOutputBuffer. */
+static IceTBoolean drawUseOutputBuffer(IceTImage image)
+{
+    IceTEnum output_format;
+    IceTVoid *output_buffer;
+    IceTInt tile_displayed;
+
+    icetGetEnumv(ICET_OUTPUT_BUFFER_FORMAT, &output_format);
+    icetGetPointerv(ICET_OUTPUT_BUFFER, &output_buffer);
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+
+    return (   (output_format != ICET_IMAGE_COLOR_NONE)
+            && (output_buffer != NULL)
+            && (tile_displayed >= 0)
+            && icetIsEnabled(ICET_COLLECT_IMAGES)
+            && !icetImageIsNull(image)
+            && (icetImageGetColorFormat(image) != ICET_IMAGE_COLOR_NONE) );
+}
+
 IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
                         const IceTDouble *modelview_matrix,
                         const IceTFloat *background_color)
@@ -770,6 +920,7 @@ IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
     IceTDouble total_time;
     IceTUInt background_color_word;
     IceTBoolean need_color_correction;
+    IceTBoolean corrected;
 
     icetRaiseDebug("In icetDrawFrame");
 
@@ -793,6 +944,8 @@ IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
                            &background_color_word,
                            &need_color_correction);
 
+    icetSelectCompositeKernel();
+
     icetGetIntegerv(ICET_FRAME_COUNT, &frame_count);
     frame_count++;
     icetStateSetIntegerv(ICET_FRAME_COUNT, 1, &frame_count);
@@ -834,11 +987,55 @@ IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
         }
     }
 
+    icetStateSetBoolean(ICET_OUTPUT_BUFFER_WRITTEN, 0);
+
     image = drawInvokeStrategy();
 
-    /* Correct background color where applicable. */
-    if (need_color_correction) {
-        drawCorrectBackground(image, background_color, background_color_word);
+    icetGetBooleanv(ICET_BACKGROUND_CORRECTED, &corrected);
+
+    if (drawUseOutputBuffer(image)) {
+        /* Strategies that collect the image with icetSingleImageCollect write
+           it straight to the output buffer.  Otherwise copy it there. */
+        IceTEnum output_format;
+        IceTInt row_pitch;
+        IceTVoid *output_buffer;
+        IceTBoolean written;
+
+        icetGetEnumv(ICET_OUTPUT_BUFFER_FORMAT, &output_format);
+        icetGetIntegerv(ICET_OUTPUT_BUFFER_ROW_PITCH, &row_pitch);
+        icetGetPointerv(ICET_OUTPUT_BUFFER, &output_buffer);
+        icetGetBooleanv(ICET_OUTPUT_BUFFER_WRITTEN, &written);
+
+        if (!written) {
+            icetImageCopyColorToBuffer(image,
+                                       output_format,
+                                       row_pitch,
+                                       output_buffer);
+        }
+
+        /* Correct background color where applicable.  The collection
+           usually did it while writing the pixels. */
+        if (need_color_correction && !corrected) {
+            drawCorrectBackground(output_buffer,
+                                  output_format,
+                                  icetImageGetWidth(image),
+                                  icetImageGetHeight(image),
+                                  row_pitch,
+                                  background_color,
+                                  background_color_word);
+        }
+
+        /* The colors are only returned in the output buffer. */
+        icetImageAdjustForOutputBuffer(image);
+    } else if (need_color_correction && !corrected) {
+        /* Correct background color where applicable. */
+        drawCorrectBackground(icetImageGetColorVoid(image, NULL),
+                              icetImageGetColorFormat(image),
+                              icetImageGetWidth(image),
+                              icetImageGetHeight(image),
+                              0,
+                              background_color,
+                              background_color_word);
     }
 
     /* Calculate times. */
@@ -854,6 +1051,8 @@ IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
 
     icetStateSetDouble(ICET_BUFFER_WRITE_TIME, 0.0);
 
+    icetTuneSingleImageStrategy();
+
     icetStateCheckMemory();
 
     return image;
@@ -16,10 +16,22 @@
 #include <IceTDevDiagnostics.h>
 #include <IceTDevMatrix.h>
 #include <IceTDevTiming.h>
+#include <IceTDevCodec.h>
 
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define ICET_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(ICET_USE_SSE2) && defined(__F16C__)
+#define ICET_USE_F16C
+#include <immintrin.h>
+#endif
+
 #define ICET_IMAGE_MAGIC_NUM            (IceTEnum)0x004D5000
 #define ICET_SPARSE_IMAGE_MAGIC_NUM     (IceTEnum)0x004D6000
 
@@ -30,7 +42,27 @@
 #define ICET_IMAGE_HEIGHT_INDEX                 4
 #define ICET_IMAGE_MAX_NUM_PIXELS_INDEX         5
 #define ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX     6
-#define ICET_IMAGE_DATA_START_INDEX             7
+#define ICET_IMAGE_FLAGS_INDEX                  7
+#define ICET_IMAGE_DATA_START_INDEX             8
+
+/* Bits for ICET_IMAGE_FLAGS_INDEX.  Full images always have no flags set.
+   ICET_SPARSE_IMAGE_ENCODED is only set in the copy that
+   icetSparseImagePackageForSend encodes with the message codec, and
+   icetSparseImageUnpackageFromReceive clears it again.
+   ICET_SPARSE_IMAGE_SEEK_INDEX is cleared when an image is received because
+   the receiving buffer may have no room for the index. */
+#define ICET_SPARSE_IMAGE_COMPACT_RUN_LENGTHS   0x0001
+#define ICET_SPARSE_IMAGE_ENCODED               0x0002
+#define ICET_SPARSE_IMAGE_PLANAR_LAYOUT         0x0004
+#define ICET_SPARSE_IMAGE_SEEK_INDEX            0x0008
+#define ICET_SPARSE_IMAGE_BLOCK_LAYOUT          0x0010
+#define ICET_SPARSE_IMAGE_VALID_FLAGS           0x001F
+
+/* The composite function picked for the frame and the color and depth formats
+   it was picked for.  These state entries are private to the image
+   functions. */
+#define ICET_COMPOSITE_KERNEL   (ICET_STATE_ENGINE_START | (IceTEnum)0x0063)
+#define ICET_COMPOSITE_KERNEL_FORMATS (ICET_STATE_ENGINE_START|(IceTEnum)0x0064)
 
 #define ICET_IMAGE_HEADER(image)        ((IceTInt *)image.opaque_internals)
 #define ICET_IMAGE_DATA(image) \
@@ -41,6 +73,130 @@ typedef IceTUnsignedInt32 IceTRunLengthType;
 #define INACTIVE_RUN_LENGTH(rl) (((IceTRunLengthType *)(rl))[0])
 #define ACTIVE_RUN_LENGTH(rl)   (((IceTRunLengthType *)(rl))[1])
 #define RUN_LENGTH_SIZE         ((IceTSizeType)(2*sizeof(IceTRunLengthType)))
+#define MAX_RUN_LENGTH          ((IceTSizeType)0x7FFFFFFF)
+
+/* Sparse images with the ICET_SPARSE_IMAGE_COMPACT_RUN_LENGTHS flag store
+   each run length in 16 bits.  Runs longer than MAX_COMPACT_RUN_LENGTH are
+   broken up.  Long inactive runs are preceded by runs with no active pixels,
+   and long active runs are followed by runs with no inactive pixels. */
+typedef IceTUnsignedInt16 IceTCompactRunLengthType;
+
+#define COMPACT_INACTIVE_RUN_LENGTH(rl) (((IceTCompactRunLengthType *)(rl))[0])
+#define COMPACT_ACTIVE_RUN_LENGTH(rl)   (((IceTCompactRunLengthType *)(rl))[1])
+#define COMPACT_RUN_LENGTH_SIZE \
+    ((IceTSizeType)(2*sizeof(IceTCompactRunLengthType)))
+#define MAX_COMPACT_RUN_LENGTH  ((IceTSizeType)0xFFFF)
+
+#define ICET_SPARSE_IMAGE_COMPACT(image)                                \
+    (   (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]              \
+         & ICET_SPARSE_IMAGE_COMPACT_RUN_LENGTHS)                       \
+     != 0)
+
+/* Run length access for either encoding.  The compact argument is true for
+   compact run lengths. */
+#define GET_INACTIVE_RUN_LENGTH(rl, compact)                            \
+    ((compact)                                                          \
+     ? (IceTSizeType)COMPACT_INACTIVE_RUN_LENGTH(rl)                    \
+     : (IceTSizeType)INACTIVE_RUN_LENGTH(rl))
+#define GET_ACTIVE_RUN_LENGTH(rl, compact)                              \
+    ((compact)                                                          \
+     ? (IceTSizeType)COMPACT_ACTIVE_RUN_LENGTH(rl)                      \
+     : (IceTSizeType)ACTIVE_RUN_LENGTH(rl))
+#define SET_INACTIVE_RUN_LENGTH(rl, compact, value)                     \
+    ((compact)                                                          \
+     ? (void)(COMPACT_INACTIVE_RUN_LENGTH(rl)                           \
+              = (IceTCompactRunLengthType)(value))                      \
+     : (void)(INACTIVE_RUN_LENGTH(rl) = (IceTRunLengthType)(value)))
+#define SET_ACTIVE_RUN_LENGTH(rl, compact, value)                       \
+    ((compact)                                                          \
+     ? (void)(COMPACT_ACTIVE_RUN_LENGTH(rl)                             \
+              = (IceTCompactRunLengthType)(value))                      \
+     : (void)(ACTIVE_RUN_LENGTH(rl) = (IceTRunLengthType)(value)))
+#define RUN_LENGTH_SIZE_OF(compact) \
+    ((compact) ? COMPACT_RUN_LENGTH_SIZE : RUN_LENGTH_SIZE)
+#define MAX_RUN_LENGTH_OF(compact) \
+    ((compact) ? MAX_COMPACT_RUN_LENGTH : MAX_RUN_LENGTH)
+
+/* Sparse images with the ICET_SPARSE_IMAGE_PLANAR_LAYOUT flag store the
+   active pixels of each run as the colors of all the pixels followed by the
+   depths of all the pixels rather than interleaving the color and depth of
+   each pixel.  The flag is only set on images with both color and depth.
+   Active runs are broken up after MAX_PLANAR_RUN_LENGTH pixels so that the
+   depths of a run being written fit in a small scratch array. */
+#define MAX_PLANAR_RUN_LENGTH   ((IceTSizeType)2048)
+#define MAX_PLANAR_DEPTH_SIZE   ((IceTSizeType)sizeof(IceTFloat))
+
+#define ICET_SPARSE_IMAGE_PLANAR(image)                                 \
+    (   (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]              \
+         & ICET_SPARSE_IMAGE_PLANAR_LAYOUT)                             \
+     != 0)
+
+/* The most active pixels a run may hold for the given run length encoding
+   and layout.  Inactive pixels are limited only by MAX_RUN_LENGTH_OF. */
+#define MAX_ACTIVE_RUN_LENGTH_OF(compact, planar) \
+    ((planar) ? MAX_PLANAR_RUN_LENGTH : MAX_RUN_LENGTH_OF(compact))
+
+/* Sparse images with the ICET_SPARSE_IMAGE_SEEK_INDEX flag keep a seek index
+   at the end of the buffer, after the space for the largest image data.  The
+   index is a count of entries followed by the entries, each of which is the
+   pixel position at the start of a run and the byte offset of that run's run
+   length from the start of the image data.  An entry is made every
+   SEEK_INDEX_STRIDE runs, so finding a pixel takes a binary search of the
+   entries and a scan of no more than SEEK_INDEX_STRIDE runs (not counting
+   runs that only continue a long run).  Every operation that writes the image
+   data either rebuilds the index or leaves it empty. */
+#define SEEK_INDEX_STRIDE       ((IceTInt)64)
+#define SEEK_INDEX_CAPACITY(num_pixels) \
+    ((IceTInt)((num_pixels)/SEEK_INDEX_STRIDE + 2))
+#define SEEK_INDEX_SIZE(num_pixels) \
+    ((IceTSizeType)((1 + 2*SEEK_INDEX_CAPACITY(num_pixels))*sizeof(IceTInt)))
+
+#define ICET_SPARSE_IMAGE_HAS_SEEK_INDEX(image)                         \
+    (   (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]              \
+         & ICET_SPARSE_IMAGE_SEEK_INDEX)                                \
+     != 0)
+
+/* Sparse images with the ICET_SPARSE_IMAGE_BLOCK_LAYOUT flag divide the image
+   into BLOCK_SIZE by BLOCK_SIZE blocks of pixels (cut short at the right and
+   top edges) rather than into runs along scanlines.  The data starts with a
+   bitmap of IceTUInt words.  Bit b%32 of word b/32 is set if block b has an
+   active pixel, where the blocks are counted across each row of blocks
+   starting at the bottom.  The pixels of each set block follow in order.  As
+   with the planar layout, a block holds the colors of all its pixels, row by
+   row, followed by all their depths.  The inactive pixels of a set block are
+   kept, so blocks are composited without looking at any run lengths. */
+#define BLOCK_SIZE              ((IceTSizeType)16)
+#define BLOCK_COUNT(length)     (((length) + BLOCK_SIZE - 1)/BLOCK_SIZE)
+#define BLOCK_BITMAP_WORDS(num_blocks)  (((num_blocks) + 31)/32)
+#define BLOCK_IS_SET(bitmap, block) \
+    ((((bitmap)[(block)/32] >> ((block)%32)) & 0x1) != 0)
+
+#define ICET_SPARSE_IMAGE_BLOCKS(image)                                 \
+    (   (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]              \
+         & ICET_SPARSE_IMAGE_BLOCK_LAYOUT)                              \
+     != 0)
+
+/* Builds the seek index of a sparse image as its runs are written. */
+typedef struct {
+    IceTInt *entries;           /* NULL if the image has no index. */
+    IceTInt num_entries;
+    IceTInt max_entries;
+    IceTInt runs_left;          /* Runs to go before the next entry. */
+    const IceTByte *data;       /* Start of the image data. */
+    IceTSizeType position;      /* Pixels written, for writers that need it. */
+} IceTSeekIndexBuilder;
+
+/* Records that a run starting at the given pixel position has been started at
+   run_length. */
+#define SEEK_INDEX_ADD_RUN(builder, run_length, pixel)                  \
+    if (((builder)->entries != NULL) && (--(builder)->runs_left == 0)) { \
+        icetSeekIndexAddEntry((builder), (run_length), (pixel));        \
+    }
+
+/* ICET_IMAGE_DEPTH_UNORM16 depths are the window depth scaled to the full
+   range of an unsigned short, so the far plane (background) is the largest
+   value. */
+#define ICET_UNORM16_FAR_DEPTH  ((IceTUShort)0xFFFF)
 
 #ifdef DEBUG
 static void ICET_TEST_IMAGE_HEADER(IceTImage image)
@@ -75,6 +231,18 @@ static void ICET_TEST_SPARSE_IMAGE_HEADER(IceTSparseImage image)
 #define MAX(x, y)       ((x) < (y) ? (y) : (x))
 #endif
 
+/* When compressing with multiple threads, images are not split into bands
+   smaller than this many pixels. */
+#define ICET_COMPRESS_MIN_BAND_PIXELS   4096
+
+/* icetParallelPixelRanges does not give a thread fewer than this many pixels.
+   The operations are simple enough that smaller ranges are not worth the
+   cost of waking a thread.  Ranges start on multiples of
+   ICET_PARALLEL_ALIGN_PIXELS, which is a whole number of 64-byte cache lines
+   in every color and depth format. */
+#define ICET_PARALLEL_MIN_PIXELS        16384
+#define ICET_PARALLEL_ALIGN_PIXELS      16
+
 #define BIT_REVERSE(result, x, max_val_plus_one)                              \
 {                                                                             \
     int placeholder;                                                          \
@@ -88,6 +256,7 @@ static void ICET_TEST_SPARSE_IMAGE_HEADER(IceTSparseImage image)
 }
 
 #ifdef _MSC_VER
+#pragma warning(disable:4054)
 #pragma warning(disable:4055)
 #endif
 
@@ -95,11 +264,333 @@ static void ICET_TEST_SPARSE_IMAGE_HEADER(IceTSparseImage image)
 static IceTSizeType colorPixelSize(IceTEnum color_format);
 static IceTSizeType depthPixelSize(IceTEnum depth_format);
 
+/* Returns true if color_format is a sparse image format of fragments with a
+   valid count. */
+static IceTBoolean icetValidFragmentFormat(IceTEnum color_format);
+
+/* Each of these returns the number of inactive pixels at the front of the
+   given buffer, looking at no more than num_pixels pixels.  The result is
+   num_pixels if all of the pixels are inactive.  These are used by the
+   compression template to quickly skip over runs of background pixels.  When
+   available, SSE2 is used to test 16 pixels at a time. */
+static IceTSizeType icetScanInactiveDepthf(const IceTFloat *depth,
+                                           IceTSizeType num_pixels);
+static IceTSizeType icetScanInactiveDepthus(const IceTUShort *depth,
+                                            IceTSizeType num_pixels);
+static IceTSizeType icetScanInactiveColorub(const IceTUInt *color,
+                                            IceTSizeType num_pixels);
+static IceTSizeType icetScanInactiveColorf(const IceTFloat *color,
+                                           IceTSizeType num_pixels);
+static IceTSizeType icetScanInactiveColorus(const IceTUShort *color,
+                                            IceTSizeType num_pixels);
+static IceTSizeType icetScanInactiveColor(const IceTVoid *color,
+                                          IceTEnum color_format,
+                                          IceTSizeType num_pixels);
+
+/* Convert count values between half and float.  When the F16C instructions
+   are available, 4 values are converted at a time. */
+static void icetHalfToFloatArray(const IceTUShort *in,
+                                 IceTFloat *out,
+                                 IceTSizeType count);
+static void icetFloatToHalfArray(const IceTFloat *in,
+                                 IceTUShort *out,
+                                 IceTSizeType count);
+
+/* Same as icetBlendHalf.  This one can be inlined in the compositing
+   loops. */
+static void icetBlendHalfPixel(const IceTUShort *front,
+                               const IceTUShort *back,
+                               IceTUShort *dest);
+
+/* A span of pixels given as separate color and depth arrays.  The stride is
+   the distance in bytes from one value to the next.  For interleaved pixels,
+   both strides are the size of a whole pixel.  For planar pixels (and full
+   images), they are the size of a color and of a depth. */
+typedef struct {
+    IceTByte *color;
+    IceTByte *depth;
+    IceTSizeType color_stride;
+    IceTSizeType depth_stride;
+} IceTPixelSpan;
+
+/* Each of these composites num_pixels pixels of the front and back spans
+   with a z-buffer test and writes the result to the dest span, which may be
+   the same as back.  A front pixel wins only if it is strictly closer.  When
+   SSE2 is available and all spans are either contiguous arrays (planar) or
+   packed color and depth pixels (interleaved), several pixels are composited
+   at once. */
+static void icetZCompositeSpanColorubDepthf(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels);
+static void icetZCompositeSpanColorubDepthus(const IceTPixelSpan *front,
+                                             const IceTPixelSpan *back,
+                                             const IceTPixelSpan *dest,
+                                             IceTSizeType num_pixels);
+static void icetZCompositeSpanColorfDepthf(const IceTPixelSpan *front,
+                                           const IceTPixelSpan *back,
+                                           const IceTPixelSpan *dest,
+                                           IceTSizeType num_pixels);
+static void icetZCompositeSpanColorfDepthus(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels);
+static void icetZCompositeSpanColorusDepthf(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels);
+static void icetZCompositeSpanColorusDepthus(const IceTPixelSpan *front,
+                                             const IceTPixelSpan *back,
+                                             const IceTPixelSpan *dest,
+                                             IceTSizeType num_pixels);
+static void icetZCompositeSpanDepthf(const IceTPixelSpan *front,
+                                     const IceTPixelSpan *back,
+                                     const IceTPixelSpan *dest,
+                                     IceTSizeType num_pixels);
+static void icetZCompositeSpanDepthus(const IceTPixelSpan *front,
+                                      const IceTPixelSpan *back,
+                                      const IceTPixelSpan *dest,
+                                      IceTSizeType num_pixels);
+
+/* Copies num_pixels pixels from the in span to the out span. */
+static void icetCopyPixelSpan(const IceTPixelSpan *in,
+                              const IceTPixelSpan *out,
+                              IceTSizeType color_size,
+                              IceTSizeType depth_size,
+                              IceTSizeType num_pixels);
+
+/* Copies the whole runs at *in_p to *out_p, stopping before the first run
+   that does not end within max_pixels pixels.  The runs are copied as they
+   are (run lengths and all), so the output must have the same run length
+   encoding and layout as the input.  Each copied run is added to out_index
+   with the first starting at pixel.  Returns the number of pixels in the
+   copied runs and moves *in_p and *out_p past them. */
+static IceTSizeType icetSparseImageCopyRuns(const IceTByte **in_p,
+                                            IceTByte **out_p,
+                                            IceTSizeType max_pixels,
+                                            IceTBoolean compact,
+                                            IceTSizeType pixel_size,
+                                            IceTSeekIndexBuilder *out_index,
+                                            IceTSizeType pixel);
+
+/* Blend num_pixels RGBA colors of the front span over those of the back span
+   and place them in the dest span.  The RGBA_UBYTE colors of each span must
+   be contiguous.  The other colors are copied to local variables because the
+   pixels of a sparse image are not necessarily aligned. */
+static void icetBlendSpanColorub(const IceTPixelSpan *front,
+                                 const IceTPixelSpan *back,
+                                 const IceTPixelSpan *dest,
+                                 IceTSizeType num_pixels);
+static void icetBlendSpanColorf(const IceTPixelSpan *front,
+                                const IceTPixelSpan *back,
+                                const IceTPixelSpan *dest,
+                                IceTSizeType num_pixels);
+static void icetBlendSpanColorus(const IceTPixelSpan *front,
+                                 const IceTPixelSpan *back,
+                                 const IceTPixelSpan *dest,
+                                 IceTSizeType num_pixels);
+
+/* ICET_COMPOSITE_MODE_MAX_INTENSITY and ICET_COMPOSITE_MODE_ADD combine each
+   color channel on its own, and a pixel is active if any of its channels is
+   not zero. */
+static IceTBoolean icetChannelCompositeMode(IceTEnum composite_mode);
+/* Returns the number of pixels at the front of num_pixels colors, each
+   stride bytes apart, that are inactive (or active if active is true) by the
+   rule of the channel modes. */
+static IceTSizeType icetScanChannelColor(const IceTByte *color,
+                                         IceTEnum color_format,
+                                         IceTSizeType stride,
+                                         IceTSizeType num_pixels,
+                                         IceTBoolean active);
+/* Takes the maximum or sum (as given by composite_mode) of each channel of
+   num_pixels colors of the front and back spans and places them in the dest
+   span.  Channels of RGBA_UBYTE colors saturate when added. */
+static void icetChannelCompositeSpan(IceTEnum composite_mode,
+                                     IceTEnum color_format,
+                                     const IceTPixelSpan *front,
+                                     const IceTPixelSpan *back,
+                                     const IceTPixelSpan *dest,
+                                     IceTSizeType num_pixels);
+static void icetMaxSpanColorub(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels);
+static void icetMaxSpanColorf(const IceTPixelSpan *front,
+                              const IceTPixelSpan *back,
+                              const IceTPixelSpan *dest,
+                              IceTSizeType num_pixels);
+static void icetMaxSpanColorus(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels);
+static void icetAddSpanColorub(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels);
+static void icetAddSpanColorf(const IceTPixelSpan *front,
+                              const IceTPixelSpan *back,
+                              const IceTPixelSpan *dest,
+                              IceTSizeType num_pixels);
+static void icetAddSpanColorus(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels);
+
+/* Functions for the fragments of ICET_COMPOSITE_MODE_FRAGMENTS.  Sparse
+   pixels of fragments are not necessarily aligned, so they are copied to
+   local variables before they are used. */
+
+/* Makes the num_fragments fragments of a sparse pixel at dest from a pixel of
+   an image with the given color and depth formats. */
+static void icetFragmentsFromPixel(const IceTByte *color,
+                                   IceTEnum color_format,
+                                   const IceTByte *depth,
+                                   IceTEnum depth_format,
+                                   IceTInt num_fragments,
+                                   IceTByte *dest);
+/* Merges the fragments of num_pixels pixels of the front and back spans by
+   depth and places them in the dest span.  When there are more fragments
+   than fit, the farthest are blended into the last one kept. */
+static void icetMergeFragmentSpan(const IceTPixelSpan *front,
+                                  const IceTPixelSpan *back,
+                                  const IceTPixelSpan *dest,
+                                  IceTSizeType num_pixels,
+                                  IceTInt num_fragments);
+/* Same as icetMergeFragmentSpan except that the number of fragments comes
+   from the color stride.  Sparse images of fragments have no depth, so the
+   stride is always the size of the fragments of a pixel. */
+static void icetMergeFragmentSpanColor(const IceTPixelSpan *front,
+                                       const IceTPixelSpan *back,
+                                       const IceTPixelSpan *dest,
+                                       IceTSizeType num_pixels);
+/* The span functions above all have this type, so the one for the current
+   composite mode and image formats can be picked before compositing any
+   pixels.  Which image is in front is given by the order of the arguments. */
+typedef void (*IceTCompositeSpanFunc)(const IceTPixelSpan *front,
+                                      const IceTPixelSpan *back,
+                                      const IceTPixelSpan *dest,
+                                      IceTSizeType num_pixels);
+/* Returns the span function for the given composite mode and formats or NULL
+   if they cannot be composited. */
+static IceTCompositeSpanFunc icetLookupCompositeSpan(IceTEnum composite_mode,
+                                                     IceTEnum color_format,
+                                                     IceTEnum depth_format);
+/* Same as icetLookupCompositeSpan for the current composite mode, but
+   returns the function icetSelectCompositeKernel picked when the formats
+   match those of the frame. */
+static IceTCompositeSpanFunc icetGetCompositeSpan(IceTEnum color_format,
+                                                  IceTEnum depth_format);
+/* Raises the error for compositing images of the given formats with the
+   current composite mode when there is no span function for them.  Images
+   with no data only get a warning, and then true is returned so that the
+   caller can clear the result. */
+static IceTBoolean icetCompositeSpanError(IceTEnum color_format,
+                                          IceTEnum depth_format);
+
+/* Blends the fragments of a sparse pixel front to back into an RGBA_FLOAT
+   color and gets the depth of the nearest fragment (1 if there are none). */
+static void icetResolveFragments(const IceTByte *fragments,
+                                 IceTInt num_fragments,
+                                 IceTFloat *color,
+                                 IceTFloat *depth);
+/* Writes a resolved color and depth to a pixel of an image with the given
+   formats. */
+static void icetWriteResolvedPixel(const IceTFloat *color,
+                                   IceTFloat depth,
+                                   IceTEnum color_format,
+                                   IceTEnum depth_format,
+                                   IceTByte *color_out,
+                                   IceTByte *depth_out);
+
+/* Versions of icetDecompressImage, icetCompressedComposite, and
+   icetCompressedCompressedComposite for sparse images in the block layout. */
+static void icetDecompressImageBlocks(const IceTSparseImage compressed_image,
+                                      IceTImage image);
+static void icetCompressedCompositeBlocks(IceTImage destBuffer,
+                                          const IceTSparseImage srcBuffer,
+                                          int srcOnTop);
+static void icetCompressedCompressedCompositeBlocks(
+                                             const IceTSparseImage front_buffer,
+                                             const IceTSparseImage back_buffer,
+                                             IceTSparseImage dest_buffer);
+
+/* Rearranges num_pixels interleaved pixels in place so that all the colors
+   come first followed by all the depths.  num_pixels can be no more than
+   MAX_PLANAR_RUN_LENGTH. */
+static void icetSparseImagePlanarizeRun(IceTVoid *pixels,
+                                        IceTSizeType num_pixels,
+                                        IceTSizeType color_size,
+                                        IceTSizeType depth_size);
+
+/* If the image is big enough, writes a copy of the sparse image with its data
+   encoded into the unused space between the image data and the seek index,
+   leaving the image itself untouched.  Returns the copy and sets
+   package_size, or returns NULL if the image should be sent as is.  The
+   first IceTInt of the encoded data holds the size of the original data. */
+static IceTVoid *icetSparseImageEncode(const IceTSparseImage image,
+                                       IceTSizeType *package_size);
+
+/* Restores the data of a sparse image encoded with icetSparseImageEncode.
+   Returns false if the encoded data is invalid. */
+static IceTBoolean icetSparseImageDecode(IceTSparseImage image);
+
 /* Given a sparse image and a pointer to the end of the data, fill in the entry
    for the actual buffer size. */
 static void icetSparseImageSetActualSize(IceTSparseImage image,
                                          const IceTVoid *data_end);
 
+/* Returns the offset from the start of a sparse image buffer where the seek
+   index is stored for an image with the given format and maximum size.  This
+   is the end of the space for the image data. */
+static IceTSizeType icetSparseImageSeekIndexOffset(IceTEnum color_format,
+                                                   IceTEnum depth_format,
+                                                   IceTSizeType num_pixels);
+
+/* Returns the seek index of a sparse image (starting with the number of
+   entries) or NULL if the image has no room for one. */
+static IceTInt *icetSparseImageGetSeekIndex(const IceTSparseImage image);
+
+/* Prepares builder to write the seek index of image.  icetSeekIndexBegin
+   starts an empty index whereas icetSeekIndexReopen adds to the entries
+   already there.  icetSeekIndexEnd records the entries added. */
+static void icetSeekIndexBegin(IceTSparseImage image,
+                               IceTSeekIndexBuilder *builder);
+static void icetSeekIndexReopen(IceTSparseImage image,
+                                IceTSeekIndexBuilder *builder);
+static void icetSeekIndexEnd(IceTSeekIndexBuilder *builder);
+
+/* Adds an index entry.  Used by SEEK_INDEX_ADD_RUN. */
+static void icetSeekIndexAddEntry(IceTSeekIndexBuilder *builder,
+                                  const IceTVoid *run_length,
+                                  IceTSizeType pixel);
+
+/* Returns the number of entries in the seek index whose runs start at or
+   before the given pixel. */
+static IceTInt icetSeekIndexFind(const IceTInt *index, IceTSizeType pixel);
+
+/* Moves the scan position of a sparse image (as given to
+   icetSparseImageScanPixels) from current_pixel to target_pixel, jumping
+   ahead with the seek index when it can.  If last_in_run_length_p is
+   non-NULL, it is set as in icetSparseImageScanPixels. */
+static void icetSparseImageSeek(const IceTSparseImage image,
+                                IceTSizeType current_pixel,
+                                IceTSizeType target_pixel,
+                                const IceTVoid **in_data_p,
+                                IceTSizeType *inactive_before_p,
+                                IceTSizeType *active_till_next_runl_p,
+                                IceTVoid **last_in_run_length_p,
+                                IceTSizeType color_size,
+                                IceTSizeType depth_size);
+
+/* Starts a new run at data with the given number of inactive pixels and no
+   active pixels.  If there are more inactive pixels than the run length
+   encoding can hold, runs with only inactive pixels are written first.  The
+   return value is the location of the run length for the new run.  The
+   active pixels, if any, follow the returned run length. */
+static IceTVoid *icetSparseImageStartRun(IceTVoid *data,
+                                         IceTSizeType num_inactive,
+                                         IceTBoolean compact);
+
 /* Given a pointer to a data element in a sparse image data buffer, the amount
  * of inactive pixels before this data element, and the number of active pixels
  * until the next run length, advance the pointer for the number of pixels given
@@ -127,7 +618,13 @@ static void icetSparseImageSetActualSize(IceTSparseImage image,
  *     an in-place copy may need to modify this run length.
  * pixels_to_skip (input): The number of pixels to advance (and optionally
  *     copy) in_data_p (and inactive_before_p and active_till_next_runl_p).
- * pixel_size (input): The size, in bytes, for the data of each pixel.
+ * color_size (input): The size, in bytes, for the color of each pixel.
+ * depth_size (input): The size, in bytes, for the depth of each pixel.
+ * in_compact (input): True if the input has compact run lengths.
+ * in_planar (input): True if the input has the planar layout.  The active
+ *     pixels of a planar run cannot be found without its run length, so for
+ *     planar input in_data_p stays on the run length of the current run
+ *     until all of its pixels are scanned.
  * out_data_p (input/output): If the intention is to copy the data, this
  *     points to the end of a data part of another sparse image.  The
  *     scanned pixels will be copied to this buffer.  This parameter will
@@ -140,15 +637,30 @@ static void icetSparseImageSetActualSize(IceTSparseImage image,
  *     to the last run length.  This parameter is optional.  If set to NULL,
  *     it is assumed that out_data_p will initially point to a run length.
  *     This parameter is ignored if out_data_p is NULL.
+ * out_compact (input): True if the output has compact run lengths.  The
+ *     input and output encodings need not match.  Ignored if out_data_p is
+ *     NULL.
+ * out_planar (input): True if the output has the planar layout.  The input
+ *     and output layouts need not match.  Ignored if out_data_p is NULL.
+ * out_index (input/output): If non-NULL, the runs started in the output are
+ *     added to this seek index builder, whose position must be the number of
+ *     pixels already in the output.  The position is advanced past the
+ *     pixels written.  Ignored if out_data_p is NULL.
  */   
 static void icetSparseImageScanPixels(const IceTVoid **in_data_p,
                                       IceTSizeType *inactive_before_p,
                                       IceTSizeType *active_till_next_runl_p,
                                       IceTVoid **last_in_run_length_p,
                                       IceTSizeType pixels_to_skip,
-                                      IceTSizeType pixel_size,
+                                      IceTSizeType color_size,
+                                      IceTSizeType depth_size,
+                                      IceTBoolean in_compact,
+                                      IceTBoolean in_planar,
                                       IceTVoid **out_data_p,
-                                      IceTVoid **out_run_length_p);
+                                      IceTVoid **out_run_length_p,
+                                      IceTBoolean out_compact,
+                                      IceTBoolean out_planar,
+                                      IceTSeekIndexBuilder *out_index);
 
 /* Similar calling structure as icetSparseImageScanPixels except that the
    data is also copied to out_image. */
@@ -157,23 +669,44 @@ static void icetSparseImageCopyPixelsInternal(
                                           IceTSizeType *inactive_before_p,
                                           IceTSizeType *active_till_next_runl_p,
                                           IceTSizeType pixels_to_copy,
-                                          IceTSizeType pixel_size,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size,
+                                          IceTBoolean in_compact,
+                                          IceTBoolean in_planar,
                                           IceTSparseImage out_image);
 
 /* Similar to icetSparseImageCopyPixelsInternal except that data_p should be
    pointing to the entry of the data in out_image and the inactive_before and
    active_till_next_runl should be 0.  The pixels in the input (and output since
-   they are the same) will be skipped as normal except that the header
-   information and last run length for the image will be adjusted so that it is
-   equivalent to a copy. */
+   they are the same) will be skipped, using the seek index if there is one,
+   and the header information will be adjusted.  The last run length read is
+   stored in last_run_length_p.  The caller must pass it to
+   icetSparseImageEndInPlaceCopy, along with the inactive_before and
+   active_till_next_runl left after this call, once it is done reading the
+   rest of the input. */
 static void icetSparseImageCopyPixelsInPlaceInternal(
                                           const IceTVoid **data_p,
                                           IceTSizeType *inactive_before_p,
                                           IceTSizeType *active_till_next_runl_p,
+                                          IceTVoid **last_run_length_p,
                                           IceTSizeType pixels_to_copy,
-                                          IceTSizeType pixel_size,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size,
                                           IceTSparseImage out_image);
 
+/* Finishes an icetSparseImageCopyPixelsInPlaceInternal by trimming the last
+   run so that the image ends after pixels_to_copy pixels.  data_end is the
+   data pointer left by the copy.  For planar images, trimming the last run
+   moves its depths over pixels that belong to the rest of the input, which is
+   why this has to wait until the rest of the input is read. */
+static void icetSparseImageEndInPlaceCopy(IceTSparseImage image,
+                                          IceTVoid *last_run_length,
+                                          IceTSizeType inactive_left,
+                                          IceTSizeType active_left,
+                                          const IceTVoid *data_end,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size);
+
 /* Choose the partitions (defined by offsets) for the given number of partitions
    and size.  The partitions are choosen such that if given a power of 2 as the
    number of partitions, you will get the same partitions if you recursively
@@ -208,13 +741,260 @@ static IceTImage renderTile(int tile,
 /* Gets an image buffer attached to this context. */
 static IceTImage getRenderBuffer(void);
 
+/* Describes how to split the compression of an image into bands for
+   icetCompressBands.  The input is made of num_units units (pixels or rows),
+   each of which becomes unit_size pixels in the compressed image.  The first
+   band gets an extra first_extra pixels and the last band an extra last_extra
+   pixels of output (for padding).  compress_band is called to compress each
+   band.  The rest of the fields are parameters for compress_band.  Those
+   that describe a rendered tile (image, screen_viewport, width, and the
+   spaces around the region) are filled by icetRenderTileForCompress. */
+typedef struct IceTCompressBandsStruct IceTCompressBands;
+typedef void (*IceTCompressBandFunc)(const IceTCompressBands *bands,
+                                     IceTInt band,
+                                     IceTInt num_bands,
+                                     IceTSizeType first_unit,
+                                     IceTSizeType num_units,
+                                     IceTSparseImage compressed_image);
+struct IceTCompressBandsStruct {
+    IceTCompressBandFunc compress_band;
+    IceTSizeType num_units;
+    IceTSizeType unit_size;
+    IceTSizeType first_extra;
+    IceTSizeType last_extra;
+
+    IceTImage image;
+    IceTSizeType offset;
+    const IceTInt *screen_viewport;
+    IceTSizeType width;
+    IceTSizeType space_left;
+    IceTSizeType space_right;
+    IceTSizeType space_bottom;
+    IceTSizeType space_top;
+    const IceTSizeType *segments;
+    IceTSizeType *pieces;
+    IceTSizeType max_pieces;
+};
+
+/* Returns the number of bands to split the compression of image into based
+   on ICET_NUM_THREADS.  A result of 1 means the image should be compressed in
+   one piece. */
+static IceTInt icetCompressNumBands(const IceTImage image,
+                                    const IceTSparseImage compressed_image,
+                                    IceTSizeType num_units,
+                                    IceTSizeType unit_size);
+
+/* Compresses an image in num_bands bands.  Each band is compressed
+   independently (on its own thread when OpenMP is available), and the
+   resulting run lengths are joined in compressed_image.  The result is
+   identical to compressing the whole image at once.  The dimensions of
+   compressed_image should be set before calling this function. */
+static void icetCompressBands(const IceTCompressBands *bands,
+                              IceTInt num_bands,
+                              IceTSparseImage compressed_image);
+
+/* Band functions for icetCompressSubImage, icetGetCompressedTileImage, and
+   icetCompressImageInterlace. */
+static void icetCompressSubImageBand(const IceTCompressBands *bands,
+                                     IceTInt band,
+                                     IceTInt num_bands,
+                                     IceTSizeType first_unit,
+                                     IceTSizeType num_units,
+                                     IceTSparseImage compressed_image);
+static void icetCompressTileBand(const IceTCompressBands *bands,
+                                 IceTInt band,
+                                 IceTInt num_bands,
+                                 IceTSizeType first_unit,
+                                 IceTSizeType num_units,
+                                 IceTSparseImage compressed_image);
+static void icetCompressInterlaceBand(const IceTCompressBands *bands,
+                                      IceTInt band,
+                                      IceTInt num_bands,
+                                      IceTSizeType first_unit,
+                                      IceTSizeType num_units,
+                                      IceTSparseImage compressed_image);
+
+/* Band function for icetCompressTileRanges. */
+static void icetCompressTileRangesBand(const IceTCompressBands *bands,
+                                       IceTInt band,
+                                       IceTInt num_bands,
+                                       IceTSizeType first_unit,
+                                       IceTSizeType num_units,
+                                       IceTSparseImage compressed_image);
+
+/* Renders tile and fills the fields of bands that describe where the
+   rendered region is.  screen_viewport must have room for 4 entries and is
+   referenced by bands.  Returns ICET_FALSE if nothing was rendered in the
+   tile, in which case bands is not filled. */
+static IceTBoolean icetRenderTileForCompress(IceTInt tile,
+                                             IceTInt *screen_viewport,
+                                             IceTCompressBands *bands);
+
+/* Compresses pixels of a tile rendered by icetRenderTileForCompress straight
+   from the rendered region.  bands->segments holds num_ranges ranges of the
+   tile (with the padding around the region) in the form of INTERLACE.  The
+   num_pixels pixels of the ranges are compressed in that order, just as if
+   they were taken from the image icetGetTileImage returns.  The dimensions
+   of compressed_image should be set before calling this function. */
+static void icetCompressTileRanges(IceTCompressBands *bands,
+                                   IceTInt num_ranges,
+                                   IceTSizeType num_pixels,
+                                   IceTSparseImage compressed_image);
+
+/* Finds the num_pixels pixels of a rendered tile starting first pixels into
+   the ranges of bands->segments.  The pixels in the rendered region are
+   placed in segments (in the form of INTERLACE) and the pixels of padding
+   around it are counted in gaps (in the form of INTERLACE_GAPS).  segments
+   must have room for 3*bands->max_pieces entries and gaps for
+   bands->max_pieces entries.  Returns the number of pixels in the
+   segments. */
+static IceTSizeType icetTileRangePieces(const IceTCompressBands *bands,
+                                        IceTSizeType first,
+                                        IceTSizeType num_pixels,
+                                        IceTSizeType *segments,
+                                        IceTSizeType *gaps);
+
+/* Fills segments with the pieces of an image of num_pixels pixels in the order
+   that icetSparseImageInterlace places them, in the form expected by the
+   INTERLACE option of compress_func_body.h.  segments must have room for
+   3*(eventual_num_partitions+1) entries.  Returns the number of segments,
+   which is less than eventual_num_partitions if some partitions are empty. */
+static IceTInt icetInterlaceSegments(IceTSizeType num_pixels,
+                                     IceTInt eventual_num_partitions,
+                                     IceTSizeType *segments);
+
+/* Describes where icetColorBufferWrite puts pixels: a buffer of color_format
+   pixels with rows width pixels wide starting row_pitch bytes apart.  The
+   pixels written come from an image of in_format. */
+typedef struct {
+    IceTByte *buffer;
+    IceTEnum color_format;
+    IceTSizeType width;
+    IceTSizeType row_pitch;
+    IceTEnum in_format;
+} IceTColorBufferWriter;
+
+/* Sets up writer for the given buffer.  Returns false (after raising an
+   error) if the formats cannot be written. */
+static IceTBoolean icetColorBufferWriterInit(IceTColorBufferWriter *writer,
+                                             IceTEnum in_format,
+                                             IceTSizeType width,
+                                             IceTEnum color_format,
+                                             IceTSizeType row_pitch,
+                                             IceTVoid *buffer);
+
+/* Writes count pixels starting at pixel position of the buffer described by
+   writer.  The colors are read from in_colors, in_stride bytes apart.  The
+   colors need not be aligned.  An in_stride of 0 writes the same color to all
+   the pixels. */
+static void icetColorBufferWrite(const IceTColorBufferWriter *writer,
+                                 IceTSizeType position,
+                                 IceTSizeType count,
+                                 const IceTVoid *in_colors,
+                                 IceTSizeType in_stride);
+
+/* Sets pixel (big enough for 4 floats) to the true background color of the
+   frame in color_format. */
+static void icetTrueBackgroundPixel(IceTEnum color_format, IceTVoid *pixel);
+
+/* Blends num_pixels colors of color_format over the background pixel (of the
+   same format) in place, or combines them with it by the channel operation of
+   the current composite mode. */
+static void icetCorrectBackgroundColors(IceTVoid *colors,
+                                        IceTEnum color_format,
+                                        const IceTVoid *background,
+                                        IceTSizeType num_pixels);
+
+/* Implements icetDecompressSubImageToBuffer and
+   icetDecompressSubImageToBufferCorrectBackground. */
+static void icetDecompressSubImageToBufferWithBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTSizeType width,
+                                         IceTEnum color_format,
+                                         IceTSizeType row_pitch,
+                                         IceTVoid *buffer,
+                                         IceTBoolean correct_background);
+
+/* Describes how a compressed band is appended to the bands before it.  The
+   first lead_pixels pixels of the band (taking lead_size bytes of data) may
+   have to be merged with the last run before the band.  The rest of the data
+   can be copied as is.  last_run_offset is the offset, in bytes from the start
+   of the data, of the last run length in the band. */
+typedef struct {
+    IceTSizeType lead_pixels;
+    IceTSizeType lead_size;
+    IceTSizeType last_run_offset;
+} IceTCompressBandJoin;
+
+/* Fills in the IceTCompressBandJoin for the given compressed band. */
+static void icetSparseImageBandJoin(const IceTSparseImage image,
+                                    IceTSizeType pixel_size,
+                                    IceTCompressBandJoin *join);
+
+/* Appends the data of a band starting at pixel band_start to an image being
+   written at *out_data_p, where *last_run_length_p is the last run length
+   written so far.  Both pointers are advanced past the band, and its seek
+   index entries are added to out_index.  The band must have the run length
+   encoding and layout given. */
+static void icetSparseImageJoinBand(const IceTSparseImage band_image,
+                                    const IceTCompressBandJoin *join,
+                                    IceTSizeType band_start,
+                                    IceTSizeType color_size,
+                                    IceTSizeType depth_size,
+                                    IceTBoolean compact,
+                                    IceTBoolean planar,
+                                    IceTVoid **out_data_p,
+                                    IceTVoid **last_run_length_p,
+                                    IceTSeekIndexBuilder *out_index);
+
+/* The arguments of icetComposite passed to icetCompositeRange.  The formats
+   and mode have already been checked. */
+typedef struct {
+    IceTEnum composite_mode;
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    int src_on_top;
+    const IceTVoid *src_color;
+    IceTVoid *dest_color;
+    const IceTVoid *src_depth;
+    IceTVoid *dest_depth;
+} IceTCompositeRangeData;
+
+/* Composites a range of pixels for icetComposite.  An IceTPixelRangeFunc
+   taking an IceTCompositeRangeData. */
+static void icetCompositeRange(IceTVoid *data,
+                               IceTSizeType first_pixel,
+                               IceTSizeType num_pixels);
+
+/* The arguments of icetImageCopyColorub and icetImageCopyColorf passed to
+   icetImageCopyColorRange.  The formats have already been checked. */
+typedef struct {
+    IceTEnum in_format;
+    IceTEnum out_format;
+    const IceTVoid *in_buffer;
+    IceTVoid *out_buffer;
+} IceTCopyColorRangeData;
+
+/* Copies and converts a range of colors for icetImageCopyColorub and
+   icetImageCopyColorf.  An IceTPixelRangeFunc taking an
+   IceTCopyColorRangeData. */
+static void icetImageCopyColorRange(IceTVoid *data,
+                                    IceTSizeType first_pixel,
+                                    IceTSizeType num_pixels);
+
 static IceTSizeType colorPixelSize(IceTEnum color_format)
 {
     switch (color_format) {
       case ICET_IMAGE_COLOR_RGBA_UBYTE: return 4;
       case ICET_IMAGE_COLOR_RGBA_FLOAT: return 4*sizeof(IceTFloat);
+      case ICET_IMAGE_COLOR_RGBA_HALF:  return 4*sizeof(IceTUShort);
       case ICET_IMAGE_COLOR_NONE:       return 0;
       default:
+          if (icetValidFragmentFormat(color_format)) {
+              return (  5*sizeof(IceTFloat)
+                      * ICET_IMAGE_COLOR_FRAGMENT_COUNT(color_format) );
+          }
           icetRaiseError("Invalid color format.", ICET_INVALID_ENUM);
           return 0;
     }
@@ -224,6 +1004,7 @@ static IceTSizeType depthPixelSize(IceTEnum depth_format)
 {
     switch (depth_format) {
       case ICET_IMAGE_DEPTH_FLOAT: return sizeof(IceTFloat);
+      case ICET_IMAGE_DEPTH_UNORM16: return sizeof(IceTUShort);
       case ICET_IMAGE_DEPTH_NONE:  return 0;
       default:
           icetRaiseError("Invalid depth format.", ICET_INVALID_ENUM);
@@ -231,1950 +1012,7399 @@ static IceTSizeType depthPixelSize(IceTEnum depth_format)
     }
 }
 
-IceTSizeType icetImageBufferSize(IceTSizeType width, IceTSizeType height)
+#ifdef ICET_USE_SSE2
+/* Returns the index of the lowest set bit in mask, which must not be 0. */
+static IceTSizeType icetFirstBitSet(unsigned int mask)
 {
-    IceTEnum color_format, depth_format;
-
-    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
-    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
-
-    return icetImageBufferSizeType(color_format, depth_format,
-                                   width, height);
+#ifdef __GNUC__
+    return (IceTSizeType)__builtin_ctz(mask);
+#else
+    IceTSizeType index = 0;
+    while ((mask & 0x0001) == 0) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
 }
+#endif /*ICET_USE_SSE2*/
 
-IceTSizeType icetImageBufferSizeType(IceTEnum color_format,
-                                     IceTEnum depth_format,
-                                     IceTSizeType width,
-                                     IceTSizeType height)
+static IceTSizeType icetScanInactiveDepthf(const IceTFloat *depth,
+                                           IceTSizeType num_pixels)
 {
-    IceTSizeType color_pixel_size = colorPixelSize(color_format);
-    IceTSizeType depth_pixel_size = depthPixelSize(depth_format);
-
-    return (  ICET_IMAGE_DATA_START_INDEX*sizeof(IceTUInt)
-            + width*height*(color_pixel_size + depth_pixel_size) );
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    const __m128 far_depth = _mm_set1_ps(1.0f);
+    for ( ; pixel + 16 <= num_pixels; pixel += 16) {
+        unsigned int active_mask;
+      /* A pixel is active if its depth is less than 1.  Note that NaN compares
+         false just as it does in the scalar test. */
+        active_mask = (unsigned int)(
+              _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth + pixel),
+                                           far_depth))
+            | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth + pixel + 4),
+                                            far_depth)) << 4)
+            | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth + pixel + 8),
+                                            far_depth)) << 8)
+            | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth + pixel + 12),
+                                            far_depth)) << 12) );
+        if (active_mask != 0) {
+            return pixel + icetFirstBitSet(active_mask);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    while ((pixel < num_pixels) && !(depth[pixel] < 1.0)) {
+        pixel++;
+    }
+    return pixel;
 }
 
-IceTSizeType icetSparseImageBufferSize(IceTSizeType width, IceTSizeType height)
+static IceTSizeType icetScanInactiveDepthus(const IceTUShort *depth,
+                                            IceTSizeType num_pixels)
 {
-    IceTEnum color_format, depth_format;
-
-    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
-    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
-
-    return icetSparseImageBufferSizeType(color_format, depth_format,
-                                         width, height);
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    const __m128i far_depth = _mm_set1_epi16((short)ICET_UNORM16_FAR_DEPTH);
+    for ( ; pixel + 16 <= num_pixels; pixel += 16) {
+        const __m128i *block = (const __m128i *)(depth + pixel);
+        unsigned int active_mask;
+      /* A pixel is inactive if its depth is on the far plane.  The compare
+         results are 0 or -1, so a signed pack keeps one byte per pixel. */
+        active_mask = (~(unsigned int)_mm_movemask_epi8(
+                           _mm_packs_epi16(
+                               _mm_cmpeq_epi16(_mm_loadu_si128(block + 0),
+                                               far_depth),
+                               _mm_cmpeq_epi16(_mm_loadu_si128(block + 1),
+                                               far_depth))))
+                      & 0xFFFF;
+        if (active_mask != 0) {
+            return pixel + icetFirstBitSet(active_mask);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    while ((pixel < num_pixels) && (depth[pixel] == ICET_UNORM16_FAR_DEPTH)) {
+        pixel++;
+    }
+    return pixel;
 }
 
-IceTSizeType icetSparseImageBufferSizeType(IceTEnum color_format,
-                                           IceTEnum depth_format,
-                                           IceTSizeType width,
-                                           IceTSizeType height)
+static IceTSizeType icetScanInactiveColorub(const IceTUInt *color,
+                                            IceTSizeType num_pixels)
 {
-    IceTSizeType size;
-    IceTSizeType pixel_size;
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pixel + 16 <= num_pixels; pixel += 16) {
+        const __m128i *block = (const __m128i *)(color + pixel);
+        __m128i alpha01, alpha23;
+        unsigned int active_mask;
+      /* Shift the alpha byte of each pixel (the last byte in memory) to the
+         bottom of its word and then pack the 16 alpha values into a single
+         register in pixel order. */
+        alpha01 = _mm_packs_epi32(
+                        _mm_srli_epi32(_mm_loadu_si128(block + 0), 24),
+                        _mm_srli_epi32(_mm_loadu_si128(block + 1), 24));
+        alpha23 = _mm_packs_epi32(
+                        _mm_srli_epi32(_mm_loadu_si128(block + 2), 24),
+                        _mm_srli_epi32(_mm_loadu_si128(block + 3), 24));
+        active_mask = (~(unsigned int)_mm_movemask_epi8(
+                           _mm_cmpeq_epi8(_mm_packus_epi16(alpha01, alpha23),
+                                          zero)))
+                      & 0xFFFF;
+        if (active_mask != 0) {
+            return pixel + icetFirstBitSet(active_mask);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    while (   (pixel < num_pixels)
+           && (((const IceTUByte *)(color + pixel))[3] == 0x00) ) {
+        pixel++;
+    }
+    return pixel;
+}
 
-    /* A sparse image full of active pixels will be the same size as a full
-       image plus a set of run lengths. */
-    size = (  RUN_LENGTH_SIZE
-            + icetImageBufferSizeType(color_format,depth_format,width,height) );
+static IceTSizeType icetScanInactiveColorf(const IceTFloat *color,
+                                           IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+        const IceTFloat *block = color + 4*pixel;
+        __m128 alpha01, alpha23;
+        unsigned int active_mask;
+      /* Gather the alpha channel of 4 pixels into one register. */
+        alpha01 = _mm_shuffle_ps(_mm_loadu_ps(block + 0),
+                                 _mm_loadu_ps(block + 4),
+                                 _MM_SHUFFLE(3,3,3,3));
+        alpha23 = _mm_shuffle_ps(_mm_loadu_ps(block + 8),
+                                 _mm_loadu_ps(block + 12),
+                                 _MM_SHUFFLE(3,3,3,3));
+        active_mask = (unsigned int)_mm_movemask_ps(
+                  _mm_cmpneq_ps(_mm_shuffle_ps(alpha01, alpha23,
+                                               _MM_SHUFFLE(2,0,2,0)),
+                                zero));
+        if (active_mask != 0) {
+            return pixel + icetFirstBitSet(active_mask);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    while ((pixel < num_pixels) && !(color[4*pixel+3] != 0.0)) {
+        pixel++;
+    }
+    return pixel;
+}
 
-    /* For most common image formats, this is as large as the sparse image may
-       be.  When the size of the run length pair is no bigger than the size of a
-       pixel (the amount of data saved by writing the run lengths), then even in
-       the pathological case of every other pixel being active.  However, it is
-       possible that the run lengths take more space to store than the pixel
-       data.  Thus, if there is an inactive run length of one, it is possible to
-       have the data set a little bigger.  It is extremely unlikely to need this
-       much memory, but we will have to allocate it just in case.  I suppose we
-       could change the compress functions to not allow run lengths of size 1,
-       but that could increase the time to compress and would definitely
-       increase the complexity of the code. */
-    pixel_size = colorPixelSize(color_format) + depthPixelSize(depth_format);
-    if (pixel_size < RUN_LENGTH_SIZE) {
-        size += (RUN_LENGTH_SIZE - pixel_size)*((width*height+1)/2);
+static IceTSizeType icetScanInactiveColorus(const IceTUShort *color,
+                                            IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+  /* A pixel is inactive if its alpha is zero (of either sign).  Mask off
+     everything but alpha without the sign bit. */
+    const __m128i alpha_mask = _mm_set_epi16(0x7FFF, 0, 0, 0,
+                                             0x7FFF, 0, 0, 0);
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+        const __m128i *block = (const __m128i *)(color + 4*pixel);
+        unsigned int zero01, zero23, active_mask;
+        zero01 = (unsigned int)_mm_movemask_epi8(
+               _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128(block + 0),
+                                             alpha_mask),
+                               zero));
+        zero23 = (unsigned int)_mm_movemask_epi8(
+               _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128(block + 1),
+                                             alpha_mask),
+                               zero));
+      /* The alpha of each pixel is in bytes 6 and 14 of its register. */
+        active_mask = (  ((zero01 >> 6) & 0x1) | ((zero01 >> 13) & 0x2)
+                       | ((zero23 >> 4) & 0x4) | ((zero23 >> 11) & 0x8) )
+                      ^ 0xF;
+        if (active_mask != 0) {
+            return pixel + icetFirstBitSet(active_mask);
+        }
     }
-    return size;
+#endif /*ICET_USE_SSE2*/
+    while ((pixel < num_pixels) && ((color[4*pixel+3] & 0x7FFF) == 0)) {
+        pixel++;
+    }
+    return pixel;
 }
 
-IceTImage icetGetStateBufferImage(IceTEnum pname,
-                                  IceTSizeType width,
-                                  IceTSizeType height)
+static IceTSizeType icetScanInactiveColor(const IceTVoid *color,
+                                          IceTEnum color_format,
+                                          IceTSizeType num_pixels)
 {
-    IceTVoid *buffer;
-    IceTSizeType buffer_size;
+    switch (color_format) {
+      case ICET_IMAGE_COLOR_RGBA_UBYTE:
+          return icetScanInactiveColorub((const IceTUInt *)color, num_pixels);
+      case ICET_IMAGE_COLOR_RGBA_FLOAT:
+          return icetScanInactiveColorf((const IceTFloat *)color, num_pixels);
+      default:
+          return icetScanInactiveColorus((const IceTUShort *)color,
+                                         num_pixels);
+    }
+}
 
-    buffer_size = icetImageBufferSize(width, height);
-    buffer = icetGetStateBuffer(pname, buffer_size);
+IceTFloat icetHalfToFloat(IceTUShort value)
+{
+#ifdef ICET_USE_F16C
+    return _cvtsh_ss(value);
+#else
+    IceTUInt sign = ((IceTUInt)value & 0x8000) << 16;
+    IceTUInt exponent = ((IceTUInt)value >> 10) & 0x1F;
+    IceTUInt mantissa = (IceTUInt)value & 0x03FF;
+    IceTUInt bits;
+    IceTFloat result;
+
+    if (exponent == 0x1F) {
+      /* Infinity or NaN. */
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+      /* Denormal half, which is a normal float. */
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x0400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x03FF) << 13);
+    }
 
-    return icetImageAssignBuffer(buffer, width, height);
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+#endif
 }
 
-IceTImage icetImageAssignBuffer(IceTVoid *buffer,
-                                IceTSizeType width,
-                                IceTSizeType height)
+IceTUShort icetFloatToHalf(IceTFloat value)
 {
-    IceTImage image;
-    IceTEnum color_format, depth_format;
-    IceTInt *header;
-
-    image.opaque_internals = buffer;
+#ifdef ICET_USE_F16C
+    return (IceTUShort)_cvtss_sh(value, 0);
+#else
+    IceTUInt bits;
+    IceTUInt sign;
+    IceTInt exponent;
+    IceTUInt mantissa;
+    IceTUInt half;
+    IceTUInt remainder;
+    IceTUInt halfway;
+
+    memcpy(&bits, &value, sizeof(bits));
+    sign = (bits >> 16) & 0x8000;
+    exponent = (IceTInt)((bits >> 23) & 0xFF);
+    mantissa = bits & 0x007FFFFF;
+
+    if (exponent == 0xFF) {
+      /* Infinity or NaN.  NaN stays NaN (and quiet). */
+        return (IceTUShort)(  sign | 0x7C00
+                            | ((mantissa != 0) ? 0x0200|(mantissa >> 13) : 0));
+    }
 
-    if (buffer == NULL) {
-        icetRaiseError("Tried to create image with NULL buffer.",
-                       ICET_INVALID_VALUE);
-        return icetImageNull();
+    exponent -= 127 - 15;
+    if (exponent >= 0x1F) {
+      /* Too big: infinity. */
+        return (IceTUShort)(sign | 0x7C00);
     }
 
-    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
-    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
+    if (exponent > 0) {
+        half = ((IceTUInt)exponent << 10) | (mantissa >> 13);
+        remainder = mantissa & 0x1FFF;
+        halfway = 0x1000;
+    } else {
+      /* Denormal half.  Shift in the implicit 1 of the float. */
+        IceTInt shift = 14 - exponent;
+        if (shift > 24) { return (IceTUShort)sign; }
+        mantissa |= 0x00800000;
+        half = mantissa >> shift;
+        remainder = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
 
-    header = ICET_IMAGE_HEADER(image);
+  /* Round to nearest, ties to even.  A carry out of the mantissa correctly
+     bumps the exponent (up to infinity). */
+    if ((remainder > halfway) || ((remainder == halfway) && (half & 1))) {
+        half++;
+    }
+    return (IceTUShort)(sign | half);
+#endif
+}
 
-    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
-        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
-        && (color_format != ICET_IMAGE_COLOR_NONE) ) {
-        icetRaiseError("Invalid color format.", ICET_INVALID_ENUM);
-        color_format = ICET_IMAGE_COLOR_NONE;
+static void icetHalfToFloatArray(const IceTUShort *in,
+                                 IceTFloat *out,
+                                 IceTSizeType count)
+{
+    IceTSizeType i = 0;
+#ifdef ICET_USE_F16C
+    for ( ; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i,
+                      _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(in+i))));
     }
-    if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
-        && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
-        icetRaiseError("Invalid depth format.", ICET_INVALID_ENUM);
-        depth_format = ICET_IMAGE_DEPTH_NONE;
+#endif
+    for ( ; i < count; i++) {
+        out[i] = icetHalfToFloat(in[i]);
     }
+}
 
-    header[ICET_IMAGE_MAGIC_NUM_INDEX]          = ICET_IMAGE_MAGIC_NUM;
-    header[ICET_IMAGE_COLOR_FORMAT_INDEX]       = color_format;
-    header[ICET_IMAGE_DEPTH_FORMAT_INDEX]       = depth_format;
-    header[ICET_IMAGE_WIDTH_INDEX]              = (IceTInt)width;
-    header[ICET_IMAGE_HEIGHT_INDEX]             = (IceTInt)height;
-    header[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]     = (IceTInt)(width*height);
-    header[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
-        = (IceTInt)icetImageBufferSizeType(color_format,
-                                           depth_format,
-                                           width,
-                                           height);
+static void icetFloatToHalfArray(const IceTFloat *in,
+                                 IceTUShort *out,
+                                 IceTSizeType count)
+{
+    IceTSizeType i = 0;
+#ifdef ICET_USE_F16C
+    for ( ; i + 4 <= count; i += 4) {
+        _mm_storel_epi64((__m128i *)(out + i),
+                         _mm_cvtps_ph(_mm_loadu_ps(in + i), 0));
+    }
+#endif
+    for ( ; i < count; i++) {
+        out[i] = icetFloatToHalf(in[i]);
+    }
+}
 
-    return image;
+static void icetBlendHalfPixel(const IceTUShort *front,
+                               const IceTUShort *back,
+                               IceTUShort *dest)
+{
+#ifdef ICET_USE_F16C
+    __m128 front_color = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)front));
+    __m128 back_color = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)back));
+    __m128 afactor = _mm_sub_ps(_mm_set1_ps(1.0f),
+                                _mm_shuffle_ps(front_color, front_color,
+                                               _MM_SHUFFLE(3,3,3,3)));
+    _mm_storel_epi64((__m128i *)dest,
+                     _mm_cvtps_ph(_mm_add_ps(_mm_mul_ps(back_color, afactor),
+                                             front_color),
+                                  0));
+#else
+    IceTFloat front_color[4];
+    IceTFloat back_color[4];
+    icetHalfToFloatArray(front, front_color, 4);
+    icetHalfToFloatArray(back, back_color, 4);
+    ICET_BLEND_FLOAT(front_color, back_color, back_color);
+    icetFloatToHalfArray(back_color, dest, 4);
+#endif
 }
 
-IceTImage icetImageNull(void)
+void icetBlendHalf(const IceTUShort *front,
+                   const IceTUShort *back,
+                   IceTUShort *dest)
 {
-    IceTImage image;
-    image.opaque_internals = NULL;
-    return image;
+    icetBlendHalfPixel(front, back, dest);
 }
 
-IceTBoolean icetImageIsNull(const IceTImage image)
+#ifdef ICET_USE_SSE2
+/* Blends the 4 RGBA_UBYTE pixels of front over those of back exactly as
+   ICET_BLEND_UBYTE does and places them in result.  Channels are widened to
+   16 bits, where the product of a channel and 255 - alpha fits, and divided
+   by 255 with the identity x/255 = (x + 1 + (x >> 8)) >> 8, which is exact
+   for 0 <= x <= 255*255.  The scalar blend casts the sum to IceTUByte, which
+   wraps rather than saturates, so the sums are masked before packing.  This
+   is a macro so that the blend loops do not make a call for each vector. */
+#define ICET_BLEND_UBYTE_VECTOR(front, back, result)                        \
+    {                                                                       \
+        const __m128i _zero = _mm_setzero_si128();                          \
+        const __m128i _one = _mm_set1_epi16(1);                             \
+        const __m128i _max = _mm_set1_epi16(0xFF);                          \
+        __m128i _wide[2];                                                   \
+        __m128i _front_wide = _mm_unpacklo_epi8(front, _zero);              \
+        __m128i _back_wide = _mm_unpacklo_epi8(back, _zero);                \
+        __m128i _product;                                                   \
+        ICET_BLEND_UBYTE_VECTOR_HALF(_wide[0]);                             \
+        _front_wide = _mm_unpackhi_epi8(front, _zero);                      \
+        _back_wide = _mm_unpackhi_epi8(back, _zero);                        \
+        ICET_BLEND_UBYTE_VECTOR_HALF(_wide[1]);                             \
+        result = _mm_packus_epi16(_wide[0], _wide[1]);                      \
+    }
+#define ICET_BLEND_UBYTE_VECTOR_HALF(wide)                                  \
+    _product = _mm_mullo_epi16(                                             \
+             _back_wide,                                                    \
+             _mm_sub_epi16(_max,                                            \
+                           _mm_shufflehi_epi16(                             \
+                               _mm_shufflelo_epi16(_front_wide,             \
+                                                   _MM_SHUFFLE(3,3,3,3)),   \
+                               _MM_SHUFFLE(3,3,3,3))));                     \
+    wide = _mm_and_si128(                                                   \
+             _mm_add_epi16(                                                 \
+                 _mm_srli_epi16(                                            \
+                     _mm_add_epi16(_mm_add_epi16(_product, _one),           \
+                                   _mm_srli_epi16(_product, 8)),            \
+                     8),                                                    \
+                 _front_wide),                                              \
+             _max)
+#endif /*ICET_USE_SSE2*/
+
+void icetBlendUByteArray(const IceTUByte *front,
+                         const IceTUByte *back,
+                         IceTUByte *dest,
+                         IceTSizeType num_pixels)
 {
-    if (image.opaque_internals == NULL) {
-        return ICET_TRUE;
-    } else {
-        return ICET_FALSE;
+    IceTSizeType pixel = 0;
+
+#ifdef ICET_USE_SSE2
+    for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+        __m128i front_vector
+            = _mm_loadu_si128((const __m128i *)(front + 4*pixel));
+        __m128i back_vector
+            = _mm_loadu_si128((const __m128i *)(back + 4*pixel));
+        __m128i result;
+        ICET_BLEND_UBYTE_VECTOR(front_vector, back_vector, result);
+        _mm_storeu_si128((__m128i *)(dest + 4*pixel), result);
+    }
+#endif /*ICET_USE_SSE2*/
+    for ( ; pixel < num_pixels; pixel++) {
+        ICET_BLEND_UBYTE(front + 4*pixel, back + 4*pixel, dest + 4*pixel);
     }
 }
 
-IceTSparseImage icetGetStateBufferSparseImage(IceTEnum pname,
-                                              IceTSizeType width,
-                                              IceTSizeType height)
+void icetBlendUByteArrayOverColor(IceTUByte *colors,
+                                  const IceTUByte *background,
+                                  IceTSizeType num_pixels)
 {
-    IceTVoid *buffer;
-    IceTSizeType buffer_size;
+    IceTSizeType pixel = 0;
+
+#ifdef ICET_USE_SSE2
+    IceTUInt background_word;
+    __m128i back;
+    memcpy(&background_word, background, sizeof(IceTUInt));
+    back = _mm_set1_epi32((int)background_word);
+    for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+        __m128i front_vector
+            = _mm_loadu_si128((const __m128i *)(colors + 4*pixel));
+        __m128i result;
+        ICET_BLEND_UBYTE_VECTOR(front_vector, back, result);
+        _mm_storeu_si128((__m128i *)(colors + 4*pixel), result);
+    }
+#endif /*ICET_USE_SSE2*/
+    for ( ; pixel < num_pixels; pixel++) {
+        ICET_UNDER_UBYTE(background, colors + 4*pixel);
+    }
+}
 
-    buffer_size = icetSparseImageBufferSize(width, height);
-    buffer = icetGetStateBuffer(pname, buffer_size);
+#ifdef ICET_USE_SSE2
+/* Selects the bits of a where mask is set and the bits of b elsewhere. */
+#define ICET_SELECT_SI128(mask, a, b) \
+    _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
 
-    return icetSparseImageAssignBuffer(buffer, width, height);
+/* Returns a mask with the bits of each 16-bit lane set where a < b.  The
+   values are compared as unsigned, which SSE2 does not do directly. */
+static __m128i icetCompareLessEpu16(__m128i a, __m128i b)
+{
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+    return _mm_cmplt_epi16(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
 }
 
-IceTSparseImage icetSparseImageAssignBuffer(IceTVoid *buffer,
-                                            IceTSizeType width,
-                                            IceTSizeType height)
+/* Selects 4 RGBA float colors of 16 bytes each.  mask has one 32-bit lane per
+   pixel that is all set where the front color is chosen. */
+static void icetSelectColorsf(__m128i mask,
+                              const IceTByte *front,
+                              const IceTByte *back,
+                              IceTByte *dest)
 {
-    IceTSparseImage image;
-    IceTEnum color_format, depth_format;
-    IceTInt *header;
-
-    image.opaque_internals = buffer;
-
-    if (buffer == NULL) {
-        icetRaiseError("Tried to create sparse image with NULL buffer.",
-                       ICET_INVALID_VALUE);
-        return image;
+    __m128i low = _mm_unpacklo_epi32(mask, mask);
+    __m128i high = _mm_unpackhi_epi32(mask, mask);
+    __m128i lanes[4];
+    int i;
+
+    lanes[0] = _mm_unpacklo_epi64(low, low);
+    lanes[1] = _mm_unpackhi_epi64(low, low);
+    lanes[2] = _mm_unpacklo_epi64(high, high);
+    lanes[3] = _mm_unpackhi_epi64(high, high);
+    for (i = 0; i < 4; i++) {
+        _mm_storeu_si128(
+                (__m128i *)(dest + 16*i),
+                ICET_SELECT_SI128(
+                       lanes[i],
+                       _mm_loadu_si128((const __m128i *)(front + 16*i)),
+                       _mm_loadu_si128((const __m128i *)(back + 16*i))));
     }
+}
+#endif /*ICET_USE_SSE2*/
+
+/* Returns true if all three spans hold contiguous color and depth arrays. */
+static IceTBoolean icetPixelSpansPlanar(const IceTPixelSpan *front,
+                                        const IceTPixelSpan *back,
+                                        const IceTPixelSpan *dest,
+                                        IceTSizeType color_size,
+                                        IceTSizeType depth_size)
+{
+    return (   (front->color_stride == color_size)
+            && (back->color_stride == color_size)
+            && (dest->color_stride == color_size)
+            && (front->depth_stride == depth_size)
+            && (back->depth_stride == depth_size)
+            && (dest->depth_stride == depth_size) );
+}
 
-    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
-    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
+/* Returns true if all three spans hold whole pixels packed together, each a
+   color followed directly by its depth. */
+static IceTBoolean icetPixelSpansInterleaved(const IceTPixelSpan *front,
+                                             const IceTPixelSpan *back,
+                                             const IceTPixelSpan *dest,
+                                             IceTSizeType color_size,
+                                             IceTSizeType depth_size)
+{
+    IceTSizeType pixel_size = color_size + depth_size;
+    return (   (front->color_stride == pixel_size)
+            && (back->color_stride == pixel_size)
+            && (dest->color_stride == pixel_size)
+            && (front->depth_stride == pixel_size)
+            && (back->depth_stride == pixel_size)
+            && (dest->depth_stride == pixel_size)
+            && (front->depth == front->color + color_size)
+            && (back->depth == back->color + color_size)
+            && (dest->depth == dest->color + color_size) );
+}
 
-    header = ICET_IMAGE_HEADER(image);
+#ifdef ICET_USE_SSE2
+/* Copies count (at most 8) interleaved pixels of pixel_size bytes, taking
+   pixel i from front where bit i of front_mask is set and from back
+   elsewhere.  pixel_size should be a constant so that the copies compile to
+   plain moves.  The source of each pixel is looked up rather than branched on
+   because the masks are rarely predictable.  When dest is back, only the front
+   pixels are copied. */
+#define ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count, front, back, dest,\
+                                       pixel_size)                      \
+    {                                                                   \
+        int _i;                                                         \
+        if ((front_mask) == (1u << (count)) - 1) {                      \
+            memcpy((dest), (front), (count)*(pixel_size));              \
+        } else if ((dest) != (back)) {                                  \
+            const IceTByte *_sources[2];                                \
+            _sources[0] = (back);                                       \
+            _sources[1] = (front);                                      \
+            for (_i = 0; _i < (count); _i++) {                          \
+                memcpy((dest) + _i*(pixel_size),                        \
+                       _sources[((front_mask) >> _i) & 0x1]             \
+                           + _i*(pixel_size),                           \
+                       (pixel_size));                                   \
+            }                                                           \
+        } else {                                                        \
+            for (_i = 0; _i < (count); _i++) {                          \
+                if (((front_mask) >> _i) & 0x1) {                       \
+                    memcpy((dest) + _i*(pixel_size),                    \
+                           (front) + _i*(pixel_size),                   \
+                           (pixel_size));                               \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }
 
-    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
-        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
-        && (color_format != ICET_IMAGE_COLOR_NONE) ) {
-        icetRaiseError("Invalid color format.", ICET_INVALID_ENUM);
-        color_format = ICET_IMAGE_COLOR_NONE;
+/* These gather the depths of count (at most 8) interleaved pixels from front
+   and back, compare them, and return a mask with bit i set where front pixel i
+   is strictly closer.  Lanes past count repeat the last pixel so that the
+   gather always has the same shape; their bits are cleared. */
+static unsigned int icetInterleavedFrontMaskf(const IceTByte *front,
+                                              const IceTByte *back,
+                                              IceTSizeType color_size,
+                                              int count)
+{
+    IceTSizeType pixel_size = color_size + sizeof(IceTFloat);
+    IceTFloat front_depth[8];
+    IceTFloat back_depth[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        IceTSizeType offset = MIN(i, count-1)*pixel_size + color_size;
+        memcpy(&front_depth[i], front + offset, sizeof(IceTFloat));
+        memcpy(&back_depth[i], back + offset, sizeof(IceTFloat));
     }
-    if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
-        && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
-        icetRaiseError("Invalid depth format.", ICET_INVALID_ENUM);
-        depth_format = ICET_IMAGE_DEPTH_NONE;
+    return (unsigned int)
+        (  (  _mm_movemask_ps(
+                  _mm_cmplt_ps(_mm_setr_ps(front_depth[0], front_depth[1],
+                                           front_depth[2], front_depth[3]),
+                               _mm_setr_ps(back_depth[0], back_depth[1],
+                                           back_depth[2], back_depth[3])))
+            | (_mm_movemask_ps(
+                  _mm_cmplt_ps(_mm_setr_ps(front_depth[4], front_depth[5],
+                                           front_depth[6], front_depth[7]),
+                               _mm_setr_ps(back_depth[4], back_depth[5],
+                                           back_depth[6], back_depth[7])))
+               << 4) )
+         & ((1u << count) - 1) );
+}
+static unsigned int icetInterleavedFrontMaskus(const IceTByte *front,
+                                               const IceTByte *back,
+                                               IceTSizeType color_size,
+                                               int count)
+{
+    IceTSizeType pixel_size = color_size + sizeof(IceTUShort);
+    IceTUShort front_depth[8];
+    IceTUShort back_depth[8];
+    __m128i mask;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        IceTSizeType offset = MIN(i, count-1)*pixel_size + color_size;
+        memcpy(&front_depth[i], front + offset, sizeof(IceTUShort));
+        memcpy(&back_depth[i], back + offset, sizeof(IceTUShort));
     }
-
-    header[ICET_IMAGE_MAGIC_NUM_INDEX]          = ICET_SPARSE_IMAGE_MAGIC_NUM;
-    header[ICET_IMAGE_COLOR_FORMAT_INDEX]       = color_format;
-    header[ICET_IMAGE_DEPTH_FORMAT_INDEX]       = depth_format;
-    header[ICET_IMAGE_WIDTH_INDEX]              = (IceTInt)width;
-    header[ICET_IMAGE_HEIGHT_INDEX]             = (IceTInt)height;
-    header[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]     = (IceTInt)(width*height);
-    header[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] = 0;
-
-  /* Make sure the runlengths are valid. */
-    icetClearSparseImage(image);
-
-    return image;
+    mask = icetCompareLessEpu16(
+                 _mm_setr_epi16((short)front_depth[0], (short)front_depth[1],
+                                (short)front_depth[2], (short)front_depth[3],
+                                (short)front_depth[4], (short)front_depth[5],
+                                (short)front_depth[6], (short)front_depth[7]),
+                 _mm_setr_epi16((short)back_depth[0], (short)back_depth[1],
+                                (short)back_depth[2], (short)back_depth[3],
+                                (short)back_depth[4], (short)back_depth[5],
+                                (short)back_depth[6], (short)back_depth[7]));
+  /* Narrow the 16-bit lanes to bytes to get one mask bit per pixel. */
+    return (  (unsigned int)_mm_movemask_epi8(
+                                  _mm_packs_epi16(mask, _mm_setzero_si128()))
+            & ((1u << count) - 1) );
 }
+#endif /*ICET_USE_SSE2*/
 
-IceTSparseImage icetSparseImageNull(void)
+/* Depth only versions of the span kernels. */
+static void icetZCompositeSpanDepthf(const IceTPixelSpan *front,
+                                     const IceTPixelSpan *back,
+                                     const IceTPixelSpan *dest,
+                                     IceTSizeType num_pixels)
 {
-    IceTSparseImage image;
-    image.opaque_internals = NULL;
-    return image;
+    IceTSizeType pixel = 0;
+
+#ifdef ICET_USE_SSE2
+    if (   (front->depth_stride == sizeof(IceTFloat))
+        && (back->depth_stride == sizeof(IceTFloat))
+        && (dest->depth_stride == sizeof(IceTFloat)) ) {
+      /* _mm_min_ps returns its second argument unless the first is strictly
+         less, which is exactly the z test. */
+        for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+            IceTSizeType offset = pixel*sizeof(IceTFloat);
+            _mm_storeu_ps(
+                 (IceTFloat *)(dest->depth + offset),
+                 _mm_min_ps(
+                      _mm_loadu_ps((const IceTFloat *)(front->depth + offset)),
+                      _mm_loadu_ps((const IceTFloat *)(back->depth+offset))));
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    for ( ; pixel < num_pixels; pixel++) {
+        IceTFloat front_value, back_value;
+        memcpy(&front_value,
+               front->depth + pixel*front->depth_stride,
+               sizeof(IceTFloat));
+        memcpy(&back_value,
+               back->depth + pixel*back->depth_stride,
+               sizeof(IceTFloat));
+        if (front_value < back_value) { back_value = front_value; }
+        memcpy(dest->depth + pixel*dest->depth_stride,
+               &back_value,
+               sizeof(IceTFloat));
+    }
 }
-
-IceTBoolean icetSparseImageIsNull(const IceTSparseImage image)
+static void icetZCompositeSpanDepthus(const IceTPixelSpan *front,
+                                      const IceTPixelSpan *back,
+                                      const IceTPixelSpan *dest,
+                                      IceTSizeType num_pixels)
 {
-    if (image.opaque_internals == NULL) {
-        return ICET_TRUE;
-    } else {
-        return ICET_FALSE;
+    IceTSizeType pixel = 0;
+
+#ifdef ICET_USE_SSE2
+    if (   (front->depth_stride == sizeof(IceTUShort))
+        && (back->depth_stride == sizeof(IceTUShort))
+        && (dest->depth_stride == sizeof(IceTUShort)) ) {
+        for ( ; pixel + 8 <= num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*sizeof(IceTUShort);
+            __m128i front_depth
+                = _mm_loadu_si128((const __m128i *)(front->depth + offset));
+            __m128i back_depth
+                = _mm_loadu_si128((const __m128i *)(back->depth + offset));
+            __m128i mask = icetCompareLessEpu16(front_depth, back_depth);
+            _mm_storeu_si128((__m128i *)(dest->depth + offset),
+                             ICET_SELECT_SI128(mask, front_depth, back_depth));
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    for ( ; pixel < num_pixels; pixel++) {
+        IceTUShort front_value, back_value;
+        memcpy(&front_value,
+               front->depth + pixel*front->depth_stride,
+               sizeof(IceTUShort));
+        memcpy(&back_value,
+               back->depth + pixel*back->depth_stride,
+               sizeof(IceTUShort));
+        if (front_value < back_value) { back_value = front_value; }
+        memcpy(dest->depth + pixel*dest->depth_stride,
+               &back_value,
+               sizeof(IceTUShort));
     }
 }
 
-void icetImageAdjustForOutput(IceTImage image)
+/* Composites pixels first_pixel through num_pixels-1 of the spans one at a
+   time.  Works with any strides.  Values are accessed with memcpy because
+   pixels in a sparse image are not necessarily aligned. */
+static void icetZCompositeSpanGeneric(const IceTPixelSpan *front,
+                                      const IceTPixelSpan *back,
+                                      const IceTPixelSpan *dest,
+                                      IceTSizeType color_size,
+                                      IceTEnum depth_format,
+                                      IceTSizeType first_pixel,
+                                      IceTSizeType num_pixels)
 {
-    IceTEnum color_format;
+    IceTSizeType depth_size = depthPixelSize(depth_format);
+    IceTSizeType pixel;
+
+    for (pixel = first_pixel; pixel < num_pixels; pixel++) {
+        const IceTByte *front_depth = front->depth + pixel*front->depth_stride;
+        const IceTByte *back_depth = back->depth + pixel*back->depth_stride;
+        const IceTByte *src_color;
+        const IceTByte *src_depth;
+        IceTByte *dest_color = dest->color + pixel*dest->color_stride;
+        IceTByte *dest_depth = dest->depth + pixel*dest->depth_stride;
+        IceTBoolean front_wins;
 
-    if (icetImageIsNull(image)) return;
+        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+            IceTFloat front_value, back_value;
+            memcpy(&front_value, front_depth, sizeof(IceTFloat));
+            memcpy(&back_value, back_depth, sizeof(IceTFloat));
+            front_wins = (front_value < back_value);
+        } else {
+            IceTUShort front_value, back_value;
+            memcpy(&front_value, front_depth, sizeof(IceTUShort));
+            memcpy(&back_value, back_depth, sizeof(IceTUShort));
+            front_wins = (front_value < back_value);
+        }
 
-    ICET_TEST_IMAGE_HEADER(image);
+        if (front_wins) {
+            src_color = front->color + pixel*front->color_stride;
+            src_depth = front_depth;
+        } else {
+            src_color = back->color + pixel*back->color_stride;
+            src_depth = back_depth;
+        }
+        if (src_color != dest_color) {
+            memcpy(dest_color, src_color, color_size);
+            memcpy(dest_depth, src_depth, depth_size);
+        }
+    }
+}
 
-    if (icetIsEnabled(ICET_COMPOSITE_ONE_BUFFER)) {
-        color_format = icetImageGetColorFormat(image);
-        if (color_format != ICET_IMAGE_COLOR_NONE) {
-          /* Set to no depth information. */
-            ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX]
-                = ICET_IMAGE_DEPTH_NONE;
-          /* Reset the image size (changes actual buffer size). */
-            icetImageSetDimensions(image,
-                                   icetImageGetWidth(image),
-                                   icetImageGetHeight(image));
+static void icetZCompositeSpanColorubDepthf(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             sizeof(IceTUInt), sizeof(IceTFloat))) {
+        for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+            IceTSizeType color_offset = pixel*sizeof(IceTUInt);
+            IceTSizeType depth_offset = pixel*sizeof(IceTFloat);
+            __m128 front_depth
+                = _mm_loadu_ps((const IceTFloat *)(front->depth+depth_offset));
+            __m128 back_depth
+                = _mm_loadu_ps((const IceTFloat *)(back->depth+depth_offset));
+            __m128 mask = _mm_cmplt_ps(front_depth, back_depth);
+            __m128i color_mask = _mm_castps_si128(mask);
+            __m128i front_color
+                = _mm_loadu_si128((const __m128i *)(front->color+color_offset));
+            __m128i back_color
+                = _mm_loadu_si128((const __m128i *)(back->color+color_offset));
+            _mm_storeu_ps((IceTFloat *)(dest->depth + depth_offset),
+                          _mm_or_ps(_mm_and_ps(mask, front_depth),
+                                    _mm_andnot_ps(mask, back_depth)));
+            _mm_storeu_si128((__m128i *)(dest->color + color_offset),
+                             ICET_SELECT_SI128(color_mask,
+                                               front_color,
+                                               back_color));
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         sizeof(IceTUInt),
+                                         sizeof(IceTFloat))) {
+      /* Each 8-byte pixel is a color followed by its depth, so 2 pixels fit
+         in a register.  Shuffle the depths of 4 pixels together to compare
+         them and widen the result to select whole pixels. */
+        for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+            IceTSizeType offset = pixel*(sizeof(IceTUInt)+sizeof(IceTFloat));
+            __m128 front01
+                = _mm_loadu_ps((const IceTFloat *)(front->color + offset));
+            __m128 front23
+                = _mm_loadu_ps((const IceTFloat *)(front->color + offset+16));
+            __m128 back01
+                = _mm_loadu_ps((const IceTFloat *)(back->color + offset));
+            __m128 back23
+                = _mm_loadu_ps((const IceTFloat *)(back->color + offset+16));
+            __m128 mask = _mm_cmplt_ps(
+                             _mm_shuffle_ps(front01, front23,
+                                            _MM_SHUFFLE(3,1,3,1)),
+                             _mm_shuffle_ps(back01, back23,
+                                            _MM_SHUFFLE(3,1,3,1)));
+            __m128 mask01 = _mm_unpacklo_ps(mask, mask);
+            __m128 mask23 = _mm_unpackhi_ps(mask, mask);
+            _mm_storeu_ps((IceTFloat *)(dest->color + offset),
+                          _mm_or_ps(_mm_and_ps(mask01, front01),
+                                    _mm_andnot_ps(mask01, back01)));
+            _mm_storeu_ps((IceTFloat *)(dest->color + offset + 16),
+                          _mm_or_ps(_mm_and_ps(mask23, front23),
+                                    _mm_andnot_ps(mask23, back23)));
+        }
+        if (pixel < num_pixels) {
+            IceTSizeType offset = pixel*(sizeof(IceTUInt)+sizeof(IceTFloat));
+            int count = (int)(num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskf(front->color + offset,
+                                            back->color + offset,
+                                            sizeof(IceTUInt),
+                                            count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front->color + offset,
+                                           back->color + offset,
+                                           dest->color + offset,
+                                           sizeof(IceTUInt)+sizeof(IceTFloat));
+            pixel = num_pixels;
         }
     }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              sizeof(IceTUInt), ICET_IMAGE_DEPTH_FLOAT,
+                              pixel, num_pixels);
 }
 
-void icetImageAdjustForInput(IceTImage image)
+static void icetZCompositeSpanColorubDepthus(const IceTPixelSpan *front,
+                                             const IceTPixelSpan *back,
+                                             const IceTPixelSpan *dest,
+                                             IceTSizeType num_pixels)
 {
-    IceTEnum color_format, depth_format;
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             sizeof(IceTUInt), sizeof(IceTUShort))) {
+        for ( ; pixel + 8 <= num_pixels; pixel += 8) {
+            IceTSizeType color_offset = pixel*sizeof(IceTUInt);
+            IceTSizeType depth_offset = pixel*sizeof(IceTUShort);
+            __m128i front_depth
+                = _mm_loadu_si128((const __m128i *)(front->depth+depth_offset));
+            __m128i back_depth
+                = _mm_loadu_si128((const __m128i *)(back->depth+depth_offset));
+            __m128i mask = icetCompareLessEpu16(front_depth, back_depth);
+            __m128i color_mask;
+            int half;
+            _mm_storeu_si128((__m128i *)(dest->depth + depth_offset),
+                             ICET_SELECT_SI128(mask, front_depth, back_depth));
+          /* Widen the 16-bit mask of each pixel to its 32-bit color. */
+            for (half = 0; half < 2; half++) {
+                const __m128i *front_color
+                    = (const __m128i *)(front->color + color_offset) + half;
+                const __m128i *back_color
+                    = (const __m128i *)(back->color + color_offset) + half;
+                __m128i *dest_color
+                    = (__m128i *)(dest->color + color_offset) + half;
+                color_mask = (  (half == 0)
+                              ? _mm_unpacklo_epi16(mask, mask)
+                              : _mm_unpackhi_epi16(mask, mask) );
+                _mm_storeu_si128(dest_color,
+                                 ICET_SELECT_SI128(
+                                               color_mask,
+                                               _mm_loadu_si128(front_color),
+                                               _mm_loadu_si128(back_color)));
+            }
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         sizeof(IceTUInt),
+                                         sizeof(IceTUShort))) {
+        const IceTSizeType pixel_size = sizeof(IceTUInt) + sizeof(IceTUShort);
+        const IceTByte *front_pixels = front->color;
+        const IceTByte *back_pixels = back->color;
+        IceTByte *dest_pixels = dest->color;
+        for ( ; pixel < num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*pixel_size;
+            int count = (int)MIN(8, num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskus(front_pixels + offset,
+                                             back_pixels + offset,
+                                             sizeof(IceTUInt),
+                                             count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front_pixels + offset,
+                                           back_pixels + offset,
+                                           dest_pixels + offset,
+                                           pixel_size);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              sizeof(IceTUInt), ICET_IMAGE_DEPTH_UNORM16,
+                              pixel, num_pixels);
+}
 
-    if (icetImageIsNull(image)) return;
+static void icetZCompositeSpanColorfDepthf(const IceTPixelSpan *front,
+                                           const IceTPixelSpan *back,
+                                           const IceTPixelSpan *dest,
+                                           IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             4*sizeof(IceTFloat), sizeof(IceTFloat))) {
+        for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+            IceTSizeType color_offset = pixel*4*sizeof(IceTFloat);
+            IceTSizeType depth_offset = pixel*sizeof(IceTFloat);
+            __m128 front_depth
+                = _mm_loadu_ps((const IceTFloat *)(front->depth+depth_offset));
+            __m128 back_depth
+                = _mm_loadu_ps((const IceTFloat *)(back->depth+depth_offset));
+            __m128 mask = _mm_cmplt_ps(front_depth, back_depth);
+            _mm_storeu_ps((IceTFloat *)(dest->depth + depth_offset),
+                          _mm_or_ps(_mm_and_ps(mask, front_depth),
+                                    _mm_andnot_ps(mask, back_depth)));
+            icetSelectColorsf(_mm_castps_si128(mask),
+                              front->color + color_offset,
+                              back->color + color_offset,
+                              dest->color + color_offset);
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         4*sizeof(IceTFloat),
+                                         sizeof(IceTFloat))) {
+        const IceTSizeType pixel_size = 4*sizeof(IceTFloat) + sizeof(IceTFloat);
+        const IceTByte *front_pixels = front->color;
+        const IceTByte *back_pixels = back->color;
+        IceTByte *dest_pixels = dest->color;
+        for ( ; pixel < num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*pixel_size;
+            int count = (int)MIN(8, num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskf(front_pixels + offset,
+                                            back_pixels + offset,
+                                            4*sizeof(IceTFloat),
+                                            count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front_pixels + offset,
+                                           back_pixels + offset,
+                                           dest_pixels + offset,
+                                           pixel_size);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              4*sizeof(IceTFloat), ICET_IMAGE_DEPTH_FLOAT,
+                              pixel, num_pixels);
+}
 
-    ICET_TEST_IMAGE_HEADER(image);
+static void icetZCompositeSpanColorfDepthus(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             4*sizeof(IceTFloat), sizeof(IceTUShort))) {
+        for ( ; pixel + 8 <= num_pixels; pixel += 8) {
+            IceTSizeType color_offset = pixel*4*sizeof(IceTFloat);
+            IceTSizeType depth_offset = pixel*sizeof(IceTUShort);
+            __m128i front_depth
+                = _mm_loadu_si128((const __m128i *)(front->depth+depth_offset));
+            __m128i back_depth
+                = _mm_loadu_si128((const __m128i *)(back->depth+depth_offset));
+            __m128i mask = icetCompareLessEpu16(front_depth, back_depth);
+            _mm_storeu_si128((__m128i *)(dest->depth + depth_offset),
+                             ICET_SELECT_SI128(mask, front_depth, back_depth));
+          /* Widen the 16-bit mask of each pixel to 32 bits, 4 pixels at a
+             time. */
+            icetSelectColorsf(_mm_unpacklo_epi16(mask, mask),
+                              front->color + color_offset,
+                              back->color + color_offset,
+                              dest->color + color_offset);
+            icetSelectColorsf(_mm_unpackhi_epi16(mask, mask),
+                              front->color + color_offset + 64,
+                              back->color + color_offset + 64,
+                              dest->color + color_offset + 64);
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         4*sizeof(IceTFloat),
+                                         sizeof(IceTUShort))) {
+        const IceTSizeType pixel_size
+            = 4*sizeof(IceTFloat) + sizeof(IceTUShort);
+        const IceTByte *front_pixels = front->color;
+        const IceTByte *back_pixels = back->color;
+        IceTByte *dest_pixels = dest->color;
+        for ( ; pixel < num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*pixel_size;
+            int count = (int)MIN(8, num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskus(front_pixels + offset,
+                                             back_pixels + offset,
+                                             4*sizeof(IceTFloat),
+                                             count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front_pixels + offset,
+                                           back_pixels + offset,
+                                           dest_pixels + offset,
+                                           pixel_size);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              4*sizeof(IceTFloat), ICET_IMAGE_DEPTH_UNORM16,
+                              pixel, num_pixels);
+}
 
-    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
-    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
+static void icetZCompositeSpanColorusDepthf(const IceTPixelSpan *front,
+                                            const IceTPixelSpan *back,
+                                            const IceTPixelSpan *dest,
+                                            IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             4*sizeof(IceTUShort), sizeof(IceTFloat))) {
+        for ( ; pixel + 4 <= num_pixels; pixel += 4) {
+            IceTSizeType color_offset = pixel*4*sizeof(IceTUShort);
+            IceTSizeType depth_offset = pixel*sizeof(IceTFloat);
+            const __m128i *front_color
+                = (const __m128i *)(front->color + color_offset);
+            const __m128i *back_color
+                = (const __m128i *)(back->color + color_offset);
+            __m128i *dest_color = (__m128i *)(dest->color + color_offset);
+            __m128 front_depth
+                = _mm_loadu_ps((const IceTFloat *)(front->depth+depth_offset));
+            __m128 back_depth
+                = _mm_loadu_ps((const IceTFloat *)(back->depth+depth_offset));
+            __m128 mask = _mm_cmplt_ps(front_depth, back_depth);
+            __m128i color_mask = _mm_castps_si128(mask);
+            __m128i front_color_lo = _mm_loadu_si128(front_color + 0);
+            __m128i front_color_hi = _mm_loadu_si128(front_color + 1);
+            __m128i back_color_lo = _mm_loadu_si128(back_color + 0);
+            __m128i back_color_hi = _mm_loadu_si128(back_color + 1);
+            _mm_storeu_ps((IceTFloat *)(dest->depth + depth_offset),
+                          _mm_or_ps(_mm_and_ps(mask, front_depth),
+                                    _mm_andnot_ps(mask, back_depth)));
+          /* Widen the 32-bit mask of each pixel to its 64-bit color. */
+            _mm_storeu_si128(dest_color + 0,
+                             ICET_SELECT_SI128(
+                                   _mm_unpacklo_epi32(color_mask, color_mask),
+                                   front_color_lo,
+                                   back_color_lo));
+            _mm_storeu_si128(dest_color + 1,
+                             ICET_SELECT_SI128(
+                                   _mm_unpackhi_epi32(color_mask, color_mask),
+                                   front_color_hi,
+                                   back_color_hi));
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         4*sizeof(IceTUShort),
+                                         sizeof(IceTFloat))) {
+        const IceTSizeType pixel_size
+            = 4*sizeof(IceTUShort) + sizeof(IceTFloat);
+        const IceTByte *front_pixels = front->color;
+        const IceTByte *back_pixels = back->color;
+        IceTByte *dest_pixels = dest->color;
+        for ( ; pixel < num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*pixel_size;
+            int count = (int)MIN(8, num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskf(front_pixels + offset,
+                                            back_pixels + offset,
+                                            4*sizeof(IceTUShort),
+                                            count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front_pixels + offset,
+                                           back_pixels + offset,
+                                           dest_pixels + offset,
+                                           pixel_size);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              4*sizeof(IceTUShort), ICET_IMAGE_DEPTH_FLOAT,
+                              pixel, num_pixels);
+}
 
-  /* Reset to the specified image format. */
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX] = color_format;
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX] = depth_format;
+static void icetZCompositeSpanColorusDepthus(const IceTPixelSpan *front,
+                                             const IceTPixelSpan *back,
+                                             const IceTPixelSpan *dest,
+                                             IceTSizeType num_pixels)
+{
+    IceTSizeType pixel = 0;
+#ifdef ICET_USE_SSE2
+    if (icetPixelSpansPlanar(front, back, dest,
+                             4*sizeof(IceTUShort), sizeof(IceTUShort))) {
+        for ( ; pixel + 8 <= num_pixels; pixel += 8) {
+            IceTSizeType color_offset = pixel*4*sizeof(IceTUShort);
+            IceTSizeType depth_offset = pixel*sizeof(IceTUShort);
+            const __m128i *front_color
+                = (const __m128i *)(front->color + color_offset);
+            const __m128i *back_color
+                = (const __m128i *)(back->color + color_offset);
+            __m128i *dest_color = (__m128i *)(dest->color + color_offset);
+            __m128i front_depth
+                = _mm_loadu_si128((const __m128i *)(front->depth+depth_offset));
+            __m128i back_depth
+                = _mm_loadu_si128((const __m128i *)(back->depth+depth_offset));
+            __m128i mask = icetCompareLessEpu16(front_depth, back_depth);
+            __m128i mask32[2];
+            int block;
+            _mm_storeu_si128((__m128i *)(dest->depth + depth_offset),
+                             ICET_SELECT_SI128(mask, front_depth, back_depth));
+          /* Widen the 16-bit mask of each pixel to its 64-bit color, 2 pixels
+             at a time. */
+            mask32[0] = _mm_unpacklo_epi16(mask, mask);
+            mask32[1] = _mm_unpackhi_epi16(mask, mask);
+            for (block = 0; block < 4; block++) {
+                __m128i color_mask
+                    = (  ((block & 1) == 0)
+                       ? _mm_unpacklo_epi32(mask32[block/2], mask32[block/2])
+                       : _mm_unpackhi_epi32(mask32[block/2], mask32[block/2]));
+                _mm_storeu_si128(dest_color + block,
+                                 ICET_SELECT_SI128(
+                                        color_mask,
+                                        _mm_loadu_si128(front_color + block),
+                                        _mm_loadu_si128(back_color + block)));
+            }
+        }
+    } else if (icetPixelSpansInterleaved(front, back, dest,
+                                         4*sizeof(IceTUShort),
+                                         sizeof(IceTUShort))) {
+        const IceTSizeType pixel_size
+            = 4*sizeof(IceTUShort) + sizeof(IceTUShort);
+        const IceTByte *front_pixels = front->color;
+        const IceTByte *back_pixels = back->color;
+        IceTByte *dest_pixels = dest->color;
+        for ( ; pixel < num_pixels; pixel += 8) {
+            IceTSizeType offset = pixel*pixel_size;
+            int count = (int)MIN(8, num_pixels - pixel);
+            unsigned int front_mask
+                = icetInterleavedFrontMaskus(front_pixels + offset,
+                                             back_pixels + offset,
+                                             4*sizeof(IceTUShort),
+                                             count);
+            ICET_SELECT_INTERLEAVED_PIXELS(front_mask, count,
+                                           front_pixels + offset,
+                                           back_pixels + offset,
+                                           dest_pixels + offset,
+                                           pixel_size);
+        }
+    }
+#endif /*ICET_USE_SSE2*/
+    icetZCompositeSpanGeneric(front, back, dest,
+                              4*sizeof(IceTUShort), ICET_IMAGE_DEPTH_UNORM16,
+                              pixel, num_pixels);
+}
 
-  /* Reset the image size (changes actual buffer size). */
-    icetImageSetDimensions(image,
-                           icetImageGetWidth(image),
-                           icetImageGetHeight(image));
+static void icetCopyPixelSpan(const IceTPixelSpan *in,
+                              const IceTPixelSpan *out,
+                              IceTSizeType color_size,
+                              IceTSizeType depth_size,
+                              IceTSizeType num_pixels)
+{
+    IceTSizeType pixel_size = color_size + depth_size;
+    IceTSizeType pixel;
+
+    if (   (in->color_stride == pixel_size)
+        && (out->color_stride == pixel_size)
+        && (in->depth == in->color + color_size)
+        && (out->depth == out->color + color_size) ) {
+        /* Both interleaved. */
+        memcpy(out->color, in->color, num_pixels*pixel_size);
+        return;
+    }
+
+    if ((in->color_stride == color_size) && (out->color_stride == color_size)) {
+        memcpy(out->color, in->color, num_pixels*color_size);
+    } else {
+        for (pixel = 0; pixel < num_pixels; pixel++) {
+            memcpy(out->color + pixel*out->color_stride,
+                   in->color + pixel*in->color_stride,
+                   color_size);
+        }
+    }
+    if ((in->depth_stride == depth_size) && (out->depth_stride == depth_size)) {
+        memcpy(out->depth, in->depth, num_pixels*depth_size);
+    } else {
+        for (pixel = 0; pixel < num_pixels; pixel++) {
+            memcpy(out->depth + pixel*out->depth_stride,
+                   in->depth + pixel*in->depth_stride,
+                   depth_size);
+        }
+    }
 }
 
-IceTEnum icetImageGetColorFormat(const IceTImage image)
+static IceTSizeType icetSparseImageCopyRuns(const IceTByte **in_p,
+                                            IceTByte **out_p,
+                                            IceTSizeType max_pixels,
+                                            IceTBoolean compact,
+                                            IceTSizeType pixel_size,
+                                            IceTSeekIndexBuilder *out_index,
+                                            IceTSizeType pixel)
 {
-    ICET_TEST_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return ICET_IMAGE_COLOR_NONE;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX];
+    const IceTByte *in = *in_p;
+    IceTByte *out = *out_p;
+    IceTSizeType run_length_size = RUN_LENGTH_SIZE_OF(compact);
+    IceTSizeType num_copied = 0;
+
+    /* Each run is copied with its run length as soon as it is found.  Finding
+       all the runs first and copying them with one memcpy is slower because
+       the search then waits on memory for every run length. */
+    while (num_copied < max_pixels) {
+        IceTSizeType num_inactive = GET_INACTIVE_RUN_LENGTH(in, compact);
+        IceTSizeType num_active = GET_ACTIVE_RUN_LENGTH(in, compact);
+        IceTSizeType num_bytes;
+        if (num_copied + num_inactive + num_active > max_pixels) break;
+        SEEK_INDEX_ADD_RUN(out_index, out, pixel + num_copied);
+        num_bytes = run_length_size + num_active*pixel_size;
+        memcpy(out, in, num_bytes);
+        num_copied += num_inactive + num_active;
+        in += num_bytes;
+        out += num_bytes;
+    }
+
+    *in_p = in;
+    *out_p = out;
+    return num_copied;
 }
-IceTEnum icetImageGetDepthFormat(const IceTImage image)
+
+static void icetBlendSpanColorub(const IceTPixelSpan *front,
+                                 const IceTPixelSpan *back,
+                                 const IceTPixelSpan *dest,
+                                 IceTSizeType num_pixels)
 {
-    ICET_TEST_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return ICET_IMAGE_DEPTH_NONE;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX];
+    icetBlendUByteArray((const IceTUByte *)front->color,
+                        (const IceTUByte *)back->color,
+                        (IceTUByte *)dest->color,
+                        num_pixels);
 }
-IceTSizeType icetImageGetWidth(const IceTImage image)
+
+static void icetBlendSpanColorf(const IceTPixelSpan *front,
+                                const IceTPixelSpan *back,
+                                const IceTPixelSpan *dest,
+                                IceTSizeType num_pixels)
 {
-    ICET_TEST_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX];
+    IceTSizeType pixel;
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        IceTFloat front_value[4], back_value[4], dest_value[4];
+        memcpy(front_value,
+               front->color + pixel*front->color_stride,
+               4*sizeof(IceTFloat));
+        memcpy(back_value,
+               back->color + pixel*back->color_stride,
+               4*sizeof(IceTFloat));
+        ICET_BLEND_FLOAT(front_value, back_value, dest_value);
+        memcpy(dest->color + pixel*dest->color_stride,
+               dest_value,
+               4*sizeof(IceTFloat));
+    }
 }
-IceTSizeType icetImageGetHeight(const IceTImage image)
+
+static void icetBlendSpanColorus(const IceTPixelSpan *front,
+                                 const IceTPixelSpan *back,
+                                 const IceTPixelSpan *dest,
+                                 IceTSizeType num_pixels)
 {
-    ICET_TEST_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX];
+    IceTSizeType pixel;
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        IceTUShort front_value[4], back_value[4], dest_value[4];
+        memcpy(front_value,
+               front->color + pixel*front->color_stride,
+               4*sizeof(IceTUShort));
+        memcpy(back_value,
+               back->color + pixel*back->color_stride,
+               4*sizeof(IceTUShort));
+        icetBlendHalfPixel(front_value, back_value, dest_value);
+        memcpy(dest->color + pixel*dest->color_stride,
+               dest_value,
+               4*sizeof(IceTUShort));
+    }
 }
-IceTSizeType icetImageGetNumPixels(const IceTImage image)
+
+static IceTBoolean icetChannelCompositeMode(IceTEnum composite_mode)
 {
-    ICET_TEST_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX]
-            * ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] );
+    return (IceTBoolean)(   (composite_mode
+                             == ICET_COMPOSITE_MODE_MAX_INTENSITY)
+                         || (composite_mode == ICET_COMPOSITE_MODE_ADD) );
 }
 
-IceTEnum icetSparseImageGetColorFormat(const IceTSparseImage image)
+static IceTSizeType icetScanChannelColor(const IceTByte *color,
+                                         IceTEnum color_format,
+                                         IceTSizeType stride,
+                                         IceTSizeType num_pixels,
+                                         IceTBoolean active)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return ICET_IMAGE_COLOR_NONE;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX];
+    IceTSizeType pixel;
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        for (pixel = 0; pixel < num_pixels; pixel++, color += stride) {
+            if ((*(const IceTUInt *)color != 0) != active) break;
+        }
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        for (pixel = 0; pixel < num_pixels; pixel++, color += stride) {
+            const IceTFloat *value = (const IceTFloat *)color;
+            if (   (   (value[0] != 0.0f) || (value[1] != 0.0f)
+                    || (value[2] != 0.0f) || (value[3] != 0.0f) )
+                != active ) break;
+        }
+    } else {
+      /* A half is zero of either sign if all but its sign bit are zero. */
+        for (pixel = 0; pixel < num_pixels; pixel++, color += stride) {
+            const IceTUShort *value = (const IceTUShort *)color;
+            if (   (((value[0] | value[1] | value[2] | value[3]) & 0x7FFF) != 0)
+                != active ) break;
+        }
+    }
+    return pixel;
 }
-IceTEnum icetSparseImageGetDepthFormat(const IceTSparseImage image)
+
+/* Takes the sum (if add is true) or maximum of each channel of num_pixels
+   colors of one format.  The add flag is a constant in each of the span
+   functions below, so the compiler can drop the test from the loop. */
+static void icetChannelSpanColorub(IceTBoolean add,
+                                   const IceTPixelSpan *front,
+                                   const IceTPixelSpan *back,
+                                   const IceTPixelSpan *dest,
+                                   IceTSizeType num_pixels)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return ICET_IMAGE_DEPTH_NONE;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX];
+    IceTSizeType pixel;
+    int channel;
+
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        const IceTUByte *front_color
+            = (const IceTUByte *)(front->color + pixel*front->color_stride);
+        const IceTUByte *back_color
+            = (const IceTUByte *)(back->color + pixel*back->color_stride);
+        IceTUByte *dest_color
+            = (IceTUByte *)(dest->color + pixel*dest->color_stride);
+        for (channel = 0; channel < 4; channel++) {
+            IceTUInt sum = (IceTUInt)front_color[channel]
+                         + (IceTUInt)back_color[channel];
+            dest_color[channel] = (IceTUByte)(
+                  add
+                ? MIN(sum, 255)
+                : MAX(front_color[channel], back_color[channel]) );
+        }
+    }
 }
-IceTSizeType icetSparseImageGetWidth(const IceTSparseImage image)
+static void icetChannelSpanColorf(IceTBoolean add,
+                                  const IceTPixelSpan *front,
+                                  const IceTPixelSpan *back,
+                                  const IceTPixelSpan *dest,
+                                  IceTSizeType num_pixels)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX];
+    IceTSizeType pixel;
+    int channel;
+
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        const IceTFloat *front_color
+            = (const IceTFloat *)(front->color + pixel*front->color_stride);
+        const IceTFloat *back_color
+            = (const IceTFloat *)(back->color + pixel*back->color_stride);
+        IceTFloat *dest_color
+            = (IceTFloat *)(dest->color + pixel*dest->color_stride);
+        for (channel = 0; channel < 4; channel++) {
+            dest_color[channel]
+                = (  add
+                   ? front_color[channel] + back_color[channel]
+                   : MAX(front_color[channel], back_color[channel]) );
+        }
+    }
 }
-IceTSizeType icetSparseImageGetHeight(const IceTSparseImage image)
+static void icetChannelSpanColorus(IceTBoolean add,
+                                   const IceTPixelSpan *front,
+                                   const IceTPixelSpan *back,
+                                   const IceTPixelSpan *dest,
+                                   IceTSizeType num_pixels)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX];
+    IceTSizeType pixel;
+    int channel;
+
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        IceTFloat front_color[4], back_color[4], dest_color[4];
+        icetHalfToFloatArray(
+            (const IceTUShort *)(front->color + pixel*front->color_stride),
+            front_color, 4);
+        icetHalfToFloatArray(
+            (const IceTUShort *)(back->color + pixel*back->color_stride),
+            back_color, 4);
+        for (channel = 0; channel < 4; channel++) {
+            dest_color[channel]
+                = (  add
+                   ? front_color[channel] + back_color[channel]
+                   : MAX(front_color[channel], back_color[channel]) );
+        }
+        icetFloatToHalfArray(
+            dest_color,
+            (IceTUShort *)(dest->color + pixel*dest->color_stride), 4);
+    }
 }
-IceTSizeType icetSparseImageGetNumPixels(const IceTSparseImage image)
+
+static void icetMaxSpanColorub(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX]
-            * ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] );
+    icetChannelSpanColorub(ICET_FALSE, front, back, dest, num_pixels);
 }
-IceTSizeType icetSparseImageGetCompressedBufferSize(
-                                             const IceTSparseImage image)
+static void icetMaxSpanColorf(const IceTPixelSpan *front,
+                              const IceTPixelSpan *back,
+                              const IceTPixelSpan *dest,
+                              IceTSizeType num_pixels)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-    if (!image.opaque_internals) return 0;
-    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+    icetChannelSpanColorf(ICET_FALSE, front, back, dest, num_pixels);
 }
-
-void icetImageSetDimensions(IceTImage image,
-                            IceTSizeType width,
-                            IceTSizeType height)
+static void icetMaxSpanColorus(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels)
 {
-    ICET_TEST_IMAGE_HEADER(image);
+    icetChannelSpanColorus(ICET_FALSE, front, back, dest, num_pixels);
+}
+static void icetAddSpanColorub(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels)
+{
+    icetChannelSpanColorub(ICET_TRUE, front, back, dest, num_pixels);
+}
+static void icetAddSpanColorf(const IceTPixelSpan *front,
+                              const IceTPixelSpan *back,
+                              const IceTPixelSpan *dest,
+                              IceTSizeType num_pixels)
+{
+    icetChannelSpanColorf(ICET_TRUE, front, back, dest, num_pixels);
+}
+static void icetAddSpanColorus(const IceTPixelSpan *front,
+                               const IceTPixelSpan *back,
+                               const IceTPixelSpan *dest,
+                               IceTSizeType num_pixels)
+{
+    icetChannelSpanColorus(ICET_TRUE, front, back, dest, num_pixels);
+}
 
-    if (icetImageIsNull(image)) {
-        icetRaiseError("Cannot set number of pixels on null image.",
-                       ICET_INVALID_VALUE);
-        return;
-    }
+static void icetChannelCompositeSpan(IceTEnum composite_mode,
+                                     IceTEnum color_format,
+                                     const IceTPixelSpan *front,
+                                     const IceTPixelSpan *back,
+                                     const IceTPixelSpan *dest,
+                                     IceTSizeType num_pixels)
+{
+    IceTBoolean add = (IceTBoolean)(composite_mode == ICET_COMPOSITE_MODE_ADD);
 
-    if (   width*height
-         > ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX] ){
-        icetRaiseError("Cannot set an image size to greater than what the"
-                       " image was originally created.", ICET_INVALID_VALUE);
-        return;
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetChannelSpanColorub(add, front, back, dest, num_pixels);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        icetChannelSpanColorf(add, front, back, dest, num_pixels);
+    } else {
+        icetChannelSpanColorus(add, front, back, dest, num_pixels);
     }
+}
 
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX] = (IceTInt)width;
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)height;
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
-        = (IceTInt)icetImageBufferSizeType(icetImageGetColorFormat(image),
-                                           icetImageGetDepthFormat(image),
-                                           width,
-                                           height);
+void icetChannelCompositeArrayWithColor(IceTEnum composite_mode,
+                                        IceTEnum color_format,
+                                        IceTVoid *colors,
+                                        const IceTVoid *background,
+                                        IceTSizeType num_pixels)
+{
+    IceTPixelSpan color_span;
+    IceTPixelSpan background_span;
+
+    color_span.color = colors;
+    color_span.color_stride = colorPixelSize(color_format);
+    color_span.depth = NULL;
+    color_span.depth_stride = 0;
+
+  /* A stride of 0 uses the one background pixel for every color. */
+    background_span.color = (IceTByte *)background;
+    background_span.color_stride = 0;
+    background_span.depth = NULL;
+    background_span.depth_stride = 0;
+
+    icetChannelCompositeSpan(composite_mode,
+                             color_format,
+                             &color_span,
+                             &background_span,
+                             &color_span,
+                             num_pixels);
 }
 
-void icetSparseImageSetDimensions(IceTSparseImage image,
-                                  IceTSizeType width,
-                                  IceTSizeType height)
+static void icetFragmentsFromPixel(const IceTByte *color,
+                                   IceTEnum color_format,
+                                   const IceTByte *depth,
+                                   IceTEnum depth_format,
+                                   IceTInt num_fragments,
+                                   IceTByte *dest)
 {
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    IceTFloat fragment[5];
 
-    if (image.opaque_internals == NULL) {
-        icetRaiseError("Cannot set number of pixels on null image.",
-                       ICET_INVALID_VALUE);
-        return;
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        const IceTUByte *in = (const IceTUByte *)color;
+        fragment[0] = (IceTFloat)in[0]/255.0f;
+        fragment[1] = (IceTFloat)in[1]/255.0f;
+        fragment[2] = (IceTFloat)in[2]/255.0f;
+        fragment[3] = (IceTFloat)in[3]/255.0f;
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        memcpy(fragment, color, 4*sizeof(IceTFloat));
+    } else {
+        IceTUShort half[4];
+        memcpy(half, color, 4*sizeof(IceTUShort));
+        icetHalfToFloatArray(half, fragment, 4);
     }
 
-    if (   width*height
-         > ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX] ){
-        icetRaiseError("Cannot set an image size to greater than what the"
-                       " image was originally created.", ICET_INVALID_VALUE);
-        return;
+    if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+        memcpy(fragment + 4, depth, sizeof(IceTFloat));
+    } else {
+        IceTUShort unorm;
+        memcpy(&unorm, depth, sizeof(IceTUShort));
+        fragment[4] = (IceTFloat)unorm/65535.0f;
     }
 
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX] = (IceTInt)width;
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)height;
-
-  /* Make sure the runlengths are valid. */
-    icetClearSparseImage(image);
+    memcpy(dest, fragment, 5*sizeof(IceTFloat));
+    memset(dest + 5*sizeof(IceTFloat),
+           0,
+           5*sizeof(IceTFloat)*(num_fragments - 1));
 }
 
-static void icetSparseImageSetActualSize(IceTSparseImage image,
-                                         const IceTVoid *data_end)
+/* Merges the fragments of one pixel.  The inputs hold num_fragments
+   fragments each, and the used ones (those with nonzero alpha) come first in
+   front to back order. */
+static void icetMergeFragments(const IceTFloat *front,
+                               const IceTFloat *back,
+                               IceTFloat *dest,
+                               IceTInt num_fragments)
 {
-    /* Compute the actual number of bytes used to store the image. */
-    IceTPointerArithmetic buffer_begin
-        =(IceTPointerArithmetic)ICET_IMAGE_HEADER(image);
-    IceTPointerArithmetic buffer_end
-        =(IceTPointerArithmetic)data_end;
-    IceTPointerArithmetic compressed_size = buffer_end - buffer_begin;
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
-        = (IceTInt)compressed_size;
-}
+    IceTInt front_index = 0;
+    IceTInt back_index = 0;
+    IceTInt dest_index = 0;
+
+#define FRONT_LEFT()                                                    \
+    ((front_index < num_fragments) && (front[5*front_index + 3] != 0.0f))
+#define BACK_LEFT()                                                     \
+    ((back_index < num_fragments) && (back[5*back_index + 3] != 0.0f))
+/* Points next at the nearer of the fragments left.  Front wins ties. */
+#define NEXT_FRAGMENT(next)                                             \
+    if (   !FRONT_LEFT()                                                \
+        || (   BACK_LEFT()                                              \
+            && (back[5*back_index + 4] < front[5*front_index + 4]) ) ) {\
+        next = back + 5*back_index;                                     \
+        back_index++;                                                   \
+    } else {                                                            \
+        next = front + 5*front_index;                                   \
+        front_index++;                                                  \
+    }
 
-const IceTVoid *icetImageGetColorConstVoid(const IceTImage image,
-                                           IceTSizeType *pixel_size)
-{
-    if (pixel_size) {
-        IceTEnum color_format = icetImageGetColorFormat(image);
-        *pixel_size = colorPixelSize(color_format);
+    while ((dest_index < num_fragments) && (FRONT_LEFT() || BACK_LEFT())) {
+        const IceTFloat *next;
+        NEXT_FRAGMENT(next);
+        memcpy(dest + 5*dest_index, next, 5*sizeof(IceTFloat));
+        dest_index++;
     }
 
-    return ICET_IMAGE_DATA(image);
-}
-IceTVoid *icetImageGetColorVoid(IceTImage image, IceTSizeType *pixel_size)
-{
-    const IceTVoid *const_buffer = icetImageGetColorConstVoid(image, pixel_size);
+    if (dest_index < num_fragments) {
+        memset(dest + 5*dest_index,
+               0,
+               5*sizeof(IceTFloat)*(num_fragments - dest_index));
+    } else {
+      /* Blend the fragments that do not fit behind the last one so that
+         their color is not lost.  The last fragment keeps its depth. */
+        IceTFloat *last = dest + 5*(num_fragments - 1);
+        while (FRONT_LEFT() || BACK_LEFT()) {
+            const IceTFloat *next;
+            NEXT_FRAGMENT(next);
+            ICET_BLEND_FLOAT(last, next, last);
+        }
+    }
 
-    /* This const cast is OK because we actually got the pointer from a
-       non-const image. */
-    return (IceTVoid *)const_buffer;
+#undef FRONT_LEFT
+#undef BACK_LEFT
+#undef NEXT_FRAGMENT
 }
 
-const IceTUByte *icetImageGetColorcub(const IceTImage image)
+static void icetMergeFragmentSpan(const IceTPixelSpan *front,
+                                  const IceTPixelSpan *back,
+                                  const IceTPixelSpan *dest,
+                                  IceTSizeType num_pixels,
+                                  IceTInt num_fragments)
 {
-    IceTEnum color_format = icetImageGetColorFormat(image);
-
-    if (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE) {
-        icetRaiseError("Color format is not of type ubyte.",
-                       ICET_INVALID_OPERATION);
-        return NULL;
+    IceTSizeType fragments_size = 5*sizeof(IceTFloat)*num_fragments;
+    IceTSizeType pixel;
+
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        IceTFloat front_value[5*ICET_MAX_FRAGMENTS_LIMIT];
+        IceTFloat back_value[5*ICET_MAX_FRAGMENTS_LIMIT];
+        IceTFloat dest_value[5*ICET_MAX_FRAGMENTS_LIMIT];
+        memcpy(front_value,
+               front->color + pixel*front->color_stride,
+               fragments_size);
+        memcpy(back_value,
+               back->color + pixel*back->color_stride,
+               fragments_size);
+        icetMergeFragments(front_value, back_value, dest_value, num_fragments);
+        memcpy(dest->color + pixel*dest->color_stride,
+               dest_value,
+               fragments_size);
     }
-
-    return icetImageGetColorConstVoid(image, NULL);
 }
-IceTUByte *icetImageGetColorub(IceTImage image)
-{
-    const IceTUByte *const_buffer = icetImageGetColorcub(image);
 
-    /* This const cast is OK because we actually got the pointer from a
-       non-const image. */
-    return (IceTUByte *)const_buffer;
+static void icetMergeFragmentSpanColor(const IceTPixelSpan *front,
+                                       const IceTPixelSpan *back,
+                                       const IceTPixelSpan *dest,
+                                       IceTSizeType num_pixels)
+{
+    icetMergeFragmentSpan(
+        front, back, dest, num_pixels,
+        (IceTInt)(front->color_stride/(IceTSizeType)(5*sizeof(IceTFloat))));
 }
-const IceTUInt *icetImageGetColorcui(const IceTImage image)
+
+static IceTCompositeSpanFunc icetLookupCompositeSpan(IceTEnum composite_mode,
+                                                     IceTEnum color_format,
+                                                     IceTEnum depth_format)
 {
-    return (const IceTUInt *)icetImageGetColorcub(image);
+    switch (composite_mode) {
+      case ICET_COMPOSITE_MODE_Z_BUFFER:
+          if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+              switch (color_format) {
+                case ICET_IMAGE_COLOR_RGBA_UBYTE:
+                    return icetZCompositeSpanColorubDepthf;
+                case ICET_IMAGE_COLOR_RGBA_FLOAT:
+                    return icetZCompositeSpanColorfDepthf;
+                case ICET_IMAGE_COLOR_RGBA_HALF:
+                    return icetZCompositeSpanColorusDepthf;
+                case ICET_IMAGE_COLOR_NONE:
+                    return icetZCompositeSpanDepthf;
+              }
+          } else if (depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+              switch (color_format) {
+                case ICET_IMAGE_COLOR_RGBA_UBYTE:
+                    return icetZCompositeSpanColorubDepthus;
+                case ICET_IMAGE_COLOR_RGBA_FLOAT:
+                    return icetZCompositeSpanColorfDepthus;
+                case ICET_IMAGE_COLOR_RGBA_HALF:
+                    return icetZCompositeSpanColorusDepthus;
+                case ICET_IMAGE_COLOR_NONE:
+                    return icetZCompositeSpanDepthus;
+              }
+          }
+          return NULL;
+      case ICET_COMPOSITE_MODE_BLEND:
+          if (depth_format != ICET_IMAGE_DEPTH_NONE) return NULL;
+          switch (color_format) {
+            case ICET_IMAGE_COLOR_RGBA_UBYTE: return icetBlendSpanColorub;
+            case ICET_IMAGE_COLOR_RGBA_FLOAT: return icetBlendSpanColorf;
+            case ICET_IMAGE_COLOR_RGBA_HALF:  return icetBlendSpanColorus;
+          }
+          return NULL;
+      case ICET_COMPOSITE_MODE_MAX_INTENSITY:
+          if (depth_format != ICET_IMAGE_DEPTH_NONE) return NULL;
+          switch (color_format) {
+            case ICET_IMAGE_COLOR_RGBA_UBYTE: return icetMaxSpanColorub;
+            case ICET_IMAGE_COLOR_RGBA_FLOAT: return icetMaxSpanColorf;
+            case ICET_IMAGE_COLOR_RGBA_HALF:  return icetMaxSpanColorus;
+          }
+          return NULL;
+      case ICET_COMPOSITE_MODE_ADD:
+          if (depth_format != ICET_IMAGE_DEPTH_NONE) return NULL;
+          switch (color_format) {
+            case ICET_IMAGE_COLOR_RGBA_UBYTE: return icetAddSpanColorub;
+            case ICET_IMAGE_COLOR_RGBA_FLOAT: return icetAddSpanColorf;
+            case ICET_IMAGE_COLOR_RGBA_HALF:  return icetAddSpanColorus;
+          }
+          return NULL;
+      case ICET_COMPOSITE_MODE_FRAGMENTS:
+          if (   icetValidFragmentFormat(color_format)
+              && (depth_format == ICET_IMAGE_DEPTH_NONE) ) {
+              return icetMergeFragmentSpanColor;
+          }
+          return NULL;
+      default:
+          return NULL;
+    }
 }
-IceTUInt *icetImageGetColorui(IceTImage image)
+
+void icetSelectCompositeKernel(void)
 {
-    return (IceTUInt *)icetImageGetColorub(image);
+    IceTEnum composite_mode;
+    IceTEnum color_format, depth_format;
+    IceTInt formats[2];
+
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    icetGetSparseImageFormats(&color_format, &depth_format);
+
+    formats[0] = (IceTInt)color_format;
+    formats[1] = (IceTInt)depth_format;
+    icetStateSetIntegerv(ICET_COMPOSITE_KERNEL_FORMATS, 2, formats);
+    icetStateSetPointer(ICET_COMPOSITE_KERNEL,
+                        (IceTVoid *)icetLookupCompositeSpan(composite_mode,
+                                                            color_format,
+                                                            depth_format));
 }
-const IceTFloat *icetImageGetColorcf(const IceTImage image)
+
+static IceTCompositeSpanFunc icetGetCompositeSpan(IceTEnum color_format,
+                                                  IceTEnum depth_format)
 {
-    IceTEnum color_format = icetImageGetColorFormat(image);
+    const IceTInt *formats = icetUnsafeStateGetInteger(
+                                                ICET_COMPOSITE_KERNEL_FORMATS);
+    IceTEnum composite_mode;
 
-    if (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT) {
-        icetRaiseError("Color format is not of type float.",
-                       ICET_INVALID_OPERATION);
-        return NULL;
+    if (   ((IceTEnum)formats[0] == color_format)
+        && ((IceTEnum)formats[1] == depth_format) ) {
+        IceTCompositeSpanFunc composite_span
+            = (IceTCompositeSpanFunc)(*icetUnsafeStateGetPointer(
+                                                       ICET_COMPOSITE_KERNEL));
+        if (composite_span != NULL) return composite_span;
     }
 
-    return icetImageGetColorConstVoid(image, NULL);
+  /* Not the formats of the frame (or no frame yet), so look it up. */
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    return icetLookupCompositeSpan(composite_mode, color_format, depth_format);
 }
-IceTFloat *icetImageGetColorf(IceTImage image)
+
+static IceTBoolean icetCompositeSpanError(IceTEnum color_format,
+                                          IceTEnum depth_format)
 {
-    const IceTFloat *const_buffer = icetImageGetColorcf(image);
+    IceTEnum composite_mode;
 
-    
-    /* This const cast is OK because we actually got the pointer from a
-       non-const image. */
-    return (IceTFloat *)const_buffer;
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+
+    if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+        if (depth_format == ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseError("Cannot use Z buffer compositing operation with no"
+                           " Z buffer.", ICET_INVALID_OPERATION);
+        } else if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+                   && (depth_format != ICET_IMAGE_DEPTH_UNORM16) ) {
+            icetRaiseError("Encountered invalid depth format.",
+                           ICET_SANITY_CHECK_FAIL);
+        } else {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+    } else if (   (composite_mode == ICET_COMPOSITE_MODE_BLEND)
+               || icetChannelCompositeMode(composite_mode) ) {
+        if (depth_format != ICET_IMAGE_DEPTH_NONE) {
+            if (composite_mode == ICET_COMPOSITE_MODE_BLEND) {
+                icetRaiseError("Cannot use blend composite with a depth"
+                               " buffer.", ICET_INVALID_VALUE);
+            } else {
+                icetRaiseError("Cannot use channel composite with a depth"
+                               " buffer.", ICET_INVALID_VALUE);
+            }
+        } else if (color_format == ICET_IMAGE_COLOR_NONE) {
+            icetRaiseWarning("Compositing image with no data.",
+                             ICET_INVALID_OPERATION);
+            return ICET_TRUE;
+        } else {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+    } else if (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+        icetRaiseError("Cannot use fragment composite on images without"
+                       " fragments.", ICET_INVALID_VALUE);
+    } else {
+        icetRaiseError("Encountered invalid composite mode.",
+                       ICET_SANITY_CHECK_FAIL);
+    }
+    return ICET_FALSE;
 }
 
-const IceTVoid *icetImageGetDepthConstVoid(const IceTImage image,
-                                           IceTSizeType *pixel_size)
+static void icetResolveFragments(const IceTByte *fragments,
+                                 IceTInt num_fragments,
+                                 IceTFloat *color,
+                                 IceTFloat *depth)
 {
-    IceTEnum color_format = icetImageGetColorFormat(image);
-    IceTSizeType color_format_bytes;
-    const IceTByte *image_data_pointer;
+    IceTFloat value[5*ICET_MAX_FRAGMENTS_LIMIT];
+    IceTInt fragment;
 
-    if (pixel_size) {
-        IceTEnum depth_format = icetImageGetDepthFormat(image);
-        *pixel_size = depthPixelSize(depth_format);
-    }
+    memcpy(value, fragments, 5*sizeof(IceTFloat)*num_fragments);
 
-    color_format_bytes = (  icetImageGetNumPixels(image)
-                          * colorPixelSize(color_format) );
+    color[0] = color[1] = color[2] = color[3] = 0.0f;
+    *depth = (value[3] != 0.0f) ? value[4] : 1.0f;
+    for (fragment = 0;
+         (fragment < num_fragments) && (value[5*fragment + 3] != 0.0f);
+         fragment++) {
+        ICET_BLEND_FLOAT(color, value + 5*fragment, color);
+    }
+}
 
-    /* Cast to IceTByte to ensure pointer arithmetic is correct. */
-    image_data_pointer = (const IceTByte*)ICET_IMAGE_DATA(image);
+static void icetWriteResolvedPixel(const IceTFloat *color,
+                                   IceTFloat depth,
+                                   IceTEnum color_format,
+                                   IceTEnum depth_format,
+                                   IceTByte *color_out,
+                                   IceTByte *depth_out)
+{
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        IceTUByte *out = (IceTUByte *)color_out;
+        out[0] = (IceTUByte)(255*color[0] + 0.5f);
+        out[1] = (IceTUByte)(255*color[1] + 0.5f);
+        out[2] = (IceTUByte)(255*color[2] + 0.5f);
+        out[3] = (IceTUByte)(255*color[3] + 0.5f);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        memcpy(color_out, color, 4*sizeof(IceTFloat));
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        IceTUShort half[4];
+        icetFloatToHalfArray(color, half, 4);
+        memcpy(color_out, half, 4*sizeof(IceTUShort));
+    }
 
-    return image_data_pointer + color_format_bytes;
+    if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+        memcpy(depth_out, &depth, sizeof(IceTFloat));
+    } else if (depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+        IceTUShort unorm = (IceTUShort)(65535.0f*depth + 0.5f);
+        memcpy(depth_out, &unorm, sizeof(IceTUShort));
+    }
 }
-IceTVoid *icetImageGetDepthVoid(IceTImage image, IceTSizeType *pixel_size)
-{
-    const IceTVoid *const_buffer =icetImageGetDepthConstVoid(image, pixel_size);
 
-    /* This const cast is OK because we actually got the pointer from a
-       non-const image. */
-    return (IceTVoid *)const_buffer;  
+static void icetSparseImagePlanarizeRun(IceTVoid *pixels,
+                                        IceTSizeType num_pixels,
+                                        IceTSizeType color_size,
+                                        IceTSizeType depth_size)
+{
+    IceTByte depths[MAX_PLANAR_RUN_LENGTH*MAX_PLANAR_DEPTH_SIZE];
+    const IceTByte *in = pixels;
+    IceTByte *color_out = pixels;
+    IceTByte *depth_out = depths;
+    IceTSizeType pixel;
+
+  /* The colors move toward the front, so they can be packed in place.  The
+     depths are held aside and copied after the colors. */
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        memcpy(depth_out, in + color_size, depth_size);
+        memmove(color_out, in, color_size);
+        in += color_size + depth_size;
+        color_out += color_size;
+        depth_out += depth_size;
+    }
+    memcpy(color_out, depths, num_pixels*depth_size);
 }
-const IceTFloat *icetImageGetDepthcf(const IceTImage image)
+
+IceTSizeType icetImageBufferSize(IceTSizeType width, IceTSizeType height)
 {
-    IceTEnum depth_format = icetImageGetDepthFormat(image);
+    IceTEnum color_format, depth_format;
 
-    if (depth_format != ICET_IMAGE_DEPTH_FLOAT) {
-        icetRaiseError("Depth format is not of type float.",
-                       ICET_INVALID_OPERATION);
-        return NULL;
-    }
+    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
+    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
 
-    return icetImageGetDepthConstVoid(image, NULL);
+    return icetImageBufferSizeType(color_format, depth_format,
+                                   width, height);
 }
-IceTFloat *icetImageGetDepthf(IceTImage image)
+
+IceTSizeType icetImageBufferSizeType(IceTEnum color_format,
+                                     IceTEnum depth_format,
+                                     IceTSizeType width,
+                                     IceTSizeType height)
 {
-    const IceTFloat *const_buffer = icetImageGetDepthcf(image);
+    IceTSizeType color_pixel_size = colorPixelSize(color_format);
+    IceTSizeType depth_pixel_size = depthPixelSize(depth_format);
 
-    
-    /* This const cast is OK because we actually got the pointer from a
-       non-const image. */
-    return (IceTFloat *)const_buffer;
+    return (  ICET_IMAGE_DATA_START_INDEX*sizeof(IceTUInt)
+            + width*height*(color_pixel_size + depth_pixel_size) );
 }
 
-void icetImageCopyColorub(const IceTImage image,
-                          IceTUByte *color_buffer,
-                          IceTEnum out_color_format)
+static IceTBoolean icetValidFragmentFormat(IceTEnum color_format)
 {
-    IceTEnum in_color_format = icetImageGetColorFormat(image);
+    IceTInt count = ICET_IMAGE_COLOR_FRAGMENT_COUNT(color_format);
+    return (IceTBoolean)(   ICET_IMAGE_COLOR_IS_FRAGMENTS(color_format)
+                         && (count > 0)
+                         && (count <= ICET_MAX_FRAGMENTS_LIMIT) );
+}
 
-    if (out_color_format != ICET_IMAGE_COLOR_RGBA_UBYTE) {
-        icetRaiseError("Color format is not of type ubyte.",
-                       ICET_INVALID_ENUM);
-        return;
-    }
-    if (in_color_format == ICET_IMAGE_COLOR_NONE) {
-        icetRaiseError("Input image has no color data.",
-                       ICET_INVALID_OPERATION);
-        return;
-    }
+void icetGetSparseImageFormats(IceTEnum *color_format, IceTEnum *depth_format)
+{
+    IceTEnum composite_mode;
 
-    if (in_color_format == out_color_format) {
-        const IceTUByte *in_buffer = icetImageGetColorcub(image);
-        IceTSizeType color_format_bytes = (  icetImageGetNumPixels(image)
-                                           * colorPixelSize(in_color_format) );
-        memcpy(color_buffer, in_buffer, color_format_bytes);
-    } else if (   (in_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT)
-               && (out_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) ) {
-        const IceTFloat *in_buffer = icetImageGetColorcf(image);
-        IceTSizeType num_pixels = icetImageGetNumPixels(image);
-        IceTSizeType i;
-        const IceTFloat *in;
-        IceTUByte *out;
-        for (i = 0, in = in_buffer, out = color_buffer; i < 4*num_pixels;
-             i++, in++, out++) {
-            out[0] = (IceTUByte)(255*in[0]);
-        }
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    if (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+        IceTInt max_fragments;
+        icetGetIntegerv(ICET_MAX_FRAGMENTS, &max_fragments);
+        *color_format = ICET_IMAGE_COLOR_FRAGMENTS(max_fragments);
+        *depth_format = ICET_IMAGE_DEPTH_NONE;
     } else {
-        icetRaiseError("Encountered unexpected color format combination.",
-                       ICET_SANITY_CHECK_FAIL);
+        icetGetEnumv(ICET_COLOR_FORMAT, color_format);
+        icetGetEnumv(ICET_DEPTH_FORMAT, depth_format);
     }
 }
 
-void icetImageCopyColorf(const IceTImage image,
-                         IceTFloat *color_buffer,
-                         IceTEnum out_color_format)
+IceTSizeType icetSparseImageBufferSize(IceTSizeType width, IceTSizeType height)
 {
-    IceTEnum in_color_format = icetImageGetColorFormat(image);
+    IceTEnum color_format, depth_format;
 
-    if (out_color_format != ICET_IMAGE_COLOR_RGBA_FLOAT) {
-        icetRaiseError("Color format is not of type float.",
-                       ICET_INVALID_ENUM);
-        return;
-    }
-    if (in_color_format == ICET_IMAGE_COLOR_NONE) {
-        icetRaiseError("Input image has no color data.",
-                       ICET_INVALID_OPERATION);
-        return;
-    }
+    icetGetSparseImageFormats(&color_format, &depth_format);
 
-    if (in_color_format == out_color_format) {
-        const IceTFloat *in_buffer = icetImageGetColorcf(image);
-        IceTSizeType color_format_bytes = (  icetImageGetNumPixels(image)
-                                           * colorPixelSize(in_color_format) );
-        memcpy(color_buffer, in_buffer, color_format_bytes);
-    } else if (   (in_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE)
-               && (out_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) ) {
-        const IceTUByte *in_buffer = icetImageGetColorcub(image);
-        IceTSizeType num_pixels = icetImageGetNumPixels(image);
-        IceTSizeType i;
-        const IceTUByte *in;
-        IceTFloat *out;
-        for (i = 0, in = in_buffer, out = color_buffer; i < 4*num_pixels;
-             i++, in++, out++) {
-            out[0] = (IceTFloat)in[0]/255.0f;
-        }
-    } else {
-        icetRaiseError("Unexpected format combination.",
-                       ICET_SANITY_CHECK_FAIL);
-    }
+    return icetSparseImageBufferSizeType(color_format, depth_format,
+                                         width, height);
 }
 
-void icetImageCopyDepthf(const IceTImage image,
-                         IceTFloat *depth_buffer,
-                         IceTEnum out_depth_format)
+IceTSizeType icetSparseImageBufferSizeType(IceTEnum color_format,
+                                           IceTEnum depth_format,
+                                           IceTSizeType width,
+                                           IceTSizeType height)
 {
-    IceTEnum in_depth_format = icetImageGetDepthFormat(image);
+    /* The seek index goes after the space for the image data. */
+    return (  icetSparseImageSeekIndexOffset(color_format,
+                                             depth_format,
+                                             width*height)
+            + SEEK_INDEX_SIZE(width*height) );
+}
 
-    if (out_depth_format != ICET_IMAGE_DEPTH_FLOAT) {
-        icetRaiseError("Depth format is not of type float.",
-                       ICET_INVALID_ENUM);
-        return;
-    }
-    if (in_depth_format == ICET_IMAGE_DEPTH_NONE) {
-        icetRaiseError("Input image has no depth data.",
-                       ICET_INVALID_OPERATION);
-        return;
-    }
+static IceTSizeType icetSparseImageSeekIndexOffset(IceTEnum color_format,
+                                                   IceTEnum depth_format,
+                                                   IceTSizeType num_pixels)
+{
+    IceTSizeType size;
+    IceTSizeType pixel_size;
 
-  /* Currently only possibility is
-     in_color_format == out_color_format == ICET_IMAGE_DEPTH_FLOAT. */
-    {
-        const IceTFloat *in_buffer = icetImageGetDepthcf(image);
-        IceTSizeType depth_format_bytes = (  icetImageGetNumPixels(image)
-                                           * depthPixelSize(in_depth_format) );
-        memcpy(depth_buffer, in_buffer, depth_format_bytes);
+    /* A sparse image full of active pixels will be the same size as a full
+       image plus a set of run lengths. */
+    size = (  RUN_LENGTH_SIZE
+            + icetImageBufferSizeType(color_format,depth_format,num_pixels,1) );
+
+    /* For most common image formats, this is as large as the sparse image may
+       be.  When the size of the run length pair is no bigger than the size of a
+       pixel (the amount of data saved by writing the run lengths), then even in
+       the pathological case of every other pixel being active.  However, it is
+       possible that the run lengths take more space to store than the pixel
+       data.  Thus, if there is an inactive run length of one, it is possible to
+       have the data set a little bigger.  It is extremely unlikely to need this
+       much memory, but we will have to allocate it just in case.  I suppose we
+       could change the compress functions to not allow run lengths of size 1,
+       but that could increase the time to compress and would definitely
+       increase the complexity of the code. */
+    pixel_size = colorPixelSize(color_format) + depthPixelSize(depth_format);
+    if (pixel_size < RUN_LENGTH_SIZE) {
+        size += (RUN_LENGTH_SIZE - pixel_size)*((num_pixels+1)/2);
     }
+
+    /* Compact run lengths are smaller, but long runs have to be broken up
+       into several run lengths. */
+    size += COMPACT_RUN_LENGTH_SIZE*(num_pixels/MAX_COMPACT_RUN_LENGTH + 2);
+
+    /* Likewise, long active runs are broken up in the planar layout. */
+    size += RUN_LENGTH_SIZE*(num_pixels/MAX_PLANAR_RUN_LENGTH + 2);
+
+    /* The block layout stores every pixel of a set block but no run lengths.
+       It needs no more than the bitmap of blocks on top of a full image. */
+    size += (IceTSizeType)sizeof(IceTUInt)*(num_pixels/32 + 1);
+
+    /* Align the seek index that follows. */
+    size += (IceTSizeType)sizeof(IceTInt) - 1;
+    size -= size%(IceTSizeType)sizeof(IceTInt);
+    return size;
 }
 
-IceTBoolean icetImageEqual(const IceTImage image1, const IceTImage image2)
+static IceTInt *icetSparseImageGetSeekIndex(const IceTSparseImage image)
 {
-    return image1.opaque_internals == image2.opaque_internals;
+    if (!ICET_SPARSE_IMAGE_HAS_SEEK_INDEX(image)) { return NULL; }
+    return (IceTInt *)(  (IceTByte *)ICET_IMAGE_HEADER(image)
+                       + icetSparseImageSeekIndexOffset(
+                             icetSparseImageGetColorFormat(image),
+                             icetSparseImageGetDepthFormat(image),
+                             ICET_IMAGE_HEADER(image)
+                                 [ICET_IMAGE_MAX_NUM_PIXELS_INDEX]) );
 }
 
-void icetImageCopyPixels(const IceTImage in_image, IceTSizeType in_offset,
-                         IceTImage out_image, IceTSizeType out_offset,
-                         IceTSizeType num_pixels)
+static void icetSeekIndexBegin(IceTSparseImage image,
+                               IceTSeekIndexBuilder *builder)
 {
-    IceTEnum color_format, depth_format;
+    IceTInt *index = icetSparseImageGetSeekIndex(image);
+    if (index != NULL) { index[0] = 0; }
+    icetSeekIndexReopen(image, builder);
+}
 
-    color_format = icetImageGetColorFormat(in_image);
-    depth_format = icetImageGetDepthFormat(in_image);
-    if (   (color_format != icetImageGetColorFormat(out_image))
-        || (depth_format != icetImageGetDepthFormat(out_image)) ) {
-        icetRaiseError("Cannot copy pixels of images with different formats.",
-                       ICET_INVALID_VALUE);
-        return;
-    }
+static void icetSeekIndexReopen(IceTSparseImage image,
+                                IceTSeekIndexBuilder *builder)
+{
+    IceTInt *index = icetSparseImageGetSeekIndex(image);
 
-    if (    (in_offset < 0)
-         || (in_offset + num_pixels > icetImageGetNumPixels(in_image)) ) {
-        icetRaiseError("Pixels to copy are outside of range of source image.",
-                       ICET_INVALID_VALUE);
-    }
-    if (    (out_offset < 0)
-         || (out_offset + num_pixels > icetImageGetNumPixels(out_image)) ) {
-        icetRaiseError("Pixels to copy are outside of range of source image.",
-                       ICET_INVALID_VALUE);
+    if (index != NULL) {
+        builder->entries = index + 1;
+        builder->num_entries = index[0];
+        builder->max_entries = SEEK_INDEX_CAPACITY(
+                 ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]);
+    } else {
+        builder->entries = NULL;
+        builder->num_entries = 0;
+        builder->max_entries = 0;
     }
+    builder->runs_left = SEEK_INDEX_STRIDE;
+    builder->data = ICET_IMAGE_DATA(image);
+    builder->position = 0;
+}
 
-    if (color_format != ICET_IMAGE_COLOR_NONE) {
-        const IceTByte *in_colors;  /* Use IceTByte for pointer arithmetic */
-        IceTByte *out_colors;
-        IceTSizeType pixel_size;
-        in_colors = icetImageGetColorVoid(in_image, &pixel_size);
-        out_colors = icetImageGetColorVoid(out_image, NULL);
-        memcpy(out_colors + pixel_size*out_offset,
-               in_colors + pixel_size*in_offset,
-               pixel_size*num_pixels);
+static void icetSeekIndexEnd(IceTSeekIndexBuilder *builder)
+{
+    if (builder->entries != NULL) {
+        builder->entries[-1] = builder->num_entries;
     }
+}
 
-    if (depth_format != ICET_IMAGE_DEPTH_NONE) {
-        const IceTByte *in_depths;  /* Use IceTByte for pointer arithmetic */
-        IceTByte *out_depths;
-        IceTSizeType pixel_size;
-        in_depths = icetImageGetDepthVoid(in_image, &pixel_size);
-        out_depths = icetImageGetDepthVoid(out_image, NULL);
-        memcpy(out_depths + pixel_size*out_offset,
-               in_depths + pixel_size*in_offset,
-               pixel_size*num_pixels);
+static void icetSeekIndexAddEntry(IceTSeekIndexBuilder *builder,
+                                  const IceTVoid *run_length,
+                                  IceTSizeType pixel)
+{
+    builder->runs_left = SEEK_INDEX_STRIDE;
+    if (builder->num_entries < builder->max_entries) {
+        IceTInt *entry = builder->entries + 2*builder->num_entries;
+        entry[0] = (IceTInt)pixel;
+        entry[1] = (IceTInt)((const IceTByte *)run_length - builder->data);
+        builder->num_entries++;
     }
 }
 
-void icetImageCopyRegion(const IceTImage in_image,
-                         const IceTInt *in_viewport,
-                         IceTImage out_image,
-                         const IceTInt *out_viewport)
+static IceTInt icetSeekIndexFind(const IceTInt *index, IceTSizeType pixel)
 {
-    IceTEnum color_format = icetImageGetColorFormat(in_image);
-    IceTEnum depth_format = icetImageGetDepthFormat(in_image);
+    const IceTInt *entries = index + 1;
+    IceTInt low = 0;
+    IceTInt high = index[0];
+
+    while (low < high) {
+        IceTInt middle = (low + high)/2;
+        if (entries[2*middle] <= pixel) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
 
-    if (    (color_format != icetImageGetColorFormat(out_image))
-         || (depth_format != icetImageGetDepthFormat(out_image)) ) {
-        icetRaiseError("icetImageCopyRegion only supports copying images"
-                       " of the same format.", ICET_INVALID_VALUE);
-        return;
-    }
+IceTImage icetGetStateBufferImage(IceTEnum pname,
+                                  IceTSizeType width,
+                                  IceTSizeType height)
+{
+    IceTVoid *buffer;
+    IceTSizeType buffer_size;
 
-    if (    (in_viewport[2] != out_viewport[2])
-         || (in_viewport[3] != out_viewport[3]) ) {
-        icetRaiseError("Sizes of input and output regions must be the same.",
-                       ICET_INVALID_VALUE);
-        return;
-    }
+    buffer_size = icetImageBufferSize(width, height);
+    buffer = icetGetStateBuffer(pname, buffer_size);
 
-    if (color_format != ICET_IMAGE_COLOR_NONE) {
-        IceTSizeType pixel_size;
-        /* Use IceTByte for byte-based pointer arithmetic. */
-        const IceTByte *src = icetImageGetColorVoid(in_image, &pixel_size);
-        IceTByte *dest = icetImageGetColorVoid(out_image, &pixel_size);
-        IceTSizeType y;
+    return icetImageAssignBuffer(buffer, width, height);
+}
 
-      /* Advance pointers up to vertical offset. */
-        src  += in_viewport[1]*icetImageGetWidth(in_image)*pixel_size;
-        dest += out_viewport[1]*icetImageGetWidth(out_image)*pixel_size;
+IceTImage icetImageAssignBuffer(IceTVoid *buffer,
+                                IceTSizeType width,
+                                IceTSizeType height)
+{
+    IceTImage image;
+    IceTEnum color_format, depth_format;
+    IceTInt *header;
 
-      /* Advance pointers forward to horizontal offset. */
-        src  += in_viewport[0]*pixel_size;
-        dest += out_viewport[0]*pixel_size;
+    image.opaque_internals = buffer;
 
-        for (y = 0; y < in_viewport[3]; y++) {
-            memcpy(dest, src, in_viewport[2]*pixel_size);
-            src  += icetImageGetWidth(in_image)*pixel_size;
-            dest += icetImageGetWidth(out_image)*pixel_size;
-        }
+    if (buffer == NULL) {
+        icetRaiseError("Tried to create image with NULL buffer.",
+                       ICET_INVALID_VALUE);
+        return icetImageNull();
     }
 
-    if (depth_format != ICET_IMAGE_DEPTH_NONE) {
-        IceTSizeType pixel_size;
-        /* Use IceTByte for byte-based pointer arithmetic. */
-        const IceTByte *src = icetImageGetDepthVoid(in_image, &pixel_size);
-        IceTByte *dest = icetImageGetDepthVoid(out_image, &pixel_size);
-        IceTSizeType y;
-
-      /* Advance pointers up to vertical offset. */
-        src  += in_viewport[1]*icetImageGetWidth(in_image)*pixel_size;
-        dest += out_viewport[1]*icetImageGetWidth(out_image)*pixel_size;
+    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
+    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
 
-      /* Advance pointers forward to horizontal offset. */
-        src  += in_viewport[0]*pixel_size;
-        dest += out_viewport[0]*pixel_size;
+    header = ICET_IMAGE_HEADER(image);
 
-        for (y = 0; y < in_viewport[3]; y++) {
-            memcpy(dest, src, in_viewport[2]*pixel_size);
-            src  += icetImageGetWidth(in_image)*pixel_size;
-            dest += icetImageGetWidth(out_image)*pixel_size;
-        }
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+        && (color_format != ICET_IMAGE_COLOR_NONE) ) {
+        icetRaiseError("Invalid color format.", ICET_INVALID_ENUM);
+        color_format = ICET_IMAGE_COLOR_NONE;
+    }
+    if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+        && (depth_format != ICET_IMAGE_DEPTH_UNORM16)
+        && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+        icetRaiseError("Invalid depth format.", ICET_INVALID_ENUM);
+        depth_format = ICET_IMAGE_DEPTH_NONE;
     }
-}
-
-void icetImageClearAroundRegion(IceTImage image, const IceTInt *region)
-{
-    IceTSizeType width = icetImageGetWidth(image);
-    IceTSizeType height = icetImageGetHeight(image);
-    IceTEnum color_format = icetImageGetColorFormat(image);
-    IceTEnum depth_format = icetImageGetDepthFormat(image);
-    IceTSizeType x, y;
-
-    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
-        IceTUInt *color_buffer = icetImageGetColorui(image);
-        IceTUInt background_color;
-
-        icetGetIntegerv(ICET_BACKGROUND_COLOR_WORD,(IceTInt*)&background_color);
-
-      /* Clear out bottom. */
-        for (y = 0; y < region[1]; y++) {
-            for (x = 0; x < width; x++) {
-                color_buffer[y*width + x] = background_color;
-            }
-        }
-      /* Clear out left and right. */
-        if ((region[0] > 0) || (region[0]+region[2] < width)) {
-            for (y = region[1]; y < region[1]+region[3]; y++) {
-                for (x = 0; x < region[0]; x++) {
-                    color_buffer[y*width + x] = background_color;
-                }
-                for (x = region[0]+region[2]; x < width; x++) {
-                    color_buffer[y*width + x] = background_color;
-                }
-            }
-        }
-      /* Clear out top. */
-        for (y = region[1]+region[3]; y < height; y++) {
-            for (x = 0; x < width; x++) {
-                color_buffer[y*width + x] = background_color;
-            }
-        }
-    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
-        IceTFloat *color_buffer = icetImageGetColorf(image);
-        IceTFloat background_color[4];
 
-        icetGetFloatv(ICET_BACKGROUND_COLOR, background_color);
+    header[ICET_IMAGE_MAGIC_NUM_INDEX]          = ICET_IMAGE_MAGIC_NUM;
+    header[ICET_IMAGE_COLOR_FORMAT_INDEX]       = color_format;
+    header[ICET_IMAGE_DEPTH_FORMAT_INDEX]       = depth_format;
+    header[ICET_IMAGE_WIDTH_INDEX]              = (IceTInt)width;
+    header[ICET_IMAGE_HEIGHT_INDEX]             = (IceTInt)height;
+    header[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]     = (IceTInt)(width*height);
+    header[ICET_IMAGE_FLAGS_INDEX]              = 0;
+    header[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+        = (IceTInt)icetImageBufferSizeType(color_format,
+                                           depth_format,
+                                           width,
+                                           height);
 
-      /* Clear out bottom. */
-        for (y = 0; y < region[1]; y++) {
-            for (x = 0; x < width; x++) {
-                color_buffer[4*(y*width + x) + 0] = background_color[0];
-                color_buffer[4*(y*width + x) + 1] = background_color[1];
-                color_buffer[4*(y*width + x) + 2] = background_color[2];
-                color_buffer[4*(y*width + x) + 3] = background_color[3];
-            }
-        }
-      /* Clear out left and right. */
-        if ((region[0] > 0) || (region[0]+region[2] < width)) {
-            for (y = region[1]; y < region[1]+region[3]; y++) {
-                for (x = 0; x < region[0]; x++) {
-                    color_buffer[4*(y*width + x) + 0] = background_color[0];
-                    color_buffer[4*(y*width + x) + 1] = background_color[1];
-                    color_buffer[4*(y*width + x) + 2] = background_color[2];
-                    color_buffer[4*(y*width + x) + 3] = background_color[3];
-                }
-                for (x = region[0]+region[2]; x < width; x++) {
-                    color_buffer[4*(y*width + x) + 0] = background_color[0];
-                    color_buffer[4*(y*width + x) + 1] = background_color[1];
-                    color_buffer[4*(y*width + x) + 2] = background_color[2];
-                    color_buffer[4*(y*width + x) + 3] = background_color[3];
-                }
-            }
-        }
-      /* Clear out top. */
-        for (y = region[1]+region[3]; y < height; y++) {
-            for (x = 0; x < width; x++) {
-                color_buffer[4*(y*width + x) + 0] = background_color[0];
-                color_buffer[4*(y*width + x) + 1] = background_color[1];
-                color_buffer[4*(y*width + x) + 2] = background_color[2];
-                color_buffer[4*(y*width + x) + 3] = background_color[3];
-            }
-        }
-    } else if (color_format != ICET_IMAGE_COLOR_NONE) {
-        icetRaiseError("Invalid color format.", ICET_SANITY_CHECK_FAIL);
-    }
+    return image;
+}
 
-    if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
-        IceTFloat *depth_buffer = icetImageGetDepthf(image);
+IceTImage icetImageNull(void)
+{
+    IceTImage image;
+    image.opaque_internals = NULL;
+    return image;
+}
 
-      /* Clear out bottom. */
-        for (y = 0; y < region[1]; y++) {
-            for (x = 0; x < width; x++) {
-                depth_buffer[y*width + x] = 1.0f;
-            }
-        }
-      /* Clear out left and right. */
-        if ((region[0] > 0) || (region[0]+region[2] < width)) {
-            for (y = region[1]; y < region[1]+region[3]; y++) {
-                for (x = 0; x < region[0]; x++) {
-                    depth_buffer[y*width + x] = 1.0f;
-                }
-                for (x = region[0]+region[2]; x < width; x++) {
-                    depth_buffer[y*width + x] = 1.0f;
-                }
-            }
-        }
-      /* Clear out top. */
-        for (y = region[1]+region[3]; y < height; y++) {
-            for (x = 0; x < width; x++) {
-                depth_buffer[y*width + x] = 1.0f;
-            }
-        }
-    } else if (depth_format != ICET_IMAGE_DEPTH_NONE) {
-        icetRaiseError("Invalid depth format.", ICET_SANITY_CHECK_FAIL);
+IceTBoolean icetImageIsNull(const IceTImage image)
+{
+    if (image.opaque_internals == NULL) {
+        return ICET_TRUE;
+    } else {
+        return ICET_FALSE;
     }
 }
 
-void icetImagePackageForSend(IceTImage image,
-                             IceTVoid **buffer, IceTSizeType *size)
+IceTSparseImage icetGetStateBufferSparseImage(IceTEnum pname,
+                                              IceTSizeType width,
+                                              IceTSizeType height)
 {
-    ICET_TEST_IMAGE_HEADER(image);
+    IceTVoid *buffer;
+    IceTSizeType buffer_size;
 
-    *buffer = image.opaque_internals;
-    *size = ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+    buffer_size = icetSparseImageBufferSize(width, height);
+    buffer = icetGetStateBuffer(pname, buffer_size);
 
-    if (*size != icetImageBufferSizeType(icetImageGetColorFormat(image),
-                                         icetImageGetDepthFormat(image),
-                                         icetImageGetWidth(image),
-                                         icetImageGetHeight(image))) {
-        icetRaiseError("Inconsistent buffer size detected.",
-                       ICET_SANITY_CHECK_FAIL);
-    }
+    return icetSparseImageAssignBuffer(buffer, width, height);
 }
 
-IceTImage icetImageUnpackageFromReceive(IceTVoid *buffer)
+IceTSparseImage icetSparseImageAssignBuffer(IceTVoid *buffer,
+                                            IceTSizeType width,
+                                            IceTSizeType height)
 {
-    IceTImage image;
+    IceTSparseImage image;
     IceTEnum color_format, depth_format;
+    IceTInt *header;
 
     image.opaque_internals = buffer;
 
-  /* Check the image for validity. */
-    if (    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAGIC_NUM_INDEX]
-         != ICET_IMAGE_MAGIC_NUM ) {
-        icetRaiseError("Invalid image buffer: no magic number.",
+    if (buffer == NULL) {
+        icetRaiseError("Tried to create sparse image with NULL buffer.",
                        ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
         return image;
     }
 
-    color_format = icetImageGetColorFormat(image);
-    if (    (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
-         && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
-         && (color_format != ICET_IMAGE_COLOR_NONE) ) {
-        icetRaiseError("Invalid image buffer: invalid color format.",
-                       ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
-    }
+    icetGetSparseImageFormats(&color_format, &depth_format);
 
-    depth_format = icetImageGetDepthFormat(image);
-    if (    (depth_format != ICET_IMAGE_DEPTH_FLOAT)
-         && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
-        icetRaiseError("Invalid image buffer: invalid depth format.",
-                       ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
+    header = ICET_IMAGE_HEADER(image);
+
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+        && (color_format != ICET_IMAGE_COLOR_NONE)
+        && !icetValidFragmentFormat(color_format) ) {
+        icetRaiseError("Invalid color format.", ICET_INVALID_ENUM);
+        color_format = ICET_IMAGE_COLOR_NONE;
+    }
+    if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+        && (depth_format != ICET_IMAGE_DEPTH_UNORM16)
+        && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+        icetRaiseError("Invalid depth format.", ICET_INVALID_ENUM);
+        depth_format = ICET_IMAGE_DEPTH_NONE;
     }
 
-    if (    icetImageBufferSizeType(color_format, depth_format,
-                                    icetImageGetWidth(image),
-                                    icetImageGetHeight(image))
-         != ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] ) {
-        icetRaiseError("Inconsistent sizes in image data.", ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
+    header[ICET_IMAGE_MAGIC_NUM_INDEX]          = ICET_SPARSE_IMAGE_MAGIC_NUM;
+    header[ICET_IMAGE_COLOR_FORMAT_INDEX]       = color_format;
+    header[ICET_IMAGE_DEPTH_FORMAT_INDEX]       = depth_format;
+    header[ICET_IMAGE_WIDTH_INDEX]              = (IceTInt)width;
+    header[ICET_IMAGE_HEIGHT_INDEX]             = (IceTInt)height;
+    header[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]     = (IceTInt)(width*height);
+    header[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] = 0;
+    header[ICET_IMAGE_FLAGS_INDEX]
+        = (  icetIsEnabled(ICET_COMPACT_RUN_LENGTHS)
+           ? ICET_SPARSE_IMAGE_COMPACT_RUN_LENGTHS : 0 );
+    if (   icetIsEnabled(ICET_PLANAR_SPARSE_IMAGES)
+        && (color_format != ICET_IMAGE_COLOR_NONE)
+        && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+        IceTEnum composite_mode;
+        icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+      /* Only z-buffer compositing keeps both color and depth. */
+        if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+            header[ICET_IMAGE_FLAGS_INDEX] |= ICET_SPARSE_IMAGE_PLANAR_LAYOUT;
+        }
+    }
+    if (icetIsEnabled(ICET_INDEX_SPARSE_IMAGES)) {
+        header[ICET_IMAGE_FLAGS_INDEX] |= ICET_SPARSE_IMAGE_SEEK_INDEX;
     }
 
-  /* The source may have used a bigger buffer than allocated here at the
-     receiver.  Record only size that holds current image. */
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
-        = (IceTInt)icetImageGetNumPixels(image);
+  /* Make sure the runlengths are valid. */
+    icetClearSparseImage(image);
 
-  /* The image is valid (as far as we can tell). */
     return image;
 }
 
-void icetSparseImagePackageForSend(IceTSparseImage image,
-                                   IceTVoid **buffer, IceTSizeType *size)
-{
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
-
-    if (icetSparseImageIsNull(image)) {
-        /* Should we return a Null pointer and 0 size without error?
-           Would all versions of MPI accept that? */
-        icetRaiseError("Cannot package NULL image for send.",
-                       ICET_INVALID_VALUE);
-        *buffer = NULL;
-        *size = 0;
-        return;
-    }
-
-    *buffer = image.opaque_internals;
-    *size = ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
-}
-
-IceTSparseImage icetSparseImageUnpackageFromReceive(IceTVoid *buffer)
+IceTSparseImage icetSparseImageNull(void)
 {
     IceTSparseImage image;
-    IceTEnum color_format, depth_format;
-
-    image.opaque_internals = buffer;
-
-  /* Check the image for validity. */
-    if (    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAGIC_NUM_INDEX]
-         != ICET_SPARSE_IMAGE_MAGIC_NUM ) {
-        icetRaiseError("Invalid image buffer: no magic number.",
-                       ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
-    }
-
-    color_format = icetSparseImageGetColorFormat(image);
-    if (    (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
-         && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
-         && (color_format != ICET_IMAGE_COLOR_NONE) ) {
-        icetRaiseError("Invalid image buffer: invalid color format.",
-                       ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
-    }
-
-    depth_format = icetSparseImageGetDepthFormat(image);
-    if (    (depth_format != ICET_IMAGE_DEPTH_FLOAT)
-         && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
-        icetRaiseError("Invalid image buffer: invalid depth format.",
-                       ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
-    }
-
-    if (   icetSparseImageBufferSizeType(color_format, depth_format,
-                                         icetSparseImageGetWidth(image),
-                                         icetSparseImageGetHeight(image))
-         < ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] ) {
-        icetRaiseError("Inconsistent sizes in image data.", ICET_INVALID_VALUE);
-        image.opaque_internals = NULL;
-        return image;
-    }
-
-  /* The source may have used a bigger buffer than allocated here at the
-     receiver.  Record only size that holds current image. */
-    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
-        = (IceTInt)icetSparseImageGetNumPixels(image);
-
-  /* The image is valid (as far as we can tell). */
+    image.opaque_internals = NULL;
     return image;
 }
 
-IceTBoolean icetSparseImageEqual(const IceTSparseImage image1,
-                                 const IceTSparseImage image2)
+IceTBoolean icetSparseImageIsNull(const IceTSparseImage image)
 {
-    return image1.opaque_internals == image2.opaque_internals;
+    if (image.opaque_internals == NULL) {
+        return ICET_TRUE;
+    } else {
+        return ICET_FALSE;
+    }
 }
 
-static void icetSparseImageScanPixels(const IceTVoid **in_data_p,
-                                      IceTSizeType *inactive_before_p,
-                                      IceTSizeType *active_till_next_runl_p,
-                                      IceTVoid **last_in_run_length_p,
-                                      IceTSizeType pixels_to_skip,
-                                      IceTSizeType pixel_size,
-                                      IceTVoid **out_data_p,
-                                      IceTVoid **out_run_length_p)
+void icetImageAdjustForOutput(IceTImage image)
 {
-    const IceTByte *in_data = *in_data_p; /* IceTByte for byte-pointer arithmetic. */
-    IceTSizeType inactive_before = *inactive_before_p;
-    IceTSizeType active_till_next_runl = *active_till_next_runl_p;
-    IceTSizeType pixels_left = pixels_to_skip;
-    const IceTVoid *last_in_run_length = NULL;
-    IceTByte *out_data;
-    IceTVoid *last_out_run_length;
-
-    if (pixels_left < 1) { return; }    /* Nothing to do. */
-
-#define ADVANCE_OUT_RUN_LENGTH()                        \
-    {                                                   \
-        last_out_run_length = out_data;                 \
-        out_data += RUN_LENGTH_SIZE;                    \
-        INACTIVE_RUN_LENGTH(last_out_run_length) = 0;   \
-        ACTIVE_RUN_LENGTH(last_out_run_length) = 0;     \
-    }        
-
-    if (out_data_p != NULL) {
-        out_data = *out_data_p;
-        if (out_run_length_p != NULL) {
-            last_out_run_length = *out_run_length_p;
-        } else /* out_run_length_p == NULL */ {
-            ADVANCE_OUT_RUN_LENGTH();
-        }
-    } else /* out_data_p == NULL */ {
-        out_data = NULL;
-        last_out_run_length = NULL;
-    }
+    IceTEnum color_format;
 
-    while (pixels_left > 0) {
-        IceTSizeType count;
-        if ((inactive_before == 0) && (active_till_next_runl == 0)) {
-            last_in_run_length = in_data;
-            inactive_before = INACTIVE_RUN_LENGTH(in_data);
-            active_till_next_runl = ACTIVE_RUN_LENGTH(in_data);
-            in_data += RUN_LENGTH_SIZE;
-        }
+    if (icetImageIsNull(image)) return;
 
-        count = MIN(inactive_before, pixels_left);
-        if (count > 0) {
-            if (out_data != NULL) {
-                if (ACTIVE_RUN_LENGTH(last_out_run_length) > 0) {
-                    ADVANCE_OUT_RUN_LENGTH();
-                }
-                INACTIVE_RUN_LENGTH(last_out_run_length) += count;
-            }
-            inactive_before -= count;
-            pixels_left -= count;
-        }
+    ICET_TEST_IMAGE_HEADER(image);
 
-        count = MIN(active_till_next_runl, pixels_left);
-        if (count > 0) {
-            if (out_data != NULL) {
-                ACTIVE_RUN_LENGTH(last_out_run_length) += count;
-                memcpy(out_data, in_data, count*pixel_size);
-                out_data += count*pixel_size;
-            }
-            in_data += count*pixel_size;
-            active_till_next_runl -= count;
-            pixels_left -= count;
+    if (icetIsEnabled(ICET_COMPOSITE_ONE_BUFFER)) {
+        color_format = icetImageGetColorFormat(image);
+        if (color_format != ICET_IMAGE_COLOR_NONE) {
+          /* Set to no depth information. */
+            ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX]
+                = ICET_IMAGE_DEPTH_NONE;
+          /* Reset the image size (changes actual buffer size). */
+            icetImageSetDimensions(image,
+                                   icetImageGetWidth(image),
+                                   icetImageGetHeight(image));
         }
     }
-    if (pixels_left < 0) {
-        icetRaiseError("Miscounted pixels", ICET_SANITY_CHECK_FAIL);
-    }
-
-    *in_data_p = in_data;
-    *inactive_before_p = inactive_before;
-    *active_till_next_runl_p = active_till_next_runl;
-    if (last_in_run_length_p) {
-        *last_in_run_length_p = (IceTVoid *)last_in_run_length;
-    }
-    if (out_data_p) {
-        *out_data_p = out_data;
-    }
-    if (out_run_length_p) {
-        *out_run_length_p = last_out_run_length;
-    }
-
-#undef ADVANCE_OUT_RUN_LENGTH
 }
 
-static void icetSparseImageCopyPixelsInternal(
-                                          const IceTVoid **in_data_p,
-                                          IceTSizeType *inactive_before_p,
-                                          IceTSizeType *active_till_next_runl_p,
-                                          IceTSizeType pixels_to_copy,
-                                          IceTSizeType pixel_size,
-                                          IceTSparseImage out_image)
+void icetImageAdjustForOutputBuffer(IceTImage image)
 {
-    IceTVoid *out_data = ICET_IMAGE_DATA(out_image);
+    IceTSizeType depth_bytes;
 
-    icetSparseImageSetDimensions(out_image, pixels_to_copy, 1);
+    if (icetImageIsNull(image)) return;
 
-    icetSparseImageScanPixels(in_data_p,
-                              inactive_before_p,
-                              active_till_next_runl_p,
-                              NULL,
-                              pixels_to_copy,
-                              pixel_size,
-                              &out_data,
-                              NULL);
+    ICET_TEST_IMAGE_HEADER(image);
 
-    icetSparseImageSetActualSize(out_image, out_data);
+  /* Move any depth values to where the colors started. */
+    depth_bytes = (  icetImageGetNumPixels(image)
+                   * depthPixelSize(icetImageGetDepthFormat(image)) );
+    memmove(ICET_IMAGE_DATA(image),
+            icetImageGetDepthVoid(image, NULL),
+            depth_bytes);
+
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX]
+        = ICET_IMAGE_COLOR_NONE;
+  /* Reset the image size (changes actual buffer size). */
+    icetImageSetDimensions(image,
+                           icetImageGetWidth(image),
+                           icetImageGetHeight(image));
 }
 
-static void icetSparseImageCopyPixelsInPlaceInternal(
-                                          const IceTVoid **in_data_p,
-                                          IceTSizeType *inactive_before_p,
-                                          IceTSizeType *active_till_next_runl_p,
-                                          IceTSizeType pixels_to_copy,
-                                          IceTSizeType pixel_size,
-                                          IceTSparseImage out_image)
+void icetImageAdjustForInput(IceTImage image)
 {
-    IceTVoid *last_run_length = NULL;
+    IceTEnum color_format, depth_format;
 
-#ifdef DEBUG
-    if (   (*in_data_p != ICET_IMAGE_DATA(out_image))
-        || (*inactive_before_p != 0)
-        || (*active_till_next_runl_p != 0) ) {
-        icetRaiseError("icetSparseImageCopyPixelsInPlaceInternal not called"
-                       " at beginning of buffer.",
-                       ICET_SANITY_CHECK_FAIL);
-    }
-#endif
+    if (icetImageIsNull(image)) return;
 
-    icetSparseImageScanPixels(in_data_p,
-                              inactive_before_p,
-                              active_till_next_runl_p,
-                              &last_run_length,
-                              pixels_to_copy,
-                              pixel_size,
-                              NULL,
-                              NULL);
+    ICET_TEST_IMAGE_HEADER(image);
 
-    ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_WIDTH_INDEX]
-        = (IceTInt)pixels_to_copy;
-    ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)1;
+    icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
+    icetGetEnumv(ICET_DEPTH_FORMAT, &depth_format);
 
-    if (last_run_length != NULL) {
-        INACTIVE_RUN_LENGTH(last_run_length) -= *inactive_before_p;
-        ACTIVE_RUN_LENGTH(last_run_length) -= *active_till_next_runl_p;
-    }
+  /* Reset to the specified image format. */
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX] = color_format;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX] = depth_format;
 
-    icetSparseImageSetActualSize(out_image, *in_data_p);
+  /* Reset the image size (changes actual buffer size). */
+    icetImageSetDimensions(image,
+                           icetImageGetWidth(image),
+                           icetImageGetHeight(image));
 }
 
-void icetSparseImageCopyPixels(const IceTSparseImage in_image,
-                               IceTSizeType in_offset,
-                               IceTSizeType num_pixels,
-                               IceTSparseImage out_image)
+IceTEnum icetImageGetColorFormat(const IceTImage image)
 {
-    IceTEnum color_format;
-    IceTEnum depth_format;
-    IceTSizeType pixel_size;
+    ICET_TEST_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return ICET_IMAGE_COLOR_NONE;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX];
+}
+IceTEnum icetImageGetDepthFormat(const IceTImage image)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return ICET_IMAGE_DEPTH_NONE;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX];
+}
+IceTSizeType icetImageGetWidth(const IceTImage image)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX];
+}
+IceTSizeType icetImageGetHeight(const IceTImage image)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX];
+}
+IceTSizeType icetImageGetNumPixels(const IceTImage image)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX]
+            * ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] );
+}
 
-    const IceTVoid *in_data;
-    IceTSizeType start_inactive;
-    IceTSizeType start_active;
+IceTEnum icetSparseImageGetColorFormat(const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return ICET_IMAGE_COLOR_NONE;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_COLOR_FORMAT_INDEX];
+}
+IceTEnum icetSparseImageGetDepthFormat(const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return ICET_IMAGE_DEPTH_NONE;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_DEPTH_FORMAT_INDEX];
+}
+IceTSizeType icetSparseImageGetWidth(const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX];
+}
+IceTSizeType icetSparseImageGetHeight(const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX];
+}
+IceTSizeType icetSparseImageGetNumPixels(const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX]
+            * ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] );
+}
+IceTSizeType icetSparseImageGetCompressedBufferSize(
+                                             const IceTSparseImage image)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+    if (!image.opaque_internals) return 0;
+    return ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+}
 
-    icetTimingCompressBegin();
+void icetImageSetDimensions(IceTImage image,
+                            IceTSizeType width,
+                            IceTSizeType height)
+{
+    ICET_TEST_IMAGE_HEADER(image);
 
-    color_format = icetSparseImageGetColorFormat(in_image);
-    depth_format = icetSparseImageGetDepthFormat(in_image);
-    if (   (color_format != icetSparseImageGetColorFormat(out_image))
-        || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
-        icetRaiseError("Cannot copy pixels of images with different formats.",
+    if (icetImageIsNull(image)) {
+        icetRaiseError("Cannot set number of pixels on null image.",
                        ICET_INVALID_VALUE);
-        icetTimingCompressEnd();
         return;
     }
 
-    if (   (in_offset == 0)
-        && (num_pixels == icetSparseImageGetNumPixels(in_image)) ) {
-        /* Special case, copying image in its entirety.  Using the standard
-         * method will work, but doing a raw data copy can be faster. */
-        IceTSizeType bytes_to_copy
-            = ICET_IMAGE_HEADER(in_image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
-        IceTSizeType max_pixels
-            = ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX];
-
-        ICET_TEST_SPARSE_IMAGE_HEADER(out_image);
-
-        if (max_pixels < num_pixels) {
-            icetRaiseError("Cannot set an image size to greater than what the"
-                           " image was originally created.",
-                           ICET_INVALID_VALUE);
-            icetTimingCompressEnd();
-            return;
-        }
+    if (   width*height
+         > ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX] ){
+        icetRaiseError("Cannot set an image size to greater than what the"
+                       " image was originally created.", ICET_INVALID_VALUE);
+        return;
+    }
 
-        memcpy(ICET_IMAGE_HEADER(out_image),
-               ICET_IMAGE_HEADER(in_image),
-               bytes_to_copy);
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX] = (IceTInt)width;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)height;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+        = (IceTInt)icetImageBufferSizeType(icetImageGetColorFormat(image),
+                                           icetImageGetDepthFormat(image),
+                                           width,
+                                           height);
+}
 
-        ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
-            = max_pixels;
+void icetSparseImageSetDimensions(IceTSparseImage image,
+                                  IceTSizeType width,
+                                  IceTSizeType height)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
 
-        icetTimingCompressEnd();
+    if (image.opaque_internals == NULL) {
+        icetRaiseError("Cannot set number of pixels on null image.",
+                       ICET_INVALID_VALUE);
         return;
     }
 
-    pixel_size = colorPixelSize(color_format) + depthPixelSize(depth_format);
-
-    in_data = ICET_IMAGE_DATA(in_image);
-    start_inactive = start_active = 0;
-    icetSparseImageScanPixels(&in_data,
-                              &start_inactive,
-                              &start_active,
-                              NULL,
-                              in_offset,
-                              pixel_size,
-                              NULL,
-                              NULL);
+    if (   width*height
+         > ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX] ){
+        icetRaiseError("Cannot set an image size to greater than what the"
+                       " image was originally created.", ICET_INVALID_VALUE);
+        return;
+    }
 
-    icetSparseImageCopyPixelsInternal(&in_data,
-                                      &start_inactive,
-                                      &start_active,
-                                      num_pixels,
-                                      pixel_size,
-                                      out_image);
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX] = (IceTInt)width;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)height;
 
-    icetTimingCompressEnd();
+  /* Make sure the runlengths are valid. */
+    icetClearSparseImage(image);
 }
 
-IceTSizeType icetSparseImageSplitPartitionNumPixels(
-                                                IceTSizeType input_num_pixels,
-                                                IceTInt num_partitions,
-                                                IceTInt eventual_num_partitions)
+static void icetSparseImageSetActualSize(IceTSparseImage image,
+                                         const IceTVoid *data_end)
 {
-    IceTInt sub_partitions = eventual_num_partitions/num_partitions;
+    /* Compute the actual number of bytes used to store the image. */
+    IceTPointerArithmetic buffer_begin
+        =(IceTPointerArithmetic)ICET_IMAGE_HEADER(image);
+    IceTPointerArithmetic buffer_end
+        =(IceTPointerArithmetic)data_end;
+    IceTPointerArithmetic compressed_size = buffer_end - buffer_begin;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+        = (IceTInt)compressed_size;
+}
 
-#ifdef DEBUG
-    if (eventual_num_partitions%num_partitions != 0) {
-        icetRaiseError("num_partitions not a factor"
-                       " of eventual_num_partitions.",
-                       ICET_INVALID_VALUE);
+static IceTVoid *icetSparseImageStartRun(IceTVoid *data,
+                                         IceTSizeType num_inactive,
+                                         IceTBoolean compact)
+{
+    IceTByte *run_length = data; /* IceTByte for byte-pointer arithmetic. */
+    IceTSizeType max_run_length = MAX_RUN_LENGTH_OF(compact);
+
+    while (num_inactive > max_run_length) {
+        SET_INACTIVE_RUN_LENGTH(run_length, compact, max_run_length);
+        SET_ACTIVE_RUN_LENGTH(run_length, compact, 0);
+        run_length += RUN_LENGTH_SIZE_OF(compact);
+        num_inactive -= max_run_length;
     }
-#endif
 
-    return input_num_pixels/num_partitions + sub_partitions;
+    SET_INACTIVE_RUN_LENGTH(run_length, compact, num_inactive);
+    SET_ACTIVE_RUN_LENGTH(run_length, compact, 0);
+    return run_length;
 }
 
-static void icetSparseImageSplitChoosePartitions(
-                                                IceTInt num_partitions,
-                                                IceTInt eventual_num_partitions,
-                                                IceTSizeType size,
-                                                IceTSizeType first_offset,
-                                                IceTSizeType *offsets)
+const IceTVoid *icetImageGetColorConstVoid(const IceTImage image,
+                                           IceTSizeType *pixel_size)
 {
-    IceTSizeType remainder = size%eventual_num_partitions;
-    IceTInt sub_partitions = eventual_num_partitions/num_partitions;
-    IceTSizeType partition_lower_size
-        = (size/eventual_num_partitions)*sub_partitions;
-    IceTSizeType this_offset = first_offset;
-    IceTInt partition_idx;
-
-#ifdef DEBUG
-    if (eventual_num_partitions%num_partitions != 0) {
-        icetRaiseError("num_partitions not a factor"
-                       " of eventual_num_partitions.",
-                       ICET_INVALID_VALUE);
+    if (pixel_size) {
+        IceTEnum color_format = icetImageGetColorFormat(image);
+        *pixel_size = colorPixelSize(color_format);
     }
-#endif
 
-    for (partition_idx = 0; partition_idx < num_partitions; partition_idx++) {
-        offsets[partition_idx] = this_offset;
-        this_offset += partition_lower_size;
-        if (remainder > sub_partitions) {
-            this_offset += sub_partitions;
-            remainder -= sub_partitions;
-        } else {
-            this_offset += remainder;
-            remainder = 0;
-        }
-    }
+    return ICET_IMAGE_DATA(image);
 }
-
-void icetSparseImageSplit(const IceTSparseImage in_image,
-                          IceTSizeType in_image_offset,
-                          IceTInt num_partitions,
-                          IceTInt eventual_num_partitions,
-                          IceTSparseImage *out_images,
-                          IceTSizeType *offsets)
+IceTVoid *icetImageGetColorVoid(IceTImage image, IceTSizeType *pixel_size)
 {
-    IceTSizeType total_num_pixels;
+    const IceTVoid *const_buffer = icetImageGetColorConstVoid(image, pixel_size);
 
-    IceTEnum color_format;
-    IceTEnum depth_format;
-    IceTSizeType pixel_size;
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTVoid *)const_buffer;
+}
 
-    const IceTVoid *in_data;
-    IceTSizeType start_inactive;
-    IceTSizeType start_active;
+const IceTUByte *icetImageGetColorcub(const IceTImage image)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
 
-    IceTInt partition;
+    if (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetRaiseError("Color format is not of type ubyte.",
+                       ICET_INVALID_OPERATION);
+        return NULL;
+    }
 
-    icetTimingCompressBegin();
+    return icetImageGetColorConstVoid(image, NULL);
+}
+IceTUByte *icetImageGetColorub(IceTImage image)
+{
+    const IceTUByte *const_buffer = icetImageGetColorcub(image);
 
-    if (num_partitions < 2) {
-        icetRaiseError("It does not make sense to call icetSparseImageSplit"
-                       " with less than 2 partitions.",
-                       ICET_INVALID_VALUE);
-        icetTimingCompressEnd();
-        return;
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTUByte *)const_buffer;
+}
+const IceTUInt *icetImageGetColorcui(const IceTImage image)
+{
+    return (const IceTUInt *)icetImageGetColorcub(image);
+}
+IceTUInt *icetImageGetColorui(IceTImage image)
+{
+    return (IceTUInt *)icetImageGetColorub(image);
+}
+const IceTFloat *icetImageGetColorcf(const IceTImage image)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
+
+    if (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        icetRaiseError("Color format is not of type float.",
+                       ICET_INVALID_OPERATION);
+        return NULL;
     }
 
-    total_num_pixels = icetSparseImageGetNumPixels(in_image);
+    return icetImageGetColorConstVoid(image, NULL);
+}
+IceTFloat *icetImageGetColorf(IceTImage image)
+{
+    const IceTFloat *const_buffer = icetImageGetColorcf(image);
 
-    color_format = icetSparseImageGetColorFormat(in_image);
-    depth_format = icetSparseImageGetDepthFormat(in_image);
-    pixel_size = colorPixelSize(color_format) + depthPixelSize(depth_format);
+    
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTFloat *)const_buffer;
+}
 
-    in_data = ICET_IMAGE_DATA(in_image);
-    start_inactive = start_active = 0;
+const IceTUShort *icetImageGetColorcus(const IceTImage image)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
 
-    icetSparseImageSplitChoosePartitions(num_partitions,
-                                         eventual_num_partitions,
-                                         total_num_pixels,
-                                         in_image_offset,
-                                         offsets);
+    if (color_format != ICET_IMAGE_COLOR_RGBA_HALF) {
+        icetRaiseError("Color format is not of type half.",
+                       ICET_INVALID_OPERATION);
+        return NULL;
+    }
 
-    for (partition = 0; partition < num_partitions; partition++) {
-        IceTSparseImage out_image = out_images[partition];
-        IceTSizeType partition_num_pixels;
+    return icetImageGetColorConstVoid(image, NULL);
+}
+IceTUShort *icetImageGetColorus(IceTImage image)
+{
+    const IceTUShort *const_buffer = icetImageGetColorcus(image);
 
-        if (   (color_format != icetSparseImageGetColorFormat(out_image))
-            || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
-            icetRaiseError("Cannot copy pixels of images with different"
-                           " formats.",
-                           ICET_INVALID_VALUE);
-            icetTimingCompressEnd();
-            return;
-        }
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTUShort *)const_buffer;
+}
 
-        if (partition < num_partitions-1) {
-            partition_num_pixels = offsets[partition+1] - offsets[partition];
-        } else {
-            partition_num_pixels
-                = total_num_pixels + in_image_offset - offsets[partition];
-        }
+const IceTVoid *icetImageGetDepthConstVoid(const IceTImage image,
+                                           IceTSizeType *pixel_size)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTSizeType color_format_bytes;
+    const IceTByte *image_data_pointer;
 
-        if (icetSparseImageEqual(in_image, out_image)) {
-            if (partition == 0) {
-                icetSparseImageCopyPixelsInPlaceInternal(&in_data,
-                                                         &start_inactive,
-                                                         &start_active,
-                                                         partition_num_pixels,
-                                                         pixel_size,
-                                                         out_image);
-            } else {
-                icetRaiseError("icetSparseImageSplit copy in place only allowed"
-                               " in first partition.",
-                               ICET_INVALID_VALUE);
-            }
-        } else {
-            icetSparseImageCopyPixelsInternal(&in_data,
-                                              &start_inactive,
-                                              &start_active,
-                                              partition_num_pixels,
-                                              pixel_size,
-                                              out_image);
-        }
+    if (pixel_size) {
+        IceTEnum depth_format = icetImageGetDepthFormat(image);
+        *pixel_size = depthPixelSize(depth_format);
     }
 
-#ifdef DEBUG
-    if (   (start_inactive != 0)
-        || (start_active != 0) ) {
-        icetRaiseError("Counting problem.", ICET_SANITY_CHECK_FAIL);
-    }
-#endif
+    color_format_bytes = (  icetImageGetNumPixels(image)
+                          * colorPixelSize(color_format) );
 
-    icetTimingCompressEnd();
+    /* Cast to IceTByte to ensure pointer arithmetic is correct. */
+    image_data_pointer = (const IceTByte*)ICET_IMAGE_DATA(image);
+
+    return image_data_pointer + color_format_bytes;
 }
+IceTVoid *icetImageGetDepthVoid(IceTImage image, IceTSizeType *pixel_size)
+{
+    const IceTVoid *const_buffer =icetImageGetDepthConstVoid(image, pixel_size);
 
-void icetSparseImageInterlace(const IceTSparseImage in_image,
-                              IceTInt eventual_num_partitions,
-                              IceTEnum scratch_state_buffer,
-                              IceTSparseImage out_image)
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTVoid *)const_buffer;  
+}
+const IceTFloat *icetImageGetDepthcf(const IceTImage image)
 {
-    IceTSizeType num_pixels = icetSparseImageGetNumPixels(in_image);
-    IceTEnum color_format = icetSparseImageGetColorFormat(in_image);
-    IceTEnum depth_format = icetSparseImageGetDepthFormat(in_image);
-    IceTSizeType lower_partition_size = num_pixels/eventual_num_partitions;
-    IceTSizeType remaining_pixels = num_pixels%eventual_num_partitions;
-    IceTSizeType pixel_size;
-    IceTInt original_partition_idx;
-    IceTInt interlaced_partition_idx;
-    const IceTVoid **in_data_array;
-    IceTSizeType *inactive_before_array;
-    IceTSizeType *active_till_next_runl_array;
-    const IceTVoid *in_data;
-    IceTVoid *out_data;
-    IceTSizeType inactive_before;
-    IceTSizeType active_till_next_runl;
-    IceTVoid *last_run_length;
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
 
-    /* Special case, nothing to do. */
-    if (eventual_num_partitions < 2) {
-        icetSparseImageCopyPixels(in_image, 0, num_pixels, out_image);
-        return;
+    if (depth_format != ICET_IMAGE_DEPTH_FLOAT) {
+        icetRaiseError("Depth format is not of type float.",
+                       ICET_INVALID_OPERATION);
+        return NULL;
     }
 
-    if (   (color_format != icetSparseImageGetColorFormat(out_image))
-        || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
-        icetRaiseError("Cannot copy pixels of images with different formats.",
-                       ICET_INVALID_VALUE);
-        return;
-    }
+    return icetImageGetDepthConstVoid(image, NULL);
+}
+IceTFloat *icetImageGetDepthf(IceTImage image)
+{
+    const IceTFloat *const_buffer = icetImageGetDepthcf(image);
 
-    pixel_size = colorPixelSize(color_format) + depthPixelSize(depth_format);
+    
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTFloat *)const_buffer;
+}
+const IceTUShort *icetImageGetDepthcus(const IceTImage image)
+{
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
 
-    {
-        IceTByte *buffer = icetGetStateBuffer(
-                              scratch_state_buffer,
-                                eventual_num_partitions*sizeof(IceTVoid*)
-                              + 2*eventual_num_partitions*sizeof(IceTSizeType));
-        in_data_array = (const IceTVoid **)buffer;
-        inactive_before_array
-            = (IceTSizeType *)(  buffer
-                               + eventual_num_partitions*sizeof(IceTVoid*));
-        active_till_next_runl_array
-            = inactive_before_array + eventual_num_partitions;
+    if (depth_format != ICET_IMAGE_DEPTH_UNORM16) {
+        icetRaiseError("Depth format is not of type unsigned short.",
+                       ICET_INVALID_OPERATION);
+        return NULL;
     }
 
-    /* Run through the input data and figure out where each interlaced
-       partition needs to read from. */
-    in_data = ICET_IMAGE_DATA(in_image);
-    inactive_before = 0;
-    active_till_next_runl = 0;
-    for (original_partition_idx = 0;
-         original_partition_idx < eventual_num_partitions;
-         original_partition_idx++) {
-        IceTSizeType pixels_to_skip;
-
-        BIT_REVERSE(interlaced_partition_idx,
-                    original_partition_idx,
-                    eventual_num_partitions);
-        if (eventual_num_partitions <= interlaced_partition_idx) {
-            interlaced_partition_idx = original_partition_idx;
-        }
+    return icetImageGetDepthConstVoid(image, NULL);
+}
+IceTUShort *icetImageGetDepthus(IceTImage image)
+{
+    const IceTUShort *const_buffer = icetImageGetDepthcus(image);
 
-        pixels_to_skip = lower_partition_size;
-        if (interlaced_partition_idx < remaining_pixels) {
-            pixels_to_skip += 1;
-        }
+    /* This const cast is OK because we actually got the pointer from a
+       non-const image. */
+    return (IceTUShort *)const_buffer;
+}
 
-        in_data_array[interlaced_partition_idx] = in_data;
-        inactive_before_array[interlaced_partition_idx] = inactive_before;
-        active_till_next_runl_array[interlaced_partition_idx]
-            = active_till_next_runl;
+void icetImageCopyColorub(const IceTImage image,
+                          IceTUByte *color_buffer,
+                          IceTEnum out_color_format)
+{
+    IceTEnum in_color_format = icetImageGetColorFormat(image);
+    IceTCopyColorRangeData data;
 
-        if (original_partition_idx < eventual_num_partitions-1) {
-            icetSparseImageScanPixels((const IceTVoid**)&in_data,
-                                      &inactive_before,
-                                      &active_till_next_runl,
-                                      NULL,
-                                      pixels_to_skip,
-                                      pixel_size,
-                                      NULL,
-                                      NULL);
-        }
+    if (out_color_format != ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetRaiseError("Color format is not of type ubyte.",
+                       ICET_INVALID_ENUM);
+        return;
+    }
+    if (in_color_format == ICET_IMAGE_COLOR_NONE) {
+        icetRaiseError("Input image has no color data.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+    if (   (in_color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (in_color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (in_color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+        icetRaiseError("Encountered unexpected color format combination.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
     }
 
-    /* Set up output image. */
-    icetSparseImageSetDimensions(out_image,
-                                 icetSparseImageGetWidth(in_image),
-                                 icetSparseImageGetHeight(in_image));
-    out_data = ICET_IMAGE_DATA(out_image);
-    INACTIVE_RUN_LENGTH(out_data) = 0;
-    ACTIVE_RUN_LENGTH(out_data) = 0;
-    last_run_length = out_data;
-    out_data = (IceTByte*)out_data + RUN_LENGTH_SIZE;
+    data.in_format = in_color_format;
+    data.out_format = out_color_format;
+    data.in_buffer = icetImageGetColorConstVoid(image, NULL);
+    data.out_buffer = color_buffer;
+    icetParallelPixelRanges(icetImageGetNumPixels(image),
+                            1,
+                            icetImageCopyColorRange,
+                            &data);
+}
 
-    for (interlaced_partition_idx = 0;
-         interlaced_partition_idx < eventual_num_partitions;
-         interlaced_partition_idx++) {
-        IceTSizeType pixels_left;
+void icetImageCopyColorf(const IceTImage image,
+                         IceTFloat *color_buffer,
+                         IceTEnum out_color_format)
+{
+    IceTEnum in_color_format = icetImageGetColorFormat(image);
+    IceTCopyColorRangeData data;
+
+    if (out_color_format != ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        icetRaiseError("Color format is not of type float.",
+                       ICET_INVALID_ENUM);
+        return;
+    }
+    if (in_color_format == ICET_IMAGE_COLOR_NONE) {
+        icetRaiseError("Input image has no color data.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+    if (   (in_color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (in_color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (in_color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+        icetRaiseError("Unexpected format combination.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+
+    data.in_format = in_color_format;
+    data.out_format = out_color_format;
+    data.in_buffer = icetImageGetColorConstVoid(image, NULL);
+    data.out_buffer = color_buffer;
+    icetParallelPixelRanges(icetImageGetNumPixels(image),
+                            1,
+                            icetImageCopyColorRange,
+                            &data);
+}
+
+static void icetImageCopyColorRange(IceTVoid *data_p,
+                                    IceTSizeType first_pixel,
+                                    IceTSizeType num_pixels)
+{
+    const IceTCopyColorRangeData *data = (IceTCopyColorRangeData *)data_p;
+    IceTEnum in_color_format = data->in_format;
+    IceTEnum out_color_format = data->out_format;
+    IceTSizeType i;
+
+    if (in_color_format == out_color_format) {
+        IceTSizeType pixel_size = colorPixelSize(in_color_format);
+        memcpy((IceTByte *)data->out_buffer + first_pixel*pixel_size,
+               (const IceTByte *)data->in_buffer + first_pixel*pixel_size,
+               num_pixels*pixel_size);
+    } else if (out_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        IceTUByte *color_buffer
+            = (IceTUByte *)data->out_buffer + 4*first_pixel;
+        if (in_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+            const IceTFloat *in
+                = (const IceTFloat *)data->in_buffer + 4*first_pixel;
+            for (i = 0; i < 4*num_pixels; i++) {
+                color_buffer[i] = (IceTUByte)(255*in[i]);
+            }
+        } else { /* in_color_format == ICET_IMAGE_COLOR_RGBA_HALF */
+            const IceTUShort *in_buffer
+                = (const IceTUShort *)data->in_buffer + 4*first_pixel;
+            IceTFloat color[4];
+            for (i = 0; i < num_pixels; i++) {
+                icetHalfToFloatArray(in_buffer + 4*i, color, 4);
+                color_buffer[4*i + 0] = (IceTUByte)(255*color[0]);
+                color_buffer[4*i + 1] = (IceTUByte)(255*color[1]);
+                color_buffer[4*i + 2] = (IceTUByte)(255*color[2]);
+                color_buffer[4*i + 3] = (IceTUByte)(255*color[3]);
+            }
+        }
+    } else { /* out_color_format == ICET_IMAGE_COLOR_RGBA_FLOAT */
+        IceTFloat *color_buffer
+            = (IceTFloat *)data->out_buffer + 4*first_pixel;
+        if (in_color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            const IceTUByte *in
+                = (const IceTUByte *)data->in_buffer + 4*first_pixel;
+            for (i = 0; i < 4*num_pixels; i++) {
+                color_buffer[i] = (IceTFloat)in[i]/255.0f;
+            }
+        } else { /* in_color_format == ICET_IMAGE_COLOR_RGBA_HALF */
+            icetHalfToFloatArray(
+                        (const IceTUShort *)data->in_buffer + 4*first_pixel,
+                        color_buffer,
+                        4*num_pixels);
+        }
+    }
+}
+
+void icetImageCopyDepthf(const IceTImage image,
+                         IceTFloat *depth_buffer,
+                         IceTEnum out_depth_format)
+{
+    IceTEnum in_depth_format = icetImageGetDepthFormat(image);
+
+    if (out_depth_format != ICET_IMAGE_DEPTH_FLOAT) {
+        icetRaiseError("Depth format is not of type float.",
+                       ICET_INVALID_ENUM);
+        return;
+    }
+    if (in_depth_format == ICET_IMAGE_DEPTH_NONE) {
+        icetRaiseError("Input image has no depth data.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    if (in_depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+        const IceTFloat *in_buffer = icetImageGetDepthcf(image);
+        IceTSizeType depth_format_bytes = (  icetImageGetNumPixels(image)
+                                           * depthPixelSize(in_depth_format) );
+        memcpy(depth_buffer, in_buffer, depth_format_bytes);
+    } else if (in_depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+        const IceTUShort *in_buffer = icetImageGetDepthcus(image);
+        IceTSizeType num_pixels = icetImageGetNumPixels(image);
+        IceTSizeType i;
+        const IceTUShort *in;
+        IceTFloat *out;
+        for (i = 0, in = in_buffer, out = depth_buffer; i < num_pixels;
+             i++, in++, out++) {
+            out[0] = (IceTFloat)in[0]/65535.0f;
+        }
+    } else {
+        icetRaiseError("Unexpected format combination.",
+                       ICET_SANITY_CHECK_FAIL);
+    }
+}
+
+IceTBoolean icetImageEqual(const IceTImage image1, const IceTImage image2)
+{
+    return image1.opaque_internals == image2.opaque_internals;
+}
+
+void icetImageCopyPixels(const IceTImage in_image, IceTSizeType in_offset,
+                         IceTImage out_image, IceTSizeType out_offset,
+                         IceTSizeType num_pixels)
+{
+    IceTEnum color_format, depth_format;
+
+    color_format = icetImageGetColorFormat(in_image);
+    depth_format = icetImageGetDepthFormat(in_image);
+    if (   (color_format != icetImageGetColorFormat(out_image))
+        || (depth_format != icetImageGetDepthFormat(out_image)) ) {
+        icetRaiseError("Cannot copy pixels of images with different formats.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    if (    (in_offset < 0)
+         || (in_offset + num_pixels > icetImageGetNumPixels(in_image)) ) {
+        icetRaiseError("Pixels to copy are outside of range of source image.",
+                       ICET_INVALID_VALUE);
+    }
+    if (    (out_offset < 0)
+         || (out_offset + num_pixels > icetImageGetNumPixels(out_image)) ) {
+        icetRaiseError("Pixels to copy are outside of range of source image.",
+                       ICET_INVALID_VALUE);
+    }
+
+    if (color_format != ICET_IMAGE_COLOR_NONE) {
+        const IceTByte *in_colors;  /* Use IceTByte for pointer arithmetic */
+        IceTByte *out_colors;
+        IceTSizeType pixel_size;
+        in_colors = icetImageGetColorVoid(in_image, &pixel_size);
+        out_colors = icetImageGetColorVoid(out_image, NULL);
+        memcpy(out_colors + pixel_size*out_offset,
+               in_colors + pixel_size*in_offset,
+               pixel_size*num_pixels);
+    }
+
+    if (depth_format != ICET_IMAGE_DEPTH_NONE) {
+        const IceTByte *in_depths;  /* Use IceTByte for pointer arithmetic */
+        IceTByte *out_depths;
+        IceTSizeType pixel_size;
+        in_depths = icetImageGetDepthVoid(in_image, &pixel_size);
+        out_depths = icetImageGetDepthVoid(out_image, NULL);
+        memcpy(out_depths + pixel_size*out_offset,
+               in_depths + pixel_size*in_offset,
+               pixel_size*num_pixels);
+    }
+}
+
+void icetImageCopyRegion(const IceTImage in_image,
+                         const IceTInt *in_viewport,
+                         IceTImage out_image,
+                         const IceTInt *out_viewport)
+{
+    IceTEnum color_format = icetImageGetColorFormat(in_image);
+    IceTEnum depth_format = icetImageGetDepthFormat(in_image);
+
+    if (    (color_format != icetImageGetColorFormat(out_image))
+         || (depth_format != icetImageGetDepthFormat(out_image)) ) {
+        icetRaiseError("icetImageCopyRegion only supports copying images"
+                       " of the same format.", ICET_INVALID_VALUE);
+        return;
+    }
+
+    if (    (in_viewport[2] != out_viewport[2])
+         || (in_viewport[3] != out_viewport[3]) ) {
+        icetRaiseError("Sizes of input and output regions must be the same.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    if (color_format != ICET_IMAGE_COLOR_NONE) {
+        IceTSizeType pixel_size;
+        /* Use IceTByte for byte-based pointer arithmetic. */
+        const IceTByte *src = icetImageGetColorVoid(in_image, &pixel_size);
+        IceTByte *dest = icetImageGetColorVoid(out_image, &pixel_size);
+        IceTSizeType y;
+
+      /* Advance pointers up to vertical offset. */
+        src  += in_viewport[1]*icetImageGetWidth(in_image)*pixel_size;
+        dest += out_viewport[1]*icetImageGetWidth(out_image)*pixel_size;
+
+      /* Advance pointers forward to horizontal offset. */
+        src  += in_viewport[0]*pixel_size;
+        dest += out_viewport[0]*pixel_size;
+
+        for (y = 0; y < in_viewport[3]; y++) {
+            memcpy(dest, src, in_viewport[2]*pixel_size);
+            src  += icetImageGetWidth(in_image)*pixel_size;
+            dest += icetImageGetWidth(out_image)*pixel_size;
+        }
+    }
+
+    if (depth_format != ICET_IMAGE_DEPTH_NONE) {
+        IceTSizeType pixel_size;
+        /* Use IceTByte for byte-based pointer arithmetic. */
+        const IceTByte *src = icetImageGetDepthVoid(in_image, &pixel_size);
+        IceTByte *dest = icetImageGetDepthVoid(out_image, &pixel_size);
+        IceTSizeType y;
+
+      /* Advance pointers up to vertical offset. */
+        src  += in_viewport[1]*icetImageGetWidth(in_image)*pixel_size;
+        dest += out_viewport[1]*icetImageGetWidth(out_image)*pixel_size;
+
+      /* Advance pointers forward to horizontal offset. */
+        src  += in_viewport[0]*pixel_size;
+        dest += out_viewport[0]*pixel_size;
+
+        for (y = 0; y < in_viewport[3]; y++) {
+            memcpy(dest, src, in_viewport[2]*pixel_size);
+            src  += icetImageGetWidth(in_image)*pixel_size;
+            dest += icetImageGetWidth(out_image)*pixel_size;
+        }
+    }
+}
+
+void icetImageClearAroundRegion(IceTImage image, const IceTInt *region)
+{
+    IceTSizeType width = icetImageGetWidth(image);
+    IceTSizeType height = icetImageGetHeight(image);
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
+    IceTSizeType x, y;
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        IceTUInt *color_buffer = icetImageGetColorui(image);
+        IceTUInt background_color;
+
+        icetGetIntegerv(ICET_BACKGROUND_COLOR_WORD,(IceTInt*)&background_color);
+
+      /* Clear out bottom. */
+        for (y = 0; y < region[1]; y++) {
+            for (x = 0; x < width; x++) {
+                color_buffer[y*width + x] = background_color;
+            }
+        }
+      /* Clear out left and right. */
+        if ((region[0] > 0) || (region[0]+region[2] < width)) {
+            for (y = region[1]; y < region[1]+region[3]; y++) {
+                for (x = 0; x < region[0]; x++) {
+                    color_buffer[y*width + x] = background_color;
+                }
+                for (x = region[0]+region[2]; x < width; x++) {
+                    color_buffer[y*width + x] = background_color;
+                }
+            }
+        }
+      /* Clear out top. */
+        for (y = region[1]+region[3]; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                color_buffer[y*width + x] = background_color;
+            }
+        }
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        IceTFloat *color_buffer = icetImageGetColorf(image);
+        IceTFloat background_color[4];
+
+        icetGetFloatv(ICET_BACKGROUND_COLOR, background_color);
+
+      /* Clear out bottom. */
+        for (y = 0; y < region[1]; y++) {
+            for (x = 0; x < width; x++) {
+                color_buffer[4*(y*width + x) + 0] = background_color[0];
+                color_buffer[4*(y*width + x) + 1] = background_color[1];
+                color_buffer[4*(y*width + x) + 2] = background_color[2];
+                color_buffer[4*(y*width + x) + 3] = background_color[3];
+            }
+        }
+      /* Clear out left and right. */
+        if ((region[0] > 0) || (region[0]+region[2] < width)) {
+            for (y = region[1]; y < region[1]+region[3]; y++) {
+                for (x = 0; x < region[0]; x++) {
+                    color_buffer[4*(y*width + x) + 0] = background_color[0];
+                    color_buffer[4*(y*width + x) + 1] = background_color[1];
+                    color_buffer[4*(y*width + x) + 2] = background_color[2];
+                    color_buffer[4*(y*width + x) + 3] = background_color[3];
+                }
+                for (x = region[0]+region[2]; x < width; x++) {
+                    color_buffer[4*(y*width + x) + 0] = background_color[0];
+                    color_buffer[4*(y*width + x) + 1] = background_color[1];
+                    color_buffer[4*(y*width + x) + 2] = background_color[2];
+                    color_buffer[4*(y*width + x) + 3] = background_color[3];
+                }
+            }
+        }
+      /* Clear out top. */
+        for (y = region[1]+region[3]; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                color_buffer[4*(y*width + x) + 0] = background_color[0];
+                color_buffer[4*(y*width + x) + 1] = background_color[1];
+                color_buffer[4*(y*width + x) + 2] = background_color[2];
+                color_buffer[4*(y*width + x) + 3] = background_color[3];
+            }
+        }
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        IceTUShort *color_buffer = icetImageGetColorus(image);
+        IceTFloat background_color_float[4];
+        IceTUShort background_color[4];
+
+        icetGetFloatv(ICET_BACKGROUND_COLOR, background_color_float);
+        icetFloatToHalfArray(background_color_float, background_color, 4);
+
+      /* Clear out bottom. */
+        for (y = 0; y < region[1]; y++) {
+            for (x = 0; x < width; x++) {
+                memcpy(color_buffer + 4*(y*width + x), background_color,
+                       sizeof(background_color));
+            }
+        }
+      /* Clear out left and right. */
+        if ((region[0] > 0) || (region[0]+region[2] < width)) {
+            for (y = region[1]; y < region[1]+region[3]; y++) {
+                for (x = 0; x < region[0]; x++) {
+                    memcpy(color_buffer + 4*(y*width + x), background_color,
+                           sizeof(background_color));
+                }
+                for (x = region[0]+region[2]; x < width; x++) {
+                    memcpy(color_buffer + 4*(y*width + x), background_color,
+                           sizeof(background_color));
+                }
+            }
+        }
+      /* Clear out top. */
+        for (y = region[1]+region[3]; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                memcpy(color_buffer + 4*(y*width + x), background_color,
+                       sizeof(background_color));
+            }
+        }
+    } else if (color_format != ICET_IMAGE_COLOR_NONE) {
+        icetRaiseError("Invalid color format.", ICET_SANITY_CHECK_FAIL);
+    }
+
+    if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+        IceTFloat *depth_buffer = icetImageGetDepthf(image);
+
+      /* Clear out bottom. */
+        for (y = 0; y < region[1]; y++) {
+            for (x = 0; x < width; x++) {
+                depth_buffer[y*width + x] = 1.0f;
+            }
+        }
+      /* Clear out left and right. */
+        if ((region[0] > 0) || (region[0]+region[2] < width)) {
+            for (y = region[1]; y < region[1]+region[3]; y++) {
+                for (x = 0; x < region[0]; x++) {
+                    depth_buffer[y*width + x] = 1.0f;
+                }
+                for (x = region[0]+region[2]; x < width; x++) {
+                    depth_buffer[y*width + x] = 1.0f;
+                }
+            }
+        }
+      /* Clear out top. */
+        for (y = region[1]+region[3]; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                depth_buffer[y*width + x] = 1.0f;
+            }
+        }
+    } else if (depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+        IceTUShort *depth_buffer = icetImageGetDepthus(image);
+
+      /* Clear out bottom. */
+        for (y = 0; y < region[1]; y++) {
+            for (x = 0; x < width; x++) {
+                depth_buffer[y*width + x] = ICET_UNORM16_FAR_DEPTH;
+            }
+        }
+      /* Clear out left and right. */
+        if ((region[0] > 0) || (region[0]+region[2] < width)) {
+            for (y = region[1]; y < region[1]+region[3]; y++) {
+                for (x = 0; x < region[0]; x++) {
+                    depth_buffer[y*width + x] = ICET_UNORM16_FAR_DEPTH;
+                }
+                for (x = region[0]+region[2]; x < width; x++) {
+                    depth_buffer[y*width + x] = ICET_UNORM16_FAR_DEPTH;
+                }
+            }
+        }
+      /* Clear out top. */
+        for (y = region[1]+region[3]; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                depth_buffer[y*width + x] = ICET_UNORM16_FAR_DEPTH;
+            }
+        }
+    } else if (depth_format != ICET_IMAGE_DEPTH_NONE) {
+        icetRaiseError("Invalid depth format.", ICET_SANITY_CHECK_FAIL);
+    }
+}
+
+void icetImagePackageForSend(IceTImage image,
+                             IceTVoid **buffer, IceTSizeType *size)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+
+    *buffer = image.opaque_internals;
+    *size = ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+
+    if (*size != icetImageBufferSizeType(icetImageGetColorFormat(image),
+                                         icetImageGetDepthFormat(image),
+                                         icetImageGetWidth(image),
+                                         icetImageGetHeight(image))) {
+        icetRaiseError("Inconsistent buffer size detected.",
+                       ICET_SANITY_CHECK_FAIL);
+    }
+}
+
+IceTImage icetImageUnpackageFromReceive(IceTVoid *buffer)
+{
+    IceTImage image;
+    IceTEnum color_format, depth_format;
+
+    image.opaque_internals = buffer;
+
+  /* Check the image for validity. */
+    if (    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAGIC_NUM_INDEX]
+         != ICET_IMAGE_MAGIC_NUM ) {
+        icetRaiseError("Invalid image buffer: no magic number.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    color_format = icetImageGetColorFormat(image);
+    if (    (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+         && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+         && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+         && (color_format != ICET_IMAGE_COLOR_NONE) ) {
+        icetRaiseError("Invalid image buffer: invalid color format.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    depth_format = icetImageGetDepthFormat(image);
+    if (    (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+         && (depth_format != ICET_IMAGE_DEPTH_UNORM16)
+         && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+        icetRaiseError("Invalid image buffer: invalid depth format.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    if (    icetImageBufferSizeType(color_format, depth_format,
+                                    icetImageGetWidth(image),
+                                    icetImageGetHeight(image))
+         != ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] ) {
+        icetRaiseError("Inconsistent sizes in image data.", ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+  /* The source may have used a bigger buffer than allocated here at the
+     receiver.  Record only size that holds current image. */
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
+        = (IceTInt)icetImageGetNumPixels(image);
+
+  /* The image is valid (as far as we can tell). */
+    return image;
+}
+
+void icetSparseImagePackageForSend(IceTSparseImage image,
+                                   IceTVoid **buffer, IceTSizeType *size)
+{
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+
+    if (icetSparseImageIsNull(image)) {
+        /* Should we return a Null pointer and 0 size without error?
+           Would all versions of MPI accept that? */
+        icetRaiseError("Cannot package NULL image for send.",
+                       ICET_INVALID_VALUE);
+        *buffer = NULL;
+        *size = 0;
+        return;
+    }
+
+    if (icetIsEnabled(ICET_MESSAGE_CODEC)) {
+        *buffer = icetSparseImageEncode(image, size);
+        if (*buffer != NULL) { return; }
+    }
+
+    *buffer = image.opaque_internals;
+    *size = ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+}
+
+static IceTVoid *icetSparseImageEncode(const IceTSparseImage image,
+                                       IceTSizeType *package_size)
+{
+    IceTSizeType header_size = ICET_IMAGE_DATA_START_INDEX*sizeof(IceTUInt);
+    IceTSizeType actual_size;
+    IceTSizeType data_size;
+    IceTSizeType package_offset;
+    IceTSizeType max_encoded_size;
+    IceTSizeType encoded_size;
+    IceTInt threshold;
+    IceTByte *package;
+
+    actual_size = ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+    data_size = actual_size - header_size;
+    icetGetIntegerv(ICET_MESSAGE_CODEC_THRESHOLD, &threshold);
+    if (data_size < threshold) { return NULL; }
+
+  /* The package goes in the space left after the image data.  Only use the
+     encoding if it fits there and makes the message smaller. */
+    package_offset = actual_size + (IceTSizeType)sizeof(IceTInt) - 1;
+    package_offset -= package_offset%(IceTSizeType)sizeof(IceTInt);
+    max_encoded_size
+        = (  icetSparseImageSeekIndexOffset(
+                 icetSparseImageGetColorFormat(image),
+                 icetSparseImageGetDepthFormat(image),
+                 ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX])
+           - package_offset - header_size - (IceTSizeType)sizeof(IceTInt) );
+    if (max_encoded_size > data_size - (IceTSizeType)sizeof(IceTInt) - 1) {
+        max_encoded_size = data_size - (IceTSizeType)sizeof(IceTInt) - 1;
+    }
+    if (max_encoded_size <= 0) { return NULL; }
+
+    icetTimingCodecBegin();
+
+    package = (IceTByte *)ICET_IMAGE_HEADER(image) + package_offset;
+    encoded_size = icetCodecEncode(ICET_IMAGE_DATA(image),
+                                   data_size,
+                                   package + header_size + sizeof(IceTInt),
+                                   max_encoded_size);
+    if (encoded_size > 0) {
+        IceTInt *package_header = (IceTInt *)package;
+        *package_size
+            = header_size + (IceTSizeType)sizeof(IceTInt) + encoded_size;
+        memcpy(package_header, ICET_IMAGE_HEADER(image), header_size);
+        package_header[ICET_IMAGE_FLAGS_INDEX] |= ICET_SPARSE_IMAGE_ENCODED;
+        package_header[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+            = (IceTInt)*package_size;
+        ((IceTInt *)(package + header_size))[0] = (IceTInt)data_size;
+    } else {
+        package = NULL;
+    }
+
+    icetTimingCodecEnd();
+
+    return package;
+}
+
+static IceTBoolean icetSparseImageDecode(IceTSparseImage image)
+{
+    IceTSizeType header_size = ICET_IMAGE_DATA_START_INDEX*sizeof(IceTUInt);
+    IceTSizeType encoded_size;
+    IceTSizeType data_size;
+    IceTByte *data;
+    IceTVoid *encoded;
+    IceTBoolean success;
+
+    encoded_size
+        = (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+           - header_size - (IceTSizeType)sizeof(IceTInt) );
+    if (encoded_size < 0) { return ICET_FALSE; }
+
+    data = ICET_IMAGE_DATA(image);
+    data_size = ((IceTInt *)data)[0];
+    if (   (data_size < 0)
+        || (  icetSparseImageBufferSizeType(
+                                      icetSparseImageGetColorFormat(image),
+                                      icetSparseImageGetDepthFormat(image),
+                                      icetSparseImageGetWidth(image),
+                                      icetSparseImageGetHeight(image))
+            < header_size + data_size) ) {
+        return ICET_FALSE;
+    }
+
+    icetTimingCodecBegin();
+
+  /* The decoded data is written over the encoded data, so move the encoded
+     data out of the way first. */
+    encoded = icetGetStateBuffer(ICET_MESSAGE_CODEC_BUF, encoded_size);
+    memcpy(encoded, data + sizeof(IceTInt), encoded_size);
+    success = (   icetCodecDecode(encoded, encoded_size, data, data_size)
+               == data_size );
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]
+        &= ~ICET_SPARSE_IMAGE_ENCODED;
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX]
+        = (IceTInt)(header_size + data_size);
+
+    icetTimingCodecEnd();
+
+    return success;
+}
+
+IceTSparseImage icetSparseImageUnpackageFromReceive(IceTVoid *buffer)
+{
+    IceTSparseImage image;
+    IceTEnum color_format, depth_format;
+
+    image.opaque_internals = buffer;
+
+  /* Check the image for validity. */
+    if (    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAGIC_NUM_INDEX]
+         != ICET_SPARSE_IMAGE_MAGIC_NUM ) {
+        icetRaiseError("Invalid image buffer: no magic number.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    color_format = icetSparseImageGetColorFormat(image);
+    if (    (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+         && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+         && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+         && (color_format != ICET_IMAGE_COLOR_NONE)
+         && !icetValidFragmentFormat(color_format) ) {
+        icetRaiseError("Invalid image buffer: invalid color format.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    depth_format = icetSparseImageGetDepthFormat(image);
+    if (    (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+         && (depth_format != ICET_IMAGE_DEPTH_UNORM16)
+         && (depth_format != ICET_IMAGE_DEPTH_NONE) ) {
+        icetRaiseError("Invalid image buffer: invalid depth format.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    if (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]
+        & ~ICET_SPARSE_IMAGE_VALID_FLAGS ) {
+        icetRaiseError("Invalid image buffer: invalid flags.",
+                       ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    if (   icetSparseImageBufferSizeType(color_format, depth_format,
+                                         icetSparseImageGetWidth(image),
+                                         icetSparseImageGetHeight(image))
+         < ICET_IMAGE_HEADER(image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX] ) {
+        icetRaiseError("Inconsistent sizes in image data.", ICET_INVALID_VALUE);
+        image.opaque_internals = NULL;
+        return image;
+    }
+
+    if (  ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]
+        & ICET_SPARSE_IMAGE_ENCODED ) {
+        if (!icetSparseImageDecode(image)) {
+            icetRaiseError("Invalid image buffer: corrupt encoded data.",
+                           ICET_INVALID_VALUE);
+            image.opaque_internals = NULL;
+            return image;
+        }
+    }
+
+  /* The source may have used a bigger buffer than allocated here at the
+     receiver.  Record only size that holds current image.  There may not be
+     room for a seek index after it. */
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
+        = (IceTInt)icetSparseImageGetNumPixels(image);
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]
+        &= ~ICET_SPARSE_IMAGE_SEEK_INDEX;
+
+  /* The image is valid (as far as we can tell). */
+    return image;
+}
+
+IceTBoolean icetSparseImageEqual(const IceTSparseImage image1,
+                                 const IceTSparseImage image2)
+{
+    return image1.opaque_internals == image2.opaque_internals;
+}
+
+static void icetSparseImageScanPixels(const IceTVoid **in_data_p,
+                                      IceTSizeType *inactive_before_p,
+                                      IceTSizeType *active_till_next_runl_p,
+                                      IceTVoid **last_in_run_length_p,
+                                      IceTSizeType pixels_to_skip,
+                                      IceTSizeType color_size,
+                                      IceTSizeType depth_size,
+                                      IceTBoolean in_compact,
+                                      IceTBoolean in_planar,
+                                      IceTVoid **out_data_p,
+                                      IceTVoid **out_run_length_p,
+                                      IceTBoolean out_compact,
+                                      IceTBoolean out_planar,
+                                      IceTSeekIndexBuilder *out_index)
+{
+    const IceTByte *in_data = *in_data_p; /* IceTByte for byte-pointer arithmetic. */
+    IceTSizeType inactive_before = *inactive_before_p;
+    IceTSizeType active_till_next_runl = *active_till_next_runl_p;
+    IceTSizeType pixels_left = pixels_to_skip;
+    IceTSizeType pixel_size = color_size + depth_size;
+    const IceTVoid *last_in_run_length = NULL;
+    IceTSizeType in_run_length_size = RUN_LENGTH_SIZE_OF(in_compact);
+    IceTSizeType out_run_length_size = RUN_LENGTH_SIZE_OF(out_compact);
+    IceTSizeType out_max_run_length = MAX_RUN_LENGTH_OF(out_compact);
+    IceTSizeType out_max_active_run_length
+        = MAX_ACTIVE_RUN_LENGTH_OF(out_compact, out_planar);
+    IceTByte *out_data;
+    IceTVoid *last_out_run_length;
+
+    if (pixels_left < 1) { return; }    /* Nothing to do. */
+
+#define ADVANCE_OUT_RUN_LENGTH()                                        \
+    {                                                                   \
+        last_out_run_length = out_data;                                 \
+        out_data += out_run_length_size;                                \
+        SET_INACTIVE_RUN_LENGTH(last_out_run_length, out_compact, 0);   \
+        SET_ACTIVE_RUN_LENGTH(last_out_run_length, out_compact, 0);     \
+    }
+
+/* Starts a new output run at the current output pixel. */
+#define START_OUT_RUN(out_pixel)                                        \
+    {                                                                   \
+        ADVANCE_OUT_RUN_LENGTH();                                       \
+        if (out_index != NULL) {                                        \
+            SEEK_INDEX_ADD_RUN(out_index, last_out_run_length, out_pixel);\
+        }                                                               \
+    }
+
+    if (out_data_p != NULL) {
+        out_data = *out_data_p;
+        if (out_run_length_p != NULL) {
+            last_out_run_length = *out_run_length_p;
+        } else /* out_run_length_p == NULL */ {
+            START_OUT_RUN(out_index ? out_index->position : 0);
+        }
+    } else /* out_data_p == NULL */ {
+        out_data = NULL;
+        last_out_run_length = NULL;
+        out_index = NULL;
+    }
+
+    while (pixels_left > 0) {
+        IceTSizeType count;
+        if ((inactive_before == 0) && (active_till_next_runl == 0)) {
+            last_in_run_length = in_data;
+            inactive_before = GET_INACTIVE_RUN_LENGTH(in_data, in_compact);
+            active_till_next_runl = GET_ACTIVE_RUN_LENGTH(in_data, in_compact);
+            if (!in_planar) {
+                in_data += in_run_length_size;
+            }
+        }
+
+        count = MIN(inactive_before, pixels_left);
+        if (count > 0) {
+            if (out_data != NULL) {
+                IceTSizeType out_inactive;
+                if (GET_ACTIVE_RUN_LENGTH(last_out_run_length, out_compact)
+                    > 0) {
+                    START_OUT_RUN(out_index ? out_index->position : 0);
+                }
+                out_inactive
+                    = (  GET_INACTIVE_RUN_LENGTH(last_out_run_length,
+                                                 out_compact)
+                       + count );
+                while (out_inactive > out_max_run_length) {
+                    SET_INACTIVE_RUN_LENGTH(last_out_run_length,
+                                            out_compact,
+                                            out_max_run_length);
+                    out_inactive -= out_max_run_length;
+                    ADVANCE_OUT_RUN_LENGTH();
+                }
+                SET_INACTIVE_RUN_LENGTH(last_out_run_length,
+                                        out_compact,
+                                        out_inactive);
+                if (out_index != NULL) { out_index->position += count; }
+            }
+            inactive_before -= count;
+            pixels_left -= count;
+        }
+
+        count = MIN(active_till_next_runl, pixels_left);
+        if (count > 0) {
+            IceTPixelSpan in_span;
+            if (in_planar) {
+                IceTSizeType in_active
+                    = GET_ACTIVE_RUN_LENGTH(in_data, in_compact);
+                IceTSizeType in_position = in_active - active_till_next_runl;
+                in_span.color = (  (IceTByte *)in_data + in_run_length_size
+                                 + in_position*color_size );
+                in_span.depth = (  (IceTByte *)in_data + in_run_length_size
+                                 + in_active*color_size
+                                 + in_position*depth_size );
+                in_span.color_stride = color_size;
+                in_span.depth_stride = depth_size;
+            } else {
+                in_span.color = (IceTByte *)in_data;
+                in_span.depth = (IceTByte *)in_data + color_size;
+                in_span.color_stride = in_span.depth_stride = pixel_size;
+            }
+            if (out_data != NULL) {
+              /* Fill the current output run and start new ones (with no
+                 inactive pixels) if it gets too long. */
+                IceTSizeType count_left = count;
+                while (count_left > 0) {
+                    IceTSizeType out_active
+                        = GET_ACTIVE_RUN_LENGTH(last_out_run_length,
+                                                out_compact);
+                    IceTSizeType run_count
+                        = MIN(count_left,
+                              out_max_active_run_length - out_active);
+                    if (run_count < 1) {
+                        START_OUT_RUN(  (out_index ? out_index->position : 0)
+                                      + (count - count_left) );
+                        continue;
+                    }
+                    SET_ACTIVE_RUN_LENGTH(last_out_run_length,
+                                          out_compact,
+                                          out_active + run_count);
+                    if (!in_planar && !out_planar) {
+                        memcpy(out_data, in_span.color, run_count*pixel_size);
+                    } else {
+                        IceTPixelSpan out_span;
+                        if (out_planar) {
+                          /* Move the depths already in the run to make room
+                             for the new colors. */
+                            IceTByte *run_start
+                                = out_data - out_active*pixel_size;
+                            out_span.color = run_start + out_active*color_size;
+                            out_span.depth = (  run_start
+                                              + (out_active + run_count)
+                                                *color_size
+                                              + out_active*depth_size );
+                            memmove(out_span.depth - out_active*depth_size,
+                                    out_span.color,
+                                    out_active*depth_size);
+                            out_span.color_stride = color_size;
+                            out_span.depth_stride = depth_size;
+                        } else {
+                            out_span.color = out_data;
+                            out_span.depth = out_data + color_size;
+                            out_span.color_stride = pixel_size;
+                            out_span.depth_stride = pixel_size;
+                        }
+                        icetCopyPixelSpan(&in_span, &out_span,
+                                          color_size, depth_size,
+                                          run_count);
+                    }
+                    out_data += run_count*pixel_size;
+                    in_span.color += run_count*in_span.color_stride;
+                    in_span.depth += run_count*in_span.depth_stride;
+                    count_left -= run_count;
+                }
+                if (out_index != NULL) { out_index->position += count; }
+            }
+            if (!in_planar) {
+                in_data += count*pixel_size;
+            }
+            active_till_next_runl -= count;
+            pixels_left -= count;
+        }
+
+        if (   in_planar
+            && (inactive_before == 0)
+            && (active_till_next_runl == 0) ) {
+            /* Done with this run, so move past its pixels. */
+            in_data += (  in_run_length_size
+                        + GET_ACTIVE_RUN_LENGTH(in_data, in_compact)
+                          *pixel_size );
+        }
+    }
+    if (pixels_left < 0) {
+        icetRaiseError("Miscounted pixels", ICET_SANITY_CHECK_FAIL);
+    }
+
+    *in_data_p = in_data;
+    *inactive_before_p = inactive_before;
+    *active_till_next_runl_p = active_till_next_runl;
+    if (last_in_run_length_p) {
+        *last_in_run_length_p = (IceTVoid *)last_in_run_length;
+    }
+    if (out_data_p) {
+        *out_data_p = out_data;
+    }
+    if (out_run_length_p) {
+        *out_run_length_p = last_out_run_length;
+    }
+
+#undef ADVANCE_OUT_RUN_LENGTH
+#undef START_OUT_RUN
+}
+
+static void icetSparseImageSeek(const IceTSparseImage image,
+                                IceTSizeType current_pixel,
+                                IceTSizeType target_pixel,
+                                const IceTVoid **in_data_p,
+                                IceTSizeType *inactive_before_p,
+                                IceTSizeType *active_till_next_runl_p,
+                                IceTVoid **last_in_run_length_p,
+                                IceTSizeType color_size,
+                                IceTSizeType depth_size)
+{
+    const IceTInt *index = icetSparseImageGetSeekIndex(image);
+
+    if (last_in_run_length_p != NULL) { *last_in_run_length_p = NULL; }
+
+    if (index != NULL) {
+        IceTInt entry = icetSeekIndexFind(index, target_pixel) - 1;
+        if ((entry >= 0) && (index[1 + 2*entry] > current_pixel)) {
+            /* Jump to the start of the run in the index entry. */
+            current_pixel = index[1 + 2*entry];
+            *in_data_p = (  (const IceTByte *)ICET_IMAGE_DATA(image)
+                          + index[2 + 2*entry] );
+            *inactive_before_p = 0;
+            *active_till_next_runl_p = 0;
+        }
+    }
+
+    icetSparseImageScanPixels(in_data_p,
+                              inactive_before_p,
+                              active_till_next_runl_p,
+                              last_in_run_length_p,
+                              target_pixel - current_pixel,
+                              color_size,
+                              depth_size,
+                              ICET_SPARSE_IMAGE_COMPACT(image),
+                              ICET_SPARSE_IMAGE_PLANAR(image),
+                              NULL,
+                              NULL,
+                              ICET_SPARSE_IMAGE_COMPACT(image),
+                              ICET_SPARSE_IMAGE_PLANAR(image),
+                              NULL);
+}
+
+static void icetSparseImageCopyPixelsInternal(
+                                          const IceTVoid **in_data_p,
+                                          IceTSizeType *inactive_before_p,
+                                          IceTSizeType *active_till_next_runl_p,
+                                          IceTSizeType pixels_to_copy,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size,
+                                          IceTBoolean in_compact,
+                                          IceTBoolean in_planar,
+                                          IceTSparseImage out_image)
+{
+    IceTVoid *out_data = ICET_IMAGE_DATA(out_image);
+    IceTSeekIndexBuilder out_index;
+
+    icetSparseImageSetDimensions(out_image, pixels_to_copy, 1);
+    icetSeekIndexBegin(out_image, &out_index);
+
+    icetSparseImageScanPixels(in_data_p,
+                              inactive_before_p,
+                              active_till_next_runl_p,
+                              NULL,
+                              pixels_to_copy,
+                              color_size,
+                              depth_size,
+                              in_compact,
+                              in_planar,
+                              &out_data,
+                              NULL,
+                              ICET_SPARSE_IMAGE_COMPACT(out_image),
+                              ICET_SPARSE_IMAGE_PLANAR(out_image),
+                              &out_index);
+
+    icetSparseImageSetActualSize(out_image, out_data);
+    icetSeekIndexEnd(&out_index);
+}
+
+static void icetSparseImageCopyPixelsInPlaceInternal(
+                                          const IceTVoid **in_data_p,
+                                          IceTSizeType *inactive_before_p,
+                                          IceTSizeType *active_till_next_runl_p,
+                                          IceTVoid **last_run_length_p,
+                                          IceTSizeType pixels_to_copy,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size,
+                                          IceTSparseImage out_image)
+{
+#ifdef DEBUG
+    if (   (*in_data_p != ICET_IMAGE_DATA(out_image))
+        || (*inactive_before_p != 0)
+        || (*active_till_next_runl_p != 0) ) {
+        icetRaiseError("icetSparseImageCopyPixelsInPlaceInternal not called"
+                       " at beginning of buffer.",
+                       ICET_SANITY_CHECK_FAIL);
+    }
+#endif
+
+    icetSparseImageSeek(out_image,
+                        0,
+                        pixels_to_copy,
+                        in_data_p,
+                        inactive_before_p,
+                        active_till_next_runl_p,
+                        last_run_length_p,
+                        color_size,
+                        depth_size);
+
+    ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_WIDTH_INDEX]
+        = (IceTInt)pixels_to_copy;
+    ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_HEIGHT_INDEX] = (IceTInt)1;
+}
+
+static void icetSparseImageEndInPlaceCopy(IceTSparseImage image,
+                                          IceTVoid *last_run_length,
+                                          IceTSizeType inactive_left,
+                                          IceTSizeType active_left,
+                                          const IceTVoid *data_end,
+                                          IceTSizeType color_size,
+                                          IceTSizeType depth_size)
+{
+    IceTBoolean compact = ICET_SPARSE_IMAGE_COMPACT(image);
+
+    if (last_run_length != NULL) {
+        IceTSizeType active
+            = GET_ACTIVE_RUN_LENGTH(last_run_length, compact) - active_left;
+        if (   ICET_SPARSE_IMAGE_PLANAR(image)
+            && ((inactive_left > 0) || (active_left > 0)) ) {
+          /* The data pointer was left on the last run length.  Keep the
+             first active pixels and move their depths after their colors. */
+            IceTByte *run_data
+                = (IceTByte *)last_run_length + RUN_LENGTH_SIZE_OF(compact);
+            IceTSizeType total_active
+                = GET_ACTIVE_RUN_LENGTH(last_run_length, compact);
+            memmove(run_data + active*color_size,
+                    run_data + total_active*color_size,
+                    active*depth_size);
+            data_end = run_data + active*(color_size + depth_size);
+        }
+        SET_INACTIVE_RUN_LENGTH(
+                   last_run_length,
+                   compact,
+                     GET_INACTIVE_RUN_LENGTH(last_run_length, compact)
+                   - inactive_left);
+        SET_ACTIVE_RUN_LENGTH(last_run_length, compact, active);
+    }
+
+    icetSparseImageSetActualSize(image, data_end);
+
+    /* Drop the index entries for runs past the end of the image. */
+    {
+        IceTInt *index = icetSparseImageGetSeekIndex(image);
+        if (index != NULL) {
+            index[0] = icetSeekIndexFind(
+                             index, icetSparseImageGetNumPixels(image) - 1);
+        }
+    }
+}
+
+void icetSparseImageCopyPixels(const IceTSparseImage in_image,
+                               IceTSizeType in_offset,
+                               IceTSizeType num_pixels,
+                               IceTSparseImage out_image)
+{
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+
+    const IceTVoid *in_data;
+    IceTBoolean in_compact;
+    IceTBoolean in_planar;
+    IceTSizeType start_inactive;
+    IceTSizeType start_active;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(in_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    icetTimingCompressBegin();
+
+    color_format = icetSparseImageGetColorFormat(in_image);
+    depth_format = icetSparseImageGetDepthFormat(in_image);
+    if (   (color_format != icetSparseImageGetColorFormat(out_image))
+        || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
+        icetRaiseError("Cannot copy pixels of images with different formats.",
+                       ICET_INVALID_VALUE);
+        icetTimingCompressEnd();
+        return;
+    }
+
+    if (   (in_offset == 0)
+        && (num_pixels == icetSparseImageGetNumPixels(in_image)) ) {
+        /* Special case, copying image in its entirety.  Using the standard
+         * method will work, but doing a raw data copy can be faster. */
+        IceTSizeType bytes_to_copy
+            = ICET_IMAGE_HEADER(in_image)[ICET_IMAGE_ACTUAL_BUFFER_SIZE_INDEX];
+        IceTSizeType max_pixels
+            = ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX];
+        IceTInt out_has_index
+            = (  ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_FLAGS_INDEX]
+               & ICET_SPARSE_IMAGE_SEEK_INDEX );
+        const IceTInt *in_index;
+        IceTInt *out_index;
+
+        ICET_TEST_SPARSE_IMAGE_HEADER(out_image);
+
+        if (max_pixels < num_pixels) {
+            icetRaiseError("Cannot set an image size to greater than what the"
+                           " image was originally created.",
+                           ICET_INVALID_VALUE);
+            icetTimingCompressEnd();
+            return;
+        }
+
+        memcpy(ICET_IMAGE_HEADER(out_image),
+               ICET_IMAGE_HEADER(in_image),
+               bytes_to_copy);
+
+        ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX]
+            = max_pixels;
+
+        /* The seek index is kept with the buffer rather than the data. */
+        ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_FLAGS_INDEX]
+            = (  (  ICET_IMAGE_HEADER(out_image)[ICET_IMAGE_FLAGS_INDEX]
+                  & ~ICET_SPARSE_IMAGE_SEEK_INDEX)
+               | out_has_index );
+        in_index = icetSparseImageGetSeekIndex(in_image);
+        out_index = icetSparseImageGetSeekIndex(out_image);
+        if (out_index != NULL) {
+            if (in_index != NULL) {
+                memcpy(out_index, in_index,
+                       (1 + 2*in_index[0])*sizeof(IceTInt));
+            } else {
+                out_index[0] = 0;
+            }
+        }
+
+        icetTimingCompressEnd();
+        return;
+    }
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+
+    in_compact = ICET_SPARSE_IMAGE_COMPACT(in_image);
+    in_planar = ICET_SPARSE_IMAGE_PLANAR(in_image);
+    in_data = ICET_IMAGE_DATA(in_image);
+    start_inactive = start_active = 0;
+    icetSparseImageSeek(in_image,
+                        0,
+                        in_offset,
+                        &in_data,
+                        &start_inactive,
+                        &start_active,
+                        NULL,
+                        color_size,
+                        depth_size);
+
+    icetSparseImageCopyPixelsInternal(&in_data,
+                                      &start_inactive,
+                                      &start_active,
+                                      num_pixels,
+                                      color_size,
+                                      depth_size,
+                                      in_compact,
+                                      in_planar,
+                                      out_image);
+
+    icetTimingCompressEnd();
+}
+
+void icetSparseImageAppend(IceTSparseImage image, const IceTSparseImage tail)
+{
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTSizeType num_pixels;
+    IceTSizeType tail_num_pixels;
+    IceTBoolean compact;
+    IceTBoolean planar;
+    IceTCompressBandJoin join;
+    IceTSeekIndexBuilder out_index;
+    const IceTVoid *in_data;
+    IceTSizeType inactive_before;
+    IceTSizeType active_till_next_runl;
+    IceTVoid *out_data;
+    IceTVoid *last_run_length;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(image) || ICET_SPARSE_IMAGE_BLOCKS(tail)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    color_format = icetSparseImageGetColorFormat(image);
+    depth_format = icetSparseImageGetDepthFormat(image);
+    if (   (color_format != icetSparseImageGetColorFormat(tail))
+        || (depth_format != icetSparseImageGetDepthFormat(tail)) ) {
+        icetRaiseError("Cannot append images with different formats.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    num_pixels = icetSparseImageGetNumPixels(image);
+    tail_num_pixels = icetSparseImageGetNumPixels(tail);
+    if (   num_pixels + tail_num_pixels
+        > ICET_IMAGE_HEADER(image)[ICET_IMAGE_MAX_NUM_PIXELS_INDEX] ) {
+        icetRaiseError("Cannot set an image size to greater than what the"
+                       " image was originally created.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+    if (tail_num_pixels < 1) return;
+    if (num_pixels < 1) {
+        icetSparseImageCopyPixels(tail, 0, tail_num_pixels, image);
+        return;
+    }
+
+    icetTimingCompressBegin();
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+    compact = ICET_SPARSE_IMAGE_COMPACT(image);
+    planar = ICET_SPARSE_IMAGE_PLANAR(image);
+
+    /* Find the last run of the image, which the leading pixels of the tail
+       may be merged into.  The seek index skips most of the image. */
+    in_data = ICET_IMAGE_DATA(image);
+    inactive_before = active_till_next_runl = 0;
+    icetSparseImageSeek(image,
+                        0,
+                        num_pixels,
+                        &in_data,
+                        &inactive_before,
+                        &active_till_next_runl,
+                        &last_run_length,
+                        color_size,
+                        depth_size);
+    if (last_run_length == NULL) {
+        /* The index pointed at the very end.  Scan the whole image. */
+        in_data = ICET_IMAGE_DATA(image);
+        inactive_before = active_till_next_runl = 0;
+        icetSparseImageScanPixels(&in_data,
+                                  &inactive_before,
+                                  &active_till_next_runl,
+                                  &last_run_length,
+                                  num_pixels,
+                                  color_size,
+                                  depth_size,
+                                  compact,
+                                  planar,
+                                  NULL,
+                                  NULL,
+                                  compact,
+                                  planar,
+                                  NULL);
+    }
+    out_data = (  (IceTByte *)ICET_IMAGE_HEADER(image)
+                + icetSparseImageGetCompressedBufferSize(image) );
+
+    icetSeekIndexReopen(image, &out_index);
+    if (   (ICET_SPARSE_IMAGE_COMPACT(tail) != compact)
+        || (ICET_SPARSE_IMAGE_PLANAR(tail) != planar) ) {
+        /* The data of the tail cannot be copied as is, so convert all of it
+           as it is scanned. */
+        in_data = ICET_IMAGE_DATA(tail);
+        inactive_before = active_till_next_runl = 0;
+        icetSparseImageScanPixels(&in_data,
+                                  &inactive_before,
+                                  &active_till_next_runl,
+                                  NULL,
+                                  tail_num_pixels,
+                                  color_size,
+                                  depth_size,
+                                  ICET_SPARSE_IMAGE_COMPACT(tail),
+                                  ICET_SPARSE_IMAGE_PLANAR(tail),
+                                  &out_data,
+                                  &last_run_length,
+                                  compact,
+                                  planar,
+                                  NULL);
+    } else {
+        icetSparseImageBandJoin(tail, color_size + depth_size, &join);
+        icetSparseImageJoinBand(tail,
+                                &join,
+                                num_pixels,
+                                color_size,
+                                depth_size,
+                                compact,
+                                planar,
+                                &out_data,
+                                &last_run_length,
+                                &out_index);
+    }
+
+    icetSparseImageSetActualSize(image, out_data);
+    icetSeekIndexEnd(&out_index);
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_WIDTH_INDEX]
+        = (IceTInt)(num_pixels + tail_num_pixels);
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_HEIGHT_INDEX] = 1;
+
+    icetTimingCompressEnd();
+}
+
+IceTSizeType icetSparseImageSplitPartitionNumPixels(
+                                                IceTSizeType input_num_pixels,
+                                                IceTInt num_partitions,
+                                                IceTInt eventual_num_partitions)
+{
+    IceTInt sub_partitions = eventual_num_partitions/num_partitions;
+
+#ifdef DEBUG
+    if (eventual_num_partitions%num_partitions != 0) {
+        icetRaiseError("num_partitions not a factor"
+                       " of eventual_num_partitions.",
+                       ICET_INVALID_VALUE);
+    }
+#endif
+
+    return input_num_pixels/num_partitions + sub_partitions;
+}
+
+static void icetSparseImageSplitChoosePartitions(
+                                                IceTInt num_partitions,
+                                                IceTInt eventual_num_partitions,
+                                                IceTSizeType size,
+                                                IceTSizeType first_offset,
+                                                IceTSizeType *offsets)
+{
+    IceTSizeType remainder = size%eventual_num_partitions;
+    IceTInt sub_partitions = eventual_num_partitions/num_partitions;
+    IceTSizeType partition_lower_size
+        = (size/eventual_num_partitions)*sub_partitions;
+    IceTSizeType this_offset = first_offset;
+    IceTInt partition_idx;
+
+#ifdef DEBUG
+    if (eventual_num_partitions%num_partitions != 0) {
+        icetRaiseError("num_partitions not a factor"
+                       " of eventual_num_partitions.",
+                       ICET_INVALID_VALUE);
+    }
+#endif
+
+    for (partition_idx = 0; partition_idx < num_partitions; partition_idx++) {
+        offsets[partition_idx] = this_offset;
+        this_offset += partition_lower_size;
+        if (remainder > sub_partitions) {
+            this_offset += sub_partitions;
+            remainder -= sub_partitions;
+        } else {
+            this_offset += remainder;
+            remainder = 0;
+        }
+    }
+}
+
+void icetSparseImageSplit(const IceTSparseImage in_image,
+                          IceTSizeType in_image_offset,
+                          IceTInt num_partitions,
+                          IceTInt eventual_num_partitions,
+                          IceTSparseImage *out_images,
+                          IceTSizeType *offsets)
+{
+    IceTSizeType total_num_pixels;
+
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+
+    const IceTVoid *in_data;
+    IceTBoolean in_compact;
+    IceTBoolean in_planar;
+    IceTSizeType start_inactive;
+    IceTSizeType start_active;
+
+    IceTBoolean in_place = ICET_FALSE;
+    IceTVoid *in_place_last_run_length = NULL;
+    IceTSizeType in_place_inactive_left = 0;
+    IceTSizeType in_place_active_left = 0;
+    const IceTVoid *in_place_data_end = NULL;
+
+    IceTInt partition;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(in_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    icetTimingCompressBegin();
+
+    if (num_partitions < 2) {
+        icetRaiseError("It does not make sense to call icetSparseImageSplit"
+                       " with less than 2 partitions.",
+                       ICET_INVALID_VALUE);
+        icetTimingCompressEnd();
+        return;
+    }
+
+    total_num_pixels = icetSparseImageGetNumPixels(in_image);
+
+    color_format = icetSparseImageGetColorFormat(in_image);
+    depth_format = icetSparseImageGetDepthFormat(in_image);
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+
+    in_compact = ICET_SPARSE_IMAGE_COMPACT(in_image);
+    in_planar = ICET_SPARSE_IMAGE_PLANAR(in_image);
+    in_data = ICET_IMAGE_DATA(in_image);
+    start_inactive = start_active = 0;
+
+    icetSparseImageSplitChoosePartitions(num_partitions,
+                                         eventual_num_partitions,
+                                         total_num_pixels,
+                                         in_image_offset,
+                                         offsets);
+
+    for (partition = 0; partition < num_partitions; partition++) {
+        IceTSparseImage out_image = out_images[partition];
+        IceTSizeType partition_num_pixels;
+
+        if (   (color_format != icetSparseImageGetColorFormat(out_image))
+            || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
+            icetRaiseError("Cannot copy pixels of images with different"
+                           " formats.",
+                           ICET_INVALID_VALUE);
+            icetTimingCompressEnd();
+            return;
+        }
+
+        if (partition < num_partitions-1) {
+            partition_num_pixels = offsets[partition+1] - offsets[partition];
+        } else {
+            partition_num_pixels
+                = total_num_pixels + in_image_offset - offsets[partition];
+        }
+
+        if (icetSparseImageEqual(in_image, out_image)) {
+            if (partition == 0) {
+                icetSparseImageCopyPixelsInPlaceInternal(
+                                                    &in_data,
+                                                    &start_inactive,
+                                                    &start_active,
+                                                    &in_place_last_run_length,
+                                                    partition_num_pixels,
+                                                    color_size,
+                                                    depth_size,
+                                                    out_image);
+                in_place = ICET_TRUE;
+                in_place_inactive_left = start_inactive;
+                in_place_active_left = start_active;
+                in_place_data_end = in_data;
+            } else {
+                icetRaiseError("icetSparseImageSplit copy in place only allowed"
+                               " in first partition.",
+                               ICET_INVALID_VALUE);
+            }
+        } else {
+            icetSparseImageCopyPixelsInternal(&in_data,
+                                              &start_inactive,
+                                              &start_active,
+                                              partition_num_pixels,
+                                              color_size,
+                                              depth_size,
+                                              in_compact,
+                                              in_planar,
+                                              out_image);
+        }
+    }
+
+    /* The image copied in place is finished only after the other partitions
+       are done reading from it. */
+    if (in_place) {
+        icetSparseImageEndInPlaceCopy(out_images[0],
+                                      in_place_last_run_length,
+                                      in_place_inactive_left,
+                                      in_place_active_left,
+                                      in_place_data_end,
+                                      color_size,
+                                      depth_size);
+    }
+
+#ifdef DEBUG
+    if (   (start_inactive != 0)
+        || (start_active != 0) ) {
+        icetRaiseError("Counting problem.", ICET_SANITY_CHECK_FAIL);
+    }
+#endif
+
+    icetTimingCompressEnd();
+}
+
+/* Returns true if a color, which need not be aligned, is opaque.  Colors
+   with an alpha of (at least) one hide everything behind them when blended,
+   so this is exact rather than a threshold. */
+static IceTBoolean icetColorPixelOpaque(IceTEnum color_format,
+                                        const IceTByte *color)
+{
+    switch (color_format) {
+      case ICET_IMAGE_COLOR_RGBA_UBYTE:
+          return (((const IceTUByte *)color)[3] == 0xFF);
+      case ICET_IMAGE_COLOR_RGBA_FLOAT:
+          {
+              IceTFloat alpha;
+              memcpy(&alpha, color + 3*sizeof(IceTFloat), sizeof(IceTFloat));
+              return (alpha >= 1.0f);
+          }
+      case ICET_IMAGE_COLOR_RGBA_HALF:
+          {
+            /* Positive halves from 1 to infinity. */
+              IceTUShort alpha;
+              memcpy(&alpha, color + 3*sizeof(IceTUShort),sizeof(IceTUShort));
+              return ((alpha >= 0x3C00) && (alpha <= 0x7C00));
+          }
+      default:
+          return ICET_FALSE;
+    }
+}
+
+#define OPACITY_MASK_BIT(mask, pixel)                                   \
+    (((mask)[(pixel)/32] >> ((pixel)%32)) & 1)
+
+void icetSparseImageOpacityMask(const IceTSparseImage image, IceTUInt *mask)
+{
+    IceTEnum color_format;
+    IceTSizeType num_pixels;
+    IceTSizeType color_size;
+    IceTSizeType pixel_size;
+    IceTSizeType color_stride;
+    IceTBoolean compact;
+    const IceTByte *data;
+    IceTSizeType pixel;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    num_pixels = icetSparseImageGetNumPixels(image);
+    memset(mask, 0, ICET_OPACITY_MASK_WORDS(num_pixels)*sizeof(IceTUInt));
+
+    color_format = icetSparseImageGetColorFormat(image);
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+      /* Without colors, nothing is opaque. */
+        return;
+    }
+
+    color_size = colorPixelSize(color_format);
+    pixel_size = color_size
+               + depthPixelSize(icetSparseImageGetDepthFormat(image));
+    color_stride = ICET_SPARSE_IMAGE_PLANAR(image) ? color_size : pixel_size;
+    compact = ICET_SPARSE_IMAGE_COMPACT(image);
+
+    data = ICET_IMAGE_DATA(image);
+    pixel = 0;
+    while (pixel < num_pixels) {
+        IceTSizeType num_active;
+        const IceTByte *color;
+        IceTSizeType i;
+
+        pixel += GET_INACTIVE_RUN_LENGTH(data, compact);
+        num_active = GET_ACTIVE_RUN_LENGTH(data, compact);
+        color = data + RUN_LENGTH_SIZE_OF(compact);
+        for (i = 0; i < num_active; i++) {
+            if (icetColorPixelOpaque(color_format, color)) {
+                mask[pixel/32] |= (IceTUInt)1 << (pixel%32);
+            }
+            color += color_stride;
+            pixel++;
+        }
+        data += RUN_LENGTH_SIZE_OF(compact) + num_active*pixel_size;
+    }
+}
+
+/* Adds num_inactive inactive pixels to the end of a sparse image being written
+   with icetSparseImageScanPixels.  If *out_run_length_p is NULL, the first run
+   is started. */
+static void icetSparseImageAppendInactive(IceTVoid **out_data_p,
+                                          IceTVoid **out_run_length_p,
+                                          IceTBoolean out_compact,
+                                          IceTSizeType num_inactive,
+                                          IceTSeekIndexBuilder *out_index)
+{
+    IceTByte *out_data = *out_data_p;
+    IceTVoid *run_length = *out_run_length_p;
+    IceTSizeType run_length_size = RUN_LENGTH_SIZE_OF(out_compact);
+    IceTSizeType max_run_length = MAX_RUN_LENGTH_OF(out_compact);
+    IceTSizeType inactive;
+
+    if (   (run_length == NULL)
+        || (GET_ACTIVE_RUN_LENGTH(run_length, out_compact) > 0) ) {
+        run_length = out_data;
+        out_data += run_length_size;
+        SET_INACTIVE_RUN_LENGTH(run_length, out_compact, 0);
+        SET_ACTIVE_RUN_LENGTH(run_length, out_compact, 0);
+        SEEK_INDEX_ADD_RUN(out_index, run_length, out_index->position);
+    }
+
+    inactive = GET_INACTIVE_RUN_LENGTH(run_length, out_compact) + num_inactive;
+    while (inactive > max_run_length) {
+        SET_INACTIVE_RUN_LENGTH(run_length, out_compact, max_run_length);
+        inactive -= max_run_length;
+        run_length = out_data;
+        out_data += run_length_size;
+        SET_INACTIVE_RUN_LENGTH(run_length, out_compact, 0);
+        SET_ACTIVE_RUN_LENGTH(run_length, out_compact, 0);
+    }
+    SET_INACTIVE_RUN_LENGTH(run_length, out_compact, inactive);
+    out_index->position += num_inactive;
+
+    *out_data_p = out_data;
+    *out_run_length_p = run_length;
+}
+
+void icetSparseImageCullOccluded(const IceTSparseImage in_image,
+                                 const IceTUInt *mask,
+                                 IceTSparseImage out_image)
+{
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTSizeType num_pixels;
+    IceTBoolean in_compact;
+    IceTBoolean in_planar;
+    IceTBoolean out_compact;
+    IceTBoolean out_planar;
+    const IceTVoid *in_data;
+    IceTSizeType inactive_before;
+    IceTSizeType active_till_next_runl;
+    IceTVoid *out_data;
+    IceTVoid *out_run_length;
+    IceTSeekIndexBuilder out_index;
+    IceTSizeType pixel;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(in_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    color_format = icetSparseImageGetColorFormat(in_image);
+    depth_format = icetSparseImageGetDepthFormat(in_image);
+    if (   (color_format != icetSparseImageGetColorFormat(out_image))
+        || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
+        icetRaiseError("Cannot copy pixels of images with different formats.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    icetTimingCompressBegin();
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+    num_pixels = icetSparseImageGetNumPixels(in_image);
+    in_compact = ICET_SPARSE_IMAGE_COMPACT(in_image);
+    in_planar = ICET_SPARSE_IMAGE_PLANAR(in_image);
+
+    icetSparseImageSetDimensions(out_image,
+                                 icetSparseImageGetWidth(in_image),
+                                 icetSparseImageGetHeight(in_image));
+    out_compact = ICET_SPARSE_IMAGE_COMPACT(out_image);
+    out_planar = ICET_SPARSE_IMAGE_PLANAR(out_image);
+
+    in_data = ICET_IMAGE_DATA(in_image);
+    inactive_before = 0;
+    active_till_next_runl = 0;
+    out_data = ICET_IMAGE_DATA(out_image);
+    out_run_length = NULL;
+    icetSeekIndexBegin(out_image, &out_index);
+    icetSparseImageAppendInactive(&out_data, &out_run_length, out_compact,
+                                  0, &out_index);
+
+  /* Alternate between stretches of pixels that are copied and stretches
+     that are skipped and left inactive. */
+    pixel = 0;
+    while (pixel < num_pixels) {
+        IceTUInt occluded = OPACITY_MASK_BIT(mask, pixel);
+        IceTSizeType count = 1;
+
+        while (pixel + count < num_pixels) {
+            IceTSizeType next = pixel + count;
+            if (   (next%32 == 0)
+                && (next + 32 <= num_pixels)
+                && (mask[next/32] == (occluded ? 0xFFFFFFFF : 0)) ) {
+                count += 32;
+            } else if (OPACITY_MASK_BIT(mask, next) == occluded) {
+                count++;
+            } else {
+                break;
+            }
+        }
+
+        if (occluded) {
+            icetSparseImageScanPixels(&in_data,
+                                      &inactive_before,
+                                      &active_till_next_runl,
+                                      NULL,
+                                      count,
+                                      color_size,
+                                      depth_size,
+                                      in_compact,
+                                      in_planar,
+                                      NULL,
+                                      NULL,
+                                      out_compact,
+                                      out_planar,
+                                      NULL);
+            icetSparseImageAppendInactive(&out_data, &out_run_length,
+                                          out_compact, count, &out_index);
+        } else {
+            icetSparseImageScanPixels(&in_data,
+                                      &inactive_before,
+                                      &active_till_next_runl,
+                                      NULL,
+                                      count,
+                                      color_size,
+                                      depth_size,
+                                      in_compact,
+                                      in_planar,
+                                      &out_data,
+                                      &out_run_length,
+                                      out_compact,
+                                      out_planar,
+                                      &out_index);
+        }
+        pixel += count;
+    }
+
+    icetSparseImageSetActualSize(out_image, out_data);
+    icetSeekIndexEnd(&out_index);
+
+    icetTimingCompressEnd();
+}
+
+#undef OPACITY_MASK_BIT
+
+void icetSparseImageInterlace(const IceTSparseImage in_image,
+                              IceTInt eventual_num_partitions,
+                              IceTEnum scratch_state_buffer,
+                              IceTSparseImage out_image)
+{
+    IceTSizeType num_pixels = icetSparseImageGetNumPixels(in_image);
+    IceTEnum color_format = icetSparseImageGetColorFormat(in_image);
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(in_image);
+    IceTSizeType lower_partition_size = num_pixels/eventual_num_partitions;
+    IceTSizeType remaining_pixels = num_pixels%eventual_num_partitions;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTBoolean in_compact = ICET_SPARSE_IMAGE_COMPACT(in_image);
+    IceTBoolean in_planar = ICET_SPARSE_IMAGE_PLANAR(in_image);
+    IceTBoolean out_compact;
+    IceTBoolean out_planar;
+    IceTInt original_partition_idx;
+    IceTInt interlaced_partition_idx;
+    const IceTVoid **in_data_array;
+    IceTSizeType *inactive_before_array;
+    IceTSizeType *active_till_next_runl_array;
+    const IceTVoid *in_data;
+    IceTVoid *out_data;
+    IceTSizeType inactive_before;
+    IceTSizeType active_till_next_runl;
+    IceTVoid *last_run_length;
+    IceTSizeType in_position;
+    IceTSeekIndexBuilder out_index;
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(in_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    /* Special case, nothing to do. */
+    if (eventual_num_partitions < 2) {
+        icetSparseImageCopyPixels(in_image, 0, num_pixels, out_image);
+        return;
+    }
+
+    if (   (color_format != icetSparseImageGetColorFormat(out_image))
+        || (depth_format != icetSparseImageGetDepthFormat(out_image)) ) {
+        icetRaiseError("Cannot copy pixels of images with different formats.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+
+    {
+        IceTByte *buffer = icetGetStateBuffer(
+                              scratch_state_buffer,
+                                eventual_num_partitions*sizeof(IceTVoid*)
+                              + 2*eventual_num_partitions*sizeof(IceTSizeType));
+        in_data_array = (const IceTVoid **)buffer;
+        inactive_before_array
+            = (IceTSizeType *)(  buffer
+                               + eventual_num_partitions*sizeof(IceTVoid*));
+        active_till_next_runl_array
+            = inactive_before_array + eventual_num_partitions;
+    }
+
+    /* Run through the input data and figure out where each interlaced
+       partition needs to read from. */
+    in_data = ICET_IMAGE_DATA(in_image);
+    inactive_before = 0;
+    active_till_next_runl = 0;
+    in_position = 0;
+    for (original_partition_idx = 0;
+         original_partition_idx < eventual_num_partitions;
+         original_partition_idx++) {
+        IceTSizeType pixels_to_skip;
+
+        BIT_REVERSE(interlaced_partition_idx,
+                    original_partition_idx,
+                    eventual_num_partitions);
+        if (eventual_num_partitions <= interlaced_partition_idx) {
+            interlaced_partition_idx = original_partition_idx;
+        }
+
+        pixels_to_skip = lower_partition_size;
+        if (interlaced_partition_idx < remaining_pixels) {
+            pixels_to_skip += 1;
+        }
+
+        in_data_array[interlaced_partition_idx] = in_data;
+        inactive_before_array[interlaced_partition_idx] = inactive_before;
+        active_till_next_runl_array[interlaced_partition_idx]
+            = active_till_next_runl;
+
+        if (original_partition_idx < eventual_num_partitions-1) {
+            icetSparseImageSeek(in_image,
+                                in_position,
+                                in_position + pixels_to_skip,
+                                &in_data,
+                                &inactive_before,
+                                &active_till_next_runl,
+                                NULL,
+                                color_size,
+                                depth_size);
+            in_position += pixels_to_skip;
+        }
+    }
+
+    /* Set up output image. */
+    icetSparseImageSetDimensions(out_image,
+                                 icetSparseImageGetWidth(in_image),
+                                 icetSparseImageGetHeight(in_image));
+    out_compact = ICET_SPARSE_IMAGE_COMPACT(out_image);
+    out_planar = ICET_SPARSE_IMAGE_PLANAR(out_image);
+    out_data = ICET_IMAGE_DATA(out_image);
+    SET_INACTIVE_RUN_LENGTH(out_data, out_compact, 0);
+    SET_ACTIVE_RUN_LENGTH(out_data, out_compact, 0);
+    last_run_length = out_data;
+    out_data = (IceTByte*)out_data + RUN_LENGTH_SIZE_OF(out_compact);
+    icetSeekIndexBegin(out_image, &out_index);
+    SEEK_INDEX_ADD_RUN(&out_index, last_run_length, 0);
+
+    for (interlaced_partition_idx = 0;
+         interlaced_partition_idx < eventual_num_partitions;
+         interlaced_partition_idx++) {
+        IceTSizeType pixels_left;
 
         pixels_left = lower_partition_size;
         if (interlaced_partition_idx < remaining_pixels) {
-            pixels_left += 1;
+            pixels_left += 1;
+        }
+
+        in_data = in_data_array[interlaced_partition_idx];
+        inactive_before = inactive_before_array[interlaced_partition_idx];
+        active_till_next_runl
+            = active_till_next_runl_array[interlaced_partition_idx];
+
+        icetSparseImageScanPixels((const IceTVoid **)&in_data,
+                                  &inactive_before,
+                                  &active_till_next_runl,
+                                  NULL,
+                                  pixels_left,
+                                  color_size,
+                                  depth_size,
+                                  in_compact,
+                                  in_planar,
+                                  (IceTVoid **)&out_data,
+                                  &last_run_length,
+                                  out_compact,
+                                  out_planar,
+                                  &out_index);
+    }
+
+    icetSparseImageSetActualSize(out_image, out_data);
+    icetSeekIndexEnd(&out_index);
+}
+
+IceTSizeType icetGetInterlaceOffset(IceTInt partition_index,
+                                    IceTInt eventual_num_partitions,
+                                    IceTSizeType original_image_size)
+{
+    IceTSizeType lower_partition_size;
+    IceTSizeType remaining_pixels;
+    IceTSizeType offset;
+    IceTInt original_partition_idx;
+
+    if ((partition_index < 0) || (eventual_num_partitions <= partition_index)) {
+        icetRaiseError("Invalid partition for interlace offset",
+                       ICET_INVALID_VALUE);
+        return 0;
+    }
+
+    lower_partition_size = original_image_size/eventual_num_partitions;
+    remaining_pixels = original_image_size%eventual_num_partitions;
+
+    offset = 0;
+    for (original_partition_idx = 0;
+         original_partition_idx < eventual_num_partitions;
+         original_partition_idx++) {
+        IceTInt interlaced_partition_idx;
+        IceTSizeType partition_size;
+
+        BIT_REVERSE(interlaced_partition_idx,
+                    original_partition_idx,
+                    eventual_num_partitions);
+        if (eventual_num_partitions <= interlaced_partition_idx) {
+            interlaced_partition_idx = original_partition_idx;
+        }
+
+        if (interlaced_partition_idx == partition_index) {
+            /* Found any partitions before this one. */
+            return offset;
+        }
+
+        partition_size = lower_partition_size;
+        if (interlaced_partition_idx < remaining_pixels) {
+            partition_size += 1;
+        }
+
+        offset += partition_size;
+    }
+
+    /* Should never get here. */
+    icetRaiseError("Could not find partition index.", ICET_SANITY_CHECK_FAIL);
+    return 0;
+}
+
+void icetClearImage(IceTImage image)
+{
+    IceTInt region[4] = {0, 0, 0, 0};
+    icetImageClearAroundRegion(image, region);
+}
+
+void icetClearImageTrueBackground(IceTImage image)
+{
+    IceTBoolean need_correction;
+    IceTEnum color_format = icetImageGetColorFormat(image);
+
+    icetClearImage(image);
+
+    icetGetBooleanv(ICET_NEED_BACKGROUND_CORRECTION, &need_correction);
+    if (need_correction && (color_format != ICET_IMAGE_COLOR_NONE)) {
+        IceTFloat background[4];
+        IceTSizeType pixel_size;
+        IceTByte *color = icetImageGetColorVoid(image, &pixel_size);
+        IceTSizeType num_pixels = icetImageGetNumPixels(image);
+        IceTSizeType pixel;
+
+        icetTrueBackgroundPixel(color_format, background);
+        for (pixel = 0; pixel < num_pixels; pixel++) {
+            memcpy(color + pixel*pixel_size, background, pixel_size);
+        }
+    }
+}
+
+void icetClearSparseImage(IceTSparseImage image)
+{
+    IceTByte *data;
+    IceTBoolean compact;
+
+    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+
+    if (icetSparseImageIsNull(image)) { return; }
+
+    /* Cleared images are always run length encoded.  Writers of the block
+       layout set it again after clearing. */
+    ICET_IMAGE_HEADER(image)[ICET_IMAGE_FLAGS_INDEX]
+        &= ~ICET_SPARSE_IMAGE_BLOCK_LAYOUT;
+
+    /* Likewise, any seek index is out of date. */
+    {
+        IceTInt *index = icetSparseImageGetSeekIndex(image);
+        if (index != NULL) { index[0] = 0; }
+    }
+
+    /* Use IceTByte for byte-based pointer arithmetic. */
+    compact = ICET_SPARSE_IMAGE_COMPACT(image);
+    data = icetSparseImageStartRun(ICET_IMAGE_DATA(image),
+                                   icetSparseImageGetNumPixels(image),
+                                   compact);
+
+    icetSparseImageSetActualSize(image, data+RUN_LENGTH_SIZE_OF(compact));
+}
+
+void icetSetColorFormat(IceTEnum color_format)
+{
+    IceTBoolean isDrawing;
+
+    icetGetBooleanv(ICET_IS_DRAWING_FRAME, &isDrawing);
+    if (isDrawing) {
+        icetRaiseError("Attempted to change the color format while drawing."
+                       " This probably means that you called icetSetColorFormat"
+                       " in a drawing callback. You cannot do that. Call this"
+                       " function before starting the draw operation.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    if (   (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE)
+        || (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT)
+        || (color_format == ICET_IMAGE_COLOR_RGBA_HALF)
+        || (color_format == ICET_IMAGE_COLOR_NONE) ) {
+        icetStateSetInteger(ICET_COLOR_FORMAT, color_format);
+    } else {
+        icetRaiseError("Invalid IceT color format.", ICET_INVALID_ENUM);
+    }
+}
+
+void icetSetDepthFormat(IceTEnum depth_format)
+{
+    IceTBoolean isDrawing;
+
+    icetGetBooleanv(ICET_IS_DRAWING_FRAME, &isDrawing);
+    if (isDrawing) {
+        icetRaiseError("Attempted to change the depth format while drawing."
+                       " This probably means that you called icetSetDepthFormat"
+                       " in a drawing callback. You cannot do that. Call this"
+                       " function before starting the draw operation.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+    if (   (depth_format == ICET_IMAGE_DEPTH_FLOAT)
+        || (depth_format == ICET_IMAGE_DEPTH_UNORM16)
+        || (depth_format == ICET_IMAGE_DEPTH_NONE) ) {
+        icetStateSetInteger(ICET_DEPTH_FORMAT, depth_format);
+    } else {
+        icetRaiseError("Invalid IceT depth format.", ICET_INVALID_ENUM);
+    }
+}
+
+void icetGetTileImage(IceTInt tile, IceTImage image)
+{
+    IceTInt screen_viewport[4], target_viewport[4];
+    const IceTInt *viewports;
+    IceTSizeType width, height;
+    IceTImage rendered_image;
+
+    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
+    width = viewports[4*tile+2];
+    height = viewports[4*tile+3];
+    icetImageSetDimensions(image, width, height);
+
+    rendered_image = renderTile(tile, screen_viewport, target_viewport, image);
+
+    icetTimingBufferReadBegin();
+
+    if (icetImageEqual(rendered_image, image)) {
+      /* Check to make sure the screen and target viewports are also equal. */
+        if (    (screen_viewport[0] != target_viewport[0])
+             || (screen_viewport[1] != target_viewport[1])
+             || (screen_viewport[2] != target_viewport[2])
+             || (screen_viewport[3] != target_viewport[3]) ) {
+            icetRaiseError("Inconsistent values returned from renderTile.",
+                           ICET_SANITY_CHECK_FAIL);
+        }
+    } else {
+      /* Copy the appropriate part of the image to the output buffer. */
+        icetImageCopyRegion(rendered_image, screen_viewport,
+                            image, target_viewport);
+    }
+
+    icetImageClearAroundRegion(image, target_viewport);
+
+    icetTimingBufferReadEnd();
+}
+
+void icetGetCompressedTileImage(IceTInt tile, IceTSparseImage compressed_image)
+{
+    IceTInt screen_viewport[4];
+    IceTCompressBands bands;
+    const IceTInt *viewports;
+    IceTSizeType width, height;
+    IceTInt num_bands;
+
+    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
+    width = viewports[4*tile+2];
+    height = viewports[4*tile+3];
+    icetSparseImageSetDimensions(compressed_image, width, height);
+
+    if (!icetRenderTileForCompress(tile, screen_viewport, &bands)) {
+        /* Tile empty.  Just clear result. */
+        icetClearSparseImage(compressed_image);
+        return;
+    }
+
+    num_bands = icetCompressNumBands(bands.image, compressed_image,
+                                     screen_viewport[3], width);
+    if (num_bands > 1) {
+        bands.compress_band = icetCompressTileBand;
+        bands.num_units = screen_viewport[3];
+        bands.unit_size = width;
+        bands.first_extra = bands.space_bottom*width;
+        bands.last_extra = bands.space_top*width;
+        icetCompressBands(&bands, num_bands, compressed_image);
+        return;
+    }
+
+#define INPUT_IMAGE             bands.image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define PADDING
+#define SPACE_BOTTOM            bands.space_bottom
+#define SPACE_TOP               bands.space_top
+#define SPACE_LEFT              bands.space_left
+#define SPACE_RIGHT             bands.space_right
+#define FULL_WIDTH              width
+#define FULL_HEIGHT             height
+#define REGION
+#define REGION_OFFSET_X         screen_viewport[0]
+#define REGION_OFFSET_Y         screen_viewport[1]
+#define REGION_WIDTH            screen_viewport[2]
+#define REGION_HEIGHT           screen_viewport[3]
+#include "compress_func_body.h"
+}
+
+void icetGetCompressedTileImageSplit(IceTInt tile,
+                                     IceTInt num_partitions,
+                                     IceTInt eventual_num_partitions,
+                                     IceTSparseImage *out_images,
+                                     IceTSizeType *offsets)
+{
+    IceTInt screen_viewport[4];
+    IceTCompressBands bands;
+    IceTSizeType range[3];
+    const IceTInt *viewports;
+    IceTSizeType total_num_pixels;
+    IceTBoolean rendered;
+    IceTInt partition;
+
+    if (num_partitions < 2) {
+        icetRaiseError("It does not make sense to call"
+                       " icetGetCompressedTileImageSplit with less than 2"
+                       " partitions.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
+    total_num_pixels = viewports[4*tile+2]*viewports[4*tile+3];
+
+    /* Use the same partitions as icetCompressImageSplit. */
+    icetSparseImageSplitChoosePartitions(num_partitions,
+                                         eventual_num_partitions,
+                                         total_num_pixels,
+                                         0,
+                                         offsets);
+
+    rendered = icetRenderTileForCompress(tile, screen_viewport, &bands);
+    bands.segments = range;
+
+    for (partition = 0; partition < num_partitions; partition++) {
+        IceTSizeType partition_num_pixels;
+
+        if (partition < num_partitions-1) {
+            partition_num_pixels = offsets[partition+1] - offsets[partition];
+        } else {
+            partition_num_pixels = total_num_pixels - offsets[partition];
+        }
+
+        icetSparseImageSetDimensions(out_images[partition],
+                                     partition_num_pixels,
+                                     1);
+        if (rendered) {
+            range[0] = offsets[partition];
+            range[1] = partition_num_pixels;
+            range[2] = 0;
+            icetCompressTileRanges(&bands,
+                                   1,
+                                   partition_num_pixels,
+                                   out_images[partition]);
+        } else {
+            icetClearSparseImage(out_images[partition]);
+        }
+    }
+}
+
+void icetGetCompressedTileImageInterlace(IceTInt tile,
+                                         IceTInt eventual_num_partitions,
+                                         IceTEnum scratch_state_buffer,
+                                         IceTSparseImage compressed_image)
+{
+    IceTInt screen_viewport[4];
+    IceTCompressBands bands;
+    IceTSizeType *segments;
+    IceTInt num_segments;
+    const IceTInt *viewports;
+    IceTSizeType width, height;
+
+    /* Special case, nothing to interlace. */
+    if (eventual_num_partitions < 2) {
+        icetGetCompressedTileImage(tile, compressed_image);
+        return;
+    }
+
+    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
+    width = viewports[4*tile+2];
+    height = viewports[4*tile+3];
+    icetSparseImageSetDimensions(compressed_image, width, height);
+
+    if (!icetRenderTileForCompress(tile, screen_viewport, &bands)) {
+        /* Tile empty.  Just clear result. */
+        icetClearSparseImage(compressed_image);
+        return;
+    }
+
+    segments = icetGetStateBuffer(
+                    scratch_state_buffer,
+                    3*(eventual_num_partitions+1)*sizeof(IceTSizeType));
+    num_segments = icetInterlaceSegments(width*height,
+                                         eventual_num_partitions,
+                                         segments);
+    bands.segments = segments;
+
+    icetCompressTileRanges(&bands,
+                           num_segments,
+                           width*height,
+                           compressed_image);
+}
+
+void icetCompressImage(const IceTImage image,
+                       IceTSparseImage compressed_image)
+{
+    icetCompressSubImage(image, 0, icetImageGetNumPixels(image),
+                         compressed_image);
+
+  /* This is a hack to get the width/height of the compressed image to agree
+     with the original image. */
+    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_WIDTH_INDEX]
+        = (IceTInt)icetImageGetWidth(image);
+    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_HEIGHT_INDEX]
+        = (IceTInt)icetImageGetHeight(image);
+}
+
+void icetCompressSubImage(const IceTImage image,
+                          IceTSizeType offset, IceTSizeType pixels,
+                          IceTSparseImage compressed_image)
+{
+    IceTInt num_bands;
+
+    ICET_TEST_IMAGE_HEADER(image);
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+
+    icetSparseImageSetDimensions(compressed_image, pixels, 1);
+
+    num_bands = icetCompressNumBands(image, compressed_image, pixels, 1);
+    if (num_bands > 1) {
+        IceTCompressBands bands;
+        bands.compress_band = icetCompressSubImageBand;
+        bands.num_units = pixels;
+        bands.unit_size = 1;
+        bands.first_extra = 0;
+        bands.last_extra = 0;
+        bands.image = image;
+        bands.offset = offset;
+        bands.screen_viewport = NULL;
+        bands.width = pixels;
+        bands.space_left = bands.space_right = 0;
+        bands.space_bottom = bands.space_top = 0;
+        bands.segments = NULL;
+        bands.pieces = NULL;
+        bands.max_pieces = 0;
+        icetCompressBands(&bands, num_bands, compressed_image);
+        return;
+    }
+
+#define INPUT_IMAGE             image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define OFFSET                  offset
+#define PIXEL_COUNT             pixels
+#include "compress_func_body.h"
+}
+
+void icetCompressImageSplit(const IceTImage image,
+                            IceTInt num_partitions,
+                            IceTInt eventual_num_partitions,
+                            IceTSparseImage *out_images,
+                            IceTSizeType *offsets)
+{
+    IceTSizeType total_num_pixels;
+    IceTInt partition;
+
+    ICET_TEST_IMAGE_HEADER(image);
+
+    if (num_partitions < 2) {
+        icetRaiseError("It does not make sense to call icetCompressImageSplit"
+                       " with less than 2 partitions.",
+                       ICET_INVALID_VALUE);
+        return;
+    }
+
+    total_num_pixels = icetImageGetNumPixels(image);
+
+    /* Use the same partitions as icetSparseImageSplit so that the pieces are
+       the same as compressing the whole image and then splitting it. */
+    icetSparseImageSplitChoosePartitions(num_partitions,
+                                         eventual_num_partitions,
+                                         total_num_pixels,
+                                         0,
+                                         offsets);
+
+    for (partition = 0; partition < num_partitions; partition++) {
+        IceTSizeType partition_num_pixels;
+
+        if (partition < num_partitions-1) {
+            partition_num_pixels = offsets[partition+1] - offsets[partition];
+        } else {
+            partition_num_pixels = total_num_pixels - offsets[partition];
+        }
+
+        icetCompressSubImage(image,
+                             offsets[partition],
+                             partition_num_pixels,
+                             out_images[partition]);
+    }
+}
+
+void icetCompressImageInterlace(const IceTImage image,
+                                IceTInt eventual_num_partitions,
+                                IceTEnum scratch_state_buffer,
+                                IceTSparseImage compressed_image)
+{
+    IceTSizeType num_pixels;
+    IceTSizeType *segments;
+    IceTInt num_segments;
+    IceTInt num_bands;
+
+    ICET_TEST_IMAGE_HEADER(image);
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+
+    /* Special case, nothing to interlace. */
+    if (eventual_num_partitions < 2) {
+        icetCompressImage(image, compressed_image);
+        return;
+    }
+
+    num_pixels = icetImageGetNumPixels(image);
+    segments = icetGetStateBuffer(
+                    scratch_state_buffer,
+                    3*(eventual_num_partitions+1)*sizeof(IceTSizeType));
+    num_segments = icetInterlaceSegments(num_pixels,
+                                         eventual_num_partitions,
+                                         segments);
+
+    icetSparseImageSetDimensions(compressed_image,
+                                 icetImageGetWidth(image),
+                                 icetImageGetHeight(image));
+
+    /* Bands are made of whole segments.  The unit size is only used to
+       allocate space for the bands, so the largest segment size is used. */
+    num_bands = icetCompressNumBands(
+                               image,
+                               compressed_image,
+                               num_segments,
+                               num_pixels/eventual_num_partitions + 1);
+    if (num_bands > 1) {
+        IceTCompressBands bands;
+        bands.compress_band = icetCompressInterlaceBand;
+        bands.num_units = num_segments;
+        bands.unit_size = num_pixels/eventual_num_partitions + 1;
+        bands.first_extra = 0;
+        bands.last_extra = 0;
+        bands.image = image;
+        bands.offset = 0;
+        bands.screen_viewport = NULL;
+        bands.width = num_pixels;
+        bands.space_left = bands.space_right = 0;
+        bands.space_bottom = bands.space_top = 0;
+        bands.segments = segments;
+        bands.pieces = NULL;
+        bands.max_pieces = 0;
+        icetCompressBands(&bands, num_bands, compressed_image);
+        return;
+    }
+
+#define INPUT_IMAGE             image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define INTERLACE               segments
+#include "compress_func_body.h"
+}
+
+static IceTInt icetInterlaceSegments(IceTSizeType num_pixels,
+                                     IceTInt eventual_num_partitions,
+                                     IceTSizeType *segments)
+{
+    IceTSizeType lower_partition_size = num_pixels/eventual_num_partitions;
+    IceTSizeType remaining_pixels = num_pixels%eventual_num_partitions;
+    IceTSizeType in_position;
+    IceTInt original_partition_idx;
+    IceTInt interlaced_partition_idx;
+    IceTInt num_segments;
+    IceTInt segment;
+
+    /* Find where each interlaced partition starts in the input. */
+    in_position = 0;
+    for (original_partition_idx = 0;
+         original_partition_idx < eventual_num_partitions;
+         original_partition_idx++) {
+        IceTSizeType partition_size;
+
+        BIT_REVERSE(interlaced_partition_idx,
+                    original_partition_idx,
+                    eventual_num_partitions);
+        if (eventual_num_partitions <= interlaced_partition_idx) {
+            interlaced_partition_idx = original_partition_idx;
+        }
+
+        partition_size = lower_partition_size;
+        if (interlaced_partition_idx < remaining_pixels) {
+            partition_size += 1;
+        }
+
+        segments[3*interlaced_partition_idx + 0] = in_position;
+        segments[3*interlaced_partition_idx + 1] = partition_size;
+        in_position += partition_size;
+    }
+
+    /* Drop empty partitions.  They only happen at the end of the interlaced
+       order, where the partitions are smaller. */
+    num_segments = 0;
+    for (interlaced_partition_idx = 0;
+         interlaced_partition_idx < eventual_num_partitions;
+         interlaced_partition_idx++) {
+        if (segments[3*interlaced_partition_idx + 1] > 0) {
+            segments[3*num_segments + 0]
+                = segments[3*interlaced_partition_idx + 0];
+            segments[3*num_segments + 1]
+                = segments[3*interlaced_partition_idx + 1];
+            num_segments++;
+        }
+    }
+
+    /* Find the jump from the end of each segment to the start of the next. */
+    segments[3*num_segments + 0] = num_pixels;
+    segments[3*num_segments + 1] = 0;
+    segments[3*num_segments + 2] = 0;
+    for (segment = 0; segment < num_segments; segment++) {
+        segments[3*segment + 2]
+            = (  segments[3*(segment+1) + 0]
+               - (segments[3*segment + 0] + segments[3*segment + 1]) );
+    }
+    if (num_segments > 0) {
+        segments[3*(num_segments-1) + 2] = 0;
+    }
+
+    return num_segments;
+}
+
+static IceTInt icetCompressNumBands(const IceTImage image,
+                                    const IceTSparseImage compressed_image,
+                                    IceTSizeType num_units,
+                                    IceTSizeType unit_size)
+{
+    IceTInt num_threads;
+    IceTInt num_bands;
+    IceTEnum composite_mode;
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
+
+    icetGetIntegerv(ICET_NUM_THREADS, &num_threads);
+    if (num_threads < 2) return 1;
+
+  /* Leave any case that raises a warning or error to the regular compression
+     so that it is only reported once. */
+    if (   (color_format != icetSparseImageGetColorFormat(compressed_image))
+        || (depth_format != icetSparseImageGetDepthFormat(compressed_image)) ) {
+        return 1;
+    }
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+        if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+            && (depth_format != ICET_IMAGE_DEPTH_UNORM16) ) {
+            return 1;
+        }
+        if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+            && (color_format != ICET_IMAGE_COLOR_NONE) ) {
+            return 1;
+        }
+    } else if (   (composite_mode == ICET_COMPOSITE_MODE_BLEND)
+               || icetChannelCompositeMode(composite_mode) ) {
+        if (depth_format != ICET_IMAGE_DEPTH_NONE) return 1;
+        if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+            return 1;
+        }
+    } else {
+        return 1;
+    }
+
+  /* Do not bother splitting up small images. */
+    num_bands = (IceTInt)(num_units*unit_size/ICET_COMPRESS_MIN_BAND_PIXELS);
+    num_bands = MIN(num_bands, num_threads);
+    num_bands = MIN(num_bands, (IceTInt)num_units);
+    return MAX(num_bands, 1);
+}
+
+static void icetCompressBands(const IceTCompressBands *bands,
+                              IceTInt num_bands,
+                              IceTSparseImage compressed_image)
+{
+    IceTEnum color_format = icetSparseImageGetColorFormat(compressed_image);
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(compressed_image);
+    IceTSizeType width = icetSparseImageGetWidth(compressed_image);
+    IceTSizeType height = icetSparseImageGetHeight(compressed_image);
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTBoolean compact = ICET_SPARSE_IMAGE_COMPACT(compressed_image);
+    IceTBoolean planar = ICET_SPARSE_IMAGE_PLANAR(compressed_image);
+    IceTSizeType units_per_band = bands->num_units/num_bands;
+    IceTSizeType remaining_units = bands->num_units%num_bands;
+    IceTSparseImage *band_images;
+    IceTCompressBandJoin *joins;
+    IceTVoid *out_data;
+    IceTVoid *last_run_length;
+    IceTSeekIndexBuilder out_index;
+    IceTSizeType band_start;
+    IceTInt band;
+
+    icetTimingCompressBegin();
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+
+#define BAND_FIRST_UNIT(band) \
+    ((band)*units_per_band + MIN(band, remaining_units))
+#define BAND_NUM_UNITS(band) \
+    (units_per_band + (((band) < remaining_units) ? 1 : 0))
+
+  /* The first band is compressed directly into compressed_image.  The rest
+     are compressed into scratch images that are later appended. */
+    {
+        IceTSizeType buffer_size;
+        IceTByte *buffer;
+
+        buffer_size
+            = num_bands*(sizeof(IceTSparseImage)+sizeof(IceTCompressBandJoin));
+        for (band = 1; band < num_bands; band++) {
+            IceTSizeType band_pixels = BAND_NUM_UNITS(band)*bands->unit_size;
+            if (band == num_bands-1) band_pixels += bands->last_extra;
+            buffer_size += icetSparseImageBufferSizeType(color_format,
+                                                         depth_format,
+                                                         band_pixels, 1);
+        }
+        buffer = icetGetStateBuffer(ICET_COMPRESS_BANDS_BUF, buffer_size);
+
+        band_images = (IceTSparseImage *)buffer;
+        buffer += num_bands*sizeof(IceTSparseImage);
+        joins = (IceTCompressBandJoin *)buffer;
+        buffer += num_bands*sizeof(IceTCompressBandJoin);
+
+        band_images[0] = compressed_image;
+        for (band = 1; band < num_bands; band++) {
+            IceTSizeType band_pixels = BAND_NUM_UNITS(band)*bands->unit_size;
+            if (band == num_bands-1) band_pixels += bands->last_extra;
+            band_images[band]
+                = icetSparseImageAssignBuffer(buffer, band_pixels, 1);
+            ICET_IMAGE_HEADER(band_images[band])[ICET_IMAGE_FLAGS_INDEX]
+                = ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_FLAGS_INDEX];
+            buffer += icetSparseImageBufferSizeType(color_format,
+                                                    depth_format,
+                                                    band_pixels, 1);
+        }
+    }
+
+#ifdef ICET_USE_OPENMP
+#pragma omp parallel for num_threads(num_bands) schedule(static, 1)
+#endif
+    for (band = 0; band < num_bands; band++) {
+        bands->compress_band(bands,
+                             band,
+                             num_bands,
+                             BAND_FIRST_UNIT(band),
+                             BAND_NUM_UNITS(band),
+                             band_images[band]);
+        icetSparseImageBandJoin(band_images[band],
+                                color_size + depth_size,
+                                &joins[band]);
+    }
+
+#undef BAND_FIRST_UNIT
+#undef BAND_NUM_UNITS
+
+  /* Append the remaining bands to the first.  The leading runs of each band
+     are scanned onto the end of the output so that they are joined with the
+     last run just as they would be if the image were compressed all at once.
+     The rest of the band is copied as is, and so are its seek index entries
+     (shifted to their place in the output). */
+    out_data = (  (IceTByte *)ICET_IMAGE_HEADER(compressed_image)
+                + icetSparseImageGetCompressedBufferSize(compressed_image) );
+    last_run_length = (  (IceTByte *)ICET_IMAGE_DATA(compressed_image)
+                       + joins[0].last_run_offset );
+    icetSeekIndexReopen(compressed_image, &out_index);
+    band_start = icetSparseImageGetNumPixels(band_images[0]);
+    for (band = 1; band < num_bands; band++) {
+        icetSparseImageJoinBand(band_images[band],
+                                &joins[band],
+                                band_start,
+                                color_size,
+                                depth_size,
+                                compact,
+                                planar,
+                                &out_data,
+                                &last_run_length,
+                                &out_index);
+        band_start += icetSparseImageGetNumPixels(band_images[band]);
+    }
+
+    icetSparseImageSetActualSize(compressed_image, out_data);
+    icetSeekIndexEnd(&out_index);
+    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_WIDTH_INDEX]
+        = (IceTInt)width;
+    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_HEIGHT_INDEX]
+        = (IceTInt)height;
+
+    icetTimingCompressEnd();
+}
+
+static void icetCompressSubImageBand(const IceTCompressBands *bands,
+                                     IceTInt band,
+                                     IceTInt num_bands,
+                                     IceTSizeType first_unit,
+                                     IceTSizeType num_units,
+                                     IceTSparseImage compressed_image)
+{
+    IceTSizeType offset = bands->offset + first_unit;
+
+    (void)band;
+    (void)num_bands;
+
+    icetSparseImageSetDimensions(compressed_image, num_units, 1);
+
+#define INPUT_IMAGE             bands->image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define OFFSET                  offset
+#define PIXEL_COUNT             num_units
+#define NO_TIMING
+#include "compress_func_body.h"
+}
+
+static void icetCompressTileBand(const IceTCompressBands *bands,
+                                 IceTInt band,
+                                 IceTInt num_bands,
+                                 IceTSizeType first_unit,
+                                 IceTSizeType num_units,
+                                 IceTSparseImage compressed_image)
+{
+    IceTSizeType space_bottom = (band == 0) ? bands->space_bottom : 0;
+    IceTSizeType space_top = (band == num_bands-1) ? bands->space_top : 0;
+    IceTSizeType height = num_units + space_bottom + space_top;
+    IceTSizeType region_y = bands->screen_viewport[1] + first_unit;
+
+    icetSparseImageSetDimensions(compressed_image, bands->width, height);
+
+#define INPUT_IMAGE             bands->image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define PADDING
+#define SPACE_BOTTOM            space_bottom
+#define SPACE_TOP               space_top
+#define SPACE_LEFT              bands->space_left
+#define SPACE_RIGHT             bands->space_right
+#define FULL_WIDTH              bands->width
+#define FULL_HEIGHT             height
+#define REGION
+#define REGION_OFFSET_X         bands->screen_viewport[0]
+#define REGION_OFFSET_Y         region_y
+#define REGION_WIDTH            bands->screen_viewport[2]
+#define REGION_HEIGHT           num_units
+#define NO_TIMING
+#include "compress_func_body.h"
+}
+
+static void icetCompressInterlaceBand(const IceTCompressBands *bands,
+                                      IceTInt band,
+                                      IceTInt num_bands,
+                                      IceTSizeType first_unit,
+                                      IceTSizeType num_units,
+                                      IceTSparseImage compressed_image)
+{
+    const IceTSizeType *segments = bands->segments + 3*first_unit;
+    IceTSizeType num_pixels = 0;
+    IceTSizeType segment;
+
+    (void)band;
+    (void)num_bands;
+
+    for (segment = 0; segment < num_units; segment++) {
+        num_pixels += segments[3*segment + 1];
+    }
+
+    icetSparseImageSetDimensions(compressed_image, num_pixels, 1);
+
+#define INPUT_IMAGE             bands->image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define INTERLACE               segments
+#define PIXEL_COUNT             num_pixels
+#define NO_TIMING
+#include "compress_func_body.h"
+}
+
+static void icetCompressTileRangesBand(const IceTCompressBands *bands,
+                                       IceTInt band,
+                                       IceTInt num_bands,
+                                       IceTSizeType first_unit,
+                                       IceTSizeType num_units,
+                                       IceTSparseImage compressed_image)
+{
+    IceTSizeType *segments = bands->pieces + 4*bands->max_pieces*band;
+    IceTSizeType *gaps = segments + 3*bands->max_pieces;
+    IceTSizeType num_pixels;
+
+    (void)num_bands;
+
+    num_pixels = icetTileRangePieces(bands,
+                                     first_unit,
+                                     num_units,
+                                     segments,
+                                     gaps);
+
+    icetSparseImageSetDimensions(compressed_image, num_units, 1);
+
+#define INPUT_IMAGE             bands->image
+#define OUTPUT_SPARSE_IMAGE     compressed_image
+#define INTERLACE               segments
+#define INTERLACE_GAPS          gaps
+#define PIXEL_COUNT             num_pixels
+#define NO_TIMING
+#include "compress_func_body.h"
+}
+
+static IceTBoolean icetRenderTileForCompress(IceTInt tile,
+                                             IceTInt *screen_viewport,
+                                             IceTCompressBands *bands)
+{
+    IceTInt target_viewport[4];
+    const IceTInt *viewports;
+    IceTSizeType width, height;
+
+    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
+    width = viewports[4*tile+2];
+    height = viewports[4*tile+3];
+
+    bands->image = renderTile(tile, screen_viewport, target_viewport,
+                              icetImageNull());
+
+    if ((target_viewport[2] < 1) || (target_viewport[3] < 1)) {
+        return ICET_FALSE;
+    }
+
+    bands->offset = 0;
+    bands->screen_viewport = screen_viewport;
+    bands->width = width;
+    bands->space_left = target_viewport[0];
+    bands->space_right = width - target_viewport[2] - bands->space_left;
+    bands->space_bottom = target_viewport[1];
+    bands->space_top = height - target_viewport[3] - bands->space_bottom;
+    bands->segments = NULL;
+    bands->pieces = NULL;
+    bands->max_pieces = 0;
+
+    return ICET_TRUE;
+}
+
+static void icetCompressTileRanges(IceTCompressBands *bands,
+                                   IceTInt num_ranges,
+                                   IceTSizeType num_pixels,
+                                   IceTSparseImage compressed_image)
+{
+    IceTInt num_bands;
+
+    num_bands = icetCompressNumBands(bands->image, compressed_image,
+                                     num_pixels, 1);
+
+    /* Each range crosses every row of the region at most once, and each
+       range (and each band) may cut a row in two.  One more entry is needed
+       for the end of the segments. */
+    bands->max_pieces = bands->screen_viewport[3] + 2*num_ranges + 3;
+    bands->pieces = icetGetStateBuffer(
+                     ICET_COMPRESS_PIECES_BUF,
+                     num_bands*4*bands->max_pieces*sizeof(IceTSizeType));
+
+    bands->compress_band = icetCompressTileRangesBand;
+    bands->num_units = num_pixels;
+    bands->unit_size = 1;
+    bands->first_extra = 0;
+    bands->last_extra = 0;
+
+    if (num_bands > 1) {
+        icetCompressBands(bands, num_bands, compressed_image);
+    } else {
+        IceTSizeType width = icetSparseImageGetWidth(compressed_image);
+        IceTSizeType height = icetSparseImageGetHeight(compressed_image);
+
+        icetTimingCompressBegin();
+        icetCompressTileRangesBand(bands, 0, 1, 0, num_pixels,
+                                   compressed_image);
+        icetTimingCompressEnd();
+
+        /* The band is compressed as a single line of pixels. */
+        ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_WIDTH_INDEX]
+            = (IceTInt)width;
+        ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_HEIGHT_INDEX]
+            = (IceTInt)height;
+    }
+}
+
+static IceTSizeType icetTileRangePieces(const IceTCompressBands *bands,
+                                        IceTSizeType first,
+                                        IceTSizeType num_pixels,
+                                        IceTSizeType *segments,
+                                        IceTSizeType *gaps)
+{
+    const IceTSizeType *range = bands->segments;
+    const IceTInt *screen_viewport = bands->screen_viewport;
+    IceTSizeType input_width = icetImageGetWidth(bands->image);
+    IceTSizeType width = bands->width;
+    IceTSizeType region_left = bands->space_left;
+    IceTSizeType region_right = width - bands->space_right;
+    IceTSizeType region_bottom = bands->space_bottom;
+    IceTSizeType region_top = region_bottom + screen_viewport[3];
+    IceTSizeType position = 0;
+    IceTSizeType range_remaining = 0;
+    IceTSizeType remaining = num_pixels;
+    IceTSizeType gap = 0;
+    IceTSizeType segment_pixels = 0;
+    IceTInt num_segments = 0;
+    IceTInt segment;
+
+    /* Find where the first pixel is. */
+    if (remaining > 0) {
+        while (first >= range[1]) {
+            first -= range[1];
+            range += 3;
+        }
+        position = range[0] + first;
+        range_remaining = range[1] - first;
+    }
+
+    while (remaining > 0) {
+        IceTSizeType line, x, run;
+
+        if (range_remaining == 0) {
+            range += 3;
+            position = range[0];
+            range_remaining = range[1];
+            continue;
+        }
+
+        line = position/width;
+        x = position%width;
+        run = MIN(remaining, range_remaining);
+        if (line < region_bottom) {
+            run = MIN(run, region_bottom*width - position);
+            gap += run;
+        } else if (line >= region_top) {
+            gap += run;
+        } else if (x < region_left) {
+            run = MIN(run, region_left - x);
+            gap += run;
+        } else if (x >= region_right) {
+            run = MIN(run, width - x);
+            gap += run;
+        } else {
+            IceTSizeType input_offset
+                = (  (screen_viewport[1] + line - region_bottom)*input_width
+                   + screen_viewport[0] + x - region_left );
+            run = MIN(run, region_right - x);
+            if (   (num_segments > 0) && (gap == 0)
+                && (  segments[3*(num_segments-1) + 0]
+                    + segments[3*(num_segments-1) + 1] == input_offset) ) {
+                segments[3*(num_segments-1) + 1] += run;
+            } else {
+                gaps[num_segments] = gap;
+                segments[3*num_segments + 0] = input_offset;
+                segments[3*num_segments + 1] = run;
+                num_segments++;
+                gap = 0;
+            }
+            segment_pixels += run;
+        }
+
+        position += run;
+        range_remaining -= run;
+        remaining -= run;
+    }
+    gaps[num_segments] = gap;
+
+    /* Find the jump from the end of each segment to the start of the next. */
+    segments[3*num_segments + 0] = 0;
+    segments[3*num_segments + 1] = 0;
+    segments[3*num_segments + 2] = 0;
+    for (segment = 0; segment < num_segments-1; segment++) {
+        segments[3*segment + 2]
+            = (  segments[3*(segment+1) + 0]
+               - (segments[3*segment + 0] + segments[3*segment + 1]) );
+    }
+    if (num_segments > 0) {
+        segments[3*(num_segments-1) + 2] = 0;
+    }
+
+    return segment_pixels;
+}
+
+static void icetSparseImageBandJoin(const IceTSparseImage image,
+                                    IceTSizeType pixel_size,
+                                    IceTCompressBandJoin *join)
+{
+    IceTBoolean compact = ICET_SPARSE_IMAGE_COMPACT(image);
+    IceTSizeType run_length_size = RUN_LENGTH_SIZE_OF(compact);
+    const IceTByte *data_start = ICET_IMAGE_DATA(image);
+    const IceTByte *data_end
+        = (  (const IceTByte *)ICET_IMAGE_HEADER(image)
+           + icetSparseImageGetCompressedBufferSize(image) );
+    const IceTByte *data = data_start;
+    const IceTByte *last_run_length = data_start;
+    IceTBoolean in_lead = ICET_TRUE;
+    IceTSizeType previous_active = 0;
+
+    join->lead_pixels = 0;
+    join->lead_size = 0;
+
+  /* Once a run with inactive pixels follows active pixels, the output will be
+     at the start of a new run, and everything from there on is unaffected by
+     what comes before the band. */
+    while (data < data_end) {
+        IceTSizeType inactive = GET_INACTIVE_RUN_LENGTH(data, compact);
+        IceTSizeType active = GET_ACTIVE_RUN_LENGTH(data, compact);
+        IceTSizeType run_size = run_length_size + active*pixel_size;
+
+        if (in_lead && (previous_active > 0) && (inactive > 0)) {
+            in_lead = ICET_FALSE;
+        }
+        if (in_lead) {
+            join->lead_pixels += inactive + active;
+            join->lead_size += run_size;
+        }
+        previous_active = active;
+
+        last_run_length = data;
+        data += run_size;
+    }
+
+    join->last_run_offset = (IceTSizeType)(last_run_length - data_start);
+}
+
+static void icetSparseImageJoinBand(const IceTSparseImage band_image,
+                                    const IceTCompressBandJoin *join,
+                                    IceTSizeType band_start,
+                                    IceTSizeType color_size,
+                                    IceTSizeType depth_size,
+                                    IceTBoolean compact,
+                                    IceTBoolean planar,
+                                    IceTVoid **out_data_p,
+                                    IceTVoid **last_run_length_p,
+                                    IceTSeekIndexBuilder *out_index)
+{
+    const IceTVoid *in_data = ICET_IMAGE_DATA(band_image);
+    const IceTByte *in_end
+        = (  (const IceTByte *)ICET_IMAGE_HEADER(band_image)
+           + icetSparseImageGetCompressedBufferSize(band_image) );
+    IceTSizeType inactive_before = 0;
+    IceTSizeType active_till_next_runl = 0;
+    IceTSizeType data_size;
+
+    icetSparseImageScanPixels(&in_data,
+                              &inactive_before,
+                              &active_till_next_runl,
+                              NULL,
+                              join->lead_pixels,
+                              color_size,
+                              depth_size,
+                              compact,
+                              planar,
+                              out_data_p,
+                              last_run_length_p,
+                              compact,
+                              planar,
+                              NULL);
+
+    data_size = (IceTSizeType)(in_end - (const IceTByte *)in_data);
+    memcpy(*out_data_p, in_data, data_size);
+    if (join->last_run_offset >= join->lead_size) {
+        *last_run_length_p = (  (IceTByte *)*out_data_p
+                              + (join->last_run_offset - join->lead_size) );
+    }
+
+    if (out_index->entries != NULL) {
+        const IceTInt *band_index = icetSparseImageGetSeekIndex(band_image);
+        IceTInt num_entries = (band_index != NULL) ? band_index[0] : 0;
+        IceTInt entry;
+        for (entry = 0; entry < num_entries; entry++) {
+            IceTSizeType offset = band_index[2 + 2*entry];
+            if (offset < join->lead_size) continue;
+            icetSeekIndexAddEntry(
+                             out_index,
+                             (IceTByte *)*out_data_p + (offset-join->lead_size),
+                             band_start + band_index[1 + 2*entry]);
+        }
+    }
+
+    *out_data_p = (IceTByte *)*out_data_p + data_size;
+}
+
+void icetDecompressImage(const IceTSparseImage compressed_image,
+                         IceTImage image)
+{
+    if (ICET_SPARSE_IMAGE_BLOCKS(compressed_image)) {
+        icetDecompressImageBlocks(compressed_image, image);
+        return;
+    }
+
+    icetImageSetDimensions(image,
+                           icetSparseImageGetWidth(compressed_image),
+                           icetSparseImageGetHeight(compressed_image));
+
+    icetDecompressSubImage(compressed_image, 0, image);
+}
+
+void icetDecompressSubImage(const IceTSparseImage compressed_image,
+                            IceTSizeType offset,
+                            IceTImage image)
+{
+    ICET_TEST_IMAGE_HEADER(image);
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(compressed_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+#define INPUT_SPARSE_IMAGE      compressed_image
+#define OUTPUT_IMAGE            image
+#define TIME_DECOMPRESSION
+#define OFFSET                  offset
+#define PIXEL_COUNT             icetSparseImageGetNumPixels(compressed_image)
+#include "decompress_func_body.h"
+}
+
+
+void icetDecompressImageCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTImage image)
+{
+    if (ICET_SPARSE_IMAGE_BLOCKS(compressed_image)) {
+        IceTBoolean need_correction;
+        icetDecompressImageBlocks(compressed_image, image);
+        icetGetBooleanv(ICET_NEED_BACKGROUND_CORRECTION, &need_correction);
+        if (   need_correction
+            && (icetImageGetColorFormat(image) != ICET_IMAGE_COLOR_NONE) ) {
+            IceTFloat background[4];
+            icetTrueBackgroundPixel(icetImageGetColorFormat(image),
+                                    background);
+            icetCorrectBackgroundColors(icetImageGetColorVoid(image, NULL),
+                                        icetImageGetColorFormat(image),
+                                        background,
+                                        icetImageGetNumPixels(image));
+        }
+        return;
+    }
+
+    icetImageSetDimensions(image,
+                           icetSparseImageGetWidth(compressed_image),
+                           icetSparseImageGetHeight(compressed_image));
+
+    icetDecompressSubImageCorrectBackground(compressed_image, 0, image);
+}
+
+void icetDecompressSubImageCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTImage image)
+{
+    IceTBoolean need_correction;
+
+    icetGetBooleanv(ICET_NEED_BACKGROUND_CORRECTION, &need_correction);
+    if (!need_correction) {
+        icetDecompressSubImage(compressed_image, offset, image);
+        return;
+    }
+
+    ICET_TEST_IMAGE_HEADER(image);
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(compressed_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+#define INPUT_SPARSE_IMAGE      compressed_image
+#define OUTPUT_IMAGE            image
+#define TIME_DECOMPRESSION
+#define CORRECT_BACKGROUND
+#define OFFSET                  offset
+#define PIXEL_COUNT             icetSparseImageGetNumPixels(compressed_image)
+#include "decompress_func_body.h"
+}
+
+void icetDecompressSubImageToBuffer(const IceTSparseImage compressed_image,
+                                    IceTSizeType offset,
+                                    IceTSizeType width,
+                                    IceTEnum color_format,
+                                    IceTSizeType row_pitch,
+                                    IceTVoid *buffer)
+{
+    icetDecompressSubImageToBufferWithBackground(compressed_image,
+                                                 offset,
+                                                 width,
+                                                 color_format,
+                                                 row_pitch,
+                                                 buffer,
+                                                 ICET_FALSE);
+}
+
+void icetDecompressSubImageToBufferCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTSizeType width,
+                                         IceTEnum color_format,
+                                         IceTSizeType row_pitch,
+                                         IceTVoid *buffer)
+{
+    IceTBoolean need_correction;
+    icetGetBooleanv(ICET_NEED_BACKGROUND_CORRECTION, &need_correction);
+    icetDecompressSubImageToBufferWithBackground(compressed_image,
+                                                 offset,
+                                                 width,
+                                                 color_format,
+                                                 row_pitch,
+                                                 buffer,
+                                                 need_correction);
+}
+
+/* Active pixels corrected for the background are blended this many at a time
+   before they are written to the buffer. */
+#define ICET_CORRECT_BACKGROUND_CHUNK 256
+
+static void icetDecompressSubImageToBufferWithBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTSizeType width,
+                                         IceTEnum color_format,
+                                         IceTSizeType row_pitch,
+                                         IceTVoid *buffer,
+                                         IceTBoolean correct_background)
+{
+    IceTColorBufferWriter writer;
+    IceTEnum in_format = icetSparseImageGetColorFormat(compressed_image);
+    IceTEnum write_format;
+    IceTInt num_fragments = 0;
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(compressed_image);
+    IceTBoolean compact = ICET_SPARSE_IMAGE_COMPACT(compressed_image);
+    IceTBoolean planar = ICET_SPARSE_IMAGE_PLANAR(compressed_image);
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTSizeType color_stride;
+    IceTSizeType write_size;
+    const IceTByte *data;
+    const IceTByte *data_end;
+    IceTSizeType position;
+    IceTFloat background[4];
+    IceTUShort background_half[4];
+    const IceTVoid *background_pixel = background;
+
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+
+    if (ICET_SPARSE_IMAGE_BLOCKS(compressed_image)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+
+  /* Fragments are resolved to RGBA_FLOAT colors before they are written. */
+    if (ICET_IMAGE_COLOR_IS_FRAGMENTS(in_format)) {
+        write_format = ICET_IMAGE_COLOR_RGBA_FLOAT;
+        num_fragments = ICET_IMAGE_COLOR_FRAGMENT_COUNT(in_format);
+    } else {
+        write_format = in_format;
+    }
+
+    if (!icetColorBufferWriterInit(&writer, write_format, width,
+                                   color_format, row_pitch, buffer)) {
+        return;
+    }
+
+    icetTimingCompressBegin();
+
+    color_size = colorPixelSize(in_format);
+    depth_size = depthPixelSize(depth_format);
+    color_stride = planar ? color_size : color_size + depth_size;
+    write_size = colorPixelSize(write_format);
+
+    /* Inactive pixels get the background color, just as they do when
+       decompressing into an image. */
+    if (correct_background) {
+        icetTrueBackgroundPixel(write_format, background);
+        background_pixel = background;
+    } else if (write_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetGetIntegerv(ICET_BACKGROUND_COLOR_WORD, (IceTInt *)background);
+    } else if (write_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        icetGetFloatv(ICET_BACKGROUND_COLOR, background);
+        icetFloatToHalfArray(background, background_half, 4);
+        background_pixel = background_half;
+    } else {
+        icetGetFloatv(ICET_BACKGROUND_COLOR, background);
+    }
+
+    data = ICET_IMAGE_DATA(compressed_image);
+    data_end = (  (const IceTByte *)ICET_IMAGE_HEADER(compressed_image)
+                + icetSparseImageGetCompressedBufferSize(compressed_image) );
+    position = offset;
+    while (data < data_end) {
+        IceTSizeType inactive = GET_INACTIVE_RUN_LENGTH(data, compact);
+        IceTSizeType active = GET_ACTIVE_RUN_LENGTH(data, compact);
+
+        data += RUN_LENGTH_SIZE_OF(compact);
+        icetColorBufferWrite(&writer, position, inactive,
+                             background_pixel, 0);
+        position += inactive;
+        if (correct_background || (num_fragments > 0)) {
+            const IceTByte *in = data;
+            IceTSizeType left = active;
+            while (left > 0) {
+                IceTFloat colors[4*ICET_CORRECT_BACKGROUND_CHUNK];
+                IceTSizeType count = MIN(left, ICET_CORRECT_BACKGROUND_CHUNK);
+                IceTSizeType i;
+                for (i = 0; i < count; i++) {
+                    if (num_fragments > 0) {
+                        IceTFloat depth;
+                        icetResolveFragments(in + i*color_stride,
+                                             num_fragments,
+                                             colors + 4*i,
+                                             &depth);
+                    } else {
+                        memcpy((IceTByte *)colors + i*color_size,
+                               in + i*color_stride,
+                               color_size);
+                    }
+                }
+                if (correct_background) {
+                    icetCorrectBackgroundColors(colors, write_format,
+                                                background_pixel, count);
+                }
+                icetColorBufferWrite(&writer, position, count,
+                                     colors, write_size);
+                in += count*color_stride;
+                position += count;
+                left -= count;
+            }
+        } else {
+            icetColorBufferWrite(&writer, position, active,
+                                 data, color_stride);
+            position += active;
+        }
+        data += active*(color_size + depth_size);
+    }
+
+#ifdef DEBUG
+    if (   position
+        != offset + icetSparseImageGetNumPixels(compressed_image) ) {
+        icetRaiseError("Counting problem.", ICET_SANITY_CHECK_FAIL);
+    }
+#endif
+
+    icetTimingCompressEnd();
+}
+
+void icetImageCopyColorToBuffer(const IceTImage image,
+                                IceTEnum color_format,
+                                IceTSizeType row_pitch,
+                                IceTVoid *buffer)
+{
+    IceTColorBufferWriter writer;
+    IceTEnum in_format = icetImageGetColorFormat(image);
+
+    ICET_TEST_IMAGE_HEADER(image);
+
+    if (!icetColorBufferWriterInit(&writer,
+                                   in_format,
+                                   icetImageGetWidth(image),
+                                   color_format,
+                                   row_pitch,
+                                   buffer)) {
+        return;
+    }
+
+    icetColorBufferWrite(&writer,
+                         0,
+                         icetImageGetNumPixels(image),
+                         icetImageGetColorConstVoid(image, NULL),
+                         colorPixelSize(in_format));
+}
+
+static IceTBoolean icetColorBufferWriterInit(IceTColorBufferWriter *writer,
+                                             IceTEnum in_format,
+                                             IceTSizeType width,
+                                             IceTEnum color_format,
+                                             IceTSizeType row_pitch,
+                                             IceTVoid *buffer)
+{
+    if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+        && (color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+        icetRaiseError("Invalid color format for output buffer.",
+                       ICET_INVALID_ENUM);
+        return ICET_FALSE;
+    }
+    if (in_format == ICET_IMAGE_COLOR_NONE) {
+        icetRaiseError("Input image has no color data.",
+                       ICET_INVALID_OPERATION);
+        return ICET_FALSE;
+    }
+    if (row_pitch == 0) {
+        row_pitch = width*colorPixelSize(color_format);
+    } else if (row_pitch < width*colorPixelSize(color_format)) {
+        icetRaiseError("Row pitch of output buffer is too small.",
+                       ICET_INVALID_VALUE);
+        return ICET_FALSE;
+    }
+
+    writer->buffer = buffer;
+    writer->color_format = color_format;
+    writer->width = width;
+    writer->row_pitch = row_pitch;
+    writer->in_format = in_format;
+    return ICET_TRUE;
+}
+
+static void icetColorBufferWrite(const IceTColorBufferWriter *writer,
+                                 IceTSizeType position,
+                                 IceTSizeType count,
+                                 const IceTVoid *in_colors,
+                                 IceTSizeType in_stride)
+{
+    IceTSizeType in_size = colorPixelSize(writer->in_format);
+    IceTSizeType out_size = colorPixelSize(writer->color_format);
+    const IceTByte *in = in_colors;
+
+    while (count > 0) {
+        IceTSizeType x = position%writer->width;
+        IceTSizeType y = position/writer->width;
+        IceTSizeType row_count = MIN(count, writer->width - x);
+        IceTByte *out = writer->buffer + y*writer->row_pitch + x*out_size;
+        IceTSizeType i;
+
+        if (writer->in_format == writer->color_format) {
+            if (in_stride == in_size) {
+                memcpy(out, in, row_count*in_size);
+            } else {
+                for (i = 0; i < row_count; i++) {
+                    memcpy(out + i*out_size, in + i*in_stride, in_size);
+                }
+            }
+        } else {
+            /* Convert through float as icetImageCopyColorub and
+               icetImageCopyColorf do. */
+            for (i = 0; i < row_count; i++) {
+                const IceTUByte *in_pixel
+                    = (const IceTUByte *)(in + i*in_stride);
+                IceTUByte *out_pixel = (IceTUByte *)(out + i*out_size);
+                IceTFloat color[4];
+
+                if (writer->in_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                    color[0] = (IceTFloat)in_pixel[0]/255.0f;
+                    color[1] = (IceTFloat)in_pixel[1]/255.0f;
+                    color[2] = (IceTFloat)in_pixel[2]/255.0f;
+                    color[3] = (IceTFloat)in_pixel[3]/255.0f;
+                } else if (writer->in_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                    IceTUShort half[4];
+                    memcpy(half, in_pixel, sizeof(half));
+                    icetHalfToFloatArray(half, color, 4);
+                } else {
+                    memcpy(color, in_pixel, sizeof(color));
+                }
+
+                if (writer->color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                    out_pixel[0] = (IceTUByte)(255*color[0]);
+                    out_pixel[1] = (IceTUByte)(255*color[1]);
+                    out_pixel[2] = (IceTUByte)(255*color[2]);
+                    out_pixel[3] = (IceTUByte)(255*color[3]);
+                } else if (writer->color_format==ICET_IMAGE_COLOR_RGBA_HALF) {
+                    icetFloatToHalfArray(color, (IceTUShort *)out_pixel, 4);
+                } else {
+                    memcpy(out_pixel, color, sizeof(color));
+                }
+            }
+        }
+
+        in += row_count*in_stride;
+        position += row_count;
+        count -= row_count;
+    }
+}
+
+static void icetTrueBackgroundPixel(IceTEnum color_format, IceTVoid *pixel)
+{
+    IceTFloat background[4];
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetGetIntegerv(ICET_TRUE_BACKGROUND_COLOR_WORD, (IceTInt *)pixel);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        icetGetFloatv(ICET_TRUE_BACKGROUND_COLOR, background);
+        icetFloatToHalfArray(background, (IceTUShort *)pixel, 4);
+    } else {
+        icetGetFloatv(ICET_TRUE_BACKGROUND_COLOR, (IceTFloat *)pixel);
+    }
+}
+
+static void icetCorrectBackgroundColors(IceTVoid *colors,
+                                        IceTEnum color_format,
+                                        const IceTVoid *background,
+                                        IceTSizeType num_pixels)
+{
+    IceTEnum composite_mode;
+    IceTSizeType pixel;
+
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    if (icetChannelCompositeMode(composite_mode)) {
+        icetChannelCompositeArrayWithColor(composite_mode, color_format,
+                                           colors, background, num_pixels);
+        return;
+    }
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        icetBlendUByteArrayOverColor(colors, background, num_pixels);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        IceTFloat *color = colors;
+        for (pixel = 0; pixel < num_pixels; pixel++, color += 4) {
+            ICET_UNDER_FLOAT((const IceTFloat *)background, color);
+        }
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        IceTUShort *color = colors;
+        for (pixel = 0; pixel < num_pixels; pixel++, color += 4) {
+            icetBlendHalfPixel(color, background, color);
+        }
+    }
+}
+
+void icetParallelPixelRanges(IceTSizeType num_units,
+                             IceTSizeType unit_pixels,
+                             IceTPixelRangeFunc func,
+                             IceTVoid *data)
+{
+    IceTInt num_threads;
+    IceTInt num_ranges;
+    IceTSizeType align_units;
+    IceTSizeType units_per_range;
+    IceTInt range;
+
+    icetGetIntegerv(ICET_NUM_THREADS, &num_threads);
+    num_ranges = (IceTInt)MIN(num_threads,
+                              num_units*unit_pixels/ICET_PARALLEL_MIN_PIXELS);
+    if (num_ranges < 2) {
+        func(data, 0, num_units);
+        return;
+    }
+
+  /* Round the size of each range up so that ranges start on cache lines. */
+    align_units = MAX(ICET_PARALLEL_ALIGN_PIXELS/unit_pixels, 1);
+    units_per_range = (num_units + num_ranges - 1)/num_ranges;
+    units_per_range
+        = ((units_per_range + align_units - 1)/align_units)*align_units;
+    num_ranges = (IceTInt)((num_units + units_per_range - 1)/units_per_range);
+
+#ifdef ICET_USE_OPENMP
+#pragma omp parallel for num_threads(num_ranges) schedule(static, 1)
+#endif
+    for (range = 0; range < num_ranges; range++) {
+        IceTSizeType first_unit = range*units_per_range;
+        func(data, first_unit, MIN(units_per_range, num_units - first_unit));
+    }
+}
+
+void icetComposite(IceTImage destBuffer, const IceTImage srcBuffer,
+                   int srcOnTop)
+{
+    IceTSizeType pixels;
+    IceTEnum composite_mode;
+    IceTEnum color_format, depth_format;
+    IceTCompositeRangeData data;
+
+    pixels = icetImageGetNumPixels(destBuffer);
+    if (pixels != icetImageGetNumPixels(srcBuffer)) {
+        icetRaiseError("Source and destination sizes don't match.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+
+    color_format = icetImageGetColorFormat(destBuffer);
+    depth_format = icetImageGetDepthFormat(destBuffer);
+
+    if (   (color_format != icetImageGetColorFormat(srcBuffer))
+        || (depth_format != icetImageGetDepthFormat(srcBuffer)) ) {
+        icetRaiseError("Source and destination types don't match.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+
+  /* Check everything that could raise an error or warning here so that the
+     pixels can be composited on any thread. */
+    if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+        if (depth_format == ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseError("Cannot use Z buffer compositing operation with no"
+                           " Z buffer.", ICET_INVALID_OPERATION);
+            return;
+        } else if (   (depth_format != ICET_IMAGE_DEPTH_FLOAT)
+                   && (depth_format != ICET_IMAGE_DEPTH_UNORM16) ) {
+            icetRaiseError("Encountered invalid depth format.",
+                           ICET_SANITY_CHECK_FAIL);
+            return;
+        }
+        if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+            && (color_format != ICET_IMAGE_COLOR_RGBA_HALF)
+            && (color_format != ICET_IMAGE_COLOR_NONE) ) {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+            return;
+        }
+    } else if (   (composite_mode == ICET_COMPOSITE_MODE_BLEND)
+               || icetChannelCompositeMode(composite_mode) ) {
+        if (depth_format != ICET_IMAGE_DEPTH_NONE) {
+            icetRaiseWarning("Z buffer ignored during blend composite"
+                             " operation.  Output z buffer meaningless.",
+                             ICET_INVALID_VALUE);
+        }
+        if (color_format == ICET_IMAGE_COLOR_NONE) {
+            icetRaiseWarning("Compositing image with no data.",
+                             ICET_INVALID_OPERATION);
+            return;
+        } else if (   (color_format != ICET_IMAGE_COLOR_RGBA_UBYTE)
+                   && (color_format != ICET_IMAGE_COLOR_RGBA_FLOAT)
+                   && (color_format != ICET_IMAGE_COLOR_RGBA_HALF) ) {
+            icetRaiseError("Encountered invalid color format.",
+                           ICET_SANITY_CHECK_FAIL);
+            return;
+        }
+    } else if (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+        icetRaiseError("Fragments can only be composited in sparse images.",
+                       ICET_INVALID_OPERATION);
+        return;
+    } else {
+        icetRaiseError("Encountered invalid composite mode.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+
+    data.composite_mode = composite_mode;
+    data.color_format = color_format;
+    data.depth_format = depth_format;
+    data.src_on_top = srcOnTop;
+    data.src_color = icetImageGetColorConstVoid(srcBuffer, NULL);
+    data.dest_color = icetImageGetColorVoid(destBuffer, NULL);
+    data.src_depth = icetImageGetDepthConstVoid(srcBuffer, NULL);
+    data.dest_depth = icetImageGetDepthVoid(destBuffer, NULL);
+
+    icetTimingBlendBegin();
+
+    icetParallelPixelRanges(pixels, 1, icetCompositeRange, &data);
+
+    icetTimingBlendEnd();
+}
+
+static void icetCompositeRange(IceTVoid *data_p,
+                               IceTSizeType first_pixel,
+                               IceTSizeType pixels)
+{
+    const IceTCompositeRangeData *data = (IceTCompositeRangeData *)data_p;
+    IceTEnum color_format = data->color_format;
+    IceTEnum depth_format = data->depth_format;
+    IceTSizeType i;
+
+    if (data->composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+            const IceTFloat *srcDepthBuffer
+                = (const IceTFloat *)data->src_depth + first_pixel;
+            IceTFloat *destDepthBuffer
+                = (IceTFloat *)data->dest_depth + first_pixel;
+
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                const IceTUInt *srcColorBuffer
+                    = (const IceTUInt *)data->src_color + first_pixel;
+                IceTUInt *destColorBuffer
+                    = (IceTUInt *)data->dest_color + first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[i] = srcColorBuffer[i];
+                    }
+                }
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                const IceTFloat *srcColorBuffer
+                    = (const IceTFloat *)data->src_color + 4*first_pixel;
+                IceTFloat *destColorBuffer
+                    = (IceTFloat *)data->dest_color + 4*first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[4*i+0] = srcColorBuffer[4*i+0];
+                        destColorBuffer[4*i+1] = srcColorBuffer[4*i+1];
+                        destColorBuffer[4*i+2] = srcColorBuffer[4*i+2];
+                        destColorBuffer[4*i+3] = srcColorBuffer[4*i+3];
+                    }
+                }
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                const IceTUShort *srcColorBuffer
+                    = (const IceTUShort *)data->src_color + 4*first_pixel;
+                IceTUShort *destColorBuffer
+                    = (IceTUShort *)data->dest_color + 4*first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[4*i+0] = srcColorBuffer[4*i+0];
+                        destColorBuffer[4*i+1] = srcColorBuffer[4*i+1];
+                        destColorBuffer[4*i+2] = srcColorBuffer[4*i+2];
+                        destColorBuffer[4*i+3] = srcColorBuffer[4*i+3];
+                    }
+                }
+            } else { /* color_format == ICET_IMAGE_COLOR_NONE */
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                    }
+                }
+            }
+        } else { /* depth_format == ICET_IMAGE_DEPTH_UNORM16 */
+            const IceTUShort *srcDepthBuffer
+                = (const IceTUShort *)data->src_depth + first_pixel;
+            IceTUShort *destDepthBuffer
+                = (IceTUShort *)data->dest_depth + first_pixel;
+
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                const IceTUInt *srcColorBuffer
+                    = (const IceTUInt *)data->src_color + first_pixel;
+                IceTUInt *destColorBuffer
+                    = (IceTUInt *)data->dest_color + first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[i] = srcColorBuffer[i];
+                    }
+                }
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                const IceTFloat *srcColorBuffer
+                    = (const IceTFloat *)data->src_color + 4*first_pixel;
+                IceTFloat *destColorBuffer
+                    = (IceTFloat *)data->dest_color + 4*first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[4*i+0] = srcColorBuffer[4*i+0];
+                        destColorBuffer[4*i+1] = srcColorBuffer[4*i+1];
+                        destColorBuffer[4*i+2] = srcColorBuffer[4*i+2];
+                        destColorBuffer[4*i+3] = srcColorBuffer[4*i+3];
+                    }
+                }
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+                const IceTUShort *srcColorBuffer
+                    = (const IceTUShort *)data->src_color + 4*first_pixel;
+                IceTUShort *destColorBuffer
+                    = (IceTUShort *)data->dest_color + 4*first_pixel;
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                        destColorBuffer[4*i+0] = srcColorBuffer[4*i+0];
+                        destColorBuffer[4*i+1] = srcColorBuffer[4*i+1];
+                        destColorBuffer[4*i+2] = srcColorBuffer[4*i+2];
+                        destColorBuffer[4*i+3] = srcColorBuffer[4*i+3];
+                    }
+                }
+            } else { /* color_format == ICET_IMAGE_COLOR_NONE */
+                for (i = 0; i < pixels; i++) {
+                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
+                        destDepthBuffer[i] = srcDepthBuffer[i];
+                    }
+                }
+            }
+        }
+    } else if (icetChannelCompositeMode(data->composite_mode)) {
+      /* The channel operations do not depend on order. */
+        IceTSizeType color_size = colorPixelSize(color_format);
+        IceTPixelSpan src_span;
+        IceTPixelSpan dest_span;
+        src_span.color
+            = (IceTByte *)data->src_color + first_pixel*color_size;
+        dest_span.color = (IceTByte *)data->dest_color + first_pixel*color_size;
+        src_span.depth = dest_span.depth = NULL;
+        src_span.color_stride = dest_span.color_stride = color_size;
+        src_span.depth_stride = dest_span.depth_stride = 0;
+        icetChannelCompositeSpan(data->composite_mode,
+                                 color_format,
+                                 &src_span,
+                                 &dest_span,
+                                 &dest_span,
+                                 pixels);
+    } else { /* composite_mode == ICET_COMPOSITE_MODE_BLEND */
+        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            const IceTUByte *srcColorBuffer
+                = (const IceTUByte *)data->src_color + 4*first_pixel;
+            IceTUByte *destColorBuffer
+                = (IceTUByte *)data->dest_color + 4*first_pixel;
+            if (data->src_on_top) {
+                icetBlendUByteArray(srcColorBuffer,
+                                    destColorBuffer,
+                                    destColorBuffer,
+                                    pixels);
+            } else {
+                icetBlendUByteArray(destColorBuffer,
+                                    srcColorBuffer,
+                                    destColorBuffer,
+                                    pixels);
+            }
+        } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+            const IceTFloat *srcColorBuffer
+                = (const IceTFloat *)data->src_color + 4*first_pixel;
+            IceTFloat *destColorBuffer
+                = (IceTFloat *)data->dest_color + 4*first_pixel;
+            if (data->src_on_top) {
+                for (i = 0; i < pixels; i++) {
+                    ICET_OVER_FLOAT(srcColorBuffer + i*4,
+                                    destColorBuffer + i*4);
+                }
+            } else {
+                for (i = 0; i < pixels; i++) {
+                    ICET_UNDER_FLOAT(srcColorBuffer + i*4,
+                                     destColorBuffer + i*4);
+                }
+            }
+        } else { /* color_format == ICET_IMAGE_COLOR_RGBA_HALF */
+            const IceTUShort *srcColorBuffer
+                = (const IceTUShort *)data->src_color + 4*first_pixel;
+            IceTUShort *destColorBuffer
+                = (IceTUShort *)data->dest_color + 4*first_pixel;
+            if (data->src_on_top) {
+                for (i = 0; i < pixels; i++) {
+                    icetBlendHalfPixel(srcColorBuffer + i*4,
+                                       destColorBuffer + i*4,
+                                       destColorBuffer + i*4);
+                }
+            } else {
+                for (i = 0; i < pixels; i++) {
+                    icetBlendHalfPixel(destColorBuffer + i*4,
+                                       srcColorBuffer + i*4,
+                                       destColorBuffer + i*4);
+                }
+            }
         }
-
-        in_data = in_data_array[interlaced_partition_idx];
-        inactive_before = inactive_before_array[interlaced_partition_idx];
-        active_till_next_runl
-            = active_till_next_runl_array[interlaced_partition_idx];
-
-        icetSparseImageScanPixels((const IceTVoid **)&in_data,
-                                  &inactive_before,
-                                  &active_till_next_runl,
-                                  NULL,
-                                  pixels_left,
-                                  pixel_size,
-                                  (IceTVoid **)&out_data,
-                                  &last_run_length);
     }
-
-    icetSparseImageSetActualSize(out_image, out_data);
 }
 
-IceTSizeType icetGetInterlaceOffset(IceTInt partition_index,
-                                    IceTInt eventual_num_partitions,
-                                    IceTSizeType original_image_size)
+void icetCompressedComposite(IceTImage destBuffer,
+                             const IceTSparseImage srcBuffer,
+                             int srcOnTop)
 {
-    IceTSizeType lower_partition_size;
-    IceTSizeType remaining_pixels;
-    IceTSizeType offset;
-    IceTInt original_partition_idx;
-
-    if ((partition_index < 0) || (eventual_num_partitions <= partition_index)) {
-        icetRaiseError("Invalid partition for interlace offset",
+    if (    icetImageGetNumPixels(destBuffer)
+         != icetSparseImageGetNumPixels(srcBuffer) ) {
+        icetRaiseError("Size of input and output buffers do not agree.",
                        ICET_INVALID_VALUE);
-        return 0;
+    }
+    if (ICET_SPARSE_IMAGE_BLOCKS(srcBuffer)) {
+        icetCompressedCompositeBlocks(destBuffer, srcBuffer, srcOnTop);
+        return;
+    }
+    icetCompressedSubComposite(destBuffer, 0, srcBuffer, srcOnTop);
+}
+void icetCompressedSubComposite(IceTImage destBuffer,
+                                IceTSizeType offset,
+                                const IceTSparseImage srcBuffer,
+                                int srcOnTop)
+{
+    if (ICET_SPARSE_IMAGE_BLOCKS(srcBuffer)) {
+        icetRaiseError("Sparse images in the block layout can only be"
+                       " decompressed or composited whole.",
+                       ICET_INVALID_OPERATION);
+        return;
     }
 
-    lower_partition_size = original_image_size/eventual_num_partitions;
-    remaining_pixels = original_image_size%eventual_num_partitions;
+    icetTimingBlendBegin();
 
-    offset = 0;
-    for (original_partition_idx = 0;
-         original_partition_idx < eventual_num_partitions;
-         original_partition_idx++) {
-        IceTInt interlaced_partition_idx;
-        IceTSizeType partition_size;
+    if (srcOnTop) {
+#define INPUT_SPARSE_IMAGE      srcBuffer
+#define OUTPUT_IMAGE            destBuffer
+#define OFFSET                  offset
+#define PIXEL_COUNT             icetSparseImageGetNumPixels(srcBuffer)
+#define COMPOSITE
+#define BLEND_RGBA_UBYTE(src, dest, count) \
+    icetBlendUByteArray(src, dest, dest, count)
+#define BLEND_RGBA_FLOAT        ICET_OVER_FLOAT
+#define BLEND_RGBA_HALF(src, dest)  icetBlendHalfPixel(src, dest, dest)
+#include "decompress_func_body.h"
+    } else {
+#define INPUT_SPARSE_IMAGE      srcBuffer
+#define OUTPUT_IMAGE            destBuffer
+#define OFFSET                  offset
+#define PIXEL_COUNT             icetSparseImageGetNumPixels(srcBuffer)
+#define COMPOSITE
+#define BLEND_RGBA_UBYTE(src, dest, count) \
+    icetBlendUByteArray(dest, src, dest, count)
+#define BLEND_RGBA_FLOAT        ICET_UNDER_FLOAT
+#define BLEND_RGBA_HALF(src, dest)  icetBlendHalfPixel(dest, src, dest)
+#include "decompress_func_body.h"
+    }
 
-        BIT_REVERSE(interlaced_partition_idx,
-                    original_partition_idx,
-                    eventual_num_partitions);
-        if (eventual_num_partitions <= interlaced_partition_idx) {
-            interlaced_partition_idx = original_partition_idx;
-        }
+    icetTimingBlendEnd();
+}
 
-        if (interlaced_partition_idx == partition_index) {
-            /* Found any partitions before this one. */
-            return offset;
-        }
+void icetCompressedCompressedComposite(const IceTSparseImage front_buffer,
+                                       const IceTSparseImage back_buffer,
+                                       IceTSparseImage dest_buffer)
+{
+    if (   ICET_SPARSE_IMAGE_BLOCKS(front_buffer)
+        || ICET_SPARSE_IMAGE_BLOCKS(back_buffer) ) {
+        icetCompressedCompressedCompositeBlocks(front_buffer,
+                                                back_buffer,
+                                                dest_buffer);
+        return;
+    }
 
-        partition_size = lower_partition_size;
-        if (interlaced_partition_idx < remaining_pixels) {
-            partition_size += 1;
-        }
+    icetTimingBlendBegin();
 
-        offset += partition_size;
-    }
+#define FRONT_SPARSE_IMAGE front_buffer
+#define BACK_SPARSE_IMAGE back_buffer
+#define DEST_SPARSE_IMAGE dest_buffer
+#include "cc_composite_func_body.h"
 
-    /* Should never get here. */
-    icetRaiseError("Could not find partition index.", ICET_SANITY_CHECK_FAIL);
-    return 0;
+    icetTimingBlendEnd();
 }
 
-void icetClearImage(IceTImage image)
+/* Returns true if the color or depth of a single pixel, which need not be
+   aligned, marks it as inactive. */
+static IceTBoolean icetColorPixelInactive(IceTEnum composite_mode,
+                                          IceTEnum color_format,
+                                          const IceTByte *color)
 {
-    IceTInt region[4] = {0, 0, 0, 0};
-    icetImageClearAroundRegion(image, region);
-}
+    if (icetChannelCompositeMode(composite_mode)) {
+        IceTUShort value[8];
+        memcpy(value, color, colorPixelSize(color_format));
+        return (icetScanChannelColor((const IceTByte *)value, color_format,
+                                     0, 1, ICET_FALSE) == 1);
+    }
 
-void icetClearSparseImage(IceTSparseImage image)
+    switch (color_format) {
+      case ICET_IMAGE_COLOR_RGBA_UBYTE:
+          return (((const IceTUByte *)color)[3] == 0x00);
+      case ICET_IMAGE_COLOR_RGBA_FLOAT:
+          {
+              IceTFloat alpha;
+              memcpy(&alpha, color + 3*sizeof(IceTFloat), sizeof(IceTFloat));
+              return !(alpha != 0.0);
+          }
+      case ICET_IMAGE_COLOR_RGBA_HALF:
+          {
+              IceTUShort alpha;
+              memcpy(&alpha, color + 3*sizeof(IceTUShort),sizeof(IceTUShort));
+              return ((alpha & 0x7FFF) == 0);
+          }
+      default:
+          return ICET_TRUE;
+    }
+}
+static IceTBoolean icetDepthPixelInactive(IceTEnum depth_format,
+                                          const IceTByte *depth)
 {
-    IceTByte *data;
+    switch (depth_format) {
+      case ICET_IMAGE_DEPTH_FLOAT:
+          {
+              IceTFloat value;
+              memcpy(&value, depth, sizeof(IceTFloat));
+              return !(value < 1.0);
+          }
+      case ICET_IMAGE_DEPTH_UNORM16:
+          {
+              IceTUShort value;
+              memcpy(&value, depth, sizeof(IceTUShort));
+              return (value == ICET_UNORM16_FAR_DEPTH);
+          }
+      default:
+          return ICET_TRUE;
+    }
+}
 
-    ICET_TEST_SPARSE_IMAGE_HEADER(image);
+/* Returns true if any of the num_pixels pixels of a full image starting at
+   pixel is active.  Depth is tested for z-buffer compositing and alpha for
+   blending, just as when compressing into runs. */
+static IceTBoolean icetImageSpanActive(const IceTImage image,
+                                       IceTBoolean test_depth,
+                                       IceTSizeType pixel,
+                                       IceTSizeType num_pixels)
+{
+    if (test_depth) {
+        switch (icetImageGetDepthFormat(image)) {
+          case ICET_IMAGE_DEPTH_FLOAT:
+              return (  icetScanInactiveDepthf(
+                            icetImageGetDepthcf(image) + pixel, num_pixels)
+                      < num_pixels );
+          case ICET_IMAGE_DEPTH_UNORM16:
+              return (  icetScanInactiveDepthus(
+                            icetImageGetDepthcus(image) + pixel, num_pixels)
+                      < num_pixels );
+          default:
+              return ICET_FALSE;
+        }
+    } else {
+        switch (icetImageGetColorFormat(image)) {
+          case ICET_IMAGE_COLOR_RGBA_UBYTE:
+              return (  icetScanInactiveColorub(
+                            icetImageGetColorcui(image) + pixel, num_pixels)
+                      < num_pixels );
+          case ICET_IMAGE_COLOR_RGBA_FLOAT:
+              return (  icetScanInactiveColorf(
+                            icetImageGetColorcf(image) + 4*pixel, num_pixels)
+                      < num_pixels );
+          case ICET_IMAGE_COLOR_RGBA_HALF:
+              return (  icetScanInactiveColorus(
+                            icetImageGetColorcus(image) + 4*pixel, num_pixels)
+                      < num_pixels );
+          default:
+              return ICET_FALSE;
+        }
+    }
+}
 
-    if (icetSparseImageIsNull(image)) { return; }
+/* Where icetCompressedMultiComposite is in the runs of one input image. */
+typedef struct {
+    const IceTByte *next;       /* Next run length to read. */
+    IceTSizeType num_inactive;
+    IceTSizeType num_active;
+    IceTPixelSpan span;         /* The next active pixel. */
+    IceTBoolean compact;
+    IceTBoolean planar;
+} IceTMultiCompositeCursor;
+
+/* icetCompressedMultiComposite composites the images this many pixels at a
+   time in a tile small enough to stay in cache. */
+#define ICET_MULTI_COMPOSITE_TILE       1024
+
+/* Loads run lengths of the image under cursor until it has active pixels or
+   there are no pixels left after pixel. */
+#define MULTI_LOAD_RUN(cursor, pixel)                                   \
+    while (   ((cursor)->num_active == 0)                               \
+           && (((cursor)->num_inactive + (pixel)) < num_pixels) ) {     \
+        (cursor)->num_inactive                                          \
+            += GET_INACTIVE_RUN_LENGTH((cursor)->next, (cursor)->compact);\
+        (cursor)->num_active                                            \
+            = GET_ACTIVE_RUN_LENGTH((cursor)->next, (cursor)->compact); \
+        (cursor)->span.color = (  (IceTByte *)(cursor)->next            \
+                                + RUN_LENGTH_SIZE_OF((cursor)->compact) );\
+        (cursor)->span.depth = (  (cursor)->planar                      \
+                                ? (  (cursor)->span.color               \
+                                   + (cursor)->num_active*color_size)   \
+                                : (cursor)->span.color + color_size );  \
+        (cursor)->next = (  (cursor)->span.color                        \
+                          + (cursor)->num_active*pixel_size );          \
+    }
 
-    /* Use IceTByte for byte-based pointer arithmetic. */
-    data = ICET_IMAGE_DATA(image);
-    INACTIVE_RUN_LENGTH(data) = icetSparseImageGetNumPixels(image);
-    ACTIVE_RUN_LENGTH(data) = 0;
+/* Returns the number of pixels at the front of a tile that are active (or
+   inactive if active is false). */
+static IceTSizeType icetMultiCompositeScan(IceTEnum composite_mode,
+                                           IceTEnum color_format,
+                                           IceTEnum depth_format,
+                                           const IceTPixelSpan *tile,
+                                           IceTSizeType num_pixels,
+                                           IceTBoolean active)
+{
+    const IceTByte *value;
+    IceTSizeType stride;
+    IceTSizeType pixel;
 
-    icetSparseImageSetActualSize(image, data+RUN_LENGTH_SIZE);
-}
+    if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+        if (!active && (tile->depth_stride == depthPixelSize(depth_format))) {
+            if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+                return icetScanInactiveDepthf((const IceTFloat *)tile->depth,
+                                              num_pixels);
+            } else {
+                return icetScanInactiveDepthus(
+                               (const IceTUShort *)tile->depth, num_pixels);
+            }
+        }
+        value = tile->depth;
+        stride = tile->depth_stride;
+        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+            for (pixel = 0; pixel < num_pixels; pixel++, value += stride) {
+                if ((*(const IceTFloat *)value < 1.0) != active) break;
+            }
+        } else {
+            for (pixel = 0; pixel < num_pixels; pixel++, value += stride) {
+                if (  (*(const IceTUShort *)value != ICET_UNORM16_FAR_DEPTH)
+                    != active ) break;
+            }
+        }
+        return pixel;
+    }
 
-void icetSetColorFormat(IceTEnum color_format)
-{
-    IceTBoolean isDrawing;
+    /* A pixel of fragments is active if its first fragment is used. */
+    if (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+        value = tile->color + 3*sizeof(IceTFloat);
+        stride = tile->color_stride;
+        for (pixel = 0; pixel < num_pixels; pixel++, value += stride) {
+            if ((*(const IceTFloat *)value != 0.0f) != active) break;
+        }
+        return pixel;
+    }
 
-    icetGetBooleanv(ICET_IS_DRAWING_FRAME, &isDrawing);
-    if (isDrawing) {
-        icetRaiseError("Attempted to change the color format while drawing."
-                       " This probably means that you called icetSetColorFormat"
-                       " in a drawing callback. You cannot do that. Call this"
-                       " function before starting the draw operation.",
-                       ICET_INVALID_OPERATION);
-        return;
+    if (icetChannelCompositeMode(composite_mode)) {
+        return icetScanChannelColor(tile->color, color_format,
+                                    tile->color_stride, num_pixels, active);
     }
 
-    if (   (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE)
-        || (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT)
-        || (color_format == ICET_IMAGE_COLOR_NONE) ) {
-        icetStateSetInteger(ICET_COLOR_FORMAT, color_format);
+    /* Blended images have no depth, so the colors are contiguous. */
+    if (!active) {
+        switch (color_format) {
+          case ICET_IMAGE_COLOR_RGBA_UBYTE:
+              return icetScanInactiveColorub((const IceTUInt *)tile->color,
+                                             num_pixels);
+          case ICET_IMAGE_COLOR_RGBA_FLOAT:
+              return icetScanInactiveColorf((const IceTFloat *)tile->color,
+                                            num_pixels);
+          default:
+              return icetScanInactiveColorus((const IceTUShort *)tile->color,
+                                             num_pixels);
+        }
+    }
+    pixel = 0;
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        const IceTUByte *color = (const IceTUByte *)tile->color;
+        while ((pixel < num_pixels) && (color[4*pixel+3] != 0x00)) {
+            pixel++;
+        }
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        const IceTFloat *color = (const IceTFloat *)tile->color;
+        while ((pixel < num_pixels) && (color[4*pixel+3] != 0.0)) {
+            pixel++;
+        }
     } else {
-        icetRaiseError("Invalid IceT color format.", ICET_INVALID_ENUM);
+        const IceTUShort *color = (const IceTUShort *)tile->color;
+        while ((pixel < num_pixels) && ((color[4*pixel+3] & 0x7FFF) != 0)) {
+            pixel++;
+        }
     }
+    return pixel;
 }
 
-void icetSetDepthFormat(IceTEnum depth_format)
+void icetCompressedMultiComposite(const IceTSparseImage *images,
+                                  IceTInt num_images,
+                                  IceTSparseImage dest_buffer)
 {
-    IceTBoolean isDrawing;
+    IceTEnum composite_mode;
+    IceTEnum color_format;
+    IceTEnum depth_format;
+    IceTCompositeSpanFunc composite_span;
+    IceTSizeType color_size;
+    IceTSizeType depth_size;
+    IceTSizeType pixel_size;
+    IceTMultiCompositeCursor *cursors;
+    IceTByte *tile_buffer;
+    IceTPixelSpan tile;
+    IceTInt image_index;
+    IceTSizeType num_pixels;
+    IceTSizeType pixel;
+    /* Use IceTByte for byte-based pointer arithmetic. */
+    IceTByte *dest;
+    IceTVoid *dest_runlengths;
+    IceTSizeType dest_num_active;
+    IceTSizeType dest_num_inactive;
+    IceTSizeType dest_inactive_start;
+    IceTPixelSpan dest_span;
+    IceTSeekIndexBuilder dest_index;
+    IceTBoolean dest_compact;
+    IceTBoolean dest_planar;
+    IceTSizeType dest_max_run_length;
+    IceTBoolean corrupt = ICET_FALSE;
+    /* The depths of a planar run being written go here until the run is
+       closed and they can be placed after the colors. */
+    IceTByte dest_depths[MAX_PLANAR_RUN_LENGTH*MAX_PLANAR_DEPTH_SIZE];
+
+    if (num_images < 1) {
+        icetRaiseError("No images given to composite.", ICET_INVALID_VALUE);
+        return;
+    }
+    if (num_images == 2) {
+        icetCompressedCompressedComposite(images[0], images[1], dest_buffer);
+        return;
+    }
 
-    icetGetBooleanv(ICET_IS_DRAWING_FRAME, &isDrawing);
-    if (isDrawing) {
-        icetRaiseError("Attempted to change the depth format while drawing."
-                       " This probably means that you called icetSetDepthFormat"
-                       " in a drawing callback. You cannot do that. Call this"
-                       " function before starting the draw operation.",
-                       ICET_INVALID_OPERATION);
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    color_format = icetSparseImageGetColorFormat(dest_buffer);
+    depth_format = icetSparseImageGetDepthFormat(dest_buffer);
+    num_pixels = icetSparseImageGetNumPixels(images[0]);
+    for (image_index = 0; image_index < num_images; image_index++) {
+        const IceTSparseImage image = images[image_index];
+        if (   (color_format != icetSparseImageGetColorFormat(image))
+            || (depth_format != icetSparseImageGetDepthFormat(image))
+            || (num_pixels != icetSparseImageGetNumPixels(image)) ) {
+            icetRaiseError("Input buffers do not agree for multi-image"
+                           " composite.",
+                           ICET_SANITY_CHECK_FAIL);
+            return;
+        }
+        if (ICET_SPARSE_IMAGE_BLOCKS(image)) {
+            icetRaiseError("Sparse images in the block layout can only be"
+                           " composited two at a time.",
+                           ICET_INVALID_OPERATION);
+            return;
+        }
+    }
+    composite_span = icetGetCompositeSpan(color_format, depth_format);
+    if (composite_span == NULL) {
+        if (icetCompositeSpanError(color_format, depth_format)) {
+            icetClearSparseImage(dest_buffer);
+        }
         return;
     }
 
-    if (   (depth_format == ICET_IMAGE_DEPTH_FLOAT)
-        || (depth_format == ICET_IMAGE_DEPTH_NONE) ) {
-        icetStateSetInteger(ICET_DEPTH_FORMAT, depth_format);
-    } else {
-        icetRaiseError("Invalid IceT depth format.", ICET_INVALID_ENUM);
+    icetTimingBlendBegin();
+
+    color_size = colorPixelSize(color_format);
+    depth_size = depthPixelSize(depth_format);
+    pixel_size = color_size + depth_size;
+
+    tile_buffer = icetGetStateBuffer(
+                      ICET_MULTI_COMPOSITE_BUF,
+                      ICET_MULTI_COMPOSITE_TILE*pixel_size
+                      + num_images*sizeof(IceTMultiCompositeCursor));
+    cursors = (IceTMultiCompositeCursor *)(  tile_buffer
+                                           + ICET_MULTI_COMPOSITE_TILE
+                                             *pixel_size);
+    for (image_index = 0; image_index < num_images; image_index++) {
+        IceTMultiCompositeCursor *cursor = &cursors[image_index];
+        cursor->next = ICET_IMAGE_DATA(images[image_index]);
+        cursor->num_inactive = cursor->num_active = 0;
+        cursor->compact = ICET_SPARSE_IMAGE_COMPACT(images[image_index]);
+        cursor->planar = ICET_SPARSE_IMAGE_PLANAR(images[image_index]);
+        cursor->span.color = cursor->span.depth = NULL;
+        cursor->span.color_stride = cursor->planar ? color_size : pixel_size;
+        cursor->span.depth_stride = cursor->planar ? depth_size : pixel_size;
     }
-}
 
-void icetGetTileImage(IceTInt tile, IceTImage image)
-{
-    IceTInt screen_viewport[4], target_viewport[4];
-    const IceTInt *viewports;
-    IceTSizeType width, height;
-    IceTImage rendered_image;
+    icetSparseImageSetDimensions(dest_buffer,
+                                 icetSparseImageGetWidth(images[0]),
+                                 icetSparseImageGetHeight(images[0]));
+    dest_compact = ICET_SPARSE_IMAGE_COMPACT(dest_buffer);
+    dest_planar = ICET_SPARSE_IMAGE_PLANAR(dest_buffer);
+    dest_max_run_length = MAX_ACTIVE_RUN_LENGTH_OF(dest_compact, dest_planar);
+    dest_span.color_stride = dest_planar ? color_size : pixel_size;
+    dest_span.depth_stride = dest_planar ? depth_size : pixel_size;
+    /* The tile has the same layout as the destination so that the fastest
+       kernels can be used and the tile can be copied straight to it. */
+    tile.color = tile_buffer;
+    tile.depth = (  dest_planar
+                  ? tile_buffer + ICET_MULTI_COMPOSITE_TILE*color_size
+                  : tile_buffer + color_size );
+    tile.color_stride = dest_span.color_stride;
+    tile.depth_stride = dest_span.depth_stride;
+    dest = ICET_IMAGE_DATA(dest_buffer);
+    dest_runlengths = NULL;
+    dest_num_active = 0;
+    dest_num_inactive = 0;
+    dest_inactive_start = 0;
+    icetSeekIndexBegin(dest_buffer, &dest_index);
+
+/* Closes the current destination run (if any) with its active pixels. */
+#define MULTI_CLOSE_DEST_RUN()                                          \
+    if (dest_runlengths != NULL) {                                      \
+        SET_ACTIVE_RUN_LENGTH(dest_runlengths,                          \
+                              dest_compact,                             \
+                              dest_num_active);                         \
+        if (dest_planar) {                                              \
+            memcpy(dest, dest_depths, dest_num_active*depth_size);      \
+            dest += dest_num_active*depth_size;                         \
+        }                                                               \
+        dest_num_active = 0;                                            \
+    }
 
-    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
-    width = viewports[4*tile+2];
-    height = viewports[4*tile+3];
-    icetImageSetDimensions(image, width, height);
+/* Starts a destination run with the inactive pixels seen since the last
+   active pixel. */
+#define MULTI_START_DEST_RUN()                                          \
+    MULTI_CLOSE_DEST_RUN();                                             \
+    SEEK_INDEX_ADD_RUN(&dest_index, dest, dest_inactive_start);         \
+    dest_runlengths = icetSparseImageStartRun(dest,                     \
+                                              dest_num_inactive,        \
+                                              dest_compact);            \
+    dest = (IceTByte *)dest_runlengths + RUN_LENGTH_SIZE_OF(dest_compact);\
+    dest_num_inactive = 0;
+
+    pixel = 0;
+    while ((pixel < num_pixels) && !corrupt) {
+        IceTSizeType num_tile_pixels;
+        IceTSizeType tile_pixel;
+
+        /* Skip right over pixels that are inactive in every image. */
+        {
+            IceTSizeType num_skip = num_pixels - pixel;
+            for (image_index = 0; image_index < num_images; image_index++) {
+                IceTMultiCompositeCursor *cursor = &cursors[image_index];
+                MULTI_LOAD_RUN(cursor, pixel);
+                num_skip = MIN(num_skip, cursor->num_inactive);
+            }
+            if (num_skip > 0) {
+                if (dest_num_inactive == 0) {
+                    dest_inactive_start = pixel;
+                }
+                dest_num_inactive += num_skip;
+                for (image_index = 0; image_index < num_images; image_index++) {
+                    cursors[image_index].num_inactive -= num_skip;
+                }
+                pixel += num_skip;
+                continue;
+            }
+        }
 
-    rendered_image = renderTile(tile, screen_viewport, target_viewport, image);
+        /* Composite each image into the tile from back to front.  A pixel
+           only replaces one already in the tile if it is strictly in front,
+           just as when compositing the images two at a time. */
+        num_tile_pixels = MIN(ICET_MULTI_COMPOSITE_TILE, num_pixels - pixel);
+        if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
+            IceTByte *depth = tile.depth;
+            for (tile_pixel = 0; tile_pixel < num_tile_pixels; tile_pixel++) {
+                if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+                    *(IceTFloat *)depth = 1.0f;
+                } else {
+                    *(IceTUShort *)depth = ICET_UNORM16_FAR_DEPTH;
+                }
+                depth += tile.depth_stride;
+            }
+        } else {
+            memset(tile.color, 0, num_tile_pixels*color_size);
+        }
+        for (image_index = num_images - 1; image_index >= 0; image_index--) {
+            IceTMultiCompositeCursor *cursor = &cursors[image_index];
+            tile_pixel = 0;
+            while (tile_pixel < num_tile_pixels) {
+                IceTSizeType count;
+                MULTI_LOAD_RUN(cursor, pixel + tile_pixel);
+                if (cursor->num_inactive > 0) {
+                    count = MIN(cursor->num_inactive,
+                                num_tile_pixels - tile_pixel);
+                    cursor->num_inactive -= count;
+                } else if (cursor->num_active > 0) {
+                    IceTPixelSpan tile_span;
+                    count = MIN(cursor->num_active,
+                                num_tile_pixels - tile_pixel);
+                    tile_span = tile;
+                    tile_span.color += tile_pixel*tile.color_stride;
+                    tile_span.depth += tile_pixel*tile.depth_stride;
+                    composite_span(&cursor->span, &tile_span, &tile_span,
+                                   count);
+                    cursor->span.color += count*cursor->span.color_stride;
+                    cursor->span.depth += count*cursor->span.depth_stride;
+                    cursor->num_active -= count;
+                } else {
+                    /* The image ran out of runs before the last pixel. */
+                    corrupt = ICET_TRUE;
+                    break;
+                }
+                tile_pixel += count;
+            }
+        }
 
-    icetTimingBufferReadBegin();
+        /* Write the active pixels of the tile as runs. */
+        tile_pixel = 0;
+        while (tile_pixel < num_tile_pixels) {
+            IceTPixelSpan tile_span;
+            IceTSizeType count;
+
+            tile_span = tile;
+            tile_span.color += tile_pixel*tile.color_stride;
+            tile_span.depth += tile_pixel*tile.depth_stride;
+            count = icetMultiCompositeScan(composite_mode,
+                                           color_format,
+                                           depth_format,
+                                           &tile_span,
+                                           num_tile_pixels - tile_pixel,
+                                           ICET_FALSE);
+            if (count > 0) {
+                if (dest_num_inactive == 0) {
+                    dest_inactive_start = pixel + tile_pixel;
+                }
+                dest_num_inactive += count;
+                tile_pixel += count;
+                continue;
+            }
 
-    if (icetImageEqual(rendered_image, image)) {
-      /* Check to make sure the screen and target viewports are also equal. */
-        if (    (screen_viewport[0] != target_viewport[0])
-             || (screen_viewport[1] != target_viewport[1])
-             || (screen_viewport[2] != target_viewport[2])
-             || (screen_viewport[3] != target_viewport[3]) ) {
-            icetRaiseError("Inconsistent values returned from renderTile.",
-                           ICET_SANITY_CHECK_FAIL);
+            count = icetMultiCompositeScan(composite_mode,
+                                           color_format,
+                                           depth_format,
+                                           &tile_span,
+                                           num_tile_pixels - tile_pixel,
+                                           ICET_TRUE);
+            tile_pixel += count;
+            while (count > 0) {
+                IceTSizeType num_to_copy;
+                if (   (dest_num_inactive > 0)
+                    || (dest_runlengths == NULL)
+                    || (dest_num_active >= dest_max_run_length) ) {
+                    if (dest_num_inactive == 0) {
+                        dest_inactive_start
+                            = pixel + tile_pixel - count;
+                    }
+                    MULTI_START_DEST_RUN();
+                }
+                num_to_copy = MIN(count, dest_max_run_length-dest_num_active);
+                dest_span.color = dest;
+                dest_span.depth = (  dest_planar
+                                   ? dest_depths + dest_num_active*depth_size
+                                   : dest + color_size );
+                icetCopyPixelSpan(&tile_span, &dest_span,
+                                  color_size, depth_size, num_to_copy);
+                tile_span.color += num_to_copy*tile.color_stride;
+                tile_span.depth += num_to_copy*tile.depth_stride;
+                dest += num_to_copy*dest_span.color_stride;
+                dest_num_active += num_to_copy;
+                count -= num_to_copy;
+            }
         }
-    } else {
-      /* Copy the appropriate part of the image to the output buffer. */
-        icetImageCopyRegion(rendered_image, screen_viewport,
-                            image, target_viewport);
+
+        pixel += num_tile_pixels;
     }
 
-    icetImageClearAroundRegion(image, target_viewport);
+    if (dest_num_inactive > 0) {
+        MULTI_START_DEST_RUN();
+    }
+    MULTI_CLOSE_DEST_RUN();
+#undef MULTI_CLOSE_DEST_RUN
+#undef MULTI_START_DEST_RUN
+
+    if (corrupt || (pixel != num_pixels)) {
+        icetRaiseError("Corrupt compressed image.", ICET_INVALID_VALUE);
+    }
+
+    icetSparseImageSetActualSize(dest_buffer, dest);
+    icetSeekIndexEnd(&dest_index);
 
-    icetTimingBufferReadEnd();
+    icetTimingBlendEnd();
 }
 
-void icetGetCompressedTileImage(IceTInt tile, IceTSparseImage compressed_image)
+#undef MULTI_LOAD_RUN
+
+void icetCompressImageBlocks(const IceTImage image,
+                             IceTSparseImage compressed_image)
 {
-    IceTInt screen_viewport[4], target_viewport[4];
-    IceTImage raw_image;
-    const IceTInt *viewports;
-    IceTSizeType width, height;
-    IceTSizeType space_left, space_right, space_bottom, space_top;
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
+    IceTEnum composite_mode;
+    IceTSizeType width = icetImageGetWidth(image);
+    IceTSizeType height = icetImageGetHeight(image);
+    IceTSizeType color_size = colorPixelSize(color_format);
+    IceTSizeType depth_size = depthPixelSize(depth_format);
+    IceTSizeType blocks_across = BLOCK_COUNT(width);
+    IceTSizeType num_blocks = blocks_across*BLOCK_COUNT(height);
+    IceTSizeType num_words = BLOCK_BITMAP_WORDS(num_blocks);
+    const IceTByte *in_color;
+    const IceTByte *in_depth;
+    IceTUInt *bitmap;
+    IceTByte *out_data;
+    IceTBoolean test_depth;
+    IceTSizeType block;
 
-    viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
-    width = viewports[4*tile+2];
-    height = viewports[4*tile+3];
-    icetSparseImageSetDimensions(compressed_image, width, height);
+    ICET_TEST_IMAGE_HEADER(image);
+    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
 
-    raw_image = renderTile(tile, screen_viewport, target_viewport,
-                           icetImageNull());
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    if (composite_mode == ICET_COMPOSITE_MODE_FRAGMENTS) {
+        icetRaiseError("The block layout does not hold fragments.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
 
-    if ((target_viewport[2] < 1) || (target_viewport[3] < 1)) {
-        /* Tile empty.  Just clear result. */
-        icetClearSparseImage(compressed_image);
+    if (   (color_format != icetSparseImageGetColorFormat(compressed_image))
+        || (depth_format != icetSparseImageGetDepthFormat(compressed_image)) ) {
+        icetRaiseError("Format of input and output to compress do not match.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+
+    test_depth = (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER);
+    if (test_depth && (depth_format == ICET_IMAGE_DEPTH_NONE)) {
+        icetRaiseError("Cannot use Z buffer compression with no"
+                       " Z buffer.", ICET_INVALID_OPERATION);
         return;
     }
 
-    space_left = target_viewport[0];
-    space_right = width - target_viewport[2] - space_left;
-    space_bottom = target_viewport[1];
-    space_top = height - target_viewport[3] - space_bottom;
+    icetTimingCompressBegin();
 
     icetSparseImageSetDimensions(compressed_image, width, height);
+    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_FLAGS_INDEX]
+        |= ICET_SPARSE_IMAGE_BLOCK_LAYOUT;
+
+    in_color = (const IceTByte *)icetImageGetColorConstVoid(image, NULL);
+    in_depth = (const IceTByte *)icetImageGetDepthConstVoid(image, NULL);
+    bitmap = ICET_IMAGE_DATA(compressed_image);
+    memset(bitmap, 0, num_words*sizeof(IceTUInt));
+    out_data = (IceTByte *)(bitmap + num_words);
+
+    for (block = 0; block < num_blocks; block++) {
+        IceTSizeType x = (block%blocks_across)*BLOCK_SIZE;
+        IceTSizeType y = (block/blocks_across)*BLOCK_SIZE;
+        IceTSizeType block_width = MIN(BLOCK_SIZE, width - x);
+        IceTSizeType block_height = MIN(BLOCK_SIZE, height - y);
+        IceTSizeType block_pixels = block_width*block_height;
+        IceTSizeType row;
+        IceTSizeType pixel;
+
+        for (row = 0; row < block_height; row++) {
+            if (icetImageSpanActive(image, test_depth,
+                                    (y + row)*width + x, block_width)) {
+                break;
+            }
+        }
+        if (row == block_height) { continue; }
+
+        bitmap[block/32] |= (IceTUInt)0x1 << (block%32);
+        for (row = 0; row < block_height; row++) {
+            IceTSizeType in_pixel = (y + row)*width + x;
+            memcpy(out_data + row*block_width*color_size,
+                   in_color + in_pixel*color_size,
+                   block_width*color_size);
+            memcpy(out_data + block_pixels*color_size
+                            + row*block_width*depth_size,
+                   in_depth + in_pixel*depth_size,
+                   block_width*depth_size);
+        }
 
-#define INPUT_IMAGE             raw_image
-#define OUTPUT_SPARSE_IMAGE     compressed_image
-#define PADDING
-#define SPACE_BOTTOM            space_bottom
-#define SPACE_TOP               space_top
-#define SPACE_LEFT              space_left
-#define SPACE_RIGHT             space_right
-#define FULL_WIDTH              width
-#define FULL_HEIGHT             height
-#define REGION
-#define REGION_OFFSET_X         screen_viewport[0]
-#define REGION_OFFSET_Y         screen_viewport[1]
-#define REGION_WIDTH            screen_viewport[2]
-#define REGION_HEIGHT           screen_viewport[3]
-#include "compress_func_body.h"
-}
+        if (!test_depth) {
+          /* Clear the colors of inactive pixels so that blending a block
+             leaves them as if they were never there. */
+            for (pixel = 0; pixel < block_pixels; pixel++) {
+                IceTByte *color = out_data + pixel*color_size;
+                if (icetColorPixelInactive(composite_mode,
+                                           color_format,
+                                           color)) {
+                    memset(color, 0, color_size);
+                }
+            }
+        }
 
-void icetCompressImage(const IceTImage image,
-                       IceTSparseImage compressed_image)
-{
-    icetCompressSubImage(image, 0, icetImageGetNumPixels(image),
-                         compressed_image);
+        out_data += block_pixels*(color_size + depth_size);
+    }
 
-  /* This is a hack to get the width/height of the compressed image to agree
-     with the original image. */
-    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_WIDTH_INDEX]
-        = (IceTInt)icetImageGetWidth(image);
-    ICET_IMAGE_HEADER(compressed_image)[ICET_IMAGE_HEIGHT_INDEX]
-        = (IceTInt)icetImageGetHeight(image);
+    icetSparseImageSetActualSize(compressed_image, out_data);
+
+    icetTimingCompressEnd();
 }
 
-void icetCompressSubImage(const IceTImage image,
-                          IceTSizeType offset, IceTSizeType pixels,
-                          IceTSparseImage compressed_image)
+static void icetDecompressImageBlocks(const IceTSparseImage compressed_image,
+                                      IceTImage image)
 {
+    IceTEnum color_format = icetSparseImageGetColorFormat(compressed_image);
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(compressed_image);
+    IceTEnum composite_mode;
+    IceTSizeType width = icetSparseImageGetWidth(compressed_image);
+    IceTSizeType height = icetSparseImageGetHeight(compressed_image);
+    IceTSizeType color_size = colorPixelSize(color_format);
+    IceTSizeType depth_size = depthPixelSize(depth_format);
+    IceTSizeType blocks_across = BLOCK_COUNT(width);
+    IceTSizeType num_blocks = blocks_across*BLOCK_COUNT(height);
+    const IceTUInt *bitmap;
+    const IceTByte *in_data;
+    IceTByte *out_color;
+    IceTByte *out_depth;
+    IceTBoolean test_depth;
+    IceTSizeType block;
+
     ICET_TEST_IMAGE_HEADER(image);
     ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
 
-    icetSparseImageSetDimensions(compressed_image, pixels, 1);
+    if (   (color_format != icetImageGetColorFormat(image))
+        || (depth_format != icetImageGetDepthFormat(image)) ) {
+        icetRaiseError("Input/output buffers have different formats.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
 
-#define INPUT_IMAGE             image
-#define OUTPUT_SPARSE_IMAGE     compressed_image
-#define OFFSET                  offset
-#define PIXEL_COUNT             pixels
-#include "compress_func_body.h"
-}
+    icetTimingCompressBegin();
 
-void icetDecompressImage(const IceTSparseImage compressed_image,
-                         IceTImage image)
-{
-    icetImageSetDimensions(image,
-                           icetSparseImageGetWidth(compressed_image),
-                           icetSparseImageGetHeight(compressed_image));
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    test_depth = (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER);
 
-    icetDecompressSubImage(compressed_image, 0, image);
-}
+    icetImageSetDimensions(image, width, height);
+    icetClearImage(image);
+
+    out_color = icetImageGetColorVoid(image, NULL);
+    out_depth = icetImageGetDepthVoid(image, NULL);
+    bitmap = ICET_IMAGE_DATA(compressed_image);
+    in_data = (const IceTByte *)(bitmap + BLOCK_BITMAP_WORDS(num_blocks));
+
+    for (block = 0; block < num_blocks; block++) {
+        IceTSizeType x = (block%blocks_across)*BLOCK_SIZE;
+        IceTSizeType y = (block/blocks_across)*BLOCK_SIZE;
+        IceTSizeType block_width = MIN(BLOCK_SIZE, width - x);
+        IceTSizeType block_height = MIN(BLOCK_SIZE, height - y);
+        IceTSizeType block_pixels = block_width*block_height;
+        const IceTByte *in_color = in_data;
+        const IceTByte *in_depth = in_data + block_pixels*color_size;
+        IceTSizeType pixel;
+
+        if (!BLOCK_IS_SET(bitmap, block)) { continue; }
+
+      /* Inactive pixels keep the background left by icetClearImage. */
+        for (pixel = 0; pixel < block_pixels; pixel++) {
+            IceTSizeType out_pixel = (  (y + pixel/block_width)*width
+                                      + x + pixel%block_width );
+            if (  test_depth
+                ? icetDepthPixelInactive(depth_format,
+                                         in_depth + pixel*depth_size)
+                : icetColorPixelInactive(composite_mode,
+                                         color_format,
+                                         in_color + pixel*color_size) ) {
+                continue;
+            }
+            memcpy(out_color + out_pixel*color_size,
+                   in_color + pixel*color_size,
+                   color_size);
+            memcpy(out_depth + out_pixel*depth_size,
+                   in_depth + pixel*depth_size,
+                   depth_size);
+        }
 
-void icetDecompressSubImage(const IceTSparseImage compressed_image,
-                            IceTSizeType offset,
-                            IceTImage image)
-{
-    ICET_TEST_IMAGE_HEADER(image);
-    ICET_TEST_SPARSE_IMAGE_HEADER(compressed_image);
+        in_data += block_pixels*(color_size + depth_size);
+    }
 
-#define INPUT_SPARSE_IMAGE      compressed_image
-#define OUTPUT_IMAGE            image
-#define TIME_DECOMPRESSION
-#define OFFSET                  offset
-#define PIXEL_COUNT             icetSparseImageGetNumPixels(compressed_image)
-#include "decompress_func_body.h"
+    icetTimingCompressEnd();
 }
 
-
-void icetComposite(IceTImage destBuffer, const IceTImage srcBuffer,
-                   int srcOnTop)
+static void icetCompressedCompositeBlocks(IceTImage destBuffer,
+                                          const IceTSparseImage srcBuffer,
+                                          int srcOnTop)
 {
-    IceTSizeType pixels;
-    IceTSizeType i;
+    IceTEnum color_format = icetSparseImageGetColorFormat(srcBuffer);
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(srcBuffer);
     IceTEnum composite_mode;
-    IceTEnum color_format, depth_format;
-
-    pixels = icetImageGetNumPixels(destBuffer);
-    if (pixels != icetImageGetNumPixels(srcBuffer)) {
-        icetRaiseError("Source and destination sizes don't match.",
+    IceTSizeType width = icetSparseImageGetWidth(srcBuffer);
+    IceTSizeType height = icetSparseImageGetHeight(srcBuffer);
+    IceTSizeType color_size = colorPixelSize(color_format);
+    IceTSizeType depth_size = depthPixelSize(depth_format);
+    IceTSizeType blocks_across = BLOCK_COUNT(width);
+    IceTSizeType num_blocks = blocks_across*BLOCK_COUNT(height);
+    IceTCompositeSpanFunc composite_span;
+    const IceTUInt *bitmap;
+    const IceTByte *in_data;
+    IceTByte *image_color;
+    IceTByte *image_depth;
+    IceTSizeType block;
+
+    if (   (color_format != icetImageGetColorFormat(destBuffer))
+        || (depth_format != icetImageGetDepthFormat(destBuffer)) ) {
+        icetRaiseError("Input/output buffers have different formats.",
                        ICET_SANITY_CHECK_FAIL);
         return;
     }
-
-    color_format = icetImageGetColorFormat(destBuffer);
-    depth_format = icetImageGetDepthFormat(destBuffer);
-
-    if (   (color_format != icetImageGetColorFormat(srcBuffer))
-        || (depth_format != icetImageGetDepthFormat(srcBuffer)) ) {
-        icetRaiseError("Source and destination types don't match.",
-                       ICET_SANITY_CHECK_FAIL);
+    if (   (width != icetImageGetWidth(destBuffer))
+        || (height != icetImageGetHeight(destBuffer)) ) {
+        icetRaiseError("Size of input and output buffers do not agree.",
+                       ICET_INVALID_VALUE);
         return;
     }
 
     icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
 
-    icetTimingBlendBegin();
+  /* Only the z-buffer test uses the depths.  Otherwise, the depth of the
+     image is kept. */
+    composite_span = icetGetCompositeSpan(
+              color_format,
+              (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER)
+              ? depth_format : ICET_IMAGE_DEPTH_NONE);
+    if (composite_span == NULL) {
+        icetCompositeSpanError(color_format, depth_format);
+        return;
+    }
 
-    if (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) {
-        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
-            const IceTFloat *srcDepthBuffer = icetImageGetDepthf(srcBuffer);
-            IceTFloat *destDepthBuffer = icetImageGetDepthf(destBuffer);
+    icetTimingBlendBegin();
 
-            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
-                const IceTUInt *srcColorBuffer=icetImageGetColorui(srcBuffer);
-                IceTUInt *destColorBuffer = icetImageGetColorui(destBuffer);
-                for (i = 0; i < pixels; i++) {
-                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
-                        destDepthBuffer[i] = srcDepthBuffer[i];
-                        destColorBuffer[i] = srcColorBuffer[i];
-                    }
-                }
-            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
-                const IceTFloat *srcColorBuffer = icetImageGetColorf(srcBuffer);
-                IceTFloat *destColorBuffer = icetImageGetColorf(destBuffer);
-                for (i = 0; i < pixels; i++) {
-                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
-                        destDepthBuffer[i] = srcDepthBuffer[i];
-                        destColorBuffer[4*i+0] = srcColorBuffer[4*i+0];
-                        destColorBuffer[4*i+1] = srcColorBuffer[4*i+1];
-                        destColorBuffer[4*i+2] = srcColorBuffer[4*i+2];
-                        destColorBuffer[4*i+3] = srcColorBuffer[4*i+3];
-                    }
-                }
-            } else if (color_format == ICET_IMAGE_COLOR_NONE) {
-                for (i = 0; i < pixels; i++) {
-                    if (srcDepthBuffer[i] < destDepthBuffer[i]) {
-                        destDepthBuffer[i] = srcDepthBuffer[i];
-                    }
-                }
-            } else {
-                icetRaiseError("Encountered invalid color format.",
-                               ICET_SANITY_CHECK_FAIL);
-            }
-        } else if (depth_format == ICET_IMAGE_DEPTH_NONE) {
-            icetRaiseError("Cannot use Z buffer compositing operation with no"
-                           " Z buffer.", ICET_INVALID_OPERATION);
-        } else {
-            icetRaiseError("Encountered invalid depth format.",
-                           ICET_SANITY_CHECK_FAIL);
-        }
-    } else if (composite_mode == ICET_COMPOSITE_MODE_BLEND) {
-        if (depth_format != ICET_IMAGE_DEPTH_NONE) {
-            icetRaiseWarning("Z buffer ignored during blend composite"
-                             " operation.  Output z buffer meaningless.",
-                             ICET_INVALID_VALUE);
-        }
-        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
-            const IceTUByte *srcColorBuffer = icetImageGetColorcub(srcBuffer);
-            IceTUByte *destColorBuffer = icetImageGetColorub(destBuffer);
-            if (srcOnTop) {
-                for (i = 0; i < pixels; i++) {
-                    ICET_OVER_UBYTE(srcColorBuffer + i*4,
-                                    destColorBuffer + i*4);
-                }
-            } else {
-                for (i = 0; i < pixels; i++) {
-                    ICET_UNDER_UBYTE(srcColorBuffer + i*4,
-                                     destColorBuffer + i*4);
-                }
-            }
-        } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
-            const IceTFloat *srcColorBuffer = icetImageGetColorcf(srcBuffer);
-            IceTFloat *destColorBuffer = icetImageGetColorf(destBuffer);
-            if (srcOnTop) {
-                for (i = 0; i < pixels; i++) {
-                    ICET_OVER_FLOAT(srcColorBuffer + i*4,
-                                    destColorBuffer + i*4);
-                }
+    image_color = icetImageGetColorVoid(destBuffer, NULL);
+    image_depth = icetImageGetDepthVoid(destBuffer, NULL);
+    bitmap = ICET_IMAGE_DATA(srcBuffer);
+    in_data = (const IceTByte *)(bitmap + BLOCK_BITMAP_WORDS(num_blocks));
+
+    for (block = 0; block < num_blocks; block++) {
+        IceTSizeType x = (block%blocks_across)*BLOCK_SIZE;
+        IceTSizeType y = (block/blocks_across)*BLOCK_SIZE;
+        IceTSizeType block_width = MIN(BLOCK_SIZE, width - x);
+        IceTSizeType block_height = MIN(BLOCK_SIZE, height - y);
+        IceTSizeType block_pixels = block_width*block_height;
+        IceTSizeType row;
+
+        if (!BLOCK_IS_SET(bitmap, block)) { continue; }
+
+        for (row = 0; row < block_height; row++) {
+            IceTSizeType image_pixel = (y + row)*width + x;
+            IceTPixelSpan src_span;
+            IceTPixelSpan image_span;
+
+            src_span.color
+                = (IceTByte *)in_data + row*block_width*color_size;
+            src_span.depth
+                = (IceTByte *)in_data + block_pixels*color_size
+                                      + row*block_width*depth_size;
+            src_span.color_stride = color_size;
+            src_span.depth_stride = depth_size;
+            image_span.color = image_color + image_pixel*color_size;
+            image_span.depth = image_depth + image_pixel*depth_size;
+            image_span.color_stride = color_size;
+            image_span.depth_stride = depth_size;
+
+          /* The z-buffer test does not depend on order, and a front pixel
+             only wins if it is strictly closer, so put the source in front
+             as icetCompressedSubComposite does. */
+            if (   srcOnTop
+                || (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) ) {
+                composite_span(&src_span, &image_span, &image_span,
+                               block_width);
             } else {
-                for (i = 0; i < pixels; i++) {
-                    ICET_UNDER_FLOAT(srcColorBuffer + i*4,
-                                     destColorBuffer + i*4);
-                }
+                composite_span(&image_span, &src_span, &image_span,
+                               block_width);
             }
-        } else if (color_format == ICET_IMAGE_COLOR_NONE) {
-            icetRaiseWarning("Compositing image with no data.",
-                             ICET_INVALID_OPERATION);
-        } else {
-            icetRaiseError("Encountered invalid color format.",
-                           ICET_SANITY_CHECK_FAIL);
         }
-    } else {
-        icetRaiseError("Encountered invalid composite mode.",
-                       ICET_SANITY_CHECK_FAIL);
+
+        in_data += block_pixels*(color_size + depth_size);
     }
 
     icetTimingBlendEnd();
 }
 
-void icetCompressedComposite(IceTImage destBuffer,
-                             const IceTSparseImage srcBuffer,
-                             int srcOnTop)
+static void icetCompressedCompressedCompositeBlocks(
+                                             const IceTSparseImage front_buffer,
+                                             const IceTSparseImage back_buffer,
+                                             IceTSparseImage dest_buffer)
 {
-    if (    icetImageGetNumPixels(destBuffer)
-         != icetSparseImageGetNumPixels(srcBuffer) ) {
-        icetRaiseError("Size of input and output buffers do not agree.",
+    IceTEnum color_format = icetSparseImageGetColorFormat(front_buffer);
+    IceTEnum depth_format = icetSparseImageGetDepthFormat(front_buffer);
+    IceTEnum composite_mode;
+    IceTSizeType width = icetSparseImageGetWidth(front_buffer);
+    IceTSizeType height = icetSparseImageGetHeight(front_buffer);
+    IceTSizeType color_size = colorPixelSize(color_format);
+    IceTSizeType depth_size = depthPixelSize(depth_format);
+    IceTSizeType blocks_across = BLOCK_COUNT(width);
+    IceTSizeType num_blocks = blocks_across*BLOCK_COUNT(height);
+    IceTSizeType num_words = BLOCK_BITMAP_WORDS(num_blocks);
+    IceTCompositeSpanFunc composite_span;
+    const IceTUInt *front_bitmap;
+    const IceTUInt *back_bitmap;
+    IceTUInt *dest_bitmap;
+    const IceTByte *front_data;
+    const IceTByte *back_data;
+    IceTByte *dest_data;
+    IceTSizeType block;
+
+    if (   !ICET_SPARSE_IMAGE_BLOCKS(front_buffer)
+        || !ICET_SPARSE_IMAGE_BLOCKS(back_buffer) ) {
+        icetRaiseError("Cannot composite a sparse image in the block layout"
+                       " with one of runs.",
+                       ICET_INVALID_OPERATION);
+        return;
+    }
+    if (   (color_format != icetSparseImageGetColorFormat(back_buffer))
+        || (color_format != icetSparseImageGetColorFormat(dest_buffer))
+        || (depth_format != icetSparseImageGetDepthFormat(back_buffer))
+        || (depth_format != icetSparseImageGetDepthFormat(dest_buffer)) ) {
+        icetRaiseError("Input buffers do not agree for compressed-compressed"
+                       " composite.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+    if (   (width != icetSparseImageGetWidth(back_buffer))
+        || (height != icetSparseImageGetHeight(back_buffer)) ) {
+        icetRaiseError("Size of input buffers do not agree.",
                        ICET_INVALID_VALUE);
+        return;
     }
-    icetCompressedSubComposite(destBuffer, 0, srcBuffer, srcOnTop);
-}
-void icetCompressedSubComposite(IceTImage destBuffer,
-                                IceTSizeType offset,
-                                const IceTSparseImage srcBuffer,
-                                int srcOnTop)
-{
-    icetTimingBlendBegin();
 
-    if (srcOnTop) {
-#define INPUT_SPARSE_IMAGE      srcBuffer
-#define OUTPUT_IMAGE            destBuffer
-#define OFFSET                  offset
-#define PIXEL_COUNT             icetSparseImageGetNumPixels(srcBuffer)
-#define COMPOSITE
-#define BLEND_RGBA_UBYTE        ICET_OVER_UBYTE
-#define BLEND_RGBA_FLOAT        ICET_OVER_FLOAT
-#include "decompress_func_body.h"
-    } else {
-#define INPUT_SPARSE_IMAGE      srcBuffer
-#define OUTPUT_IMAGE            destBuffer
-#define OFFSET                  offset
-#define PIXEL_COUNT             icetSparseImageGetNumPixels(srcBuffer)
-#define COMPOSITE
-#define BLEND_RGBA_UBYTE        ICET_UNDER_UBYTE
-#define BLEND_RGBA_FLOAT        ICET_UNDER_FLOAT
-#include "decompress_func_body.h"
-    }
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
 
-    icetTimingBlendEnd();
-}
+  /* Only the z-buffer test uses the depths.  Otherwise, the depth of the
+     back block is kept. */
+    composite_span = icetGetCompositeSpan(
+              color_format,
+              (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER)
+              ? depth_format : ICET_IMAGE_DEPTH_NONE);
+    if (composite_span == NULL) {
+        if (icetCompositeSpanError(color_format, depth_format)) {
+            icetClearSparseImage(dest_buffer);
+        }
+        return;
+    }
 
-void icetCompressedCompressedComposite(const IceTSparseImage front_buffer,
-                                       const IceTSparseImage back_buffer,
-                                       IceTSparseImage dest_buffer)
-{
     icetTimingBlendBegin();
 
-#define FRONT_SPARSE_IMAGE front_buffer
-#define BACK_SPARSE_IMAGE back_buffer
-#define DEST_SPARSE_IMAGE dest_buffer
-#include "cc_composite_func_body.h"
+    icetSparseImageSetDimensions(dest_buffer, width, height);
+    ICET_IMAGE_HEADER(dest_buffer)[ICET_IMAGE_FLAGS_INDEX]
+        |= ICET_SPARSE_IMAGE_BLOCK_LAYOUT;
+
+  /* A block of the result is set if it is set in either input. */
+    front_bitmap = ICET_IMAGE_DATA(front_buffer);
+    back_bitmap = ICET_IMAGE_DATA(back_buffer);
+    dest_bitmap = ICET_IMAGE_DATA(dest_buffer);
+    for (block = 0; block < num_words; block++) {
+        dest_bitmap[block] = front_bitmap[block] | back_bitmap[block];
+    }
+    front_data = (const IceTByte *)(front_bitmap + num_words);
+    back_data = (const IceTByte *)(back_bitmap + num_words);
+    dest_data = (IceTByte *)(dest_bitmap + num_words);
+
+    for (block = 0; block < num_blocks; block++) {
+        IceTSizeType x = (block%blocks_across)*BLOCK_SIZE;
+        IceTSizeType y = (block/blocks_across)*BLOCK_SIZE;
+        IceTSizeType block_pixels
+            = MIN(BLOCK_SIZE, width - x)*MIN(BLOCK_SIZE, height - y);
+        IceTSizeType block_size = block_pixels*(color_size + depth_size);
+        IceTBoolean in_front = BLOCK_IS_SET(front_bitmap, block);
+        IceTBoolean in_back = BLOCK_IS_SET(back_bitmap, block);
+
+        if (in_front && in_back) {
+          /* Blocks are planar, so each is composited as a single span. */
+            IceTPixelSpan front_span;
+            IceTPixelSpan back_span;
+            IceTPixelSpan dest_span;
+            front_span.color = (IceTByte *)front_data;
+            front_span.depth = (IceTByte *)front_data+block_pixels*color_size;
+            back_span.color = (IceTByte *)back_data;
+            back_span.depth = (IceTByte *)back_data + block_pixels*color_size;
+            dest_span.color = dest_data;
+            dest_span.depth = dest_data + block_pixels*color_size;
+            front_span.color_stride = back_span.color_stride
+                = dest_span.color_stride = color_size;
+            front_span.depth_stride = back_span.depth_stride
+                = dest_span.depth_stride = depth_size;
+            composite_span(&front_span, &back_span, &dest_span,
+                           block_pixels);
+            if (   (composite_mode != ICET_COMPOSITE_MODE_Z_BUFFER)
+                && (depth_size > 0) ) {
+                memcpy(dest_span.depth, back_span.depth,
+                       block_pixels*depth_size);
+            }
+            front_data += block_size;
+            back_data += block_size;
+        } else if (in_front) {
+            memcpy(dest_data, front_data, block_size);
+            front_data += block_size;
+        } else if (in_back) {
+            memcpy(dest_data, back_data, block_size);
+            back_data += block_size;
+        } else {
+            continue;
+        }
+        dest_data += block_size;
+    }
+
+    icetSparseImageSetActualSize(dest_buffer, dest_data);
 
     icetTimingBlendEnd();
 }
@@ -94,7 +94,8 @@ void icetStateCopy(IceTState dest, const IceTState src)
             || (pname == ICET_DATA_REPLICATION_GROUP)
             || (pname == ICET_DATA_REPLICATION_GROUP_SIZE)
             || (pname == ICET_COMPOSITE_ORDER)
-            || (pname == ICET_PROCESS_ORDERS) )
+            || (pname == ICET_PROCESS_ORDERS)
+            || (pname == ICET_PROCESS_NODES) )
         {
             continue;
         }
@@ -134,6 +135,9 @@ void icetStateSetDefaults(void)
     icetStateSetInteger(ICET_BACKGROUND_COLOR_WORD, 0);
     icetStateSetInteger(ICET_COLOR_FORMAT, ICET_IMAGE_COLOR_RGBA_UBYTE);
     icetStateSetInteger(ICET_DEPTH_FORMAT, ICET_IMAGE_DEPTH_FLOAT);
+    icetStateSetInteger(ICET_OUTPUT_BUFFER_FORMAT, ICET_IMAGE_COLOR_NONE);
+    icetStateSetInteger(ICET_OUTPUT_BUFFER_ROW_PITCH, 0);
+    icetStateSetPointer(ICET_OUTPUT_BUFFER, NULL);
 
     icetResetTiles();
     icetStateSetIntegerv(ICET_DISPLAY_NODES, 0, NULL);
@@ -185,6 +189,71 @@ void icetStateSetDefaults(void)
         icetStateSetInteger(ICET_MAX_IMAGE_SPLIT, ICET_MAX_IMAGE_SPLIT_DEFAULT);
     }
 
+    if (getenv("ICET_NUM_THREADS") != NULL) {
+        IceTInt num_threads = atoi(getenv("ICET_NUM_THREADS"));
+        if (num_threads > 0) {
+            icetStateSetInteger(ICET_NUM_THREADS, num_threads);
+        } else {
+            icetRaiseError("Environment variable ICET_NUM_THREADS must be"
+                           " set to an integer greater than 0.",
+                           ICET_INVALID_VALUE);
+            icetStateSetInteger(ICET_NUM_THREADS, 1);
+        }
+    } else {
+        icetStateSetInteger(ICET_NUM_THREADS, 1);
+    }
+
+    if (getenv("ICET_MESSAGE_CODEC_THRESHOLD") != NULL) {
+        IceTInt threshold = atoi(getenv("ICET_MESSAGE_CODEC_THRESHOLD"));
+        if (threshold >= 0) {
+            icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD, threshold);
+        } else {
+            icetRaiseError("Environment variable ICET_MESSAGE_CODEC_THRESHOLD"
+                           " must be set to a non-negative integer.",
+                           ICET_INVALID_VALUE);
+            icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD,
+                                ICET_MESSAGE_CODEC_THRESHOLD_DEFAULT);
+        }
+    } else {
+        icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD,
+                            ICET_MESSAGE_CODEC_THRESHOLD_DEFAULT);
+    }
+
+    if (getenv("ICET_MAX_FRAGMENTS") != NULL) {
+        IceTInt max_fragments = atoi(getenv("ICET_MAX_FRAGMENTS"));
+        if (   (max_fragments > 0)
+            && (max_fragments <= ICET_MAX_FRAGMENTS_LIMIT) ) {
+            icetStateSetInteger(ICET_MAX_FRAGMENTS, max_fragments);
+        } else {
+            icetRaiseError("Environment variable ICET_MAX_FRAGMENTS must be"
+                           " set to an integer from 1 to 16.",
+                           ICET_INVALID_VALUE);
+            icetStateSetInteger(ICET_MAX_FRAGMENTS,
+                                ICET_MAX_FRAGMENTS_DEFAULT);
+        }
+    } else {
+        icetStateSetInteger(ICET_MAX_FRAGMENTS, ICET_MAX_FRAGMENTS_DEFAULT);
+    }
+
+    if (getenv("ICET_RADIXK_CHUNK_SIZE") != NULL) {
+        IceTInt chunk_size = atoi(getenv("ICET_RADIXK_CHUNK_SIZE"));
+        if (chunk_size >= 0) {
+            icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE, chunk_size);
+        } else {
+            icetRaiseError("Environment variable ICET_RADIXK_CHUNK_SIZE must"
+                           " be set to a non-negative integer.",
+                           ICET_INVALID_VALUE);
+            icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE,
+                                ICET_RADIXK_CHUNK_SIZE_DEFAULT);
+        }
+    } else {
+        icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE,
+                            ICET_RADIXK_CHUNK_SIZE_DEFAULT);
+    }
+
+    icetStateSetInteger(ICET_RADIXK_TUNED_MAGIC_K, 0);
+    icetStateSetInteger(ICET_RADIXK_TUNED_MAX_IMAGE_SPLIT, 0);
+
     icetStateSetPointer(ICET_DRAW_FUNCTION, NULL);
     icetStateSetPointer(ICET_RENDER_LAYER_DESTRUCTOR, NULL);
 
@@ -194,6 +263,13 @@ void icetStateSetDefaults(void)
     icetEnable(ICET_COMPOSITE_ONE_BUFFER);
     icetEnable(ICET_INTERLACE_IMAGES);
     icetEnable(ICET_COLLECT_IMAGES);
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    icetDisable(ICET_MESSAGE_CODEC);
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+    icetDisable(ICET_INDEX_SPARSE_IMAGES);
+    icetDisable(ICET_OPACITY_CULLING);
+    icetDisable(ICET_NODE_AWARE_COMPOSITE);
+    icetDisable(ICET_RADIXK_AUTO_TUNE);
 
     icetStateSetBoolean(ICET_IS_DRAWING_FRAME, 0);
     icetStateSetBoolean(ICET_RENDER_BUFFER_SIZE, 0);
@@ -201,6 +277,9 @@ void icetStateSetDefaults(void)
     icetStateSetInteger(ICET_VALID_PIXELS_TILE, -1);
     icetStateSetInteger(ICET_VALID_PIXELS_OFFSET, 0);
     icetStateSetInteger(ICET_VALID_PIXELS_NUM, 0);
+    icetStateSetBoolean(ICET_OUTPUT_BUFFER_WRITTEN, 0);
+    icetStateSetBoolean(ICET_NEED_BACKGROUND_CORRECTION, 0);
+    icetStateSetBoolean(ICET_BACKGROUND_CORRECTED, 0);
 
     icetStateResetTiming();
 }
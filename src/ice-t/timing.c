@@ -34,6 +34,7 @@ void icetStateResetTiming(void)
     icetStateSetDouble(ICET_BUFFER_READ_TIME, 0.0);
     icetStateSetDouble(ICET_BUFFER_WRITE_TIME, 0.0);
     icetStateSetDouble(ICET_COMPRESS_TIME, 0.0);
+    icetStateSetDouble(ICET_CODEC_TIME, 0.0);
     icetStateSetDouble(ICET_BLEND_TIME, 0.0);
     icetStateSetDouble(ICET_COMPOSITE_TIME, 0.0);
     icetStateSetDouble(ICET_COLLECT_TIME, 0.0);
@@ -167,6 +168,21 @@ void icetTimingCompressEnd(void)
                   "compress");
 }
 
+void icetTimingCodecBegin(void)
+{
+    icetTimingBegin(ICET_SUBFUNC_START_TIME,
+                    ICET_SUBFUNC_TIME_ID,
+                    ICET_CODEC_TIME,
+                    "codec");
+}
+void icetTimingCodecEnd(void)
+{
+    icetTimingEnd(ICET_SUBFUNC_START_TIME,
+                  ICET_SUBFUNC_TIME_ID,
+                  ICET_CODEC_TIME,
+                  "codec");
+}
+
 void icetTimingBlendBegin(void)
 {
     icetTimingBegin(ICET_SUBFUNC_START_TIME,
@@ -273,6 +289,17 @@ static const IceTEventInfo *icetEventFind(IceTEnum pname)
         new_event->next = events;
         events = new_event;
 
+        new_event = malloc(sizeof(IceTEventInfo));
+        new_event->pname = ICET_CODEC_TIME;
+        MPE_Log_get_state_eventIDs(&new_event->mpe_event_begin,
+                                   &new_event->mpe_event_end);
+        MPE_Describe_state(new_event->mpe_event_begin,
+                           new_event->mpe_event_end,
+                           "message codec",
+                           "steel blue");
+        new_event->next = events;
+        events = new_event;
+
         new_event = malloc(sizeof(IceTEventInfo));
         new_event->pname = ICET_BLEND_TIME;
         MPE_Log_get_state_eventIDs(&new_event->mpe_event_begin,
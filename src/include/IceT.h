@@ -119,6 +119,11 @@ struct IceTCommunicatorStruct {
 
 typedef struct IceTCommunicatorStruct *IceTCommunicator;
 
+typedef int (*IceTCommNodeFunc)(IceTCommunicator self);
+
+ICET_EXPORT void icetCommunicatorSetNodeFunc(IceTCommunicator comm,
+                                             IceTCommNodeFunc node_func);
+
 ICET_EXPORT IceTDouble  icetWallTime(void);
 
 ICET_EXPORT IceTContext icetCreateContext(IceTCommunicator comm);
@@ -162,9 +167,11 @@ typedef struct { IceTVoid *opaque_internals; } IceTImage;
 
 #define ICET_IMAGE_COLOR_RGBA_UBYTE     (IceTEnum)0xC001
 #define ICET_IMAGE_COLOR_RGBA_FLOAT     (IceTEnum)0xC002
+#define ICET_IMAGE_COLOR_RGBA_HALF      (IceTEnum)0xC003
 #define ICET_IMAGE_COLOR_NONE           (IceTEnum)0xC000
 
 #define ICET_IMAGE_DEPTH_FLOAT          (IceTEnum)0xD001
+#define ICET_IMAGE_DEPTH_UNORM16        (IceTEnum)0xD002
 #define ICET_IMAGE_DEPTH_NONE           (IceTEnum)0xD000
 
 ICET_EXPORT void icetSetColorFormat(IceTEnum color_format);
@@ -180,11 +187,15 @@ ICET_EXPORT IceTSizeType icetImageGetNumPixels(const IceTImage image);
 ICET_EXPORT IceTUByte *icetImageGetColorub(IceTImage image);
 ICET_EXPORT IceTUInt *icetImageGetColorui(IceTImage image);
 ICET_EXPORT IceTFloat *icetImageGetColorf(IceTImage image);
+ICET_EXPORT IceTUShort *icetImageGetColorus(IceTImage image);
 ICET_EXPORT IceTFloat *icetImageGetDepthf(IceTImage image);
+ICET_EXPORT IceTUShort *icetImageGetDepthus(IceTImage image);
 ICET_EXPORT const IceTUByte *icetImageGetColorcub(const IceTImage image);
 ICET_EXPORT const IceTUInt *icetImageGetColorcui(const IceTImage image);
 ICET_EXPORT const IceTFloat *icetImageGetColorcf(const IceTImage image);
+ICET_EXPORT const IceTUShort *icetImageGetColorcus(const IceTImage image);
 ICET_EXPORT const IceTFloat *icetImageGetDepthcf(const IceTImage image);
+ICET_EXPORT const IceTUShort *icetImageGetDepthcus(const IceTImage image);
 ICET_EXPORT void icetImageCopyColorub(const IceTImage image,
                                       IceTUByte *color_buffer,
                                       IceTEnum color_format);
@@ -216,6 +227,9 @@ ICET_EXPORT const char *icetGetSingleImageStrategyName(void);
 
 #define ICET_COMPOSITE_MODE_Z_BUFFER    (IceTEnum)0x0301
 #define ICET_COMPOSITE_MODE_BLEND       (IceTEnum)0x0302
+#define ICET_COMPOSITE_MODE_FRAGMENTS   (IceTEnum)0x0303
+#define ICET_COMPOSITE_MODE_MAX_INTENSITY (IceTEnum)0x0304
+#define ICET_COMPOSITE_MODE_ADD         (IceTEnum)0x0305
 ICET_EXPORT void icetCompositeMode(IceTEnum mode);
 
 ICET_EXPORT void icetCompositeOrder(const IceTInt *process_ranks);
@@ -236,6 +250,10 @@ ICET_EXPORT IceTImage icetDrawFrame(const IceTDouble *projection_matrix,
                                     const IceTDouble *modelview_matrix,
                                     const IceTFloat *background_color);
 
+ICET_EXPORT void icetOutputBuffer(IceTEnum color_format,
+                                  IceTSizeType row_pitch,
+                                  IceTVoid *buffer);
+
 #define ICET_DIAG_OFF           (IceTEnum)0x0000
 #define ICET_DIAG_ERRORS        (IceTEnum)0x0001
 #define ICET_DIAG_WARNINGS      (IceTEnum)0x0003
@@ -259,6 +277,8 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_PHYSICAL_RENDER_HEIGHT (ICET_STATE_ENGINE_START| (IceTEnum)0x0008)
 #define ICET_COLOR_FORMAT       (ICET_STATE_ENGINE_START | (IceTEnum)0x0009)
 #define ICET_DEPTH_FORMAT       (ICET_STATE_ENGINE_START | (IceTEnum)0x000A)
+#define ICET_OUTPUT_BUFFER_FORMAT (ICET_STATE_ENGINE_START | (IceTEnum)0x000B)
+#define ICET_OUTPUT_BUFFER_ROW_PITCH (ICET_STATE_ENGINE_START|(IceTEnum)0x000C)
 
 #define ICET_NUM_TILES          (ICET_STATE_ENGINE_START | (IceTEnum)0x0010)
 #define ICET_TILE_VIEWPORTS     (ICET_STATE_ENGINE_START | (IceTEnum)0x0011)
@@ -279,12 +299,22 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_DATA_REPLICATION_GROUP (ICET_STATE_ENGINE_START | (IceTEnum)0x002C)
 #define ICET_DATA_REPLICATION_GROUP_SIZE (ICET_STATE_ENGINE_START | (IceTEnum)0x002D)
 #define ICET_FRAME_COUNT        (ICET_STATE_ENGINE_START | (IceTEnum)0x002E)
+#define ICET_PROCESS_NODES      (ICET_STATE_ENGINE_START | (IceTEnum)0x002F)
 
 #define ICET_MAGIC_K            (ICET_STATE_ENGINE_START | (IceTEnum)0x0040)
 #define ICET_MAX_IMAGE_SPLIT    (ICET_STATE_ENGINE_START | (IceTEnum)0x0041)
+#define ICET_NUM_THREADS        (ICET_STATE_ENGINE_START | (IceTEnum)0x0042)
+#define ICET_MESSAGE_CODEC_THRESHOLD (ICET_STATE_ENGINE_START|(IceTEnum)0x0043)
+#define ICET_MAX_FRAGMENTS      (ICET_STATE_ENGINE_START | (IceTEnum)0x0044)
+#define ICET_RADIXK_CHUNK_SIZE  (ICET_STATE_ENGINE_START | (IceTEnum)0x0045)
+#define ICET_RADIXK_TUNED_MAGIC_K (ICET_STATE_ENGINE_START | (IceTEnum)0x0047)
+#define ICET_RADIXK_TUNED_MAX_IMAGE_SPLIT (ICET_STATE_ENGINE_START|(IceTEnum)0x0048)
+/* 0x0046 and 0x0049 to 0x004D are used privately by radix-k. */
 
 #define ICET_DRAW_FUNCTION      (ICET_STATE_ENGINE_START | (IceTEnum)0x0060)
 #define ICET_RENDER_LAYER_DESTRUCTOR (ICET_STATE_ENGINE_START|(IceTEnum)0x0061)
+#define ICET_OUTPUT_BUFFER      (ICET_STATE_ENGINE_START | (IceTEnum)0x0062)
+/* 0x0063 and 0x0064 are used privately by the image functions. */
 
 #define ICET_STATE_FRAME_START  (IceTEnum)0x00000080
 
@@ -304,12 +334,17 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_VALID_PIXELS_TILE  (ICET_STATE_FRAME_START | (IceTEnum)0x000C)
 #define ICET_VALID_PIXELS_OFFSET (ICET_STATE_FRAME_START | (IceTEnum)0x000D)
 #define ICET_VALID_PIXELS_NUM   (ICET_STATE_FRAME_START | (IceTEnum)0x000E)
+#define ICET_OUTPUT_BUFFER_WRITTEN (ICET_STATE_FRAME_START|(IceTEnum)0x000F)
 
 #define ICET_RENDERED_VIEWPORT  (ICET_STATE_FRAME_START | (IceTEnum)0x0010)
 #define ICET_RENDER_BUFFER      (ICET_STATE_FRAME_START | (IceTEnum)0x0011)
 #define ICET_RENDER_BUFFER_SIZE (ICET_STATE_FRAME_START | (IceTEnum)0x0012)
 #define ICET_RENDER_BUFFER_HOLD (ICET_STATE_FRAME_START | (IceTEnum)0x0013)
 #define ICET_TILE_PROJECTIONS   (ICET_STATE_FRAME_START | (IceTEnum)0x0014)
+#define ICET_NEED_BACKGROUND_CORRECTION (ICET_STATE_FRAME_START|(IceTEnum)0x0015)
+#define ICET_TRUE_BACKGROUND_COLOR (ICET_STATE_FRAME_START|(IceTEnum)0x0016)
+#define ICET_TRUE_BACKGROUND_COLOR_WORD (ICET_STATE_FRAME_START|(IceTEnum)0x0017)
+#define ICET_BACKGROUND_CORRECTED (ICET_STATE_FRAME_START|(IceTEnum)0x0018)
 
 #define ICET_STATE_TIMING_START (IceTEnum)0x000000C0
 
@@ -323,6 +358,7 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_COLLECT_TIME       (ICET_STATE_TIMING_START | (IceTEnum)0x0007)
 #define ICET_TOTAL_DRAW_TIME    (ICET_STATE_TIMING_START | (IceTEnum)0x0008)
 #define ICET_BYTES_SENT         (ICET_STATE_TIMING_START | (IceTEnum)0x0009)
+#define ICET_CODEC_TIME         (ICET_STATE_TIMING_START | (IceTEnum)0x000A)
 
 #define ICET_DRAW_START_TIME    (ICET_STATE_TIMING_START | (IceTEnum)0x0010)
 #define ICET_DRAW_TIME_ID       (ICET_STATE_TIMING_START | (IceTEnum)0x0011)
@@ -342,6 +378,13 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_COMPOSITE_ONE_BUFFER (ICET_STATE_ENABLE_START | (IceTEnum)0x0004)
 #define ICET_INTERLACE_IMAGES   (ICET_STATE_ENABLE_START | (IceTEnum)0x0005)
 #define ICET_COLLECT_IMAGES     (ICET_STATE_ENABLE_START | (IceTEnum)0x0006)
+#define ICET_COMPACT_RUN_LENGTHS (ICET_STATE_ENABLE_START | (IceTEnum)0x0007)
+#define ICET_MESSAGE_CODEC      (ICET_STATE_ENABLE_START | (IceTEnum)0x0008)
+#define ICET_PLANAR_SPARSE_IMAGES (ICET_STATE_ENABLE_START | (IceTEnum)0x0009)
+#define ICET_INDEX_SPARSE_IMAGES (ICET_STATE_ENABLE_START | (IceTEnum)0x000A)
+#define ICET_OPACITY_CULLING    (ICET_STATE_ENABLE_START | (IceTEnum)0x000B)
+#define ICET_NODE_AWARE_COMPOSITE (ICET_STATE_ENABLE_START | (IceTEnum)0x000C)
+#define ICET_RADIXK_AUTO_TUNE   (ICET_STATE_ENABLE_START | (IceTEnum)0x000D)
 
 /* This set of enable state variables are reserved for the rendering layer. */
 #define ICET_RENDER_LAYER_ENABLE_START (ICET_STATE_ENABLE_START | (IceTEnum)0x0030)
@@ -362,6 +405,11 @@ ICET_EXPORT void icetDiagnostics(IceTBitField mask);
 #define ICET_COMM_OFFSET_BUF    (ICET_CORE_BUFFER_START | (IceTEnum)0x0005)
 #define ICET_IMAGE_COLLECT_OFFSET_BUF (ICET_CORE_BUFFER_START | (IceTEnum)0x0006)
 #define ICET_IMAGE_COLLECT_SIZE_BUF (ICET_CORE_BUFFER_START | (IceTEnum)0x0007)
+#define ICET_COMPRESS_BANDS_BUF (ICET_CORE_BUFFER_START | (IceTEnum)0x0008)
+#define ICET_MESSAGE_CODEC_BUF  (ICET_CORE_BUFFER_START | (IceTEnum)0x0009)
+#define ICET_IMAGE_COLLECT_BUF  (ICET_CORE_BUFFER_START | (IceTEnum)0x000A)
+#define ICET_MULTI_COMPOSITE_BUF (ICET_CORE_BUFFER_START | (IceTEnum)0x000B)
+#define ICET_COMPRESS_PIECES_BUF (ICET_CORE_BUFFER_START | (IceTEnum)0x000C)
 
 #define ICET_RENDER_LAYER_BUFFER_START (ICET_STATE_BUFFER_START | (IceTEnum)0x0010)
 #define ICET_RENDER_LAYER_BUFFER_END   (ICET_STATE_BUFFER_START | (IceTEnum)0x0020)
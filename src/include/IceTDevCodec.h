@@ -0,0 +1,47 @@
+/* -*- c -*- *******************************************************/
+/*
+ * Copyright (C) 2011 Sandia Corporation
+ * Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+ * the U.S. Government retains certain rights in this software.
+ *
+ * This source code is released under the New BSD License.
+ */
+
+#ifndef __IceTDevCodec_h
+#define __IceTDevCodec_h
+
+#include <IceT.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+/* A fast lossless byte compressor used to shrink messages before they are
+   sent.  The encoded data uses the LZ4 block format: a sequence of literal
+   runs and back references of at least 4 bytes up to 64 KB back. */
+
+/* Encodes input_size bytes of input into output.  Returns the number of
+   bytes written to output, or 0 if the encoded data does not fit in
+   max_output_size bytes (in which case the contents of output are
+   undefined). */
+ICET_EXPORT IceTSizeType icetCodecEncode(const IceTVoid *input,
+                                         IceTSizeType input_size,
+                                         IceTVoid *output,
+                                         IceTSizeType max_output_size);
+
+/* Decodes input_size bytes of encoded input into output, which can hold
+   max_output_size bytes.  Returns the number of bytes written to output, or
+   -1 if the encoded data is malformed or does not fit in output. */
+ICET_EXPORT IceTSizeType icetCodecDecode(const IceTVoid *input,
+                                         IceTSizeType input_size,
+                                         IceTVoid *output,
+                                         IceTSizeType max_output_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IceTDevCodec_h */
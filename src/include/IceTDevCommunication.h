@@ -19,6 +19,11 @@ extern "C" {
 }
 #endif
 
+/* Returns the function given to icetCommunicatorSetNodeFunc for comm or NULL
+   if there is none. */
+ICET_EXPORT IceTCommNodeFunc icetCommunicatorGetNodeFunc(
+                                                 IceTCommunicator comm);
+
 /* All of these methods call the associated method in the communicator for
    the current context. */
 ICET_EXPORT IceTCommunicator icetCommDuplicate();
@@ -74,6 +79,11 @@ ICET_EXPORT int icetCommWaitany(int count, IceTCommRequest *array_of_requests);
 ICET_EXPORT void icetCommWaitall(int count, IceTCommRequest *array_of_requests);
 ICET_EXPORT int icetCommSize();
 ICET_EXPORT int icetCommRank();
+/* Returns the same number, the smallest rank on the node, for every process
+ * that shares a node with the local process.  All processes must call it.
+ * If the communicator has no node function, every process is its own
+ * node. */
+ICET_EXPORT int icetCommNode();
 
 /* When used in place of sendbuf in one of the gathers, then this means that
  * the local process should skip sending to itself.  Instead, the correct
@@ -36,6 +36,9 @@ ICET_EXPORT IceTImage icetImageAssignBuffer(IceTVoid *buffer,
                                             IceTSizeType width,
                                             IceTSizeType height);
 ICET_EXPORT void icetImageAdjustForOutput(IceTImage image);
+/* Drops the colors of an image that were written to the output buffer,
+   keeping any depth values. */
+ICET_EXPORT void icetImageAdjustForOutputBuffer(IceTImage image);
 ICET_EXPORT void icetImageAdjustForInput(IceTImage image);
 ICET_EXPORT void icetImageSetDimensions(IceTImage image,
                                         IceTSizeType width,
@@ -70,6 +73,20 @@ ICET_EXPORT IceTImage icetImageUnpackageFromReceive(IceTVoid *buffer);
 
 typedef struct { IceTVoid *opaque_internals; } IceTSparseImage;
 
+/* In ICET_COMPOSITE_MODE_FRAGMENTS, sparse images hold count fragments per
+   pixel rather than a single color and depth.  Each fragment is 5 IceTFloat
+   values: a premultiplied RGBA color followed by a depth.  The fragments of a
+   pixel are sorted front to back, and any unused fragments are at the end
+   with all values 0.  These sparse images have no separate depth. */
+#define ICET_IMAGE_COLOR_FRAGMENTS(count)       ((IceTEnum)(0xC100 | (count)))
+#define ICET_IMAGE_COLOR_IS_FRAGMENTS(format)   (((format) & 0xFF00) == 0xC100)
+#define ICET_IMAGE_COLOR_FRAGMENT_COUNT(format) ((IceTInt)((format) & 0x00FF))
+
+/* Gets the color and depth formats of sparse images made with the current
+   state, which differ from those of images in
+   ICET_COMPOSITE_MODE_FRAGMENTS. */
+ICET_EXPORT void icetGetSparseImageFormats(IceTEnum *color_format,
+                                           IceTEnum *depth_format);
 ICET_EXPORT IceTSizeType icetSparseImageBufferSize(IceTSizeType width,
                                                    IceTSizeType height);
 ICET_EXPORT IceTSizeType icetSparseImageBufferSizeType(IceTEnum color_format,
@@ -95,6 +112,9 @@ ICET_EXPORT void icetSparseImageSetDimensions(IceTSparseImage image,
                                               IceTSizeType height);
 ICET_EXPORT IceTSizeType icetSparseImageGetCompressedBufferSize(
                                                    const IceTSparseImage image);
+/* When ICET_MESSAGE_CODEC is enabled, icetSparseImagePackageForSend may encode
+   the image data into the unused end of the image buffer.  The image itself
+   is left as it was, but it must not be written until the send completes. */
 ICET_EXPORT void icetSparseImagePackageForSend(IceTSparseImage image,
                                                IceTVoid **buffer,
                                                IceTSizeType *size);
@@ -119,6 +139,23 @@ ICET_EXPORT IceTSizeType icetSparseImageSplitPartitionNumPixels(
                                                IceTSizeType input_num_pixels,
                                                IceTInt num_partitions,
                                                IceTInt eventual_num_partitions);
+/* Adds the pixels of tail to the end of image, which becomes a single row.
+   Undoes an icetSparseImageSplit one partition at a time. */
+ICET_EXPORT void icetSparseImageAppend(IceTSparseImage image,
+                                       const IceTSparseImage tail);
+
+/* An opacity mask has a bit for each pixel of a sparse image, which is set
+   where the pixel is opaque.  When blending, nothing behind an opaque pixel
+   can be seen, so icetSparseImageCullOccluded makes the pixels of an image
+   behind the one the mask came from inactive.  The result is the same when
+   the images are blended, but less data has to be sent.  The mask is an
+   array of ICET_OPACITY_MASK_WORDS(num_pixels) words. */
+#define ICET_OPACITY_MASK_WORDS(num_pixels)     (((num_pixels) + 31)/32)
+ICET_EXPORT void icetSparseImageOpacityMask(const IceTSparseImage image,
+                                            IceTUInt *mask);
+ICET_EXPORT void icetSparseImageCullOccluded(const IceTSparseImage in_image,
+                                             const IceTUInt *mask,
+                                             IceTSparseImage out_image);
 
 ICET_EXPORT void icetSparseImageInterlace(const IceTSparseImage in_image,
                                           IceTInt eventual_num_partitions,
@@ -131,6 +168,9 @@ ICET_EXPORT IceTSizeType icetGetInterlaceOffset(
                                               IceTSizeType original_image_size);
 
 ICET_EXPORT void icetClearImage(IceTImage image);
+/* Like icetClearImage except that, when ICET_NEED_BACKGROUND_CORRECTION is
+   set for the frame, the colors are the true background color. */
+ICET_EXPORT void icetClearImageTrueBackground(IceTImage image);
 ICET_EXPORT void icetClearSparseImage(IceTSparseImage image);
 
 ICET_EXPORT void icetGetTileImage(IceTInt tile, IceTImage image);
@@ -138,6 +178,29 @@ ICET_EXPORT void icetGetTileImage(IceTInt tile, IceTImage image);
 ICET_EXPORT void icetGetCompressedTileImage(IceTInt tile,
                                             IceTSparseImage compressed_image);
 
+/* Renders a tile and compresses it directly into the pieces that
+   icetCompressImageSplit would create from the image icetGetTileImage
+   returns.  The pixels are compressed straight from the rendered region in a
+   single pass, so the whole tile is never copied into an image.  None of the
+   out_images may be the same buffer. */
+ICET_EXPORT void icetGetCompressedTileImageSplit(
+                                             IceTInt tile,
+                                             IceTInt num_partitions,
+                                             IceTInt eventual_num_partitions,
+                                             IceTSparseImage *out_images,
+                                             IceTSizeType *offsets);
+
+/* Renders a tile and compresses it directly into the interlaced order that
+   icetCompressImageInterlace would give the image icetGetTileImage returns.
+   Like icetGetCompressedTileImageSplit, the pixels are compressed straight
+   from the rendered region.  The scratch_state_buffer holds a small table of
+   where the partitions are. */
+ICET_EXPORT void icetGetCompressedTileImageInterlace(
+                                             IceTInt tile,
+                                             IceTInt eventual_num_partitions,
+                                             IceTEnum scratch_state_buffer,
+                                             IceTSparseImage compressed_image);
+
 ICET_EXPORT void icetCompressImage(const IceTImage image,
                                    IceTSparseImage compressed_image);
 
@@ -146,6 +209,36 @@ ICET_EXPORT void icetCompressSubImage(const IceTImage image,
                                       IceTSizeType pixels,
                                       IceTSparseImage compressed_image);
 
+/* Compresses an image directly into the pieces that icetSparseImageSplit
+   would create from the compressed image.  This saves compressing the whole
+   image just to copy it again into pieces.  None of the out_images may be the
+   same buffer. */
+ICET_EXPORT void icetCompressImageSplit(const IceTImage image,
+                                        IceTInt num_partitions,
+                                        IceTInt eventual_num_partitions,
+                                        IceTSparseImage *out_images,
+                                        IceTSizeType *offsets);
+
+/* Compresses an image directly into the interlaced order that
+   icetSparseImageInterlace would give the compressed image.  This saves
+   compressing the image into a buffer just to copy it again.  The
+   scratch_state_buffer holds a small table of where the partitions are. */
+ICET_EXPORT void icetCompressImageInterlace(const IceTImage image,
+                                            IceTInt eventual_num_partitions,
+                                            IceTEnum scratch_state_buffer,
+                                            IceTSparseImage compressed_image);
+
+/* Compresses an image into blocks of 16x16 pixels rather than runs of
+   pixels along each scanline.  The result is a bitmap of the blocks that
+   have an active pixel followed by all the pixels of those blocks.  This is
+   smaller than the runs when the active pixels cover a compact area of a wide
+   image.  A sparse image in this layout may be sent, decompressed with
+   icetDecompressImage, and composited with icetCompressedComposite or with
+   another image in this layout by icetCompressedCompressedComposite, but it
+   may not be split or used in any other operation on part of an image. */
+ICET_EXPORT void icetCompressImageBlocks(const IceTImage image,
+                                         IceTSparseImage compressed_image);
+
 ICET_EXPORT void icetDecompressImage(const IceTSparseImage compressed_image,
                                      IceTImage image);
 
@@ -153,6 +246,69 @@ ICET_EXPORT void icetDecompressSubImage(const IceTSparseImage compressed_image,
                                         IceTSizeType offset,
                                         IceTImage image);
 
+/* Decompresses the colors of compressed_image into an application buffer of
+   color_format pixels with rows width pixels wide.  Each row starts row_pitch
+   bytes after the last (0 means the rows are packed).  The first pixel of the
+   compressed image goes offset pixels into the buffer.  Inactive pixels get
+   the background color, as with icetDecompressSubImage. */
+ICET_EXPORT void icetDecompressSubImageToBuffer(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTSizeType width,
+                                         IceTEnum color_format,
+                                         IceTSizeType row_pitch,
+                                         IceTVoid *buffer);
+
+/* Versions of icetDecompressImage, icetDecompressSubImage, and
+   icetDecompressSubImageToBuffer for the final image of a frame.  When
+   ICET_NEED_BACKGROUND_CORRECTION is set, the blended colors are placed over
+   the true background color (ICET_TRUE_BACKGROUND_COLOR) while they are
+   written, which saves icetDrawFrame a pass over the image.  Otherwise they
+   are the same as the plain versions. */
+ICET_EXPORT void icetDecompressImageCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTImage image);
+ICET_EXPORT void icetDecompressSubImageCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTImage image);
+ICET_EXPORT void icetDecompressSubImageToBufferCorrectBackground(
+                                         const IceTSparseImage compressed_image,
+                                         IceTSizeType offset,
+                                         IceTSizeType width,
+                                         IceTEnum color_format,
+                                         IceTSizeType row_pitch,
+                                         IceTVoid *buffer);
+
+/* Like icetImageCopyColorub and icetImageCopyColorf except that the rows of
+   buffer start row_pitch bytes apart (0 means the rows are packed). */
+ICET_EXPORT void icetImageCopyColorToBuffer(const IceTImage image,
+                                            IceTEnum color_format,
+                                            IceTSizeType row_pitch,
+                                            IceTVoid *buffer);
+
+/* Calls func on consecutive ranges that together cover all num_units units of
+   an image, where each unit is unit_pixels pixels (1 for single pixels or the
+   width for rows).  When ICET_NUM_THREADS is greater than 1 and the image is
+   large enough, the ranges run on separate threads and start on multiples of
+   16 pixels so that threads seldom write to the same cache line.  func must
+   not raise errors or change the state. */
+typedef void (*IceTPixelRangeFunc)(IceTVoid *data,
+                                   IceTSizeType first_unit,
+                                   IceTSizeType num_units);
+ICET_EXPORT void icetParallelPixelRanges(IceTSizeType num_units,
+                                         IceTSizeType unit_pixels,
+                                         IceTPixelRangeFunc func,
+                                         IceTVoid *data);
+
+/* Picks the function that composites spans of pixels for the current
+   composite mode and the formats of sparse images.  The compositing functions
+   use it rather than checking the mode and formats on every call.  This is
+   called when a frame starts and when the composite mode changes.  Sparse
+   images of other formats still work, but the function has to be looked up
+   each time. */
+ICET_EXPORT void icetSelectCompositeKernel(void);
+
 ICET_EXPORT void icetComposite(IceTImage destBuffer,
                                const IceTImage srcBuffer,
                                int srcOnTop);
@@ -171,18 +327,56 @@ ICET_EXPORT void icetCompressedCompressedComposite(
                                              const IceTSparseImage back_buffer,
                                              IceTSparseImage dest_buffer);
 
+/* Composites num_images sparse images, ordered from front to back, into
+   dest_buffer in a single pass over all of their runs.  The result is the
+   same as compositing the images two at a time from back to front with
+   icetCompressedCompressedComposite, but the intermediate images are never
+   written.  dest_buffer may not be one of the images.  Images in the block
+   layout are not supported. */
+ICET_EXPORT void icetCompressedMultiComposite(const IceTSparseImage *images,
+                                              IceTInt num_images,
+                                              IceTSparseImage dest_buffer);
+
+/* Divides x by 255, rounding down, for 0 <= x <= 255*255. */
+#define ICET_DIV255(x)  (((x) + 1 + ((x) >> 8)) >> 8)
+
 #define ICET_BLEND_UBYTE(front, back, dest)                             \
 {                                                                       \
     IceTUInt afactor = 255 - (front)[3];                                \
-    (dest)[0] = (IceTUByte)(((back)[0]*afactor)/255 + (front)[0]);      \
-    (dest)[1] = (IceTUByte)(((back)[1]*afactor)/255 + (front)[1]);      \
-    (dest)[2] = (IceTUByte)(((back)[2]*afactor)/255 + (front)[2]);      \
-    (dest)[3] = (IceTUByte)(((back)[3]*afactor)/255 + (front)[3]);      \
+    (dest)[0] = (IceTUByte)(ICET_DIV255((back)[0]*afactor) + (front)[0]);\
+    (dest)[1] = (IceTUByte)(ICET_DIV255((back)[1]*afactor) + (front)[1]);\
+    (dest)[2] = (IceTUByte)(ICET_DIV255((back)[2]*afactor) + (front)[2]);\
+    (dest)[3] = (IceTUByte)(ICET_DIV255((back)[3]*afactor) + (front)[3]);\
 }
 
 #define ICET_OVER_UBYTE(src, dest)  ICET_BLEND_UBYTE(src, dest, dest)
 #define ICET_UNDER_UBYTE(src, dest) ICET_BLEND_UBYTE(dest, src, dest)
 
+/* Blends num_pixels RGBA_UBYTE pixels of front over those of back into dest
+   with the same results as ICET_BLEND_UBYTE, several pixels at a time when
+   SSE2 is available.  dest may be the same as front or back. */
+ICET_EXPORT void icetBlendUByteArray(const IceTUByte *front,
+                                     const IceTUByte *back,
+                                     IceTUByte *dest,
+                                     IceTSizeType num_pixels);
+
+/* Blends num_pixels RGBA_UBYTE pixels in place over the single color
+   background, as ICET_UNDER_UBYTE(background, colors) does for each. */
+ICET_EXPORT void icetBlendUByteArrayOverColor(IceTUByte *colors,
+                                              const IceTUByte *background,
+                                              IceTSizeType num_pixels);
+
+/* Combines num_pixels colors of color_format in place with the single color
+   background (of the same format) using the per channel operation of
+   composite_mode, which is ICET_COMPOSITE_MODE_MAX_INTENSITY or
+   ICET_COMPOSITE_MODE_ADD.  This places the images of these modes over a
+   background the way ICET_UNDER_UBYTE does for blending. */
+ICET_EXPORT void icetChannelCompositeArrayWithColor(IceTEnum composite_mode,
+                                                    IceTEnum color_format,
+                                                    IceTVoid *colors,
+                                                    const IceTVoid *background,
+                                                    IceTSizeType num_pixels);
+
 #define ICET_BLEND_FLOAT(front, back, dest)                             \
 {                                                                       \
     IceTFloat afactor = 1.0f - (front)[3];                              \
@@ -195,6 +389,23 @@ ICET_EXPORT void icetCompressedCompressedComposite(
 #define ICET_OVER_FLOAT(src, dest)  ICET_BLEND_FLOAT(src, dest, dest)
 #define ICET_UNDER_FLOAT(src, dest) ICET_BLEND_FLOAT(dest, src, dest)
 
+/* Colors of ICET_IMAGE_COLOR_RGBA_HALF are IEEE 754 half-precision floats
+   held in IceTUShort.  These convert one value to and from float, rounding
+   to the nearest half. */
+ICET_EXPORT IceTFloat icetHalfToFloat(IceTUShort value);
+ICET_EXPORT IceTUShort icetFloatToHalf(IceTFloat value);
+
+/* Blends one half-precision pixel over another as ICET_BLEND_FLOAT does.
+   The blend is done in float and rounded back to half once. */
+ICET_EXPORT void icetBlendHalf(const IceTUShort *front,
+                               const IceTUShort *back,
+                               IceTUShort *dest);
+
+#define ICET_BLEND_HALF(front, back, dest)  icetBlendHalf(front, back, dest)
+
+#define ICET_OVER_HALF(src, dest)   ICET_BLEND_HALF(src, dest, dest)
+#define ICET_UNDER_HALF(src, dest)  ICET_BLEND_HALF(dest, src, dest)
+
 #ifdef __cplusplus
 }
 #endif
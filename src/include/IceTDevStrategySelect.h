@@ -43,10 +43,19 @@ ICET_STRATEGY_EXPORT void icetInvokeSingleImageStrategy(
                                                   const IceTInt *compose_group,
                                                   IceTInt group_size,
                                                   IceTInt image_dest,
+                                             IceTInt uncompressed_tile,
                                                   IceTSparseImage input_image,
                                                   IceTSparseImage *result_image,
                                                   IceTSizeType *piece_offset);
 
+/* Called by all processes before each frame so that the single image
+   strategy can gather what it needs from all processes. */
+ICET_STRATEGY_EXPORT void icetPrepareSingleImageStrategy(void);
+
+/* Called by all processes after each frame so that the single image strategy
+   can adjust itself to how long compositing took. */
+ICET_STRATEGY_EXPORT void icetTuneSingleImageStrategy(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@
 void icetAutomaticCompose(const IceTInt *compose_group,
                           IceTInt group_size,
                           IceTInt image_dest,
+                          IceTInt uncompressed_tile,
                           IceTSparseImage input_image,
                           IceTSparseImage *result_image,
                           IceTSizeType *piece_offset)
@@ -26,6 +27,7 @@ void icetAutomaticCompose(const IceTInt *compose_group,
                                       compose_group,
                                       group_size,
                                       image_dest,
+                                      uncompressed_tile,
                                       input_image,
                                       result_image,
                                       piece_offset);
@@ -35,6 +37,7 @@ void icetAutomaticCompose(const IceTInt *compose_group,
                                       compose_group,
                                       group_size,
                                       image_dest,
+                                      uncompressed_tile,
                                       input_image,
                                       result_image,
                                       piece_offset);
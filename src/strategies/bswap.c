@@ -18,9 +18,12 @@
 #define BSWAP_SPARE_WORKING_IMAGE_BUFFER        ICET_SI_STRATEGY_BUFFER_2
 #define BSWAP_IMAGE_ARRAY                       ICET_SI_STRATEGY_BUFFER_3
 #define BSWAP_DUMMY_ARRAY                       ICET_SI_STRATEGY_BUFFER_4
+#define BSWAP_OPACITY_MASK_BUFFER               ICET_SI_STRATEGY_BUFFER_5
+#define BSWAP_CULLED_IMAGE_BUFFER               ICET_SI_STRATEGY_BUFFER_6
 
 #define BSWAP_SWAP_IMAGES 21
 #define BSWAP_TELESCOPE 22
+#define BSWAP_OPACITY_MASK 23
 
 #define BIT_REVERSE(result, x, max_val_plus_one)                              \
 {                                                                             \
@@ -341,10 +344,56 @@ static void bswapReceiveFromUpperGroup(const IceTInt *lower_group,
  * deadlock).  If spare_image is non-NULL, then in that variable an image with a
  * buffer that is not the result_image nor any other buffers reserved for
  * holding during splits and transfers.  Subsequent operations can safely
- * composite into that buffer and return that as a resulting image. */
+ * composite into that buffer and return that as a resulting image.  If
+ * uncompressed_tile is not negative, working_image holds no pixels yet and
+ * that tile is rendered and compressed straight into the halves of the first
+ * swap. */
+/* With opacity culling, the process in front sends the opacity mask of the
+ * half of the image it keeps to its partner, which drops the pixels hidden
+ * by it from the half it sends back.  Returns the image to send. */
+static IceTSparseImage bswapCullOccluded(IceTInt pair_rank,
+                                         IceTInt inOnTop,
+                                         const IceTSparseImage keep_image,
+                                         IceTSparseImage send_image)
+{
+    IceTSizeType num_pixels;
+    IceTSizeType num_words;
+    IceTUInt *mask;
+    IceTSparseImage culled_image;
+
+    if (!inOnTop) {
+        num_words = ICET_OPACITY_MASK_WORDS(
+                                    icetSparseImageGetNumPixels(keep_image));
+        mask = icetGetStateBuffer(BSWAP_OPACITY_MASK_BUFFER,
+                                  num_words*sizeof(IceTUInt));
+        icetSparseImageOpacityMask(keep_image, mask);
+        icetCommSend(mask,
+                     num_words,
+                     ICET_INT,
+                     pair_rank,
+                     BSWAP_OPACITY_MASK);
+        return send_image;
+    }
+
+    num_pixels = icetSparseImageGetNumPixels(send_image);
+    num_words = ICET_OPACITY_MASK_WORDS(num_pixels);
+    mask = icetGetStateBuffer(BSWAP_OPACITY_MASK_BUFFER,
+                              num_words*sizeof(IceTUInt));
+    icetCommRecv(mask,
+                 num_words,
+                 ICET_INT,
+                 pair_rank,
+                 BSWAP_OPACITY_MASK);
+    culled_image = icetGetStateBufferSparseImage(BSWAP_CULLED_IMAGE_BUFFER,
+                                                 num_pixels, 1);
+    icetSparseImageCullOccluded(send_image, mask, culled_image);
+    return culled_image;
+}
+
 static void bswapComposePow2(const IceTInt *compose_group,
                              IceTInt group_size,
                              IceTInt largest_group_size,
+                             IceTInt uncompressed_tile,
                              IceTSparseImage working_image,
                              IceTSparseImage spare_image,
                              IceTSparseImage *result_image,
@@ -355,10 +404,15 @@ static void bswapComposePow2(const IceTInt *compose_group,
     IceTInt group_rank;
     IceTSparseImage image_data = working_image;
     IceTSparseImage available_image = spare_image;
+    IceTEnum composite_mode;
+    IceTBoolean cull_occluded;
 
     *piece_offset = 0;
 
     if (group_size < 2) {
+        if (uncompressed_tile >= 0) {
+            icetGetCompressedTileImage(uncompressed_tile, image_data);
+        }
         *result_image = image_data;
         if (unused_image) { *unused_image = icetSparseImageNull(); }
         return;
@@ -366,6 +420,10 @@ static void bswapComposePow2(const IceTInt *compose_group,
 
     group_rank = icetFindMyRankInGroup(compose_group, group_size);
 
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    cull_occluded = (   icetIsEnabled(ICET_OPACITY_CULLING)
+                     && (composite_mode == ICET_COMPOSITE_MODE_BLEND) );
+
     /* To do the ordering correct, at iteration i we must swap with a
      * process 2^i units away.  The easiest way to find the process to
      * pair with is to simply xor the group_rank with a value with the
@@ -391,12 +449,20 @@ static void bswapComposePow2(const IceTInt *compose_group,
             outgoing_images[1]
                 = icetGetStateBufferSparseImage(BSWAP_OUTGOING_IMAGES_BUFFER,
                                                 piece_num_pixels, 1);
-            icetSparseImageSplit(image_data,
-                                 *piece_offset,
-                                 2,
-                                 largest_group_size/bitmask,
-                                 outgoing_images,
-                                 outgoing_offsets);
+            if ((bitmask == 0x0001) && (uncompressed_tile >= 0)) {
+                icetGetCompressedTileImageSplit(uncompressed_tile,
+                                                2,
+                                                largest_group_size/bitmask,
+                                                outgoing_images,
+                                                outgoing_offsets);
+            } else {
+                icetSparseImageSplit(image_data,
+                                     *piece_offset,
+                                     2,
+                                     largest_group_size/bitmask,
+                                     outgoing_images,
+                                     outgoing_offsets);
+            }
         }
 
         /* Find pair process and decide which half of the image to send. */
@@ -424,6 +490,13 @@ static void bswapComposePow2(const IceTInt *compose_group,
             IceTVoid *in_image_buffer;
             IceTSparseImage in_image;
 
+            if (cull_occluded) {
+                send_image = bswapCullOccluded(compose_group[pair],
+                                               inOnTop,
+                                               keep_image,
+                                               send_image);
+            }
+
             icetSparseImagePackageForSend(send_image,
                                           &package_buffer,
                                           &package_size);
@@ -479,10 +552,13 @@ static void bswapComposePow2(const IceTInt *compose_group,
  * the ith piece, where i is group_rank with the bits reversed (which is
  * necessary to get the ordering correct).  If both color and depth buffers are
  * inputs, both are located in the uncollected images regardless of what buffers
- * are selected for outputs. */
+ * are selected for outputs.  If uncompressed_tile is not negative, it is the
+ * tile to render and compose and working_image is the buffer to compress it
+ * in. */
 static void bswapComposeNoCombine(const IceTInt *compose_group,
                                   IceTInt group_size,
                                   IceTInt largest_group_size,
+                                  IceTInt uncompressed_tile,
                                   IceTSparseImage working_image,
                                   IceTSparseImage *result_image,
                                   IceTSizeType *piece_offset)
@@ -503,6 +579,7 @@ static void bswapComposeNoCombine(const IceTInt *compose_group,
         bswapComposeNoCombine(compose_group + pow2size,
                               extra_proc,
                               largest_group_size,
+                              uncompressed_tile,
                               working_image,
                               result_image,
                               piece_offset);
@@ -524,13 +601,15 @@ static void bswapComposeNoCombine(const IceTInt *compose_group,
         IceTSparseImage available_image;
         IceTSparseImage spare_image;
         IceTBoolean use_interlace;
+        IceTInt pow2_uncompressed_tile = uncompressed_tile;
         IceTSizeType total_num_pixels
             = icetSparseImageGetNumPixels(working_image);
 
         use_interlace
             = (largest_group_size > 2) && icetIsEnabled(ICET_INTERLACE_IMAGES);
-        if (use_interlace) {
-            IceTSparseImage interlaced_image = icetGetStateBufferSparseImage(
+        if (use_interlace && (uncompressed_tile < 0)) {
+            IceTSparseImage interlaced_image;
+            interlaced_image = icetGetStateBufferSparseImage(
                                        BSWAP_SPARE_WORKING_IMAGE_BUFFER,
                                        icetSparseImageGetWidth(working_image),
                                        icetSparseImageGetHeight(working_image));
@@ -540,26 +619,37 @@ static void bswapComposeNoCombine(const IceTInt *compose_group,
                                      interlaced_image);
             input_image = interlaced_image;
             available_image = working_image;
-        } else if (pow2size > 1) {
-            /* Allocate available image. */
-            IceTSizeType piece_num_pixels
-                = icetSparseImageSplitPartitionNumPixels(total_num_pixels,
+        } else {
+            if (use_interlace) {
+                /* Compress straight into the interlaced order.  The image
+                   then needs no more buffers than one not interlaced. */
+                icetGetCompressedTileImageInterlace(uncompressed_tile,
+                                                    largest_group_size,
+                                                    BSWAP_DUMMY_ARRAY,
+                                                    working_image);
+                pow2_uncompressed_tile = -1;
+            }
+            if (pow2size > 1) {
+                /* Allocate available image. */
+                IceTSizeType piece_num_pixels
+                    = icetSparseImageSplitPartitionNumPixels(
+                                                         total_num_pixels,
                                                          2,
                                                          largest_group_size);
-            available_image
-                = icetGetStateBufferSparseImage(BSWAP_SPARE_WORKING_IMAGE_BUFFER,
-                                                piece_num_pixels, 1);
-            input_image = working_image;
-        } else {
+                available_image = icetGetStateBufferSparseImage(
+                                              BSWAP_SPARE_WORKING_IMAGE_BUFFER,
+                                              piece_num_pixels, 1);
+            } else {
+                available_image = icetSparseImageNull();
+            }
             input_image = working_image;
-            available_image = icetSparseImageNull();
         }
-            
 
         /* I am part of the lower group.  Do the actual binary swap. */
         bswapComposePow2(compose_group,
                          pow2size,
                          largest_group_size,
+                         pow2_uncompressed_tile,
                          input_image,
                          available_image,
                          result_image,
@@ -590,6 +680,7 @@ static void bswapComposeNoCombine(const IceTInt *compose_group,
 void icetBswapCompose(const IceTInt *compose_group,
                       IceTInt group_size,
                       IceTInt image_dest,
+                      IceTInt uncompressed_tile,
                       IceTSparseImage input_image,
                       IceTSparseImage *result_image,
                       IceTSizeType *piece_offset)
@@ -604,6 +695,7 @@ void icetBswapCompose(const IceTInt *compose_group,
     bswapComposeNoCombine(compose_group,
                           group_size,
                           -1,
+                          uncompressed_tile,
                           input_image,
                           result_image,
                           piece_offset);
@@ -424,6 +424,7 @@ void icetSendRecvLargeMessages(IceTInt numMessagesSending,
 void icetSingleImageCompose(IceTInt *compose_group,
                             IceTInt group_size,
                             IceTInt image_dest,
+                            IceTInt uncompressed_tile,
                             IceTSparseImage input_image,
                             IceTSparseImage *result_image,
                             IceTSizeType *piece_offset)
@@ -435,11 +436,192 @@ void icetSingleImageCompose(IceTInt *compose_group,
                                   compose_group,
                                   group_size,
                                   image_dest,
+                                  uncompressed_tile,
                                   input_image,
                                   result_image,
                                   piece_offset);
 }
 
+/* Called at the destination of icetSingleImageCollect once all pixels have
+   been written.  If the frame needs background correction, the pixels were
+   corrected as they were decompressed, so icetDrawFrame can skip it. */
+static void icetSingleImageCollectNoteCorrected(void)
+{
+    IceTBoolean need_correction;
+    icetGetBooleanv(ICET_NEED_BACKGROUND_CORRECTION, &need_correction);
+    if (need_correction) {
+        icetStateSetBoolean(ICET_BACKGROUND_CORRECTED, 1);
+    }
+}
+
+/* Used by icetSingleImageCollect when an output buffer is set with
+   icetOutputBuffer.  The pieces are gathered as sparse images, and the
+   destination decompresses them straight into the output buffer. */
+static void icetSingleImageCollectSparse(const IceTSparseImage input_image,
+                                         IceTInt dest,
+                                         IceTSizeType piece_offset,
+                                         IceTImage result_image)
+{
+    IceTSizeType piece_info[3];
+    IceTSizeType *all_piece_info;
+    IceTSizeType piece_size;
+    IceTVoid *send_buffer;
+    IceTSizeType send_size;
+    IceTInt rank;
+    IceTInt numproc;
+
+    rank = icetCommRank();
+    numproc = icetCommSize();
+
+    /* The destination decompresses its own piece directly. */
+    piece_size = icetSparseImageGetNumPixels(input_image);
+    if ((piece_size > 0) && (rank != dest)) {
+        icetSparseImagePackageForSend(input_image, &send_buffer, &send_size);
+    } else {
+        send_buffer = NULL;
+        send_size = 0;
+    }
+
+    /* Gather the offset, pixel count, and message size of every piece. */
+    piece_info[0] = piece_offset;
+    piece_info[1] = piece_size;
+    piece_info[2] = send_size;
+    if (rank == dest) {
+        all_piece_info = icetGetStateBuffer(ICET_IMAGE_COLLECT_OFFSET_BUF,
+                                            3*sizeof(IceTSizeType)*numproc);
+    } else {
+        all_piece_info = NULL;
+    }
+    icetCommGather(piece_info, 3, ICET_SIZE_TYPE, all_piece_info, dest);
+
+    if (rank == dest) {
+        IceTEnum output_format;
+        IceTInt row_pitch;
+        IceTVoid *output_buffer;
+        IceTBoolean decompress_to_image;
+        IceTSizeType width = icetImageGetWidth(result_image);
+        IceTSizeType *sizes;
+        IceTSizeType *offsets;
+        IceTSizeType total_size;
+        IceTSizeType total_pixels;
+        IceTSizeType largest_piece;
+        IceTEnum piece_color_format;
+        IceTEnum piece_depth_format;
+        IceTByte *pieces_buffer;
+        IceTInt proc;
+
+        icetGetEnumv(ICET_OUTPUT_BUFFER_FORMAT, &output_format);
+        icetGetIntegerv(ICET_OUTPUT_BUFFER_ROW_PITCH, &row_pitch);
+        icetGetPointerv(ICET_OUTPUT_BUFFER, &output_buffer);
+
+        /* The result image still needs the pixels if there is no output
+           buffer here or if it returns depths. */
+        decompress_to_image
+            = (   (output_buffer == NULL)
+               || (   !icetIsEnabled(ICET_COMPOSITE_ONE_BUFFER)
+                   && (   icetImageGetDepthFormat(result_image)
+                       != ICET_IMAGE_DEPTH_NONE) ) );
+
+        sizes = icetGetStateBuffer(ICET_IMAGE_COLLECT_SIZE_BUF,
+                                   2*sizeof(IceTSizeType)*numproc);
+        offsets = sizes + numproc;
+        total_size = 0;
+        total_pixels = 0;
+        largest_piece = 0;
+        for (proc = 0; proc < numproc; proc++) {
+            sizes[proc] = all_piece_info[3*proc + 2];
+            offsets[proc] = total_size;
+            total_size += sizes[proc];
+            total_pixels += all_piece_info[3*proc + 1];
+            if (   (sizes[proc] > 0)
+                && (largest_piece < all_piece_info[3*proc + 1]) ) {
+                largest_piece = all_piece_info[3*proc + 1];
+            }
+        }
+
+        /* Pieces that were encoded by the message codec are decoded in place,
+           which can run over the pieces after them.  Leave room at the end and
+           unpack the pieces back to front. */
+        icetGetSparseImageFormats(&piece_color_format, &piece_depth_format);
+        pieces_buffer = icetGetStateBuffer(
+                                ICET_IMAGE_COLLECT_BUF,
+                                  total_size
+                                + icetSparseImageBufferSizeType(
+                                                           piece_color_format,
+                                                           piece_depth_format,
+                                                           largest_piece,
+                                                           1));
+
+        icetTimingCollectBegin();
+        icetCommGatherv(ICET_IN_PLACE_COLLECT,
+                        0,
+                        ICET_BYTE,
+                        pieces_buffer,
+                        sizes,
+                        offsets,
+                        dest);
+        icetTimingCollectEnd();
+
+        /* If no process composited some of the pixels (which happens when
+           no process has data for the tile), they are background. */
+        if (total_pixels < icetImageGetNumPixels(result_image)) {
+            icetClearImageTrueBackground(result_image);
+            if (output_buffer != NULL) {
+                icetImageCopyColorToBuffer(result_image,
+                                           output_format,
+                                           row_pitch,
+                                           output_buffer);
+            }
+        }
+
+        for (proc = numproc-1; proc >= 0; proc--) {
+            IceTSparseImage piece;
+            IceTSizeType offset = all_piece_info[3*proc + 0];
+
+            if (proc == rank) {
+                if (piece_size < 1) { continue; }
+                piece = input_image;
+            } else {
+                if (sizes[proc] < 1) { continue; }
+                piece = icetSparseImageUnpackageFromReceive(
+                                                 pieces_buffer + offsets[proc]);
+            }
+
+            if (output_buffer != NULL) {
+                icetDecompressSubImageToBufferCorrectBackground(
+                                                               piece,
+                                                               offset,
+                                                               width,
+                                                               output_format,
+                                                               row_pitch,
+                                                               output_buffer);
+            }
+            if (decompress_to_image) {
+                icetDecompressSubImageCorrectBackground(piece,
+                                                        offset,
+                                                        result_image);
+            }
+        }
+
+        if (output_buffer != NULL) {
+            icetStateSetBoolean(ICET_OUTPUT_BUFFER_WRITTEN, 1);
+        }
+        icetSingleImageCollectNoteCorrected();
+
+        icetImageAdjustForOutput(result_image);
+    } else {
+        icetTimingCollectBegin();
+        icetCommGatherv(send_buffer,
+                        send_size,
+                        ICET_BYTE,
+                        NULL,
+                        NULL,
+                        NULL,
+                        dest);
+        icetTimingCollectEnd();
+    }
+}
+
 void icetSingleImageCollect(const IceTSparseImage input_image,
                             IceTInt dest,
                             IceTSizeType piece_offset,
@@ -463,6 +645,22 @@ void icetSingleImageCollect(const IceTSparseImage input_image,
     rank = icetCommRank();
     numproc = icetCommSize();
 
+    /* Every process must pick the same way to collect.  The color format
+       and the output buffer format are the same everywhere, so this only
+       depends on them.  Processes that do not display the image give the
+       format with no buffer. */
+    icetGetEnumv(ICET_OUTPUT_BUFFER_FORMAT, &color_format);
+    if (color_format != ICET_IMAGE_COLOR_NONE) {
+        icetGetEnumv(ICET_COLOR_FORMAT, &color_format);
+        if (color_format != ICET_IMAGE_COLOR_NONE) {
+            icetSingleImageCollectSparse(input_image,
+                                         dest,
+                                         piece_offset,
+                                         result_image);
+            return;
+        }
+    }
+
     /* Collect partitions held by each process. */
     piece_size = icetSparseImageGetNumPixels(input_image);
     if (rank == dest) {
@@ -499,8 +697,12 @@ void icetSingleImageCollect(const IceTSparseImage input_image,
 #endif
 
     if (piece_size > 0) {
-        /* Decompress data into appropriate offset of result image. */
-        icetDecompressSubImage(input_image, piece_offset, result_image);
+        /* Decompress data into appropriate offset of result image.  Any
+           background correction happens here, so the destination does not
+           have to make another pass over the gathered image. */
+        icetDecompressSubImageCorrectBackground(input_image,
+                                                piece_offset,
+                                                result_image);
     } else if (rank != dest) {
         /* If this function is called for multiple collections, it is likely
            that the local process will not have data for all collections.  To
@@ -593,5 +795,9 @@ void icetSingleImageCollect(const IceTSparseImage input_image,
         }
     }
 
+    if (rank == dest) {
+        icetSingleImageCollectNoteCorrected();
+    }
+
     icetTimingCollectEnd();
 }
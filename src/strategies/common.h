@@ -144,6 +144,13 @@ void icetSendRecvLargeMessages(IceTInt numMessagesSending,
         placed.  It is an index into compose_group, not the actual rank
         of the process.  This is a hint to the composite algorithm rather
         than a determination of where data will end up.
+   uncompressed_tile - If not negative, the tile to render and composite.
+        In this case input_image holds no data but must have the dimensions
+        of the tile and will be used as the buffer to compress it in.  The
+        strategy renders the tile when it compresses it.  Strategies that
+        split the image right away compress the rendered region straight
+        into the pieces rather than compressing the image and then splitting
+        it.  If negative, input_image holds the image to composite.
    input_image - The input image colors and/or depth to be used.  This buffer
         may (and probably will) be changed during the composition.  The end data
         is undefined.
@@ -161,6 +168,7 @@ void icetSendRecvLargeMessages(IceTInt numMessagesSending,
 void icetSingleImageCompose(IceTInt *compose_group,
                             IceTInt group_size,
                             IceTInt image_dest,
+                            IceTInt uncompressed_tile,
                             IceTSparseImage input_image,
                             IceTSparseImage *result_image,
                             IceTSizeType *piece_offset);
@@ -182,7 +190,11 @@ void icetSingleImageCompose(IceTInt *compose_group,
    piece_offset - The offset to the start of the valid pixels will be placed
         in this argument.  Same value as returned from icetSingleImageCompose.
    result_image - an allocated and sized image in which to place the
-        uncompressed results of the collection.  */
+        uncompressed results of the collection.
+
+   If an output buffer is set with icetOutputBuffer, the pieces are collected
+   as sparse images and decompressed straight into that buffer at dest, and
+   the color of result_image is left undefined unless dest has no buffer.  */
 void icetSingleImageCollect(const IceTSparseImage input_image,
                             IceTInt dest,
                             IceTSizeType piece_offset,
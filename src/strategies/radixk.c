@@ -32,6 +32,11 @@
 
 #define RADIXK_SWAP_IMAGE_TAG_START     2200
 #define RADIXK_TELESCOPE_IMAGE_TAG      2300
+#define RADIXK_OPACITY_MASK_TAG_START   2400
+
+/* Most chunks an image piece is sent in.  Beyond this the messages get too
+   small to overlap much with compositing. */
+#define RADIXK_MAX_CHUNKS               32
 
 #define RADIXK_RECEIVE_BUFFER                   ICET_SI_STRATEGY_BUFFER_0
 #define RADIXK_SEND_BUFFER                      ICET_SI_STRATEGY_BUFFER_1
@@ -44,6 +49,37 @@
 #define RADIXK_SPLIT_OFFSET_ARRAY_BUFFER        ICET_SI_STRATEGY_BUFFER_8
 #define RADIXK_SPLIT_IMAGE_ARRAY_BUFFER         ICET_SI_STRATEGY_BUFFER_9
 #define RADIXK_RANK_LIST_BUFFER                 ICET_SI_STRATEGY_BUFFER_10
+#define RADIXK_INCOMING_IMAGE_ARRAY_BUFFER      ICET_SI_STRATEGY_BUFFER_11
+#define RADIXK_OPACITY_MASK_BUFFER              ICET_SI_STRATEGY_BUFFER_12
+#define RADIXK_OPACITY_REQUEST_BUFFER           ICET_SI_STRATEGY_BUFFER_13
+#define RADIXK_CULLED_IMAGE_BUFFER              ICET_SI_STRATEGY_BUFFER_14
+#define RADIXK_CHUNK_BUFFER                     ICET_SI_STRATEGY_BUFFER_15
+/* The tuner runs between frames, when the rank list is not in use. */
+#define RADIXK_TUNE_TIMES_BUFFER                RADIXK_RANK_LIST_BUFFER
+
+/* The tuner times each candidate over RADIXK_TUNE_CANDIDATE_FRAMES frames.
+   It explores again after RADIXK_TUNE_SLOW_FRAMES frames in a row take
+   RADIXK_TUNE_SLOW_FACTOR times longer than the best time it found.  Once the
+   tuner settles, processes only agree on whether to explore again every
+   RADIXK_TUNE_CHECK_FRAMES frames. */
+#define RADIXK_TUNE_CANDIDATE_FRAMES    3
+#define RADIXK_TUNE_SLOW_FACTOR         1.5
+#define RADIXK_TUNE_SLOW_FRAMES         3
+#define RADIXK_TUNE_CHECK_FRAMES        8
+
+/* Bookkeeping of the tuner.  These state entries are private to radix-k;
+   only the values the tuner picks are public.  RADIXK_TUNE_CANDIDATE is the
+   candidate being timed or -1 once settled, and RADIXK_TUNE_BEST and
+   RADIXK_TUNE_BEST_TIME the fastest candidate so far and its average time.
+   RADIXK_TUNE_FRAME_COUNT counts the frames timed for the candidate, or the
+   frames since the last check once settled, and RADIXK_TUNE_TIME_SUM adds up
+   the local composite time of the candidate's frames. */
+#define RADIXK_TUNE_CANDIDATE   (ICET_STATE_ENGINE_START | (IceTEnum)0x0046)
+#define RADIXK_TUNE_BEST_TIME   (ICET_STATE_ENGINE_START | (IceTEnum)0x0049)
+#define RADIXK_TUNE_BEST        (ICET_STATE_ENGINE_START | (IceTEnum)0x004A)
+#define RADIXK_TUNE_SLOW_COUNT  (ICET_STATE_ENGINE_START | (IceTEnum)0x004B)
+#define RADIXK_TUNE_FRAME_COUNT (ICET_STATE_ENGINE_START | (IceTEnum)0x004C)
+#define RADIXK_TUNE_TIME_SUM    (ICET_STATE_ENGINE_START | (IceTEnum)0x004D)
 
 typedef struct radixkRoundInfoStruct {
     IceTInt k; /* k value for this round. */
@@ -64,7 +100,7 @@ typedef struct radixkPartnerInfoStruct {
     IceTVoid *receiveBuffer; /* A buffer for receiving data from partner. */
     IceTSparseImage sendImage; /* A buffer to hold data being sent to partner */
     IceTSparseImage receiveImage; /* Hold for received non-composited image. */
-    IceTInt compositeLevel; /* Level in compositing tree for round. */
+    IceTSparseImage *sendChunks; /* Pieces of send image when pipelining. */
 } radixkPartnerInfo;
 
 /* BEGIN_PIVOT_FOR(loop_var, low, pivot, high)...END_PIVOT_FOR() provides a
@@ -124,20 +160,19 @@ static void radixkSwapImages(IceTSparseImage *image1, IceTSparseImage *image2)
    inputs:
      info: holds the number of rounds and k values for each round
      group_rank: my rank in composite order (compose_group in icetRadixkCompose)
+     max_image_split: the most partitions the image may be split into
 
    outputs:
      fills info with split, has_image, and partition_index for each round.
 */
 static void radixkGetPartitionIndices(radixkInfo info,
-                                      IceTInt group_rank)
+                                      IceTInt group_rank,
+                                      IceTInt max_image_split)
 {
 
     IceTInt step; /* step size in rank for a lattice direction */
     IceTInt total_partitions;
     IceTInt current_round;
-    IceTInt max_image_split;
-
-    icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &max_image_split);
 
     total_partitions = 1;
     step = 1;
@@ -172,13 +207,70 @@ static void radixkGetPartitionIndices(radixkInfo info,
 
 }
 
+/* radixkGetNodeSize
+
+   Finds whether the processes of a compose group that share a node form
+   contiguous, equally sized blocks of the group.  If they do, the first round
+   of radix-k can be done entirely among processes on the same node.
+
+   returns:
+     the number of processes per node if ICET_NODE_AWARE_COMPOSITE is enabled
+     and the group spans more than one node in such blocks, 1 otherwise.
+*/
+static IceTInt radixkGetNodeSize(const IceTInt *compose_group,
+                                 IceTInt group_size)
+{
+    const IceTInt *process_nodes;
+    IceTInt node_size;
+    IceTInt group_index;
+
+    if (!icetIsEnabled(ICET_NODE_AWARE_COMPOSITE)) { return 1; }
+    if (icetStateGetType(ICET_PROCESS_NODES) == ICET_NULL) { return 1; }
+
+    process_nodes = icetUnsafeStateGetInteger(ICET_PROCESS_NODES);
+
+    node_size = 1;
+    while (   (node_size < group_size)
+           && (   process_nodes[compose_group[node_size]]
+               == process_nodes[compose_group[0]]) ) {
+        node_size++;
+    }
+    if ((node_size < 2) || (node_size >= group_size)) { return 1; }
+    if ((group_size % node_size) != 0) { return 1; }
+
+    for (group_index = 0; group_index < group_size; group_index++) {
+        IceTInt block_start = group_index - group_index%node_size;
+        if (   process_nodes[compose_group[group_index]]
+            != process_nodes[compose_group[block_start]] ) {
+            return 1;
+        }
+        if (   (block_start > 0)
+            && (   process_nodes[compose_group[block_start]]
+                == process_nodes[compose_group[block_start-1]]) ) {
+            return 1;
+        }
+    }
+
+    return node_size;
+}
+
+/* radixkGetK
+
+   Factors a compose group into the k of each round.  If node_size is greater
+   than 1, it must divide compose_group_size, and the first round uses it as
+   its k so that it happens among processes on the same node.  The rest of
+   the group is factored as close to magic_k as possible, and the image is
+   split into no more than max_image_split partitions.
+*/
 static radixkInfo radixkGetK(IceTInt compose_group_size,
-                             IceTInt group_rank)
+                             IceTInt group_rank,
+                             IceTInt node_size,
+                             IceTInt magic_k,
+                             IceTInt max_image_split)
 {
     /* Divide the world size into groups that are closest to the magic k
        value. */
     radixkInfo info;
-    IceTInt magic_k;
     IceTInt max_num_k;
     IceTInt next_divide;
 
@@ -196,14 +288,17 @@ static radixkInfo radixkGetK(IceTInt compose_group_size,
 
     info.num_rounds = 0;
 
-    icetGetIntegerv(ICET_MAGIC_K, &magic_k);
-
     /* The maximum number of factors possible is the floor of log base 2. */
     max_num_k = radixkFindFloorPow2(compose_group_size);
     info.rounds = icetGetStateBuffer(RADIXK_FACTORS_ARRAY_BUFFER,
                                      sizeof(radixkRoundInfo) * max_num_k);
 
     next_divide = compose_group_size;
+    if ((node_size > 1) && ((compose_group_size % node_size) == 0)) {
+        info.rounds[info.num_rounds].k = node_size;
+        next_divide /= node_size;
+        info.num_rounds++;
+    }
     while (next_divide > 1) {
         IceTInt next_k = -1;
 
@@ -280,7 +375,7 @@ static radixkInfo radixkGetK(IceTInt compose_group_size,
         }
     }
 
-    radixkGetPartitionIndices(info, group_rank);
+    radixkGetPartitionIndices(info, group_rank, max_image_split);
 
     return info;
 }
@@ -406,11 +501,68 @@ static IceTInt radixkGetGroupRankForFinalPartitionIndex(const radixkInfo *info,
     partners: Array of radixkPartnerInfo describing all the processes
         participating in this round.
 */
+/* Returns the number of chunks each image piece is sent in during a round.
+   With more than one, partners composite the chunks that have arrived while
+   the rest are still being transferred.  Only split rounds are pipelined. */
+static IceTInt radixkGetNumChunks(const radixkRoundInfo *round_info,
+                                  IceTInt remaining_partitions,
+                                  IceTSizeType start_size)
+{
+    IceTInt chunk_size;
+    IceTSizeType partition_num_pixels;
+    IceTSizeType smallest_partition;
+    IceTSizeType num_chunks;
+
+    if (!round_info->split) { return 1; }
+
+    icetGetIntegerv(ICET_RADIXK_CHUNK_SIZE, &chunk_size);
+    if (chunk_size < 1) { return 1; }
+
+    partition_num_pixels
+        = icetSparseImageSplitPartitionNumPixels(start_size,
+                                                 round_info->k,
+                                                 remaining_partitions);
+    num_chunks = (partition_num_pixels + chunk_size - 1)/chunk_size;
+    if (num_chunks > RADIXK_MAX_CHUNKS) { num_chunks = RADIXK_MAX_CHUNKS; }
+
+    /* Do not make chunks with no pixels. */
+    smallest_partition = (  (start_size/remaining_partitions)
+                          * (remaining_partitions/round_info->k) );
+    if (num_chunks > smallest_partition) { num_chunks = smallest_partition; }
+
+    return (num_chunks > 1) ? (IceTInt)num_chunks : 1;
+}
+
+/* Returns the most pixels in one chunk of an image piece. */
+static IceTSizeType radixkGetChunkNumPixels(const radixkRoundInfo *round_info,
+                                            IceTInt remaining_partitions,
+                                            IceTSizeType start_size,
+                                            IceTInt num_chunks)
+{
+    IceTSizeType partition_num_pixels;
+
+    if (round_info->split) {
+        partition_num_pixels
+            = icetSparseImageSplitPartitionNumPixels(start_size,
+                                                     round_info->k,
+                                                     remaining_partitions);
+    } else {
+        partition_num_pixels = start_size;
+    }
+
+    if (num_chunks < 2) {
+        return partition_num_pixels;
+    } else {
+        return partition_num_pixels/num_chunks + 1;
+    }
+}
+
 static radixkPartnerInfo *radixkGetPartners(const radixkRoundInfo *round_info,
                                             IceTInt remaining_partitions,
                                             const IceTInt *compose_group,
                                             IceTInt group_rank,
-                                            IceTSizeType start_size)
+                                            IceTSizeType start_size,
+                                            IceTInt num_chunks)
 {
     const IceTInt current_k = round_info->k;
     const IceTInt step = round_info->step;
@@ -421,6 +573,7 @@ static radixkPartnerInfo *radixkGetPartners(const radixkRoundInfo *round_info,
     IceTVoid *send_buf_pool;
     IceTSizeType partition_num_pixels;
     IceTSizeType sparse_image_size;
+    IceTSizeType receive_size;
     IceTInt first_partner_group_rank;
     IceTInt i;
 
@@ -440,9 +593,16 @@ static radixkPartnerInfo *radixkGetPartners(const radixkRoundInfo *round_info,
         sending_data = !receiving_data;
     }
     sparse_image_size = icetSparseImageBufferSize(partition_num_pixels, 1);
+    /* When pipelining, each partner's buffer holds all of its chunks. */
+    receive_size = num_chunks*icetSparseImageBufferSize(
+                                 radixkGetChunkNumPixels(round_info,
+                                                         remaining_partitions,
+                                                         start_size,
+                                                         num_chunks),
+                                 1);
     if (receiving_data) {
         recv_buf_pool = icetGetStateBuffer(RADIXK_RECEIVE_BUFFER,
-                                           sparse_image_size * current_k);
+                                           receive_size * current_k);
     } else {
         recv_buf_pool = NULL;
     }
@@ -467,7 +627,7 @@ static radixkPartnerInfo *radixkGetPartners(const radixkRoundInfo *round_info,
         p->offset = -1;
 
         if (receiving_data) {
-            p->receiveBuffer = ((IceTByte*)recv_buf_pool + i*sparse_image_size);
+            p->receiveBuffer = ((IceTByte*)recv_buf_pool + i*receive_size);
         } else {
             p->receiveBuffer = NULL;
         }
@@ -483,8 +643,8 @@ static radixkPartnerInfo *radixkGetPartners(const radixkRoundInfo *round_info,
         }
 
         p->receiveImage = icetSparseImageNull();
+        p->sendChunks = NULL;
 
-        p->compositeLevel = -1;
     }
 
     return partners;
@@ -496,70 +656,206 @@ static IceTCommRequest *radixkPostReceives(radixkPartnerInfo *partners,
                                            const radixkRoundInfo *round_info,
                                            IceTInt current_round,
                                            IceTInt remaining_partitions,
-                                           IceTSizeType start_size)
+                                           IceTSizeType start_size,
+                                           IceTInt num_chunks)
 {
     IceTCommRequest *receive_requests;
-    IceTSizeType partition_num_pixels;
     IceTSizeType sparse_image_size;
     IceTInt tag;
+    IceTInt chunk;
     IceTInt i;
 
     /* If not collecting any image partition, post no receives. */
     if (!round_info->has_image) { return NULL; }
 
-    receive_requests =icetGetStateBuffer(RADIXK_RECEIVE_REQUEST_BUFFER,
-                                         round_info->k*sizeof(IceTCommRequest));
+    receive_requests = icetGetStateBuffer(
+                         RADIXK_RECEIVE_REQUEST_BUFFER,
+                         num_chunks*round_info->k*sizeof(IceTCommRequest));
 
-    if (round_info->split) {
-        partition_num_pixels
-            = icetSparseImageSplitPartitionNumPixels(start_size,
-                                                     round_info->k,
-                                                     remaining_partitions);
-    } else {
-        partition_num_pixels = start_size;
-    }
-    sparse_image_size = icetSparseImageBufferSize(partition_num_pixels, 1);
+    sparse_image_size = icetSparseImageBufferSize(
+                                 radixkGetChunkNumPixels(round_info,
+                                                         remaining_partitions,
+                                                         start_size,
+                                                         num_chunks),
+                                 1);
 
     tag = RADIXK_SWAP_IMAGE_TAG_START + current_round;
 
-    for (i = 0; i < round_info->k; i++) {
-        radixkPartnerInfo *p = &partners[i];
-        if (i != round_info->partition_index) {
-            receive_requests[i] = icetCommIrecv(p->receiveBuffer,
-                                                sparse_image_size,
-                                                ICET_BYTE,
-                                                p->rank,
-                                                tag);
-            p->compositeLevel = -1;
-        } else {
-            /* No need to send to myself. */
-            receive_requests[i] = ICET_COMM_REQUEST_NULL;
+    /* The chunks from a partner all have the same tag.  Messages between two
+       processes arrive in the order they are sent, so they land in order. */
+    for (chunk = 0; chunk < num_chunks; chunk++) {
+        IceTCommRequest *chunk_requests
+            = receive_requests + chunk*round_info->k;
+        for (i = 0; i < round_info->k; i++) {
+            radixkPartnerInfo *p = &partners[i];
+            if (i != round_info->partition_index) {
+                chunk_requests[i] = icetCommIrecv(
+                              (IceTByte *)p->receiveBuffer
+                                  + chunk*sparse_image_size,
+                              sparse_image_size,
+                              ICET_BYTE,
+                              p->rank,
+                              tag);
+            } else {
+                /* No need to send to myself. */
+                chunk_requests[i] = ICET_COMM_REQUEST_NULL;
+            }
         }
     }
 
     return receive_requests;
 }
 
+/* With opacity culling, each process sends the opacity mask of its own piece
+   to the partners behind it, whose pieces of that partition are composited
+   under it.  The pieces for the partners in front are then replaced by copies
+   without the pixels their masks hide. */
+static void radixkCullOccluded(const radixkPartnerInfo *partners,
+                               const radixkRoundInfo *round_info,
+                               IceTInt current_round,
+                               IceTSparseImage *image_pieces)
+{
+    const IceTInt current_k = round_info->k;
+    const IceTInt me = round_info->partition_index;
+    IceTSizeType max_num_pixels;
+    IceTSizeType max_num_words;
+    IceTSizeType piece_buffer_size;
+    IceTUInt *masks;
+    IceTCommRequest *requests;
+    IceTByte *culled_buffers;
+    IceTInt tag;
+    IceTInt i;
+
+    max_num_pixels = 0;
+    for (i = 0; i < current_k; i++) {
+        IceTSizeType num_pixels = icetSparseImageGetNumPixels(image_pieces[i]);
+        if (num_pixels > max_num_pixels) { max_num_pixels = num_pixels; }
+    }
+    max_num_words = ICET_OPACITY_MASK_WORDS(max_num_pixels);
+
+    masks = icetGetStateBuffer(RADIXK_OPACITY_MASK_BUFFER,
+                               current_k*max_num_words*sizeof(IceTUInt));
+    requests = icetGetStateBuffer(RADIXK_OPACITY_REQUEST_BUFFER,
+                                  current_k*sizeof(IceTCommRequest));
+    tag = RADIXK_OPACITY_MASK_TAG_START + current_round;
+
+    /* Every partner splits an image of the same size the same way, so the
+       piece I hold for a partner has as many pixels as the partner's own. */
+    icetSparseImageOpacityMask(image_pieces[me], masks + me*max_num_words);
+    for (i = 0; i < current_k; i++) {
+        if (i < me) {
+            requests[i] = icetCommIrecv(
+                masks + i*max_num_words,
+                ICET_OPACITY_MASK_WORDS(
+                    icetSparseImageGetNumPixels(image_pieces[i])),
+                ICET_INT,
+                partners[i].rank,
+                tag);
+        } else if (i > me) {
+            requests[i] = icetCommIsend(
+                masks + me*max_num_words,
+                ICET_OPACITY_MASK_WORDS(
+                    icetSparseImageGetNumPixels(image_pieces[me])),
+                ICET_INT,
+                partners[i].rank,
+                tag);
+        } else {
+            requests[i] = ICET_COMM_REQUEST_NULL;
+        }
+    }
+    icetCommWaitall(current_k, requests);
+
+    if (me < 1) return;
+
+    piece_buffer_size = icetSparseImageBufferSize(max_num_pixels, 1);
+    culled_buffers = icetGetStateBuffer(RADIXK_CULLED_IMAGE_BUFFER,
+                                        me*piece_buffer_size);
+    for (i = 0; i < me; i++) {
+        IceTSparseImage culled_image = icetSparseImageAssignBuffer(
+                    culled_buffers + i*piece_buffer_size, max_num_pixels, 1);
+        icetSparseImageCullOccluded(image_pieces[i],
+                                    masks + i*max_num_words,
+                                    culled_image);
+        image_pieces[i] = culled_image;
+    }
+}
+
+/* Splits each image piece into the chunks it is sent in and points the
+   sendChunks of its partner to them. */
+static void radixkSplitChunks(radixkPartnerInfo *partners,
+                              const radixkRoundInfo *round_info,
+                              IceTInt num_chunks,
+                              const IceTSparseImage *image_pieces)
+{
+    const IceTInt num_images = round_info->k*num_chunks;
+    IceTSizeType chunk_num_pixels;
+    IceTSizeType chunk_buffer_size;
+    IceTSparseImage *chunk_images;
+    IceTByte *chunk_buffers;
+    IceTSizeType *chunk_offsets;
+    IceTInt i;
+
+    chunk_num_pixels = 0;
+    for (i = 0; i < round_info->k; i++) {
+        IceTSizeType num_pixels = icetSparseImageGetNumPixels(image_pieces[i]);
+        if (num_pixels > chunk_num_pixels) { chunk_num_pixels = num_pixels; }
+    }
+    chunk_num_pixels = chunk_num_pixels/num_chunks + 1;
+
+    chunk_buffer_size = icetSparseImageBufferSize(chunk_num_pixels, 1);
+    chunk_images = icetGetStateBuffer(
+                                RADIXK_CHUNK_BUFFER,
+                                num_images*(  sizeof(IceTSparseImage)
+                                            + chunk_buffer_size)
+                                + num_chunks*sizeof(IceTSizeType));
+    chunk_buffers = (IceTByte *)(chunk_images + num_images);
+    chunk_offsets
+        = (IceTSizeType *)(chunk_buffers + num_images*chunk_buffer_size);
+
+    for (i = 0; i < round_info->k; i++) {
+        IceTSparseImage *piece_chunks = chunk_images + i*num_chunks;
+        IceTInt chunk;
+        for (chunk = 0; chunk < num_chunks; chunk++) {
+            piece_chunks[chunk] = icetSparseImageAssignBuffer(
+                      chunk_buffers + (i*num_chunks + chunk)*chunk_buffer_size,
+                      chunk_num_pixels, 1);
+        }
+        icetSparseImageSplit(image_pieces[i],
+                             0,
+                             num_chunks,
+                             num_chunks,
+                             piece_chunks,
+                             chunk_offsets);
+        partners[i].sendChunks = piece_chunks;
+    }
+}
+
 /* As applicable, posts an asynchronous send for each process to which we are
-   sending an image piece. */
+   sending an image piece.  If cull_occluded is true, pixels hidden behind the
+   opaque pixels of partners in front are left out of the pieces sent. */
 static IceTCommRequest *radixkPostSends(radixkPartnerInfo *partners,
                                         const radixkRoundInfo *round_info,
                                         IceTInt current_round,
                                         IceTInt remaining_partitions,
                                         IceTSizeType start_offset,
-                                        const IceTSparseImage image)
+                                        IceTInt uncompressed_tile,
+                                        const IceTSparseImage image,
+                                        IceTBoolean cull_occluded,
+                                        IceTInt num_chunks)
 {
     IceTCommRequest *send_requests;
     IceTInt *piece_offsets;
     IceTSparseImage *image_pieces;
     IceTInt tag;
+    IceTInt chunk;
     IceTInt i;
 
     tag = RADIXK_SWAP_IMAGE_TAG_START + current_round;
 
     if (round_info->split) {
-        send_requests=icetGetStateBuffer(RADIXK_SEND_REQUEST_BUFFER,
-                                         round_info->k*sizeof(IceTCommRequest));
+        send_requests = icetGetStateBuffer(
+                            RADIXK_SEND_REQUEST_BUFFER,
+                            num_chunks*round_info->k*sizeof(IceTCommRequest));
 
         piece_offsets = icetGetStateBuffer(RADIXK_SPLIT_OFFSET_ARRAY_BUFFER,
                                            round_info->k * sizeof(IceTInt));
@@ -568,40 +864,66 @@ static IceTCommRequest *radixkPostSends(radixkPartnerInfo *partners,
         for (i = 0; i < round_info->k; i++) {
             image_pieces[i] = partners[i].sendImage;
         }
-        icetSparseImageSplit(image,
-                             start_offset,
-                             round_info->k,
-                             remaining_partitions,
-                             image_pieces,
-                             piece_offsets);
+        if (uncompressed_tile >= 0) {
+            /* First round.  Compress straight into the pieces. */
+            icetGetCompressedTileImageSplit(uncompressed_tile,
+                                            round_info->k,
+                                            remaining_partitions,
+                                            image_pieces,
+                                            piece_offsets);
+        } else {
+            icetSparseImageSplit(image,
+                                 start_offset,
+                                 round_info->k,
+                                 remaining_partitions,
+                                 image_pieces,
+                                 piece_offsets);
+        }
+
+        if (cull_occluded) {
+            radixkCullOccluded(partners, round_info, current_round,
+                               image_pieces);
+        }
+
+        if (num_chunks > 1) {
+            radixkSplitChunks(partners, round_info, num_chunks, image_pieces);
+        }
 
         /* The pivot for loop arranges the sends to happen in an order such that
            those to be composited first in their destinations will be sent
            first.  This serves little purpose other than to try to stagger the
            order of sending images so that no everyone sends to the same process
-           first. */
-        BEGIN_PIVOT_FOR(i, 0, round_info->partition_index, round_info->k) {
-            radixkPartnerInfo *p = &partners[i];
-            p->offset = piece_offsets[i];
-            if (i != round_info->partition_index) {
-                IceTVoid *package_buffer;
-                IceTSizeType package_size;
-
-                icetSparseImagePackageForSend(image_pieces[i],
-                                              &package_buffer, &package_size);
-
-                send_requests[i] = icetCommIsend(package_buffer,
-                                                 package_size,
-                                                 ICET_BYTE,
-                                                 p->rank,
-                                                 tag);
-            } else {
-                /* Implicitly send to myself. */
-                send_requests[i] = ICET_COMM_REQUEST_NULL;
-                p->receiveImage = p->sendImage;
-                p->compositeLevel = 0;
-            }
-        } END_PIVOT_FOR();
+           first.  When pipelining, the first chunk goes to every partner
+           before the second so that all partners can start compositing. */
+        for (chunk = 0; chunk < num_chunks; chunk++) {
+            IceTCommRequest *chunk_requests
+                = send_requests + chunk*round_info->k;
+            BEGIN_PIVOT_FOR(i, 0, round_info->partition_index, round_info->k) {
+                radixkPartnerInfo *p = &partners[i];
+                p->offset = piece_offsets[i];
+                if (i != round_info->partition_index) {
+                    IceTSparseImage send_image;
+                    IceTVoid *package_buffer;
+                    IceTSizeType package_size;
+
+                    send_image = (num_chunks > 1)
+                        ? p->sendChunks[chunk] : image_pieces[i];
+                    icetSparseImagePackageForSend(send_image,
+                                                  &package_buffer,
+                                                  &package_size);
+
+                    chunk_requests[i] = icetCommIsend(package_buffer,
+                                                      package_size,
+                                                      ICET_BYTE,
+                                                      p->rank,
+                                                      tag);
+                } else {
+                    /* Implicitly send to myself. */
+                    chunk_requests[i] = ICET_COMM_REQUEST_NULL;
+                    p->receiveImage = p->sendImage;
+                }
+            } END_PIVOT_FOR();
+        }
     } else { /* !round_info->split */
         radixkPartnerInfo *p = &partners[round_info->partition_index];
         send_requests = icetGetStateBuffer(RADIXK_SEND_REQUEST_BUFFER,
@@ -610,7 +932,6 @@ static IceTCommRequest *radixkPostSends(radixkPartnerInfo *partners,
             send_requests[0] = ICET_COMM_REQUEST_NULL;
             p->receiveImage = p->sendImage = image;
             p->offset = start_offset;
-            p->compositeLevel = 0;
         } else {
             IceTVoid *package_buffer;
             IceTSizeType package_size;
@@ -631,68 +952,87 @@ static IceTCommRequest *radixkPostSends(radixkPartnerInfo *partners,
     return send_requests;
 }
 
-/* When compositing incoming images, we pair up the images and composite in
-   a tree.  This minimizes the amount of times non-overlapping pixels need
-   to be copied.  Returns true when all images are composited */
-static IceTBoolean radixkTryCompositeIncoming(radixkPartnerInfo *partners,
-                                              const radixkRoundInfo *round_info,
-                                              IceTInt incoming_index,
-                                              IceTSparseImage *spare_image_p,
-                                              IceTSparseImage final_image)
+/* The incoming images of a round are split into groups of about sqrt(k)
+   neighbors in fold order.  Each group is composited as soon as all of its
+   images are in, while the images of other groups are still arriving, and
+   the group results are then composited into the final image.  Every pixel is
+   written at most twice no matter how big k is. */
+static IceTInt radixkFoldGroupSize(IceTInt k)
 {
-    const IceTInt current_k = round_info->k;
-    IceTSparseImage spare_image = *spare_image_p;
-    IceTInt to_composite_index = incoming_index;
-
-    while (ICET_TRUE) {
-        IceTInt level = partners[to_composite_index].compositeLevel;
-        IceTInt dist_to_sibling = (1 << level);
-        IceTInt subtree_size = (dist_to_sibling << 1);
-        IceTInt front_index;
-        IceTInt back_index;
-
-        if (to_composite_index%subtree_size == 0) {
-            front_index = to_composite_index;
-            back_index = to_composite_index + dist_to_sibling;
-
-            if (back_index >= current_k) {
-                /* This image has no partner at this level.  Just promote
-                   the level and continue. */
-                if (front_index == 0) {
-                    /* Special case.  When index 0 has no partner, we must
-                       be at the top of the tree and we are done. */
-                    break;
-                }
-                partners[to_composite_index].compositeLevel++;
-                continue;
-            }
-        } else {
-            back_index = to_composite_index;
-            front_index = to_composite_index - dist_to_sibling;
-        }
+    IceTInt group_size = 2;
+    while (group_size*group_size < k) { group_size++; }
+    return group_size;
+}
 
-        if (   partners[front_index].compositeLevel
-            != partners[back_index].compositeLevel ) {
-            /* Paired images are not on the same level.  Cannot composite
-               until more images come in.  We are done for now. */
-            break;
-        }
+static IceTInt radixkFoldNumGroups(IceTInt k)
+{
+    IceTInt group_size = radixkFoldGroupSize(k);
+    return (k + group_size - 1)/group_size;
+}
 
-        if ((front_index == 0) && (subtree_size >= current_k)) {
-            /* This will be the last image composited.  Composite to final
-               location. */
-            spare_image = final_image;
-        }
-        icetCompressedCompressedComposite(partners[front_index].receiveImage,
-                                          partners[back_index].receiveImage,
-                                          spare_image);
-        radixkSwapImages(&partners[front_index].receiveImage, &spare_image);
-        partners[front_index].compositeLevel++;
-        to_composite_index = front_index;
+/* Composites num_images images, ordered from front to back, into
+   dest_image. */
+static void radixkCompositeImages(const IceTSparseImage *images,
+                                  IceTInt num_images,
+                                  IceTSparseImage dest_image)
+{
+    if (num_images > 2) {
+        icetCompressedMultiComposite(images, num_images, dest_image);
+    } else if (num_images == 2) {
+        icetCompressedCompressedComposite(images[0], images[1], dest_image);
+    } else if (!icetSparseImageEqual(images[0], dest_image)) {
+        icetSparseImageCopyPixels(images[0],
+                                  0,
+                                  icetSparseImageGetNumPixels(images[0]),
+                                  dest_image);
+    }
+}
+
+/* Records the image of the partner at index, which starts out as a null image
+   in images.  When that completes a group, the group is composited into
+   spare_image, which then takes the buffer of the first image of the group.
+   When it completes the last group, the group results are composited into
+   final_image.  Returns true when final_image is done. */
+static IceTBoolean radixkFoldIncoming(IceTSparseImage *images,
+                                      IceTInt k,
+                                      IceTInt index,
+                                      IceTSparseImage incoming_image,
+                                      IceTSparseImage *spare_image_p,
+                                      IceTSparseImage final_image,
+                                      IceTInt *groups_left_p)
+{
+    IceTInt group_size = radixkFoldGroupSize(k);
+    IceTInt num_groups = radixkFoldNumGroups(k);
+    IceTInt first = (index/group_size)*group_size;
+    IceTInt count = k - first;
+    IceTInt i;
+
+    if (count > group_size) { count = group_size; }
+
+    images[index] = incoming_image;
+    for (i = first; i < first + count; i++) {
+        if (icetSparseImageIsNull(images[i])) { return ICET_FALSE; }
     }
 
-    *spare_image_p = spare_image;
-    return ((1 << partners[0].compositeLevel) >= current_k);
+    if (num_groups == 1) {
+        radixkCompositeImages(images, k, final_image);
+        return ICET_TRUE;
+    }
+
+    if (count > 1) {
+        radixkCompositeImages(images + first, count, *spare_image_p);
+        radixkSwapImages(&images[first], spare_image_p);
+    }
+
+    (*groups_left_p)--;
+    if (*groups_left_p > 0) { return ICET_FALSE; }
+
+    /* Each group result is in the first image of its group. */
+    for (i = 1; i < num_groups; i++) {
+        images[i] = images[i*group_size];
+    }
+    radixkCompositeImages(images, num_groups, final_image);
+    return ICET_TRUE;
 }
 
 static void radixkCompositeIncomingImages(radixkPartnerInfo *partners,
@@ -700,10 +1040,13 @@ static void radixkCompositeIncomingImages(radixkPartnerInfo *partners,
                                           const radixkRoundInfo *round_info,
                                           IceTSparseImage image)
 {
+    const IceTInt current_k = round_info->k;
     radixkPartnerInfo *me = &partners[round_info->partition_index];
 
+    IceTSparseImage *incoming_images;
     IceTSparseImage spare_image;
-    IceTInt total_composites;
+    IceTInt groups_left;
+    IceTInt partner_idx;
 
     IceTSizeType width;
     IceTSizeType height;
@@ -715,49 +1058,49 @@ static void radixkCompositeIncomingImages(radixkPartnerInfo *partners,
         return;
     }
 
-    /* Regardless of order, there are k-1 composite operations to perform. */
-    total_composites = round_info->k - 1;
-
-    /* We will be reusing buffers like crazy, but we'll need at least one more
-       for the first composite, assuming we have at least two composites. */
     width = icetSparseImageGetWidth(me->sendImage);
     height = icetSparseImageGetHeight(me->sendImage);
-    if (total_composites >= 2) {
-        spare_image = icetGetStateBufferSparseImage(RADIXK_SPARE_BUFFER,
-                                                    width,
-                                                    height);
-    } else {
-        spare_image = icetSparseImageNull();
+
+    /* Grumble.  Stupid special case where the result goes in the same image as
+       my send image (which can happen when not splitting).  Nothing is
+       received from myself, so move my image to my own receive buffer. */
+    if (icetSparseImageEqual(me->sendImage, image)) {
+        IceTSparseImage my_image
+            = icetSparseImageAssignBuffer(me->receiveBuffer, width, height);
+        icetSparseImageCopyPixels(image, 0, width*height, my_image);
+        me->receiveImage = me->sendImage = my_image;
     }
 
-    /* Grumble.  Stupid special case where there is only one composite and
-       we want the result to go in the same image as my send image (which can
-       happen when not splitting). */
-    if (icetSparseImageEqual(me->sendImage,image) && (total_composites < 2)) {
+    incoming_images = icetGetStateBuffer(RADIXK_INCOMING_IMAGE_ARRAY_BUFFER,
+                                         sizeof(IceTSparseImage)*current_k);
+    for (partner_idx = 0; partner_idx < current_k; partner_idx++) {
+        incoming_images[partner_idx] = icetSparseImageNull();
+    }
+    groups_left = radixkFoldNumGroups(current_k);
+    if (groups_left > 1) {
         spare_image = icetGetStateBufferSparseImage(RADIXK_SPARE_BUFFER,
                                                     width,
                                                     height);
-        icetSparseImageCopyPixels(me->sendImage, 0, width*height, spare_image);
-        me->sendImage = spare_image;
+    } else {
+        spare_image = icetSparseImageNull();
     }
 
-    /* Start by trying to composite the implicit receive from myself.  It won't
-       actually composite anything, but it may change the composite level.  It
-       will also defensively set composites_done correctly. */
-    composites_done = radixkTryCompositeIncoming(partners,
-                                                 round_info,
-                                                 round_info->partition_index,
-                                                 &spare_image,
-                                                 image);
+    /* Start with the implicit receive from myself. */
+    composites_done = radixkFoldIncoming(incoming_images,
+                                         current_k,
+                                         round_info->partition_index,
+                                         me->sendImage,
+                                         &spare_image,
+                                         image,
+                                         &groups_left);
 
     while (!composites_done) {
         IceTInt receive_idx;
         radixkPartnerInfo *receiver;
 
         /* Wait for an image to come in. */
-        receive_idx = icetCommWaitany(round_info->k, receive_requests);
+        receive_idx = icetCommWaitany(current_k, receive_requests);
         receiver = &partners[receive_idx];
-        receiver->compositeLevel = 0;
         receiver->receiveImage
             = icetSparseImageUnpackageFromReceive(receiver->receiveBuffer);
         if (   (icetSparseImageGetWidth(receiver->receiveImage) != width)
@@ -766,18 +1109,112 @@ static void radixkCompositeIncomingImages(radixkPartnerInfo *partners,
                            ICET_SANITY_CHECK_FAIL);
         }
 
-        /* Try to composite that image. */
-        composites_done = radixkTryCompositeIncoming(partners,
-                                                     round_info,
-                                                     receive_idx,
-                                                     &spare_image,
-                                                     image);
+        /* Composite it with its group if the group is complete. */
+        composites_done = radixkFoldIncoming(incoming_images,
+                                             current_k,
+                                             receive_idx,
+                                             receiver->receiveImage,
+                                             &spare_image,
+                                             image,
+                                             &groups_left);
     }
 }
 
+/* Composites the pieces of a pipelined round one chunk at a time.  The images
+   of each chunk are composited in groups as they arrive, like those of a
+   round that is not pipelined, while the later chunks are still in flight.
+   The chunk is then appended to image. */
+static void radixkCompositeIncomingChunks(radixkPartnerInfo *partners,
+                                          IceTCommRequest *receive_requests,
+                                          const radixkRoundInfo *round_info,
+                                          IceTInt num_chunks,
+                                          IceTSizeType chunk_num_pixels,
+                                          IceTSparseImage image)
+{
+    const IceTInt current_k = round_info->k;
+    radixkPartnerInfo *me = &partners[round_info->partition_index];
+    IceTSizeType chunk_buffer_size;
+    IceTSparseImage *incoming_images;
+    IceTSparseImage chunk_image;
+    IceTInt chunk;
+
+    chunk_buffer_size = icetSparseImageBufferSize(chunk_num_pixels, 1);
+    incoming_images = icetGetStateBuffer(RADIXK_INCOMING_IMAGE_ARRAY_BUFFER,
+                                         sizeof(IceTSparseImage)*current_k);
+    chunk_image = icetGetStateBufferSparseImage(RADIXK_SPARE_BUFFER,
+                                                chunk_num_pixels,
+                                                1);
+
+    for (chunk = 0; chunk < num_chunks; chunk++) {
+        IceTSparseImage my_chunk = me->sendChunks[chunk];
+        IceTSparseImage dest_image = (chunk == 0) ? image : chunk_image;
+        IceTCommRequest *chunk_requests = receive_requests + chunk*current_k;
+        IceTSparseImage spare_image;
+        IceTInt groups_left;
+        IceTBoolean composites_done;
+        IceTInt partner_idx;
+
+        for (partner_idx = 0; partner_idx < current_k; partner_idx++) {
+            incoming_images[partner_idx] = icetSparseImageNull();
+        }
+        groups_left = radixkFoldNumGroups(current_k);
+
+        /* Nothing is received from myself, so my own slot of the receive
+           buffer holds the group results. */
+        spare_image = icetSparseImageAssignBuffer(
+                                          (IceTByte *)me->receiveBuffer
+                                              + chunk*chunk_buffer_size,
+                                          chunk_num_pixels,
+                                          1);
+
+        composites_done = radixkFoldIncoming(incoming_images,
+                                             current_k,
+                                             round_info->partition_index,
+                                             my_chunk,
+                                             &spare_image,
+                                             dest_image,
+                                             &groups_left);
+
+        while (!composites_done) {
+            IceTInt receive_idx;
+            radixkPartnerInfo *receiver;
+            IceTSparseImage incoming_chunk;
+
+            receive_idx = icetCommWaitany(current_k, chunk_requests);
+            receiver = &partners[receive_idx];
+            incoming_chunk = icetSparseImageUnpackageFromReceive(
+                                          (IceTByte *)receiver->receiveBuffer
+                                              + chunk*chunk_buffer_size);
+            if (   icetSparseImageGetNumPixels(incoming_chunk)
+                != icetSparseImageGetNumPixels(my_chunk) ) {
+                icetRaiseError("Radix-k received image with wrong size.",
+                               ICET_SANITY_CHECK_FAIL);
+            }
+
+            composites_done = radixkFoldIncoming(incoming_images,
+                                                 current_k,
+                                                 receive_idx,
+                                                 incoming_chunk,
+                                                 &spare_image,
+                                                 dest_image,
+                                                 &groups_left);
+        }
+
+        if (chunk > 0) {
+            icetSparseImageAppend(image, chunk_image);
+        }
+    }
+}
+
+/* If uncompressed_tile is not negative, working_image holds no pixels yet and
+   that tile is rendered and compressed into the pieces of the first round.  The
+   image is split into no more than total_num_partitions pieces. */
 static void icetRadixkBasicCompose(const IceTInt *compose_group,
                                    IceTInt group_size,
+                                   IceTInt node_size,
+                                   IceTInt magic_k,
                                    IceTInt total_num_partitions,
+                                   IceTInt uncompressed_tile,
                                    IceTSparseImage working_image,
                                    IceTSizeType *piece_offset)
 {
@@ -786,6 +1223,8 @@ static void icetRadixkBasicCompose(const IceTInt *compose_group,
     IceTSizeType my_offset;
     IceTInt current_round;
     IceTInt remaining_partitions;
+    IceTEnum composite_mode;
+    IceTBoolean cull_occluded;
 
     /* Find your rank in your group. */
     IceTInt group_rank = icetFindMyRankInGroup(compose_group, group_size);
@@ -799,11 +1238,22 @@ static void icetRadixkBasicCompose(const IceTInt *compose_group,
     if (group_size == 1) {
         /* I am the only process in the group.  No compositing to be done.
          * Just return and the image will be complete. */
+        if (uncompressed_tile >= 0) {
+            icetGetCompressedTileImage(uncompressed_tile, working_image);
+        }
         *piece_offset = 0;
         return;
     }
 
-    info = radixkGetK(group_size, group_rank);
+    info = radixkGetK(group_size,
+                      group_rank,
+                      node_size,
+                      magic_k,
+                      total_num_partitions);
+
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    cull_occluded = (   icetIsEnabled(ICET_OPACITY_CULLING)
+                     && (composite_mode == ICET_COMPOSITE_MODE_BLEND) );
 
     /* num_rounds > 0 is assumed several places throughout this function */
     if (info.num_rounds <= 0) {
@@ -820,34 +1270,62 @@ static void icetRadixkBasicCompose(const IceTInt *compose_group,
     for (current_round = 0; current_round < info.num_rounds; current_round++) {
         IceTSizeType my_size = icetSparseImageGetNumPixels(working_image);
         const radixkRoundInfo *round_info = &info.rounds[current_round];
+        IceTInt num_chunks = radixkGetNumChunks(round_info,
+                                                remaining_partitions,
+                                                my_size);
         radixkPartnerInfo *partners = radixkGetPartners(round_info,
                                                         remaining_partitions,
                                                         compose_group,
                                                         group_rank,
-                                                        my_size);
+                                                        my_size,
+                                                        num_chunks);
         IceTCommRequest *receive_requests;
         IceTCommRequest *send_requests;
 
+        if (!round_info->split && (uncompressed_tile >= 0)) {
+            /* Only split rounds compress straight into the pieces. */
+            icetGetCompressedTileImage(uncompressed_tile, working_image);
+            uncompressed_tile = -1;
+        }
+
         receive_requests = radixkPostReceives(partners,
                                               round_info,
                                               current_round,
                                               remaining_partitions,
-                                              my_size);
+                                              my_size,
+                                              num_chunks);
 
         send_requests = radixkPostSends(partners,
                                         round_info,
                                         current_round,
                                         remaining_partitions,
                                         my_offset,
-                                        working_image);
-
-        radixkCompositeIncomingImages(partners,
-                                      receive_requests,
-                                      round_info,
-                                      working_image);
+                                        uncompressed_tile,
+                                        working_image,
+                                        cull_occluded,
+                                        num_chunks);
+        uncompressed_tile = -1;
+
+        if (num_chunks > 1) {
+            radixkCompositeIncomingChunks(partners,
+                                          receive_requests,
+                                          round_info,
+                                          num_chunks,
+                                          radixkGetChunkNumPixels(
+                                              round_info,
+                                              remaining_partitions,
+                                              my_size,
+                                              num_chunks),
+                                          working_image);
+        } else {
+            radixkCompositeIncomingImages(partners,
+                                          receive_requests,
+                                          round_info,
+                                          working_image);
+        }
 
         if (round_info->split) {
-            icetCommWaitall(round_info->k, send_requests);
+            icetCommWaitall(num_chunks*round_info->k, send_requests);
         } else {
             icetCommWait(&send_requests[0]);
         }
@@ -870,7 +1348,9 @@ static IceTInt icetRadixkTelescopeFindUpperGroupSender(
                                                      const IceTInt *my_group,
                                                      IceTInt my_group_size,
                                                      const IceTInt *upper_group,
-                                                     IceTInt upper_group_size)
+                                                     IceTInt upper_group_size,
+                                                     IceTInt magic_k,
+                                                     IceTInt max_image_split)
 {
     radixkInfo info;
     IceTInt my_group_rank;
@@ -882,7 +1362,11 @@ static IceTInt icetRadixkTelescopeFindUpperGroupSender(
     IceTInt sender_group_rank;
 
     my_group_rank = icetFindMyRankInGroup(my_group, my_group_size);
-    info = radixkGetK(my_group_size, my_group_rank);
+    info = radixkGetK(my_group_size,
+                      my_group_rank,
+                      1,
+                      magic_k,
+                      max_image_split);
 
     my_partition_index = radixkGetFinalPartitionIndex(&info);
     if (my_partition_index < 0) {
@@ -892,7 +1376,11 @@ static IceTInt icetRadixkTelescopeFindUpperGroupSender(
 
     my_num_partitions = radixkGetTotalNumPartitions(&info);
 
-    info = radixkGetK(radixkFindPower2(upper_group_size), 0);
+    info = radixkGetK(radixkFindPower2(upper_group_size),
+                      0,
+                      1,
+                      magic_k,
+                      max_image_split);
     upper_num_partitions = radixkGetTotalNumPartitions(&info);
     group_difference_factor = my_num_partitions/upper_num_partitions;
 
@@ -909,6 +1397,8 @@ static void icetRadixkTelescopeFindLowerGroupReceivers(
                                                      IceTInt lower_group_size,
                                                      const IceTInt *my_group,
                                                      IceTInt my_group_size,
+                                                     IceTInt magic_k,
+                                                     IceTInt max_image_split,
                                                      IceTInt **receiver_ranks_p,
                                                      IceTInt *num_receivers_p)
 {
@@ -922,7 +1412,11 @@ static void icetRadixkTelescopeFindLowerGroupReceivers(
     IceTInt *receiver_ranks;
     IceTInt receiver_idx;
 
-    info = radixkGetK(my_group_size, my_group_rank);
+    info = radixkGetK(my_group_size,
+                      my_group_rank,
+                      1,
+                      magic_k,
+                      max_image_split);
     my_num_partitions = radixkGetTotalNumPartitions(&info);
     my_partition_index = radixkGetFinalPartitionIndex(&info);
     if (my_partition_index < 0) {
@@ -931,7 +1425,7 @@ static void icetRadixkTelescopeFindLowerGroupReceivers(
         return;
     }
 
-    info = radixkGetK(lower_group_size, 0);
+    info = radixkGetK(lower_group_size, 0, 1, magic_k, max_image_split);
     lower_num_partitions = radixkGetTotalNumPartitions(&info);
     num_receivers = lower_num_partitions/my_num_partitions;
     receiver_ranks = icetGetStateBuffer(RADIXK_RANK_LIST_BUFFER,
@@ -952,10 +1446,13 @@ static void icetRadixkTelescopeFindLowerGroupReceivers(
 
 static void icetRadixkTelescopeComposeReceive(const IceTInt *my_group,
                                               IceTInt my_group_size,
+                                              IceTInt node_size,
+                                              IceTInt magic_k,
                                               const IceTInt *upper_group,
                                               IceTInt upper_group_size,
                                               IceTInt total_num_partitions,
                                               IceTBoolean local_in_front,
+                                              IceTInt uncompressed_tile,
                                               IceTSparseImage input_image,
                                               IceTSparseImage *result_image,
                                               IceTSizeType *piece_offset)
@@ -966,7 +1463,10 @@ static void icetRadixkTelescopeComposeReceive(const IceTInt *my_group,
     /* Start with the basic compose of my group. */
     icetRadixkBasicCompose(my_group,
                            my_group_size,
+                           node_size,
+                           magic_k,
                            total_num_partitions,
+                           uncompressed_tile,
                            working_image,
                            piece_offset);
 
@@ -975,7 +1475,9 @@ static void icetRadixkTelescopeComposeReceive(const IceTInt *my_group,
             = icetRadixkTelescopeFindUpperGroupSender(my_group,
                                                       my_group_size,
                                                       upper_group,
-                                                      upper_group_size);
+                                                      upper_group_size,
+                                                      magic_k,
+                                                      total_num_partitions);
     } else {
         upper_sender = -1;
     }
@@ -1031,7 +1533,9 @@ static void icetRadixkTelescopeComposeSend(const IceTInt *lower_group,
                                            IceTInt lower_group_size,
                                            const IceTInt *my_group,
                                            IceTInt my_group_size,
+                                           IceTInt magic_k,
                                            IceTInt total_num_partitions,
+                                           IceTInt uncompressed_tile,
                                            IceTSparseImage input_image)
 {
     const IceTInt *main_group;
@@ -1067,16 +1571,23 @@ static void icetRadixkTelescopeComposeSend(const IceTInt *lower_group,
 
         icetRadixkTelescopeComposeReceive(main_group,
                                           main_group_size,
+                                          1,
+                                          magic_k,
                                           sub_group,
                                           sub_group_size,
                                           total_num_partitions,
                                           main_in_front,
+                                          uncompressed_tile,
                                           input_image,
                                           &working_image,
                                           &piece_offset);
 
         {
-            radixkInfo info = radixkGetK(main_group_size, 0);
+            radixkInfo info = radixkGetK(main_group_size,
+                                         0,
+                                         1,
+                                         magic_k,
+                                         total_num_partitions);
             num_local_partitions = radixkGetTotalNumPartitions(&info);
         }
 
@@ -1084,6 +1595,8 @@ static void icetRadixkTelescopeComposeSend(const IceTInt *lower_group,
                                                    lower_group_size,
                                                    main_group,
                                                    main_group_size,
+                                                   magic_k,
+                                                   total_num_partitions,
                                                    &receiver_ranks,
                                                    &num_receivers);
 
@@ -1154,7 +1667,9 @@ static void icetRadixkTelescopeComposeSend(const IceTInt *lower_group,
                                        main_group_size,
                                        sub_group,
                                        sub_group_size,
+                                       magic_k,
                                        total_num_partitions,
+                                       uncompressed_tile,
                                        input_image);
     }
 }
@@ -1162,6 +1677,9 @@ static void icetRadixkTelescopeComposeSend(const IceTInt *lower_group,
 static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
                                        IceTInt group_size,
                                        IceTInt image_dest,
+                                       IceTInt magic_k,
+                                       IceTInt max_image_split,
+                                       IceTInt uncompressed_tile,
                                        IceTSparseImage input_image,
                                        IceTSparseImage *result_image,
                                        IceTSizeType *piece_offset)
@@ -1174,12 +1692,20 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
     IceTBoolean use_interlace;
     IceTInt main_group_rank;
     IceTInt total_num_partitions;
-    IceTInt save_max_image_split;
+    IceTInt node_size;
 
     IceTSparseImage working_image = input_image;
     IceTSizeType original_image_size = icetSparseImageGetNumPixels(input_image);
 
-    main_group_size = radixkFindPower2(group_size);
+    /* If the group is laid out by node, composite it all at once so that the
+       first round stays on each node.  Otherwise, split off a power of two
+       group and telescope the rest into it. */
+    node_size = radixkGetNodeSize(compose_group, group_size);
+    if (node_size > 1) {
+        main_group_size = group_size;
+    } else {
+        main_group_size = radixkFindPower2(group_size);
+    }
     sub_group_size = group_size - main_group_size;
     /* Simple optimization to put image_dest in main group so that it has at
        least some data. */
@@ -1198,30 +1724,36 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
        partitions. */
     {
         /* Middle argument does not matter. */
-        radixkInfo info = radixkGetK(main_group_size, 0);
+        radixkInfo info = radixkGetK(main_group_size,
+                                     0,
+                                     node_size,
+                                     magic_k,
+                                     max_image_split);
         total_num_partitions = radixkGetTotalNumPartitions(&info);
     }
 
     /* This is a corner case I found.  It is possible for the main group to have
        a smaller number of partitions than the sub group when the sub group
        causes a smaller k in the last room that fits within the max image split.
-       To prevent this from happening, temporarily set the max image split to
-       the total number of partitions we know we are using. */
-    icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &save_max_image_split);
-    icetStateSetInteger(ICET_MAX_IMAGE_SPLIT, total_num_partitions);
+       To prevent this from happening, the rest of the compositing uses the
+       total number of partitions we know we are using as the max image
+       split. */
 
     /* Since we know the number of final pieces we will create, now is a good
        place to interlace the image (and then later adjust the offset. */
-    {
-        IceTInt magic_k;
-        use_interlace = icetIsEnabled(ICET_INTERLACE_IMAGES);
-
-        icetGetIntegerv(ICET_MAGIC_K, &magic_k);
-        use_interlace &= (total_num_partitions > magic_k);
-    }
-
-    if (use_interlace) {
-        IceTSparseImage interlaced_image = icetGetStateBufferSparseImage(
+    use_interlace = icetIsEnabled(ICET_INTERLACE_IMAGES);
+    use_interlace &= (total_num_partitions > magic_k);
+
+    if (use_interlace && (uncompressed_tile >= 0)) {
+        /* Compress straight into the interlaced order. */
+        icetGetCompressedTileImageInterlace(uncompressed_tile,
+                                            total_num_partitions,
+                                            RADIXK_SPLIT_OFFSET_ARRAY_BUFFER,
+                                            working_image);
+        uncompressed_tile = -1;
+    } else if (use_interlace) {
+        IceTSparseImage interlaced_image;
+        interlaced_image = icetGetStateBufferSparseImage(
                                        RADIXK_INTERLACED_IMAGE_BUFFER,
                                        icetSparseImageGetWidth(working_image),
                                        icetSparseImageGetHeight(working_image));
@@ -1237,10 +1769,13 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
         /* In the main group. */
         icetRadixkTelescopeComposeReceive(main_group,
                                           main_group_size,
+                                          node_size,
+                                          magic_k,
                                           sub_group,
                                           sub_group_size,
                                           total_num_partitions,
                                           main_in_front,
+                                          uncompressed_tile,
                                           working_image,
                                           result_image,
                                           piece_offset);
@@ -1250,15 +1785,14 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
                                        main_group_size,
                                        sub_group,
                                        sub_group_size,
+                                       magic_k,
                                        total_num_partitions,
+                                       uncompressed_tile,
                                        working_image);
         *result_image = icetSparseImageNull();
         *piece_offset = 0;
     }
 
-    /* Restore the true image split. */
-    icetStateSetInteger(ICET_MAX_IMAGE_SPLIT, save_max_image_split);
-
     /* If we interlaced the image and are actually returning something,
        correct the offset. */
     if (use_interlace && (0 < icetSparseImageGetNumPixels(*result_image))) {
@@ -1272,7 +1806,10 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
         }
 
         info = radixkGetK(main_group_size,
-                          main_group_rank);
+                          main_group_rank,
+                          node_size,
+                          magic_k,
+                          total_num_partitions);
 
         global_partition = radixkGetFinalPartitionIndex(&info);
         *piece_offset = icetGetInterlaceOffset(global_partition,
@@ -1284,27 +1821,288 @@ static void icetRadixkTelescopeCompose(const IceTInt *compose_group,
 }
 
 
+void icetRadixkPrepare(void)
+{
+    IceTInt num_proc;
+    IceTInt node;
+    IceTInt *process_nodes;
+
+    if (!icetIsEnabled(ICET_NODE_AWARE_COMPOSITE)) { return; }
+
+    /* Finding the nodes is collective and takes a few messages, so it is done
+       only once for the communicator of this context. */
+    if (icetStateGetType(ICET_PROCESS_NODES) != ICET_NULL) { return; }
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    node = icetCommNode();
+    process_nodes = icetStateAllocateInteger(ICET_PROCESS_NODES, num_proc);
+    icetCommAllgather(&node, 1, ICET_INT, process_nodes);
+}
+
 void icetRadixkCompose(const IceTInt *compose_group,
                        IceTInt group_size,
                        IceTInt image_dest,
+                       IceTInt uncompressed_tile,
                        IceTSparseImage input_image,
                        IceTSparseImage *result_image,
                        IceTSizeType *piece_offset)
 {
+    IceTInt magic_k;
+    IceTInt max_image_split;
+
+    icetGetIntegerv(ICET_MAGIC_K, &magic_k);
+    icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &max_image_split);
+
+    /* When tuning, use the k and maximum image split the tuner picked for
+       this frame instead. */
+    if (icetIsEnabled(ICET_RADIXK_AUTO_TUNE)) {
+        IceTInt tuned_magic_k;
+        icetGetIntegerv(ICET_RADIXK_TUNED_MAGIC_K, &tuned_magic_k);
+        if (tuned_magic_k > 1) {
+            magic_k = tuned_magic_k;
+            icetGetIntegerv(ICET_RADIXK_TUNED_MAX_IMAGE_SPLIT,
+                            &max_image_split);
+        }
+    }
+
     icetRadixkTelescopeCompose(compose_group,
                                group_size,
                                image_dest,
+                               magic_k,
+                               max_image_split,
+                               uncompressed_tile,
                                input_image,
                                result_image,
                                piece_offset);
 }
 
-static IceTBoolean radixkTryPartitionLookup(IceTInt group_size)
+/* radixkTuneGetCandidate
+
+   The tuner tries each power of two k up to 32 (and no larger than the number
+   of processes) with no limit on the image split and with a couple of smaller
+   limits.  This finds the pair with the given index.
+
+   returns:
+     true if there is a candidate with that index, false otherwise.
+*/
+static IceTBoolean radixkTuneGetCandidate(IceTInt candidate,
+                                          IceTInt *magic_k,
+                                          IceTInt *max_image_split)
+{
+    IceTInt splits[3];
+    IceTInt num_proc;
+    IceTInt k;
+    IceTInt index;
+
+    splits[0] = ICET_MAX_IMAGE_SPLIT_DEFAULT;
+    splits[1] = 64;
+    splits[2] = 16;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    index = 0;
+    for (k = 2; (k <= 32) && ((k == 2) || (k <= num_proc)); k *= 2) {
+        int split_index;
+        for (split_index = 0; split_index < 3; split_index++) {
+            IceTInt split = splits[split_index];
+
+            /* Smaller limits only matter if some group can split further. */
+            if (   (split_index > 0)
+                && ((split >= num_proc) || (split >= splits[0])) ) {
+                continue;
+            }
+
+            if (index == candidate) {
+                *magic_k = k;
+                *max_image_split = split;
+                return ICET_TRUE;
+            }
+            index++;
+        }
+    }
+
+    return ICET_FALSE;
+}
+
+static void radixkTuneUseCandidate(IceTInt candidate)
+{
+    IceTInt magic_k;
+    IceTInt max_image_split;
+
+    if (!radixkTuneGetCandidate(candidate, &magic_k, &max_image_split)) {
+        icetRaiseError("Invalid radix-k tuning candidate.",
+                       ICET_SANITY_CHECK_FAIL);
+        return;
+    }
+    icetStateSetInteger(ICET_RADIXK_TUNED_MAGIC_K, magic_k);
+    icetStateSetInteger(ICET_RADIXK_TUNED_MAX_IMAGE_SPLIT, max_image_split);
+}
+
+/* Starts timing the candidates from the first one. */
+static void radixkTuneExplore(void)
+{
+    icetStateSetInteger(RADIXK_TUNE_CANDIDATE, 0);
+    icetStateSetInteger(RADIXK_TUNE_BEST, -1);
+    icetStateSetDouble(RADIXK_TUNE_BEST_TIME, 0.0);
+    icetStateSetInteger(RADIXK_TUNE_FRAME_COUNT, 0);
+    icetStateSetDouble(RADIXK_TUNE_TIME_SUM, 0.0);
+    radixkTuneUseCandidate(0);
+}
+
+/* Returns the longest of the given times over all processes, which is the
+   same on every process. */
+static IceTDouble radixkTuneSlowestTime(IceTDouble local_time)
+{
+    IceTDouble *all_times;
+    IceTDouble slowest_time;
+    IceTInt num_proc;
+    IceTInt proc;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    all_times = icetGetStateBuffer(RADIXK_TUNE_TIMES_BUFFER,
+                                   num_proc*sizeof(IceTDouble));
+    icetCommAllgather(&local_time, 1, ICET_DOUBLE, all_times);
+
+    slowest_time = all_times[0];
+    for (proc = 1; proc < num_proc; proc++) {
+        if (all_times[proc] > slowest_time) { slowest_time = all_times[proc]; }
+    }
+    return slowest_time;
+}
+
+/* Checks a frame drawn with the best candidate.  Each process counts its own
+   slow frames without communicating, and the processes only share their
+   counts every RADIXK_TUNE_CHECK_FRAMES frames to decide together whether to
+   explore again, as the images have probably changed. */
+static void radixkTuneCheckSettled(void)
+{
+    IceTDouble composite_time;
+    IceTDouble best_time;
+    IceTInt slow_frames;
+    IceTInt frames;
+    IceTInt *all_slow_frames;
+    IceTInt num_proc;
+    IceTInt proc;
+    IceTBoolean explore;
+
+    icetGetDoublev(ICET_COMPOSITE_TIME, &composite_time);
+    icetGetDoublev(RADIXK_TUNE_BEST_TIME, &best_time);
+    icetGetIntegerv(RADIXK_TUNE_SLOW_COUNT, &slow_frames);
+    icetGetIntegerv(RADIXK_TUNE_FRAME_COUNT, &frames);
+
+    /* The best time is that of the slowest process, so a process taking
+       much longer than it is slow. */
+    if (composite_time > RADIXK_TUNE_SLOW_FACTOR*best_time) {
+        slow_frames++;
+    } else {
+        slow_frames = 0;
+    }
+    icetStateSetInteger(RADIXK_TUNE_SLOW_COUNT, slow_frames);
+
+    frames++;
+    if (frames < RADIXK_TUNE_CHECK_FRAMES) {
+        icetStateSetInteger(RADIXK_TUNE_FRAME_COUNT, frames);
+        return;
+    }
+    icetStateSetInteger(RADIXK_TUNE_FRAME_COUNT, 0);
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    all_slow_frames = icetGetStateBuffer(RADIXK_TUNE_TIMES_BUFFER,
+                                         num_proc*sizeof(IceTInt));
+    icetCommAllgather(&slow_frames, 1, ICET_INT, all_slow_frames);
+
+    explore = ICET_FALSE;
+    for (proc = 0; proc < num_proc; proc++) {
+        if (all_slow_frames[proc] >= RADIXK_TUNE_SLOW_FRAMES) {
+            explore = ICET_TRUE;
+        }
+    }
+
+    if (explore) {
+        radixkTuneExplore();
+    }
+}
+
+void icetRadixkTune(void)
+{
+    IceTDouble composite_time;
+    IceTDouble time_sum;
+    IceTDouble candidate_time;
+    IceTDouble best_time;
+    IceTInt tuned_magic_k;
+    IceTInt candidate;
+    IceTInt best_candidate;
+    IceTInt frames;
+    IceTInt magic_k;
+    IceTInt max_image_split;
+
+    if (!icetIsEnabled(ICET_RADIXK_AUTO_TUNE)) { return; }
+
+    icetGetIntegerv(ICET_RADIXK_TUNED_MAGIC_K, &tuned_magic_k);
+    if (   (tuned_magic_k < 2)
+        || (icetStateGetType(RADIXK_TUNE_CANDIDATE) == ICET_NULL) ) {
+        /* Start exploring.  The frame just drawn used no candidate. */
+        radixkTuneExplore();
+        return;
+    }
+
+    icetGetIntegerv(RADIXK_TUNE_CANDIDATE, &candidate);
+    if (candidate < 0) {
+        /* Using the best candidate. */
+        radixkTuneCheckSettled();
+        return;
+    }
+
+    /* Exploring.  Add up the time of the frame just drawn, and the processes
+       only compare times once the candidate has drawn all its frames. */
+    icetGetDoublev(ICET_COMPOSITE_TIME, &composite_time);
+    icetGetDoublev(RADIXK_TUNE_TIME_SUM, &time_sum);
+    icetGetIntegerv(RADIXK_TUNE_FRAME_COUNT, &frames);
+    time_sum += composite_time;
+    frames++;
+    if (frames < RADIXK_TUNE_CANDIDATE_FRAMES) {
+        icetStateSetDouble(RADIXK_TUNE_TIME_SUM, time_sum);
+        icetStateSetInteger(RADIXK_TUNE_FRAME_COUNT, frames);
+        return;
+    }
+    icetStateSetDouble(RADIXK_TUNE_TIME_SUM, 0.0);
+    icetStateSetInteger(RADIXK_TUNE_FRAME_COUNT, 0);
+
+    /* Record the average time of the candidate and move on to the next one
+       or, after the last, settle on the best. */
+    candidate_time = radixkTuneSlowestTime(time_sum/frames);
+    icetGetIntegerv(RADIXK_TUNE_BEST, &best_candidate);
+    icetGetDoublev(RADIXK_TUNE_BEST_TIME, &best_time);
+
+    if ((best_candidate < 0) || (candidate_time < best_time)) {
+        best_candidate = candidate;
+        icetStateSetInteger(RADIXK_TUNE_BEST, best_candidate);
+        icetStateSetDouble(RADIXK_TUNE_BEST_TIME, candidate_time);
+    }
+
+    candidate++;
+    if (radixkTuneGetCandidate(candidate, &magic_k, &max_image_split)) {
+        icetStateSetInteger(RADIXK_TUNE_CANDIDATE, candidate);
+        radixkTuneUseCandidate(candidate);
+    } else {
+        icetStateSetInteger(RADIXK_TUNE_CANDIDATE, -1);
+        icetStateSetInteger(RADIXK_TUNE_SLOW_COUNT, 0);
+        radixkTuneUseCandidate(best_candidate);
+    }
+}
+
+static IceTBoolean radixkTryPartitionLookup(IceTInt group_size,
+                                            IceTInt node_size,
+                                            IceTInt max_image_split)
 {
     IceTInt *partition_assignments;
     IceTInt group_rank;
     IceTInt partition_index;
     IceTInt num_partitions;
+    IceTInt magic_k;
+
+    icetGetIntegerv(ICET_MAGIC_K, &magic_k);
 
     partition_assignments = malloc(group_size * sizeof(IceTInt));
     for (partition_index = 0;
@@ -1318,7 +2116,11 @@ static IceTBoolean radixkTryPartitionLookup(IceTInt group_size)
         radixkInfo info;
         IceTInt rank_assignment;
 
-        info = radixkGetK(group_size, group_rank);
+        info = radixkGetK(group_size,
+                          group_rank,
+                          node_size,
+                          magic_k,
+                          max_image_split);
         partition_index = radixkGetFinalPartitionIndex(&info);
         /* Check if this rank has no partition. */
         if (partition_index < 0) { continue; }
@@ -1348,7 +2150,12 @@ static IceTBoolean radixkTryPartitionLookup(IceTInt group_size)
 
     {
         radixkInfo info;
-        info = radixkGetK(group_size, 0);
+        info = radixkGetK(group_size, 0, node_size, magic_k, max_image_split);
+        if ((node_size > 1) && (info.rounds[0].k != node_size)) {
+            printf("First round has k of %d, expected node size %d\n",
+                   info.rounds[0].k, node_size);
+            return ICET_FALSE;
+        }
         if (num_partitions != radixkGetTotalNumPartitions(&info)) {
             printf("Expected %d partitions, found %d\n",
                    radixkGetTotalNumPartitions(&info),
@@ -1357,15 +2164,10 @@ static IceTBoolean radixkTryPartitionLookup(IceTInt group_size)
         }
     }
 
-    {
-        IceTInt max_image_split;
-
-        icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &max_image_split);
-        if (num_partitions > max_image_split) {
-            printf("Got %d partitions.  Expected no more than %d\n",
-                   num_partitions, max_image_split);
-            return ICET_FALSE;
-        }
+    if (num_partitions > max_image_split) {
+        printf("Got %d partitions.  Expected no more than %d\n",
+               num_partitions, max_image_split);
+        return ICET_FALSE;
     }
 
     free(partition_assignments);
@@ -1373,6 +2175,23 @@ static IceTBoolean radixkTryPartitionLookup(IceTInt group_size)
     return ICET_TRUE;
 }
 
+/* For tests, returns the candidate the tuner is timing or -1 if it has
+   settled. */
+ICET_EXPORT IceTInt icetRadixkTuneCandidateTest(void)
+{
+    IceTInt candidate;
+
+    if (icetStateGetType(RADIXK_TUNE_CANDIDATE) == ICET_NULL) { return -1; }
+    icetGetIntegerv(RADIXK_TUNE_CANDIDATE, &candidate);
+    return candidate;
+}
+
+/* For tests, makes the frames after the tuner settles look slow. */
+ICET_EXPORT void icetRadixkTuneForgetBestTimeTest(void)
+{
+    icetStateSetDouble(RADIXK_TUNE_BEST_TIME, 0.0);
+}
+
 ICET_EXPORT IceTBoolean icetRadixkPartitionLookupUnitTest(void)
 {
     const IceTInt group_sizes_to_try[] = {
@@ -1385,6 +2204,13 @@ ICET_EXPORT IceTBoolean icetRadixkPartitionLookupUnitTest(void)
     };
     const IceTInt num_group_sizes_to_try
         = sizeof(group_sizes_to_try)/sizeof(IceTInt);
+    const IceTInt node_sizes_to_try[] = {
+        2,                              /* Smallest node. */
+        12,                             /* Not a power of two. */
+        48                              /* Large node. */
+    };
+    const IceTInt num_node_sizes_to_try
+        = sizeof(node_sizes_to_try)/sizeof(IceTInt);
     IceTInt group_size_index;
 
     printf("\nTesting rank/partition mapping.\n");
@@ -1400,16 +2226,48 @@ ICET_EXPORT IceTBoolean icetRadixkPartitionLookupUnitTest(void)
         for (max_image_split = 1;
              max_image_split/2 < group_size;
              max_image_split *= 2) {
-            icetStateSetInteger(ICET_MAX_IMAGE_SPLIT, max_image_split);
-
             printf("  Maximum num splits set to %d\n", max_image_split);
 
-            if (!radixkTryPartitionLookup(group_size)) {
+            if (!radixkTryPartitionLookup(group_size, 1, max_image_split)) {
                 return ICET_FALSE;
             }
         }
     }
 
+    printf("\nTesting rank/partition mapping with rounds on nodes.\n");
+
+    for (group_size_index = 0;
+         group_size_index < num_group_sizes_to_try;
+         group_size_index++) {
+        IceTInt group_size = group_sizes_to_try[group_size_index];
+        IceTInt node_size_index;
+
+        for (node_size_index = 0;
+             node_size_index < num_node_sizes_to_try;
+             node_size_index++) {
+            IceTInt node_size = node_sizes_to_try[node_size_index];
+            IceTInt max_image_split;
+
+            if (   (node_size >= group_size)
+                || ((group_size % node_size) != 0) ) {
+                continue;
+            }
+
+            printf("Trying size %d with %d processes per node\n",
+                   group_size, node_size);
+
+            for (max_image_split = 1;
+                 max_image_split/2 < group_size;
+                 max_image_split *= 2) {
+                if (!radixkTryPartitionLookup(group_size,
+                                              node_size,
+                                              max_image_split)) {
+                    return ICET_FALSE;
+                }
+            }
+        }
+    }
+
     return ICET_TRUE;
 }
 
@@ -1418,12 +2276,15 @@ ICET_EXPORT IceTBoolean icetRadixkPartitionLookupUnitTest(void)
 static IceTBoolean radixkTryTelescopeSendReceive(IceTInt *main_group,
                                                  IceTInt main_group_size,
                                                  IceTInt *sub_group,
-                                                 IceTInt sub_group_size)
+                                                 IceTInt sub_group_size,
+                                                 IceTInt max_image_split)
 {
     IceTInt rank;
     IceTInt sub_group_idx;
+    IceTInt magic_k;
 
     icetGetIntegerv(ICET_RANK, &rank);
+    icetGetIntegerv(ICET_MAGIC_K, &magic_k);
 
     /* Check the receives for each entry in sub_group. */
     /* Fill initial sub_group. */
@@ -1438,6 +2299,8 @@ static IceTBoolean radixkTryTelescopeSendReceive(IceTInt *main_group,
                                                    main_group_size,
                                                    sub_group,
                                                    sub_group_size,
+                                                   magic_k,
+                                                   max_image_split,
                                                    &receiver_ranks,
                                                    &num_receivers);
         sub_group[sub_group_idx] = SUB_GROUP_RANK(sub_group_idx);
@@ -1469,7 +2332,9 @@ static IceTBoolean radixkTryTelescopeSendReceive(IceTInt *main_group,
             send_rank = icetRadixkTelescopeFindUpperGroupSender(main_group,
                                                                 main_group_size,
                                                                 sub_group,
-                                                                sub_group_size);
+                                                                sub_group_size,
+                                                                magic_k,
+                                                               max_image_split);
             main_group[receiver_group_rank] = receiver_rank;
 
             if (send_rank != SUB_GROUP_RANK(sub_group_idx)) {
@@ -1529,12 +2394,11 @@ ICET_EXPORT IceTBoolean icetRadixTelescopeSendReceiveTest(void)
 
                 printf("    Max image split %d\n", max_image_split);
 
-                icetStateSetInteger(ICET_MAX_IMAGE_SPLIT, max_image_split);
-
                 result = radixkTryTelescopeSendReceive(main_group,
                                                        main_group_size,
                                                        sub_group,
-                                                       sub_group_size);
+                                                       sub_group_size,
+                                                       max_image_split);
 
                 if (!result) { return ICET_FALSE; }
             }
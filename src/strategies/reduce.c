@@ -98,6 +98,7 @@ IceTImage icetReduceCompose(void)
         icetSingleImageCompose(compose_group,
                                group_size,
                                group_image_dest,
+                               -1,
                                rendered_image,
                                &composited_image,
                                &piece_offset);
@@ -515,7 +516,7 @@ IceTImage reduceCollect(const IceTSparseImage composited_image,
     if ((tile_displayed >= 0) && (tile_displayed != compose_tile)) {
         /* Return empty image if nothing in this tile. */
         icetRaiseDebug("Clearing pixels");
-        icetClearImage(result_image);
+        icetClearImageTrueBackground(result_image);
     }
 
     return result_image;
@@ -25,27 +25,33 @@ extern IceTImage icetVtreeCompose(void);
 extern void icetAutomaticCompose(const IceTInt *compose_group,
                                  IceTInt group_size,
                                  IceTInt image_dest,
+                                 IceTInt uncompressed_tile,
                                  IceTSparseImage input_image,
                                  IceTSparseImage *result_image,
                                  IceTSizeType *piece_offset);
 extern void icetBswapCompose(const IceTInt *compose_group,
                              IceTInt group_size,
                              IceTInt image_dest,
+                             IceTInt uncompressed_tile,
                              IceTSparseImage input_image,
                              IceTSparseImage *result_image,
                              IceTSizeType *piece_offset);
 extern void icetTreeCompose(const IceTInt *compose_group,
                             IceTInt group_size,
                             IceTInt image_dest,
+                            IceTInt uncompressed_tile,
                             IceTSparseImage input_image,
                             IceTSparseImage *result_image,
                             IceTSizeType *piece_offset);
 extern void icetRadixkCompose(const IceTInt *compose_group,
                               IceTInt group_size,
                               IceTInt image_dest,
+                              IceTInt uncompressed_tile,
                               IceTSparseImage input_image,
                               IceTSparseImage *result_image,
                               IceTSizeType *piece_offset);
+extern void icetRadixkPrepare(void);
+extern void icetRadixkTune(void);
 
 /*==================================================================*/
 
@@ -155,6 +161,7 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
                                    const IceTInt *compose_group,
                                    IceTInt group_size,
                                    IceTInt image_dest,
+                                   IceTInt uncompressed_tile,
                                    IceTSparseImage input_image,
                                    IceTSparseImage *result_image,
                                    IceTSizeType *piece_offset)
@@ -167,6 +174,7 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
           icetAutomaticCompose(compose_group,
                                group_size,
                                image_dest,
+                               uncompressed_tile,
                                input_image,
                                result_image,
                                piece_offset);
@@ -175,6 +183,7 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
           icetBswapCompose(compose_group,
                            group_size,
                            image_dest,
+                           uncompressed_tile,
                            input_image,
                            result_image,
                            piece_offset);
@@ -183,6 +192,7 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
           icetTreeCompose(compose_group,
                           group_size,
                           image_dest,
+                          uncompressed_tile,
                           input_image,
                           result_image,
                           piece_offset);
@@ -191,6 +201,7 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
           icetRadixkCompose(compose_group,
                             group_size,
                             image_dest,
+                            uncompressed_tile,
                             input_image,
                             result_image,
                             piece_offset);
@@ -202,3 +213,23 @@ void icetInvokeSingleImageStrategy(IceTEnum strategy,
 
     icetStateCheckMemory();
 }
+
+void icetPrepareSingleImageStrategy(void)
+{
+    IceTEnum strategy;
+
+    icetGetEnumv(ICET_SINGLE_IMAGE_STRATEGY, &strategy);
+    if (strategy == ICET_SINGLE_IMAGE_STRATEGY_RADIXK) {
+        icetRadixkPrepare();
+    }
+}
+
+void icetTuneSingleImageStrategy(void)
+{
+    IceTEnum strategy;
+
+    icetGetEnumv(ICET_SINGLE_IMAGE_STRATEGY, &strategy);
+    if (strategy == ICET_SINGLE_IMAGE_STRATEGY_RADIXK) {
+        icetRadixkTune();
+    }
+}
@@ -28,6 +28,8 @@ IceTImage icetSequentialCompose(void)
     const IceTInt *tile_viewports;
     IceTBoolean ordered_composite;
     IceTBoolean image_collect;
+    IceTEnum single_image_strategy;
+    IceTBoolean compose_uncompressed;
     IceTImage my_image;
     IceTInt *compose_group;
     int i;
@@ -39,6 +41,14 @@ IceTImage icetSequentialCompose(void)
     tile_viewports = icetUnsafeStateGetInteger(ICET_TILE_VIEWPORTS);
     ordered_composite = icetIsEnabled(ICET_ORDERED_COMPOSITE);
     image_collect = icetIsEnabled(ICET_COLLECT_IMAGES);
+    icetGetEnumv(ICET_SINGLE_IMAGE_STRATEGY, &single_image_strategy);
+
+    /* Binary swap and radix-k split the image right away, so they can
+       compress the rendered region of the tile straight into the pieces they
+       send without copying it into a whole tile first. */
+    compose_uncompressed
+        = (   (single_image_strategy == ICET_SINGLE_IMAGE_STRATEGY_BSWAP)
+           || (single_image_strategy == ICET_SINGLE_IMAGE_STRATEGY_RADIXK) );
 
     if (!image_collect && (num_tiles > 1)) {
         icetRaiseWarning("Sequential strategy must collect images with more"
@@ -64,6 +74,7 @@ IceTImage icetSequentialCompose(void)
     for (i = 0; i < num_tiles; i++) {
 	int d_node = display_nodes[i];
 	int image_dest;
+        IceTInt uncompressed_tile;
         IceTSparseImage rendered_image;
         IceTSparseImage composited_image;
         IceTSizeType piece_offset;
@@ -87,10 +98,17 @@ IceTImage icetSequentialCompose(void)
         rendered_image = icetGetStateBufferSparseImage(SEQUENTIAL_IMAGE_BUFFER,
                                                        tile_width, tile_height);
 
-        icetGetCompressedTileImage(i, rendered_image);
+        if (compose_uncompressed) {
+            /* The strategy renders the tile when it compresses it. */
+            uncompressed_tile = i;
+        } else {
+            uncompressed_tile = -1;
+            icetGetCompressedTileImage(i, rendered_image);
+        }
 	icetSingleImageCompose(compose_group,
                                num_proc,
                                image_dest,
+                               uncompressed_tile,
                                rendered_image,
                                &composited_image,
                                &piece_offset);
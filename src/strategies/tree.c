@@ -131,6 +131,7 @@ static void RecursiveTreeCompose(const IceTInt *compose_group,
 void icetTreeCompose(const IceTInt *compose_group,
                      IceTInt group_size,
                      IceTInt image_dest,
+                     IceTInt uncompressed_tile,
                      IceTSparseImage input_image,
                      IceTSparseImage *result_image,
                      IceTSizeType *piece_offset)
@@ -142,6 +143,11 @@ void icetTreeCompose(const IceTInt *compose_group,
     IceTSizeType width, height;
     IceTSizeType sparseBufferSize;
 
+    /* The tree never splits the image, so just compress it up front. */
+    if (uncompressed_tile >= 0) {
+        icetGetCompressedTileImage(uncompressed_tile, input_image);
+    }
+
     width = icetSparseImageGetWidth(input_image);
     height = icetSparseImageGetHeight(input_image);
 
@@ -0,0 +1,302 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_CORRECT_COLORED_BACKGROUND.  A frame drawn with a
+** colored background must be the same as the frame drawn with a black
+** background and then blended over the colored background.  The frames are
+** drawn with each color format, with and without an output buffer, and with
+** strategies that correct the background while collecting the image as well
+** as those that correct it afterward.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Draws a pattern of partially transparent pixels that differs on each
+   process.  The geometry only covers the left half of the screen, so a
+   tile on the right half has no data. */
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum color_format = icetImageGetColorFormat(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTUByte color[4];
+        if ((i/5 + rank)%3 == 0) {
+            color[0] = color[1] = color[2] = color[3] = 0;
+        } else {
+            IceTUByte alpha = ((i + rank)%2 == 0) ? 255 : 96;
+            color[0] = (IceTUByte)((i*13 + rank*29)%(alpha + 1));
+            color[1] = (IceTUByte)((i*7 + rank*3)%(alpha + 1));
+            color[2] = (IceTUByte)((i + rank*101)%(alpha + 1));
+            color[3] = alpha;
+        }
+        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            memcpy(icetImageGetColorub(result) + 4*i, color, 4);
+        } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+            IceTFloat *out = icetImageGetColorf(result) + 4*i;
+            out[0] = (IceTFloat)color[0]/255.0f;
+            out[1] = (IceTFloat)color[1]/255.0f;
+            out[2] = (IceTFloat)color[2]/255.0f;
+            out[3] = (IceTFloat)color[3]/255.0f;
+        } else {
+            IceTUShort *out = icetImageGetColorus(result) + 4*i;
+            out[0] = icetFloatToHalf((IceTFloat)color[0]/255.0f);
+            out[1] = icetFloatToHalf((IceTFloat)color[1]/255.0f);
+            out[2] = icetFloatToHalf((IceTFloat)color[2]/255.0f);
+            out[3] = icetFloatToHalf((IceTFloat)color[3]/255.0f);
+        }
+    }
+}
+
+/* Blends num_pixels colors in place over the background as
+   ICET_CORRECT_COLORED_BACKGROUND should. */
+static void BlendOverBackground(IceTVoid *colors,
+                                IceTEnum color_format,
+                                const IceTFloat *background,
+                                IceTSizeType num_pixels)
+{
+    IceTSizeType i;
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        IceTUByte background_ubyte[4];
+        background_ubyte[0] = (IceTUByte)(255*background[0]);
+        background_ubyte[1] = (IceTUByte)(255*background[1]);
+        background_ubyte[2] = (IceTUByte)(255*background[2]);
+        background_ubyte[3] = (IceTUByte)(255*background[3]);
+        icetBlendUByteArrayOverColor(colors, background_ubyte, num_pixels);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        IceTFloat *color = colors;
+        for (i = 0; i < num_pixels; i++, color += 4) {
+            ICET_UNDER_FLOAT(background, color);
+        }
+    } else {
+        IceTUShort background_half[4];
+        IceTUShort *color = colors;
+        background_half[0] = icetFloatToHalf(background[0]);
+        background_half[1] = icetFloatToHalf(background[1]);
+        background_half[2] = icetFloatToHalf(background[2]);
+        background_half[3] = icetFloatToHalf(background[3]);
+        for (i = 0; i < num_pixels; i++, color += 4) {
+            ICET_UNDER_HALF(background_half, color);
+        }
+    }
+}
+
+static int BackgroundCorrectTryFrame(IceTEnum color_format,
+                                     IceTBoolean use_output_buffer)
+{
+    IceTDouble identity[16];
+    IceTFloat black[4];
+    IceTFloat background[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTSizeType num_pixels;
+    IceTSizeType pixel_size;
+    IceTByte *expected;
+    IceTByte *output;
+    const IceTByte *corrected;
+    IceTSizeType i;
+    int result = TEST_PASSED;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+
+    black[0] = black[1] = black[2] = black[3] = 0.0f;
+
+    background[0] = 0.25f;
+    background[1] = 0.5f;
+    background[2] = 0.75f;
+    background[3] = 1.0f;
+
+    icetSetColorFormat(color_format);
+
+    /* Draw the reference image over a black background, which needs no
+       correction. */
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+    image = icetDrawFrame(identity, identity, black);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    num_pixels = icetImageGetNumPixels(image);
+
+    if (tile_displayed >= 0) {
+        const IceTVoid *colors = icetImageGetColorVoid(image, &pixel_size);
+        expected = malloc(num_pixels*pixel_size);
+        memcpy(expected, colors, num_pixels*pixel_size);
+        BlendOverBackground(expected, color_format, background, num_pixels);
+        output = malloc(num_pixels*pixel_size);
+        memset(output, 0xAB, num_pixels*pixel_size);
+    } else {
+        expected = NULL;
+        output = NULL;
+        pixel_size = 0;
+    }
+
+    /* Draw again over the colored background. */
+    if (use_output_buffer) {
+        icetOutputBuffer(color_format, 0, output);
+    }
+    image = icetDrawFrame(identity, identity, background);
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+
+    if (tile_displayed >= 0) {
+        if (use_output_buffer) {
+            corrected = output;
+        } else {
+            corrected = icetImageGetColorVoid(image, NULL);
+        }
+        for (i = 0; i < num_pixels; i++) {
+            if (memcmp(corrected + i*pixel_size,
+                       expected + i*pixel_size,
+                       pixel_size) != 0) {
+                printf("*** Pixel %d not blended over the background.\n",
+                       (int)i);
+                result = TEST_FAILED;
+                break;
+            }
+        }
+        free(expected);
+        free(output);
+    }
+
+    return result;
+}
+
+static int BackgroundCorrectTryStrategies(void)
+{
+    IceTEnum strategies[3];
+    IceTEnum color_formats[3];
+    int strategy_index;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    strategies[0] = ICET_STRATEGY_REDUCE;
+    strategies[1] = ICET_STRATEGY_SEQUENTIAL;
+    strategies[2] = ICET_STRATEGY_DIRECT;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+    color_formats[2] = ICET_IMAGE_COLOR_RGBA_HALF;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    for (strategy_index = 0; strategy_index < 3; strategy_index++) {
+        int color_format_index;
+
+        icetStrategy(strategies[strategy_index]);
+
+        for (color_format_index = 0;
+             color_format_index < 3;
+             color_format_index++) {
+            IceTEnum color_format = color_formats[color_format_index];
+            IceTBoolean use_output_buffer;
+
+            for (use_output_buffer = 0;
+                 use_output_buffer <= 1;
+                 use_output_buffer++) {
+                if (rank == 0) {
+                    printf("    %s strategy, color format 0x%X, %s\n",
+                           icetGetStrategyName(),
+                           color_format,
+                           use_output_buffer ? "output buffer" : "image");
+                }
+
+                /* Keep drawing frames after a failure so that all processes
+                   stay in step. */
+                if (BackgroundCorrectTryFrame(color_format, use_output_buffer)
+                    != TEST_PASSED) {
+                    result = TEST_FAILED;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static int BackgroundCorrectRun(void)
+{
+    IceTInt num_proc;
+    IceTInt rank;
+    IceTInt *process_ranks;
+    IceTInt proc;
+    int result;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 0.0, -1.0, 1.0, -1.0, 1.0);
+
+    process_ranks = malloc(num_proc * sizeof(IceTInt));
+    for (proc = 0; proc < num_proc; proc++) {
+        process_ranks[proc] = proc;
+    }
+    icetEnable(ICET_ORDERED_COMPOSITE);
+    icetCompositeOrder(process_ranks);
+    free(process_ranks);
+
+    if (rank == 0) {
+        printf("  Using one tile\n");
+    }
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, num_proc-1);
+
+    result = BackgroundCorrectTryStrategies();
+
+    if (num_proc > 1) {
+        if (rank == 0) {
+            printf("  Using two tiles\n");
+        }
+        icetResetTiles();
+        icetAddTile(0, 0, SCREEN_WIDTH/2, SCREEN_HEIGHT, 0);
+        icetAddTile(SCREEN_WIDTH/2, 0,
+                    SCREEN_WIDTH - SCREEN_WIDTH/2, SCREEN_HEIGHT,
+                    num_proc-1);
+
+        if (BackgroundCorrectTryStrategies() != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    return result;
+}
+
+int BackgroundCorrect(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(BackgroundCorrectRun);
+}
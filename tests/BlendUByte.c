@@ -0,0 +1,315 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks that blending RGBA_UBYTE colors gives exactly the results
+** of dividing by 255 after every multiply, which is how IceT has always
+** blended them.  It checks icetBlendUByteArray for every pair of alpha and
+** color value, and then checks each compositing operation in blend mode
+** against a reference composite.  It also reports how long blending takes.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_TIMING_PIXELS       (1024*1024)
+#define NUM_TIMING_TRIALS       10
+
+/* Blends one pixel as IceT originally did, with a division for each
+   channel. */
+static void ReferenceBlend(const IceTUByte *front,
+                           const IceTUByte *back,
+                           IceTUByte *dest)
+{
+    IceTUInt afactor = 255 - front[3];
+    dest[0] = (IceTUByte)((back[0]*afactor)/255 + front[0]);
+    dest[1] = (IceTUByte)((back[1]*afactor)/255 + front[1]);
+    dest[2] = (IceTUByte)((back[2]*afactor)/255 + front[2]);
+    dest[3] = (IceTUByte)((back[3]*afactor)/255 + front[3]);
+}
+
+static int CompareColors(const IceTUByte *expected,
+                         const IceTUByte *actual,
+                         IceTSizeType num_pixels,
+                         const char *operation)
+{
+    IceTSizeType i;
+
+    for (i = 0; i < 4*num_pixels; i++) {
+        if (expected[i] != actual[i]) {
+            printf("*** %s: channel %d of pixel %d is %d, should be %d.\n",
+                   operation, (int)(i%4), (int)(i/4),
+                   (int)actual[i], (int)expected[i]);
+            return TEST_FAILED;
+        }
+    }
+    return TEST_PASSED;
+}
+
+/* Blends every alpha against every back value.  The front colors are random
+   and not premultiplied, so some sums wrap around as they do in the
+   reference.  The number of pixels is odd so that the scalar tail of the
+   vector loop is also used. */
+static int TestAllValues(void)
+{
+    IceTUByte front[4*255];
+    IceTUByte back[4*255];
+    IceTUByte expected[4*255];
+    IceTUByte actual[4*255];
+    IceTUByte background[4];
+    int alpha;
+    int i;
+    int result = TEST_PASSED;
+
+    printf("Checking all alpha and color values.\n");
+    for (alpha = 0; alpha < 256; alpha++) {
+        for (i = 0; i < 255; i++) {
+            front[4*i + 0] = (IceTUByte)(rand()%256);
+            front[4*i + 1] = (IceTUByte)(rand()%256);
+            front[4*i + 2] = (IceTUByte)(rand()%256);
+            front[4*i + 3] = (IceTUByte)alpha;
+            back[4*i + 0] = (IceTUByte)i;
+            back[4*i + 1] = (IceTUByte)(255 - i);
+            back[4*i + 2] = (IceTUByte)(rand()%256);
+            back[4*i + 3] = (IceTUByte)(rand()%256);
+            ReferenceBlend(front + 4*i, back + 4*i, expected + 4*i);
+        }
+
+        icetBlendUByteArray(front, back, actual, 255);
+        if (CompareColors(expected, actual, 255, "Blend") != TEST_PASSED) {
+            result = TEST_FAILED;
+            break;
+        }
+
+        memcpy(actual, back, sizeof(actual));
+        icetBlendUByteArray(front, actual, actual, 255);
+        if (CompareColors(expected, actual, 255, "Blend over")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+            break;
+        }
+
+        memcpy(actual, front, sizeof(actual));
+        icetBlendUByteArray(actual, back, actual, 255);
+        if (CompareColors(expected, actual, 255, "Blend under")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+            break;
+        }
+
+        background[0] = (IceTUByte)(rand()%256);
+        background[1] = (IceTUByte)(rand()%256);
+        background[2] = (IceTUByte)(rand()%256);
+        background[3] = (IceTUByte)(rand()%256);
+        for (i = 0; i < 255; i++) {
+            ReferenceBlend(front + 4*i, background, expected + 4*i);
+        }
+        memcpy(actual, front, sizeof(actual));
+        icetBlendUByteArrayOverColor(actual, background, 255);
+        if (CompareColors(expected, actual, 255, "Blend over background")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+            break;
+        }
+    }
+
+    return result;
+}
+
+static int TestComposite(void)
+{
+    IceTSizeType num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    IceTVoid *buffers[8];
+    int num_buffers = 0;
+    IceTImage front, back, result_image;
+    IceTSparseImage sparse_front, sparse_back, sparse_result;
+    IceTUByte *expected;
+    IceTSizeType pixel;
+    TestImagePattern pattern;
+    int planar;
+    int result = TEST_PASSED;
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetStateSetInteger(ICET_BACKGROUND_COLOR_WORD, 0);
+
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    front = icetImageAssignBuffer(buffers[num_buffers++],
+                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    back = icetImageAssignBuffer(buffers[num_buffers++],
+                                 SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    result_image = icetImageAssignBuffer(buffers[num_buffers++],
+                                         SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    sparse_front = icetSparseImageAssignBuffer(buffers[num_buffers++],
+                                               SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    sparse_back = icetSparseImageAssignBuffer(buffers[num_buffers++],
+                                              SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    sparse_result = icetSparseImageAssignBuffer(buffers[num_buffers++],
+                                                SCREEN_WIDTH, SCREEN_HEIGHT);
+    expected = malloc(4*num_pixels);
+    buffers[num_buffers++] = expected;
+
+    /* Runs of transparent pixels and runs of random colors, which are what
+       blending sees when compositing.  Every byte value is a level. */
+    init_test_image_pattern(&pattern);
+    pattern.max_run = 100;
+    pattern.channel_levels = 255;
+    init_test_image(front, 1, &pattern);
+    init_test_image(back, 2, &pattern);
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        ReferenceBlend(icetImageGetColorcub(front) + 4*pixel,
+                       icetImageGetColorcub(back) + 4*pixel,
+                       expected + 4*pixel);
+    }
+
+    printf("Checking full image composite.\n");
+    icetImageCopyPixels(back, 0, result_image, 0, num_pixels);
+    icetComposite(result_image, front, 1);
+    if (CompareColors(expected, icetImageGetColorcub(result_image),
+                      num_pixels, "Composite over") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    icetImageCopyPixels(front, 0, result_image, 0, num_pixels);
+    icetComposite(result_image, back, 0);
+    if (CompareColors(expected, icetImageGetColorcub(result_image),
+                      num_pixels, "Composite under") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (planar = 0; planar < 2; planar++) {
+        printf("Using %s sparse images.\n",
+               planar ? "planar" : "interleaved");
+        if (planar) {
+            icetEnable(ICET_PLANAR_SPARSE_IMAGES);
+        } else {
+            icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+        }
+        icetSparseImageSetDimensions(sparse_front, SCREEN_WIDTH, SCREEN_HEIGHT);
+        icetSparseImageSetDimensions(sparse_back, SCREEN_WIDTH, SCREEN_HEIGHT);
+        icetSparseImageSetDimensions(sparse_result,
+                                     SCREEN_WIDTH, SCREEN_HEIGHT);
+        icetCompressImage(front, sparse_front);
+        icetCompressImage(back, sparse_back);
+
+        printf("  Checking compressed composite.\n");
+        icetImageCopyPixels(back, 0, result_image, 0, num_pixels);
+        icetCompressedComposite(result_image, sparse_front, 1);
+        if (CompareColors(expected, icetImageGetColorcub(result_image),
+                          num_pixels, "Compressed composite over")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        icetImageCopyPixels(front, 0, result_image, 0, num_pixels);
+        icetCompressedComposite(result_image, sparse_back, 0);
+        if (CompareColors(expected, icetImageGetColorcub(result_image),
+                          num_pixels, "Compressed composite under")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("  Checking compressed-compressed composite.\n");
+        icetCompressedCompressedComposite(sparse_front,
+                                          sparse_back,
+                                          sparse_result);
+        icetDecompressImage(sparse_result, result_image);
+        if (CompareColors(expected, icetImageGetColorcub(result_image),
+                          num_pixels, "Compressed-compressed composite")
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+
+    printf("Checking block layout composite.\n");
+    icetCompressImageBlocks(front, sparse_front);
+    icetCompressImageBlocks(back, sparse_back);
+    icetCompressedCompressedComposite(sparse_front, sparse_back, sparse_result);
+    icetDecompressImage(sparse_result, result_image);
+    if (CompareColors(expected, icetImageGetColorcub(result_image),
+                      num_pixels, "Block composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+
+    return result;
+}
+
+static void TimeBlend(void)
+{
+    IceTUByte *front = malloc(4*NUM_TIMING_PIXELS);
+    IceTUByte *back = malloc(4*NUM_TIMING_PIXELS);
+    IceTDouble start;
+    IceTSizeType i;
+    int trial;
+
+    for (i = 0; i < 4*NUM_TIMING_PIXELS; i++) {
+        front[i] = (IceTUByte)(rand()%256);
+        back[i] = (IceTUByte)(rand()%256);
+    }
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetBlendUByteArray(front, back, back, NUM_TIMING_PIXELS);
+    }
+    printf("Time to blend %d pixels: %.3f ms\n",
+           NUM_TIMING_PIXELS,
+           1000.0*(icetWallTime() - start)/NUM_TIMING_TRIALS);
+
+    free(front);
+    free(back);
+}
+
+static int BlendUByteRun(void)
+{
+    int result = TEST_PASSED;
+
+    srand(1234);
+
+    if (TestAllValues() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (TestComposite() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    TimeBlend();
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int BlendUByte(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(BlendUByteRun);
+}
@@ -0,0 +1,302 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks sparse images compressed into blocks with
+** icetCompressImageBlocks.  It checks that decompressing, compositing, and
+** sending them give the same results as images compressed into runs.  It
+** also reports the size of each and how long compositing takes.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_BLOBS 3
+#define NUM_TIMING_TRIALS 10
+
+/* Fills the image with a few round blobs of runs of active pixels in a field
+   of inactive pixels.  When compositing with z-buffers, inactive pixels get
+   colors that are not zero to check that they are never mistaken for active
+   pixels.  The same image is created for a given seed. */
+static void InitBlobImage(IceTImage image, unsigned int seed)
+{
+    IceTEnum composite_mode;
+    IceTSizeType width = icetImageGetWidth(image);
+    IceTSizeType height = icetImageGetHeight(image);
+    IceTBoolean *mask = malloc(width*height*sizeof(IceTBoolean));
+    TestImagePattern pattern;
+    IceTSizeType x, y;
+    IceTSizeType pixel;
+    int blob;
+
+    srand(seed);
+
+    for (pixel = 0; pixel < width*height; pixel++) {
+        mask[pixel] = ICET_FALSE;
+    }
+    for (blob = 0; blob < NUM_BLOBS; blob++) {
+        IceTSizeType blob_x = rand()%width;
+        IceTSizeType blob_y = rand()%height;
+        IceTSizeType blob_radius = 5 + rand()%(width/8);
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                IceTSizeType dx = x - blob_x;
+                IceTSizeType dy = y - blob_y;
+                if (dx*dx + dy*dy < blob_radius*blob_radius) {
+                    mask[y*width + x] = ICET_TRUE;
+                }
+            }
+        }
+    }
+
+    init_test_image_pattern(&pattern);
+    pattern.start_active = ICET_TRUE;
+    pattern.depth_levels = 256;
+    pattern.mask = mask;
+    init_test_image(image, seed, &pattern);
+
+    icetGetEnumv(ICET_COMPOSITE_MODE, &composite_mode);
+    if (   (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER)
+        && (icetImageGetColorFormat(image) != ICET_IMAGE_COLOR_NONE) ) {
+        IceTSizeType color_size;
+        IceTByte *color = icetImageGetColorVoid(image, &color_size);
+        for (pixel = 0; pixel < width*height; pixel++) {
+            if (!mask[pixel]) {
+                memset(color + pixel*color_size, 0x3C, color_size);
+            }
+        }
+    }
+
+    free(mask);
+}
+
+/* Packages the image as for sending and unpackages a copy of the message
+   into receive_buffer. */
+static IceTSparseImage SendImage(IceTSparseImage image,
+                                 IceTVoid *receive_buffer)
+{
+    IceTVoid *message;
+    IceTSizeType message_size;
+
+    icetSparseImagePackageForSend(image, &message, &message_size);
+    memcpy(receive_buffer, message, message_size);
+    return icetSparseImageUnpackageFromReceive(receive_buffer);
+}
+
+static IceTDouble TimeComposite(IceTSparseImage front,
+                                IceTSparseImage back,
+                                IceTSparseImage dest)
+{
+    IceTDouble start;
+    int trial;
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetCompressedCompressedComposite(front, back, dest);
+    }
+    return (icetWallTime() - start)/NUM_TIMING_TRIALS;
+}
+
+static int DoBlockTest(IceTEnum composite_mode,
+                       IceTEnum color_format,
+                       IceTEnum depth_format)
+{
+    IceTVoid *buffers[10];
+    int num_buffers = 0;
+    IceTImage image;
+    IceTImage expected_full;
+    IceTImage actual_full;
+    IceTSparseImage run_front, run_back, run_result;
+    IceTSparseImage block_front, block_back, block_result;
+    IceTSparseImage received;
+    IceTDouble run_time, block_time;
+    int src_on_top;
+    int result = TEST_PASSED;
+
+    printf("Using %s compositing\n",
+           (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) ? "z-buffer"
+           : ((composite_mode == ICET_COMPOSITE_MODE_ADD) ? "add" : "blend"));
+    printf("Using color format of 0x%x\n", (int)color_format);
+    printf("Using depth format of 0x%x\n", (int)depth_format);
+
+    icetCompositeMode(composite_mode);
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    image = icetImageAssignBuffer(buffers[num_buffers++],
+                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    expected_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                          SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    actual_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                        SCREEN_WIDTH, SCREEN_HEIGHT);
+
+#define NEW_SPARSE_IMAGE(var)                                           \
+    buffers[num_buffers]                                                \
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT)); \
+    var = icetSparseImageAssignBuffer(buffers[num_buffers++],           \
+                                      SCREEN_WIDTH, SCREEN_HEIGHT)
+    NEW_SPARSE_IMAGE(run_front);
+    NEW_SPARSE_IMAGE(run_back);
+    NEW_SPARSE_IMAGE(run_result);
+    NEW_SPARSE_IMAGE(block_front);
+    NEW_SPARSE_IMAGE(block_back);
+    NEW_SPARSE_IMAGE(block_result);
+    buffers[num_buffers]
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    num_buffers++;
+#undef NEW_SPARSE_IMAGE
+
+    InitBlobImage(image, 12345);
+    icetCompressImage(image, run_front);
+    icetCompressImageBlocks(image, block_front);
+    InitBlobImage(image, 54321);
+    icetCompressImage(image, run_back);
+    icetCompressImageBlocks(image, block_back);
+
+    printf("Run image %d bytes, block image %d bytes.\n",
+           (int)icetSparseImageGetCompressedBufferSize(run_front),
+           (int)icetSparseImageGetCompressedBufferSize(block_front));
+    if (   icetSparseImageGetCompressedBufferSize(block_front)
+        > icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT) ) {
+        printf("*** Block image larger than advertised buffer size.\n");
+        result = TEST_FAILED;
+    }
+
+    printf("Checking decompression.\n");
+    if (compare_sparse_images(run_front, block_front, expected_full,
+                              actual_full, "Decompression") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (compare_sparse_images(run_back, block_back, expected_full, actual_full,
+                              "Decompression") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (src_on_top = 0; src_on_top < 2; src_on_top++) {
+        printf("Checking composite with full image, source on %s.\n",
+               src_on_top ? "top" : "bottom");
+        icetDecompressImage(run_back, expected_full);
+        icetCompressedComposite(expected_full, run_front, src_on_top);
+        icetDecompressImage(run_back, actual_full);
+        icetCompressedComposite(actual_full, block_front, src_on_top);
+        if (compare_test_images(expected_full, actual_full, 0.0f,
+                                "Composite with full image") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Checking compressed composite.\n");
+    icetCompressedCompressedComposite(run_front, run_back, run_result);
+    icetCompressedCompressedComposite(block_front, block_back, block_result);
+    if (compare_sparse_images(run_result, block_result, expected_full,
+                              actual_full,
+                              "Compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Timing.\n");
+    run_time = TimeComposite(run_front, run_back, run_result);
+    block_time = TimeComposite(block_front, block_back, block_result);
+    printf("  Compressed composite of runs %.3f ms, of blocks %.3f ms\n",
+           1000.0*run_time, 1000.0*block_time);
+
+    printf("Checking composite of a composited image.\n");
+    icetCompressedCompressedComposite(run_result, run_back, run_front);
+    icetCompressedCompressedComposite(block_result, block_back, block_front);
+    if (compare_sparse_images(run_front, block_front, expected_full,
+                              actual_full,
+                              "Composite of composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking send.\n");
+    icetEnable(ICET_MESSAGE_CODEC);
+    icetDecompressImage(block_result, expected_full);
+    received = SendImage(block_result, buffers[num_buffers-1]);
+    icetDecompressImage(received, actual_full);
+    if (compare_test_images(expected_full, actual_full, 0.0f,
+                            "Send") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    icetDisable(ICET_MESSAGE_CODEC);
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+    return result;
+}
+
+static int BlockSparseImagesRun()
+{
+    IceTEnum color_formats[3];
+    IceTEnum depth_formats[2];
+    int color_index;
+    int depth_index;
+    int result = TEST_PASSED;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+    color_formats[2] = ICET_IMAGE_COLOR_RGBA_HALF;
+    depth_formats[0] = ICET_IMAGE_DEPTH_FLOAT;
+    depth_formats[1] = ICET_IMAGE_DEPTH_UNORM16;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+
+    for (color_index = 0; color_index < 3; color_index++) {
+        for (depth_index = 0; depth_index < 2; depth_index++) {
+            if (DoBlockTest(ICET_COMPOSITE_MODE_Z_BUFFER,
+                            color_formats[color_index],
+                            depth_formats[depth_index]) != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+            printf("\n\n");
+        }
+        if (DoBlockTest(ICET_COMPOSITE_MODE_BLEND,
+                        color_formats[color_index],
+                        ICET_IMAGE_DEPTH_NONE) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        printf("\n\n");
+        if (DoBlockTest(ICET_COMPOSITE_MODE_ADD,
+                        color_formats[color_index],
+                        ICET_IMAGE_DEPTH_NONE) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        printf("\n\n");
+    }
+
+    if (DoBlockTest(ICET_COMPOSITE_MODE_Z_BUFFER,
+                    ICET_IMAGE_COLOR_NONE,
+                    ICET_IMAGE_DEPTH_FLOAT) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+
+    return result;
+}
+
+int BlockSparseImages(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(BlockSparseImagesRun);
+}
@@ -0,0 +1,275 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_COMPOSITE_MODE_MAX_INTENSITY and
+** ICET_COMPOSITE_MODE_ADD.  Each process draws a pattern of colors, some
+** with a zero alpha, and the composited image must have the maximum or sum
+** of each channel over all processes.  The values are multiples of 1/256 so
+** that sums are exact in every color format and order.  With a colored
+** background and ICET_CORRECT_COLORED_BACKGROUND, the background is combined
+** with the image by the same operation (once).
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Gets the channels process rank draws at pixel in units of 1/256. */
+static void ChannelsAt(IceTInt rank, IceTSizeType pixel, IceTInt *channels)
+{
+    if ((pixel/7 + rank)%3 == 0) {
+        channels[0] = channels[1] = channels[2] = channels[3] = 0;
+    } else {
+        channels[0] = (IceTInt)((pixel*13 + rank*29)%97);
+        channels[1] = (IceTInt)((pixel*7 + rank*3)%61);
+        channels[2] = (IceTInt)((pixel + rank*101)%200);
+        /* Pixels with color but no alpha are still active. */
+        channels[3] = ((pixel + rank)%2 == 0) ? 0 : 150;
+    }
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum color_format = icetImageGetColorFormat(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTInt channels[4];
+        int channel;
+        ChannelsAt(rank, i, channels);
+        for (channel = 0; channel < 4; channel++) {
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                icetImageGetColorub(result)[4*i + channel]
+                    = (IceTUByte)channels[channel];
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                icetImageGetColorf(result)[4*i + channel]
+                    = (IceTFloat)channels[channel]/256.0f;
+            } else {
+                icetImageGetColorus(result)[4*i + channel]
+                    = icetFloatToHalf((IceTFloat)channels[channel]/256.0f);
+            }
+        }
+    }
+}
+
+/* The colored background in units of 1/256.  The alpha of 1 makes sums of
+   alpha greater than 1. */
+static const IceTInt BackgroundChannels[4] = { 64, 32, 128, 256 };
+
+static int ChannelCompositeTryFrame(IceTEnum composite_mode,
+                                    IceTEnum color_format,
+                                    IceTBoolean colored_background)
+{
+    IceTDouble identity[16];
+    IceTFloat background[4];
+    int channel;
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTInt num_proc;
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    int result = TEST_PASSED;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+    for (channel = 0; channel < 4; channel++) {
+        background[channel] = colored_background
+            ? (IceTFloat)BackgroundChannels[channel]/256.0f : 0.0f;
+    }
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    icetCompositeMode(composite_mode);
+    icetSetColorFormat(color_format);
+
+    image = icetDrawFrame(identity, identity, background);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) return result;
+
+    num_pixels = icetImageGetNumPixels(image);
+    for (i = 0; i < num_pixels; i++) {
+        IceTInt expected[4];
+        IceTInt proc;
+
+        expected[0] = expected[1] = expected[2] = expected[3] = 0;
+        for (proc = 0; proc < num_proc; proc++) {
+            IceTInt channels[4];
+            ChannelsAt(proc, i, channels);
+            for (channel = 0; channel < 4; channel++) {
+                if (composite_mode == ICET_COMPOSITE_MODE_ADD) {
+                    expected[channel] += channels[channel];
+                } else if (channels[channel] > expected[channel]) {
+                    expected[channel] = channels[channel];
+                }
+            }
+        }
+
+        for (channel = 0; channel < 4; channel++) {
+            IceTFloat actual;
+            IceTFloat value;
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                /* The background is converted to bytes as 255*color. */
+                IceTInt background_byte = (IceTInt)(255*background[channel]);
+                IceTInt byte;
+                if (composite_mode == ICET_COMPOSITE_MODE_ADD) {
+                    byte = expected[channel] + background_byte;
+                } else {
+                    byte = (expected[channel] > background_byte)
+                        ? expected[channel] : background_byte;
+                }
+                actual = icetImageGetColorcub(image)[4*i + channel];
+                value = (IceTFloat)((byte < 255) ? byte : 255);
+            } else {
+                IceTFloat background_value = background[channel];
+                if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                    actual = icetImageGetColorcf(image)[4*i + channel];
+                } else {
+                    actual = icetHalfToFloat(
+                                 icetImageGetColorcus(image)[4*i + channel]);
+                }
+                value = (IceTFloat)expected[channel]/256.0f;
+                if (composite_mode == ICET_COMPOSITE_MODE_ADD) {
+                    value += background_value;
+                } else if (background_value > value) {
+                    value = background_value;
+                }
+            }
+            if (actual != value) {
+                printf("*** Pixel %d channel %d is %f, expected %f.\n",
+                       (int)i, channel, actual, value);
+                result = TEST_FAILED;
+                break;
+            }
+        }
+        if (result != TEST_PASSED) break;
+    }
+
+    return result;
+}
+
+static int ChannelCompositeRun(void)
+{
+    IceTEnum strategies[5];
+    IceTEnum single_image_strategies[3];
+    IceTEnum composite_modes[2];
+    IceTEnum color_formats[3];
+    IceTInt num_proc;
+    IceTInt rank;
+    int strategy_index;
+    int result = TEST_PASSED;
+
+    strategies[0] = ICET_STRATEGY_DIRECT;
+    strategies[1] = ICET_STRATEGY_SEQUENTIAL;
+    strategies[2] = ICET_STRATEGY_SPLIT;
+    strategies[3] = ICET_STRATEGY_REDUCE;
+    strategies[4] = ICET_STRATEGY_VTREE;
+
+    single_image_strategies[0] = ICET_SINGLE_IMAGE_STRATEGY_BSWAP;
+    single_image_strategies[1] = ICET_SINGLE_IMAGE_STRATEGY_TREE;
+    single_image_strategies[2] = ICET_SINGLE_IMAGE_STRATEGY_RADIXK;
+
+    composite_modes[0] = ICET_COMPOSITE_MODE_MAX_INTENSITY;
+    composite_modes[1] = ICET_COMPOSITE_MODE_ADD;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+    color_formats[2] = ICET_IMAGE_COLOR_RGBA_HALF;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetDisable(ICET_ORDERED_COMPOSITE);
+    icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, num_proc-1);
+
+    for (strategy_index = 0; strategy_index < 5; strategy_index++) {
+        int single_image_strategy_index;
+
+        icetStrategy(strategies[strategy_index]);
+
+        for (single_image_strategy_index = 0;
+             single_image_strategy_index < 3;
+             single_image_strategy_index++) {
+            int mode_index;
+
+            icetSingleImageStrategy(
+                single_image_strategies[single_image_strategy_index]);
+
+            for (mode_index = 0; mode_index < 2; mode_index++) {
+                int color_format_index;
+                for (color_format_index = 0;
+                     color_format_index < 3;
+                     color_format_index++) {
+                    int colored;
+                    for (colored = 0; colored < 2; colored++) {
+                        if (rank == 0) {
+                            printf("    %s strategy, %s single image"
+                                   " strategy, mode 0x%X, color format"
+                                   " 0x%X, %s background\n",
+                                   icetGetStrategyName(),
+                                   icetGetSingleImageStrategyName(),
+                                   composite_modes[mode_index],
+                                   color_formats[color_format_index],
+                                   colored ? "colored" : "black");
+                        }
+
+                        /* Keep drawing frames after a failure so that all
+                           processes stay in step. */
+                        if (ChannelCompositeTryFrame(
+                                composite_modes[mode_index],
+                                color_formats[color_format_index],
+                                (IceTBoolean)colored)
+                            != TEST_PASSED) {
+                            result = TEST_FAILED;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    icetDisable(ICET_CORRECT_COLORED_BACKGROUND);
+
+    return result;
+}
+
+int ChannelComposite(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(ChannelCompositeRun);
+}
@@ -0,0 +1,339 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the compact run length encoding of sparse images
+** (enabled with ICET_COMPACT_RUN_LENGTHS).  It reports how much smaller the
+** compact encoding makes a fragmented image and checks that decompression,
+** splitting, interlacing, and compositing give the same results with either
+** encoding.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_PARTITIONS 4
+
+/* Fills the image with something like a rendering of many small particles:
+   lots of short active runs separated by short gaps.  There is also an
+   inactive run at the start and an active run in the middle that are too
+   long to fit in a single compact run length.  The same image is created
+   for a given seed. */
+static void InitFragmentedImage(IceTImage image, unsigned int seed)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
+    IceTSizeType num_pixels = icetImageGetNumPixels(image);
+    IceTSizeType pixel = 0;
+    IceTBoolean active = ICET_FALSE;
+    IceTBoolean long_active_run = ICET_FALSE;
+
+    srand(seed);
+
+    while (pixel < num_pixels) {
+        IceTSizeType run_length;
+        IceTSizeType end;
+
+        if (pixel == 0) {
+            run_length = 70000 + rand()%10000;
+        } else if (active && !long_active_run && (pixel > num_pixels/2)) {
+            run_length = 70000 + rand()%10000;
+            long_active_run = ICET_TRUE;
+        } else if (active) {
+            run_length = rand()%4 + 1;
+        } else {
+            run_length = rand()%16 + 1;
+        }
+        end = pixel + run_length;
+        if (end > num_pixels) end = num_pixels;
+
+        for ( ; pixel < end; pixel++) {
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                IceTUByte *color = icetImageGetColorub(image) + 4*pixel;
+                color[0] = (IceTUByte)(rand()%256);
+                color[1] = (IceTUByte)(rand()%256);
+                color[2] = (IceTUByte)(rand()%256);
+                color[3] = active ? (IceTUByte)(rand()%255 + 1) : 0;
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                IceTFloat *color = icetImageGetColorf(image) + 4*pixel;
+                color[0] = (IceTFloat)(rand()%256)/255;
+                color[1] = (IceTFloat)(rand()%256)/255;
+                color[2] = (IceTFloat)(rand()%256)/255;
+                color[3] = active ? (IceTFloat)(rand()%255 + 1)/255 : 0.0f;
+            }
+            if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+                IceTFloat *depth = icetImageGetDepthf(image) + pixel;
+                depth[0] = active ? (IceTFloat)(rand()%255)/255 : 1.0f;
+            }
+        }
+
+        active = !active;
+    }
+}
+
+static IceTSizeType WireSize(IceTSparseImage image)
+{
+    IceTVoid *buffer;
+    IceTSizeType size;
+    icetSparseImagePackageForSend(image, &buffer, &size);
+    return size;
+}
+
+static int DoCompactRunLengthsTest(IceTEnum color_format,
+                                   IceTEnum depth_format,
+                                   IceTEnum composite_mode)
+{
+    IceTSizeType num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    IceTSizeType partition_pixels;
+    IceTVoid *buffers[10 + 3*NUM_PARTITIONS];
+    int num_buffers = 0;
+    IceTImage image;
+    IceTImage expected_full;
+    IceTImage actual_full;
+    IceTSparseImage standard_front, standard_back, standard_result;
+    IceTSparseImage compact_front, compact_back, compact_result;
+    IceTSparseImage mixed_result;
+    IceTSparseImage standard_partitions[NUM_PARTITIONS];
+    IceTSparseImage compact_partitions[NUM_PARTITIONS];
+    IceTSparseImage mixed_partitions[NUM_PARTITIONS];
+    IceTSizeType offsets[NUM_PARTITIONS];
+    IceTSizeType standard_size, compact_size;
+    int compact_dest;
+    int partition;
+    int result = TEST_PASSED;
+
+    printf("Using color format of 0x%x\n", (int)color_format);
+    printf("Using depth format of 0x%x\n", (int)depth_format);
+    printf("Using composite mode of 0x%x\n", (int)composite_mode);
+
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+    icetCompositeMode(composite_mode);
+
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    image = icetImageAssignBuffer(buffers[num_buffers++],
+                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    expected_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                          SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    actual_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                        SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    standard_front = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                             &buffers[num_buffers++]);
+    standard_back = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+    standard_result = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                              &buffers[num_buffers++]);
+    mixed_result = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    compact_front = new_layout_sparse_image(TEST_SPARSE_COMPACT, SCREEN_WIDTH,
+                                            SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+    compact_back = new_layout_sparse_image(TEST_SPARSE_COMPACT, SCREEN_WIDTH,
+                                           SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    compact_result = new_layout_sparse_image(TEST_SPARSE_COMPACT, SCREEN_WIDTH,
+                                             SCREEN_HEIGHT,
+                                             &buffers[num_buffers++]);
+
+    partition_pixels = icetSparseImageSplitPartitionNumPixels(num_pixels,
+                                                              NUM_PARTITIONS,
+                                                              NUM_PARTITIONS);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        standard_partitions[partition]
+            = new_layout_sparse_image(0, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+        mixed_partitions[partition]
+            = new_layout_sparse_image(0, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+        compact_partitions[partition]
+            = new_layout_sparse_image(TEST_SPARSE_COMPACT, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+    }
+
+    InitFragmentedImage(image, 12345);
+    icetCompressImage(image, standard_front);
+    icetCompressImage(image, compact_front);
+    InitFragmentedImage(image, 54321);
+    icetCompressImage(image, standard_back);
+    icetCompressImage(image, compact_back);
+
+    standard_size = WireSize(standard_front);
+    compact_size = WireSize(compact_front);
+    printf("Standard run lengths: %d bytes\n", (int)standard_size);
+    printf("Compact run lengths:  %d bytes\n", (int)compact_size);
+    printf("Reduction: %.1f%%\n",
+           100.0*(double)(standard_size - compact_size)/(double)standard_size);
+    if (compact_size >= standard_size) {
+        printf("*** Compact run lengths did not make the image smaller.\n");
+        result = TEST_FAILED;
+    }
+    if (compact_size > icetSparseImageBufferSize(SCREEN_WIDTH,SCREEN_HEIGHT)) {
+        printf("*** Compact image larger than advertised buffer size.\n");
+        result = TEST_FAILED;
+    }
+
+    printf("Checking decompression.\n");
+    if (compare_sparse_images(standard_front, compact_front, expected_full,
+                              actual_full, "Decompression") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+  /* Check each operation on compact input, writing both compact and
+     standard run lengths, against doing the same with standard run
+     lengths. */
+    for (compact_dest = 0; compact_dest < 2; compact_dest++) {
+        IceTSparseImage dest = compact_dest ? compact_result : mixed_result;
+        IceTSparseImage *dest_partitions
+            = compact_dest ? compact_partitions : mixed_partitions;
+
+        printf("Writing %s run lengths.\n",
+               compact_dest ? "compact" : "standard");
+
+        printf("  Checking interlace.\n");
+        icetSparseImageInterlace(standard_front,
+                                 NUM_PARTITIONS,
+                                 ICET_SI_STRATEGY_BUFFER_0,
+                                 standard_result);
+        icetSparseImageInterlace(compact_front,
+                                 NUM_PARTITIONS,
+                                 ICET_SI_STRATEGY_BUFFER_0,
+                                 dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Interlace") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("  Checking split.\n");
+        icetSparseImageSplit(standard_front,
+                             0,
+                             NUM_PARTITIONS,
+                             NUM_PARTITIONS,
+                             standard_partitions,
+                             offsets);
+        icetSparseImageSplit(compact_front,
+                             0,
+                             NUM_PARTITIONS,
+                             NUM_PARTITIONS,
+                             dest_partitions,
+                             offsets);
+        for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+            if (compare_sparse_images(standard_partitions[partition],
+                                      dest_partitions[partition], expected_full,
+                                      actual_full, "Split") != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+        }
+
+        printf("  Checking composite.\n");
+        icetCompressedCompressedComposite(standard_front,
+                                          standard_back,
+                                          standard_result);
+        icetCompressedCompressedComposite(compact_front,
+                                          compact_back,
+                                          dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Composite") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        icetCompressedCompressedComposite(compact_front,
+                                          standard_back,
+                                          dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Composite") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Checking split in place.\n");
+    icetSparseImageCopyPixels(compact_front, 0, num_pixels, compact_result);
+    compact_partitions[0] = compact_result;
+    icetSparseImageSplit(compact_result,
+                         0,
+                         NUM_PARTITIONS,
+                         NUM_PARTITIONS,
+                         compact_partitions,
+                         offsets);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        if (compare_sparse_images(standard_partitions[partition],
+                                  compact_partitions[partition], expected_full,
+                                  actual_full,
+                                  "Split in place") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+    return result;
+}
+
+static int CompactRunLengthsRun()
+{
+    int result = TEST_PASSED;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+
+    printf("Compress depth only.\n");
+    if (DoCompactRunLengthsTest(ICET_IMAGE_COLOR_NONE,
+                                ICET_IMAGE_DEPTH_FLOAT,
+                                ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 8-bit color only.\n");
+    if (DoCompactRunLengthsTest(ICET_IMAGE_COLOR_RGBA_UBYTE,
+                                ICET_IMAGE_DEPTH_NONE,
+                                ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 32-bit color only.\n");
+    if (DoCompactRunLengthsTest(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                ICET_IMAGE_DEPTH_NONE,
+                                ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress depth and 8-bit color.\n");
+    if (DoCompactRunLengthsTest(ICET_IMAGE_COLOR_RGBA_UBYTE,
+                                ICET_IMAGE_DEPTH_FLOAT,
+                                ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress depth and 32-bit color.\n");
+    if (DoCompactRunLengthsTest(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                ICET_IMAGE_DEPTH_FLOAT,
+                                ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+
+    return result;
+}
+
+int CompactRunLengths(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(CompactRunLengthsRun);
+}
@@ -0,0 +1,292 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks that the operations on full images that are split among
+** threads when ICET_NUM_THREADS is greater than 1 (icetComposite, the color
+** copies, and the background correction of icetDrawFrame) give exactly the
+** same results as when they run on one thread.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* An odd size so that the ranges do not fall on round numbers. */
+#define IMAGE_WIDTH     517
+#define IMAGE_HEIGHT    301
+
+static IceTInt ThreadCounts[] = { 2, 3, 7, 16, 64 };
+#define NUM_THREAD_COUNTS ((int)(sizeof(ThreadCounts)/sizeof(IceTInt)))
+
+static IceTDouble IdentityMatrix[16] = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 0.0, 0.0, 1.0
+};
+
+static void drawCallback(const IceTDouble *projection_matrix,
+                         const IceTDouble *modelview_matrix,
+                         const IceTFloat *background_color,
+                         const IceTInt *readback_viewport,
+                         IceTImage result)
+{
+  /* Don't care about this information. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    init_runs_image(result, 3);
+}
+
+static int CompareImages(const IceTImage expected, const IceTImage actual)
+{
+    IceTVoid *expected_buffer;
+    IceTVoid *actual_buffer;
+    IceTSizeType expected_size;
+    IceTSizeType actual_size;
+
+    icetImagePackageForSend(expected, &expected_buffer, &expected_size);
+    icetImagePackageForSend(actual, &actual_buffer, &actual_size);
+    if (   (expected_size != actual_size)
+        || (memcmp(expected_buffer, actual_buffer, expected_size) != 0) ) {
+        printf("*** Image does not match the one made with 1 thread.\n");
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+static int CompareBuffers(const IceTVoid *expected,
+                          const IceTVoid *actual,
+                          IceTSizeType size)
+{
+    if (memcmp(expected, actual, size) != 0) {
+        printf("*** Colors do not match those copied with 1 thread.\n");
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+static int DoCompositeThreadsTest(IceTEnum color_format,
+                                  IceTEnum depth_format,
+                                  IceTEnum composite_mode)
+{
+    IceTVoid *buffers[8];
+    int num_buffers = 0;
+    IceTImage front, back, expected, actual;
+    IceTSizeType num_pixels = IMAGE_WIDTH*IMAGE_HEIGHT;
+    IceTUByte *expected_ub, *actual_ub;
+    IceTFloat *expected_f, *actual_f;
+    int src_on_top;
+    int thread_idx;
+    int result = TEST_PASSED;
+
+    printf("Using color format of 0x%x\n", (int)color_format);
+    printf("Using depth format of 0x%x\n", (int)depth_format);
+    printf("Using composite mode of 0x%x\n", (int)composite_mode);
+
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+    icetCompositeMode(composite_mode);
+
+#define NEW_IMAGE(image)                                                \
+    buffers[num_buffers]                                                \
+        = malloc(icetImageBufferSize(IMAGE_WIDTH, IMAGE_HEIGHT));       \
+    image = icetImageAssignBuffer(buffers[num_buffers++],               \
+                                  IMAGE_WIDTH, IMAGE_HEIGHT)
+    NEW_IMAGE(front);
+    NEW_IMAGE(back);
+    NEW_IMAGE(expected);
+    NEW_IMAGE(actual);
+#undef NEW_IMAGE
+    expected_ub = malloc(4*num_pixels);
+    buffers[num_buffers++] = expected_ub;
+    actual_ub = malloc(4*num_pixels);
+    buffers[num_buffers++] = actual_ub;
+    expected_f = malloc(4*num_pixels*sizeof(IceTFloat));
+    buffers[num_buffers++] = expected_f;
+    actual_f = malloc(4*num_pixels*sizeof(IceTFloat));
+    buffers[num_buffers++] = actual_f;
+
+    init_runs_image(front, 1);
+    init_runs_image(back, 2);
+
+    for (src_on_top = 0; src_on_top < 2; src_on_top++) {
+        printf("Compositing with source %s.\n",
+               src_on_top ? "on top" : "underneath");
+        icetStateSetInteger(ICET_NUM_THREADS, 1);
+        icetImageCopyPixels(back, 0, expected, 0, num_pixels);
+        icetComposite(expected, front, src_on_top);
+        for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+            printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+            icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+            icetImageCopyPixels(back, 0, actual, 0, num_pixels);
+            icetComposite(actual, front, src_on_top);
+            if (CompareImages(expected, actual) != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+        }
+    }
+
+    if (color_format != ICET_IMAGE_COLOR_NONE) {
+        printf("Copying colors.\n");
+        icetStateSetInteger(ICET_NUM_THREADS, 1);
+        icetImageCopyColorub(front, expected_ub, ICET_IMAGE_COLOR_RGBA_UBYTE);
+        icetImageCopyColorf(front, expected_f, ICET_IMAGE_COLOR_RGBA_FLOAT);
+        for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+            printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+            icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+            memset(actual_ub, 0, 4*num_pixels);
+            icetImageCopyColorub(front, actual_ub, ICET_IMAGE_COLOR_RGBA_UBYTE);
+            if (   CompareBuffers(expected_ub, actual_ub, 4*num_pixels)
+                != TEST_PASSED ) {
+                result = TEST_FAILED;
+            }
+            memset(actual_f, 0, 4*num_pixels*sizeof(IceTFloat));
+            icetImageCopyColorf(front, actual_f, ICET_IMAGE_COLOR_RGBA_FLOAT);
+            if (   CompareBuffers(expected_f,
+                                  actual_f,
+                                  4*num_pixels*sizeof(IceTFloat))
+                != TEST_PASSED ) {
+                result = TEST_FAILED;
+            }
+        }
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+    return result;
+}
+
+/* Draws a frame with a colored background, which is blended in at the end
+   of icetDrawFrame, and compares it to the frame drawn with 1 thread. */
+static int DoBackgroundThreadsTest(IceTEnum color_format)
+{
+    IceTFloat background[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+    IceTVoid *expected_buffer;
+    IceTImage expected;
+    IceTImage image;
+    int thread_idx;
+    int result = TEST_PASSED;
+
+    printf("Correcting background with color format of 0x%x\n",
+           (int)color_format);
+
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    image = icetDrawFrame(IdentityMatrix, IdentityMatrix, background);
+    if (!icetImageIsNull(image)) {
+        expected_buffer
+            = malloc(icetImageBufferSize(icetImageGetWidth(image),
+                                         icetImageGetHeight(image)));
+        expected = icetImageAssignBuffer(expected_buffer,
+                                         icetImageGetWidth(image),
+                                         icetImageGetHeight(image));
+        icetImageCopyPixels(image, 0,
+                            expected, 0,
+                            icetImageGetNumPixels(image));
+    } else {
+      /* This process does not display a tile, but it still has to take part
+         in drawing every frame. */
+        expected_buffer = NULL;
+        expected = icetImageNull();
+    }
+
+    for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+        icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+        image = icetDrawFrame(IdentityMatrix, IdentityMatrix, background);
+        if (   !icetImageIsNull(expected)
+            && (CompareImages(expected, image) != TEST_PASSED) ) {
+            result = TEST_FAILED;
+        }
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetDisable(ICET_CORRECT_COLORED_BACKGROUND);
+    free(expected_buffer);
+    return result;
+}
+
+static int CompositeThreadsRun(void)
+{
+    IceTEnum color_formats[] = {
+        ICET_IMAGE_COLOR_RGBA_UBYTE,
+        ICET_IMAGE_COLOR_RGBA_FLOAT,
+        ICET_IMAGE_COLOR_RGBA_HALF,
+        ICET_IMAGE_COLOR_NONE
+    };
+    IceTEnum depth_formats[] = {
+        ICET_IMAGE_DEPTH_FLOAT,
+        ICET_IMAGE_DEPTH_UNORM16
+    };
+    int color_idx;
+    int depth_idx;
+    int result = TEST_PASSED;
+
+    for (depth_idx = 0; depth_idx < 2; depth_idx++) {
+        for (color_idx = 0; color_idx < 4; color_idx++) {
+            printf("\n");
+            if (DoCompositeThreadsTest(color_formats[color_idx],
+                                       depth_formats[depth_idx],
+                                       ICET_COMPOSITE_MODE_Z_BUFFER)
+                != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+        }
+    }
+    for (color_idx = 0; color_idx < 3; color_idx++) {
+        printf("\n");
+        if (DoCompositeThreadsTest(color_formats[color_idx],
+                                   ICET_IMAGE_DEPTH_NONE,
+                                   ICET_COMPOSITE_MODE_BLEND)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+    icetDrawCallback(drawCallback);
+    icetStrategy(ICET_STRATEGY_SEQUENTIAL);
+    for (color_idx = 0; color_idx < 3; color_idx++) {
+        printf("\n");
+        if (DoBackgroundThreadsTest(color_formats[color_idx]) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int CompositeThreads(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(CompositeThreadsRun);
+}
@@ -0,0 +1,431 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks that compressing an image in bands (as is done when
+** ICET_NUM_THREADS is greater than 1) gives exactly the same sparse image
+** as compressing it all at once.  It also checks that compressing a tile
+** straight into partitions or interlaced order matches compressing the
+** tile image.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static IceTDouble IdentityMatrix[16] = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 0.0, 0.0, 1.0
+};
+static IceTFloat Black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+static IceTInt ThreadCounts[] = { 2, 3, 7, 16, 64 };
+#define NUM_THREAD_COUNTS ((int)(sizeof(ThreadCounts)/sizeof(IceTInt)))
+
+/* Fills the image with a mix of short runs and runs that span many bands.  A
+   few runs are too long to fit in a compact run length.  The same image is
+   created every time. */
+static void InitRunsImage(IceTImage image)
+{
+    TestImagePattern pattern;
+    init_test_image_pattern(&pattern);
+    pattern.max_run = 200;
+    pattern.long_run = 40000;
+    init_test_image(image, 12345, &pattern);
+}
+
+static void drawCallback(const IceTDouble *projection_matrix,
+                         const IceTDouble *modelview_matrix,
+                         const IceTFloat *background_color,
+                         const IceTInt *readback_viewport,
+                         IceTImage result)
+{
+  /* Don't care about this information. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    InitRunsImage(result);
+}
+
+static int CompareSparseImages(const IceTSparseImage expected,
+                               const IceTSparseImage actual)
+{
+    IceTVoid *expected_buffer;
+    IceTVoid *actual_buffer;
+    IceTSizeType expected_size;
+    IceTSizeType actual_size;
+
+    if (   (icetSparseImageGetWidth(expected)
+            != icetSparseImageGetWidth(actual))
+        || (icetSparseImageGetHeight(expected)
+            != icetSparseImageGetHeight(actual)) ) {
+        printf("*** Dimensions of images do not match.\n");
+        return TEST_FAILED;
+    }
+
+    icetSparseImagePackageForSend(expected, &expected_buffer, &expected_size);
+    icetSparseImagePackageForSend(actual, &actual_buffer, &actual_size);
+    if (expected_size != actual_size) {
+        printf("*** Expected a compressed size of %d, got %d.\n",
+               (int)expected_size, (int)actual_size);
+        return TEST_FAILED;
+    }
+    if (memcmp(expected_buffer, actual_buffer, expected_size) != 0) {
+        printf("*** Compressed data does not match.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+/* Checks that compressing the tile straight into partitions gives the same
+   pieces as compressing the whole tile image into partitions, with any
+   number of threads. */
+#define TILE_SPLIT_PARTITIONS 3
+#define TILE_SPLIT_EVENTUAL_PARTITIONS 6
+static int CompareTileSplit(IceTImage image)
+{
+    IceTSparseImage expected_pieces[TILE_SPLIT_PARTITIONS];
+    IceTSparseImage pieces[TILE_SPLIT_PARTITIONS];
+    IceTSizeType expected_offsets[TILE_SPLIT_PARTITIONS];
+    IceTSizeType offsets[TILE_SPLIT_PARTITIONS];
+    IceTSizeType piece_pixels;
+    IceTSizeType piece_size;
+    IceTByte *buffer;
+    int partition;
+    int thread_idx;
+    int result = TEST_PASSED;
+
+    printf("Compressing tile image into partitions.\n");
+
+    piece_pixels = icetSparseImageSplitPartitionNumPixels(
+                                              SCREEN_WIDTH*SCREEN_HEIGHT,
+                                              TILE_SPLIT_PARTITIONS,
+                                              TILE_SPLIT_EVENTUAL_PARTITIONS);
+    piece_size = icetSparseImageBufferSize(piece_pixels, 1);
+    buffer = malloc(2*TILE_SPLIT_PARTITIONS*piece_size);
+    for (partition = 0; partition < TILE_SPLIT_PARTITIONS; partition++) {
+        expected_pieces[partition]
+            = icetSparseImageAssignBuffer(buffer + 2*partition*piece_size,
+                                          piece_pixels, 1);
+        pieces[partition]
+            = icetSparseImageAssignBuffer(buffer + (2*partition+1)*piece_size,
+                                          piece_pixels, 1);
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetGetTileImage(0, image);
+    icetCompressImageSplit(image,
+                           TILE_SPLIT_PARTITIONS,
+                           TILE_SPLIT_EVENTUAL_PARTITIONS,
+                           expected_pieces,
+                           expected_offsets);
+
+    for (thread_idx = -1; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        IceTInt num_threads = (thread_idx < 0) ? 1 : ThreadCounts[thread_idx];
+        printf("  with %d threads\n", (int)num_threads);
+        icetStateSetInteger(ICET_NUM_THREADS, num_threads);
+        icetGetCompressedTileImageSplit(0,
+                                        TILE_SPLIT_PARTITIONS,
+                                        TILE_SPLIT_EVENTUAL_PARTITIONS,
+                                        pieces,
+                                        offsets);
+        for (partition = 0; partition < TILE_SPLIT_PARTITIONS; partition++) {
+            if (offsets[partition] != expected_offsets[partition]) {
+                printf("*** Partition %d has offset %d, expected %d.\n",
+                       partition,
+                       (int)offsets[partition],
+                       (int)expected_offsets[partition]);
+                result = TEST_FAILED;
+            }
+            if (   CompareSparseImages(expected_pieces[partition],
+                                       pieces[partition])
+                != TEST_PASSED) {
+                printf("*** Partition %d does not match.\n", partition);
+                result = TEST_FAILED;
+            }
+        }
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+
+    free(buffer);
+    return result;
+}
+
+/* Checks that compressing the tile straight into interlaced order gives the
+   same image as compressing the whole tile image into interlaced order, with
+   any number of threads.  The compressed images must be the size of the
+   tile. */
+#define TILE_INTERLACE_PARTITIONS 7
+static int CompareTileInterlace(IceTImage image,
+                                IceTSparseImage expectedimage,
+                                IceTSparseImage compressedimage)
+{
+    int thread_idx;
+    int result = TEST_PASSED;
+
+    printf("Compressing tile image into interlaced order.\n");
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetGetTileImage(0, image);
+    icetCompressImageInterlace(image,
+                               TILE_INTERLACE_PARTITIONS,
+                               ICET_SI_STRATEGY_BUFFER_1,
+                               expectedimage);
+
+    for (thread_idx = -1; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        IceTInt num_threads = (thread_idx < 0) ? 1 : ThreadCounts[thread_idx];
+        printf("  with %d threads\n", (int)num_threads);
+        icetStateSetInteger(ICET_NUM_THREADS, num_threads);
+        icetGetCompressedTileImageInterlace(0,
+                                            TILE_INTERLACE_PARTITIONS,
+                                            ICET_SI_STRATEGY_BUFFER_1,
+                                            compressedimage);
+        if (CompareSparseImages(expectedimage, compressedimage)!=TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+
+    return result;
+}
+
+static int DoCompressionThreadsTest(IceTEnum color_format,
+                                    IceTEnum depth_format,
+                                    IceTEnum composite_mode)
+{
+    IceTImage image;
+    IceTVoid *imagebuffer;
+    IceTSizeType imagesize;
+    IceTSparseImage expectedimage;
+    IceTVoid *expectedbuffer;
+    IceTSparseImage compressedimage;
+    IceTVoid *compressedbuffer;
+    IceTSizeType compressedsize;
+    IceTInt viewport[4];
+    IceTSizeType offset, pixels;
+    int thread_idx;
+    int result;
+
+    result = TEST_PASSED;
+
+    printf("Using color format of 0x%x\n", (int)color_format);
+    printf("Using depth format of 0x%x\n", (int)depth_format);
+    printf("Using composite mode of 0x%x\n", (int)composite_mode);
+
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+    icetCompositeMode(composite_mode);
+
+    imagesize = icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT);
+    imagebuffer = malloc(imagesize);
+    image = icetImageAssignBuffer(imagebuffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    compressedsize = icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT);
+    expectedbuffer = malloc(compressedsize);
+    expectedimage = icetSparseImageAssignBuffer(expectedbuffer,
+                                                SCREEN_WIDTH,
+                                                SCREEN_HEIGHT);
+    compressedbuffer = malloc(compressedsize);
+    compressedimage = icetSparseImageAssignBuffer(compressedbuffer,
+                                                  SCREEN_WIDTH,
+                                                  SCREEN_HEIGHT);
+
+    InitRunsImage(image);
+
+    printf("Compressing whole image.\n");
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetCompressImage(image, expectedimage);
+    for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+        icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+        icetCompressImage(image, compressedimage);
+        if (CompareSparseImages(expectedimage, compressedimage)!=TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    offset = 37;
+    pixels = SCREEN_WIDTH*SCREEN_HEIGHT - 2*offset - 11;
+    printf("Compressing %d pixels at offset %d.\n", (int)pixels, (int)offset);
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetCompressSubImage(image, offset, pixels, expectedimage);
+    for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+        icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+        icetCompressSubImage(image, offset, pixels, compressedimage);
+        if (CompareSparseImages(expectedimage, compressedimage)!=TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+  /* As in the CompressionSize test, set up the state that
+   * icetGetCompressedTileImage expects by hand.  The contained viewport is
+   * made smaller than the tile so that the compressed image is padded. */
+    printf("Setup for actual render.\n");
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+    icetDrawCallback(drawCallback);
+    icetDrawFrame(IdentityMatrix, IdentityMatrix, Black);
+    viewport[0] = 13;  viewport[1] = 7;
+    viewport[2] = (IceTInt)SCREEN_WIDTH - 13 - 21;
+    viewport[3] = (IceTInt)SCREEN_HEIGHT - 7 - 5;
+    icetStateSetIntegerv(ICET_CONTAINED_VIEWPORT, 4, viewport);
+    printf("Compressing padded tile image.\n");
+    icetGetCompressedTileImage(0, expectedimage);
+    for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+        icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+        icetGetCompressedTileImage(0, compressedimage);
+        if (CompareSparseImages(expectedimage, compressedimage)!=TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+    if (CompareTileSplit(image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (   CompareTileInterlace(image, expectedimage, compressedimage)
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    viewport[0] = 0;  viewport[1] = 3;
+    viewport[2] = (IceTInt)SCREEN_WIDTH;
+    viewport[3] = (IceTInt)SCREEN_HEIGHT - 3 - 9;
+    icetStateSetIntegerv(ICET_CONTAINED_VIEWPORT, 4, viewport);
+    printf("Compressing tile image padded on top and bottom.\n");
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+    icetGetCompressedTileImage(0, expectedimage);
+    for (thread_idx = 0; thread_idx < NUM_THREAD_COUNTS; thread_idx++) {
+        printf("  with %d threads\n", (int)ThreadCounts[thread_idx]);
+        icetStateSetInteger(ICET_NUM_THREADS, ThreadCounts[thread_idx]);
+        icetGetCompressedTileImage(0, compressedimage);
+        if (CompareSparseImages(expectedimage, compressedimage)!=TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+    if (CompareTileSplit(image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (   CompareTileInterlace(image, expectedimage, compressedimage)
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+
+    free(imagebuffer);
+    free(expectedbuffer);
+    free(compressedbuffer);
+    return result;
+}
+
+static int DoCompressionThreadsFormats(void)
+{
+    int result = TEST_PASSED;
+
+    printf("Compress depth only.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_NONE,
+                                 ICET_IMAGE_DEPTH_FLOAT,
+                                 ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 8-bit color only.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_UBYTE,
+                                 ICET_IMAGE_DEPTH_NONE,
+                                 ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 32-bit color only.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                 ICET_IMAGE_DEPTH_NONE,
+                                 ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress depth and 8-bit color.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_UBYTE,
+                                 ICET_IMAGE_DEPTH_FLOAT,
+                                 ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress depth and 32-bit color.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                 ICET_IMAGE_DEPTH_FLOAT,
+                                 ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 16-bit color only.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_HALF,
+                                 ICET_IMAGE_DEPTH_NONE,
+                                 ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress depth and 16-bit color.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_HALF,
+                                 ICET_IMAGE_DEPTH_FLOAT,
+                                 ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompress 16-bit depth and 8-bit color.\n");
+    if (DoCompressionThreadsTest(ICET_IMAGE_COLOR_RGBA_UBYTE,
+                                 ICET_IMAGE_DEPTH_UNORM16,
+                                 ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    return result;
+}
+
+static int CompressionThreadsRun()
+{
+    int result = TEST_PASSED;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+
+    printf("Standard run lengths.\n\n");
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    if (DoCompressionThreadsFormats() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nCompact run lengths.\n\n");
+    icetEnable(ICET_COMPACT_RUN_LENGTHS);
+    if (DoCompressionThreadsFormats() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+
+    return result;
+}
+
+int CompressionThreads(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(CompressionThreadsRun);
+}
@@ -0,0 +1,193 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the ICET_IMAGE_DEPTH_UNORM16 depth format.  It composites
+** the same images stored with 16-bit and with floating point depth and checks
+** that compression, decompression, and all the z-buffer compositing
+** operations give the same answer.  It also checks that the 16-bit depth
+** makes compressed images smaller.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+static int DoDepthUnorm16Test(IceTEnum color_format)
+{
+    IceTVoid *buffers[12];
+    int num_buffers = 0;
+    IceTImage unorm16_front, unorm16_back, unorm16_result;
+    IceTImage float_front, float_back, float_result;
+    IceTSparseImage unorm16_sparse_front, unorm16_sparse_back;
+    IceTSparseImage unorm16_sparse_result;
+    IceTSparseImage float_sparse_front, float_sparse_back;
+    IceTSparseImage float_sparse_result;
+    IceTSizeType num_active;
+    IceTSizeType unorm16_size, float_size;
+    int result = TEST_PASSED;
+    int i;
+
+    printf("Using color format of 0x%x\n", (int)color_format);
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+
+    unorm16_front = new_test_image(color_format, ICET_IMAGE_DEPTH_UNORM16,
+                                   &buffers[num_buffers++]);
+    unorm16_back = new_test_image(color_format, ICET_IMAGE_DEPTH_UNORM16,
+                                  &buffers[num_buffers++]);
+    unorm16_result = new_test_image(color_format, ICET_IMAGE_DEPTH_UNORM16,
+                                    &buffers[num_buffers++]);
+    float_front = new_test_image(color_format, ICET_IMAGE_DEPTH_FLOAT,
+                                 &buffers[num_buffers++]);
+    float_back = new_test_image(color_format, ICET_IMAGE_DEPTH_FLOAT,
+                                &buffers[num_buffers++]);
+    float_result = new_test_image(color_format, ICET_IMAGE_DEPTH_FLOAT,
+                                  &buffers[num_buffers++]);
+    unorm16_sparse_front = new_test_sparse_image(color_format,
+                                                 ICET_IMAGE_DEPTH_UNORM16,
+                                                 &buffers[num_buffers++]);
+    unorm16_sparse_back = new_test_sparse_image(color_format,
+                                                ICET_IMAGE_DEPTH_UNORM16,
+                                                &buffers[num_buffers++]);
+    unorm16_sparse_result = new_test_sparse_image(color_format,
+                                                  ICET_IMAGE_DEPTH_UNORM16,
+                                                  &buffers[num_buffers++]);
+    float_sparse_front = new_test_sparse_image(color_format,
+                                               ICET_IMAGE_DEPTH_FLOAT,
+                                               &buffers[num_buffers++]);
+    float_sparse_back = new_test_sparse_image(color_format,
+                                              ICET_IMAGE_DEPTH_FLOAT,
+                                              &buffers[num_buffers++]);
+    float_sparse_result = new_test_sparse_image(color_format,
+                                                ICET_IMAGE_DEPTH_FLOAT,
+                                                &buffers[num_buffers++]);
+
+    num_active = init_runs_image(unorm16_front, 1);
+    init_runs_image(unorm16_back, 2);
+    init_runs_image(float_front, 1);
+    init_runs_image(float_back, 2);
+
+    printf("Checking compression.\n");
+    icetCompressImage(unorm16_front, unorm16_sparse_front);
+    icetCompressImage(unorm16_back, unorm16_sparse_back);
+    icetCompressImage(float_front, float_sparse_front);
+    icetCompressImage(float_back, float_sparse_back);
+    unorm16_size = icetSparseImageGetCompressedBufferSize(unorm16_sparse_front);
+    float_size = icetSparseImageGetCompressedBufferSize(float_sparse_front);
+    printf("Float depth:     %d bytes\n", (int)float_size);
+    printf("16-bit depth:    %d bytes\n", (int)unorm16_size);
+    if (   float_size - unorm16_size
+        != num_active*(IceTSizeType)(sizeof(IceTFloat)-sizeof(IceTUShort)) ) {
+        printf("*** Expected 16-bit depth to save %d bytes.\n",
+               (int)(num_active*(sizeof(IceTFloat)-sizeof(IceTUShort))));
+        result = TEST_FAILED;
+    }
+
+    printf("Checking decompression.\n");
+    icetDecompressImage(unorm16_sparse_front, unorm16_result);
+    icetDecompressImage(float_sparse_front, float_result);
+    if (compare_test_images(unorm16_result, float_result, 0.0f,
+                            "Decompress") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (compare_test_images(unorm16_front, float_front, 0.0f, "Original")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking full image composite.\n");
+    icetImageCopyPixels(unorm16_back, 0, unorm16_result, 0,
+                        icetImageGetNumPixels(unorm16_back));
+    icetImageCopyPixels(float_back, 0, float_result, 0,
+                        icetImageGetNumPixels(float_back));
+    icetComposite(unorm16_result, unorm16_front, 1);
+    icetComposite(float_result, float_front, 1);
+    if (compare_test_images(unorm16_result, float_result, 0.0f,
+                            "Composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking compressed composite.\n");
+    icetImageCopyPixels(unorm16_back, 0, unorm16_result, 0,
+                        icetImageGetNumPixels(unorm16_back));
+    icetImageCopyPixels(float_back, 0, float_result, 0,
+                        icetImageGetNumPixels(float_back));
+    icetCompressedComposite(unorm16_result, unorm16_sparse_front, 1);
+    icetCompressedComposite(float_result, float_sparse_front, 1);
+    if (compare_test_images(unorm16_result, float_result, 0.0f,
+                            "Compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking compressed-compressed composite.\n");
+    icetCompressedCompressedComposite(unorm16_sparse_front,
+                                      unorm16_sparse_back,
+                                      unorm16_sparse_result);
+    icetCompressedCompressedComposite(float_sparse_front,
+                                      float_sparse_back,
+                                      float_sparse_result);
+    icetDecompressImage(unorm16_sparse_result, unorm16_result);
+    icetDecompressImage(float_sparse_result, float_result);
+    if (compare_test_images(unorm16_result, float_result, 0.0f,
+                            "Compressed-compressed composite")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking clear.\n");
+    icetClearImage(unorm16_result);
+    icetClearImage(float_result);
+    if (compare_test_images(unorm16_result, float_result, 0.0f, "Clear")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (i = 0; i < num_buffers; i++) {
+        free(buffers[i]);
+    }
+
+    return result;
+}
+
+static int DepthUnorm16Run()
+{
+    int result = TEST_PASSED;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+
+    printf("Depth only.\n");
+    if (DoDepthUnorm16Test(ICET_IMAGE_COLOR_NONE) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nDepth and 8-bit color.\n");
+    if (DoDepthUnorm16Test(ICET_IMAGE_COLOR_RGBA_UBYTE) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("\n\nDepth and 32-bit color.\n");
+    if (DoDepthUnorm16Test(ICET_IMAGE_COLOR_RGBA_FLOAT) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int DepthUnorm16(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(DepthUnorm16Run);
+}
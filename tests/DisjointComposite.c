@@ -0,0 +1,328 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks icetCompressedCompressedComposite on images whose active
+** pixels do not overlap, which are composited by copying whole runs, as well
+** as on images that do overlap.  The results are checked against
+** compositing the front image onto the decompressed back image for every
+** combination of sparse image layouts, and the seek index of the result is
+** checked by copying pieces of it.  It also reports the throughput of
+** compositing screen sized images in Gpixels/s.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_PIECES              7
+#define NUM_TIMING_TRIALS       50
+
+/* The layouts are checked with images of this size.  Timing uses the size
+   of the screen. */
+#define IMAGE_WIDTH             317
+#define IMAGE_HEIGHT            203
+
+/* The ways the active pixels of the front (0) and back (1) images are
+   placed. */
+#define PATTERN_HALVES          0  /* Front in first half, back in second. */
+#define PATTERN_BANDS           1  /* Alternating bands of rows. */
+#define PATTERN_COLUMNS         2  /* Alternating narrow columns. */
+#define PATTERN_OVERLAP         3  /* Both anywhere. */
+#define NUM_PATTERNS            4
+
+static const char *g_pattern_names[NUM_PATTERNS] = {
+    "disjoint halves", "disjoint bands", "disjoint columns", "overlapping"
+};
+
+/* Returns true if the given pixel may be active in image which (0 for front,
+   1 for back) of the pattern. */
+static IceTBoolean InRegion(int pattern,
+                            int which,
+                            IceTSizeType pixel,
+                            IceTSizeType width,
+                            IceTSizeType num_pixels)
+{
+    switch (pattern) {
+      case PATTERN_HALVES:
+          return (pixel < num_pixels/2) == (which == 0);
+      case PATTERN_BANDS:
+          return (((pixel/width)/16)%2) == which;
+      case PATTERN_COLUMNS:
+          return (((pixel%width)/24)%2) == which;
+      default:
+          return ICET_TRUE;
+    }
+}
+
+/* Fills the image with short alternating runs of inactive pixels and
+   random pixels, keeping the active pixels in the region of the pattern.
+   The runs are short so that runs of one image often end just after the
+   other becomes active. */
+static void InitRegionImage(IceTImage image, int pattern, int which)
+{
+    IceTSizeType width = icetImageGetWidth(image);
+    IceTSizeType num_pixels = icetImageGetNumPixels(image);
+    IceTBoolean *mask = malloc(num_pixels*sizeof(IceTBoolean));
+    TestImagePattern image_pattern;
+    IceTSizeType pixel;
+
+    for (pixel = 0; pixel < num_pixels; pixel++) {
+        mask[pixel] = InRegion(pattern, which, pixel, width, num_pixels);
+    }
+
+    init_test_image_pattern(&image_pattern);
+    image_pattern.max_run = 60;
+    image_pattern.start_active = ICET_TRUE;
+    image_pattern.depth_levels = 8;
+    image_pattern.mask = mask;
+    init_test_image(image, 20 + 2*pattern + which, &image_pattern);
+
+    free(mask);
+}
+
+/* Compares num_pixels pixels of actual with those of expected starting at
+   offset. */
+static int ComparePixels(const IceTImage expected,
+                         IceTSizeType offset,
+                         const IceTImage actual,
+                         IceTSizeType num_pixels,
+                         const char *description)
+{
+    IceTSizeType pixel_size;
+    const IceTByte *expected_data;
+    const IceTByte *actual_data;
+
+    if (icetImageGetColorFormat(expected) != ICET_IMAGE_COLOR_NONE) {
+        expected_data = icetImageGetColorConstVoid(expected, &pixel_size);
+        actual_data = icetImageGetColorConstVoid(actual, NULL);
+        if (memcmp(expected_data + offset*pixel_size,
+                   actual_data,
+                   num_pixels*pixel_size) != 0) {
+            printf("*** %s: colors differ.\n", description);
+            return TEST_FAILED;
+        }
+    }
+    if (icetImageGetDepthFormat(expected) != ICET_IMAGE_DEPTH_NONE) {
+        expected_data = icetImageGetDepthConstVoid(expected, &pixel_size);
+        actual_data = icetImageGetDepthConstVoid(actual, NULL);
+        if (memcmp(expected_data + offset*pixel_size,
+                   actual_data,
+                   num_pixels*pixel_size) != 0) {
+            printf("*** %s: depths differ.\n", description);
+            return TEST_FAILED;
+        }
+    }
+    return TEST_PASSED;
+}
+
+static int TestFormat(IceTEnum composite_mode,
+                      IceTEnum color_format,
+                      IceTEnum depth_format)
+{
+    IceTSizeType num_pixels = IMAGE_WIDTH*IMAGE_HEIGHT;
+    IceTSizeType piece_size = num_pixels/NUM_PIECES;
+    IceTVoid *buffers[16];
+    int num_buffers = 0;
+    IceTImage full_images[2];
+    IceTImage expected;
+    IceTImage actual;
+    IceTImage piece;
+    IceTSparseImage piece_sparse;
+    int pattern;
+    int result = TEST_PASSED;
+
+    printf("Checking %s with color 0x%x and depth 0x%x.\n",
+           (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) ? "z-buffer"
+                                                             : "blend",
+           color_format, depth_format);
+
+    icetCompositeMode(composite_mode);
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+
+#define NEW_IMAGE(width, height)                                        \
+    icetImageAssignBuffer(                                              \
+        buffers[num_buffers++]                                          \
+            = malloc(icetImageBufferSize(width, height)),               \
+        width, height)
+    full_images[0] = NEW_IMAGE(IMAGE_WIDTH, IMAGE_HEIGHT);
+    full_images[1] = NEW_IMAGE(IMAGE_WIDTH, IMAGE_HEIGHT);
+    expected = NEW_IMAGE(IMAGE_WIDTH, IMAGE_HEIGHT);
+    actual = NEW_IMAGE(IMAGE_WIDTH, IMAGE_HEIGHT);
+    piece = NEW_IMAGE(piece_size, 1);
+#undef NEW_IMAGE
+    piece_sparse = new_layout_sparse_image(0, piece_size, 1,
+                                           &buffers[num_buffers++]);
+
+    for (pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+        int front_layout, back_layout, dest_layout;
+
+        InitRegionImage(full_images[0], pattern, 0);
+        InitRegionImage(full_images[1], pattern, 1);
+
+        for (front_layout = 0; front_layout < 4; front_layout++) {
+        for (back_layout = 0; back_layout < 4; back_layout++) {
+        for (dest_layout = 0; dest_layout < 4; dest_layout++) {
+            int first_buffer = num_buffers;
+            IceTSparseImage front, back, dest;
+            char description[256];
+            IceTSizeType offset;
+
+            sprintf(description, "%s, layouts %d %d %d",
+                    g_pattern_names[pattern],
+                    front_layout, back_layout, dest_layout);
+
+            front = new_layout_sparse_image(front_layout, IMAGE_WIDTH,
+                                            IMAGE_HEIGHT,
+                                            &buffers[num_buffers++]);
+            back = new_layout_sparse_image(back_layout, IMAGE_WIDTH,
+                                           IMAGE_HEIGHT,
+                                           &buffers[num_buffers++]);
+            dest = new_layout_sparse_image(dest_layout | TEST_SPARSE_INDEXED,
+                                           IMAGE_WIDTH, IMAGE_HEIGHT,
+                                           &buffers[num_buffers++]);
+            icetCompressImage(full_images[0], front);
+            icetCompressImage(full_images[1], back);
+
+            icetDecompressImage(back, expected);
+            icetCompressedComposite(expected, front, 1);
+
+            icetCompressedCompressedComposite(front, back, dest);
+            icetDecompressImage(dest, actual);
+            if (ComparePixels(expected, 0, actual, num_pixels, description)
+                != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+
+            /* Copying pieces uses the seek index of dest. */
+            for (offset = 0;
+                 offset + piece_size <= num_pixels;
+                 offset += piece_size) {
+                icetSparseImageCopyPixels(dest, offset, piece_size,
+                                          piece_sparse);
+                icetDecompressImage(piece_sparse, piece);
+                if (ComparePixels(expected, offset, piece, piece_size,
+                                  description) != TEST_PASSED) {
+                    result = TEST_FAILED;
+                }
+            }
+
+            while (num_buffers > first_buffer) {
+                free(buffers[--num_buffers]);
+            }
+        }
+        }
+        }
+    }
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+
+    return result;
+}
+
+/* Reports how fast screen sized images of each pattern are composited. */
+static void TimeComposite(void)
+{
+    IceTSizeType num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    IceTVoid *buffers[5];
+    IceTImage full_images[2];
+    IceTSparseImage front, back, dest;
+    int pattern;
+    int i;
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    for (i = 0; i < 2; i++) {
+        buffers[i]
+            = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+        full_images[i] = icetImageAssignBuffer(buffers[i],
+                                               SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    front = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                    &buffers[2]);
+    back = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT, &buffers[3]);
+    dest = new_layout_sparse_image(0, SCREEN_WIDTH, SCREEN_HEIGHT, &buffers[4]);
+
+    printf("Compositing %dx%d images:\n",
+           (int)SCREEN_WIDTH, (int)SCREEN_HEIGHT);
+    for (pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+        IceTDouble start, seconds;
+        int trial;
+
+        InitRegionImage(full_images[0], pattern, 0);
+        InitRegionImage(full_images[1], pattern, 1);
+        icetCompressImage(full_images[0], front);
+        icetCompressImage(full_images[1], back);
+
+        start = icetWallTime();
+        for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+            icetCompressedCompressedComposite(front, back, dest);
+        }
+        seconds = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+        printf("  %-16s %8.3f ms, %6.2f Gpixels/s\n",
+               g_pattern_names[pattern],
+               1000.0*seconds,
+               (seconds > 0.0) ? 1e-9*num_pixels/seconds : 0.0);
+    }
+
+    for (i = 0; i < 5; i++) {
+        free(buffers[i]);
+    }
+}
+
+static int DisjointCompositeRun(void)
+{
+    int result = TEST_PASSED;
+
+#define TEST_FORMAT(mode, color, depth)                                 \
+    if (TestFormat(mode, color, depth) != TEST_PASSED) {                \
+        result = TEST_FAILED;                                           \
+    }
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_FLOAT, ICET_IMAGE_DEPTH_UNORM16);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_NONE, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_NONE);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_FLOAT, ICET_IMAGE_DEPTH_NONE);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_HALF, ICET_IMAGE_DEPTH_NONE);
+#undef TEST_FORMAT
+
+    TimeComposite();
+
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    icetDisable(ICET_INDEX_SPARSE_IMAGES);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int DisjointComposite(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(DisjointCompositeRun);
+}
@@ -0,0 +1,339 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_COMPOSITE_MODE_FRAGMENTS.  Each process draws
+** partially transparent pixels at depths that put the processes in a
+** different order for each pixel, so no composite order could blend them.
+** When every process gets a fragment, the composited image must match
+** blending the fragments sorted by depth.  With a single fragment the colors
+** are approximate, but the opacity must still be exact.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Gets the premultiplied color and depth process rank draws at pixel.
+   Returns false if the process draws nothing there. */
+static IceTBoolean FragmentAt(IceTInt rank,
+                              IceTInt num_proc,
+                              IceTSizeType pixel,
+                              IceTFloat *color,
+                              IceTFloat *depth)
+{
+    IceTInt alpha;
+
+    if ((pixel/5 + rank)%3 == 0) {
+        color[0] = color[1] = color[2] = color[3] = 0.0f;
+        *depth = 1.0f;
+        return ICET_FALSE;
+    }
+
+    alpha = ((pixel + rank)%2 == 0) ? 192 : 64;
+    color[0] = (IceTFloat)((pixel*13 + rank*29)%(alpha + 1))/255.0f;
+    color[1] = (IceTFloat)((pixel*7 + rank*3)%(alpha + 1))/255.0f;
+    color[2] = (IceTFloat)((pixel + rank*101)%(alpha + 1))/255.0f;
+    color[3] = (IceTFloat)alpha/255.0f;
+    *depth = (IceTFloat)((rank + pixel/3)%num_proc + 1)/(num_proc + 2.0f);
+    return ICET_TRUE;
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum color_format = icetImageGetColorFormat(result);
+    IceTFloat *depth_buffer = icetImageGetDepthf(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+    IceTInt num_proc;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTFloat color[4];
+        FragmentAt(rank, num_proc, i, color, depth_buffer + i);
+        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            IceTUByte *out = icetImageGetColorub(result) + 4*i;
+            out[0] = (IceTUByte)(255*color[0] + 0.5f);
+            out[1] = (IceTUByte)(255*color[1] + 0.5f);
+            out[2] = (IceTUByte)(255*color[2] + 0.5f);
+            out[3] = (IceTUByte)(255*color[3] + 0.5f);
+        } else {
+            memcpy(icetImageGetColorf(result) + 4*i,
+                   color,
+                   4*sizeof(IceTFloat));
+        }
+    }
+}
+
+/* Blends the fragments all processes draw at pixel in depth order over the
+   background. */
+static void ExpectedPixel(IceTInt num_proc,
+                          IceTSizeType pixel,
+                          const IceTFloat *background,
+                          IceTFloat *color,
+                          IceTFloat *depth)
+{
+    IceTFloat last_depth = -1.0f;
+    IceTInt layer;
+
+    color[0] = color[1] = color[2] = color[3] = 0.0f;
+    *depth = 1.0f;
+
+    /* The depths of a pixel are distinct, so find each nearest one left. */
+    for (layer = 0; layer < num_proc; layer++) {
+        IceTFloat next_color[4];
+        IceTFloat next_depth = 2.0f;
+        IceTInt proc;
+        for (proc = 0; proc < num_proc; proc++) {
+            IceTFloat proc_color[4];
+            IceTFloat proc_depth;
+            if (   FragmentAt(proc, num_proc, pixel, proc_color, &proc_depth)
+                && (proc_depth > last_depth)
+                && (proc_depth < next_depth) ) {
+                memcpy(next_color, proc_color, 4*sizeof(IceTFloat));
+                next_depth = proc_depth;
+            }
+        }
+        if (next_depth > 1.0f) break;
+        if (last_depth < 0.0f) {
+            *depth = next_depth;
+        }
+        ICET_BLEND_FLOAT(color, next_color, color);
+        last_depth = next_depth;
+    }
+
+    ICET_UNDER_FLOAT(background, color);
+}
+
+static int FragmentCompositeTryFrame(IceTEnum color_format,
+                                     IceTBoolean use_output_buffer,
+                                     IceTBoolean exact)
+{
+    IceTDouble identity[16];
+    IceTFloat background[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTInt num_proc;
+    IceTSizeType num_pixels;
+    IceTByte *output;
+    IceTSizeType i;
+    int result = TEST_PASSED;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+
+    background[0] = 0.25f;
+    background[1] = 0.5f;
+    background[2] = 0.75f;
+    background[3] = 0.5f;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    icetSetColorFormat(color_format);
+
+    num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    output = NULL;
+    if (use_output_buffer) {
+        output = malloc(num_pixels*4*sizeof(IceTFloat));
+        memset(output, 0xAB, num_pixels*4*sizeof(IceTFloat));
+        icetOutputBuffer(color_format, 0, output);
+    }
+    image = icetDrawFrame(identity, identity, background);
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) {
+        free(output);
+        return result;
+    }
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTFloat expected[4];
+        IceTFloat expected_depth;
+        IceTFloat actual[4];
+        IceTFloat tolerance;
+        int channel;
+
+        ExpectedPixel(num_proc, i, background, expected, &expected_depth);
+
+        if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            const IceTUByte *colors = use_output_buffer
+                ? (const IceTUByte *)output : icetImageGetColorcub(image);
+            for (channel = 0; channel < 4; channel++) {
+                actual[channel] = (IceTFloat)colors[4*i + channel]/255.0f;
+            }
+            tolerance = 2.0f/255.0f;
+        } else {
+            const IceTFloat *colors = use_output_buffer
+                ? (const IceTFloat *)output : icetImageGetColorcf(image);
+            memcpy(actual, colors + 4*i, 4*sizeof(IceTFloat));
+            tolerance = 0.0001f;
+        }
+
+        /* Fragments that do not fit are blended approximately, but the
+           opacity does not depend on the order. */
+        for (channel = exact ? 0 : 3; channel < 4; channel++) {
+            IceTFloat difference = actual[channel] - expected[channel];
+            if ((difference > tolerance) || (difference < -tolerance)) {
+                printf("*** Pixel %d channel %d is %f, expected %f.\n",
+                       (int)i, channel, actual[channel], expected[channel]);
+                result = TEST_FAILED;
+                break;
+            }
+        }
+        if (result != TEST_PASSED) break;
+
+        if (   exact
+            && !use_output_buffer
+            && (icetImageGetDepthFormat(image) == ICET_IMAGE_DEPTH_FLOAT)
+            && (icetImageGetDepthcf(image)[i] != expected_depth) ) {
+            printf("*** Pixel %d depth is %f, expected %f.\n",
+                   (int)i, icetImageGetDepthcf(image)[i], expected_depth);
+            result = TEST_FAILED;
+            break;
+        }
+    }
+
+    free(output);
+    return result;
+}
+
+static int FragmentCompositeTryStrategies(IceTBoolean exact)
+{
+    IceTEnum strategies[2];
+    IceTEnum single_image_strategies[3];
+    IceTEnum color_formats[2];
+    int strategy_index;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    strategies[0] = ICET_STRATEGY_REDUCE;
+    strategies[1] = ICET_STRATEGY_SEQUENTIAL;
+
+    single_image_strategies[0] = ICET_SINGLE_IMAGE_STRATEGY_BSWAP;
+    single_image_strategies[1] = ICET_SINGLE_IMAGE_STRATEGY_TREE;
+    single_image_strategies[2] = ICET_SINGLE_IMAGE_STRATEGY_RADIXK;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    for (strategy_index = 0; strategy_index < 2; strategy_index++) {
+        int single_image_strategy_index;
+
+        icetStrategy(strategies[strategy_index]);
+
+        for (single_image_strategy_index = 0;
+             single_image_strategy_index < 3;
+             single_image_strategy_index++) {
+            int color_format_index;
+
+            icetSingleImageStrategy(
+                single_image_strategies[single_image_strategy_index]);
+
+            for (color_format_index = 0;
+                 color_format_index < 2;
+                 color_format_index++) {
+                IceTEnum color_format = color_formats[color_format_index];
+                IceTBoolean use_output_buffer;
+
+                for (use_output_buffer = 0;
+                     use_output_buffer <= 1;
+                     use_output_buffer++) {
+                    if (rank == 0) {
+                        printf("    %s strategy, %s single image strategy,"
+                               " color format 0x%X, %s\n",
+                               icetGetStrategyName(),
+                               icetGetSingleImageStrategyName(),
+                               color_format,
+                               use_output_buffer ? "output buffer" : "image");
+                    }
+
+                    /* Keep drawing frames after a failure so that all
+                       processes stay in step. */
+                    if (FragmentCompositeTryFrame(color_format,
+                                                  use_output_buffer,
+                                                  exact)
+                        != TEST_PASSED) {
+                        result = TEST_FAILED;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static int FragmentCompositeRun(void)
+{
+    IceTInt num_proc;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_FRAGMENTS);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+    icetDisable(ICET_ORDERED_COMPOSITE);
+    icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, num_proc-1);
+
+    if (num_proc <= ICET_MAX_FRAGMENTS_LIMIT) {
+        if (rank == 0) {
+            printf("  Using %d fragments\n", (int)num_proc);
+        }
+        icetStateSetInteger(ICET_MAX_FRAGMENTS, num_proc);
+        result = FragmentCompositeTryStrategies(ICET_TRUE);
+    }
+
+    if (rank == 0) {
+        printf("  Using 1 fragment\n");
+    }
+    icetStateSetInteger(ICET_MAX_FRAGMENTS, 1);
+    if (FragmentCompositeTryStrategies(ICET_FALSE) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    return result;
+}
+
+int FragmentComposite(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(FragmentCompositeRun);
+}
@@ -0,0 +1,368 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the ICET_IMAGE_COLOR_RGBA_HALF color format.  It checks
+** the conversions between half and single precision floats and then
+** composites the same images stored with half and with single precision
+** colors.  Z-buffer compositing only moves pixels around, so it must give
+** exactly the same answer.  Blending rounds each result to a half, so it must
+** give the same answer within the precision of a half.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/* A blend rounds once to a half, which has an 11 bit significand.  Colors
+   are no bigger than 1, so the error is at most 2^-11.  Drawing a frame can
+   blend each pixel once per process, so leave room for a few roundings. */
+#define HALF_BLEND_TOLERANCE    0.004f
+
+static int CheckConversion(IceTFloat value, IceTUShort expected)
+{
+    IceTUShort half = icetFloatToHalf(value);
+    if (half != expected) {
+        printf("*** %g converted to half 0x%04X, expected 0x%04X.\n",
+               value, half, expected);
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+static int TestConversions(void)
+{
+    IceTUInt bits;
+    int result = TEST_PASSED;
+
+    printf("Checking half conversions.\n");
+
+  /* Every half other than a NaN must survive a trip through a float. */
+    for (bits = 0; bits < 0x10000; bits++) {
+        IceTUShort half = (IceTUShort)bits;
+        if (((half & 0x7C00) == 0x7C00) && ((half & 0x03FF) != 0)) continue;
+        if (icetFloatToHalf(icetHalfToFloat(half)) != half) {
+            printf("*** Half 0x%04X changed to 0x%04X through float %g.\n",
+                   half, icetFloatToHalf(icetHalfToFloat(half)),
+                   icetHalfToFloat(half));
+            result = TEST_FAILED;
+            break;
+        }
+    }
+
+    if (icetHalfToFloat(0x3C00) != 1.0f) {
+        printf("*** Half 0x3C00 should be 1.\n");
+        result = TEST_FAILED;
+    }
+
+    if (CheckConversion(0.0f, 0x0000) != TEST_PASSED) result = TEST_FAILED;
+    if (CheckConversion(1.0f, 0x3C00) != TEST_PASSED) result = TEST_FAILED;
+    if (CheckConversion(-2.0f, 0xC000) != TEST_PASSED) result = TEST_FAILED;
+    if (CheckConversion(65504.0f, 0x7BFF) != TEST_PASSED) result=TEST_FAILED;
+    if (CheckConversion(1.0e6f, 0x7C00) != TEST_PASSED) result = TEST_FAILED;
+    if (CheckConversion(1.0e-9f, 0x0000) != TEST_PASSED) result = TEST_FAILED;
+  /* Smallest denormal. */
+    if (CheckConversion(5.9604645e-8f, 0x0001) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+  /* Ties round to even. */
+    if (CheckConversion(1.0f + 1.0f/2048, 0x3C00) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (CheckConversion(1.0f + 3.0f/2048, 0x3C02) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    return result;
+}
+
+static int DoHalfColorTest(IceTEnum composite_mode, IceTEnum depth_format)
+{
+    IceTVoid *buffers[12];
+    int num_buffers = 0;
+    IceTImage half_front, half_back, half_result;
+    IceTImage float_front, float_back, float_result;
+    IceTSparseImage half_sparse_front, half_sparse_back, half_sparse_result;
+    IceTSparseImage float_sparse_front, float_sparse_back;
+    IceTSparseImage float_sparse_result;
+    IceTSizeType num_active;
+    IceTSizeType half_size, float_size;
+    IceTFloat tolerance;
+    int result = TEST_PASSED;
+    int i;
+
+    icetCompositeMode(composite_mode);
+    tolerance = (composite_mode == ICET_COMPOSITE_MODE_BLEND)
+        ? HALF_BLEND_TOLERANCE : 0.0f;
+
+    half_front = new_test_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                                depth_format,
+                                &buffers[num_buffers++]);
+    half_back = new_test_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                               depth_format,
+                               &buffers[num_buffers++]);
+    half_result = new_test_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                                 depth_format,
+                                 &buffers[num_buffers++]);
+    float_front = new_test_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                 depth_format,
+                                 &buffers[num_buffers++]);
+    float_back = new_test_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                depth_format,
+                                &buffers[num_buffers++]);
+    float_result = new_test_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                  depth_format,
+                                  &buffers[num_buffers++]);
+    half_sparse_front = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                                              depth_format,
+                                              &buffers[num_buffers++]);
+    half_sparse_back = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                                             depth_format,
+                                             &buffers[num_buffers++]);
+    half_sparse_result = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_HALF,
+                                               depth_format,
+                                               &buffers[num_buffers++]);
+    float_sparse_front = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                               depth_format,
+                                               &buffers[num_buffers++]);
+    float_sparse_back = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                              depth_format,
+                                              &buffers[num_buffers++]);
+    float_sparse_result = new_test_sparse_image(ICET_IMAGE_COLOR_RGBA_FLOAT,
+                                                depth_format,
+                                                &buffers[num_buffers++]);
+
+    num_active = init_runs_image(half_front, 1);
+    init_runs_image(half_back, 2);
+    init_runs_image(float_front, 1);
+    init_runs_image(float_back, 2);
+
+    printf("Checking compression.\n");
+    icetCompressImage(half_front, half_sparse_front);
+    icetCompressImage(half_back, half_sparse_back);
+    icetCompressImage(float_front, float_sparse_front);
+    icetCompressImage(float_back, float_sparse_back);
+    half_size = icetSparseImageGetCompressedBufferSize(half_sparse_front);
+    float_size = icetSparseImageGetCompressedBufferSize(float_sparse_front);
+    printf("Float color:     %d bytes\n", (int)float_size);
+    printf("Half color:      %d bytes\n", (int)half_size);
+    if (   float_size - half_size
+        != (  num_active
+            * (IceTSizeType)(4*(sizeof(IceTFloat) - sizeof(IceTUShort)))) ) {
+        printf("*** Expected half color to save %d bytes.\n",
+               (int)(num_active*4*(sizeof(IceTFloat)-sizeof(IceTUShort))));
+        result = TEST_FAILED;
+    }
+
+    printf("Checking decompression.\n");
+    icetDecompressImage(half_sparse_front, half_result);
+    icetDecompressImage(float_sparse_front, float_result);
+    if (compare_test_images(half_result, float_result, 0.0f, "Decompress")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking full image composite.\n");
+    icetImageCopyPixels(half_back, 0, half_result, 0,
+                        icetImageGetNumPixels(half_back));
+    icetImageCopyPixels(float_back, 0, float_result, 0,
+                        icetImageGetNumPixels(float_back));
+    icetComposite(half_result, half_front, 1);
+    icetComposite(float_result, float_front, 1);
+    if (compare_test_images(half_result, float_result, tolerance, "Composite")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking compressed composite.\n");
+    icetImageCopyPixels(half_back, 0, half_result, 0,
+                        icetImageGetNumPixels(half_back));
+    icetImageCopyPixels(float_back, 0, float_result, 0,
+                        icetImageGetNumPixels(float_back));
+    icetCompressedComposite(half_result, half_sparse_front, 1);
+    icetCompressedComposite(float_result, float_sparse_front, 1);
+    if (compare_test_images(half_result, float_result, tolerance,
+                      "Compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking compressed-compressed composite.\n");
+    icetCompressedCompressedComposite(half_sparse_front,
+                                      half_sparse_back,
+                                      half_sparse_result);
+    icetCompressedCompressedComposite(float_sparse_front,
+                                      float_sparse_back,
+                                      float_sparse_result);
+    icetDecompressImage(half_sparse_result, half_result);
+    icetDecompressImage(float_sparse_result, float_result);
+    if (compare_test_images(half_result, float_result, tolerance,
+                      "Compressed-compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (i = 0; i < num_buffers; i++) {
+        free(buffers[i]);
+    }
+
+    return result;
+}
+
+/* Draws the same pattern in either color format. */
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    init_runs_image(result, (unsigned int)rank + 1);
+}
+
+static IceTImage DrawFrame(IceTEnum color_format, IceTFloat **color)
+{
+    IceTDouble identity[16];
+    IceTFloat background[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+
+    background[0] = 0.25f;
+    background[1] = 0.5f;
+    background[2] = 0.75f;
+    background[3] = 1.0f;
+
+    icetSetColorFormat(color_format);
+    image = icetDrawFrame(identity, identity, background);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed >= 0) {
+        *color = malloc(4*icetImageGetNumPixels(image)*sizeof(IceTFloat));
+        icetImageCopyColorf(image, *color, ICET_IMAGE_COLOR_RGBA_FLOAT);
+    } else {
+        *color = NULL;
+    }
+
+    return image;
+}
+
+static int TestDrawFrame(void)
+{
+    IceTImage image;
+    IceTFloat *half_color;
+    IceTFloat *float_color;
+    IceTInt num_proc;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    if (rank == 0) {
+        printf("Checking blended frame with colored background.\n");
+    }
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetDisable(ICET_ORDERED_COMPOSITE);
+    icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+    icetStrategy(ICET_STRATEGY_REDUCE);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+
+    DrawFrame(ICET_IMAGE_COLOR_RGBA_FLOAT, &float_color);
+    image = DrawFrame(ICET_IMAGE_COLOR_RGBA_HALF, &half_color);
+
+    if (rank == 0) {
+        IceTSizeType num_values = 4*icetImageGetNumPixels(image);
+        IceTSizeType i;
+        for (i = 0; i < num_values; i++) {
+            IceTFloat diff = half_color[i] - float_color[i];
+            if (   (diff > num_proc*HALF_BLEND_TOLERANCE)
+                || (diff < -num_proc*HALF_BLEND_TOLERANCE) ) {
+                printf("*** Frame color %f should be %f (pixel %d).\n",
+                       half_color[i], float_color[i], (int)(i/4));
+                result = TEST_FAILED;
+                break;
+            }
+        }
+    }
+
+    free(half_color);
+    free(float_color);
+    icetDisable(ICET_CORRECT_COLORED_BACKGROUND);
+
+    return result;
+}
+
+static int HalfColorRun(void)
+{
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    if (rank == 0) {
+        if (TestConversions() != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("\n\nBlending.\n");
+        if (DoHalfColorTest(ICET_COMPOSITE_MODE_BLEND, ICET_IMAGE_DEPTH_NONE)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("\n\nZ buffer with float depth.\n");
+        if (DoHalfColorTest(ICET_COMPOSITE_MODE_Z_BUFFER,
+                            ICET_IMAGE_DEPTH_FLOAT) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("\n\nZ buffer with 16-bit depth.\n");
+        if (DoHalfColorTest(ICET_COMPOSITE_MODE_Z_BUFFER,
+                            ICET_IMAGE_DEPTH_UNORM16) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        printf("\n\n");
+    }
+
+    if (TestDrawFrame() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int HalfColor(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(HalfColorRun);
+}
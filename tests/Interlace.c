@@ -7,16 +7,19 @@
 **
 ** This test check to make sure that when an image is interlaced, split,
 ** and then combined back together, all the pixels are reconstructed
-** correctly.
+** correctly.  It also checks that compressing an image directly into the
+** interlaced order gives the same image as compressing and then interlacing.
 *****************************************************************************/
 
 #include "test_codes.h"
 #include "test-util.h"
 
 #include <IceTDevImage.h>
+#include <IceTDevState.h>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 /* Encode image position in color. */
 #define ACTIVE_COLOR(x, y) \
@@ -258,6 +261,29 @@ static IceTBoolean CompareImageDepths(const IceTImage image_a,
     return ICET_TRUE;
 }
 
+static IceTBoolean CompareSparseImages(const IceTSparseImage image_a,
+                                       const IceTSparseImage image_b)
+{
+    IceTVoid *buffer_a;
+    IceTVoid *buffer_b;
+    IceTSizeType size_a;
+    IceTSizeType size_b;
+
+    icetSparseImagePackageForSend(image_a, &buffer_a, &size_a);
+    icetSparseImagePackageForSend(image_b, &buffer_b, &size_b);
+    if (size_a != size_b) {
+        printf("ERROR: Expected a compressed size of %d, got %d.\n",
+               (int)size_a, (int)size_b);
+        return ICET_FALSE;
+    }
+    if (memcmp(buffer_a, buffer_b, size_a) != 0) {
+        printf("ERROR: Compressed data does not match.\n");
+        return ICET_FALSE;
+    }
+
+    return ICET_TRUE;
+}
+
 static int TestInterlaceSplit(const IceTImage image)
 {
 #define NUM_PARTITIONS 13
@@ -265,6 +291,10 @@ static int TestInterlaceSplit(const IceTImage image)
     IceTSparseImage original_sparse;
     IceTVoid *interlaced_sparse_buffer;
     IceTSparseImage interlaced_sparse;
+    IceTVoid *direct_sparse_buffer;
+    IceTSparseImage direct_sparse;
+    IceTInt original_num_threads;
+    IceTInt num_threads;
     IceTVoid *sparse_partition_buffer[NUM_PARTITIONS];
     IceTSparseImage sparse_partition[NUM_PARTITIONS];
     IceTSizeType offsets[NUM_PARTITIONS];
@@ -294,6 +324,11 @@ static int TestInterlaceSplit(const IceTImage image)
                                                     width,
                                                     height);
 
+    direct_sparse_buffer = malloc(icetSparseImageBufferSize(width, height));
+    direct_sparse = icetSparseImageAssignBuffer(direct_sparse_buffer,
+                                                width,
+                                                height);
+
     for (partition = 0; partition < NUM_PARTITIONS; partition++) {
         sparse_partition_buffer[partition]
             = malloc(icetSparseImageBufferSize(num_partition_pixels, 1));
@@ -313,6 +348,22 @@ static int TestInterlaceSplit(const IceTImage image)
                              ICET_SI_STRATEGY_BUFFER_0,
                              interlaced_sparse);
 
+    icetGetIntegerv(ICET_NUM_THREADS, &original_num_threads);
+    for (num_threads = 1; num_threads <= 4; num_threads += 3) {
+        printf("Compressing directly into interlaced order with %d threads\n",
+               num_threads);
+        icetStateSetInteger(ICET_NUM_THREADS, num_threads);
+        icetCompressImageInterlace(image,
+                                   NUM_PARTITIONS,
+                                   ICET_SI_STRATEGY_BUFFER_1,
+                                   direct_sparse);
+        if (!CompareSparseImages(interlaced_sparse, direct_sparse)) {
+            icetStateSetInteger(ICET_NUM_THREADS, original_num_threads);
+            return TEST_FAILED;
+        }
+    }
+    icetStateSetInteger(ICET_NUM_THREADS, original_num_threads);
+
     printf("Splitting image %d times\n", NUM_PARTITIONS);
     icetSparseImageSplit(interlaced_sparse,
                          0,
@@ -336,6 +387,7 @@ static int TestInterlaceSplit(const IceTImage image)
 
     free(original_sparse_buffer);
     free(interlaced_sparse_buffer);
+    free(direct_sparse_buffer);
     for (partition = 0; partition < NUM_PARTITIONS; partition++) {
         free(sparse_partition_buffer[partition]);
     }
@@ -0,0 +1,444 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the lossless codec applied to sparse images before they
+** are sent (enabled with ICET_MESSAGE_CODEC).  It checks that the codec
+** round trips data of many sorts, that packaged images shrink and unpackage
+** to the same pixels, that ICET_MESSAGE_CODEC_THRESHOLD is respected, and
+** that compositing gives the same result with the codec on or off.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevCodec.h>
+#include <IceTDevCommunication.h>
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CODEC_BUFFER_SIZE 300000
+
+static IceTDouble IdentityMatrix[16] = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 0.0, 0.0, 1.0
+};
+static IceTFloat Black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+/* Encodes and decodes the given data and checks that it comes back the
+   same.  Also checks that encoding into a buffer that is too small fails
+   cleanly. */
+static int CheckCodecRoundTrip(const IceTUByte *input,
+                               IceTSizeType input_size,
+                               const char *description)
+{
+    IceTSizeType max_encoded_size = input_size + input_size/255 + 16;
+    IceTUByte *encoded = malloc(max_encoded_size);
+    IceTUByte *decoded = malloc(input_size + 1);
+    IceTSizeType encoded_size;
+    IceTSizeType decoded_size;
+    int result = TEST_PASSED;
+
+    encoded_size = icetCodecEncode(input, input_size,
+                                   encoded, max_encoded_size);
+    printf("  %s: %d bytes encoded to %d bytes\n",
+           description, (int)input_size, (int)encoded_size);
+    if (encoded_size <= 0) {
+        printf("*** Encoding failed.\n");
+        result = TEST_FAILED;
+    } else {
+        decoded_size = icetCodecDecode(encoded, encoded_size,
+                                       decoded, input_size + 1);
+        if (decoded_size != input_size) {
+            printf("*** Decoded %d bytes.\n", (int)decoded_size);
+            result = TEST_FAILED;
+        } else if (memcmp(input, decoded, input_size) != 0) {
+            printf("*** Decoded data does not match.\n");
+            result = TEST_FAILED;
+        }
+
+        if (   (encoded_size > 1)
+            && (icetCodecEncode(input, input_size,
+                                encoded, encoded_size - 1) != 0) ) {
+            printf("*** Encoding into a small buffer did not fail.\n");
+            result = TEST_FAILED;
+        }
+
+        if (   (input_size > 0)
+            && (icetCodecDecode(encoded, encoded_size,
+                                decoded, input_size - 1) != -1) ) {
+            printf("*** Decoding into a small buffer did not fail.\n");
+            result = TEST_FAILED;
+        }
+    }
+
+    free(encoded);
+    free(decoded);
+    return result;
+}
+
+static int CheckCodec(void)
+{
+    IceTUByte *data = malloc(CODEC_BUFFER_SIZE);
+    IceTSizeType size;
+    IceTSizeType i;
+    int result = TEST_PASSED;
+
+    printf("Checking codec round trips.\n");
+
+    memset(data, 0, CODEC_BUFFER_SIZE);
+    if (CheckCodecRoundTrip(data, CODEC_BUFFER_SIZE, "Zeros") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (i = 0; i < CODEC_BUFFER_SIZE; i++) {
+        data[i] = (IceTUByte)(i%3 + 1);
+    }
+    if (   CheckCodecRoundTrip(data, CODEC_BUFFER_SIZE, "Short pattern")
+        != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    srand(1234);
+    for (i = 0; i < CODEC_BUFFER_SIZE; i++) {
+        data[i] = (IceTUByte)(rand()%256);
+    }
+    if (CheckCodecRoundTrip(data, CODEC_BUFFER_SIZE, "Random") != TEST_PASSED){
+        result = TEST_FAILED;
+    }
+
+  /* Random runs of repeated random bytes with matches far apart. */
+    i = 0;
+    while (i < CODEC_BUFFER_SIZE) {
+        IceTSizeType run_length = rand()%600 + 1;
+        IceTUByte value = (IceTUByte)(rand()%4);
+        for ( ; (run_length > 0) && (i < CODEC_BUFFER_SIZE); run_length--) {
+            data[i++] = (rand()%8 == 0) ? (IceTUByte)(rand()%256) : value;
+        }
+    }
+    if (CheckCodecRoundTrip(data, CODEC_BUFFER_SIZE, "Runs") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    for (size = 0; size < 20; size++) {
+        char description[64];
+        sprintf(description, "Size %d", (int)size);
+        if (CheckCodecRoundTrip(data, size, description) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Checking malformed data.\n");
+    data[0] = 0x1F;     /* 1 literal, then a match... */
+    data[1] = 0xAB;
+    data[2] = 0x10;     /* ...reaching back before the start of output. */
+    data[3] = 0x00;
+    if (icetCodecDecode(data, 4, data + 100, 1000) != -1) {
+        printf("*** Bad match offset not detected.\n");
+        result = TEST_FAILED;
+    }
+    data[0] = 0xF0;     /* Literal length continues past the input. */
+    data[1] = 0xFF;
+    if (icetCodecDecode(data, 2, data + 100, 1000) != -1) {
+        printf("*** Truncated input not detected.\n");
+        result = TEST_FAILED;
+    }
+
+    free(data);
+    return result;
+}
+
+/* Fills the image with a few flat colored shapes on an empty background,
+   which is the sort of image the codec can shrink. */
+static void InitFlatImage(IceTImage image, IceTInt seed)
+{
+    IceTSizeType width = icetImageGetWidth(image);
+    IceTSizeType height = icetImageGetHeight(image);
+    IceTUByte *color = icetImageGetColorub(image);
+    IceTFloat *depth = icetImageGetDepthf(image);
+    IceTSizeType x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            IceTSizeType pixel = y*width + x;
+            IceTSizeType band = (x + y + 16*seed)/32;
+            if (band%3 == 0) {
+                color[4*pixel + 0] = (IceTUByte)(40*seed);
+                color[4*pixel + 1] = (IceTUByte)(band%256);
+                color[4*pixel + 2] = (IceTUByte)(y/16);
+                color[4*pixel + 3] = 255;
+                depth[pixel] = 0.5f + 0.0625f*(IceTFloat)(seed%8);
+            } else {
+                color[4*pixel + 0] = 0;
+                color[4*pixel + 1] = 0;
+                color[4*pixel + 2] = 0;
+                color[4*pixel + 3] = 0;
+                depth[pixel] = 1.0f;
+            }
+        }
+    }
+}
+
+/* Packages the sparse image, copies the message to a receive buffer, and
+   unpackages it.  Returns the size of the message. */
+static IceTSizeType SendImage(IceTSparseImage image,
+                              IceTVoid *receive_buffer,
+                              IceTSparseImage *received_image)
+{
+    IceTVoid *package_buffer;
+    IceTSizeType package_size;
+
+    icetSparseImagePackageForSend(image, &package_buffer, &package_size);
+    memcpy(receive_buffer, package_buffer, package_size);
+    *received_image = icetSparseImageUnpackageFromReceive(receive_buffer);
+    return package_size;
+}
+
+static int CheckSameImage(const IceTImage expected, const IceTImage actual)
+{
+    IceTSizeType num_pixels = icetImageGetNumPixels(expected);
+
+    if (icetImageGetNumPixels(actual) != num_pixels) {
+        printf("*** Images have different numbers of pixels.\n");
+        return TEST_FAILED;
+    }
+    if (memcmp(icetImageGetColorcub(expected),
+               icetImageGetColorcub(actual),
+               4*num_pixels) != 0) {
+        printf("*** Color data does not match.\n");
+        return TEST_FAILED;
+    }
+    if (memcmp(icetImageGetDepthcf(expected),
+               icetImageGetDepthcf(actual),
+               num_pixels*sizeof(IceTFloat)) != 0) {
+        printf("*** Depth data does not match.\n");
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+static int CheckPackaging(void)
+{
+    IceTVoid *image_buffer;
+    IceTVoid *result_buffer;
+    IceTVoid *sparse_buffer;
+    IceTVoid *receive_buffer;
+    IceTImage image;
+    IceTImage result_image;
+    IceTSparseImage sparse_image;
+    IceTSparseImage received_image;
+    IceTSizeType plain_size;
+    IceTSizeType encoded_size;
+    IceTSizeType size;
+    int result = TEST_PASSED;
+
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+
+    image_buffer = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    image = icetImageAssignBuffer(image_buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+    result_buffer = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    result_image = icetImageAssignBuffer(result_buffer,
+                                         SCREEN_WIDTH, SCREEN_HEIGHT);
+    sparse_buffer
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    sparse_image = icetSparseImageAssignBuffer(sparse_buffer,
+                                               SCREEN_WIDTH, SCREEN_HEIGHT);
+    receive_buffer
+        = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+
+    InitFlatImage(image, 3);
+
+    printf("Checking package without codec.\n");
+    icetDisable(ICET_MESSAGE_CODEC);
+    icetCompressImage(image, sparse_image);
+    plain_size = SendImage(sparse_image, receive_buffer, &received_image);
+    icetDecompressImage(received_image, result_image);
+    if (CheckSameImage(image, result_image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking package with codec.\n");
+    icetEnable(ICET_MESSAGE_CODEC);
+    icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD, 0);
+    icetCompressImage(image, sparse_image);
+    encoded_size = SendImage(sparse_image, receive_buffer, &received_image);
+    printf("Plain message:   %d bytes\n", (int)plain_size);
+    printf("Encoded message: %d bytes\n", (int)encoded_size);
+    if (encoded_size >= plain_size) {
+        printf("*** Codec did not make the message smaller.\n");
+        result = TEST_FAILED;
+    }
+    if (icetSparseImageGetCompressedBufferSize(received_image) != plain_size) {
+        printf("*** Received image has wrong size.\n");
+        result = TEST_FAILED;
+    }
+    icetDecompressImage(received_image, result_image);
+    if (CheckSameImage(image, result_image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking that packaging leaves the image alone.\n");
+    if (icetSparseImageGetCompressedBufferSize(sparse_image) != plain_size) {
+        printf("*** Packaged image changed size.\n");
+        result = TEST_FAILED;
+    }
+    icetDecompressImage(sparse_image, result_image);
+    if (CheckSameImage(image, result_image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking packaging an image twice.\n");
+    icetCompressImage(image, sparse_image);
+    SendImage(sparse_image, receive_buffer, &received_image);
+    size = SendImage(sparse_image, receive_buffer, &received_image);
+    if (size != encoded_size) {
+        printf("*** Second package is %d bytes.\n", (int)size);
+        result = TEST_FAILED;
+    }
+    icetDecompressImage(received_image, result_image);
+    if (CheckSameImage(image, result_image) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking threshold.\n");
+    icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD, plain_size);
+    icetCompressImage(image, sparse_image);
+    size = SendImage(sparse_image, receive_buffer, &received_image);
+    if (size != plain_size) {
+        printf("*** Message below threshold was encoded.\n");
+        result = TEST_FAILED;
+    }
+
+    printf("Checking empty image.\n");
+    icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD, 0);
+    icetImageSetDimensions(image, 0, 0);
+    icetCompressImage(image, sparse_image);
+    SendImage(sparse_image, receive_buffer, &received_image);
+    if (icetSparseImageGetNumPixels(received_image) != 0) {
+        printf("*** Empty image did not stay empty.\n");
+        result = TEST_FAILED;
+    }
+
+    icetDisable(ICET_MESSAGE_CODEC);
+
+    free(image_buffer);
+    free(result_buffer);
+    free(sparse_buffer);
+    free(receive_buffer);
+    return result;
+}
+
+static void drawCallback(const IceTDouble *projection_matrix,
+                         const IceTDouble *modelview_matrix,
+                         const IceTFloat *background_color,
+                         const IceTInt *readback_viewport,
+                         IceTImage result)
+{
+    IceTInt rank;
+
+  /* Don't care about this information. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    InitFlatImage(result, rank);
+}
+
+static int CheckComposite(void)
+{
+    IceTSizeType num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    IceTUByte *plain_color = malloc(4*num_pixels);
+    IceTInt rank;
+    int strategy_index;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetDisable(ICET_CORRECT_COLORED_BACKGROUND);
+    icetStrategy(ICET_STRATEGY_REDUCE);
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+    icetDrawCallback(drawCallback);
+    icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD, 0);
+
+    for (strategy_index = 0;
+         strategy_index < SINGLE_IMAGE_STRATEGY_LIST_SIZE;
+         strategy_index++) {
+        IceTImage image;
+        IceTInt local_result = TEST_PASSED;
+
+        icetSingleImageStrategy(single_image_strategy_list[strategy_index]);
+        if (rank == 0) {
+            printf("Checking composite with %s strategy.\n",
+                   icetGetSingleImageStrategyName());
+        }
+
+        icetDisable(ICET_MESSAGE_CODEC);
+        image = icetDrawFrame(IdentityMatrix, IdentityMatrix, Black);
+        if (rank == 0) {
+            icetImageCopyColorub(image, plain_color,
+                                 ICET_IMAGE_COLOR_RGBA_UBYTE);
+        }
+
+        icetEnable(ICET_MESSAGE_CODEC);
+        image = icetDrawFrame(IdentityMatrix, IdentityMatrix, Black);
+        if (   (rank == 0)
+            && (memcmp(plain_color, icetImageGetColorcub(image),
+                       4*num_pixels) != 0) ) {
+            printf("*** Composite with codec does not match.\n");
+            local_result = TEST_FAILED;
+        }
+
+        icetDisable(ICET_MESSAGE_CODEC);
+        if (local_result != TEST_PASSED) { result = TEST_FAILED; }
+    }
+
+    free(plain_color);
+    return result;
+}
+
+static int MessageCodecRun()
+{
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    if (rank == 0) {
+        if (CheckCodec() != TEST_PASSED) { result = TEST_FAILED; }
+        if (CheckPackaging() != TEST_PASSED) { result = TEST_FAILED; }
+    }
+
+    if (CheckComposite() != TEST_PASSED) { result = TEST_FAILED; }
+
+    icetStateSetInteger(ICET_MESSAGE_CODEC_THRESHOLD,
+                        ICET_MESSAGE_CODEC_THRESHOLD_DEFAULT);
+
+    return result;
+}
+
+int MessageCodec(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(MessageCodecRun);
+}
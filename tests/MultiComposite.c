@@ -0,0 +1,252 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks that icetCompressedMultiComposite gives exactly the image
+** that compositing the same sparse images two at a time from back to front
+** does.  It checks every composite mode and image format with each sparse
+** image layout and up to eight images.  It also reports how long each way of
+** compositing eight images takes.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MAX_IMAGES              8
+#define NUM_TIMING_TRIALS       10
+
+/* The formats are checked with images of this size.  Timing uses the size
+   of the screen. */
+#define IMAGE_WIDTH             317
+#define IMAGE_HEIGHT            203
+
+/* Composites the images two at a time from back to front, as the tree in
+   radix-k did. */
+static void PairwiseComposite(const IceTSparseImage *images,
+                              IceTInt num_images,
+                              IceTSparseImage dest,
+                              IceTSparseImage spare)
+{
+    IceTInt image_index;
+
+    if (num_images == 1) {
+        icetSparseImageCopyPixels(images[0],
+                                  0,
+                                  icetSparseImageGetNumPixels(images[0]),
+                                  dest);
+        return;
+    }
+
+    /* Pick the buffer for the first composite so that the last one is in
+       dest. */
+    if ((num_images%2) == 0) {
+        IceTSparseImage temp = dest;
+        dest = spare;
+        spare = temp;
+    }
+    icetCompressedCompressedComposite(images[num_images-2],
+                                      images[num_images-1],
+                                      spare);
+    for (image_index = num_images - 3; image_index >= 0; image_index--) {
+        IceTSparseImage temp;
+        icetCompressedCompressedComposite(images[image_index], spare, dest);
+        temp = dest;
+        dest = spare;
+        spare = temp;
+    }
+}
+
+static int TestFormat(IceTEnum composite_mode,
+                      IceTEnum color_format,
+                      IceTEnum depth_format,
+                      IceTSizeType width,
+                      IceTSizeType height,
+                      IceTBoolean time)
+{
+    IceTVoid *buffers[2*MAX_IMAGES + 5];
+    int num_buffers = 0;
+    IceTImage full_images[MAX_IMAGES];
+    IceTSparseImage sparse_images[MAX_IMAGES];
+    IceTSparseImage expected, spare, actual;
+    IceTImage expected_image, actual_image;
+    IceTInt num_images;
+    TestImagePattern pattern;
+    int layout;
+    int result = TEST_PASSED;
+
+    printf("Checking %s with color 0x%x and depth 0x%x.\n",
+           (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER) ? "z-buffer"
+                                                             : "blend",
+           color_format, depth_format);
+
+    icetCompositeMode(composite_mode);
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+
+#define NEW_IMAGE()                                                     \
+    icetImageAssignBuffer(                                              \
+        buffers[num_buffers++]                                          \
+            = malloc(icetImageBufferSize(width, height)),               \
+        width, height)
+#define NEW_SPARSE_IMAGE()                                              \
+    icetSparseImageAssignBuffer(                                        \
+        buffers[num_buffers++]                                          \
+            = malloc(icetSparseImageBufferSize(width, height)),         \
+        width, height)
+
+    /* Depths take only a few values so that images often tie, and some
+       images have runs longer than a planar run can hold.  Half float
+       channels are quarters so that they blend exactly. */
+    init_test_image_pattern(&pattern);
+    pattern.depth_levels = 8;
+    if (color_format == ICET_IMAGE_COLOR_RGBA_HALF) {
+        pattern.channel_levels = 4;
+    }
+    for (num_images = 0; num_images < MAX_IMAGES; num_images++) {
+        unsigned int seed = 10 + num_images;
+        full_images[num_images] = NEW_IMAGE();
+        pattern.max_run = ((seed%2) == 0) ? 100 : 5000;
+        pattern.start_active = ((seed%3) == 0);
+        init_test_image(full_images[num_images], seed, &pattern);
+        sparse_images[num_images] = NEW_SPARSE_IMAGE();
+    }
+    expected_image = NEW_IMAGE();
+    actual_image = NEW_IMAGE();
+    expected = NEW_SPARSE_IMAGE();
+    spare = NEW_SPARSE_IMAGE();
+    actual = NEW_SPARSE_IMAGE();
+
+#undef NEW_IMAGE
+#undef NEW_SPARSE_IMAGE
+
+    for (layout = 0; layout < (time ? 1 : 4); layout++) {
+        if (layout & 1) {
+            icetEnable(ICET_PLANAR_SPARSE_IMAGES);
+        } else {
+            icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+        }
+        if (layout & 2) {
+            icetEnable(ICET_COMPACT_RUN_LENGTHS);
+        } else {
+            icetDisable(ICET_COMPACT_RUN_LENGTHS);
+        }
+
+        for (num_images = 0; num_images < MAX_IMAGES; num_images++) {
+            icetCompressImage(full_images[num_images],
+                              sparse_images[num_images]);
+        }
+
+        for (num_images = 1; num_images <= MAX_IMAGES; num_images++) {
+            char description[256];
+            sprintf(description, "%d images, %s%s layout",
+                    (int)num_images,
+                    (layout & 2) ? "compact " : "",
+                    (layout & 1) ? "planar" : "interleaved");
+
+            PairwiseComposite(sparse_images, num_images, expected, spare);
+            icetCompressedMultiComposite(sparse_images, num_images, actual);
+
+            icetDecompressImage(expected, expected_image);
+            icetDecompressImage(actual, actual_image);
+            if (compare_test_images(expected_image, actual_image, 0.0f,
+                                    description) != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+        }
+
+        if (time) {
+            IceTDouble start;
+            int trial;
+
+            start = icetWallTime();
+            for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+                PairwiseComposite(sparse_images, MAX_IMAGES, expected, spare);
+            }
+            printf("  Time to composite %d images in pairs: %.3f ms\n",
+                   MAX_IMAGES,
+                   1000.0*(icetWallTime() - start)/NUM_TIMING_TRIALS);
+
+            start = icetWallTime();
+            for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+                icetCompressedMultiComposite(sparse_images, MAX_IMAGES,
+                                             actual);
+            }
+            printf("  Time to composite %d images in one pass: %.3f ms\n",
+                   MAX_IMAGES,
+                   1000.0*(icetWallTime() - start)/NUM_TIMING_TRIALS);
+        }
+    }
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+
+    return result;
+}
+
+static int MultiCompositeRun(void)
+{
+    int result = TEST_PASSED;
+
+#define TEST_FORMAT(mode, color, depth)                                 \
+    if (TestFormat(mode, color, depth, IMAGE_WIDTH, IMAGE_HEIGHT,       \
+                   ICET_FALSE) != TEST_PASSED) {                        \
+        result = TEST_FAILED;                                           \
+    }
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_FLOAT, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_HALF, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_NONE, ICET_IMAGE_DEPTH_FLOAT);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_UNORM16);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_FLOAT, ICET_IMAGE_DEPTH_UNORM16);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_RGBA_HALF, ICET_IMAGE_DEPTH_UNORM16);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_Z_BUFFER,
+                ICET_IMAGE_COLOR_NONE, ICET_IMAGE_DEPTH_UNORM16);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_NONE);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_FLOAT, ICET_IMAGE_DEPTH_NONE);
+    TEST_FORMAT(ICET_COMPOSITE_MODE_BLEND,
+                ICET_IMAGE_COLOR_RGBA_HALF, ICET_IMAGE_DEPTH_NONE);
+#undef TEST_FORMAT
+
+    if (TestFormat(ICET_COMPOSITE_MODE_Z_BUFFER,
+                   ICET_IMAGE_COLOR_RGBA_UBYTE, ICET_IMAGE_DEPTH_FLOAT,
+                   SCREEN_WIDTH, SCREEN_HEIGHT, ICET_TRUE) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    return result;
+}
+
+int MultiComposite(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(MultiCompositeRun);
+}
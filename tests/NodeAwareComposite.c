@@ -0,0 +1,369 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_NODE_AWARE_COMPOSITE.  The processes are assigned to
+** several made up node layouts, and radix-k compositing with its first round
+** on each node must give the same image as compositing without knowing about
+** nodes (up to rounding when blending).  Z-buffer images are also checked
+** against the image the processes draw.  One more layout puts two processes
+** on each node with a number of nodes that is not a power of two and makes
+** radix-k interlace the images.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Gets the premultiplied channels, in units of 1/255, and depth process rank
+   draws at pixel. */
+static void PixelAt(IceTInt rank,
+                    IceTSizeType pixel,
+                    IceTInt *channels,
+                    IceTFloat *depth)
+{
+    if ((pixel/13 + rank)%4 == 0) {
+        channels[0] = channels[1] = channels[2] = channels[3] = 0;
+        *depth = 1.0f;
+    } else {
+        IceTInt alpha = ((pixel/3 + rank)%2 == 0) ? 255 : 90;
+        channels[0] = (IceTInt)((pixel*11 + rank*31)%(alpha + 1));
+        channels[1] = (IceTInt)((pixel*5 + rank*7)%(alpha + 1));
+        channels[2] = (IceTInt)((pixel + rank*97)%(alpha + 1));
+        channels[3] = alpha;
+        *depth = (IceTFloat)((pixel*7 + rank*19)%103)/128.0f;
+    }
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum depth_format = icetImageGetDepthFormat(result);
+    IceTUByte *colors = icetImageGetColorub(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTInt channels[4];
+        IceTFloat depth;
+        int channel;
+        PixelAt(rank, i, channels, &depth);
+        for (channel = 0; channel < 4; channel++) {
+            colors[4*i + channel] = (IceTUByte)channels[channel];
+        }
+        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+            icetImageGetDepthf(result)[i] = depth;
+        }
+    }
+}
+
+/* Checks that every process is on the node named by the smallest rank on
+   it. */
+static int NodeAwareCompositeCheckNodes(void)
+{
+    const IceTInt *process_nodes;
+    IceTInt num_proc;
+    IceTInt proc;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    process_nodes = icetUnsafeStateGetInteger(ICET_PROCESS_NODES);
+
+    for (proc = 0; proc < num_proc; proc++) {
+        IceTInt node = process_nodes[proc];
+        if ((node < 0) || (node > proc) || (process_nodes[node] != node)) {
+            printf("*** Process %d reports invalid node %d.\n",
+                   (int)proc, (int)node);
+            return TEST_FAILED;
+        }
+    }
+
+    return TEST_PASSED;
+}
+
+/* Draws a frame and, on the display process, returns a newly allocated array
+   with the colors.  Returns NULL on other processes.  The colors are placed
+   in an output buffer filled with garbage first so that pixels left over
+   from the last frame cannot hide any that are missing. */
+static IceTUByte *NodeAwareCompositeDrawColors(IceTBoolean node_aware)
+{
+    IceTDouble identity[16];
+    IceTFloat black[4];
+    IceTInt tile_displayed;
+    IceTUByte *colors;
+    IceTSizeType i;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+    black[0] = black[1] = black[2] = black[3] = 0.0f;
+
+    colors = malloc(4*SCREEN_WIDTH*SCREEN_HEIGHT);
+    memset(colors, 0xAB, 4*SCREEN_WIDTH*SCREEN_HEIGHT);
+
+    if (node_aware) {
+        icetEnable(ICET_NODE_AWARE_COMPOSITE);
+    } else {
+        icetDisable(ICET_NODE_AWARE_COMPOSITE);
+    }
+    icetOutputBuffer(ICET_IMAGE_COLOR_RGBA_UBYTE, 0, colors);
+
+    icetDrawFrame(identity, identity, black);
+
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+    icetDisable(ICET_NODE_AWARE_COMPOSITE);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) {
+        free(colors);
+        return NULL;
+    }
+
+    return colors;
+}
+
+/* Checks colors from a z-buffer composite against the nearest pixel every
+   process draws. */
+static int NodeAwareCompositeCheckZBuffer(const IceTUByte *colors)
+{
+    IceTInt num_proc;
+    IceTSizeType pixel;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    for (pixel = 0; pixel < SCREEN_WIDTH*SCREEN_HEIGHT; pixel++) {
+        IceTInt expected[4];
+        IceTFloat expected_depth = 1.0f;
+        IceTInt proc;
+        int channel;
+
+        expected[0] = expected[1] = expected[2] = expected[3] = 0;
+        for (proc = 0; proc < num_proc; proc++) {
+            IceTInt channels[4];
+            IceTFloat depth;
+            PixelAt(proc, pixel, channels, &depth);
+            if (depth < expected_depth) {
+                memcpy(expected, channels, sizeof(expected));
+                expected_depth = depth;
+            }
+        }
+
+        for (channel = 0; channel < 4; channel++) {
+            if ((IceTInt)colors[4*pixel + channel] != expected[channel]) {
+                printf("*** Pixel %d channel %d is %d composited on nodes,"
+                       " %d drawn.\n",
+                       (int)pixel, channel, colors[4*pixel + channel],
+                       (int)expected[channel]);
+                return TEST_FAILED;
+            }
+        }
+    }
+
+    return TEST_PASSED;
+}
+
+static int NodeAwareCompositeTryMode(IceTEnum composite_mode)
+{
+    IceTUByte *expected;
+    IceTUByte *actual;
+    int result = TEST_PASSED;
+
+    icetCompositeMode(composite_mode);
+    if (composite_mode == ICET_COMPOSITE_MODE_BLEND) {
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+        icetEnable(ICET_ORDERED_COMPOSITE);
+    } else {
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+        icetDisable(ICET_ORDERED_COMPOSITE);
+    }
+
+    expected = NodeAwareCompositeDrawColors(ICET_FALSE);
+    actual = NodeAwareCompositeDrawColors(ICET_TRUE);
+
+    if (actual != NULL) {
+        /* Compositing on nodes groups the images differently.  Blending the
+           groups in another order rounds the channels differently, so blended
+           images may be off by a little.  The z-buffer picks pixels, so its
+           images must match exactly. */
+        IceTInt tolerance
+            = (composite_mode == ICET_COMPOSITE_MODE_BLEND) ? 2 : 0;
+        IceTSizeType i;
+        for (i = 0; i < 4*SCREEN_WIDTH*SCREEN_HEIGHT; i++) {
+            if (abs((IceTInt)actual[i] - (IceTInt)expected[i]) > tolerance) {
+                printf("*** Pixel %d channel %d is %d composited on nodes,"
+                       " %d without.\n",
+                       (int)(i/4), (int)(i%4), actual[i], expected[i]);
+                result = TEST_FAILED;
+                break;
+            }
+        }
+        if (   (composite_mode == ICET_COMPOSITE_MODE_Z_BUFFER)
+            && (NodeAwareCompositeCheckZBuffer(actual) != TEST_PASSED) ) {
+            result = TEST_FAILED;
+        }
+    }
+
+    free(expected);
+    free(actual);
+    return result;
+}
+
+static int NodeAwareCompositeRun(void)
+{
+    IceTInt node_sizes[4];
+    IceTInt *process_ranks;
+    IceTInt *real_nodes;
+    IceTInt *fake_nodes;
+    IceTInt num_proc;
+    IceTInt rank;
+    IceTInt proc;
+    int node_size_index;
+    int result;
+
+    /* A node size of 0 puts the first process alone and the rest together,
+       which cannot be composited on nodes. */
+    node_sizes[0] = 2;
+    node_sizes[1] = 3;
+    node_sizes[2] = 4;
+    node_sizes[3] = 0;
+
+    /* The nodes are only found once a frame needs them. */
+    if (icetStateGetType(ICET_PROCESS_NODES) != ICET_NULL) {
+        printf("*** Nodes found before node-aware compositing was used.\n");
+        result = TEST_FAILED;
+    } else {
+        result = TEST_PASSED;
+    }
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    /* Blend in reverse rank order so that the compose group is not just the
+       process ranks in order. */
+    process_ranks = malloc(num_proc*sizeof(IceTInt));
+    for (proc = 0; proc < num_proc; proc++) {
+        process_ranks[proc] = num_proc - proc - 1;
+    }
+    icetCompositeOrder(process_ranks);
+
+    icetStrategy(ICET_STRATEGY_SEQUENTIAL);
+    icetSingleImageStrategy(ICET_SINGLE_IMAGE_STRATEGY_RADIXK);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+
+    free(NodeAwareCompositeDrawColors(ICET_TRUE));
+    if (NodeAwareCompositeCheckNodes() != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    real_nodes = malloc(num_proc*sizeof(IceTInt));
+    memcpy(real_nodes,
+           icetUnsafeStateGetInteger(ICET_PROCESS_NODES),
+           num_proc*sizeof(IceTInt));
+    fake_nodes = malloc(num_proc*sizeof(IceTInt));
+
+    for (node_size_index = 0; node_size_index < 4; node_size_index++) {
+        IceTInt node_size = node_sizes[node_size_index];
+
+        if ((node_size > 0) && ((num_proc % node_size) != 0)) { continue; }
+
+        for (proc = 0; proc < num_proc; proc++) {
+            if (node_size > 0) {
+                fake_nodes[proc] = proc - proc%node_size;
+            } else {
+                fake_nodes[proc] = (proc == 0) ? 0 : 1;
+            }
+        }
+        icetStateSetIntegerv(ICET_PROCESS_NODES, num_proc, fake_nodes);
+
+        if (rank == 0) {
+            printf("    %d processes per node\n", (int)node_size);
+        }
+
+        /* Keep drawing frames after a failure so that all processes stay in
+           step. */
+        if (   NodeAwareCompositeTryMode(ICET_COMPOSITE_MODE_BLEND)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        if (   NodeAwareCompositeTryMode(ICET_COMPOSITE_MODE_Z_BUFFER)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    /* Two processes on each of a number of nodes that is not a power of two
+       (such as 3 nodes for 6 processes).  A k of 2 leaves more partitions
+       than k, so radix-k interlaces the images, and the partitions it
+       gathers must still land in the right places. */
+    if (   (num_proc%2 == 0) && (num_proc > 4)
+        && (((num_proc/2) & (num_proc/2 - 1)) != 0) ) {
+        IceTInt magic_k;
+
+        for (proc = 0; proc < num_proc; proc++) {
+            fake_nodes[proc] = proc - proc%2;
+        }
+        icetStateSetIntegerv(ICET_PROCESS_NODES, num_proc, fake_nodes);
+
+        icetGetIntegerv(ICET_MAGIC_K, &magic_k);
+        icetStateSetInteger(ICET_MAGIC_K, 2);
+        icetEnable(ICET_INTERLACE_IMAGES);
+
+        if (rank == 0) {
+            printf("    2 processes on each of %d nodes, interlaced\n",
+                   (int)(num_proc/2));
+        }
+
+        if (   NodeAwareCompositeTryMode(ICET_COMPOSITE_MODE_BLEND)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        if (   NodeAwareCompositeTryMode(ICET_COMPOSITE_MODE_Z_BUFFER)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        icetStateSetInteger(ICET_MAGIC_K, magic_k);
+    }
+
+    icetStateSetIntegerv(ICET_PROCESS_NODES, num_proc, real_nodes);
+
+    free(fake_nodes);
+    free(real_nodes);
+    free(process_ranks);
+    return result;
+}
+
+int NodeAwareComposite(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(NodeAwareCompositeRun);
+}
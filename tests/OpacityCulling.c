@@ -0,0 +1,253 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_OPACITY_CULLING.  Each process draws a mix of
+** opaque, translucent, and empty pixels, and the processes are blended in
+** reverse rank order.  Leaving out the pixels hidden behind opaque ones must
+** not change the composited image at all.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Gets the premultiplied channels process rank draws at pixel in units of
+   1/255. */
+static void ChannelsAt(IceTInt rank, IceTSizeType pixel, IceTInt *channels)
+{
+    if ((pixel/7 + rank)%4 == 0) {
+        channels[0] = channels[1] = channels[2] = channels[3] = 0;
+    } else {
+        IceTInt alpha = ((pixel/3 + rank)%2 == 0) ? 255 : 128;
+        channels[0] = (IceTInt)((pixel*13 + rank*29)%(alpha + 1));
+        channels[1] = (IceTInt)((pixel*7 + rank*3)%(alpha + 1));
+        channels[2] = (IceTInt)((pixel + rank*101)%(alpha + 1));
+        channels[3] = alpha;
+    }
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum color_format = icetImageGetColorFormat(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTInt channels[4];
+        int channel;
+        ChannelsAt(rank, i, channels);
+        for (channel = 0; channel < 4; channel++) {
+            if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+                icetImageGetColorub(result)[4*i + channel]
+                    = (IceTUByte)channels[channel];
+            } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+                icetImageGetColorf(result)[4*i + channel]
+                    = (IceTFloat)channels[channel]/255.0f;
+            } else {
+                icetImageGetColorus(result)[4*i + channel]
+                    = icetFloatToHalf((IceTFloat)channels[channel]/255.0f);
+            }
+        }
+    }
+}
+
+/* Draws a frame and, on the display process, copies the color buffer to a
+   newly allocated array.  Returns NULL on other processes. */
+static IceTVoid *OpacityCullingDrawColors(IceTEnum color_format,
+                                          IceTSizeType *color_size)
+{
+    IceTDouble identity[16];
+    IceTFloat black[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTVoid *colors;
+    IceTSizeType i;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+    black[0] = black[1] = black[2] = black[3] = 0.0f;
+
+    icetSetColorFormat(color_format);
+
+    image = icetDrawFrame(identity, identity, black);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) return NULL;
+
+    if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        *color_size = 4*sizeof(IceTUByte);
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_FLOAT) {
+        *color_size = 4*sizeof(IceTFloat);
+    } else {
+        *color_size = 4*sizeof(IceTUShort);
+    }
+    *color_size *= icetImageGetNumPixels(image);
+
+    colors = malloc(*color_size);
+    memcpy(colors, icetImageGetColorConstVoid(image, NULL), *color_size);
+    return colors;
+}
+
+static int OpacityCullingTryFrame(IceTEnum color_format,
+                                  IceTInt front_rank)
+{
+    IceTVoid *expected;
+    IceTVoid *actual;
+    IceTSizeType color_size;
+    int result = TEST_PASSED;
+
+    icetDisable(ICET_OPACITY_CULLING);
+    expected = OpacityCullingDrawColors(color_format, &color_size);
+
+    icetEnable(ICET_OPACITY_CULLING);
+    actual = OpacityCullingDrawColors(color_format, &color_size);
+    icetDisable(ICET_OPACITY_CULLING);
+
+    if (actual == NULL) return result;
+
+    if (memcmp(actual, expected, color_size) != 0) {
+        printf("*** Image with culling differs from image without.\n");
+        result = TEST_FAILED;
+    } else if (color_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        /* Make sure the front process actually hides what is behind it. */
+        const IceTUByte *colors = actual;
+        IceTSizeType num_pixels = color_size/(4*sizeof(IceTUByte));
+        IceTSizeType i;
+        for (i = 0; i < num_pixels; i++) {
+            IceTInt channels[4];
+            int channel;
+            ChannelsAt(front_rank, i, channels);
+            if (channels[3] != 255) continue;
+            for (channel = 0; channel < 4; channel++) {
+                if (colors[4*i + channel] != channels[channel]) {
+                    printf("*** Pixel %d channel %d is %d, expected %d.\n",
+                           (int)i, channel, colors[4*i + channel],
+                           (int)channels[channel]);
+                    result = TEST_FAILED;
+                    break;
+                }
+            }
+            if (result != TEST_PASSED) break;
+        }
+    }
+
+    free(expected);
+    free(actual);
+    return result;
+}
+
+static int OpacityCullingRun(void)
+{
+    IceTEnum strategies[2];
+    IceTEnum single_image_strategies[3];
+    IceTEnum color_formats[3];
+    IceTInt *process_ranks;
+    IceTInt num_proc;
+    IceTInt rank;
+    IceTInt proc;
+    int strategy_index;
+    int result = TEST_PASSED;
+
+    strategies[0] = ICET_STRATEGY_SEQUENTIAL;
+    strategies[1] = ICET_STRATEGY_REDUCE;
+
+    single_image_strategies[0] = ICET_SINGLE_IMAGE_STRATEGY_BSWAP;
+    single_image_strategies[1] = ICET_SINGLE_IMAGE_STRATEGY_TREE;
+    single_image_strategies[2] = ICET_SINGLE_IMAGE_STRATEGY_RADIXK;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+    color_formats[2] = ICET_IMAGE_COLOR_RGBA_HALF;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    /* Blend in reverse rank order so that the front process is not the
+       first in every group. */
+    process_ranks = malloc(num_proc*sizeof(IceTInt));
+    for (proc = 0; proc < num_proc; proc++) {
+        process_ranks[proc] = num_proc - proc - 1;
+    }
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetEnable(ICET_ORDERED_COMPOSITE);
+    icetCompositeOrder(process_ranks);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+
+    for (strategy_index = 0; strategy_index < 2; strategy_index++) {
+        int single_image_strategy_index;
+
+        icetStrategy(strategies[strategy_index]);
+
+        for (single_image_strategy_index = 0;
+             single_image_strategy_index < 3;
+             single_image_strategy_index++) {
+            int color_format_index;
+
+            icetSingleImageStrategy(
+                single_image_strategies[single_image_strategy_index]);
+
+            for (color_format_index = 0;
+                 color_format_index < 3;
+                 color_format_index++) {
+                if (rank == 0) {
+                    printf("    %s strategy, %s single image strategy,"
+                           " color format 0x%X\n",
+                           icetGetStrategyName(),
+                           icetGetSingleImageStrategyName(),
+                           color_formats[color_format_index]);
+                }
+
+                /* Keep drawing frames after a failure so that all
+                   processes stay in step. */
+                if (OpacityCullingTryFrame(color_formats[color_format_index],
+                                           process_ranks[0])
+                    != TEST_PASSED) {
+                    result = TEST_FAILED;
+                }
+            }
+        }
+    }
+
+    free(process_ranks);
+    return result;
+}
+
+int OpacityCulling(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(OpacityCullingRun);
+}
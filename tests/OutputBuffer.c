@@ -0,0 +1,390 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks that the image written to a buffer given to
+** icetOutputBuffer is the same as the image returned from icetDrawFrame
+** when no output buffer is set.  It also checks that the padding at the end
+** of each row of the output buffer is left alone, that processes that
+** do not display a tile may pass a NULL buffer, and that the image returned
+** with an output buffer has no colors but keeps its depth values.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define OUTPUT_BUFFER_PADDING   12
+#define OUTPUT_BUFFER_FILL      0xAB
+
+/* Draws a pattern of partially transparent pixels that differs on each
+   process, with depths if the image has them. */
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    if (icetImageGetColorFormat(result) == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        IceTUByte *color = icetImageGetColorub(result);
+        for (i = 0; i < num_pixels; i++, color += 4) {
+            if ((i/7 + rank)%3 == 0) {
+                color[0] = color[1] = color[2] = color[3] = 0;
+            } else {
+                IceTUByte alpha = ((i + rank)%2 == 0) ? 255 : 128;
+                color[0] = (IceTUByte)((i*13 + rank*29)%(alpha + 1));
+                color[1] = (IceTUByte)((i*7 + rank*3)%(alpha + 1));
+                color[2] = (IceTUByte)((i + rank*101)%(alpha + 1));
+                color[3] = alpha;
+            }
+        }
+    } else {
+        IceTFloat *color = icetImageGetColorf(result);
+        for (i = 0; i < num_pixels; i++, color += 4) {
+            if ((i/7 + rank)%3 == 0) {
+                color[0] = color[1] = color[2] = color[3] = 0.0f;
+            } else {
+                IceTFloat alpha = ((i + rank)%2 == 0) ? 1.0f : 0.5f;
+                color[0] = alpha*(IceTFloat)((i*13 + rank*29)%256)/255.0f;
+                color[1] = alpha*(IceTFloat)((i*7 + rank*3)%256)/255.0f;
+                color[2] = alpha*(IceTFloat)((i + rank*101)%256)/255.0f;
+                color[3] = alpha;
+            }
+        }
+    }
+
+    if (icetImageGetDepthFormat(result) == ICET_IMAGE_DEPTH_FLOAT) {
+        IceTFloat *depth = icetImageGetDepthf(result);
+        for (i = 0; i < num_pixels; i++) {
+            depth[i] = (IceTFloat)((i*3 + rank*5)%17)/17.0f;
+        }
+    }
+}
+
+static IceTSizeType OutputPixelSize(IceTEnum output_format)
+{
+    if (output_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+        return 4;
+    } else {
+        return 4*sizeof(IceTFloat);
+    }
+}
+
+/* Draws a frame into an output buffer and checks it against the image drawn
+   without one.  If display_only is true, processes that do not display a
+   tile pass a NULL buffer. */
+static int OutputBufferTryFrame(IceTEnum output_format,
+                                IceTSizeType padding,
+                                IceTBoolean display_only)
+{
+    IceTDouble identity[16];
+    IceTFloat background[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTSizeType width;
+    IceTSizeType height;
+    IceTSizeType row_size;
+    IceTSizeType row_pitch;
+    IceTByte *expected;
+    IceTFloat *expected_depth;
+    IceTByte *output;
+    IceTSizeType y;
+    int result = TEST_PASSED;
+
+    identity[ 0] = 1.0;
+    identity[ 1] = 0.0;
+    identity[ 2] = 0.0;
+    identity[ 3] = 0.0;
+
+    identity[ 4] = 0.0;
+    identity[ 5] = 1.0;
+    identity[ 6] = 0.0;
+    identity[ 7] = 0.0;
+
+    identity[ 8] = 0.0;
+    identity[ 9] = 0.0;
+    identity[10] = 1.0;
+    identity[11] = 0.0;
+
+    identity[12] = 0.0;
+    identity[13] = 0.0;
+    identity[14] = 0.0;
+    identity[15] = 1.0;
+
+    background[0] = 0.25f;
+    background[1] = 0.5f;
+    background[2] = 0.75f;
+    background[3] = 1.0f;
+
+    /* Draw the reference image without an output buffer. */
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+    image = icetDrawFrame(identity, identity, background);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    width = icetImageGetWidth(image);
+    height = icetImageGetHeight(image);
+    row_size = width*OutputPixelSize(output_format);
+    row_pitch = (padding > 0) ? row_size + padding : 0;
+
+    if (tile_displayed >= 0) {
+        expected = malloc(row_size*height);
+        output = malloc((row_size + padding)*height);
+        if (output_format == ICET_IMAGE_COLOR_RGBA_UBYTE) {
+            icetImageCopyColorub(image, (IceTUByte *)expected, output_format);
+        } else {
+            icetImageCopyColorf(image, (IceTFloat *)expected, output_format);
+        }
+        memset(output, OUTPUT_BUFFER_FILL, (row_size + padding)*height);
+    } else {
+        expected = NULL;
+        output = NULL;
+    }
+    if (   (tile_displayed >= 0)
+        && (icetImageGetDepthFormat(image) == ICET_IMAGE_DEPTH_FLOAT) ) {
+        expected_depth = malloc(width*height*sizeof(IceTFloat));
+        icetImageCopyDepthf(image, expected_depth, ICET_IMAGE_DEPTH_FLOAT);
+    } else {
+        expected_depth = NULL;
+    }
+
+    /* Draw again into the output buffer. */
+    if (display_only && (tile_displayed < 0)) {
+        icetOutputBuffer(output_format, 0, NULL);
+    } else {
+        icetOutputBuffer(output_format, row_pitch, output);
+    }
+    image = icetDrawFrame(identity, identity, background);
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+
+    if (tile_displayed >= 0) {
+        if (icetImageGetColorFormat(image) != ICET_IMAGE_COLOR_NONE) {
+            printf("Image returned with output buffer has colors.\n");
+            result = TEST_FAILED;
+        }
+        if (expected_depth != NULL) {
+            if (icetImageGetDepthFormat(image) != ICET_IMAGE_DEPTH_FLOAT) {
+                printf("Image returned with output buffer lost depth.\n");
+                result = TEST_FAILED;
+            } else if (memcmp(icetImageGetDepthcf(image),
+                              expected_depth,
+                              width*height*sizeof(IceTFloat)) != 0) {
+                printf("Depth returned with output buffer is wrong.\n");
+                result = TEST_FAILED;
+            }
+            free(expected_depth);
+        }
+
+        for (y = 0; y < height; y++) {
+            const IceTByte *row = output + y*(row_size + padding);
+            IceTSizeType i;
+            if (memcmp(row, expected + y*row_size, row_size) != 0) {
+                printf("Row %d of output buffer does not match image.\n",
+                       (int)y);
+                result = TEST_FAILED;
+                break;
+            }
+            for (i = 0; i < padding; i++) {
+                if (row[row_size + i] != (IceTByte)OUTPUT_BUFFER_FILL) {
+                    printf("Padding of row %d was written over.\n", (int)y);
+                    result = TEST_FAILED;
+                    break;
+                }
+            }
+            if (result != TEST_PASSED) { break; }
+        }
+        free(expected);
+        free(output);
+    }
+
+    return result;
+}
+
+static int OutputBufferTryFormats(void)
+{
+    IceTEnum color_formats[2];
+    int color_format_index;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    for (color_format_index = 0;
+         color_format_index < 2;
+         color_format_index++) {
+        int output_format_index;
+
+        icetSetColorFormat(color_formats[color_format_index]);
+
+        for (output_format_index = 0;
+             output_format_index < 2;
+             output_format_index++) {
+            IceTEnum output_format = color_formats[output_format_index];
+            IceTSizeType padding;
+
+            /* Correcting the background in a buffer of a different format
+               gives slightly different colors than correcting it before
+               converting.  Only correct the background when they match. */
+            if (output_format_index == color_format_index) {
+                icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+            } else {
+                icetDisable(ICET_CORRECT_COLORED_BACKGROUND);
+            }
+
+            for (padding = 0;
+                 padding <= OUTPUT_BUFFER_PADDING;
+                 padding += OUTPUT_BUFFER_PADDING) {
+                if (rank == 0) {
+                    printf("      Color format 0x%X, output format 0x%X,"
+                           " padding %d\n",
+                           color_formats[color_format_index],
+                           output_format,
+                           (int)padding);
+                }
+
+                /* Keep drawing frames after a failure so that all processes
+                   stay in step. */
+                if (OutputBufferTryFrame(output_format, padding, ICET_FALSE)
+                    != TEST_PASSED) {
+                    result = TEST_FAILED;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static int OutputBufferTryStrategies(void)
+{
+    IceTEnum strategies[3];
+    int strategy_index;
+    IceTInt rank;
+    int result = TEST_PASSED;
+
+    strategies[0] = ICET_STRATEGY_REDUCE;
+    strategies[1] = ICET_STRATEGY_SEQUENTIAL;
+    strategies[2] = ICET_STRATEGY_DIRECT;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    for (strategy_index = 0; strategy_index < 3; strategy_index++) {
+        icetStrategy(strategies[strategy_index]);
+        if (rank == 0) {
+            printf("    Using %s strategy.\n", icetGetStrategyName());
+        }
+
+        if (OutputBufferTryFormats() != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        if (rank == 0) {
+            printf("      Output buffer only on display processes\n");
+        }
+        icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+        icetEnable(ICET_CORRECT_COLORED_BACKGROUND);
+        if (OutputBufferTryFrame(ICET_IMAGE_COLOR_RGBA_UBYTE, 0, ICET_TRUE)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        if (rank == 0) {
+            printf("      Output buffer with depth returned\n");
+        }
+        icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+        icetDisable(ICET_COMPOSITE_ONE_BUFFER);
+        if (OutputBufferTryFrame(ICET_IMAGE_COLOR_RGBA_UBYTE, 0, ICET_TRUE)
+            != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        icetEnable(ICET_COMPOSITE_ONE_BUFFER);
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+        icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    }
+
+    return result;
+}
+
+static int OutputBufferRun(void)
+{
+    IceTInt num_proc;
+    IceTInt rank;
+    IceTInt *process_ranks;
+    IceTInt proc;
+    int result;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    process_ranks = malloc(num_proc * sizeof(IceTInt));
+    for (proc = 0; proc < num_proc; proc++) {
+        process_ranks[proc] = proc;
+    }
+    icetEnable(ICET_ORDERED_COMPOSITE);
+    icetCompositeOrder(process_ranks);
+    free(process_ranks);
+
+    if (rank == 0) {
+        printf("  Using one tile\n");
+    }
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, num_proc-1);
+
+    result = OutputBufferTryStrategies();
+
+    if (num_proc > 1) {
+        if (rank == 0) {
+            printf("  Using two tiles\n");
+        }
+        icetResetTiles();
+        icetAddTile(0, 0, SCREEN_WIDTH/2, SCREEN_HEIGHT, 0);
+        icetAddTile(SCREEN_WIDTH/2, 0,
+                    SCREEN_WIDTH - SCREEN_WIDTH/2, SCREEN_HEIGHT,
+                    num_proc-1);
+
+        if (OutputBufferTryStrategies() != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    return result;
+}
+
+int OutputBuffer(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(OutputBufferRun);
+}
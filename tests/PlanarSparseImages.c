@@ -0,0 +1,385 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the planar layout of sparse images (enabled with
+** ICET_PLANAR_SPARSE_IMAGES).  It checks that decompression, compositing,
+** splitting, interlacing, and copying give the same results with either
+** layout, including operations that mix the layouts, and that compositing
+** sparse images matches compositing with a full image.  It also reports how
+** long compositing takes with each layout.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_PARTITIONS 4
+#define NUM_TIMING_TRIALS 10
+
+static void TimeComposite(const char *label,
+                          IceTSparseImage front,
+                          IceTSparseImage back,
+                          IceTSparseImage dest,
+                          IceTImage full)
+{
+    IceTDouble start;
+    IceTDouble ccc_time;
+    IceTDouble decompress_time;
+    int trial;
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetCompressedCompressedComposite(front, back, dest);
+    }
+    ccc_time = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetDecompressImage(back, full);
+        icetCompressedComposite(full, front, ICET_SRC_ON_TOP);
+    }
+    decompress_time = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+
+    printf("  %s layout: compressed composite %.3f ms,"
+           " decompress and composite %.3f ms\n",
+           label, 1000.0*ccc_time, 1000.0*decompress_time);
+}
+
+static int DoPlanarTest(IceTEnum color_format,
+                        IceTEnum depth_format,
+                        IceTBoolean compact)
+{
+    IceTSizeType num_pixels = SCREEN_WIDTH*SCREEN_HEIGHT;
+    IceTSizeType partition_pixels;
+    IceTVoid *buffers[12 + 3*NUM_PARTITIONS];
+    int num_buffers = 0;
+    IceTImage image;
+    IceTImage expected_full;
+    IceTImage actual_full;
+    IceTSparseImage standard_front, standard_back, standard_result;
+    IceTSparseImage planar_front, planar_back, planar_result;
+    IceTSparseImage mixed_result;
+    IceTSparseImage standard_partitions[NUM_PARTITIONS];
+    IceTSparseImage planar_partitions[NUM_PARTITIONS];
+    IceTSparseImage mixed_partitions[NUM_PARTITIONS];
+    IceTSizeType offsets[NUM_PARTITIONS];
+    TestImagePattern pattern;
+    int layout = compact ? TEST_SPARSE_COMPACT : 0;
+    int planar_dest;
+    int partition;
+    int result = TEST_PASSED;
+
+    printf("Using color format of 0x%x\n", (int)color_format);
+    printf("Using depth format of 0x%x\n", (int)depth_format);
+    printf("Using %s run lengths\n", compact ? "compact" : "standard");
+
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    image = icetImageAssignBuffer(buffers[num_buffers++],
+                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    expected_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                          SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    actual_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                        SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    standard_front = new_layout_sparse_image(layout, SCREEN_WIDTH,
+                                             SCREEN_HEIGHT,
+                                             &buffers[num_buffers++]);
+    standard_back = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+    standard_result = new_layout_sparse_image(layout, SCREEN_WIDTH,
+                                              SCREEN_HEIGHT,
+                                              &buffers[num_buffers++]);
+    mixed_result = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    planar_front = new_layout_sparse_image(layout | TEST_SPARSE_PLANAR,
+                                           SCREEN_WIDTH, SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    planar_back = new_layout_sparse_image(layout | TEST_SPARSE_PLANAR,
+                                          SCREEN_WIDTH, SCREEN_HEIGHT,
+                                          &buffers[num_buffers++]);
+    planar_result = new_layout_sparse_image(layout | TEST_SPARSE_PLANAR,
+                                            SCREEN_WIDTH, SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+
+    partition_pixels = icetSparseImageSplitPartitionNumPixels(num_pixels,
+                                                              NUM_PARTITIONS,
+                                                              NUM_PARTITIONS);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        standard_partitions[partition]
+            = new_layout_sparse_image(layout, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+        mixed_partitions[partition]
+            = new_layout_sparse_image(layout, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+        planar_partitions[partition]
+            = new_layout_sparse_image(layout | TEST_SPARSE_PLANAR,
+                                      partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+    }
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+
+    /* Short runs separated by short gaps, a few active runs longer than the
+       planar layout holds in a single run, and depths that sometimes tie. */
+    init_test_image_pattern(&pattern);
+    pattern.max_run = 40;
+    pattern.long_run = 3000;
+    pattern.depth_levels = 256;
+    init_test_image(image, 12345, &pattern);
+    icetCompressImage(image, standard_front);
+    icetCompressImage(image, planar_front);
+    init_test_image(image, 54321, &pattern);
+    icetCompressImage(image, standard_back);
+    icetCompressImage(image, planar_back);
+
+    if (   icetSparseImageGetCompressedBufferSize(planar_front)
+        > icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT) ) {
+        printf("*** Planar image larger than advertised buffer size.\n");
+        result = TEST_FAILED;
+    }
+
+    printf("Checking decompression.\n");
+    if (compare_sparse_images(standard_front, planar_front, expected_full,
+                              actual_full, "Decompression") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (compare_sparse_images(standard_back, planar_back, expected_full,
+                              actual_full, "Decompression") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking composite with full image.\n");
+    icetDecompressImage(standard_back, expected_full);
+    icetCompressedComposite(expected_full, standard_front, ICET_SRC_ON_TOP);
+    icetDecompressImage(standard_back, actual_full);
+    icetCompressedComposite(actual_full, planar_front, ICET_SRC_ON_TOP);
+    if (compare_test_images(expected_full, actual_full, 0.0f,
+                            "Composite with full image") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking compressed composite against full image composite.\n");
+    icetCompressedCompressedComposite(standard_front,
+                                      standard_back,
+                                      standard_result);
+    icetDecompressImage(standard_result, actual_full);
+    if (compare_test_images(expected_full, actual_full, 0.0f,
+                            "Compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    icetCompressedCompressedComposite(planar_front,
+                                      planar_back,
+                                      planar_result);
+    icetDecompressImage(planar_result, actual_full);
+    if (compare_test_images(expected_full, actual_full, 0.0f,
+                            "Compressed composite") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking copy.\n");
+    icetSparseImageCopyPixels(standard_front, 1000, partition_pixels,
+                              standard_partitions[0]);
+    icetSparseImageCopyPixels(planar_front, 1000, partition_pixels,
+                              planar_partitions[0]);
+    if (compare_sparse_images(standard_partitions[0], planar_partitions[0],
+                              expected_full, actual_full,
+                              "Copy") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+  /* Check each operation on planar input, writing both planar and
+     interleaved images, against doing the same with interleaved images. */
+    for (planar_dest = 0; planar_dest < 2; planar_dest++) {
+        IceTSparseImage dest = planar_dest ? planar_result : mixed_result;
+        IceTSparseImage *dest_partitions
+            = planar_dest ? planar_partitions : mixed_partitions;
+
+        printf("Writing %s layout.\n",
+               planar_dest ? "planar" : "interleaved");
+
+        printf("  Checking interlace.\n");
+        icetSparseImageInterlace(standard_front,
+                                 NUM_PARTITIONS,
+                                 ICET_SI_STRATEGY_BUFFER_0,
+                                 standard_result);
+        icetSparseImageInterlace(planar_front,
+                                 NUM_PARTITIONS,
+                                 ICET_SI_STRATEGY_BUFFER_0,
+                                 dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Interlace") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+
+        printf("  Checking split.\n");
+        icetSparseImageSplit(standard_front,
+                             0,
+                             NUM_PARTITIONS,
+                             NUM_PARTITIONS,
+                             standard_partitions,
+                             offsets);
+        icetSparseImageSplit(planar_front,
+                             0,
+                             NUM_PARTITIONS,
+                             NUM_PARTITIONS,
+                             dest_partitions,
+                             offsets);
+        for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+            if (compare_sparse_images(standard_partitions[partition],
+                                      dest_partitions[partition], expected_full,
+                                      actual_full, "Split") != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+        }
+
+        printf("  Checking composite.\n");
+        icetCompressedCompressedComposite(standard_front,
+                                          standard_back,
+                                          standard_result);
+        icetCompressedCompressedComposite(planar_front,
+                                          planar_back,
+                                          dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Composite") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        icetCompressedCompressedComposite(planar_front,
+                                          standard_back,
+                                          dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Composite") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        icetCompressedCompressedComposite(standard_front,
+                                          planar_back,
+                                          dest);
+        if (compare_sparse_images(standard_result, dest, expected_full,
+                                  actual_full, "Composite") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Checking interleaved input to planar output.\n");
+    icetCompressedCompressedComposite(standard_front,
+                                      standard_back,
+                                      planar_result);
+    if (compare_sparse_images(standard_result, planar_result, expected_full,
+                              actual_full,
+                              "Interleaved to planar") != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    icetSparseImageSplit(standard_front,
+                         0,
+                         NUM_PARTITIONS,
+                         NUM_PARTITIONS,
+                         standard_partitions,
+                         offsets);
+    icetSparseImageSplit(standard_front,
+                         0,
+                         NUM_PARTITIONS,
+                         NUM_PARTITIONS,
+                         planar_partitions,
+                         offsets);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        if (compare_sparse_images(standard_partitions[partition],
+                                  planar_partitions[partition], expected_full,
+                                  actual_full,
+                                  "Interleaved to planar") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Checking split in place.\n");
+    icetSparseImageCopyPixels(planar_front, 0, num_pixels, planar_result);
+    planar_partitions[0] = planar_result;
+    icetSparseImageSplit(planar_result,
+                         0,
+                         NUM_PARTITIONS,
+                         NUM_PARTITIONS,
+                         planar_partitions,
+                         offsets);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        if (compare_sparse_images(standard_partitions[partition],
+                                  planar_partitions[partition], expected_full,
+                                  actual_full,
+                                  "Split in place") != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    printf("Timing.\n");
+    TimeComposite("Interleaved",
+                  standard_front, standard_back, standard_result,
+                  actual_full);
+    TimeComposite("Planar",
+                  planar_front, planar_back, planar_result,
+                  actual_full);
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+    return result;
+}
+
+static int PlanarSparseImagesRun()
+{
+    IceTEnum color_formats[4];
+    IceTEnum depth_formats[2];
+    int color_index;
+    int depth_index;
+    int compact;
+    int result = TEST_PASSED;
+
+    color_formats[0] = ICET_IMAGE_COLOR_RGBA_UBYTE;
+    color_formats[1] = ICET_IMAGE_COLOR_RGBA_FLOAT;
+    color_formats[2] = ICET_IMAGE_COLOR_RGBA_HALF;
+    color_formats[3] = ICET_IMAGE_COLOR_NONE;
+    depth_formats[0] = ICET_IMAGE_DEPTH_FLOAT;
+    depth_formats[1] = ICET_IMAGE_DEPTH_UNORM16;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+
+    for (color_index = 0; color_index < 4; color_index++) {
+        for (depth_index = 0; depth_index < 2; depth_index++) {
+            for (compact = 0; compact < 2; compact++) {
+                if (DoPlanarTest(color_formats[color_index],
+                                 depth_formats[depth_index],
+                                 (IceTBoolean)compact) != TEST_PASSED) {
+                    result = TEST_FAILED;
+                }
+                printf("\n\n");
+            }
+        }
+    }
+
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+
+    return result;
+}
+
+int PlanarSparseImages(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(PlanarSparseImagesRun);
+}
@@ -0,0 +1,292 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_RADIXK_AUTO_TUNE.  While the tuner tries different
+** values of k and maximum image split, every frame must composite correctly.
+** The tuner must settle on the same choice on every process, leave the
+** ICET_MAGIC_K and ICET_MAX_IMAGE_SPLIT set by the user alone, and explore
+** again when frames get slow.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevCommunication.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Most frames to wait for the tuner to try all its candidates. */
+#define MAX_TUNE_FRAMES 60
+
+extern ICET_EXPORT IceTInt icetRadixkTuneCandidateTest(void);
+extern ICET_EXPORT void icetRadixkTuneForgetBestTimeTest(void);
+
+/* Gets the color and depth process rank draws at pixel. */
+static void PixelAt(IceTInt rank,
+                    IceTSizeType pixel,
+                    IceTUByte *color,
+                    IceTFloat *depth)
+{
+    if ((pixel/17 + rank)%3 == 0) {
+        color[0] = color[1] = color[2] = color[3] = 0;
+        *depth = 1.0f;
+    } else {
+        color[0] = (IceTUByte)((pixel*3 + rank*41)%256);
+        color[1] = (IceTUByte)((pixel*7 + rank*5)%256);
+        color[2] = (IceTUByte)((pixel + rank*89)%256);
+        color[3] = 255;
+        *depth = (IceTFloat)((pixel*5 + rank*23)%107)/128.0f;
+    }
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTUByte *colors = icetImageGetColorub(result);
+    IceTFloat *depths = icetImageGetDepthf(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        PixelAt(rank, i, colors + 4*i, depths + i);
+    }
+}
+
+/* Draws a frame and checks the image on the display process against the
+   nearest color drawn by any process. */
+static int RadixkAutoTuneDrawFrame(void)
+{
+    IceTDouble identity[16];
+    IceTFloat black[4];
+    IceTImage image;
+    IceTInt tile_displayed;
+    IceTInt num_proc;
+    const IceTUByte *colors;
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+    black[0] = black[1] = black[2] = black[3] = 0.0f;
+
+    image = icetDrawFrame(identity, identity, black);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) return TEST_PASSED;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    colors = icetImageGetColorcub(image);
+    num_pixels = icetImageGetNumPixels(image);
+    for (i = 0; i < num_pixels; i++) {
+        IceTUByte expected[4];
+        IceTFloat nearest_depth = 1.0f;
+        IceTInt proc;
+
+        expected[0] = expected[1] = expected[2] = expected[3] = 0;
+        for (proc = 0; proc < num_proc; proc++) {
+            IceTUByte color[4];
+            IceTFloat depth;
+            PixelAt(proc, i, color, &depth);
+            if (depth < nearest_depth) {
+                memcpy(expected, color, 4);
+                nearest_depth = depth;
+            }
+        }
+
+        if (memcmp(colors + 4*i, expected, 4) != 0) {
+            printf("*** Pixel %d is (%d, %d, %d, %d), expected"
+                   " (%d, %d, %d, %d).\n",
+                   (int)i,
+                   colors[4*i+0], colors[4*i+1],
+                   colors[4*i+2], colors[4*i+3],
+                   expected[0], expected[1], expected[2], expected[3]);
+            return TEST_FAILED;
+        }
+    }
+
+    return TEST_PASSED;
+}
+
+/* Draws frames until the tuner stops exploring, checking that it tries the
+   candidates in order starting with first_candidate and times each over
+   several frames.  Returns the number of frames drawn or -1 if the tuner
+   misbehaves.  A wrong image sets result to TEST_FAILED but does not stop the
+   frames so that all processes stay in step. */
+static IceTInt RadixkAutoTuneExplore(IceTInt first_candidate, int *result)
+{
+    IceTInt frame;
+    IceTInt last_candidate = first_candidate;
+    IceTInt candidate_frames = 0;
+
+    for (frame = 1; frame <= MAX_TUNE_FRAMES; frame++) {
+        IceTInt candidate;
+
+        if (RadixkAutoTuneDrawFrame() != TEST_PASSED) {
+            *result = TEST_FAILED;
+        }
+        candidate_frames++;
+
+        candidate = icetRadixkTuneCandidateTest();
+        if (candidate < 0) { return frame; }
+        if (candidate == last_candidate + 1) {
+            if (candidate_frames < 2) {
+                printf("*** Candidate %d timed over only one frame.\n",
+                       (int)last_candidate);
+                return -1;
+            }
+            last_candidate = candidate;
+            candidate_frames = 0;
+        } else if (candidate != last_candidate) {
+            printf("*** Frame %d tries candidate %d after %d.\n",
+                   (int)frame, (int)candidate, (int)last_candidate);
+            return -1;
+        }
+    }
+
+    printf("*** Tuner still exploring after %d frames.\n", MAX_TUNE_FRAMES);
+    return -1;
+}
+
+/* Checks that the tuned values are sensible and the same everywhere. */
+static int RadixkAutoTuneCheckChoice(void)
+{
+    IceTInt choice[2];
+    IceTInt *all_choices;
+    IceTInt num_proc;
+    IceTInt proc;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_RADIXK_TUNED_MAGIC_K, &choice[0]);
+    icetGetIntegerv(ICET_RADIXK_TUNED_MAX_IMAGE_SPLIT, &choice[1]);
+    if (   (choice[0] < 2) || (choice[0] > 32)
+        || ((choice[0] & (choice[0] - 1)) != 0)
+        || (choice[1] < 1) ) {
+        printf("*** Tuner chose k %d and split %d.\n",
+               (int)choice[0], (int)choice[1]);
+        result = TEST_FAILED;
+    }
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    all_choices = malloc(2*num_proc*sizeof(IceTInt));
+    icetCommAllgather(choice, 2, ICET_INT, all_choices);
+    for (proc = 0; proc < num_proc; proc++) {
+        if (   (all_choices[2*proc+0] != choice[0])
+            || (all_choices[2*proc+1] != choice[1]) ) {
+            printf("*** Process %d chose k %d and split %d,"
+                   " this process k %d and split %d.\n",
+                   (int)proc,
+                   (int)all_choices[2*proc+0], (int)all_choices[2*proc+1],
+                   (int)choice[0], (int)choice[1]);
+            result = TEST_FAILED;
+        }
+    }
+    free(all_choices);
+
+    return result;
+}
+
+static int RadixkAutoTuneRun(void)
+{
+    IceTInt magic_k;
+    IceTInt max_image_split;
+    IceTInt frames;
+    IceTInt rank;
+    IceTInt frame;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    icetGetIntegerv(ICET_MAGIC_K, &magic_k);
+    icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &max_image_split);
+
+    icetStrategy(ICET_STRATEGY_SEQUENTIAL);
+    icetSingleImageStrategy(ICET_SINGLE_IMAGE_STRATEGY_RADIXK);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+    icetDisable(ICET_ORDERED_COMPOSITE);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+
+    icetEnable(ICET_RADIXK_AUTO_TUNE);
+
+    if (rank == 0) printf("Exploring\n");
+    frames = RadixkAutoTuneExplore(0, &result);
+    if (frames < 0) { return TEST_FAILED; }
+    if (rank == 0) printf("  Settled after %d frames\n", (int)frames);
+    if (RadixkAutoTuneCheckChoice() != TEST_PASSED) { return TEST_FAILED; }
+
+    {
+        IceTInt current_magic_k;
+        IceTInt current_max_image_split;
+        icetGetIntegerv(ICET_MAGIC_K, &current_magic_k);
+        icetGetIntegerv(ICET_MAX_IMAGE_SPLIT, &current_max_image_split);
+        if (   (current_magic_k != magic_k)
+            || (current_max_image_split != max_image_split) ) {
+            printf("*** Tuning changed k to %d and split to %d.\n",
+                   (int)current_magic_k, (int)current_max_image_split);
+            return TEST_FAILED;
+        }
+    }
+
+    /* Pretend the best time found was much faster than any frame can be so
+       that the next frames are slow. */
+    if (rank == 0) printf("Slowing down\n");
+    icetRadixkTuneForgetBestTimeTest();
+    for (frame = 0; frame < MAX_TUNE_FRAMES; frame++) {
+        IceTInt candidate;
+        if (RadixkAutoTuneDrawFrame() != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+        candidate = icetRadixkTuneCandidateTest();
+        if (candidate == 0) break;
+    }
+    if (frame == MAX_TUNE_FRAMES) {
+        printf("*** Tuner did not explore again after slow frames.\n");
+        return TEST_FAILED;
+    }
+    if (rank == 0) {
+        printf("  Exploring again after %d frames\n", (int)(frame + 1));
+    }
+
+    frames = RadixkAutoTuneExplore(0, &result);
+    if (frames < 0) { return TEST_FAILED; }
+    if (RadixkAutoTuneCheckChoice() != TEST_PASSED) { return TEST_FAILED; }
+
+    icetDisable(ICET_RADIXK_AUTO_TUNE);
+
+    return result;
+}
+
+int RadixkAutoTune(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(RadixkAutoTuneRun);
+}
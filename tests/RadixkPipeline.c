@@ -0,0 +1,200 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks ICET_RADIXK_CHUNK_SIZE.  Sending the image partitions of
+** radix-k in chunks and compositing them as they arrive must give exactly
+** the same image as sending each partition whole, for blending and for
+** z-buffer compositing and for chunk sizes down to a single pixel.
+*****************************************************************************/
+
+#include <IceT.h>
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Gets the premultiplied channels, in units of 1/255, and depth process rank
+   draws at pixel. */
+static void PixelAt(IceTInt rank,
+                    IceTSizeType pixel,
+                    IceTInt *channels,
+                    IceTFloat *depth)
+{
+    if ((pixel/11 + rank)%3 == 0) {
+        channels[0] = channels[1] = channels[2] = channels[3] = 0;
+        *depth = 1.0f;
+    } else {
+        IceTInt alpha = ((pixel/5 + rank)%2 == 0) ? 255 : 100;
+        channels[0] = (IceTInt)((pixel*13 + rank*29)%(alpha + 1));
+        channels[1] = (IceTInt)((pixel*7 + rank*3)%(alpha + 1));
+        channels[2] = (IceTInt)((pixel + rank*101)%(alpha + 1));
+        channels[3] = alpha;
+        *depth = (IceTFloat)((pixel*3 + rank*17)%101)/128.0f;
+    }
+}
+
+static void draw(const IceTDouble *projection_matrix,
+                 const IceTDouble *modelview_matrix,
+                 const IceTFloat *background_color,
+                 const IceTInt *readback_viewport,
+                 IceTImage result)
+{
+    IceTEnum depth_format = icetImageGetDepthFormat(result);
+    IceTUByte *colors = icetImageGetColorub(result);
+    IceTSizeType num_pixels;
+    IceTSizeType i;
+    IceTInt rank;
+
+    /* Suppress compiler warnings. */
+    (void)projection_matrix;
+    (void)modelview_matrix;
+    (void)background_color;
+    (void)readback_viewport;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    num_pixels = icetImageGetNumPixels(result);
+
+    for (i = 0; i < num_pixels; i++) {
+        IceTInt channels[4];
+        IceTFloat depth;
+        int channel;
+        PixelAt(rank, i, channels, &depth);
+        for (channel = 0; channel < 4; channel++) {
+            colors[4*i + channel] = (IceTUByte)channels[channel];
+        }
+        if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+            icetImageGetDepthf(result)[i] = depth;
+        }
+    }
+}
+
+/* Draws a frame with the given chunk size and, on the display process,
+   returns a newly allocated array with the colors.  Returns NULL on other
+   processes.  The colors are placed in an output buffer filled with garbage
+   first so that pixels left over from the last frame cannot hide any that
+   are missing. */
+static IceTUByte *RadixkPipelineDrawColors(IceTInt chunk_size)
+{
+    IceTDouble identity[16];
+    IceTFloat black[4];
+    IceTInt tile_displayed;
+    IceTUByte *colors;
+    IceTSizeType i;
+
+    for (i = 0; i < 16; i++) {
+        identity[i] = ((i%5) == 0) ? 1.0 : 0.0;
+    }
+    black[0] = black[1] = black[2] = black[3] = 0.0f;
+
+    colors = malloc(4*SCREEN_WIDTH*SCREEN_HEIGHT);
+    memset(colors, 0xAB, 4*SCREEN_WIDTH*SCREEN_HEIGHT);
+
+    icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE, chunk_size);
+    icetOutputBuffer(ICET_IMAGE_COLOR_RGBA_UBYTE, 0, colors);
+
+    icetDrawFrame(identity, identity, black);
+
+    icetOutputBuffer(ICET_IMAGE_COLOR_NONE, 0, NULL);
+    icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE, 0);
+
+    icetGetIntegerv(ICET_TILE_DISPLAYED, &tile_displayed);
+    if (tile_displayed < 0) {
+        free(colors);
+        return NULL;
+    }
+
+    return colors;
+}
+
+static int RadixkPipelineTryMode(IceTEnum composite_mode)
+{
+    IceTInt chunk_sizes[4];
+    IceTUByte *expected;
+    IceTInt rank;
+    int chunk_index;
+    int result = TEST_PASSED;
+
+    chunk_sizes[0] = 65536;
+    chunk_sizes[1] = 20000;
+    chunk_sizes[2] = 4096;
+    chunk_sizes[3] = 1;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    icetCompositeMode(composite_mode);
+    if (composite_mode == ICET_COMPOSITE_MODE_BLEND) {
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+        icetEnable(ICET_ORDERED_COMPOSITE);
+    } else {
+        icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+        icetDisable(ICET_ORDERED_COMPOSITE);
+    }
+
+    expected = RadixkPipelineDrawColors(0);
+
+    for (chunk_index = 0; chunk_index < 4; chunk_index++) {
+        IceTUByte *actual;
+
+        if (rank == 0) {
+            printf("    mode 0x%X, chunk size %d\n",
+                   composite_mode, (int)chunk_sizes[chunk_index]);
+        }
+
+        /* Keep drawing frames after a failure so that all processes stay in
+           step. */
+        actual = RadixkPipelineDrawColors(chunk_sizes[chunk_index]);
+        if (actual == NULL) continue;
+
+        if (memcmp(actual, expected, 4*SCREEN_WIDTH*SCREEN_HEIGHT) != 0) {
+            printf("*** Image with chunks differs from image without.\n");
+            result = TEST_FAILED;
+        }
+        free(actual);
+    }
+
+    free(expected);
+    return result;
+}
+
+static int RadixkPipelineRun(void)
+{
+    IceTInt num_proc;
+    int result = TEST_PASSED;
+
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+
+    icetStrategy(ICET_STRATEGY_SEQUENTIAL);
+    icetSingleImageStrategy(ICET_SINGLE_IMAGE_STRATEGY_RADIXK);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetDrawCallback(draw);
+    icetBoundingBoxd(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+    icetResetTiles();
+    icetAddTile(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+
+    if (RadixkPipelineTryMode(ICET_COMPOSITE_MODE_BLEND) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (RadixkPipelineTryMode(ICET_COMPOSITE_MODE_Z_BUFFER) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    return result;
+}
+
+int RadixkPipeline(int argc, char *argv[])
+{
+    /* To remove warning. */
+    (void)argc;
+    (void)argv;
+
+    return run_test(RadixkPipelineRun);
+}
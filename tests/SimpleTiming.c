@@ -11,6 +11,7 @@
 
 #include <IceTDevCommunication.h>
 #include <IceTDevContext.h>
+#include <IceTDevImage.h>
 #include <IceTDevMatrix.h>
 #include "test-util.h"
 #include "test_codes.h"
@@ -49,6 +50,17 @@ typedef struct {
     IceTDouble frame_time;
 } timings_type;
 
+/* Sizes and times of images compressed into runs and into blocks for
+   -block-study. */
+typedef struct {
+    IceTInt run_bytes;
+    IceTInt block_bytes;
+    IceTDouble run_compress_time;
+    IceTDouble block_compress_time;
+    IceTDouble run_composite_time;
+    IceTDouble block_composite_time;
+} block_study_type;
+
 /* Array for quick opacity lookups. */
 #define OPACITY_LOOKUP_SIZE 4096
 #define OPACITY_MAX_DT 4
@@ -92,6 +104,9 @@ static IceTBoolean g_do_magic_k_study;
 static IceTInt g_max_magic_k;
 static IceTBoolean g_do_image_split_study;
 static IceTInt g_min_image_split;
+static IceTBoolean g_do_block_study;
+static IceTInt g_radixk_chunk_size;
+static IceTBoolean g_radixk_auto_tune;
 
 static float g_color[4];
 
@@ -119,6 +134,13 @@ static void usage(char *argv[])
            "                multiple values of k, up to <num>, doubling each time.\n");
     printf("  -max-image-split-study <num> Repeat the test for multiple maximum image\n"
            "                splits starting at <num> and doubling each time.\n");
+    printf("  -radixk-chunk-size <num> Send radix-k image partitions in\n"
+           "                chunks of <num> pixels.\n");
+    printf("  -radixk-auto-tune Use the radix-k single-image strategy and let\n"
+           "                it tune k and the maximum image split.\n");
+    printf("  -block-study  Also compare the size of each image and the time to\n"
+           "                composite it when compressed into runs and into\n"
+           "                blocks.\n");
     printf("  -h, -help      Print this help message.\n");
     printf("\nFor general testing options, try -h or -help before test name.\n");
 }
@@ -143,6 +165,9 @@ static void parse_arguments(int argc, char *argv[])
     g_max_magic_k = 0;
     g_do_image_split_study = ICET_FALSE;
     g_min_image_split = 0;
+    g_do_block_study = ICET_FALSE;
+    g_radixk_chunk_size = -1;
+    g_radixk_auto_tune = ICET_FALSE;
 
     for (arg = 1; arg < argc; arg++) {
         if (strcmp(argv[arg], "-tilesx") == 0) {
@@ -191,6 +216,14 @@ static void parse_arguments(int argc, char *argv[])
             g_single_image_strategy = ICET_SINGLE_IMAGE_STRATEGY_RADIXK;
             arg++;
             g_min_image_split = atoi(argv[arg]);
+        } else if (strcmp(argv[arg], "-radixk-chunk-size") == 0) {
+            arg++;
+            g_radixk_chunk_size = atoi(argv[arg]);
+        } else if (strcmp(argv[arg], "-radixk-auto-tune") == 0) {
+            g_radixk_auto_tune = ICET_TRUE;
+            g_single_image_strategy = ICET_SINGLE_IMAGE_STRATEGY_RADIXK;
+        } else if (strcmp(argv[arg], "-block-study") == 0) {
+            g_do_block_study = ICET_TRUE;
         } else if (   (strcmp(argv[arg], "-h") == 0)
                    || (strcmp(argv[arg], "-help")) ) {
             usage(argv);
@@ -593,6 +626,126 @@ static void find_composite_order(const IceTDouble *projection,
     free(process_ranks);
 }
 
+/* Compresses image into runs or blocks, exchanges it with the partner
+   process, and composites the two.  Records the size of the message and the
+   time to compress and composite. */
+static void block_study_layout(const IceTImage image,
+                               IceTBoolean blocks,
+                               IceTInt partner,
+                               IceTSparseImage local_image,
+                               IceTSparseImage result_image,
+                               IceTVoid *receive_buffer,
+                               IceTSizeType receive_size,
+                               IceTInt *bytes,
+                               IceTDouble *compress_time,
+                               IceTDouble *composite_time)
+{
+    IceTInt rank;
+    IceTDouble start;
+    IceTVoid *package;
+    IceTSizeType package_size;
+    IceTSparseImage received_image;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+
+    start = icetWallTime();
+    if (blocks) {
+        icetCompressImageBlocks(image, local_image);
+    } else {
+        icetCompressImage(image, local_image);
+    }
+    *compress_time = icetWallTime() - start;
+
+    icetSparseImagePackageForSend(local_image, &package, &package_size);
+    *bytes = (IceTInt)package_size;
+    if (partner != rank) {
+        icetCommSendrecv(package, package_size, ICET_BYTE, partner, 34,
+                         receive_buffer, receive_size, ICET_BYTE, partner, 34);
+    } else {
+        memcpy(receive_buffer, package, package_size);
+    }
+    received_image = icetSparseImageUnpackageFromReceive(receive_buffer);
+
+    start = icetWallTime();
+    if (rank < partner) {
+        icetCompressedCompressedComposite(local_image,
+                                          received_image,
+                                          result_image);
+    } else {
+        icetCompressedCompressedComposite(received_image,
+                                          local_image,
+                                          result_image);
+    }
+    *composite_time = icetWallTime() - start;
+}
+
+/* Renders the geometry of this process over the whole render window and
+   compares compressing it into runs and into blocks.  Each process composites
+   its image with the image of a partner process, as in the first round of
+   binary swap. */
+static void block_study_frame(const IceTDouble *projection_matrix,
+                              const IceTDouble *modelview_matrix,
+                              const IceTFloat *background_color,
+                              block_study_type *study)
+{
+    IceTInt rank;
+    IceTInt num_proc;
+    IceTInt partner;
+    IceTInt width;
+    IceTInt height;
+    IceTInt viewport[4];
+    IceTSizeType sparse_size;
+    IceTVoid *image_buffer;
+    IceTVoid *local_buffer;
+    IceTVoid *result_buffer;
+    IceTVoid *receive_buffer;
+    IceTImage image;
+    IceTSparseImage local_image;
+    IceTSparseImage result_image;
+
+    icetGetIntegerv(ICET_RANK, &rank);
+    icetGetIntegerv(ICET_NUM_PROCESSES, &num_proc);
+    icetGetIntegerv(ICET_PHYSICAL_RENDER_WIDTH, &width);
+    icetGetIntegerv(ICET_PHYSICAL_RENDER_HEIGHT, &height);
+
+    partner = rank^1;
+    if (partner >= num_proc) { partner = rank; }
+
+    image_buffer = malloc(icetImageBufferSize(width, height));
+    image = icetImageAssignBuffer(image_buffer, width, height);
+    viewport[0] = viewport[1] = 0;
+    viewport[2] = width;
+    viewport[3] = height;
+    g_first_render = ICET_FALSE;
+    draw(projection_matrix, modelview_matrix, background_color,
+         viewport, image);
+
+    sparse_size = icetSparseImageBufferSize(width, height);
+    local_buffer = malloc(sparse_size);
+    result_buffer = malloc(sparse_size);
+    receive_buffer = malloc(sparse_size);
+    local_image = icetSparseImageAssignBuffer(local_buffer, width, height);
+    result_image = icetSparseImageAssignBuffer(result_buffer, width, height);
+
+    block_study_layout(image, ICET_FALSE, partner,
+                       local_image, result_image,
+                       receive_buffer, sparse_size,
+                       &study->run_bytes,
+                       &study->run_compress_time,
+                       &study->run_composite_time);
+    block_study_layout(image, ICET_TRUE, partner,
+                       local_image, result_image,
+                       receive_buffer, sparse_size,
+                       &study->block_bytes,
+                       &study->block_compress_time,
+                       &study->block_composite_time);
+
+    free(image_buffer);
+    free(local_buffer);
+    free(result_buffer);
+    free(receive_buffer);
+}
+
 static int SimpleTimingDoRender()
 {
     IceTInt rank;
@@ -609,6 +762,7 @@ static int SimpleTimingDoRender()
     IceTFloat background_color[4];
 
     timings_type *timing_array;
+    block_study_type *block_study_array;
 
     /* Normally, the first thing that you do is set up your communication and
      * then create at least one IceT context.  This has already been done in the
@@ -697,6 +851,12 @@ static int SimpleTimingDoRender()
 
     icetStrategy(g_strategy);
     icetSingleImageStrategy(g_single_image_strategy);
+    if (g_radixk_chunk_size >= 0) {
+        icetStateSetInteger(ICET_RADIXK_CHUNK_SIZE, g_radixk_chunk_size);
+    }
+    if (g_radixk_auto_tune) {
+        icetEnable(ICET_RADIXK_AUTO_TUNE);
+    }
 
     /* Set up the projection matrix. */
     icetMatrixFrustum(-0.65*aspect, 0.65*aspect, -0.65, 0.65, 3.0, 5.0,
@@ -728,6 +888,7 @@ static int SimpleTimingDoRender()
     srand(g_seed);
 
     timing_array = malloc(g_num_frames * sizeof(timings_type));
+    block_study_array = malloc(g_num_frames * sizeof(block_study_type));
 
     for (frame = 0; frame < g_num_frames; frame++) {
         IceTDouble elapsed_time;
@@ -820,6 +981,13 @@ static int SimpleTimingDoRender()
             write_ppm(filename, buffer, (int)SCREEN_WIDTH, (int)SCREEN_HEIGHT);
             free(buffer);
         }
+
+        if (g_do_block_study) {
+            block_study_frame(projection_matrix,
+                              modelview_matrix,
+                              background_color,
+                              &block_study_array[frame]);
+        }
     }
 
     /* Print logging header. */
@@ -900,8 +1068,55 @@ static int SimpleTimingDoRender()
         free(timing_collection);
     }
 
+    if (g_do_block_study) {
+        block_study_type *study_collection
+            = malloc(num_proc*sizeof(block_study_type));
+
+        for (frame = 0; frame < g_num_frames; frame++) {
+            block_study_type *study = &block_study_array[frame];
+
+            icetCommGather(study,
+                           sizeof(block_study_type),
+                           ICET_BYTE,
+                           study_collection,
+                           0);
+
+            if (rank == 0) {
+                int p;
+                long int total_run_bytes = 0;
+                long int total_block_bytes = 0;
+
+                for (p = 0; p < num_proc; p++) {
+#define UPDATE_STUDY_MAX(field) if (study->field < study_collection[p].field) study->field = study_collection[p].field;
+                    UPDATE_STUDY_MAX(run_compress_time);
+                    UPDATE_STUDY_MAX(block_compress_time);
+                    UPDATE_STUDY_MAX(run_composite_time);
+                    UPDATE_STUDY_MAX(block_composite_time);
+                    total_run_bytes += study_collection[p].run_bytes;
+                    total_block_bytes += study_collection[p].block_bytes;
+                }
+
+                printf("BLOCKLOG,%d,%d,%d,%s,%d,%ld,%ld,%lg,%lg,%lg,%lg\n",
+                       num_proc,
+                       SCREEN_WIDTH,
+                       SCREEN_HEIGHT,
+                       g_transparent ? "yes" : "no",
+                       frame,
+                       total_run_bytes,
+                       total_block_bytes,
+                       study->run_compress_time,
+                       study->block_compress_time,
+                       study->run_composite_time,
+                       study->block_composite_time);
+            }
+        }
+
+        free(study_collection);
+    }
+
     free_region_divide(region_divisions);
     free(timing_array);
+    free(block_study_array);
 
     /* This is to prevent a non-root from printing while the root is writing
        the log. */
@@ -940,6 +1155,20 @@ int SimpleTimingRun()
                "collect time,"
                "bytes sent,"
                "frame time\n");
+        if (g_do_block_study) {
+            printf("BLOCKHEADER,"
+                   "num processes,"
+                   "width,"
+                   "height,"
+                   "transparent,"
+                   "frame,"
+                   "run bytes,"
+                   "block bytes,"
+                   "run compress time,"
+                   "block compress time,"
+                   "run composite time,"
+                   "block composite time\n");
+        }
     }
 
     if (g_do_magic_k_study) {
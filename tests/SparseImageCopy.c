@@ -210,6 +210,7 @@ static int TestSparseImageSplit(const IceTImage image)
     IceTVoid *sparse_partition_buffer[NUM_PARTITIONS];
     IceTSparseImage sparse_partition[NUM_PARTITIONS];
     IceTSizeType offsets[NUM_PARTITIONS];
+    IceTSizeType compress_offsets[NUM_PARTITIONS];
     IceTVoid *compare_sparse_buffer;
     IceTSparseImage compare_sparse;
 
@@ -287,6 +288,33 @@ static int TestSparseImageSplit(const IceTImage image)
         if (result != TEST_PASSED) return result;
     }
 
+    printf("Compressing image directly into %d partitions.\n",
+           NUM_PARTITIONS);
+    icetCompressImageSplit(image,
+                           NUM_PARTITIONS,
+                           NUM_PARTITIONS,
+                           sparse_partition,
+                           compress_offsets);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        IceTInt result;
+        if (compress_offsets[partition] != offsets[partition]) {
+            printf("Partition %d has offset %d, expected %d.\n",
+                   partition,
+                   (int)compress_offsets[partition],
+                   (int)offsets[partition]);
+            return TEST_FAILED;
+        }
+        icetCompressSubImage(image,
+                             offsets[partition],
+                             icetSparseImageGetNumPixels(
+                                                   sparse_partition[partition]),
+                             compare_sparse);
+        printf("    Comparing partition %d\n", partition);
+        result = CompareSparseImages(compare_sparse,
+                                     sparse_partition[partition]);
+        if (result != TEST_PASSED) return result;
+    }
+
     free(full_sparse_buffer);
     for (partition = 0; partition < NUM_PARTITIONS; partition++) {
         free(sparse_partition_buffer[partition]);
@@ -0,0 +1,401 @@
+/* -*- c -*- *****************************************************************
+** Copyright (C) 2011 Sandia Corporation
+** Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+** the U.S. Government retains certain rights in this software.
+**
+** This source code is released under the New BSD License.
+**
+** This test checks the seek index of sparse images (enabled with
+** ICET_INDEX_SPARSE_IMAGES).  It checks that copying, splitting, and
+** interlacing images that were compressed, composited, or split with an
+** index give the same pixels as doing so without the index.  It also reports
+** how long these operations take with and without the index.
+*****************************************************************************/
+
+#include "test_codes.h"
+#include "test-util.h"
+
+#include <IceTDevImage.h>
+#include <IceTDevState.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_PARTITIONS 8
+#define NUM_TIMING_TRIALS 10
+
+/* Checks that the two sparse images hold the same pixels.  The index is not
+   part of the image data, so the data should match byte for byte. */
+static int CompareSparse(const IceTSparseImage expected,
+                         const IceTSparseImage actual,
+                         IceTImage expected_full,
+                         IceTImage actual_full)
+{
+    if (   icetSparseImageGetCompressedBufferSize(expected)
+        != icetSparseImageGetCompressedBufferSize(actual) ) {
+        printf("*** Images have different sizes.\n");
+        return TEST_FAILED;
+    }
+
+    return compare_sparse_images(expected, actual, expected_full, actual_full,
+                                 "Indexed image");
+}
+
+/* Copies pieces at many offsets of the input images and checks that they
+   match. */
+static int CheckCopies(const IceTSparseImage plain_image,
+                       const IceTSparseImage indexed_image,
+                       IceTSparseImage plain_out,
+                       IceTSparseImage indexed_out,
+                       IceTImage expected_full,
+                       IceTImage actual_full)
+{
+    IceTSizeType num_pixels = icetSparseImageGetNumPixels(plain_image);
+    IceTSizeType piece_size = num_pixels/NUM_PARTITIONS;
+    IceTSizeType offset;
+    int result = TEST_PASSED;
+
+    for (offset = 0;
+         offset + piece_size <= num_pixels;
+         offset += piece_size/3 + 17) {
+        icetSparseImageCopyPixels(plain_image, offset, piece_size, plain_out);
+        icetSparseImageCopyPixels(indexed_image, offset, piece_size,
+                                  indexed_out);
+        if (CompareSparse(plain_out, indexed_out,
+                          expected_full, actual_full) != TEST_PASSED) {
+            printf("*** Copy at offset %d failed.\n", (int)offset);
+            result = TEST_FAILED;
+        }
+    }
+
+    return result;
+}
+
+/* Splits the input images and checks the partitions and copies from each
+   partition. */
+static int CheckSplit(const IceTSparseImage plain_image,
+                      const IceTSparseImage indexed_image,
+                      IceTSparseImage *plain_partitions,
+                      IceTSparseImage *indexed_partitions,
+                      IceTSparseImage plain_out,
+                      IceTSparseImage indexed_out,
+                      IceTImage expected_full,
+                      IceTImage actual_full)
+{
+    IceTSizeType offsets[NUM_PARTITIONS];
+    int partition;
+    int result = TEST_PASSED;
+
+    icetSparseImageSplit(plain_image, 0, NUM_PARTITIONS, NUM_PARTITIONS,
+                         plain_partitions, offsets);
+    icetSparseImageSplit(indexed_image, 0, NUM_PARTITIONS, NUM_PARTITIONS,
+                         indexed_partitions, offsets);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        if (CompareSparse(plain_partitions[partition],
+                          indexed_partitions[partition],
+                          expected_full,
+                          actual_full) != TEST_PASSED) {
+            printf("*** Partition %d failed.\n", partition);
+            result = TEST_FAILED;
+        }
+        if (CheckCopies(plain_partitions[partition],
+                        indexed_partitions[partition],
+                        plain_out,
+                        indexed_out,
+                        expected_full,
+                        actual_full) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    return result;
+}
+
+static int CheckAll(const IceTSparseImage plain_image,
+                    const IceTSparseImage indexed_image,
+                    IceTSparseImage *plain_partitions,
+                    IceTSparseImage *indexed_partitions,
+                    IceTSparseImage plain_scratch,
+                    IceTSparseImage indexed_scratch,
+                    IceTImage expected_full,
+                    IceTImage actual_full)
+{
+    int result = TEST_PASSED;
+
+    if (CompareSparse(plain_image, indexed_image,
+                      expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("  Checking copy.\n");
+    if (CheckCopies(plain_image, indexed_image,
+                    plain_scratch, indexed_scratch,
+                    expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("  Checking split.\n");
+    if (CheckSplit(plain_image, indexed_image,
+                   plain_partitions, indexed_partitions,
+                   plain_scratch, indexed_scratch,
+                   expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("  Checking interlace.\n");
+    icetSparseImageInterlace(plain_image, NUM_PARTITIONS,
+                             ICET_SI_STRATEGY_BUFFER_0, plain_scratch);
+    icetSparseImageInterlace(indexed_image, NUM_PARTITIONS,
+                             ICET_SI_STRATEGY_BUFFER_0, indexed_scratch);
+    if (CompareSparse(plain_scratch, indexed_scratch,
+                      expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+    if (CheckCopies(plain_scratch, indexed_scratch,
+                    plain_partitions[0], indexed_partitions[0],
+                    expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("  Checking split in place.\n");
+    {
+        IceTSparseImage plain_in_place[NUM_PARTITIONS];
+        IceTSparseImage indexed_in_place[NUM_PARTITIONS];
+        int partition;
+
+        icetSparseImageCopyPixels(plain_image,
+                                  0,
+                                  icetSparseImageGetNumPixels(plain_image),
+                                  plain_scratch);
+        icetSparseImageCopyPixels(indexed_image,
+                                  0,
+                                  icetSparseImageGetNumPixels(indexed_image),
+                                  indexed_scratch);
+        plain_in_place[0] = plain_scratch;
+        indexed_in_place[0] = indexed_scratch;
+        for (partition = 1; partition < NUM_PARTITIONS; partition++) {
+            plain_in_place[partition] = plain_partitions[partition];
+            indexed_in_place[partition] = indexed_partitions[partition];
+        }
+        if (CheckSplit(plain_scratch, indexed_scratch,
+                       plain_in_place, indexed_in_place,
+                       plain_partitions[0], indexed_partitions[0],
+                       expected_full, actual_full) != TEST_PASSED) {
+            result = TEST_FAILED;
+        }
+    }
+
+    return result;
+}
+
+static void TimeOperations(const char *label,
+                           const IceTSparseImage image,
+                           IceTSparseImage *partitions,
+                           IceTSparseImage scratch)
+{
+    IceTSizeType num_pixels = icetSparseImageGetNumPixels(image);
+    IceTSparseImage in_place[NUM_PARTITIONS];
+    IceTSizeType offsets[NUM_PARTITIONS];
+    IceTDouble start;
+    IceTDouble copy_time;
+    IceTDouble split_time;
+    IceTDouble interlace_time;
+    int trial;
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetSparseImageCopyPixels(image,
+                                  num_pixels - num_pixels/NUM_PARTITIONS,
+                                  num_pixels/NUM_PARTITIONS,
+                                  scratch);
+    }
+    copy_time = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+
+    memcpy(in_place, partitions, NUM_PARTITIONS*sizeof(IceTSparseImage));
+    in_place[0] = scratch;
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetSparseImageCopyPixels(image, 0, num_pixels, scratch);
+        icetSparseImageSplit(scratch, 0, NUM_PARTITIONS, NUM_PARTITIONS,
+                             in_place, offsets);
+    }
+    split_time = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+
+    start = icetWallTime();
+    for (trial = 0; trial < NUM_TIMING_TRIALS; trial++) {
+        icetSparseImageInterlace(image, NUM_PARTITIONS,
+                                 ICET_SI_STRATEGY_BUFFER_0, scratch);
+    }
+    interlace_time = (icetWallTime() - start)/NUM_TIMING_TRIALS;
+
+    printf("  %s: copy last partition %.3f ms,"
+           " copy and split in place %.3f ms, interlace %.3f ms\n",
+           label, 1000.0*copy_time, 1000.0*split_time,
+           1000.0*interlace_time);
+}
+
+static int DoIndexTest(IceTBoolean compact, IceTBoolean planar)
+{
+    IceTVoid *buffers[11 + 2*NUM_PARTITIONS];
+    int num_buffers = 0;
+    IceTImage image;
+    IceTImage expected_full;
+    IceTImage actual_full;
+    IceTSparseImage plain_front, plain_back, plain_result, plain_scratch;
+    IceTSparseImage indexed_front, indexed_back, indexed_result;
+    IceTSparseImage indexed_scratch;
+    IceTSparseImage plain_partitions[NUM_PARTITIONS];
+    IceTSparseImage indexed_partitions[NUM_PARTITIONS];
+    IceTSizeType partition_pixels;
+    TestImagePattern pattern;
+    int layout = 0;
+    int partition;
+    int result = TEST_PASSED;
+
+    printf("Using %s run lengths and %s layout\n",
+           compact ? "compact" : "standard",
+           planar ? "planar" : "interleaved");
+
+    if (compact) layout |= TEST_SPARSE_COMPACT;
+    if (planar) layout |= TEST_SPARSE_PLANAR;
+
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    image = icetImageAssignBuffer(buffers[num_buffers++],
+                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    expected_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                          SCREEN_WIDTH, SCREEN_HEIGHT);
+    buffers[num_buffers]
+        = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    actual_full = icetImageAssignBuffer(buffers[num_buffers++],
+                                        SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    plain_front = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                          &buffers[num_buffers++]);
+    plain_back = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                         &buffers[num_buffers++]);
+    plain_result = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    plain_scratch = new_layout_sparse_image(layout, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+    indexed_front = new_layout_sparse_image(layout | TEST_SPARSE_INDEXED,
+                                            SCREEN_WIDTH, SCREEN_HEIGHT,
+                                            &buffers[num_buffers++]);
+    indexed_back = new_layout_sparse_image(layout | TEST_SPARSE_INDEXED,
+                                           SCREEN_WIDTH, SCREEN_HEIGHT,
+                                           &buffers[num_buffers++]);
+    indexed_result = new_layout_sparse_image(layout | TEST_SPARSE_INDEXED,
+                                             SCREEN_WIDTH, SCREEN_HEIGHT,
+                                             &buffers[num_buffers++]);
+    indexed_scratch = new_layout_sparse_image(layout | TEST_SPARSE_INDEXED,
+                                              SCREEN_WIDTH, SCREEN_HEIGHT,
+                                              &buffers[num_buffers++]);
+
+    partition_pixels
+        = icetSparseImageSplitPartitionNumPixels(SCREEN_WIDTH*SCREEN_HEIGHT,
+                                                 NUM_PARTITIONS,
+                                                 NUM_PARTITIONS);
+    for (partition = 0; partition < NUM_PARTITIONS; partition++) {
+        plain_partitions[partition]
+            = new_layout_sparse_image(layout, partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+        indexed_partitions[partition]
+            = new_layout_sparse_image(layout | TEST_SPARSE_INDEXED,
+                                      partition_pixels, 1,
+                                      &buffers[num_buffers++]);
+    }
+
+    /* Compress with several threads so that the index is built by joining
+       the bands. */
+    icetStateSetInteger(ICET_NUM_THREADS, 4);
+    /* Many short runs of active and inactive pixels and a few long runs. */
+    init_test_image_pattern(&pattern);
+    pattern.max_run = 20;
+    pattern.long_run = 40000;
+    init_test_image(image, 12345, &pattern);
+    icetCompressImage(image, plain_front);
+    icetCompressImage(image, indexed_front);
+    init_test_image(image, 54321, &pattern);
+    icetCompressImage(image, plain_back);
+    icetCompressImage(image, indexed_back);
+    icetStateSetInteger(ICET_NUM_THREADS, 1);
+
+    printf("Checking compressed image.\n");
+    if (CheckAll(plain_front, indexed_front,
+                 plain_partitions, indexed_partitions,
+                 plain_scratch, indexed_scratch,
+                 expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking composited image.\n");
+    icetCompressedCompressedComposite(plain_front, plain_back, plain_result);
+    icetCompressedCompressedComposite(indexed_front, indexed_back,
+                                      indexed_result);
+    if (CheckAll(plain_result, indexed_result,
+                 plain_partitions, indexed_partitions,
+                 plain_scratch, indexed_scratch,
+                 expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Checking image compressed with one thread.\n");
+    icetCompressImage(image, plain_back);
+    icetCompressImage(image, indexed_back);
+    if (CheckAll(plain_back, indexed_back,
+                 plain_partitions, indexed_partitions,
+                 plain_scratch, indexed_scratch,
+                 expected_full, actual_full) != TEST_PASSED) {
+        result = TEST_FAILED;
+    }
+
+    printf("Timing.\n");
+    TimeOperations("No index", plain_result, plain_partitions, plain_scratch);
+    TimeOperations("Index", indexed_result, indexed_partitions,
+                   indexed_scratch);
+
+    while (num_buffers > 0) {
+        free(buffers[--num_buffers]);
+    }
+    return result;
+}
+
+static int SparseImageIndexRun()
+{
+    int compact;
+    int planar;
+    int result = TEST_PASSED;
+
+    icetStrategy(ICET_STRATEGY_REDUCE);
+    icetCompositeMode(ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(ICET_IMAGE_COLOR_RGBA_UBYTE);
+    icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+
+    for (compact = 0; compact < 2; compact++) {
+        for (planar = 0; planar < 2; planar++) {
+            if (DoIndexTest((IceTBoolean)compact, (IceTBoolean)planar)
+                != TEST_PASSED) {
+                result = TEST_FAILED;
+            }
+            printf("\n\n");
+        }
+    }
+
+    icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+    icetDisable(ICET_INDEX_SPARSE_IMAGES);
+
+    return result;
+}
+
+int SparseImageIndex(int argc, char *argv[])
+{
+    /* To remove warning */
+    (void)argc;
+    (void)argv;
+
+    return run_test(SparseImageIndexRun);
+}
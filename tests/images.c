@@ -0,0 +1,220 @@
+/* -*- c -*- *******************************************************/
+/*
+ * Copyright (C) 2003 Sandia Corporation
+ * Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+ * the U.S. Government retains certain rights in this software.
+ *
+ * This source code is released under the New BSD License.
+ */
+
+#include "test-util.h"
+#include "test_codes.h"
+
+#include <IceTDevImage.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+IceTImage new_test_image(IceTEnum color_format,
+                         IceTEnum depth_format,
+                         IceTVoid **buffer)
+{
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+    *buffer = malloc(icetImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    return icetImageAssignBuffer(*buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+IceTSparseImage new_test_sparse_image(IceTEnum color_format,
+                                      IceTEnum depth_format,
+                                      IceTVoid **buffer)
+{
+    icetSetColorFormat(color_format);
+    icetSetDepthFormat(depth_format);
+    *buffer = malloc(icetSparseImageBufferSize(SCREEN_WIDTH, SCREEN_HEIGHT));
+    return icetSparseImageAssignBuffer(*buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+IceTSparseImage new_layout_sparse_image(int layout,
+                                        IceTSizeType width,
+                                        IceTSizeType height,
+                                        IceTVoid **buffer)
+{
+    if (layout & TEST_SPARSE_PLANAR) {
+        icetEnable(ICET_PLANAR_SPARSE_IMAGES);
+    } else {
+        icetDisable(ICET_PLANAR_SPARSE_IMAGES);
+    }
+    if (layout & TEST_SPARSE_COMPACT) {
+        icetEnable(ICET_COMPACT_RUN_LENGTHS);
+    } else {
+        icetDisable(ICET_COMPACT_RUN_LENGTHS);
+    }
+    if (layout & TEST_SPARSE_INDEXED) {
+        icetEnable(ICET_INDEX_SPARSE_IMAGES);
+    } else {
+        icetDisable(ICET_INDEX_SPARSE_IMAGES);
+    }
+    *buffer = malloc(icetSparseImageBufferSize(width, height));
+    return icetSparseImageAssignBuffer(*buffer, width, height);
+}
+
+void init_test_image_pattern(TestImagePattern *pattern)
+{
+    pattern->max_run = 300;
+    pattern->long_run = 0;
+    pattern->start_active = ICET_FALSE;
+    pattern->channel_levels = 256;
+    pattern->depth_levels = 0;
+    pattern->mask = NULL;
+}
+
+IceTSizeType init_test_image(IceTImage image,
+                             unsigned int seed,
+                             const TestImagePattern *pattern)
+{
+    IceTEnum color_format = icetImageGetColorFormat(image);
+    IceTEnum depth_format = icetImageGetDepthFormat(image);
+    IceTSizeType num_pixels = icetImageGetNumPixels(image);
+    int levels = pattern->channel_levels;
+    IceTSizeType num_active = 0;
+    IceTSizeType pixel = 0;
+    IceTBoolean active = pattern->start_active;
+
+    srand(seed);
+
+    while (pixel < num_pixels) {
+        IceTSizeType end;
+
+        if ((pattern->long_run > 0) && (rand()%32 == 0)) {
+            end = pixel + pattern->long_run + rand()%pattern->long_run;
+        } else {
+            end = pixel + rand()%pattern->max_run + 1;
+        }
+        if (end > num_pixels) end = num_pixels;
+
+        for ( ; pixel < end; pixel++) {
+            IceTBoolean on
+                = active && ((pattern->mask == NULL) || pattern->mask[pixel]);
+            int channels[4];
+            IceTUShort depth;
+            int i;
+
+          /* Channels are premultiplied multiples of 1/levels so that every
+             color format holds them exactly. */
+            channels[3] = on ? rand()%levels + 1 : 0;
+            channels[0] = rand()%(channels[3] + 1);
+            channels[1] = rand()%(channels[3] + 1);
+            channels[2] = rand()%(channels[3] + 1);
+            if (!on) {
+                depth = 0xFFFF;
+            } else if (pattern->depth_levels > 0) {
+                depth = (IceTUShort)(  (rand()%pattern->depth_levels)
+                                     * (0x10000/pattern->depth_levels) );
+            } else {
+                depth = (IceTUShort)(rand()%0xFFFF);
+            }
+
+            for (i = 0; i < 4; i++) {
+                IceTFloat value = (IceTFloat)channels[i]/levels;
+                switch (color_format) {
+                  case ICET_IMAGE_COLOR_RGBA_UBYTE:
+                      icetImageGetColorub(image)[4*pixel + i]
+                          = (IceTUByte)((channels[i]*255 + levels/2)/levels);
+                      break;
+                  case ICET_IMAGE_COLOR_RGBA_FLOAT:
+                      icetImageGetColorf(image)[4*pixel + i] = value;
+                      break;
+                  case ICET_IMAGE_COLOR_RGBA_HALF:
+                      icetImageGetColorus(image)[4*pixel + i]
+                          = icetFloatToHalf(value);
+                      break;
+                }
+            }
+
+            if (depth_format == ICET_IMAGE_DEPTH_UNORM16) {
+                icetImageGetDepthus(image)[pixel] = depth;
+            } else if (depth_format == ICET_IMAGE_DEPTH_FLOAT) {
+                icetImageGetDepthf(image)[pixel] = (IceTFloat)depth/65535.0f;
+            }
+
+            if (on) num_active++;
+        }
+
+        active = !active;
+    }
+
+    return num_active;
+}
+
+IceTSizeType init_runs_image(IceTImage image, unsigned int seed)
+{
+    TestImagePattern pattern;
+    init_test_image_pattern(&pattern);
+    return init_test_image(image, seed, &pattern);
+}
+
+int compare_test_images(const IceTImage image0,
+                        const IceTImage image1,
+                        IceTFloat color_tolerance,
+                        const char *operation)
+{
+    IceTSizeType num_pixels = icetImageGetNumPixels(image0);
+    IceTFloat *values0;
+    IceTFloat *values1;
+    IceTSizeType i;
+    int result = TEST_PASSED;
+
+    values0 = malloc(4*num_pixels*sizeof(IceTFloat));
+    values1 = malloc(4*num_pixels*sizeof(IceTFloat));
+
+    if (icetImageGetColorFormat(image0) != ICET_IMAGE_COLOR_NONE) {
+        icetImageCopyColorf(image0, values0, ICET_IMAGE_COLOR_RGBA_FLOAT);
+        icetImageCopyColorf(image1, values1, ICET_IMAGE_COLOR_RGBA_FLOAT);
+        for (i = 0; i < 4*num_pixels; i++) {
+            IceTFloat diff = values0[i] - values1[i];
+            if ((diff > color_tolerance) || (diff < -color_tolerance)) {
+                printf("*** %s: color %f should be %f (pixel %d).\n",
+                       operation, values0[i], values1[i], (int)(i/4));
+                result = TEST_FAILED;
+                break;
+            }
+        }
+    }
+
+    if (icetImageGetDepthFormat(image0) != ICET_IMAGE_DEPTH_NONE) {
+        icetImageCopyDepthf(image0, values0, ICET_IMAGE_DEPTH_FLOAT);
+        icetImageCopyDepthf(image1, values1, ICET_IMAGE_DEPTH_FLOAT);
+        for (i = 0; i < num_pixels; i++) {
+            if (values0[i] != values1[i]) {
+                printf("*** %s: depth %f should be %f (pixel %d).\n",
+                       operation, values0[i], values1[i], (int)i);
+                result = TEST_FAILED;
+                break;
+            }
+        }
+    }
+
+    free(values0);
+    free(values1);
+
+    return result;
+}
+
+int compare_sparse_images(const IceTSparseImage expected,
+                          const IceTSparseImage actual,
+                          IceTImage expected_full,
+                          IceTImage actual_full,
+                          const char *operation)
+{
+    if (   icetSparseImageGetNumPixels(expected)
+        != icetSparseImageGetNumPixels(actual) ) {
+        printf("*** %s: images have different numbers of pixels.\n",
+               operation);
+        return TEST_FAILED;
+    }
+
+    icetDecompressImage(expected, expected_full);
+    icetDecompressImage(actual, actual_full);
+    return compare_test_images(expected_full, actual_full, 0.0f, operation);
+}
@@ -20,6 +20,7 @@ extern "C" {
 #endif
 
 #include <IceT.h>
+#include <IceTDevImage.h>
 
 extern IceTEnum strategy_list[];
 extern int STRATEGY_LIST_SIZE;
@@ -46,6 +47,69 @@ void write_ppm(const char *filename,
 
 IceTBoolean strategy_uses_single_image_strategy(IceTEnum strategy);
 
+/* Allocate an image of SCREEN_WIDTH x SCREEN_HEIGHT with the given formats,
+   which also become the current formats.  Free buffer when done. */
+IceTImage new_test_image(IceTEnum color_format,
+                         IceTEnum depth_format,
+                         IceTVoid **buffer);
+IceTSparseImage new_test_sparse_image(IceTEnum color_format,
+                                      IceTEnum depth_format,
+                                      IceTVoid **buffer);
+
+/* Layout options for new_layout_sparse_image. */
+#define TEST_SPARSE_PLANAR      0x1
+#define TEST_SPARSE_COMPACT     0x2
+#define TEST_SPARSE_INDEXED     0x4
+
+/* Allocate a sparse image of the given size in the current formats after
+   enabling exactly the layout options given.  Free buffer when done. */
+IceTSparseImage new_layout_sparse_image(int layout,
+                                        IceTSizeType width,
+                                        IceTSizeType height,
+                                        IceTVoid **buffer);
+
+/* How init_test_image lays out the pixels it writes. */
+typedef struct TestImagePatternStruct {
+    /* Runs of active and inactive pixels are 1 to max_run pixels long. */
+    IceTSizeType max_run;
+    /* If not 0, one run in 32 is long_run to 2*long_run pixels long. */
+    IceTSizeType long_run;
+    /* Whether the first run is active. */
+    IceTBoolean start_active;
+    /* Channels are premultiplied multiples of 1/channel_levels. */
+    int channel_levels;
+    /* If not 0, depths take only this many values so that images tie. */
+    int depth_levels;
+    /* If not NULL, only pixels with a true entry can be active. */
+    const IceTBoolean *mask;
+} TestImagePattern;
+
+/* Sets the pattern used by init_runs_image, which the caller may change. */
+void init_test_image_pattern(TestImagePattern *pattern);
+
+/* Fills the image with alternating runs of active and inactive pixels.  The
+   same seed gives the same pixels in any color or depth format.  Returns the
+   number of active pixels. */
+IceTSizeType init_test_image(IceTImage image,
+                             unsigned int seed,
+                             const TestImagePattern *pattern);
+IceTSizeType init_runs_image(IceTImage image, unsigned int seed);
+
+/* Checks that two images of the same size hold the same pixels.  Colors may
+   differ by color_tolerance, depths must match exactly. */
+int compare_test_images(const IceTImage image0,
+                        const IceTImage image1,
+                        IceTFloat color_tolerance,
+                        const char *operation);
+
+/* Checks that two sparse images hold the same pixels by decompressing them
+   into the given full images, which must be large enough to hold them. */
+int compare_sparse_images(const IceTSparseImage expected,
+                          const IceTSparseImage actual,
+                          IceTImage expected_full,
+                          IceTImage actual_full,
+                          const char *operation);
+
 #ifdef __cplusplus
 }
 #endif